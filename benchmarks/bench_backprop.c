@@ -0,0 +1,146 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "benchmark.h"
+
+#define BENCH_INPUTS         256
+#define BENCH_HIDDENS        128
+#define BENCH_HIDDEN_LAYERS  2
+#define BENCH_OUTPUTS        10
+
+typedef struct {
+    bp net;
+    ac autocoder;
+    FILE * fp;
+} bench_backprop_context;
+
+/**
+ * @brief Returns the number of weights in a network
+ */
+static double bench_weights(bp * net)
+{
+    double weights = 0;
+
+    COUNTUP(l, net->hidden_layers+1)
+        weights += (double)net->layers[l].no_of_units*
+            net->layers[l].no_of_inputs;
+    return weights;
+}
+
+static void bench_feed_forward(void * context)
+{
+    bp_feed_forward(&((bench_backprop_context*)context)->net, 0);
+}
+
+static void bench_backprop(void * context)
+{
+    bp_backprop(&((bench_backprop_context*)context)->net, 0);
+}
+
+static void bench_learn(void * context)
+{
+    bp_learn(&((bench_backprop_context*)context)->net, 0);
+}
+
+static void bench_update(void * context)
+{
+    bp_update(&((bench_backprop_context*)context)->net, 0);
+}
+
+static void bench_autocoder_update(void * context)
+{
+    autocoder_update(&((bench_backprop_context*)context)->autocoder);
+}
+
+static void bench_save(void * context)
+{
+    bench_backprop_context * c = (bench_backprop_context*)context;
+
+    rewind(c->fp);
+    assert(bp_save(c->fp, &c->net) == 0);
+    fflush(c->fp);
+}
+
+static void bench_load(void * context)
+{
+    bench_backprop_context * c = (bench_backprop_context*)context;
+    bp loaded;
+
+    rewind(c->fp);
+    assert(bp_load(c->fp, &loaded) == 0);
+    bp_free(&loaded);
+}
+
+void run_benchmarks_backprop(void)
+{
+    bench_backprop_context c;
+    unsigned int random_seed = 6372;
+    double weights;
+    char params[256];
+
+    assert(bp_init(&c.net, BENCH_INPUTS, BENCH_HIDDENS,
+                   BENCH_HIDDEN_LAYERS, BENCH_OUTPUTS,
+                   &random_seed) == 0);
+    COUNTUP(i, BENCH_INPUTS)
+        bp_set_input(&c.net, i,
+                     NEURON_LOW + (i % 10)*NEURON_RANGE/10.0f);
+    COUNTUP(i, BENCH_OUTPUTS)
+        bp_set_output(&c.net, i, (i == 3) ? NEURON_HIGH : NEURON_LOW);
+    bp_feed_forward(&c.net, 0);
+
+    weights = bench_weights(&c.net);
+    sprintf(params, "inputs=%d hiddens=%d layers=%d outputs=%d",
+            BENCH_INPUTS, BENCH_HIDDENS, BENCH_HIDDEN_LAYERS,
+            BENCH_OUTPUTS);
+
+    bench_run("bp_feed_forward", params, bench_feed_forward, &c,
+              2*weights);
+    bench_run("bp_backprop", params, bench_backprop, &c, 2*weights);
+    bench_run("bp_learn", params, bench_learn, &c, 2*weights);
+    bench_run("bp_update", params, bench_update, &c, 6*weights);
+
+    c.fp = tmpfile();
+    assert(c.fp);
+    bench_run("bp_save", params, bench_save, &c, 0);
+    bench_save(&c);
+    bench_run("bp_load", params, bench_load, &c, 0);
+    fclose(c.fp);
+    bp_free(&c.net);
+
+    assert(autocoder_init(&c.autocoder, BENCH_INPUTS, BENCH_HIDDENS,
+                          random_seed) == 0);
+    COUNTUP(i, BENCH_INPUTS)
+        autocoder_set_input(&c.autocoder, i, (i % 10)/10.0f);
+    sprintf(params, "inputs=%d hiddens=%d", BENCH_INPUTS, BENCH_HIDDENS);
+
+    /* encode, decode, then backpropagate and learn through the weights */
+    bench_run("autocoder_update", params, bench_autocoder_update, &c,
+              8.0*BENCH_INPUTS*BENCH_HIDDENS);
+    autocoder_free(&c.autocoder);
+}
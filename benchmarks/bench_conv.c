@@ -0,0 +1,105 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "benchmark.h"
+
+#define BENCH_IMAGE_WIDTH    64
+#define BENCH_IMAGE_DEPTH    3
+#define BENCH_FEATURE_WIDTH  5
+#define BENCH_FEATURES       16
+#define BENCH_LAYER_WIDTH    32
+#define BENCH_SAMPLES        100
+
+typedef struct {
+    float * img;
+    float * feature;
+    float * feature_score;
+    float * layer;
+    unsigned int random_seed;
+} bench_conv_context;
+
+static void bench_convolve_image(void * context)
+{
+    bench_conv_context * c = (bench_conv_context*)context;
+
+    convolve_image(c->img, BENCH_IMAGE_WIDTH, BENCH_IMAGE_WIDTH,
+                   BENCH_IMAGE_DEPTH, BENCH_FEATURE_WIDTH, BENCH_FEATURES,
+                   1, c->feature, c->layer, BENCH_LAYER_WIDTH, AF_SIGMOID);
+}
+
+static void bench_learn_features(void * context)
+{
+    bench_conv_context * c = (bench_conv_context*)context;
+
+    learn_features(c->img, BENCH_IMAGE_WIDTH, BENCH_IMAGE_WIDTH,
+                   BENCH_IMAGE_DEPTH, BENCH_FEATURE_WIDTH, BENCH_FEATURES,
+                   c->feature, c->feature_score, BENCH_SAMPLES, 0.1f,
+                   &c->random_seed);
+}
+
+void run_benchmarks_conv(void)
+{
+    bench_conv_context c;
+    int img_size = BENCH_IMAGE_WIDTH*BENCH_IMAGE_WIDTH*BENCH_IMAGE_DEPTH;
+    int feature_size =
+        BENCH_FEATURE_WIDTH*BENCH_FEATURE_WIDTH*BENCH_IMAGE_DEPTH;
+    double patch = (double)BENCH_FEATURES*feature_size;
+    char params[256];
+
+    c.random_seed = 2958;
+    FLOATALLOC(c.img, img_size);
+    FLOATALLOC(c.feature, BENCH_FEATURES*feature_size);
+    FLOATALLOC(c.feature_score, BENCH_FEATURES);
+    FLOATALLOC(c.layer, BENCH_LAYER_WIDTH*BENCH_LAYER_WIDTH*
+               BENCH_FEATURES*BENCH_IMAGE_DEPTH);
+    assert(c.img && c.feature && c.feature_score && c.layer);
+
+    COUNTUP(i, img_size)
+        c.img[i] = (rand_num(&c.random_seed)%10000)/10000.0f;
+    COUNTUP(i, BENCH_FEATURES*feature_size)
+        c.feature[i] = (rand_num(&c.random_seed)%10000)/10000.0f;
+
+    sprintf(params, "image=%dx%dx%d feature=%d features=%d layer=%d",
+            BENCH_IMAGE_WIDTH, BENCH_IMAGE_WIDTH, BENCH_IMAGE_DEPTH,
+            BENCH_FEATURE_WIDTH, BENCH_FEATURES, BENCH_LAYER_WIDTH);
+    bench_run("convolve_image", params, bench_convolve_image, &c,
+              2*patch*BENCH_LAYER_WIDTH*BENCH_LAYER_WIDTH);
+
+    /* a subtract, multiply and add for each value of each patch */
+    sprintf(params, "image=%dx%dx%d feature=%d features=%d samples=%d",
+            BENCH_IMAGE_WIDTH, BENCH_IMAGE_WIDTH, BENCH_IMAGE_DEPTH,
+            BENCH_FEATURE_WIDTH, BENCH_FEATURES, BENCH_SAMPLES);
+    bench_run("learn_features", params, bench_learn_features, &c,
+              3*patch*BENCH_SAMPLES);
+
+    free(c.img);
+    free(c.feature);
+    free(c.feature_score);
+    free(c.layer);
+}
@@ -0,0 +1,110 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "benchmark.h"
+
+#define BENCH_CSV_ROWS       2000
+#define BENCH_CSV_FIELDS     16
+#define BENCH_DATA_HIDDENS   32
+#define BENCH_DATA_LAYERS    2
+
+typedef struct {
+    char filename[256];
+    deeplearn learner;
+    unsigned int random_seed;
+} bench_data_context;
+
+static float bench_error_threshold[] = { 0.5f, 0.5f, 0.5f };
+static int bench_output_field_index[] = { BENCH_CSV_FIELDS-1 };
+
+static void bench_read_csv(void * context)
+{
+    bench_data_context * c = (bench_data_context*)context;
+    deeplearn learner;
+    unsigned int random_seed = c->random_seed;
+
+    assert(deeplearndata_read_csv(c->filename, &learner,
+                                  BENCH_DATA_HIDDENS, BENCH_DATA_LAYERS,
+                                  1, bench_output_field_index, 0,
+                                  bench_error_threshold,
+                                  &random_seed) > 0);
+    deeplearn_free(&learner);
+}
+
+static void bench_training(void * context)
+{
+    bench_data_context * c = (bench_data_context*)context;
+
+    deeplearndata_training(&c->learner);
+}
+
+void run_benchmarks_data(void)
+{
+    bench_data_context c;
+    char params[256];
+    FILE * fp;
+
+    c.random_seed = 8112;
+    sprintf(c.filename, "%slibdeep_bench.csv", DEEPLEARN_TEMP_DIRECTORY);
+    fp = fopen(c.filename, "w");
+    assert(fp);
+    COUNTUP(r, BENCH_CSV_ROWS) {
+        float sum = 0;
+
+        COUNTUP(f, BENCH_CSV_FIELDS-1) {
+            float value = (rand_num(&c.random_seed)%10000)/100.0f;
+
+            sum += value;
+            fprintf(fp, "%.2f,", value);
+        }
+        fprintf(fp, "%.2f\n", sum/(BENCH_CSV_FIELDS-1));
+    }
+    fclose(fp);
+
+    sprintf(params, "rows=%d fields=%d", BENCH_CSV_ROWS, BENCH_CSV_FIELDS);
+    bench_run("deeplearndata_read_csv", params, bench_read_csv, &c, 0);
+
+    /* training steps per second are 1e9/ns_per_op */
+    if (bench_enabled("deeplearndata_training")) {
+        assert(deeplearndata_read_csv(c.filename, &c.learner,
+                                      BENCH_DATA_HIDDENS,
+                                      BENCH_DATA_LAYERS,
+                                      1, bench_output_field_index, 0,
+                                      bench_error_threshold,
+                                      &c.random_seed) > 0);
+        deeplearn_set_plotting(&c.learner, DEEPLEARN_PLOT_NONE);
+        sprintf(params, "rows=%d fields=%d hiddens=%d layers=%d",
+                BENCH_CSV_ROWS, BENCH_CSV_FIELDS, BENCH_DATA_HIDDENS,
+                BENCH_DATA_LAYERS);
+        bench_run("deeplearndata_training", params, bench_training, &c, 0);
+        deeplearn_free(&c.learner);
+    }
+
+    remove(c.filename);
+}
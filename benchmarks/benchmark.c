@@ -0,0 +1,182 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* clock_gettime is not part of c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include "benchmark.h"
+#include <time.h>
+
+/* Allocations made by the library are counted by linking with
+   -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, so that calls to
+   these functions come here first */
+static unsigned long long bench_bytes_allocated = 0;
+static unsigned long long bench_allocations = 0;
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t n, size_t size);
+void * __real_realloc(void * ptr, size_t size);
+
+void * __wrap_malloc(size_t size)
+{
+#pragma omp atomic
+    bench_bytes_allocated += size;
+#pragma omp atomic
+    bench_allocations++;
+    return __real_malloc(size);
+}
+
+void * __wrap_calloc(size_t n, size_t size)
+{
+#pragma omp atomic
+    bench_bytes_allocated += n*size;
+#pragma omp atomic
+    bench_allocations++;
+    return __real_calloc(n, size);
+}
+
+void * __wrap_realloc(void * ptr, size_t size)
+{
+#pragma omp atomic
+    bench_bytes_allocated += size;
+#pragma omp atomic
+    bench_allocations++;
+    return __real_realloc(ptr, size);
+}
+
+static char * bench_filter = NULL;
+
+/**
+ * @brief Only runs benchmarks whose names contain the given text
+ * @param filter Text to look for, or NULL to run every benchmark
+ */
+void bench_set_filter(char * filter)
+{
+    bench_filter = filter;
+}
+
+/**
+ * @brief Returns non-zero if the named benchmark should be run
+ * @param name Name of the benchmark
+ */
+int bench_enabled(char * name)
+{
+    return (bench_filter == NULL) || (strstr(name, bench_filter) != NULL);
+}
+
+/**
+ * @brief Returns the time from a monotonic clock
+ * @returns Time in seconds
+ */
+static double bench_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec*1.0e-9;
+}
+
+/**
+ * @brief Returns the time taken to run an operation a number of times
+ * @returns Time in seconds
+ */
+static double bench_iterations(bench_function fn, void * context,
+                               unsigned long iterations)
+{
+    double start = bench_time();
+
+    for (unsigned long i = 0; i < iterations; i++)
+        fn(context);
+    return bench_time() - start;
+}
+
+static int bench_compare(const void * a, const void * b)
+{
+    double da = *(const double*)a, db = *(const double*)b;
+
+    return (da > db) - (da < db);
+}
+
+/**
+ * @brief Measures an operation and prints the result as a line of json
+ * @param name Name of the benchmark
+ * @param params Description of the sizes which are used
+ * @param fn The operation
+ * @param context Data passed to the operation
+ * @param flops_per_op Nominal floating point operations for each call,
+ *        counting a multiply-add as two, or zero if not meaningful
+ */
+void bench_run(char * name, char * params, bench_function fn,
+               void * context, double flops_per_op)
+{
+    double ns[BENCH_REPEATS], median;
+    unsigned long iterations = 1;
+    unsigned long long bytes, allocations;
+
+    if (!bench_enabled(name))
+        return;
+
+    /* the first call warms the caches and any lazily allocated buffers */
+    fn(context);
+
+    /* find how many calls take the minimum time */
+    for (;;) {
+        double elapsed = bench_iterations(fn, context, iterations);
+
+        if (elapsed >= BENCH_MIN_TIME)
+            break;
+        if (elapsed < BENCH_MIN_TIME/100)
+            iterations *= 10;
+        else
+            iterations = (unsigned long)
+                (iterations*BENCH_MIN_TIME*1.2/elapsed) + 1;
+    }
+
+    bytes = bench_bytes_allocated;
+    allocations = bench_allocations;
+    COUNTUP(r, BENCH_REPEATS)
+        ns[r] = bench_iterations(fn, context, iterations)*1.0e9/iterations;
+    bytes = bench_bytes_allocated - bytes;
+    allocations = bench_allocations - allocations;
+
+    qsort(ns, BENCH_REPEATS, sizeof(double), bench_compare);
+    median = ns[BENCH_REPEATS/2];
+
+    printf("{\"benchmark\": \"%s\", \"params\": \"%s\", "
+           "\"iterations\": %lu, \"ns_per_op\": %.1f, ",
+           name, params, iterations, median);
+    if (flops_per_op > 0)
+        printf("\"gflops\": %.3f, ", flops_per_op/median);
+    else
+        printf("\"gflops\": null, ");
+    printf("\"bytes_per_op\": %.1f, \"allocs_per_op\": %.2f}\n",
+           (double)bytes/((double)iterations*BENCH_REPEATS),
+           (double)allocations/((double)iterations*BENCH_REPEATS));
+    fflush(stdout);
+}
@@ -75,7 +75,8 @@ static void facerec_training()
                                 output_classes,
                                 error_threshold,
                                 &random_seed,
-                                extra_synthetic_images) != 0) {
+                                extra_synthetic_images,
+                                "images.cache") != 0) {
         return;
     }
 
@@ -0,0 +1,363 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* fork and getrusage are not part of c99 */
+#define _XOPEN_SOURCE 600
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "regression.h"
+
+static char * regression_status_names[] = {
+    "converged", "not_converged", "skipped", "failed"
+};
+
+/**
+ * @brief Returns the time from a monotonic clock
+ * @returns Time in seconds
+ */
+double regression_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec*1.0e-9;
+}
+
+/**
+ * @brief Trains until the error thresholds of every layer are reached,
+ *        timing only the training steps
+ * @param learner Deep learner object with training data loaded
+ * @param result Returned number of steps, time, error and test set
+ *        performance
+ * @param max_steps The number of steps after which training is stopped
+ *        if it has not converged
+ */
+void regression_train(deeplearn * learner, regression_result * result,
+                      unsigned long max_steps)
+{
+    double start_time;
+    int retval = 0;
+
+    deeplearn_set_plotting(learner, DEEPLEARN_PLOT_NONE);
+
+    start_time = regression_time();
+    while (result->steps < max_steps) {
+        retval = deeplearndata_training(learner);
+        if (retval <= 0)
+            break;
+        result->steps++;
+    }
+    result->seconds = regression_time() - start_time;
+
+    if (retval < 0)
+        result->status = REGRESSION_FAILED;
+    else if (retval > 0)
+        result->status = REGRESSION_NOT_CONVERGED;
+
+    result->layer = learner->current_hidden_layer;
+    result->error = learner->backprop_error;
+    if (result->status != REGRESSION_FAILED)
+        result->performance = deeplearndata_get_performance(learner);
+}
+
+/**
+ * @brief Runs a workload within a child process, so that the peak
+ *        memory use of each workload is measured separately
+ * @param workload The workload to run
+ * @param threads The number of threads to train with
+ * @param result Returned result
+ */
+static void regression_run(regression_workload * workload, int threads,
+                           regression_result * result)
+{
+    int fd[2], status;
+    pid_t pid;
+
+    memset(result, 0, sizeof(regression_result));
+    strncpy(result->name, workload->name, REGRESSION_NAME_LENGTH-1);
+    result->status = REGRESSION_FAILED;
+
+    if (pipe(fd) != 0)
+        return;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+        close(fd[0]);
+        close(fd[1]);
+        return;
+    }
+
+    if (pid == 0) {
+        struct rusage usage;
+
+        close(fd[0]);
+        result->status = REGRESSION_CONVERGED;
+        deeplearn_set_threads(threads);
+        workload->run(result, workload->max_steps);
+        getrusage(RUSAGE_SELF, &usage);
+        result->peak_rss_kb = usage.ru_maxrss;
+        if (write(fd[1], result, sizeof(regression_result)) !=
+            sizeof(regression_result))
+            _exit(1);
+        _exit(0);
+    }
+
+    close(fd[1]);
+    if (read(fd[0], result, sizeof(regression_result)) !=
+        sizeof(regression_result))
+        result->status = REGRESSION_FAILED;
+    close(fd[0]);
+
+    /* the child may have crashed */
+    if ((waitpid(pid, &status, 0) != pid) || (!WIFEXITED(status)) ||
+        (WEXITSTATUS(status) != 0))
+        result->status = REGRESSION_FAILED;
+}
+
+/**
+ * @brief Reads the expected results
+ * @param filename Baseline filename
+ * @param baseline Returned results, one per workload
+ * @returns The number of results read, or -1 if the file was not found
+ */
+static int regression_read_baseline(char * filename,
+                                    regression_result * baseline)
+{
+    char line[256];
+    int no_of_results = 0;
+    FILE * fp = fopen(filename, "r");
+
+    if (!fp)
+        return -1;
+
+    while ((fgets(line, 256, fp) != NULL) &&
+           (no_of_results < regression_no_of_workloads)) {
+        regression_result * result = &baseline[no_of_results];
+
+        if ((line[0] == '#') || (line[0] == '\n'))
+            continue;
+
+        memset(result, 0, sizeof(regression_result));
+        if (sscanf(line, "%31s %d %lu %lf %d %f %f %ld", result->name,
+                   &result->status, &result->steps, &result->seconds,
+                   &result->layer, &result->error, &result->performance,
+                   &result->peak_rss_kb) == 8)
+            no_of_results++;
+    }
+
+    fclose(fp);
+    return no_of_results;
+}
+
+/**
+ * @brief Saves results as the new baseline
+ * @param filename Baseline filename
+ * @param results Results of each workload
+ * @param no_of_results The number of results
+ * @returns zero on success
+ */
+static int regression_write_baseline(char * filename,
+                                     regression_result * results,
+                                     int no_of_results)
+{
+    FILE * fp = fopen(filename, "w");
+
+    if (!fp)
+        return -1;
+
+    fprintf(fp, "# name status steps seconds layer error "
+            "performance peak_rss_kb\n");
+    COUNTUP(i, no_of_results)
+        fprintf(fp, "%s %d %lu %.3f %d %.4f %.2f %ld\n", results[i].name,
+                results[i].status, results[i].steps, results[i].seconds,
+                results[i].layer, results[i].error,
+                results[i].performance, results[i].peak_rss_kb);
+
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * @brief Compares a result against its baseline, reporting any regressions.
+ *        If the baseline did not converge either then the layer reached
+ *        and the training error after the same number of steps are
+ *        compared instead
+ * @param result Result of a workload
+ * @param expected Baseline result for the same workload
+ * @returns The number of regressions
+ */
+static int regression_compare(regression_result * result,
+                              regression_result * expected)
+{
+    int regressions = 0;
+
+    if ((expected->status == REGRESSION_SKIPPED) ||
+        (expected->status == REGRESSION_FAILED))
+        return 0;
+
+    if ((result->status != expected->status) &&
+        (result->status != REGRESSION_CONVERGED)) {
+        printf("REGRESSION %s: %s\n", result->name,
+               regression_status_names[result->status]);
+        return 1;
+    }
+
+    if (expected->status == REGRESSION_NOT_CONVERGED) {
+        if (result->layer < expected->layer) {
+            printf("REGRESSION %s: reached layer %d, baseline %d\n",
+                   result->name, result->layer, expected->layer);
+            regressions++;
+        }
+        else if ((result->layer == expected->layer) &&
+                 (result->error >
+                  expected->error*(1.0 + REGRESSION_ERROR_TOLERANCE))) {
+            printf("REGRESSION %s: error %.4f, baseline %.4f\n",
+                   result->name, result->error, expected->error);
+            regressions++;
+        }
+    }
+    else if (result->steps >
+             expected->steps*(1.0 + REGRESSION_STEPS_TOLERANCE)) {
+        printf("REGRESSION %s: %lu steps, baseline %lu\n", result->name,
+               result->steps, expected->steps);
+        regressions++;
+    }
+
+    /* converging where the baseline did not is an improvement */
+    if ((result->status == expected->status) &&
+        (result->seconds >
+         expected->seconds*(1.0 + REGRESSION_TIME_TOLERANCE))) {
+        printf("REGRESSION %s: %.3f seconds, baseline %.3f\n",
+               result->name, result->seconds, expected->seconds);
+        regressions++;
+    }
+
+    if (result->performance <
+        expected->performance - REGRESSION_PERF_TOLERANCE) {
+        printf("REGRESSION %s: performance %.2f%%, baseline %.2f%%\n",
+               result->name, result->performance, expected->performance);
+        regressions++;
+    }
+
+    if (result->peak_rss_kb >
+        expected->peak_rss_kb*(1.0 + REGRESSION_RSS_TOLERANCE)) {
+        printf("REGRESSION %s: peak rss %ldkB, baseline %ldkB\n",
+               result->name, result->peak_rss_kb, expected->peak_rss_kb);
+        regressions++;
+    }
+
+    return regressions;
+}
+
+/* Trains each example until it converges, printing a line of json
+   for each, then compares the results against the baseline.
+   Usage: regression [-j threads] [-b baseline] [-w new_baseline] [name] */
+int main(int argc, char* argv[])
+{
+    int threads = 1, no_of_results = 0, no_of_expected, regressions = 0;
+    char * baseline_filename = REGRESSION_BASELINE;
+    char * write_filename = NULL;
+    char * filter = NULL;
+    regression_result * results, * expected;
+
+    COUNTUP(i, argc-1) {
+        if ((strcmp(argv[i+1], "-j") == 0) && (i+2 < argc)) {
+            threads = atoi(argv[i+2]);
+            i++;
+        }
+        else if ((strcmp(argv[i+1], "-b") == 0) && (i+2 < argc)) {
+            baseline_filename = argv[i+2];
+            i++;
+        }
+        else if ((strcmp(argv[i+1], "-w") == 0) && (i+2 < argc)) {
+            write_filename = argv[i+2];
+            i++;
+        }
+        else {
+            filter = argv[i+1];
+        }
+    }
+
+    results = (regression_result*)
+        calloc(regression_no_of_workloads, sizeof(regression_result));
+    expected = (regression_result*)
+        calloc(regression_no_of_workloads, sizeof(regression_result));
+    if ((!results) || (!expected))
+        return -1;
+
+    COUNTUP(w, regression_no_of_workloads) {
+        regression_result * result = &results[no_of_results];
+
+        if ((filter != NULL) &&
+            (strcmp(filter, regression_workloads[w].name) != 0))
+            continue;
+
+        regression_run(&regression_workloads[w], threads, result);
+        printf("{\"workload\": \"%s\", \"status\": \"%s\", "
+               "\"steps\": %lu, \"seconds\": %.3f, \"layer\": %d, "
+               "\"error\": %.4f, \"performance\": %.2f, "
+               "\"peak_rss_kb\": %ld}\n",
+               result->name, regression_status_names[result->status],
+               result->steps, result->seconds, result->layer,
+               result->error, result->performance, result->peak_rss_kb);
+        no_of_results++;
+    }
+
+    if (write_filename != NULL) {
+        regressions = regression_write_baseline(write_filename, results,
+                                                no_of_results);
+        free(results);
+        free(expected);
+        return regressions;
+    }
+
+    no_of_expected = regression_read_baseline(baseline_filename, expected);
+    if (no_of_expected < 0)
+        printf("No baseline %s\n", baseline_filename);
+
+    COUNTUP(i, no_of_results) {
+        COUNTUP(j, no_of_expected) {
+            if (strcmp(results[i].name, expected[j].name) == 0)
+                regressions += regression_compare(&results[i],
+                                                  &expected[j]);
+        }
+    }
+
+    if (no_of_expected >= 0)
+        printf("%d regressions\n", regressions);
+
+    free(results);
+    free(expected);
+    return (regressions > 0);
+}
@@ -0,0 +1,90 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEEPLEARN_REGRESSION_H
+#define DEEPLEARN_REGRESSION_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "deeplearn.h"
+#include "deeplearndata.h"
+#include "deepconvnet.h"
+
+/* where the example data sets are, relative to this directory */
+#define REGRESSION_EXAMPLES         "../examples/"
+
+/* default file containing the expected results */
+#define REGRESSION_BASELINE         "baseline.txt"
+
+/* training steps after which a workload which has not converged is
+   stopped, and its error and performance compared instead */
+#define REGRESSION_MAX_STEPS        5000000
+
+/* allowed changes relative to the baseline before a result is
+   considered to be a regression */
+#define REGRESSION_TIME_TOLERANCE   0.25
+#define REGRESSION_STEPS_TOLERANCE  0.10
+#define REGRESSION_RSS_TOLERANCE    0.20
+#define REGRESSION_ERROR_TOLERANCE  0.10
+#define REGRESSION_PERF_TOLERANCE   2.0
+
+/* outcome of a workload */
+#define REGRESSION_CONVERGED        0
+#define REGRESSION_NOT_CONVERGED    1
+#define REGRESSION_SKIPPED          2
+#define REGRESSION_FAILED           3
+
+#define REGRESSION_NAME_LENGTH      32
+
+typedef struct {
+    char name[REGRESSION_NAME_LENGTH];
+    int status;
+    unsigned long steps;
+    double seconds;
+    int layer;
+    float error;
+    float performance;
+    long peak_rss_kb;
+} regression_result;
+
+typedef struct {
+    char * name;
+    void (*run)(regression_result * result, unsigned long max_steps);
+    unsigned long max_steps;
+} regression_workload;
+
+extern regression_workload regression_workloads[];
+extern int regression_no_of_workloads;
+
+double regression_time(void);
+void regression_train(deeplearn * learner, regression_result * result,
+                      unsigned long max_steps);
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* The workloads of the examples, with the same data sets, settings and
+   random seeds, but without plotting or exporting */
+
+#include "regression.h"
+
+/**
+ * @brief Loads a csv data set from the examples
+ * @returns The number of samples loaded
+ */
+static int regression_read_csv(char * filename, deeplearn * learner,
+                               int no_of_hiddens, int hidden_layers,
+                               int no_of_outputs, int * output_field_index,
+                               int output_classes,
+                               float error_threshold[],
+                               unsigned int * random_seed)
+{
+    char path[256];
+
+    sprintf(path, "%s%s", REGRESSION_EXAMPLES, filename);
+    return deeplearndata_read_csv(path, learner, no_of_hiddens,
+                                  hidden_layers, no_of_outputs,
+                                  output_field_index, output_classes,
+                                  error_threshold, random_seed);
+}
+
+static void regression_xor(regression_result * result,
+                           unsigned long max_steps)
+{
+    deeplearn learner;
+    int output_field_index[] = { 2 };
+    float error_threshold_percent[] = { 0.1f, 0.1f };
+    unsigned int random_seed = 123;
+
+    if (regression_read_csv("xor/xor.data", &learner, 5, 1, 1,
+                            output_field_index, 0, error_threshold_percent,
+                            &random_seed) <= 0) {
+        result->status = REGRESSION_FAILED;
+        return;
+    }
+
+    deeplearn_set_learning_rate(&learner, 0.2f);
+    deeplearn_set_dropouts(&learner, 0.001f);
+    regression_train(&learner, result, max_steps);
+    deeplearn_free(&learner);
+}
+
+static void regression_iris(regression_result * result,
+                            unsigned long max_steps)
+{
+    deeplearn learner;
+    int output_field_index[] = { 4 };
+    float error_threshold_percent[] = { 0.7f, 0.7f, 0.7f, 13.0f };
+    unsigned int random_seed = 123;
+
+    if (regression_read_csv("iris/iris.data", &learner, 4*4, 3, 1,
+                            output_field_index, 3, error_threshold_percent,
+                            &random_seed) <= 0) {
+        result->status = REGRESSION_FAILED;
+        return;
+    }
+
+    deeplearn_set_learning_rate(&learner, 0.1f);
+    deeplearn_set_dropouts(&learner, 0.01f);
+    regression_train(&learner, result, max_steps);
+    deeplearn_free(&learner);
+}
+
+static void regression_wine(regression_result * result,
+                            unsigned long max_steps)
+{
+    deeplearn learner;
+    int output_field_index[] = { 11 };
+    float error_threshold_percent[] = { 1.6f, 2.05f, 4.0f, 9.5f };
+    unsigned int random_seed = 123;
+
+    if (regression_read_csv("wine/winequality-red.csv", &learner, 10, 3, 1,
+                            output_field_index, 0, error_threshold_percent,
+                            &random_seed) <= 0) {
+        result->status = REGRESSION_FAILED;
+        return;
+    }
+
+    deeplearn_set_learning_rate(&learner, 0.2f);
+    deeplearn_set_dropouts(&learner, 0.001f);
+    regression_train(&learner, result, max_steps);
+    deeplearn_free(&learner);
+}
+
+static void regression_cancer_classification(regression_result * result,
+                                             unsigned long max_steps)
+{
+    deeplearn learner;
+    int output_field_index[] = { 1 };
+    float error_threshold_percent[] = { 1.4f, 1.4f, 1.4f, 15.0f };
+    unsigned int random_seed = 123;
+
+    if (regression_read_csv("cancer_classification/wdbc.data", &learner,
+                            4*4, 3, 1, output_field_index, 0,
+                            error_threshold_percent, &random_seed) <= 0) {
+        result->status = REGRESSION_FAILED;
+        return;
+    }
+
+    deeplearn_set_learning_rate(&learner, 0.2f);
+    deeplearn_set_pruning(&learner, 5000, 0.3f);
+    deeplearn_set_dropouts(&learner, 2.0f);
+    regression_train(&learner, result, max_steps);
+    deeplearn_free(&learner);
+}
+
+static void regression_concreteslump(regression_result * result,
+                                     unsigned long max_steps)
+{
+    deeplearn learner;
+    int output_field_index[] = { 7,8,9,10 };
+    float error_threshold_percent[] = { 0.5f, 0.5f, 0.5f, 13.0f };
+    unsigned int random_seed = 123;
+
+    if (regression_read_csv("concreteslump/slump_test.data", &learner,
+                            4*4, 3, 4, output_field_index, 0,
+                            error_threshold_percent, &random_seed) <= 0) {
+        result->status = REGRESSION_FAILED;
+        return;
+    }
+
+    deeplearn_set_learning_rate(&learner, 0.1f);
+    deeplearn_set_pruning(&learner, 10000, 0.3f);
+    deeplearn_set_dropouts(&learner, 0.1f);
+    regression_train(&learner, result, max_steps);
+    deeplearn_free(&learner);
+}
+
+static void regression_facerec(regression_result * result,
+                               unsigned long max_steps)
+{
+    deepconvnet convnet;
+    float error_threshold[] = { 5.0, 5.0, 5.0 };
+    unsigned int random_seed = 34217;
+    char directory[256];
+    double start_time;
+    int retval = 0;
+
+    /* the face images are not distributed with the examples */
+    sprintf(directory, "%sfacerec/images", REGRESSION_EXAMPLES);
+    if (deepconvnet_read_images(directory, &convnet, 32, 32, 3, 5*5, 5,
+                                3, 3, 5000, 2, 5*5, 25, error_threshold,
+                                &random_seed, 5, NULL) != 0) {
+        result->status = REGRESSION_SKIPPED;
+        return;
+    }
+
+    if (convnet.no_of_images == 0) {
+        deepconvnet_free(&convnet);
+        result->status = REGRESSION_SKIPPED;
+        return;
+    }
+
+    deepconvnet_set_learning_rate(&convnet, 0.2f);
+    deepconvnet_set_dropouts(&convnet, 0.0f);
+    convnet.history.interval = 0;
+    deeplearn_set_plotting(convnet.learner, DEEPLEARN_PLOT_NONE);
+
+    start_time = regression_time();
+    while (result->steps < max_steps) {
+        retval = deepconvnet_training(&convnet);
+        if (retval != 0)
+            break;
+        result->steps++;
+    }
+    result->seconds = regression_time() - start_time;
+
+    if (retval < 0)
+        result->status = REGRESSION_FAILED;
+    else if (retval == 0)
+        result->status = REGRESSION_NOT_CONVERGED;
+
+    result->layer = convnet.learner->current_hidden_layer;
+    result->error = convnet.learner->backprop_error;
+    if (result->status != REGRESSION_FAILED)
+        result->performance = deepconvnet_get_performance(&convnet);
+
+    deepconvnet_free(&convnet);
+}
+
+regression_workload regression_workloads[] = {
+    { "xor", regression_xor, REGRESSION_MAX_STEPS },
+    { "iris", regression_iris, 4*REGRESSION_MAX_STEPS },
+    { "wine", regression_wine, REGRESSION_MAX_STEPS },
+    { "cancer_classification", regression_cancer_classification,
+      REGRESSION_MAX_STEPS },
+    { "concreteslump", regression_concreteslump, REGRESSION_MAX_STEPS },
+    { "facerec", regression_facerec, REGRESSION_MAX_STEPS }
+};
+
+int regression_no_of_workloads =
+    sizeof(regression_workloads)/sizeof(regression_workload);
@@ -29,6 +29,19 @@
 
 #include "autocoder.h"
 
+/**
+ * @brief Returns the size of the arena which holds an autocoder
+ * @param no_of_inputs The number of inputs
+ * @param no_of_hiddens The number of hidden (encoder) units
+ * @return Size in bytes
+ */
+size_t autocoder_storage_size(int no_of_inputs, int no_of_hiddens)
+{
+    return deeplearn_arena_size(no_of_inputs*sizeof(float))*3 +
+        deeplearn_arena_size(no_of_hiddens*sizeof(float))*4 +
+        deeplearn_arena_size(no_of_hiddens*no_of_inputs*sizeof(float))*2;
+}
+
 /**
  * @brief Initialise an autocoder
  * @param autocoder Autocoder object
@@ -42,82 +55,51 @@ int autocoder_init(ac * autocoder,
                    int no_of_hiddens,
                    unsigned int random_seed)
 {
-    autocoder->no_of_inputs = no_of_inputs;
-    autocoder->no_of_hiddens = no_of_hiddens;
-
-    FLOATALLOC(autocoder->inputs, no_of_inputs);
-    if (!autocoder->inputs)
+    if (deeplearn_arena_init(&autocoder->arena,
+                             autocoder_storage_size(no_of_inputs,
+                                                    no_of_hiddens)) != 0)
         return -1;
 
-    FLOATALLOC(autocoder->hiddens, no_of_hiddens);
-    if (!autocoder->hiddens) {
-        free(autocoder->inputs);
-        return -2;
-    }
-
-    FLOATALLOC(autocoder->bias, no_of_hiddens);
-    if (!autocoder->bias) {
-        free(autocoder->hiddens);
-        free(autocoder->inputs);
-        return -3;
-    }
-
-    FLOATALLOC(autocoder->weights, no_of_hiddens*no_of_inputs);
-    if (!autocoder->weights) {
-        free(autocoder->bias);
-        free(autocoder->hiddens);
-        free(autocoder->inputs);
-        return -4;
-    }
-
-    FLOATALLOC(autocoder->last_weight_change, no_of_hiddens*no_of_inputs);
-    if (!autocoder->last_weight_change) {
-        free(autocoder->weights);
-        free(autocoder->bias);
-        free(autocoder->hiddens);
-        free(autocoder->inputs);
-        return -5;
-    }
+    return autocoder_init_arena(autocoder, no_of_inputs, no_of_hiddens,
+                                &autocoder->arena, random_seed);
+}
 
-    FLOATALLOC(autocoder->outputs, no_of_inputs);
-    if (!autocoder->outputs) {
-        free(autocoder->last_weight_change);
-        free(autocoder->weights);
-        free(autocoder->bias);
-        free(autocoder->hiddens);
-        free(autocoder->inputs);
-        return -6;
-    }
+/**
+ * @brief Initialise an autocoder within an arena, which may also hold
+ *        other objects. The arena is not freed by autocoder_free
+ *        unless it is the arena of the autocoder
+ * @param autocoder Autocoder object
+ * @param no_of_inputs The number of inputs
+ * @param no_of_hiddens The number of hidden (encoder) units
+ * @param arena Arena with at least autocoder_storage_size bytes remaining
+ * @param random_seed Random number generator seed
+ * @return zero on success
+ */
+int autocoder_init_arena(ac * autocoder,
+                         int no_of_inputs,
+                         int no_of_hiddens,
+                         deeplearn_arena * arena,
+                         unsigned int random_seed)
+{
+    /* the storage belongs to whoever owns the arena */
+    if (arena != &autocoder->arena)
+        deeplearn_arena_clear(&autocoder->arena);
 
-    FLOATALLOC(autocoder->bperr, no_of_hiddens);
-    if (!autocoder->bperr) {
-        free(autocoder->outputs);
-        free(autocoder->last_weight_change);
-        free(autocoder->weights);
-        free(autocoder->bias);
-        free(autocoder->hiddens);
-        free(autocoder->inputs);
-        return -7;
-    }
+    autocoder->no_of_inputs = no_of_inputs;
+    autocoder->no_of_hiddens = no_of_hiddens;
 
-    FLOATALLOC(autocoder->last_bias_change, no_of_hiddens);
-    if (!autocoder->last_bias_change) {
-        free(autocoder->bperr);
-        free(autocoder->outputs);
-        free(autocoder->last_weight_change);
-        free(autocoder->weights);
-        free(autocoder->bias);
-        free(autocoder->hiddens);
-        free(autocoder->inputs);
-        return -8;
-    }
+    /* the arena is zeroed */
+    autocoder->inputs = ARENA_FLOATALLOC(arena, no_of_inputs);
+    autocoder->hiddens = ARENA_FLOATALLOC(arena, no_of_hiddens);
+    autocoder->bias = ARENA_FLOATALLOC(arena, no_of_hiddens);
+    autocoder->weights = ARENA_FLOATALLOC(arena, no_of_hiddens*no_of_inputs);
+    autocoder->last_weight_change =
+        ARENA_FLOATALLOC(arena, no_of_hiddens*no_of_inputs);
+    autocoder->outputs = ARENA_FLOATALLOC(arena, no_of_inputs);
+    autocoder->bperr = ARENA_FLOATALLOC(arena, no_of_hiddens);
+    autocoder->last_bias_change = ARENA_FLOATALLOC(arena, no_of_hiddens);
+    autocoder->output_gradient = ARENA_FLOATALLOC(arena, no_of_inputs);
 
-    FLOATCLEAR(autocoder->inputs, no_of_inputs);
-    FLOATCLEAR(autocoder->outputs, no_of_inputs);
-    FLOATCLEAR(autocoder->hiddens, no_of_hiddens);
-    FLOATCLEAR(autocoder->last_weight_change, no_of_hiddens*no_of_inputs);
-    FLOATCLEAR(autocoder->bperr, no_of_hiddens);
-    FLOATCLEAR(autocoder->last_bias_change, no_of_hiddens);
     autocoder->backprop_error = AUTOCODER_UNKNOWN;
     autocoder->backprop_error_average = AUTOCODER_UNKNOWN;
     autocoder->learning_rate = 0.2f;
@@ -125,6 +107,18 @@ int autocoder_init(ac * autocoder,
     autocoder->random_seed = random_seed;
     autocoder->itterations = 0;
     autocoder->dropout_percent = 0.01f;
+    autocoder->activation = ACTIVATION_FUNCTION;
+    autocoder->batch_hiddens = 0;
+    autocoder->batch_outputs = 0;
+    autocoder->batch_gradients = 0;
+    autocoder->batch_bperr = 0;
+    autocoder->weight_gradients = 0;
+    autocoder->batch_capacity = 0;
+    optimizer_init(&autocoder->optimizer, OPTIMIZER_SGD);
+    autocoder->moment1 = 0;
+    autocoder->moment2 = 0;
+    autocoder->bias_moment1 = 0;
+    autocoder->bias_moment2 = 0;
 
     /* initial small random values */
     COUNTDOWN(h, no_of_hiddens) {
@@ -134,6 +128,8 @@ int autocoder_init(ac * autocoder,
             autocoder->weights[h*no_of_inputs + i] =
                 rand_initial_weight(&autocoder->random_seed, no_of_inputs);
     }
+    rand_streams_init(autocoder->random_streams, DEEPLEARN_MAX_THREADS,
+                      autocoder->random_seed);
     return 0;
 }
 
@@ -143,14 +139,17 @@ int autocoder_init(ac * autocoder,
  */
 void autocoder_free(ac * autocoder)
 {
-    free(autocoder->inputs);
-    free(autocoder->outputs);
-    free(autocoder->hiddens);
-    free(autocoder->bias);
-    free(autocoder->weights);
-    free(autocoder->last_weight_change);
-    free(autocoder->bperr);
-    free(autocoder->last_bias_change);
+    /* the layers and weights are held within the arena */
+    deeplearn_backend_weights_changed(autocoder->weights);
+    deeplearn_arena_free(&autocoder->arena);
+    free(autocoder->batch_hiddens);
+    free(autocoder->batch_outputs);
+    free(autocoder->batch_gradients);
+    free(autocoder->batch_bperr);
+    free(autocoder->weight_gradients);
+    optimizer_moments_free(&autocoder->moment1, &autocoder->moment2);
+    optimizer_moments_free(&autocoder->bias_moment1,
+                           &autocoder->bias_moment2);
 }
 
 /**
@@ -165,12 +164,25 @@ void autocoder_encode(ac * autocoder, float encoded[],
     const unsigned int drop_percent =
         (unsigned int)(autocoder->dropout_percent*100);
 
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
+    /* weighted sums from the backend, unless individual connections
+       are to be dropped */
+    const int on_backend =
+        (use_dropouts == 0) &&
+        (deeplearn_backend_dense_forward(autocoder->weights,
+                                         autocoder->inputs, 1,
+                                         autocoder->no_of_inputs,
+                                         autocoder->no_of_hiddens,
+                                         encoded) == 0);
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(autocoder->no_of_inputs*autocoder->no_of_hiddens))
     COUNTDOWN(h, autocoder->no_of_hiddens) {
-        unsigned int randseed = (unsigned int)h + autocoder->random_seed;
+        unsigned int * randseed =
+            rand_stream_seed(autocoder->random_streams, DEEPLEARN_MAX_THREADS);
 
         if (use_dropouts != 0) {
-            if (rand_num(&randseed)%10000 < drop_percent) {
+            if (rand_num(randseed)%10000 < drop_percent) {
                 autocoder->hiddens[h] = (int)AUTOCODER_DROPPED_OUT;
                 continue;
             }
@@ -180,14 +192,15 @@ void autocoder_encode(ac * autocoder, float encoded[],
         float adder = autocoder->bias[h];
         float * w = &autocoder->weights[h*autocoder->no_of_inputs];
         float * inp = &autocoder->inputs[0];
-        if (use_dropouts == 0) {
-            COUNTDOWN(i, autocoder->no_of_inputs) {
-                adder += w[i] * inp[i];
-            }
+        if (on_backend) {
+            adder += encoded[h];
+        }
+        else if (use_dropouts == 0) {
+            adder += deeplearn_dot(w, inp, autocoder->no_of_inputs);
         }
         else {
             COUNTDOWN(i, autocoder->no_of_inputs) {
-                if (rand_num(&randseed)%10000 > drop_percent) {
+                if (rand_num(randseed)%10000 > drop_percent) {
                     adder += w[i] * inp[i];
                 }
             }
@@ -197,18 +210,19 @@ void autocoder_encode(ac * autocoder, float encoded[],
         if (autocoder->noise > 0) {
             adder = ((1.0f - autocoder->noise) * adder) +
                 (autocoder->noise *
-                 ((rand_num(&randseed)%10000)/10000.0f));
+                 ((rand_num(randseed)%10000)/10000.0f));
         }
 
         /* activation function */
-        encoded[h] = AF(adder);
+        encoded[h] = activation_value(autocoder->activation, adder);
     }
-
-    rand_num(&autocoder->random_seed);
 }
 
 /**
- * @brief Decodes the encoded (hidden) units to a given output array
+ * @brief Decodes the encoded (hidden) units to a given output array.
+ *        The weights are shared with the encoder and stored one row
+ *        per hidden unit, so outputs are decoded a tile at a time with
+ *        each row being read contiguously rather than by column
  * @param autocoder Autocoder object
  * @param decoded Array to store the decoded output values
  * @param use_dropouts If non-zero then allow dropouts in the returned results
@@ -218,43 +232,54 @@ void autocoder_decode(ac * autocoder, float decoded[],
 {
     const unsigned int drop_percent =
         (unsigned int)(autocoder->dropout_percent*100);
-
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
-    COUNTDOWN(i, autocoder->no_of_inputs) {
-        unsigned int randseed = (unsigned int)i + autocoder->random_seed;
+    const int step = autocoder->no_of_inputs;
+    const int tiles =
+        (step + AUTOCODER_DECODE_TILE - 1) / AUTOCODER_DECODE_TILE;
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(autocoder->no_of_inputs*autocoder->no_of_hiddens))
+    COUNTUP(t, tiles) {
+        unsigned int * randseed =
+            rand_stream_seed(autocoder->random_streams, DEEPLEARN_MAX_THREADS);
+        float adder[AUTOCODER_DECODE_TILE];
+        int start_i = t*AUTOCODER_DECODE_TILE;
+        int tile_width = step - start_i;
+        if (tile_width > AUTOCODER_DECODE_TILE)
+            tile_width = AUTOCODER_DECODE_TILE;
+
+        FLOATCLEAR(adder, tile_width);
 
         /* weighted sum of hidden inputs */
-        float adder = 0;
-        float * w = &autocoder->weights[i];
         float * inp = &autocoder->hiddens[0];
-        int step = autocoder->no_of_inputs;
-        if (use_dropouts == 0) {
-            COUNTDOWN(h, autocoder->no_of_hiddens) {
-                adder += w[h*step] * inp[h];
+        COUNTUP(h, autocoder->no_of_hiddens) {
+            float * w = &autocoder->weights[h*step + start_i];
+            if (use_dropouts == 0) {
+                deeplearn_axpy(adder, inp[h], w, tile_width);
+                continue;
             }
-        }
-        else {
-            COUNTDOWN(h, autocoder->no_of_hiddens) {
-                if (inp[h] != AUTOCODER_DROPPED_OUT) {
-                    if (rand_num(&randseed)%10000 > drop_percent) {
-                        adder += w[h*step] * inp[h];
-                    }
+            if (inp[h] == AUTOCODER_DROPPED_OUT)
+                continue;
+            COUNTUP(i, tile_width) {
+                if (rand_num(randseed)%10000 > drop_percent) {
+                    adder[i] += w[i] * inp[h];
                 }
             }
         }
 
-        /* add some random noise */
-        if (autocoder->noise > 0) {
-            adder = ((1.0f - autocoder->noise) * adder) +
-                (autocoder->noise *
-                 ((rand_num(&randseed)%10000)/10000.0f));
-        }
+        COUNTUP(i, tile_width) {
+            /* add some random noise */
+            if (autocoder->noise > 0) {
+                adder[i] = ((1.0f - autocoder->noise) * adder[i]) +
+                    (autocoder->noise *
+                     ((rand_num(randseed)%10000)/10000.0f));
+            }
 
-        /* activation function */
-        decoded[i] = AF(adder);
+            /* activation function */
+            decoded[start_i + i] =
+                activation_value(autocoder->activation, adder[i]);
+        }
     }
-
-    rand_num(&autocoder->random_seed);
 }
 
 /**
@@ -268,34 +293,27 @@ void autocoder_feed_forward(ac * autocoder)
 }
 
 /**
- * @brief Back propogate the error
+ * @brief Calculates the error gradient at each output unit
  * @param autocoder Autocoder object
  */
-void autocoder_backprop(ac * autocoder)
+static void autocoder_output_gradients(ac * autocoder)
 {
-    /* clear the backptop error for each hidden unit */
-    FLOATCLEAR(autocoder->bperr, autocoder->no_of_hiddens);
-
-    /* backprop from outputs to hiddens */
-    autocoder->backprop_error = 0;
-    float error_percent = 0;
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
     COUNTDOWN(i, autocoder->no_of_inputs) {
         float backprop_error = autocoder->inputs[i] - autocoder->outputs[i];
-        autocoder->backprop_error += fabs(backprop_error);
-        error_percent += fabs(backprop_error);
         float afact = autocoder->outputs[i] * (1.0f - autocoder->outputs[i]);
-        float bperr = backprop_error * afact;
-        float * w = &autocoder->weights[i];
-        int step = autocoder->no_of_inputs;
-        COUNTDOWN(h, autocoder->no_of_hiddens) {
-            if (autocoder->hiddens[h] != AUTOCODER_DROPPED_OUT)
-                autocoder->bperr[h] += bperr * w[h*step];
-        }
+        autocoder->output_gradient[i] = backprop_error * afact;
     }
+}
 
+/**
+ * @brief Updates the running average errors from the summed
+ *        absolute error of a single sample
+ * @param autocoder Autocoder object
+ */
+static void autocoder_update_error_average(ac * autocoder)
+{
     /* convert summed error to an overall percentage */
-    error_percent = error_percent * 100 /
+    float error_percent = autocoder->backprop_error * 100 /
         (NEURON_RANGE*autocoder->no_of_inputs);
 
     /* update the running average */
@@ -318,43 +336,133 @@ void autocoder_backprop(ac * autocoder)
 }
 
 /**
- * @brief Adjusts weights and biases
+ * @brief Back propogate the error
  * @param autocoder Autocoder object
  */
-void autocoder_learn(ac * autocoder)
+void autocoder_backprop(ac * autocoder)
 {
-    /* weights between outputs and hiddens */
-    float e = autocoder->learning_rate / (1.0f + autocoder->no_of_hiddens);
+    /* clear the backptop error for each hidden unit */
+    FLOATCLEAR(autocoder->bperr, autocoder->no_of_hiddens);
 
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
+    autocoder->backprop_error = 0;
     COUNTDOWN(i, autocoder->no_of_inputs) {
-        float afact = autocoder->outputs[i] * (1.0f - autocoder->outputs[i]);
-        float backprop_error = autocoder->inputs[i] - autocoder->outputs[i];
-        float gradient = afact * backprop_error;
-        float egradient = e * gradient;
-        int step = autocoder->no_of_inputs;
-        int n = (autocoder->no_of_hiddens-1)*step + i;
-        COUNTDOWN(h, autocoder->no_of_hiddens) {
-            if (autocoder->hiddens[h] != AUTOCODER_DROPPED_OUT) {
-                autocoder->last_weight_change[n] =
-                    egradient * (autocoder->last_weight_change[n] + 1) *
-                    autocoder->hiddens[h];
-                autocoder->weights[n] =
-                    CLIP_WEIGHT(autocoder->weights[n] +
-                                autocoder->last_weight_change[n]);
-            }
-            n -= step;
-        }
+        autocoder->backprop_error +=
+            fabs(autocoder->inputs[i] - autocoder->outputs[i]);
+    }
+    autocoder_output_gradients(autocoder);
+
+    /* backprop from outputs to hiddens, one weight row per hidden unit */
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(autocoder->no_of_inputs*autocoder->no_of_hiddens))
+    COUNTDOWN(h, autocoder->no_of_hiddens) {
+        if (autocoder->hiddens[h] == AUTOCODER_DROPPED_OUT)
+            continue;
+        autocoder->bperr[h] =
+            deeplearn_dot(&autocoder->weights[h*autocoder->no_of_inputs],
+                          autocoder->output_gradient,
+                          autocoder->no_of_inputs);
+    }
+
+    autocoder_update_error_average(autocoder);
+}
+
+/**
+ * @brief Adjusts the weights and bias of one hidden unit using an
+ *        adaptive optimizer. The gradients of the tied weights from the
+ *        output and input sides are combined into a single update
+ * @param autocoder Autocoder object
+ * @param h Index of the hidden unit
+ * @param g Gradients of the row of weights
+ * @param bias_gradient Gradient of the bias
+ */
+static void autocoder_optimize_hidden(ac * autocoder, int h,
+                                      const float * g, float bias_gradient)
+{
+    const int row = h*autocoder->no_of_inputs;
+    float * m = (autocoder->moment1 != 0) ? &autocoder->moment1[row] : 0;
+    float * bias_m =
+        (autocoder->bias_moment1 != 0) ? &autocoder->bias_moment1[h] : 0;
+    float one = 1;
+
+    optimizer_update(&autocoder->optimizer,
+                     &autocoder->bias[h], &autocoder->last_bias_change[h],
+                     bias_m, &autocoder->bias_moment2[h],
+                     &one, bias_gradient, 1);
+    optimizer_update(&autocoder->optimizer,
+                     &autocoder->weights[row],
+                     &autocoder->last_weight_change[row],
+                     m, &autocoder->moment2[row], g, 1,
+                     autocoder->no_of_inputs);
+}
+
+/**
+ * @brief Adjusts weights and biases using an adaptive optimizer
+ * @param autocoder Autocoder object
+ */
+static void autocoder_learn_adaptive(ac * autocoder)
+{
+    const int no_of_inputs = autocoder->no_of_inputs;
+
+    optimizer_step(&autocoder->optimizer);
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(no_of_inputs*autocoder->no_of_hiddens))
+    COUNTDOWN(h, autocoder->no_of_hiddens) {
+        float * g = &autocoder->weight_gradients[h*no_of_inputs];
+        float hidden = autocoder->hiddens[h];
+        float gradient;
+
+        if (hidden == AUTOCODER_DROPPED_OUT)
+            continue;
+
+        gradient = hidden * (1.0f - hidden) * autocoder->bperr[h];
+
+        FLOATCLEAR(g, no_of_inputs);
+        deeplearn_axpy(g, hidden, autocoder->output_gradient, no_of_inputs);
+        deeplearn_axpy(g, gradient, autocoder->inputs, no_of_inputs);
+        autocoder_optimize_hidden(autocoder, h, g, gradient);
     }
+}
 
-    /* weights between hiddens and inputs */
-    e = autocoder->learning_rate / (1.0f + autocoder->no_of_inputs);
+/**
+ * @brief Adjusts weights and biases. Each tied weight is adjusted
+ *        first from the output side and then from the input side,
+ *        one row per hidden unit
+ * @param autocoder Autocoder object
+ */
+void autocoder_learn(ac * autocoder)
+{
+    /* learning rates for weights between outputs and hiddens and
+       between hiddens and inputs */
+    float e_output =
+        autocoder->learning_rate / (1.0f + autocoder->no_of_hiddens);
+    float e = autocoder->learning_rate / (1.0f + autocoder->no_of_inputs);
+
+    autocoder_output_gradients(autocoder);
+
+    if (optimizer_adaptive(&autocoder->optimizer)) {
+        autocoder_learn_adaptive(autocoder);
+        deeplearn_backend_weights_changed(autocoder->weights);
+        return;
+    }
 
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(autocoder->no_of_inputs*autocoder->no_of_hiddens))
     COUNTDOWN(h, autocoder->no_of_hiddens) {
         if (autocoder->hiddens[h] == AUTOCODER_DROPPED_OUT)
             continue;
 
+        float * w = &autocoder->weights[h*autocoder->no_of_inputs];
+        float * dw = &autocoder->last_weight_change[h*autocoder->no_of_inputs];
+        float ehidden = e_output * autocoder->hiddens[h];
+        COUNTDOWN(i, autocoder->no_of_inputs) {
+            dw[i] = ehidden * autocoder->output_gradient[i] * (dw[i] + 1);
+            w[i] = CLIP_WEIGHT(w[i] + dw[i]);
+        }
+
         float afact = autocoder->hiddens[h] * (1.0f - autocoder->hiddens[h]);
         float backprop_error = autocoder->bperr[h];
         float gradient = afact * backprop_error;
@@ -364,17 +472,54 @@ void autocoder_learn(ac * autocoder)
         autocoder->bias[h] =
             CLIP_WEIGHT(autocoder->bias[h] +
                         autocoder->last_bias_change[h]);
-        int n = (h+1)*autocoder->no_of_inputs - 1;
         COUNTDOWN(i, autocoder->no_of_inputs) {
-            autocoder->last_weight_change[n] =
-                egradient * (autocoder->last_weight_change[n] + 1) *
-                autocoder->inputs[i];
-            autocoder->weights[n] =
-                CLIP_WEIGHT(autocoder->weights[n] +
-                            autocoder->last_weight_change[n]);
-            n--;
+            dw[i] = egradient * (dw[i] + 1) * autocoder->inputs[i];
+            w[i] = CLIP_WEIGHT(w[i] + dw[i]);
         }
     }
+
+    deeplearn_backend_weights_changed(autocoder->weights);
+}
+
+/**
+ * @brief Sets the method used to adjust the weights during training.
+ *        Moments of the weights and biases are only allocated when an
+ *        adaptive optimizer is chosen. Any previous moments are discarded
+ * @param autocoder Autocoder object
+ * @param type The optimizer, eg. OPTIMIZER_ADAM
+ * @returns zero on success
+ */
+int autocoder_set_optimizer(ac * autocoder, int type)
+{
+    const int n = autocoder->no_of_inputs*autocoder->no_of_hiddens;
+
+    if (!optimizer_valid(type))
+        return -1;
+
+    optimizer_init(&autocoder->optimizer, type);
+    optimizer_moments_free(&autocoder->moment1, &autocoder->moment2);
+    optimizer_moments_free(&autocoder->bias_moment1,
+                           &autocoder->bias_moment2);
+
+    if (optimizer_moments_alloc(type, autocoder->no_of_hiddens,
+                                autocoder->no_of_inputs,
+                                &autocoder->moment1,
+                                &autocoder->moment2) != 0)
+        return -2;
+
+    if (optimizer_moments_alloc(type, autocoder->no_of_hiddens, 1,
+                                &autocoder->bias_moment1,
+                                &autocoder->bias_moment2) != 0)
+        return -3;
+
+    /* the gradients of each row are gathered before updating */
+    if ((type != OPTIMIZER_SGD) && (autocoder->weight_gradients == 0)) {
+        FLOATALLOC(autocoder->weight_gradients, n);
+        if (!autocoder->weight_gradients)
+            return -4;
+    }
+
+    return 0;
 }
 
 /**
@@ -421,6 +566,24 @@ int autocoder_save(FILE * fp, ac * autocoder)
     if (UINTWRITE(autocoder->itterations) == 0)
         return -11;
 
+    if (INTWRITE(autocoder->activation) == 0)
+        return -12;
+
+    if (optimizer_save(fp, &autocoder->optimizer) != 0)
+        return -13;
+
+    if (optimizer_save_moments(fp, &autocoder->optimizer,
+                               autocoder->moment1, autocoder->moment2,
+                               autocoder->no_of_inputs *
+                               autocoder->no_of_hiddens) != 0)
+        return -14;
+
+    if (optimizer_save_moments(fp, &autocoder->optimizer,
+                               autocoder->bias_moment1,
+                               autocoder->bias_moment2,
+                               autocoder->no_of_hiddens) != 0)
+        return -15;
+
     return 0;
 }
 
@@ -436,6 +599,7 @@ int autocoder_load(FILE * fp, ac * autocoder, int initialise)
     int no_of_inputs = 0;
     int no_of_hiddens = 0;
     unsigned int random_seed = 0;
+    deeplearn_optimizer optimizer;
 
     if (INTREAD(no_of_inputs) == 0)
         return -1;
@@ -459,6 +623,8 @@ int autocoder_load(FILE * fp, ac * autocoder, int initialise)
         autocoder->no_of_inputs = no_of_inputs;
         autocoder->no_of_hiddens = no_of_hiddens;
         autocoder->random_seed = random_seed;
+        rand_streams_init(autocoder->random_streams, DEEPLEARN_MAX_THREADS,
+                          random_seed);
     }
 
     if (FLOATREAD(autocoder->dropout_percent) == 0)
@@ -487,6 +653,31 @@ int autocoder_load(FILE * fp, ac * autocoder, int initialise)
     if (UINTREAD(autocoder->itterations) == 0)
         return -12;
 
+    if (INTREAD(autocoder->activation) == 0)
+        return -13;
+
+    if (!activation_valid(autocoder->activation))
+        return -14;
+
+    if (optimizer_load(fp, &optimizer) != 0)
+        return -15;
+
+    if (autocoder_set_optimizer(autocoder, optimizer.type) != 0)
+        return -16;
+    autocoder->optimizer = optimizer;
+
+    if (optimizer_load_moments(fp, &autocoder->optimizer,
+                               autocoder->moment1, autocoder->moment2,
+                               no_of_inputs*no_of_hiddens) != 0)
+        return -17;
+
+    if (optimizer_load_moments(fp, &autocoder->optimizer,
+                               autocoder->bias_moment1,
+                               autocoder->bias_moment2,
+                               no_of_hiddens) != 0)
+        return -18;
+
+    deeplearn_backend_weights_changed(autocoder->weights);
     return 0;
 }
 
@@ -545,6 +736,337 @@ void autocoder_update(ac * autocoder)
     autocoder_learn(autocoder);
 }
 
+/**
+ * @brief Ensures that the mini-batch buffers can hold the given
+ *        number of samples
+ * @param autocoder Autocoder object
+ * @param batch_size The number of samples in the batch
+ * @returns zero on success
+ */
+static int autocoder_batch_alloc(ac * autocoder, int batch_size)
+{
+    const int no_of_inputs = autocoder->no_of_inputs;
+    const int no_of_hiddens = autocoder->no_of_hiddens;
+
+    if (batch_size <= autocoder->batch_capacity)
+        return 0;
+
+    free(autocoder->batch_hiddens);
+    free(autocoder->batch_outputs);
+    free(autocoder->batch_gradients);
+    free(autocoder->batch_bperr);
+    FLOATALLOC(autocoder->batch_hiddens, batch_size*no_of_hiddens);
+    FLOATALLOC(autocoder->batch_outputs, batch_size*no_of_inputs);
+    FLOATALLOC(autocoder->batch_gradients, batch_size*no_of_inputs);
+    FLOATALLOC(autocoder->batch_bperr, batch_size*no_of_hiddens);
+
+    if (autocoder->weight_gradients == 0)
+        FLOATALLOC(autocoder->weight_gradients, no_of_hiddens*no_of_inputs);
+
+    if ((!autocoder->batch_hiddens) || (!autocoder->batch_outputs) ||
+        (!autocoder->batch_gradients) || (!autocoder->batch_bperr) ||
+        (!autocoder->weight_gradients)) {
+        autocoder->batch_capacity = 0;
+        return -1;
+    }
+
+    autocoder->batch_capacity = batch_size;
+    return 0;
+}
+
+/**
+ * @brief Encodes a batch of input vectors. Each weight row is applied
+ *        to every sample before moving on to the next hidden unit
+ * @param autocoder Autocoder object
+ * @param inputs n x no_of_inputs array of input values
+ * @param n The number of samples in the batch
+ */
+static void autocoder_encode_batch(ac * autocoder, const float * inputs,
+                                   int n)
+{
+    const unsigned int drop_percent =
+        (unsigned int)(autocoder->dropout_percent*100);
+    const int no_of_inputs = autocoder->no_of_inputs;
+    const int no_of_hiddens = autocoder->no_of_hiddens;
+
+    /* weighted sums of the whole batch from the backend, which are
+       then replaced by the activations in place */
+    const int on_backend =
+        (deeplearn_backend_dense_forward(autocoder->weights, inputs, n,
+                                         no_of_inputs, no_of_hiddens,
+                                         autocoder->batch_hiddens) == 0);
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(no_of_inputs*no_of_hiddens*n))
+    COUNTDOWN(h, no_of_hiddens) {
+        unsigned int * randseed =
+            rand_stream_seed(autocoder->random_streams, DEEPLEARN_MAX_THREADS);
+        float * w = &autocoder->weights[h*no_of_inputs];
+
+        COUNTUP(b, n) {
+            float * hidden = &autocoder->batch_hiddens[b*no_of_hiddens + h];
+
+            if (rand_num(randseed)%10000 < drop_percent) {
+                *hidden = AUTOCODER_DROPPED_OUT;
+                continue;
+            }
+
+            /* weighted sum of inputs */
+            float adder = autocoder->bias[h];
+            if (on_backend)
+                adder += *hidden;
+            else
+                adder += deeplearn_dot(w, &inputs[b*no_of_inputs],
+                                       no_of_inputs);
+
+            /* add some random noise */
+            if (autocoder->noise > 0) {
+                adder = ((1.0f - autocoder->noise) * adder) +
+                    (autocoder->noise *
+                     ((rand_num(randseed)%10000)/10000.0f));
+            }
+
+            /* activation function */
+            *hidden = activation_value(autocoder->activation, adder);
+        }
+    }
+}
+
+/**
+ * @brief Decodes a batch of encoded samples, a tile of outputs at a
+ *        time, so that each weight row slice is reused by every sample
+ * @param autocoder Autocoder object
+ * @param n The number of samples in the batch
+ */
+static void autocoder_decode_batch(ac * autocoder, int n)
+{
+    const int no_of_inputs = autocoder->no_of_inputs;
+    const int no_of_hiddens = autocoder->no_of_hiddens;
+    const int tiles =
+        (no_of_inputs + AUTOCODER_DECODE_TILE - 1) / AUTOCODER_DECODE_TILE;
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(no_of_inputs*no_of_hiddens*n))
+    COUNTUP(t, tiles) {
+        unsigned int * randseed =
+            rand_stream_seed(autocoder->random_streams, DEEPLEARN_MAX_THREADS);
+        int start_i = t*AUTOCODER_DECODE_TILE;
+        int tile_width = no_of_inputs - start_i;
+        if (tile_width > AUTOCODER_DECODE_TILE)
+            tile_width = AUTOCODER_DECODE_TILE;
+
+        COUNTUP(b, n)
+            FLOATCLEAR(&autocoder->batch_outputs[b*no_of_inputs + start_i],
+                       tile_width);
+
+        /* weighted sum of hidden inputs */
+        COUNTUP(h, no_of_hiddens) {
+            float * w = &autocoder->weights[h*no_of_inputs + start_i];
+            COUNTUP(b, n) {
+                float hidden = autocoder->batch_hiddens[b*no_of_hiddens + h];
+                if (hidden == AUTOCODER_DROPPED_OUT)
+                    continue;
+                deeplearn_axpy(&autocoder->batch_outputs[b*no_of_inputs +
+                                                         start_i],
+                               hidden, w, tile_width);
+            }
+        }
+
+        COUNTUP(b, n) {
+            float * adder = &autocoder->batch_outputs[b*no_of_inputs + start_i];
+            COUNTUP(i, tile_width) {
+                /* add some random noise */
+                if (autocoder->noise > 0) {
+                    adder[i] = ((1.0f - autocoder->noise) * adder[i]) +
+                        (autocoder->noise *
+                         ((rand_num(randseed)%10000)/10000.0f));
+                }
+
+                /* activation function */
+                adder[i] = activation_value(autocoder->activation, adder[i]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Back propogates the error of a batch to the hidden units
+ * @param autocoder Autocoder object
+ * @param inputs n x no_of_inputs array of input values
+ * @param n The number of samples in the batch
+ */
+static void autocoder_backprop_batch(ac * autocoder, const float * inputs,
+                                     int n)
+{
+    const int no_of_inputs = autocoder->no_of_inputs;
+    const int no_of_hiddens = autocoder->no_of_hiddens;
+
+    /* error gradients on the outputs, and running averages which
+       are updated once per sample as with autocoder_backprop */
+    COUNTUP(b, n) {
+        const float * inp = &inputs[b*no_of_inputs];
+        float * out = &autocoder->batch_outputs[b*no_of_inputs];
+        float * g = &autocoder->batch_gradients[b*no_of_inputs];
+
+        autocoder->backprop_error = 0;
+        COUNTDOWN(i, no_of_inputs) {
+            float backprop_error = inp[i] - out[i];
+            autocoder->backprop_error += fabs(backprop_error);
+            g[i] = backprop_error * out[i] * (1.0f - out[i]);
+        }
+        autocoder_update_error_average(autocoder);
+    }
+
+    /* gradient on each hidden unit */
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(no_of_inputs*no_of_hiddens*n))
+    COUNTDOWN(h, no_of_hiddens) {
+        float * w = &autocoder->weights[h*no_of_inputs];
+
+        COUNTUP(b, n) {
+            float hidden = autocoder->batch_hiddens[b*no_of_hiddens + h];
+            float * d = &autocoder->batch_bperr[b*no_of_hiddens + h];
+
+            if (hidden == AUTOCODER_DROPPED_OUT) {
+                *d = 0;
+                continue;
+            }
+            *d = hidden * (1.0f - hidden) *
+                deeplearn_dot(w, &autocoder->batch_gradients[b*no_of_inputs],
+                              no_of_inputs);
+        }
+    }
+}
+
+/**
+ * @brief Adjusts weights and biases once for a batch. Gradients are
+ *        summed over the samples rather than averaged, so that each
+ *        sample contributes as much as it would in autocoder_update
+ *        and pretraining needs no more samples than it did before.
+ *        As with autocoder_learn each tied weight receives the output
+ *        side update first
+ * @param autocoder Autocoder object
+ * @param inputs n x no_of_inputs array of input values
+ * @param n The number of samples in the batch
+ */
+static void autocoder_learn_batch(ac * autocoder, const float * inputs,
+                                  int n)
+{
+    const int no_of_inputs = autocoder->no_of_inputs;
+    const int no_of_hiddens = autocoder->no_of_hiddens;
+    const float e_output =
+        autocoder->learning_rate / (1.0f + no_of_hiddens);
+    const float e = autocoder->learning_rate / (1.0f + no_of_inputs);
+
+    optimizer_step(&autocoder->optimizer);
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(no_of_inputs*no_of_hiddens*n))
+    COUNTDOWN(h, no_of_hiddens) {
+        float * w = &autocoder->weights[h*no_of_inputs];
+        float * dw = &autocoder->last_weight_change[h*no_of_inputs];
+        float * g = &autocoder->weight_gradients[h*no_of_inputs];
+        float bias_gradient = 0;
+        int active = 0;
+
+        /* sum of hidden * output gradient over the batch */
+        FLOATCLEAR(g, no_of_inputs);
+        COUNTUP(b, n) {
+            float hidden = autocoder->batch_hiddens[b*no_of_hiddens + h];
+            if (hidden == AUTOCODER_DROPPED_OUT)
+                continue;
+            deeplearn_axpy(g, hidden,
+                           &autocoder->batch_gradients[b*no_of_inputs],
+                           no_of_inputs);
+            active++;
+        }
+
+        /* dropped out of every sample */
+        if (active == 0)
+            continue;
+
+        /* an adaptive optimizer makes a single update from the
+           combined gradients of both sides */
+        if (optimizer_adaptive(&autocoder->optimizer)) {
+            COUNTUP(b, n) {
+                float d = autocoder->batch_bperr[b*no_of_hiddens + h];
+                if (d == 0)
+                    continue;
+                bias_gradient += d;
+                deeplearn_axpy(g, d, &inputs[b*no_of_inputs],
+                               no_of_inputs);
+            }
+            autocoder_optimize_hidden(autocoder, h, g, bias_gradient);
+            continue;
+        }
+
+        deeplearn_weight_update(w, dw, g, e_output, no_of_inputs);
+
+        /* sum of hidden gradient * input over the batch */
+        FLOATCLEAR(g, no_of_inputs);
+        COUNTUP(b, n) {
+            float d = autocoder->batch_bperr[b*no_of_hiddens + h];
+            if (d == 0)
+                continue;
+            bias_gradient += d;
+            deeplearn_axpy(g, d, &inputs[b*no_of_inputs], no_of_inputs);
+        }
+
+        autocoder->last_bias_change[h] =
+            e * (autocoder->last_bias_change[h] + 1.0f) * bias_gradient;
+        autocoder->bias[h] =
+            CLIP_WEIGHT(autocoder->bias[h] +
+                        autocoder->last_bias_change[h]);
+
+        deeplearn_weight_update(w, dw, g, e, no_of_inputs);
+    }
+
+    deeplearn_backend_weights_changed(autocoder->weights);
+}
+
+/**
+ * @brief Trains on a mini-batch of input vectors, with one update of the
+ *        weights per batch. Dropouts are applied to whole hidden units
+ *        of each sample rather than to individual connections.
+ *        Afterwards the inputs, hidden units and outputs contain the
+ *        values for the last sample of the batch
+ * @param autocoder Autocoder object
+ * @param inputs n x no_of_inputs array of input values
+ * @param n The number of samples in the batch
+ * @returns zero on success
+ */
+int autocoder_update_batch(ac * autocoder, const float * inputs, int n)
+{
+    const int no_of_inputs = autocoder->no_of_inputs;
+    const int no_of_hiddens = autocoder->no_of_hiddens;
+    const int last = n - 1;
+
+    if (n < 1)
+        return -1;
+
+    if (autocoder_batch_alloc(autocoder, n) != 0)
+        return -2;
+
+    autocoder_encode_batch(autocoder, inputs, n);
+    autocoder_decode_batch(autocoder, n);
+    autocoder_backprop_batch(autocoder, inputs, n);
+    autocoder_learn_batch(autocoder, inputs, n);
+
+    memcpy((void*)autocoder->inputs, &inputs[last*no_of_inputs],
+           no_of_inputs*sizeof(float));
+    memcpy((void*)autocoder->hiddens,
+           &autocoder->batch_hiddens[last*no_of_hiddens],
+           no_of_hiddens*sizeof(float));
+    memcpy((void*)autocoder->outputs,
+           &autocoder->batch_outputs[last*no_of_inputs],
+           no_of_inputs*sizeof(float));
+    return 0;
+}
+
 /**
  * @brief Normalises the inputs to the autocoder
  * @param autocoder Autocoder object
@@ -36,12 +36,21 @@
 #include <omp.h>
 #include "globals.h"
 #include "deeplearn_random.h"
+#include "deeplearn_simd.h"
+#include "deeplearn_backend.h"
+#include "deeplearn_threads.h"
+#include "deeplearn_activation.h"
+#include "deeplearn_optimizer.h"
 #include "deeplearn_images.h"
+#include "deeplearn_arena.h"
 #include "backprop_neuron.h"
 
 struct autocode {
     unsigned int random_seed;
 
+    /* random number generator state for each thread */
+    rand_stream random_streams[DEEPLEARN_MAX_THREADS];
+
     /* layer dimensions.
        Number of outputs is the same as number of inputs */
     int no_of_inputs,no_of_hiddens;
@@ -49,6 +58,9 @@ struct autocode {
     /* in the range 0 -> 100 */
     float dropout_percent;
 
+    /* activation function, eg. AF_SIGMOID */
+    int activation;
+
     /* layers */
     float * inputs;
     float * hiddens;
@@ -67,6 +79,7 @@ struct autocode {
 
     /* backprop error */
     float * bperr;
+    float * output_gradient;
     float backprop_error;
     float backprop_error_percent;
     float backprop_error_average;
@@ -79,6 +92,31 @@ struct autocode {
 
     /* training itterations */
     unsigned int itterations;
+
+    /* mini-batch buffers, batch_size x no_of_hiddens for the hidden
+       units and batch_size x no_of_inputs for the outputs */
+    float * batch_hiddens;
+    float * batch_outputs;
+    float * batch_gradients;
+    float * batch_bperr;
+
+    /* gradients accumulated over a mini-batch for each weight row */
+    float * weight_gradients;
+
+    /* number of samples the mini-batch buffers can hold */
+    int batch_capacity;
+
+    /* method used to adjust the weights, and the moments of the
+       weights and biases allocated by autocoder_set_optimizer */
+    deeplearn_optimizer optimizer;
+    float * moment1;
+    float * moment2;
+    float * bias_moment1;
+    float * bias_moment2;
+
+    /* storage for the layers and weights, which is empty when the
+       autocoder is held within another arena */
+    deeplearn_arena arena;
 };
 typedef struct autocode ac;
 
@@ -86,6 +124,12 @@ int autocoder_init(ac * autocoder,
                    int no_of_inputs,
                    int no_of_hiddens,
                    unsigned int random_seed);
+size_t autocoder_storage_size(int no_of_inputs, int no_of_hiddens);
+int autocoder_init_arena(ac * autocoder,
+                         int no_of_inputs,
+                         int no_of_hiddens,
+                         deeplearn_arena * arena,
+                         unsigned int random_seed);
 void autocoder_free(ac * autocoder);
 void autocoder_encode(ac * autocoder, float encoded[],
                       unsigned char use_dropouts);
@@ -94,6 +138,7 @@ void autocoder_decode(ac * autocoder, float decoded[],
 void autocoder_feed_forward(ac * autocoder);
 void autocoder_backprop(ac * autocoder);
 void autocoder_learn(ac * autocoder);
+int autocoder_set_optimizer(ac * autocoder, int type);
 int autocoder_save(FILE * fp, ac * autocoder);
 int autocoder_load(FILE * fp, ac * autocoder, int initialise);
 void autocoder_set_input(ac * autocoder, int index, float value);
@@ -101,6 +146,7 @@ void autocoder_set_inputs(ac * autocoder, float inputs[]);
 float autocoder_get_hidden(ac * autocoder, int index);
 void autocoder_set_hidden(ac * autocoder, int index, float value);
 void autocoder_update(ac * autocoder);
+int autocoder_update_batch(ac * autocoder, const float * inputs, int n);
 void autocoder_normalise_inputs(ac * autocoder);
 int autocoder_compare(ac * autocoder0, ac * autocoder1);
 int autocoder_plot_weights(ac * autocoder,
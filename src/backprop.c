@@ -29,6 +29,173 @@
 
 #include "backprop.h"
 
+/**
+* @brief Returns the space in an arena taken by the storage of a layer
+* @param no_of_units The number of units within the layer
+* @param no_of_inputs The number of inputs to each unit
+* @returns Size in bytes
+*/
+static size_t bp_layer_storage_size(int no_of_units, int no_of_inputs)
+{
+    return deeplearn_arena_size(no_of_units*sizeof(bp_neuron)) +
+        deeplearn_arena_size(no_of_inputs*sizeof(bp_neuron*)) +
+        deeplearn_arena_size(no_of_units*no_of_inputs*sizeof(float))*2 +
+        deeplearn_arena_size(no_of_units*sizeof(float))*2;
+}
+
+/**
+* @brief Takes layer-major storage for a layer of units from an arena.
+*        The units themselves are initialised by the caller
+* @param layer Layer object
+* @param no_of_units The number of units within the layer
+* @param no_of_inputs The number of inputs to each unit
+* @param input_units The units which feed into this layer
+* @param arena Arena sized with bp_layer_storage_size
+*/
+static void bp_layer_init(bp_layer * layer,
+                          int no_of_units, int no_of_inputs,
+                          bp_neuron ** input_units,
+                          deeplearn_arena * arena)
+{
+    layer->no_of_units = no_of_units;
+    layer->no_of_inputs = no_of_inputs;
+
+    layer->units = (bp_neuron*)
+        deeplearn_arena_alloc(arena, no_of_units*sizeof(bp_neuron));
+    layer->input_units = (bp_neuron**)
+        deeplearn_arena_alloc(arena, no_of_inputs*sizeof(bp_neuron*));
+    memcpy((void*)layer->input_units, (void*)input_units,
+           no_of_inputs*sizeof(bp_neuron*));
+
+    /* the arena is zeroed, but the weights are written first by the
+       threads which will update them */
+    layer->weights = ARENA_FLOATALLOC(arena, no_of_units*no_of_inputs);
+    layer->last_weight_change =
+        ARENA_FLOATALLOC(arena, no_of_units*no_of_inputs);
+    deeplearn_first_touch(layer->weights, no_of_units, no_of_inputs);
+    deeplearn_first_touch(layer->last_weight_change,
+                          no_of_units, no_of_inputs);
+    layer->values = ARENA_FLOATALLOC(arena, no_of_units);
+    layer->errors = ARENA_FLOATALLOC(arena, no_of_units);
+
+    layer->activation = ACTIVATION_FUNCTION;
+
+    /* mini-batch buffers are allocated on first use */
+    layer->batch_values = 0;
+    layer->batch_errors = 0;
+    layer->weight_gradients = 0;
+    layer->bias_gradients = 0;
+
+    /* moments are allocated when an adaptive optimizer is chosen */
+    layer->moment1 = 0;
+    layer->moment2 = 0;
+    layer->bias_moment1 = 0;
+    layer->bias_moment2 = 0;
+
+    /* weights are fed forward at full precision by default */
+    layer->weights_bf16 = 0;
+
+    /* layers are dense until they are sparsified */
+    layer->row_start = 0;
+    layer->columns = 0;
+
+    /* every input is used until units drop out within a mini-batch */
+    layer->active_inputs = 0;
+    layer->no_of_active_inputs = 0;
+    layer->compact_weights = 0;
+    layer->compact_inputs = 0;
+    layer->compact_errors = 0;
+    layer->compact_capacity = 0;
+}
+
+/**
+* @brief Initialises a unit within a layer so that its arrays point
+*        into the layer storage
+* @param layer Layer object
+* @param index Index of the unit within the layer
+* @param random_seed Random number generator seed
+* @returns The initialised unit
+*/
+static bp_neuron * bp_layer_init_unit(bp_layer * layer, int index,
+                                      unsigned int * random_seed)
+{
+    bp_neuron * n = &layer->units[index];
+    int row = index*layer->no_of_inputs;
+
+    bp_neuron_init_storage(n, layer->no_of_inputs,
+                           &layer->weights[row],
+                           &layer->last_weight_change[row],
+                           layer->input_units, random_seed);
+    return n;
+}
+
+/**
+* @brief Deallocates the buffers of a layer which are not held within
+*        the arena of the network
+* @param layer Layer object
+*/
+static void bp_layer_free(bp_layer * layer)
+{
+    deeplearn_backend_weights_changed(layer->weights);
+    free(layer->batch_values);
+    free(layer->batch_errors);
+    free(layer->weight_gradients);
+    free(layer->bias_gradients);
+    optimizer_moments_free(&layer->moment1, &layer->moment2);
+    optimizer_moments_free(&layer->bias_moment1, &layer->bias_moment2);
+    free(layer->weights_bf16);
+    free(layer->row_start);
+    free(layer->columns);
+    free(layer->active_inputs);
+    free(layer->compact_weights);
+    free(layer->compact_inputs);
+    free(layer->compact_errors);
+}
+
+/**
+* @brief Returns the size of the arena which holds a network.
+*        This covers everything created by bp_init, but not the
+*        buffers which are allocated later, such as for mini-batches
+* @param no_of_inputs The number of input units
+* @param no_of_hiddens The number of units in each hidden layer
+* @param hidden_layers The number of hidden layers
+* @param no_of_outputs The number of output units
+* @returns Size in bytes
+*/
+size_t bp_storage_size(int no_of_inputs,
+                       int no_of_hiddens,
+                       int hidden_layers,
+                       int no_of_outputs)
+{
+    bp dims;
+    size_t size;
+
+    dims.no_of_hiddens = no_of_hiddens;
+    dims.hidden_layers = hidden_layers;
+    dims.no_of_outputs = no_of_outputs;
+
+    /* input units, each with a single weight and connection */
+    size = deeplearn_arena_size(no_of_inputs*sizeof(bp_neuron*)) +
+        deeplearn_arena_size(no_of_inputs*sizeof(bp_neuron)) +
+        deeplearn_arena_size(no_of_inputs*sizeof(float))*4 +
+        deeplearn_arena_size(no_of_inputs*sizeof(bp_neuron*));
+
+    size += deeplearn_arena_size(hidden_layers*sizeof(bp_neuron**));
+    COUNTUP(l, hidden_layers)
+        size += deeplearn_arena_size(HIDDENS_IN_LAYER(&dims,l)*
+                                     sizeof(bp_neuron*));
+    size += deeplearn_arena_size(no_of_outputs*sizeof(bp_neuron*));
+    size += deeplearn_arena_size((hidden_layers+1)*sizeof(bp_layer));
+
+    COUNTUP(l, hidden_layers)
+        size += bp_layer_storage_size(HIDDENS_IN_LAYER(&dims,l),
+                                      (l == 0) ? no_of_inputs :
+                                      HIDDENS_IN_LAYER(&dims,l-1));
+    size += bp_layer_storage_size(no_of_outputs,
+                                  HIDDENS_IN_LAYER(&dims,hidden_layers-1));
+    return size;
+}
+
 /**
 * @brief Initialise a backprop neural net
 * @param net Backprop neural net object
@@ -46,11 +213,51 @@ int bp_init(bp * net,
             int no_of_outputs,
             unsigned int * random_seed)
 {
-    bp_neuron * n;
+    if (deeplearn_arena_init(&net->arena,
+                             bp_storage_size(no_of_inputs, no_of_hiddens,
+                                             hidden_layers,
+                                             no_of_outputs)) != 0)
+        return -1;
+
+    return bp_init_arena(net, no_of_inputs, no_of_hiddens,
+                         hidden_layers, no_of_outputs,
+                         &net->arena, random_seed);
+}
+
+/**
+* @brief Initialise a backprop neural net within an arena, which may
+*        also hold other objects. The arena is not freed by bp_free
+*        unless it is the arena of the network
+* @param net Backprop neural net object
+* @param no_of_inputs The number of input units
+* @param no_of_hiddens The number of units in each hidden layer
+* @param hidden_layers The number of hidden layers
+* @param no_of_outputs The number of output units
+* @param arena Arena with at least bp_storage_size bytes remaining
+* @param random_seed The random number generator seed
+* @returns zero on success
+*/
+int bp_init_arena(bp * net,
+                  int no_of_inputs,
+                  int no_of_hiddens,
+                  int hidden_layers,
+                  int no_of_outputs,
+                  deeplearn_arena * arena,
+                  unsigned int * random_seed)
+{
+    bp_neuron * input_units;
+    float * input_weights, * input_weight_changes;
+    bp_neuron ** input_connections;
+
+    /* the storage belongs to whoever owns the arena */
+    if (arena != &net->arena)
+        deeplearn_arena_clear(&net->arena);
 
     net->learning_rate = 0.2f;
     net->noise = 0.0f;
     net->random_seed = *random_seed;
+    rand_streams_init(net->random_streams, DEEPLEARN_MAX_THREADS,
+                      net->random_seed);
     net->backprop_error = DEEPLEARN_UNKNOWN_ERROR;
     net->backprop_error_average = DEEPLEARN_UNKNOWN_ERROR;
     net->backprop_error_total = DEEPLEARN_UNKNOWN_ERROR;
@@ -58,82 +265,73 @@ int bp_init(bp * net,
     net->pruning_cycle = 0;
     net->pruning_rate = 0.1f;
     net->dropout_percent = 20;
+    net->batch_capacity = 0;
+    optimizer_init(&net->optimizer, OPTIMIZER_SGD);
+    net->weight_precision = DEEPLEARN_PRECISION_FP32;
 
     net->no_of_inputs = no_of_inputs;
-    NEURON_ARRAY_ALLOC(net->inputs, no_of_inputs);
-    if (!net->inputs)
-        return -1;
-
     net->no_of_hiddens = no_of_hiddens;
     net->no_of_outputs = no_of_outputs;
     net->hidden_layers = hidden_layers;
-    NEURON_LAYERS_ALLOC(net->hiddens, hidden_layers);
-    if (!net->hiddens)
-        return -2;
 
-    COUNTDOWN(l, hidden_layers) {
-        NEURON_ARRAY_ALLOC(net->hiddens[l], HIDDENS_IN_LAYER(net,l));
-        if (!net->hiddens[l])
-            return -3;
-    }
-
-    NEURON_ARRAY_ALLOC(net->outputs, no_of_outputs);
-    if (!net->outputs)
-        return -4;
+    /* the arena is zeroed */
+    net->inputs = (bp_neuron**)
+        deeplearn_arena_alloc(arena, no_of_inputs*sizeof(bp_neuron*));
+    input_units = (bp_neuron*)
+        deeplearn_arena_alloc(arena, no_of_inputs*sizeof(bp_neuron));
+    input_weights = ARENA_FLOATALLOC(arena, no_of_inputs);
+    input_weight_changes = ARENA_FLOATALLOC(arena, no_of_inputs);
+    input_connections = (bp_neuron**)
+        deeplearn_arena_alloc(arena, no_of_inputs*sizeof(bp_neuron*));
+    net->input_values = ARENA_FLOATALLOC(arena, no_of_inputs);
+    net->input_errors = ARENA_FLOATALLOC(arena, no_of_inputs);
+
+    net->hiddens = (bp_neuron***)
+        deeplearn_arena_alloc(arena, hidden_layers*sizeof(bp_neuron**));
+    COUNTUP(l, hidden_layers)
+        net->hiddens[l] = (bp_neuron**)
+            deeplearn_arena_alloc(arena, HIDDENS_IN_LAYER(net,l)*
+                                  sizeof(bp_neuron*));
+    net->outputs = (bp_neuron**)
+        deeplearn_arena_alloc(arena, no_of_outputs*sizeof(bp_neuron*));
+    net->layers = (bp_layer*)
+        deeplearn_arena_alloc(arena, (hidden_layers+1)*sizeof(bp_layer));
 
     /* create inputs */
     COUNTDOWN(i, net->no_of_inputs) {
-        NEURONALLOC(net->inputs[i]);
-        if (!net->inputs[i])
-            return -5;
-
-        if (bp_neuron_init(net->inputs[i], 1, random_seed) != 0)
-            return -6;
+        net->inputs[i] = &input_units[i];
+        bp_neuron_init_storage(net->inputs[i], 1,
+                               &input_weights[i], &input_weight_changes[i],
+                               &input_connections[i], random_seed);
     }
 
     /* create hiddens */
     COUNTUP(l, hidden_layers) {
-        COUNTUP(i, HIDDENS_IN_LAYER(net,l)) {
-            net->hiddens[l][i] = (bp_neuron*)malloc(sizeof(bp_neuron));
-            if (!net->hiddens[l][i])
-                return -7;
-
-            n = net->hiddens[l][i];
-            if (l == 0) {
-                if (bp_neuron_init(n, no_of_inputs, random_seed) != 0)
-                    return -8;
-
-                /* connect to input layer */
-                COUNTDOWN(j, net->no_of_inputs)
-                    bp_neuron_add_connection(n, j, net->inputs[j]);
-            }
-            else {
-                if (bp_neuron_init(n, HIDDENS_IN_LAYER(net,l-1),
-                                   random_seed) != 0)
-                    return -9;
-
-                /* connect to previous hidden layer */
-                COUNTDOWN(j, HIDDENS_IN_LAYER(net,l-1))
-                    bp_neuron_add_connection(n, j, net->hiddens[l-1][j]);
-            }
+        if (l == 0) {
+            /* connect to input layer */
+            bp_layer_init(&net->layers[l], HIDDENS_IN_LAYER(net,l),
+                          no_of_inputs, net->inputs, arena);
+        }
+        else {
+            /* connect to previous hidden layer */
+            bp_layer_init(&net->layers[l], HIDDENS_IN_LAYER(net,l),
+                          HIDDENS_IN_LAYER(net,l-1),
+                          net->hiddens[l-1], arena);
         }
+
+        COUNTUP(i, HIDDENS_IN_LAYER(net,l))
+            net->hiddens[l][i] =
+                bp_layer_init_unit(&net->layers[l], i, random_seed);
     }
 
     /* create outputs */
-    COUNTDOWN(i, net->no_of_outputs) {
-        NEURONALLOC(net->outputs[i]);
-        if (!net->outputs[i])
-            return -10;
-
-        n = net->outputs[i];
-        if (bp_neuron_init(n, HIDDENS_IN_LAYER(net,hidden_layers-1),
-                           random_seed) != 0)
-            return -11;
-
-        COUNTDOWN(j, HIDDENS_IN_LAYER(net,hidden_layers-1))
-            bp_neuron_add_connection(n, j, net->hiddens[hidden_layers-1][j]);
-    }
+    bp_layer_init(&net->layers[hidden_layers], no_of_outputs,
+                  HIDDENS_IN_LAYER(net,hidden_layers-1),
+                  net->hiddens[hidden_layers-1], arena);
 
+    COUNTDOWN(i, net->no_of_outputs)
+        net->outputs[i] =
+            bp_layer_init_unit(&net->layers[hidden_layers], i, random_seed);
     return 0;
 }
 
@@ -143,30 +341,294 @@ int bp_init(bp * net,
 */
 void bp_free(bp * net)
 {
-    COUNTDOWN(i, net->no_of_inputs) {
-        bp_neuron_free(net->inputs[i]);
-        free(net->inputs[i]);
-        net->inputs[i] = 0;
+    /* the units and their arrays are held within the arena */
+    COUNTDOWN(l, net->hidden_layers+1)
+        bp_layer_free(&net->layers[l]);
+    deeplearn_arena_free(&net->arena);
+
+    net->inputs = 0;
+    net->hiddens = 0;
+    net->outputs = 0;
+    net->layers = 0;
+}
+
+/**
+* @brief Returns the dense activations which feed into the given layer
+* @param net Backprop neural net object
+* @param layer_index Index of the layer, where hidden_layers is the output layer
+* @returns Array of input activations
+*/
+static float * bp_layer_inputs(bp * net, int layer_index)
+{
+    if (layer_index == 0)
+        return net->input_values;
+
+    return net->layers[layer_index-1].values;
+}
+
+/**
+* @brief Copies the input unit values into a dense array, so that
+*        the first hidden layer doesn't need to chase input pointers
+* @param net Backprop neural net object
+*/
+static void bp_gather_inputs(bp * net)
+{
+    COUNTDOWN(i, net->no_of_inputs)
+        net->input_values[i] = net->inputs[i]->value;
+}
+
+/**
+* @brief Returns the largest number of multiply-adds within any layer,
+*        which decides whether a pass through the network is run in
+*        parallel
+* @param net Backprop neural net object
+* @return The number of multiply-adds in the largest layer
+*/
+static int bp_max_layer_work(bp * net)
+{
+    int work = 0;
+
+    COUNTDOWN(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+        if (layer->no_of_units*layer->no_of_inputs > work)
+            work = layer->no_of_units*layer->no_of_inputs;
     }
-    free(net->inputs);
+    return work;
+}
 
-    COUNTDOWN(l, net->hidden_layers) {
-        COUNTDOWN(i, HIDDENS_IN_LAYER(net,l)) {
-            bp_neuron_free(net->hiddens[l][i]);
-            free(net->hiddens[l][i]);
-            net->hiddens[l][i] = 0;
-        }
-        free(net->hiddens[l]);
-        net->hiddens[l] = 0;
+/**
+* @brief Returns the weighted sum of the inputs to a unit, using the
+*        bfloat16 copy of the weights of a dense layer if there is one.
+*        Sparse layers are trained without updating the copy
+* @param layer Layer object
+* @param i Index of the unit within the layer
+* @param inputs Activations of the previous layer
+* @return Weighted sum of the inputs
+*/
+static float bp_layer_dot(bp_layer * layer, int i, const float * inputs)
+{
+    const int no_of_inputs = layer->no_of_inputs;
+
+    if ((layer->weights_bf16 != 0) && (layer->row_start == 0))
+        return deeplearn_dot_bf16(&layer->weights_bf16[i*no_of_inputs],
+                                  inputs, no_of_inputs);
+
+    return deeplearn_dot(&layer->weights[i*no_of_inputs],
+                         inputs, no_of_inputs);
+}
+
+/**
+* @brief Updates the bfloat16 copy of the weights of a unit after
+*        they have been changed
+* @param layer Layer object
+* @param i Index of the unit within the layer
+*/
+static void bp_layer_encode_unit(bp_layer * layer, int i)
+{
+    const int no_of_inputs = layer->no_of_inputs;
+
+    if (layer->weights_bf16 == 0)
+        return;
+
+    deeplearn_bf16_encode(&layer->weights_bf16[i*no_of_inputs],
+                          &layer->weights[i*no_of_inputs], no_of_inputs);
+}
+
+/**
+* @brief Returns the weighted sum of the inputs to a dense unit, with
+*        each input randomly dropping out. The dropout mask is generated
+*        a block of inputs at a time and applied without branching
+* @param w Weights of the unit
+* @param inputs Activations of the previous layer
+* @param no_of_inputs The number of inputs
+* @param drop_key Key of the counter based random numbers for the unit
+* @param counter Position of the first input within the random numbers
+* @param drop_threshold Threshold returned by rand_mask_threshold
+* @return Weighted sum of the inputs which remain
+*/
+static float bp_dot_dropout(const float * w, const float * inputs,
+                            int no_of_inputs,
+                            unsigned int drop_key,
+                            unsigned int counter,
+                            unsigned int drop_threshold)
+{
+    unsigned int mask[DROPOUT_MASK_INPUTS/RAND_MASK_BITS];
+    float sum = 0;
+
+    for (int j = 0; j < no_of_inputs; j += DROPOUT_MASK_INPUTS) {
+        int n = no_of_inputs - j;
+
+        if (n > DROPOUT_MASK_INPUTS)
+            n = DROPOUT_MASK_INPUTS;
+
+        rand_mask(drop_key, counter + (unsigned int)j, mask, n,
+                  drop_threshold);
+        sum += deeplearn_dot_masked(&w[j], &inputs[j], mask, n);
     }
-    free(net->hiddens);
+    return sum;
+}
 
-    COUNTDOWN(i, net->no_of_outputs) {
-        bp_neuron_free(net->outputs[i]);
-        free(net->outputs[i]);
-        net->outputs[i] = 0;
+/**
+* @brief Returns the weighted sum of the inputs to a pruned unit, with
+*        each input randomly dropping out. The same inputs drop out as
+*        for bp_dot_dropout
+* @param layer Layer object
+* @param i Index of the unit within the layer
+* @param inputs Activations of the previous layer
+* @param drop_key Key of the counter based random numbers for the unit
+* @param counter Position of the first input within the random numbers
+* @param drop_threshold Threshold returned by rand_mask_threshold
+* @return Weighted sum of the inputs which remain
+*/
+static float bp_layer_sparse_dot(bp_layer * layer, int i,
+                                 const float * inputs,
+                                 unsigned int drop_key,
+                                 unsigned int counter,
+                                 unsigned int drop_threshold)
+{
+    const float * w = &layer->weights[i*layer->no_of_inputs];
+    float sum = 0;
+
+    if (drop_threshold == 0) {
+        FOR(k, layer->row_start[i], layer->row_start[i+1])
+            sum += w[layer->columns[k]] * inputs[layer->columns[k]];
+        return sum;
+    }
+
+    FOR(k, layer->row_start[i], layer->row_start[i+1]) {
+        int j = layer->columns[k];
+        unsigned int v = rand_counter(drop_key, counter + (unsigned int)j);
+        sum += w[j] * inputs[j] * (float)(v >= drop_threshold);
+    }
+    return sum;
+}
+
+/**
+* @brief Feeds a dense input vector through a single unit of a layer
+* @param layer Layer object
+* @param i Index of the unit within the layer
+* @param inputs Activations of the previous layer
+* @param noise Noise in the range 0.0 to 1.0
+* @param drop_threshold Threshold below which inputs drop out,
+*        from rand_mask_threshold, or zero for no dropouts
+* @param drop_key Key of the counter based random numbers for the layer
+* @param random_seed Random number generator seed
+*/
+static void bp_layer_feed_forward_unit(bp_layer * layer, int i,
+                                       float * inputs, float noise,
+                                       unsigned int drop_threshold,
+                                       unsigned int drop_key,
+                                       unsigned int * random_seed)
+{
+    bp_neuron * n = &layer->units[i];
+    unsigned int unit_key = 0;
+    float adder;
+
+    /* if the neuron has dropped out then set its output to zero */
+    if (n->excluded > 0) {
+        n->value = 0;
+        layer->values[i] = 0;
+        return;
+    }
+
+    if (drop_threshold != 0)
+        unit_key = rand_counter(drop_key, (unsigned int)i);
+
+    /* Sum with initial bias */
+    adder = n->bias;
+
+    /* calculate weighted sum of inputs */
+    if (layer->row_start != 0) {
+        adder += bp_layer_sparse_dot(layer, i, inputs, unit_key, 0,
+                                     drop_threshold);
+    }
+    else if (drop_threshold == 0) {
+        adder += bp_layer_dot(layer, i, inputs);
+    }
+    else {
+        adder += bp_dot_dropout(&layer->weights[i*layer->no_of_inputs],
+                                inputs, layer->no_of_inputs, unit_key, 0,
+                                drop_threshold);
+    }
+
+    /* add some random noise */
+    if (noise > 0)
+        adder = ((1.0f - noise) * adder) +
+            (noise * ((rand_num(random_seed)%10000)/10000.0f));
+
+    /* activation function */
+    n->value = activation_value(layer->activation, adder);
+    layer->values[i] = n->value;
+}
+
+/**
+* @brief Feeds a dense input vector through a layer.
+*        This is called by every thread within a parallel region, or
+*        from outside of one. Small layers are run on the master thread
+* @param layer Layer object
+* @param inputs Activations of the previous layer
+* @param noise Noise in the range 0.0 to 1.0
+* @param drop_threshold Threshold below which inputs drop out,
+*        from rand_mask_threshold, or zero for no dropouts
+* @param drop_key Key of the counter based random numbers for the layer
+* @param streams Per-thread random number streams
+*/
+static void bp_layer_feed_forward(bp_layer * layer, float * inputs,
+                                  float noise,
+                                  unsigned int drop_threshold,
+                                  unsigned int drop_key,
+                                  rand_stream * streams)
+{
+    if (!deeplearn_parallel(layer->no_of_units*layer->no_of_inputs)) {
+#pragma omp master
+        COUNTDOWN(i, layer->no_of_units)
+            bp_layer_feed_forward_unit(layer, i, inputs, noise,
+                                       drop_threshold, drop_key,
+                                       &streams[0].seed);
+#pragma omp barrier
+        return;
     }
-    free(net->outputs);
+
+#pragma omp for schedule(static)
+    COUNTDOWN(i, layer->no_of_units)
+        bp_layer_feed_forward_unit(layer, i, inputs, noise,
+                                   drop_threshold, drop_key,
+                                   rand_stream_seed(streams,
+                                                    DEEPLEARN_MAX_THREADS));
+}
+
+/**
+* @brief Returns the key of the counter based random numbers used to
+*        drop out inputs during a training step, drawing it from the
+*        seed of the network only if there are dropouts
+* @param net Backprop neural net object
+* @returns key
+*/
+static unsigned int bp_dropout_key(bp * net)
+{
+    if (net->dropout_percent == 0)
+        return 0;
+    return rand_num(&net->random_seed);
+}
+
+/**
+* @brief Propagates the dense inputs through a given number of layers.
+*        This is called by every thread within a parallel region
+* @param net Backprop neural net object
+* @param layers The number of layers to propagate through
+* @param drop_threshold Threshold below which inputs drop out,
+*        from rand_mask_threshold, or zero for no dropouts
+* @param drop_key Key of the counter based random numbers for this step
+*/
+static void bp_feed_forward_team(bp * net, int layers,
+                                 unsigned int drop_threshold,
+                                 unsigned int drop_key)
+{
+    COUNTUP(l, layers)
+        bp_layer_feed_forward(&net->layers[l], bp_layer_inputs(net, l),
+                              net->noise, drop_threshold,
+                              rand_counter(drop_key, (unsigned int)l),
+                              net->random_streams);
 }
 
 /**
@@ -176,100 +638,186 @@ void bp_free(bp * net)
 */
 void bp_feed_forward(bp * net, int learning)
 {
-    unsigned int drop_percent = 0;
-
-    if (learning != 0)
-        drop_percent = (unsigned int)(net->dropout_percent*100);
+    unsigned int drop_threshold = 0, drop_key = 0;
 
-    /* for each hidden layer */
-    COUNTUP(l, net->hidden_layers) {
-        /* For each unit within the layer */
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
-        COUNTDOWN(i, HIDDENS_IN_LAYER(net,l))
-            bp_neuron_feedForward(net->hiddens[l][i],
-                                  net->noise, drop_percent,
-                                  &net->random_seed);
+    if (learning != 0) {
+        drop_threshold =
+            rand_mask_threshold((unsigned int)(net->dropout_percent*100));
+        drop_key = bp_dropout_key(net);
     }
 
-    /* for each unit in the output layer */
-    COUNTDOWN(i, net->no_of_outputs)
-        bp_neuron_feedForward(net->outputs[i], net->noise, drop_percent,
-                              &net->random_seed);
+    bp_gather_inputs(net);
+
+    /* for each hidden layer followed by the output layer */
+#pragma omp parallel num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(bp_max_layer_work(net)))
+    bp_feed_forward_team(net, net->hidden_layers+1, drop_threshold,
+                         drop_key);
 }
 
 /**
 * @brief Propagates the current inputs through a given number of
-*        layers of the network
+*        layers of the network.  This is used during pretraining, where
+*        the layers being propagated through have already been trained,
+*        so no dropouts are applied
 * @param net Backprop neural net object
 * @param layers The number of layers to propagate through
 */
 void bp_feed_forward_layers(bp * net, int layers)
 {
-    unsigned int drop_percent =
-        (unsigned int)(net->dropout_percent*100);
+    bp_gather_inputs(net);
 
-    /* for each hidden layer */
-    COUNTUP(l, layers) {
-        /* if this layer is a hidden layer */
-        if (l < net->hidden_layers) {
-            /* For each unit within the layer */
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
-            COUNTDOWN(i, HIDDENS_IN_LAYER(net,l))
-                bp_neuron_feedForward(net->hiddens[l][i],
-                                      net->noise, drop_percent,
-                                      &net->random_seed);
-        }
-        else {
-            /* For each unit within the output layer */
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
-            COUNTDOWN(i, net->no_of_outputs)
-                bp_neuron_feedForward(net->outputs[i],
-                                      net->noise, drop_percent,
-                                      &net->random_seed);
-        }
-    }
+    if (layers > net->hidden_layers+1)
+        layers = net->hidden_layers+1;
+
+#pragma omp parallel num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(bp_max_layer_work(net)))
+    bp_feed_forward_team(net, layers, 0, 0);
 }
 
 /**
-* @brief back-propogate errors from the output layer towards the input layer
-* @param net Backprop neural net object
+* @brief Activation function
+* @param x The weighted sum of inputs
+* @return Result of the activation function
 */
-void bp_backprop(bp * net, int current_hidden_layer)
+static float af(float x)
 {
-    int neuron_count=0;
-    int start_hidden_layer = current_hidden_layer-1;
-    float errorPercent=0;
+    return x * (1.0f - x);
+}
 
-    /* clear all previous backprop errors */
-    COUNTDOWN(i, net->no_of_inputs)
-        net->inputs[i]->backprop_error = 0;
+/**
+* @brief Returns the delta of a unit, which is its error multiplied by
+*        the derivative of its activation
+* @param layer Layer object
+* @param i Index of the unit within the layer
+* @returns delta, or zero if the unit has dropped out
+*/
+static float bp_layer_delta(bp_layer * layer, int i)
+{
+    if (layer->units[i].excluded > 0) return 0;
+    return layer->errors[i] * af(layer->values[i]);
+}
 
-    /* for every hidden layer */
-    if (start_hidden_layer < 0)
-        start_hidden_layer = 0;
+/**
+* @brief Sets the error of a unit from its desired value, if it has one
+* @param layer Layer object
+* @param i Index of the unit within the layer
+*/
+static void bp_layer_unit_error(bp_layer * layer, int i)
+{
+    bp_neuron * n = &layer->units[i];
 
-    FOR(l, start_hidden_layer, net->hidden_layers) {
-        /* For each unit within the layer */
-        COUNTDOWN(i, HIDDENS_IN_LAYER(net,l))
-            net->hiddens[l][i]->backprop_error = 0;
+    /* output unit */
+    if ((n->excluded == 0) && (n->desired_value > -1))
+        layer->errors[i] = n->desired_value - layer->values[i];
+}
+
+/**
+* @brief Gathers the back-propagated errors of a contiguous block of
+*        inputs from the deltas of every unit within the layer.
+*        Each input is only written by the thread which owns its block
+* @param layer Layer object
+* @param input_errors Errors of the previous layer
+* @param start Index of the first input in the block
+* @param end Index after the last input in the block
+*/
+static void bp_layer_backprop_block(bp_layer * layer, float * input_errors,
+                                    int start, int end)
+{
+    const int no_of_inputs = layer->no_of_inputs;
+
+    COUNTUP(i, layer->no_of_units) {
+        float * w = &layer->weights[i*no_of_inputs];
+        float bperr = bp_layer_delta(layer, i);
+
+        if (bperr == 0) continue;
+
+        if (layer->row_start != 0) {
+            FOR(k, layer->row_start[i], layer->row_start[i+1]) {
+                int j = layer->columns[k];
+                if ((j >= start) && (j < end))
+                    input_errors[j] += bperr * w[j];
+            }
+            continue;
+        }
+        deeplearn_axpy(&input_errors[start], bperr, &w[start], end - start);
     }
+}
 
-    /* now back-propogate the error from the output units */
-    net->backprop_error_total = 0;
+/**
+* @brief Back-propagates the errors of a layer into the dense error
+*        array of the previous layer. Rather than each unit adding into
+*        the errors of every input, which would race between threads,
+*        the inputs are split into one block per thread, aligned to
+*        BP_BACKPROP_BLOCK, and each thread gathers the errors of its
+*        own block.
+*        This is called by every thread within a parallel region, or
+*        from outside of one. Small layers are run on the master thread
+* @param layer Layer object
+* @param input_errors Errors of the previous layer
+*/
+static void bp_layer_backprop(bp_layer * layer, float * input_errors)
+{
+    const int no_of_inputs = layer->no_of_inputs;
+    int block, blocks;
+
+    if (!deeplearn_parallel(layer->no_of_units*no_of_inputs)) {
+#pragma omp master
+        {
+            COUNTDOWN(i, layer->no_of_units)
+                bp_layer_unit_error(layer, i);
+            bp_layer_backprop_block(layer, input_errors, 0, no_of_inputs);
+        }
+#pragma omp barrier
+        return;
+    }
 
-    /* for every output unit */
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
-    COUNTDOWN(i, net->no_of_outputs) {
-        bp_neuron_backprop(net->outputs[i]);
+    /* errors of every unit are known before any are gathered */
+#pragma omp for schedule(static)
+    COUNTDOWN(i, layer->no_of_units)
+        bp_layer_unit_error(layer, i);
+
+    block = (no_of_inputs + omp_get_num_threads() - 1) /
+        omp_get_num_threads();
+    block = (block + BP_BACKPROP_BLOCK - 1) /
+        BP_BACKPROP_BLOCK * BP_BACKPROP_BLOCK;
+    blocks = (no_of_inputs + block - 1) / block;
+
+#pragma omp for schedule(static)
+    COUNTUP(b, blocks) {
+        int start = b*block;
+        int end = start + block;
+        if (end > no_of_inputs)
+            end = no_of_inputs;
+        bp_layer_backprop_block(layer, input_errors, start, end);
     }
+}
+
+/**
+* @brief Copies the dense errors of a layer back into its units
+* @param layer Layer object
+*/
+static void bp_layer_scatter_errors(bp_layer * layer)
+{
+    COUNTDOWN(i, layer->no_of_units)
+        layer->units[i].backprop_error = layer->errors[i];
+}
+
+/**
+* @brief Updates the network error statistics from the output layer errors
+* @param net Backprop neural net object
+*/
+static void bp_output_error(bp * net)
+{
+    float errorPercent=0;
+    bp_layer * output_layer = &net->layers[net->hidden_layers];
 
     COUNTDOWN(i, net->no_of_outputs) {
         /* update the total error which is used to assess
             network performance */
-        net->backprop_error_total += net->outputs[i]->backprop_error;
-        errorPercent += fabs(net->outputs[i]->backprop_error);
+        net->backprop_error_total += output_layer->errors[i];
+        errorPercent += fabs(output_layer->errors[i]);
     }
-    neuron_count += net->no_of_outputs;
 
     /* convert summed error to an overall percentage */
     errorPercent = errorPercent * 100 /
@@ -292,39 +840,105 @@ void bp_backprop(bp * net, int current_hidden_layer)
             (net->backprop_error_percent*0.999f) +
             (errorPercent*0.001f);
     }
+}
+
+/**
+* @brief back-propogate errors from the output layer towards the input layer.
+*        This is called by every thread within a parallel region, with
+*        the bookkeeping done by the master thread
+* @param net Backprop neural net object
+* @param current_hidden_layer The hidden layer currently being trained
+*/
+static void bp_backprop_team(bp * net, int current_hidden_layer)
+{
+    int neuron_count=0;
+    int start_hidden_layer = current_hidden_layer-1;
+
+    /* for every hidden layer */
+    if (start_hidden_layer < 0)
+        start_hidden_layer = 0;
+
+#pragma omp master
+    {
+        /* clear all previous backprop errors */
+        FLOATCLEAR(net->input_errors, net->no_of_inputs);
+
+        COUNTDOWN(l, net->hidden_layers+1)
+            FLOATCLEAR(net->layers[l].errors, net->layers[l].no_of_units);
+
+        /* now back-propogate the error from the output units */
+        net->backprop_error_total = 0;
+    }
+#pragma omp barrier
+
+    /* for every output unit */
+    bp_layer_backprop(&net->layers[net->hidden_layers],
+                      net->layers[net->hidden_layers-1].errors);
+
+#pragma omp master
+    {
+        bp_output_error(net);
+        neuron_count += net->no_of_outputs;
+    }
 
     /* back-propogate through the hidden layers */
     for (int l = net->hidden_layers-1; l >= start_hidden_layer; l--) {
         /* for every unit in the hidden layer */
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
-        COUNTDOWN(i, HIDDENS_IN_LAYER(net,l)) {
-            bp_neuron_backprop(net->hiddens[l][i]);
-        }
-
-        COUNTDOWN(i, HIDDENS_IN_LAYER(net,l)) {
-            /* update the total error which is used to assess
-                network performance */
-            net->backprop_error_total += net->hiddens[l][i]->backprop_error;
+        if (l == 0)
+            bp_layer_backprop(&net->layers[l], net->input_errors);
+        else
+            bp_layer_backprop(&net->layers[l], net->layers[l-1].errors);
+
+#pragma omp master
+        {
+            COUNTDOWN(i, HIDDENS_IN_LAYER(net,l)) {
+                /* update the total error which is used to assess
+                    network performance */
+                net->backprop_error_total += net->layers[l].errors[i];
+            }
+            neuron_count += HIDDENS_IN_LAYER(net,l);
         }
-        neuron_count += HIDDENS_IN_LAYER(net,l);
     }
 
-    /* overall average error */
-    net->backprop_error_total =
-        fabs(net->backprop_error_total / neuron_count);
+#pragma omp master
+    {
+        /* copy the dense errors back into the units */
+        COUNTDOWN(i, net->no_of_inputs)
+            net->inputs[i]->backprop_error = net->input_errors[i];
+
+        COUNTDOWN(l, net->hidden_layers+1)
+            bp_layer_scatter_errors(&net->layers[l]);
 
-    /* increment the number of training itterations */
-    if (net->itterations < UINT_MAX)
-        net->itterations++;
+        /* overall average error */
+        net->backprop_error_total =
+            fabs(net->backprop_error_total / neuron_count);
+
+        /* increment the number of training itterations */
+        if (net->itterations < UINT_MAX)
+            net->itterations++;
+    }
+#pragma omp barrier
 }
 
 /**
- * @brief Reprojects the input layer from a given hidden layer neuron
- *        This is like feedforward in reverse, and allows you
- *        to visualise what a hidden layer neuron is representing
- * @param layer The hidden layer within which the neuron resides
- * @param neuron_index The hidden layer index of the neuron to be reprojected
- */
+* @brief back-propogate errors from the output layer towards the input layer
+* @param net Backprop neural net object
+* @param current_hidden_layer The hidden layer currently being trained
+*/
+void bp_backprop(bp * net, int current_hidden_layer)
+{
+#pragma omp parallel num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(bp_max_layer_work(net)))
+    bp_backprop_team(net, current_hidden_layer);
+}
+
+/**
+ * @brief Reprojects the input layer from a given hidden layer neuron
+ *        This is like feedforward in reverse, and allows you
+ *        to visualise what a hidden layer neuron is representing
+ * @param layer The hidden layer within which the neuron resides
+ * @param neuron_index The hidden layer index of the neuron to be reprojected
+ */
 void bp_reproject(bp * net, int layer, int neuron_index)
 {
     bp_neuron * n;
@@ -351,7 +965,8 @@ void bp_reproject(bp * net, int layer, int neuron_index)
         COUNTDOWN(i, HIDDENS_IN_LAYER(net,layer-1)) {
             n = net->hiddens[layer-1][i];
             n->value_reprojected =
-                AF(n->value_reprojected);
+                activation_value(net->layers[layer-1].activation,
+                                 n->value_reprojected);
         }
     }
 
@@ -366,17 +981,141 @@ void bp_reproject(bp * net, int layer, int neuron_index)
         COUNTDOWN(i, HIDDENS_IN_LAYER(net,l-1)) {
             n = net->hiddens[l-1][i];
             n->value_reprojected =
-                AF(n->value_reprojected);
+                activation_value(net->layers[l-1].activation,
+                                 n->value_reprojected);
         }
     }
 }
 
 /**
-* @brief Adjust connection weights and bias values
+* @brief Adjust the bias and weights of a single unit within a layer
+*        using an adaptive optimizer
+* @param layer Layer object
+* @param optimizer The optimizer, with moments held by the layer
+* @param i Index of the unit within the layer
+* @param x Inputs or gradients for each weight of the unit
+* @param a Multiplier applied to each of x
+* @param bias_gradient Gradient of the bias
+*/
+static void bp_layer_optimize_unit(bp_layer * layer,
+                                   const deeplearn_optimizer * optimizer,
+                                   int i, const float * x, float a,
+                                   float bias_gradient)
+{
+    const int no_of_inputs = layer->no_of_inputs;
+    const int row = i*no_of_inputs;
+    bp_neuron * n = &layer->units[i];
+    float * m = (layer->moment1 != 0) ? &layer->moment1[row] : 0;
+    float * bias_m =
+        (layer->bias_moment1 != 0) ? &layer->bias_moment1[i] : 0;
+    float one = 1;
+
+    optimizer_update(optimizer, &n->bias, &n->last_bias_change,
+                     bias_m, &layer->bias_moment2[i],
+                     &one, bias_gradient, 1);
+
+    /* pruned weights of a sparse layer stay at zero */
+    if (layer->row_start != 0) {
+        optimizer_update_sparse(optimizer, &layer->weights[row],
+                                &layer->last_weight_change[row],
+                                m, &layer->moment2[row], x, a,
+                                &layer->columns[layer->row_start[i]],
+                                layer->row_start[i+1] -
+                                layer->row_start[i]);
+        return;
+    }
+
+    optimizer_update(optimizer, &layer->weights[row],
+                     &layer->last_weight_change[row],
+                     m, &layer->moment2[row], x, a, no_of_inputs);
+    bp_layer_encode_unit(layer, i);
+}
+
+/**
+* @brief Adjust the weights of a single unit within a layer
+* @param layer Layer object
+* @param optimizer The optimizer
+* @param i Index of the unit within the layer
+* @param inputs Activations of the previous layer
+* @param learning_rate Learning rate in the range 0.0 to 1.0
+*/
+static void bp_layer_learn_unit(bp_layer * layer,
+                                const deeplearn_optimizer * optimizer,
+                                int i, float * inputs,
+                                float learning_rate)
+{
+    const int no_of_inputs = layer->no_of_inputs;
+    const float e = learning_rate / (1.0f + no_of_inputs);
+    bp_neuron * n = &layer->units[i];
+    float * w = &layer->weights[i*no_of_inputs];
+    float * dw = &layer->last_weight_change[i*no_of_inputs];
+    float gradient, egradient;
+
+    if (n->excluded > 0) return;
+
+    gradient = af(layer->values[i]) * layer->errors[i];
+    n->min_weight = -2;
+    n->max_weight = 2;
+
+    if (optimizer_adaptive(optimizer)) {
+        bp_layer_optimize_unit(layer, optimizer, i, inputs,
+                               gradient, gradient);
+        return;
+    }
+
+    egradient = e * gradient;
+    n->last_bias_change = e * (n->last_bias_change + 1.0f) * gradient;
+    n->bias = CLIP_WEIGHT(n->bias + n->last_bias_change);
+
+    /* for each remaining input of a sparse layer */
+    if (layer->row_start != 0) {
+        FOR(k, layer->row_start[i], layer->row_start[i+1]) {
+            int j = layer->columns[k];
+            dw[j] = egradient * (dw[j] + 1) * inputs[j];
+            w[j] = CLIP_WEIGHT(w[j] + dw[j]);
+        }
+        return;
+    }
+
+    /* for each input */
+    deeplearn_weight_update(w, dw, inputs, egradient, no_of_inputs);
+    bp_layer_encode_unit(layer, i);
+}
+
+/**
+* @brief Adjust the weights of the units within a layer.
+*        This is called by every thread within a parallel region, or
+*        from outside of one. Small layers are run on the master thread
+* @param layer Layer object
+* @param optimizer The optimizer
+* @param inputs Activations of the previous layer
+* @param learning_rate Learning rate in the range 0.0 to 1.0
+*/
+static void bp_layer_learn(bp_layer * layer,
+                           const deeplearn_optimizer * optimizer,
+                           float * inputs, float learning_rate)
+{
+    if (!deeplearn_parallel(layer->no_of_units*layer->no_of_inputs)) {
+#pragma omp master
+        COUNTDOWN(i, layer->no_of_units)
+            bp_layer_learn_unit(layer, optimizer, i, inputs,
+                                learning_rate);
+#pragma omp barrier
+        return;
+    }
+
+#pragma omp for schedule(static)
+    COUNTDOWN(i, layer->no_of_units)
+        bp_layer_learn_unit(layer, optimizer, i, inputs, learning_rate);
+}
+
+/**
+* @brief Adjust connection weights and bias values.
+*        This is called by every thread within a parallel region
 * @param net Backprop neural net object
 * @param current_hidden_layer The hidden layer currently being trained
 */
-void bp_learn(bp * net, int current_hidden_layer)
+static void bp_learn_team(bp * net, int current_hidden_layer)
 {
     int start_hidden_layer = current_hidden_layer-1;
 
@@ -384,18 +1123,19 @@ void bp_learn(bp * net, int current_hidden_layer)
     if (start_hidden_layer < 0)
         start_hidden_layer = 0;
 
-    FOR(l, start_hidden_layer, net->hidden_layers) {
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
-        COUNTDOWN(i, HIDDENS_IN_LAYER(net,l))
-            bp_neuron_learn(net->hiddens[l][i], net->learning_rate);
-    }
-
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
-    COUNTDOWN(i, net->no_of_outputs)
-        bp_neuron_learn(net->outputs[i], net->learning_rate);
+    /* hidden layers followed by the output layer */
+    FOR(l, start_hidden_layer, net->hidden_layers+1)
+        bp_layer_learn(&net->layers[l], &net->optimizer,
+                       bp_layer_inputs(net, l), net->learning_rate);
+}
 
-    /* perform periodic pruning of weights so that there is a cycle
-       of growth and pruning */
+/**
+* @brief Periodically prunes weights so that there is a cycle
+*        of growth and pruning
+* @param net Backprop neural net object
+*/
+static void bp_learn_prune(bp * net)
+{
     if (net->pruning_cycle != 0) {
         if (net->itterations % net->pruning_cycle == 0) {
             if (net->itterations > 0) {
@@ -405,6 +1145,25 @@ void bp_learn(bp * net, int current_hidden_layer)
     }
 }
 
+/**
+* @brief Adjust connection weights and bias values
+* @param net Backprop neural net object
+* @param current_hidden_layer The hidden layer currently being trained
+*/
+void bp_learn(bp * net, int current_hidden_layer)
+{
+    optimizer_step(&net->optimizer);
+
+#pragma omp parallel num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(bp_max_layer_work(net)))
+    bp_learn_team(net, current_hidden_layer);
+
+    COUNTDOWN(l, net->hidden_layers+1)
+        deeplearn_backend_weights_changed(net->layers[l].weights);
+
+    bp_learn_prune(net);
+}
+
 /**
 * @brief Set the value of an input
 * @param net Backprop neural net object
@@ -758,6 +1517,295 @@ float bp_get_output(bp * net, int index)
     return net->outputs[index]->value;
 }
 
+/**
+* @brief Sets the activation function used by a layer
+* @param net Backprop neural net object
+* @param layer Index of the hidden layer, or hidden_layers for the output
+*        layer, or -1 to set every layer
+* @param activation The activation function, eg. AF_SIGMOID
+* @return zero on success
+*/
+int bp_set_activation(bp * net, int layer, int activation)
+{
+    if (!activation_valid(activation))
+        return -1;
+
+    if (layer < 0) {
+        COUNTUP(l, net->hidden_layers+1)
+            net->layers[l].activation = activation;
+        return 0;
+    }
+
+    if (layer > net->hidden_layers)
+        return -2;
+
+    net->layers[layer].activation = activation;
+    return 0;
+}
+
+/**
+* @brief Returns the activation function used by a layer
+* @param net Backprop neural net object
+* @param layer Index of the hidden layer, or hidden_layers for the output layer
+* @return The activation function, eg. AF_SIGMOID
+*/
+int bp_get_activation(bp * net, int layer)
+{
+    return net->layers[layer].activation;
+}
+
+/**
+* @brief Sets the method used to adjust the weights during training.
+*        Adaptive optimizers such as OPTIMIZER_ADAM keep moments for
+*        every weight and bias, which are only allocated when one of
+*        them is chosen. Any previous moments are discarded
+* @param net Backprop neural net object
+* @param type The optimizer, eg. OPTIMIZER_ADAM
+* @return zero on success
+*/
+int bp_set_optimizer(bp * net, int type)
+{
+    if (!optimizer_valid(type))
+        return -1;
+
+    optimizer_init(&net->optimizer, type);
+
+    COUNTDOWN(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+
+        optimizer_moments_free(&layer->moment1, &layer->moment2);
+        optimizer_moments_free(&layer->bias_moment1, &layer->bias_moment2);
+
+        if (optimizer_moments_alloc(type,
+                                    layer->no_of_units, layer->no_of_inputs,
+                                    &layer->moment1,
+                                    &layer->moment2) != 0)
+            return -2;
+
+        if (optimizer_moments_alloc(type, layer->no_of_units, 1,
+                                    &layer->bias_moment1,
+                                    &layer->bias_moment2) != 0)
+            return -3;
+    }
+
+    return 0;
+}
+
+/**
+* @brief Sets the precision of the weights when feeding forward.
+*        With DEEPLEARN_PRECISION_BF16 a bfloat16 copy of the weights
+*        of each layer is kept alongside the float weights, halving the
+*        memory traffic of the forward pass. Training continues to
+*        update the float weights, so small changes accumulate at full
+*        precision, and networks are saved with reduced precision
+* @param net Backprop neural net object
+* @param precision The precision, eg. DEEPLEARN_PRECISION_BF16
+* @return zero on success
+*/
+int bp_set_precision(bp * net, int precision)
+{
+    if ((precision < 0) || (precision >= DEEPLEARN_PRECISIONS))
+        return -1;
+
+    net->weight_precision = precision;
+
+    COUNTDOWN(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+
+        if (precision == DEEPLEARN_PRECISION_FP32) {
+            free(layer->weights_bf16);
+            layer->weights_bf16 = 0;
+            continue;
+        }
+
+        if (layer->weights_bf16 != 0)
+            continue;
+
+        layer->weights_bf16 = (unsigned short*)
+            malloc(layer->no_of_units*layer->no_of_inputs*
+                   sizeof(unsigned short));
+        if (!layer->weights_bf16)
+            return -2;
+    }
+
+    bp_weights_changed(net);
+    return 0;
+}
+
+/**
+* @brief Should be called after the weights have been changed directly,
+*        rather than by training, so that any reduced precision copies
+*        and copies held by the compute backend are updated
+* @param net Backprop neural net object
+*/
+void bp_weights_changed(bp * net)
+{
+    COUNTDOWN(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+
+        if (layer->weights_bf16 != 0)
+            deeplearn_bf16_encode(layer->weights_bf16, layer->weights,
+                                  layer->no_of_units*layer->no_of_inputs);
+    }
+    deeplearn_backend_weights_changed(NULL);
+}
+
+/**
+* @brief Quantizes the weights of a layer into 8 bit integers with a
+*        single scale for the layer, such that weight = q * scale.
+*        The largest weight magnitude maps onto 127
+* @param net Backprop neural net object
+* @param layer Index of the hidden layer, or hidden_layers for the output layer
+* @param weights Returned no_of_units x no_of_inputs quantized weights
+* @param scale Returned scale of the quantized weights
+* @return zero on success
+*/
+int bp_quantize_layer(bp * net, int layer, signed char * weights,
+                      float * scale)
+{
+    bp_layer * l;
+    int no_of_weights;
+    float max = 0;
+
+    if ((layer < 0) || (layer > net->hidden_layers))
+        return -1;
+
+    l = &net->layers[layer];
+    no_of_weights = l->no_of_units*l->no_of_inputs;
+
+    COUNTDOWN(i, no_of_weights) {
+        if (fabs(l->weights[i]) > max)
+            max = fabs(l->weights[i]);
+    }
+
+    *scale = 1.0f;
+    if (max > 0)
+        *scale = max / 127.0f;
+
+    COUNTDOWN(i, no_of_weights)
+        weights[i] = (signed char)roundf(l->weights[i] / *scale);
+
+    return 0;
+}
+
+/**
+* @brief Builds the compressed sparse rows of a layer from its
+*        non-zero weights
+* @param layer Layer object
+* @return zero on success
+*/
+static int bp_layer_compress(bp_layer * layer)
+{
+    const int no_of_inputs = layer->no_of_inputs;
+    int nnz = 0, k = 0;
+    int * columns;
+
+    COUNTDOWN(i, layer->no_of_units*no_of_inputs) {
+        if (layer->weights[i] != 0)
+            nnz++;
+    }
+
+    if (layer->row_start == 0) {
+        layer->row_start =
+            (int*)malloc((layer->no_of_units+1)*sizeof(int));
+        if (!layer->row_start)
+            return -1;
+    }
+
+    columns = (int*)malloc((nnz+1)*sizeof(int));
+    if (!columns)
+        return -2;
+
+    COUNTUP(i, layer->no_of_units) {
+        float * w = &layer->weights[i*no_of_inputs];
+        float * dw = &layer->last_weight_change[i*no_of_inputs];
+
+        layer->row_start[i] = k;
+        COUNTUP(j, no_of_inputs) {
+            if (w[j] != 0)
+                columns[k++] = j;
+            else
+                dw[j] = 0;
+        }
+    }
+    layer->row_start[layer->no_of_units] = k;
+
+    free(layer->columns);
+    layer->columns = columns;
+    return 0;
+}
+
+/**
+* @brief Returns a sparse layer to dense storage, so that any of its
+*        weights can grow again
+* @param layer Layer object
+*/
+static void bp_layer_decompress(bp_layer * layer)
+{
+    free(layer->row_start);
+    free(layer->columns);
+    layer->row_start = 0;
+    layer->columns = 0;
+}
+
+/**
+* @brief Converts layers which have been heavily pruned into compressed
+*        sparse rows, so that only their remaining weights are used
+*        when feeding forward, back-propagating, learning and saving.
+*        Pruned weights of a sparse layer stay at zero.
+*        Layers with fewer zero weights than the given percentage
+*        are returned to dense storage
+* @param net Backprop neural net object
+* @param min_zero_percent The minimum percentage of zero weights for
+*        a layer to become sparse
+* @return The number of sparse layers, or a negative value on error
+*/
+int bp_sparsify(bp * net, int min_zero_percent)
+{
+    int sparse_layers = 0;
+
+    COUNTDOWN(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+        int no_of_weights = layer->no_of_units*layer->no_of_inputs;
+        int zeros = 0;
+
+        COUNTDOWN(i, no_of_weights) {
+            if (layer->weights[i] == 0)
+                zeros++;
+        }
+
+        if (zeros*100 < min_zero_percent*no_of_weights) {
+            bp_layer_decompress(layer);
+            continue;
+        }
+
+        if (bp_layer_compress(layer) != 0)
+            return -1;
+        sparse_layers++;
+    }
+
+    /* dense layers may have been sparse while they were trained */
+    bp_weights_changed(net);
+    return sparse_layers;
+}
+
+/**
+* @brief Rebuilds the compressed rows of any sparse layers after their
+*        weights have been changed directly, for example by pruning
+* @param net Backprop neural net object
+* @return zero on success
+*/
+int bp_update_sparse(bp * net)
+{
+    COUNTDOWN(l, net->hidden_layers+1) {
+        if (net->layers[l].row_start == 0)
+            continue;
+        if (bp_layer_compress(&net->layers[l]) != 0)
+            return -1;
+    }
+    return 0;
+}
+
 /**
 * @brief Gets the desired value of one of the output units
 * @param net Backprop neural net object
@@ -771,7 +1819,8 @@ float bp_get_desired(bp * net, int index)
 
 /**
 * @brief Exclusion flags indicate that a unit has temporarily dropped out.
-*        This clears the all the exclusion flags
+*        This clears the all the exclusion flags, along with any
+*        compacted inputs
 * @param net Backprop neural net object
 */
 static void bp_clear_dropouts(bp * net)
@@ -784,6 +1833,90 @@ static void bp_clear_dropouts(bp * net)
         COUNTDOWN(i, HIDDENS_IN_LAYER(net,l))
             net->hiddens[l][i]->excluded = 0;
     }
+
+    /* compacted layers use every input again */
+    COUNTDOWN(l, net->hidden_layers+1)
+        net->layers[l].no_of_active_inputs = 0;
+}
+
+/**
+ * @brief Returns the weight change at a position within a layer, either
+ *        the given index or, if sampling, a random one
+ * @param layer The layer
+ * @param index Index of the weight within the layer
+ * @param samples The number of weights sampled, or zero for all of them
+ * @param seed Random number generator seed used for sampling
+ * @returns weight change
+ */
+static float bp_weight_gradient_sample(bp_layer * layer, int index,
+                                       int samples, unsigned int * seed)
+{
+    if (samples > 0)
+        index = (int)(rand_num(seed) %
+                      (unsigned int)(layer->no_of_units *
+                                     layer->no_of_inputs));
+    return layer->last_weight_change[index];
+}
+
+/**
+ * @brief Calculates the average magnitude and the standard deviation of
+ *        the weight change for a given layer, optionally from a random
+ *        sample of its weights so that the cost of monitoring does not
+ *        grow with the size of the layer
+ * @param net Backprop neural net object
+ * @param layer_index Index of the layer
+ * @param samples The number of weights to sample, or zero or less to use
+ *        every weight in the layer
+ * @param seed Random number generator seed used for sampling
+ * @param mean Returned average weight change, as bp_weight_gradient_mean
+ * @param std Returned standard deviation, as bp_weight_gradient_std
+ * @returns zero on success
+ */
+int bp_weight_gradient_stats(bp * net, int layer_index,
+                             int samples, unsigned int * seed,
+                             float * mean, float * std)
+{
+    bp_layer * layer;
+    unsigned int start_seed;
+    float total_weight_change = 0;
+    float mean_weight_change = 0;
+    float total_deviation = 0;
+    int n;
+
+    if ((layer_index < 0) || (layer_index >= net->hidden_layers))
+        return -1;
+
+    layer = &net->layers[layer_index];
+    n = layer->no_of_units * layer->no_of_inputs;
+    if ((samples <= 0) || (samples >= n))
+        samples = 0;
+    else
+        n = samples;
+
+    /* the same weights are visited on both passes */
+    start_seed = *seed;
+
+    COUNTDOWN(i, n) {
+        float change = bp_weight_gradient_sample(layer, i, samples, seed);
+        total_weight_change += fabs(change);
+        mean_weight_change += change;
+    }
+    mean_weight_change /= n;
+
+    /* sum of percentage deviation from the average weight magnitude */
+    if (fabs(mean_weight_change) > 0.0000000001f) {
+        *seed = start_seed;
+        COUNTDOWN(i, n) {
+            float change =
+                bp_weight_gradient_sample(layer, i, samples, seed);
+            total_deviation +=
+                fabs((change - mean_weight_change)/mean_weight_change);
+        }
+    }
+
+    *mean = total_weight_change * 10000000 / (float)n;
+    *std = total_deviation * 100 / n;
+    return 0;
 }
 
 /**
@@ -794,200 +1927,1726 @@ static void bp_clear_dropouts(bp * net)
  */
 float bp_weight_gradient_mean(bp * net, int layer_index)
 {
-    float total_weight_change = 0;
-    int no_of_neurons = HIDDENS_IN_LAYER(net, layer_index);
-    int inputs = net->hiddens[layer_index][0]->no_of_inputs;
+    float mean = 0, std = 0;
+    unsigned int seed = 0;
+
+    bp_weight_gradient_stats(net, layer_index, 0, &seed, &mean, &std);
+    return mean;
+}
+
+/**
+ * @brief Returns a weight histogram with values in the range 0 -> 1000
+ * @param net Backprop neural net object
+ * @param histogram Histogram array
+ * @param buckets Number of histogram buckets
+ * @param max_value The maximum weight magnitude
+ */
+void bp_weight_histogram(bp * net,
+                         unsigned int histogram[], int buckets,
+                         float max_value)
+{
+    UINTCLEAR(histogram, buckets);
+
+    COUNTDOWN(l, net->hidden_layers) {
+        int no_of_neurons = HIDDENS_IN_LAYER(net, l);
+        int inputs = net->hiddens[l][0]->no_of_inputs;
+
+        COUNTDOWN(i, no_of_neurons) {
+            bp_neuron * n = net->hiddens[l][i];
+            COUNTDOWN(w, inputs) {
+                float value = fabs(n->weights[w]);
+                if (value < max_value) {
+                    histogram[(int)(value * buckets / max_value)]++;
+                }
+            }
+        }
+    }
+
+    /* normalize */
+    unsigned int max = 1;
+    COUNTDOWN(i, buckets) {
+        if (histogram[i] > max)
+            max = histogram[i];
+    }
 
-    COUNTDOWN(i, no_of_neurons) {
-        bp_neuron * n = net->hiddens[layer_index][i];
-        COUNTDOWN(w, inputs)
-            total_weight_change += fabs(n->last_weight_change[w]);
+    COUNTDOWN(i, buckets) {
+        histogram[i] = histogram[i] * 1000 / max;
+    }
+}
+
+/**
+ * @brief Sets small weights to zero
+ * @param net Backprop neural net object
+ * @param threshold Pruning threshold in the range 0.0 -> 1.0
+ * @returns The percent of weights pruned
+ */
+int bp_prune_weights(bp * net, float threshold)
+{
+    float mean = 0;
+    unsigned int hits = 0;
+    unsigned int pruned = 0;
+
+    COUNTDOWN(l, net->hidden_layers) {
+        int no_of_neurons = HIDDENS_IN_LAYER(net, l);
+        int inputs = net->hiddens[l][0]->no_of_inputs;
+
+        hits += no_of_neurons*inputs;
+
+        COUNTDOWN(i, no_of_neurons) {
+            bp_neuron * n = net->hiddens[l][i];
+            COUNTDOWN(w, inputs) {
+                mean += fabs(n->weights[w]);
+            }
+        }
+    }
+
+    COUNTDOWN(i, net->no_of_outputs) {
+        bp_neuron * n = net->outputs[i];
+        COUNTDOWN(w, n->no_of_inputs) {
+            mean += fabs(n->weights[w]);
+            hits++;
+        }
+    }
+
+    if (hits == 0)
+        return 0;
+
+    mean /= (float)hits;
+    threshold = mean * threshold;
+
+    /* set weights to zero if they are below the pruning threshold */
+    COUNTDOWN(l, net->hidden_layers) {
+        int no_of_neurons = HIDDENS_IN_LAYER(net, l);
+        int inputs = net->hiddens[l][0]->no_of_inputs;
+
+        COUNTDOWN(i, no_of_neurons) {
+            bp_neuron * n = net->hiddens[l][i];
+            COUNTDOWN(w, inputs) {
+                if (fabs(n->weights[w]) < threshold) {
+                    n->weights[w] = 0;
+                    pruned++;
+                }
+            }
+        }
+    }
+
+    COUNTDOWN(i, net->no_of_outputs) {
+        bp_neuron * n = net->outputs[i];
+        COUNTDOWN(w, n->no_of_inputs) {
+            if (fabs(n->weights[w]) < threshold) {
+                n->weights[w] = 0;
+                pruned++;
+            }
+        }
+    }
+
+    /* remove the newly pruned weights from any sparse layers */
+    bp_update_sparse(net);
+    bp_weights_changed(net);
+
+    return (int)(pruned * 100 / hits);
+}
+
+/**
+ * @brief Returns the standard deviation of the weight change for a given layer
+ * @param net Backprop neural net object
+ * @param layer_index Index of the layer
+ * @returns standard deviation of weight change
+ */
+float bp_weight_gradient_std(bp * net, int layer_index)
+{
+    float mean = 0, std = 0;
+    unsigned int seed = 0;
+
+    bp_weight_gradient_stats(net, layer_index, 0, &seed, &mean, &std);
+    return std;
+}
+
+/**
+* @brief Randomly sets exclusion flags to cause units to drop out
+* @param net Backprop neural net object
+*/
+static void bp_dropouts(bp * net)
+{
+    int no_of_dropouts, hidden_units=0;
+    unsigned int key;
+
+    if (net->dropout_percent == 0) return;
+
+    /* total number of hidden units */
+    COUNTDOWN(l, net->hidden_layers)
+        hidden_units += HIDDENS_IN_LAYER(net,l);
+
+    /* total number of dropouts */
+    no_of_dropouts = net->dropout_percent*hidden_units/100;
+
+    /* set the exclusion flags, using counter based random numbers
+       reduced to a range without a modulo */
+    key = rand_num(&net->random_seed);
+    COUNTDOWN(n, no_of_dropouts) {
+        int l = (int)rand_range(key, (unsigned int)(n*2),
+                                (unsigned int)net->hidden_layers);
+        int i = (int)rand_range(key, (unsigned int)(n*2 + 1),
+                                (unsigned int)HIDDENS_IN_LAYER(net,l));
+        net->hiddens[l][i]->excluded = 1;
+    }
+}
+
+/**
+* @brief Update the neural net during training
+* @param net Backprop neural net object
+*/
+void bp_update(bp * net, int current_hidden_layer)
+{
+    unsigned int drop_threshold =
+        rand_mask_threshold((unsigned int)(net->dropout_percent*100));
+    unsigned int drop_key;
+    PROFILE_TIMER(t);
+
+    bp_dropouts(net);
+    drop_key = bp_dropout_key(net);
+    PROFILE_LAP(DEEPLEARN_PHASE_DROPOUTS, t, 1);
+    bp_gather_inputs(net);
+    optimizer_step(&net->optimizer);
+
+    /* a single parallel region for the forward and backward passes,
+       avoiding the cost of starting threads for each layer.
+       Each layer ends with a barrier, so the master thread can time
+       the passes */
+#pragma omp parallel num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(bp_max_layer_work(net)))
+    {
+        bp_feed_forward_team(net, net->hidden_layers+1, drop_threshold,
+                             drop_key);
+#pragma omp master
+        PROFILE_LAP(DEEPLEARN_PHASE_FORWARD, t, 1);
+        bp_backprop_team(net, current_hidden_layer);
+#pragma omp master
+        PROFILE_LAP(DEEPLEARN_PHASE_BACKPROP, t, 1);
+        bp_learn_team(net, current_hidden_layer);
+    }
+
+    COUNTDOWN(l, net->hidden_layers+1)
+        deeplearn_backend_weights_changed(net->layers[l].weights);
+
+    bp_learn_prune(net);
+    PROFILE_LAP(DEEPLEARN_PHASE_LEARN, t, 1);
+    bp_clear_dropouts(net);
+    PROFILE_LAP(DEEPLEARN_PHASE_DROPOUTS, t, 0);
+}
+
+/**
+* @brief Ensures that the mini-batch buffers of each layer can hold
+*        the given number of samples
+* @param net Backprop neural net object
+* @param batch_size The number of samples in the batch
+* @returns zero on success
+*/
+static int bp_batch_alloc(bp * net, int batch_size)
+{
+    if (batch_size <= net->batch_capacity)
+        return 0;
+
+    COUNTDOWN(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+        int units = layer->no_of_units;
+
+        free(layer->batch_values);
+        free(layer->batch_errors);
+        FLOATALLOC(layer->batch_values, batch_size*units);
+        FLOATALLOC(layer->batch_errors, batch_size*units);
+
+        if (layer->weight_gradients == 0) {
+            FLOATALLOC(layer->weight_gradients, units*layer->no_of_inputs);
+            if (layer->weight_gradients)
+                deeplearn_first_touch(layer->weight_gradients,
+                                      units, layer->no_of_inputs);
+        }
+
+        if (layer->bias_gradients == 0)
+            FLOATALLOC(layer->bias_gradients, units);
+
+        if ((!layer->batch_values) || (!layer->batch_errors) ||
+            (!layer->weight_gradients) || (!layer->bias_gradients)) {
+            net->batch_capacity = 0;
+            return -1;
+        }
+    }
+
+    net->batch_capacity = batch_size;
+    return 0;
+}
+
+/**
+* @brief Finds the inputs of a layer which remain after the units of the
+*        previous layer have dropped out. If enough samples share the
+*        same dropouts, the weights of the remaining inputs are gathered
+*        into a compact copy, so that feeding forward, back-propagating
+*        and accumulating gradients over the batch only visit the inputs
+*        which remain
+* @param layer Layer object
+* @param previous The previous layer, whose units are the inputs
+* @param batch_size The number of samples in the batch
+* @returns zero on success
+*/
+static int bp_layer_compact(bp_layer * layer, bp_layer * previous,
+                            int batch_size)
+{
+    const int no_of_inputs = layer->no_of_inputs;
+    int active = 0;
+
+    layer->no_of_active_inputs = 0;
+
+    if (layer->row_start != 0)
+        return 0;
+
+    COUNTUP(j, no_of_inputs)
+        if (previous->units[j].excluded == 0)
+            active++;
+
+    /* gathering a weight costs several times more than using it,
+       so is only worthwhile if enough work is saved over the batch */
+    if ((active == 0) ||
+        ((long)batch_size*(no_of_inputs - active) <
+         (long)DROPOUT_COMPACT_RATIO*active))
+        return 0;
+
+    if (layer->active_inputs == 0) {
+        INTALLOC(layer->active_inputs, no_of_inputs);
+        FLOATALLOC(layer->compact_weights,
+                   layer->no_of_units*no_of_inputs);
+        if ((!layer->active_inputs) || (!layer->compact_weights))
+            return -1;
+    }
+
+    if (batch_size > layer->compact_capacity) {
+        free(layer->compact_inputs);
+        free(layer->compact_errors);
+        FLOATALLOC(layer->compact_inputs, batch_size*no_of_inputs);
+        FLOATALLOC(layer->compact_errors, batch_size*no_of_inputs);
+        if ((!layer->compact_inputs) || (!layer->compact_errors)) {
+            layer->compact_capacity = 0;
+            return -2;
+        }
+        layer->compact_capacity = batch_size;
+    }
+
+    /* remaining inputs, followed by those which dropped out */
+    active = 0;
+    COUNTUP(j, no_of_inputs)
+        if (previous->units[j].excluded == 0)
+            layer->active_inputs[active++] = j;
+    layer->no_of_active_inputs = active;
+    COUNTUP(j, no_of_inputs)
+        if (previous->units[j].excluded > 0)
+            layer->active_inputs[active++] = j;
+    active = layer->no_of_active_inputs;
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(layer->no_of_units*active))
+    COUNTDOWN(i, layer->no_of_units) {
+        const float * w = &layer->weights[i*no_of_inputs];
+        float * wc = &layer->compact_weights[i*active];
+
+        if (layer->units[i].excluded > 0) continue;
+
+        COUNTUP(k, active)
+            wc[k] = w[layer->active_inputs[k]];
+    }
+    return 0;
+}
+
+/**
+* @brief Gathers the remaining inputs of each sample in a batch into
+*        the compact inputs of a layer
+* @param layer Layer object
+* @param inputs batch_size x no_of_inputs activations of the previous layer
+* @param batch_size The number of samples in the batch
+*/
+static void bp_layer_compact_inputs(bp_layer * layer, const float * inputs,
+                                    int batch_size)
+{
+    const int active = layer->no_of_active_inputs;
+
+    COUNTDOWN(b, batch_size) {
+        const float * inp = &inputs[b*layer->no_of_inputs];
+        float * xc = &layer->compact_inputs[b*active];
+
+        COUNTUP(k, active)
+            xc[k] = inp[layer->active_inputs[k]];
+    }
+}
+
+/**
+* @brief Feeds a batch of input vectors through a layer.
+*        Each row of weights is applied to every sample in the batch
+*        before moving on, so the weights are streamed once per batch.
+*        If the layer has been compacted only the remaining inputs
+*        are visited
+* @param layer Layer object
+* @param inputs batch_size x no_of_inputs activations of the previous layer
+* @param batch_size The number of samples in the batch
+* @param noise Noise in the range 0.0 to 1.0
+* @param drop_threshold Threshold below which inputs drop out,
+*        from rand_mask_threshold, or zero for no dropouts
+* @param drop_key Key of the counter based random numbers for the layer
+* @param streams Per-thread random number streams
+*/
+static void bp_layer_feed_forward_batch(bp_layer * layer,
+                                        const float * inputs,
+                                        int batch_size,
+                                        float noise,
+                                        unsigned int drop_threshold,
+                                        unsigned int drop_key,
+                                        rand_stream * streams)
+{
+    const int no_of_inputs = layer->no_of_inputs;
+    const int no_of_units = layer->no_of_units;
+    const int active = layer->no_of_active_inputs;
+
+    /* the compute backend may calculate the weighted sums of
+       a dense layer, leaving the bias and activation to be added.
+       The backend works with the float weights, so it is not used
+       when feeding forward with reduced precision */
+    int summed =
+        (drop_threshold == 0) && (layer->row_start == 0) &&
+        (layer->weights_bf16 == 0) && (active == 0) &&
+        (deeplearn_backend_dense_forward(layer->weights, inputs, batch_size,
+                                         no_of_inputs, no_of_units,
+                                         layer->batch_values) == 0);
+
+    if (active > 0)
+        bp_layer_compact_inputs(layer, inputs, batch_size);
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(no_of_units*no_of_inputs*batch_size))
+    COUNTDOWN(i, no_of_units) {
+        bp_neuron * n = &layer->units[i];
+        const float * wc = &layer->compact_weights[i*active];
+        unsigned int unit_key = 0;
+        unsigned int * random_seed =
+            rand_stream_seed(streams, DEEPLEARN_MAX_THREADS);
+
+        if (drop_threshold != 0)
+            unit_key = rand_counter(drop_key, (unsigned int)i);
+
+        COUNTUP(b, batch_size) {
+            const float * inp = &inputs[b*no_of_inputs];
+            float adder;
+
+            /* if the neuron has dropped out then set its output to zero */
+            if (n->excluded > 0) {
+                layer->batch_values[b*no_of_units + i] = 0;
+                continue;
+            }
+
+            adder = n->bias;
+
+            /* each sample has its own inputs dropped out */
+            if (summed) {
+                adder += layer->batch_values[b*no_of_units + i];
+            }
+            else if (active > 0) {
+                const float * xc = &layer->compact_inputs[b*active];
+
+                if (drop_threshold == 0)
+                    adder += deeplearn_dot(wc, xc, active);
+                else
+                    adder += bp_dot_dropout(wc, xc, active, unit_key,
+                                            (unsigned int)(b*no_of_inputs),
+                                            drop_threshold);
+            }
+            else if (drop_threshold == 0) {
+                adder += bp_layer_dot(layer, i, inp);
+            }
+            else if (layer->row_start != 0) {
+                adder += bp_layer_sparse_dot(layer, i, inp, unit_key,
+                                             (unsigned int)(b*no_of_inputs),
+                                             drop_threshold);
+            }
+            else {
+                adder += bp_dot_dropout(&layer->weights[i*no_of_inputs],
+                                        inp, no_of_inputs, unit_key,
+                                        (unsigned int)(b*no_of_inputs),
+                                        drop_threshold);
+            }
+
+            /* add some random noise */
+            if (noise > 0)
+                adder = ((1.0f - noise) * adder) +
+                    (noise * ((rand_num(random_seed)%10000)/10000.0f));
+
+            layer->batch_values[b*no_of_units + i] =
+                activation_value(layer->activation, adder);
+        }
+    }
+}
+
+/**
+* @brief Converts the batch errors of a layer into deltas and
+*        back-propagates them into the batch errors of the previous layer.
+*        Each sample writes only to its own row, so samples can be
+*        processed in parallel without conflicts
+* @param layer Layer object
+* @param input_errors batch_size x no_of_inputs errors of the previous
+*        layer, or zero if they are not needed
+* @param batch_size The number of samples in the batch
+*/
+static void bp_layer_backprop_batch(bp_layer * layer,
+                                    float * input_errors,
+                                    int batch_size)
+{
+    const int no_of_inputs = layer->no_of_inputs;
+    const int no_of_units = layer->no_of_units;
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(no_of_units*batch_size))
+    COUNTDOWN(b, batch_size) {
+        float * y = &layer->batch_values[b*no_of_units];
+        float * delta = &layer->batch_errors[b*no_of_units];
+
+        COUNTDOWN(i, no_of_units) {
+            if (layer->units[i].excluded > 0)
+                delta[i] = 0;
+            else
+                delta[i] *= af(y[i]);
+        }
+    }
+
+    if (input_errors == 0)
+        return;
+
+    /* errors of the remaining inputs, with those of the units which
+       dropped out left at zero */
+    if (layer->no_of_active_inputs > 0) {
+        const int active = layer->no_of_active_inputs;
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(no_of_units*active*batch_size))
+        COUNTDOWN(b, batch_size) {
+            float * delta = &layer->batch_errors[b*no_of_units];
+            float * ec = &layer->compact_errors[b*active];
+            float * e = &input_errors[b*no_of_inputs];
+
+            FLOATCLEAR(ec, active);
+            COUNTDOWN(i, no_of_units) {
+                if (delta[i] == 0) continue;
+                deeplearn_axpy(ec, delta[i],
+                               &layer->compact_weights[i*active], active);
+            }
+
+            FLOATCLEAR(e, no_of_inputs);
+            COUNTUP(k, active)
+                e[layer->active_inputs[k]] = ec[k];
+        }
+        return;
+    }
+
+    /* the compute backend may propagate the deltas of the whole batch */
+    if (deeplearn_backend_dense_backward(layer->weights, layer->batch_errors,
+                                         batch_size, no_of_inputs,
+                                         no_of_units, input_errors) == 0)
+        return;
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(no_of_units*no_of_inputs*batch_size))
+    COUNTDOWN(b, batch_size) {
+        float * delta = &layer->batch_errors[b*no_of_units];
+        float * e = &input_errors[b*no_of_inputs];
+        FLOATCLEAR(e, no_of_inputs);
+        COUNTDOWN(i, no_of_units) {
+            float * w = &layer->weights[i*no_of_inputs];
+            float d = delta[i];
+
+            if (d == 0) continue;
+
+            deeplearn_axpy(e, d, w, no_of_inputs);
+        }
+    }
+}
+
+/**
+* @brief Expands the gradients of the remaining inputs of a compacted
+*        layer, held at the start of an array, into the gradients of
+*        every input, with those of the inputs which dropped out at zero
+* @param g Gradients of the unit
+* @param active_inputs Indexes of the remaining inputs, in order
+* @param active The number of remaining inputs
+* @param no_of_inputs The number of inputs
+*/
+static void bp_expand_gradients(float * g, const int * active_inputs,
+                                int active, int no_of_inputs)
+{
+    int end = no_of_inputs;
+
+    /* each index is at least its position, so working downwards
+       never overwrites a gradient which is still to be moved */
+    for (int k = active-1; k >= 0; k--) {
+        int j = active_inputs[k];
+
+        g[j] = g[k];
+        FOR(z, j+1, end)
+            g[z] = 0;
+        end = j;
+    }
+    COUNTUP(z, end)
+        g[z] = 0;
+}
+
+/**
+* @brief Accumulates the average weight and bias gradients over a batch
+*        and applies a single update to the layer. If the layer has been
+*        compacted the gradients are only accumulated for the remaining
+*        inputs, and the weights of inputs which dropped out are unchanged
+* @param layer Layer object
+* @param optimizer The optimizer
+* @param inputs batch_size x no_of_inputs activations of the previous layer
+* @param batch_size The number of samples in the batch
+* @param learning_rate Learning rate in the range 0.0 to 1.0
+*/
+static void bp_layer_learn_batch(bp_layer * layer,
+                                 const deeplearn_optimizer * optimizer,
+                                 const float * inputs,
+                                 int batch_size,
+                                 float learning_rate)
+{
+    const int no_of_inputs = layer->no_of_inputs;
+    const int no_of_units = layer->no_of_units;
+    const float e = learning_rate / (1.0f + no_of_inputs);
+    const float scale = 1.0f / batch_size;
+    const int active = layer->no_of_active_inputs;
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(no_of_units*no_of_inputs*batch_size))
+    COUNTDOWN(i, no_of_units) {
+        bp_neuron * n = &layer->units[i];
+        float * w = &layer->weights[i*no_of_inputs];
+        float * dw = &layer->last_weight_change[i*no_of_inputs];
+        float * g = &layer->weight_gradients[i*no_of_inputs];
+        float bias_gradient = 0;
+        int no_of_gradients = (active > 0) ? active : no_of_inputs;
+
+        if (n->excluded > 0) continue;
+
+        /* sum of delta * input over the batch */
+        FLOATCLEAR(g, no_of_gradients);
+        COUNTUP(b, batch_size) {
+            float d = layer->batch_errors[b*no_of_units + i];
+
+            if (d == 0) continue;
+
+            bias_gradient += d;
+            if (active > 0)
+                deeplearn_axpy(g, d, &layer->compact_inputs[b*active],
+                               active);
+            else
+                deeplearn_axpy(g, d, &inputs[b*no_of_inputs], no_of_inputs);
+        }
+
+        bias_gradient *= scale;
+        layer->bias_gradients[i] = bias_gradient;
+        n->min_weight = -2;
+        n->max_weight = 2;
+
+        /* adaptive optimizers still update the moments of the weights
+           of inputs which dropped out */
+        if (optimizer_adaptive(optimizer)) {
+            if (active > 0)
+                bp_expand_gradients(g, layer->active_inputs, active,
+                                    no_of_inputs);
+            bp_layer_optimize_unit(layer, optimizer, i, g, scale,
+                                   bias_gradient);
+            continue;
+        }
+
+        n->last_bias_change = e * (n->last_bias_change + 1.0f) * bias_gradient;
+        n->bias = CLIP_WEIGHT(n->bias + n->last_bias_change);
+
+        /* the weight changes of inputs which dropped out are zero */
+        if (active > 0) {
+            COUNTUP(k, active) {
+                int j = layer->active_inputs[k];
+                dw[j] = e * scale * (dw[j] + 1) * g[k];
+                w[j] = CLIP_WEIGHT(w[j] + dw[j]);
+            }
+            FOR(k, active, no_of_inputs)
+                dw[layer->active_inputs[k]] = 0;
+            bp_layer_encode_unit(layer, i);
+            continue;
+        }
+
+        /* pruned weights of a sparse layer stay at zero */
+        if (layer->row_start != 0) {
+            FOR(k, layer->row_start[i], layer->row_start[i+1]) {
+                int j = layer->columns[k];
+                dw[j] = e * scale * (dw[j] + 1) * g[j];
+                w[j] = CLIP_WEIGHT(w[j] + dw[j]);
+            }
+            continue;
+        }
+
+        deeplearn_weight_update(w, dw, g, e * scale, no_of_inputs);
+        bp_layer_encode_unit(layer, i);
+    }
+
+    deeplearn_backend_weights_changed(layer->weights);
+}
+
+/**
+* @brief Updates the running average errors from the output errors
+*        of a single sample, in the same way as bp_backprop
+* @param net Backprop neural net object
+* @param errors Output errors for the sample
+*/
+static void bp_update_error_average(bp * net, float * errors)
+{
+    float error_total = 0, errorPercent = 0;
+
+    COUNTDOWN(i, net->no_of_outputs) {
+        error_total += errors[i];
+        errorPercent += fabs(errors[i]);
+    }
+
+    /* convert summed error to an overall percentage */
+    errorPercent = errorPercent * 100 /
+        (NEURON_RANGE*net->no_of_outputs);
+
+    /* error on the output units */
+    net->backprop_error = fabs(error_total / net->no_of_outputs);
+
+    /* update the running average */
+    if (net->backprop_error_average == DEEPLEARN_UNKNOWN_ERROR) {
+        net->backprop_error_average = net->backprop_error;
+        net->backprop_error_percent = errorPercent;
+    }
+    else {
+        net->backprop_error_average =
+            (net->backprop_error_average*0.999f) +
+            (net->backprop_error*0.001f);
+
+        net->backprop_error_percent =
+            (net->backprop_error_percent*0.999f) +
+            (errorPercent*0.001f);
+    }
+}
+
+/**
+* @brief Copies the last sample of a batch into the units, so that
+*        the usual accessors reflect the most recent sample
+* @param net Backprop neural net object
+* @param inputs The batch of input values
+* @param batch_size The number of samples in the batch
+*/
+static void bp_batch_set_units(bp * net, const float * inputs,
+                               int batch_size)
+{
+    const float * inp = &inputs[(batch_size-1)*net->no_of_inputs];
+
+    COUNTDOWN(i, net->no_of_inputs) {
+        net->input_values[i] = inp[i];
+        net->inputs[i]->value = inp[i];
+    }
+
+    COUNTDOWN(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+        int row = (batch_size-1)*layer->no_of_units;
+
+        COUNTDOWN(i, layer->no_of_units) {
+            layer->values[i] = layer->batch_values[row + i];
+            layer->units[i].value = layer->values[i];
+        }
+    }
+}
+
+/**
+* @brief Trains the network on a mini-batch of samples.
+*        Gradients are accumulated over the whole batch and
+*        a single weight update is applied at the end
+* @param net Backprop neural net object
+* @param inputs batch_size x no_of_inputs array of input values
+*        in the range 0.0 to 1.0
+* @param targets batch_size x no_of_outputs array of desired output
+*        values in the range 0.0 to 1.0
+* @param batch_size The number of samples in the batch
+* @returns zero on success
+*/
+int bp_update_batch(bp * net, const float * inputs, const float * targets,
+                    int batch_size)
+{
+    const int no_of_outputs = net->no_of_outputs;
+    bp_layer * output_layer = &net->layers[net->hidden_layers];
+    unsigned int drop_threshold =
+        rand_mask_threshold((unsigned int)(net->dropout_percent*100));
+    unsigned int drop_key;
+    unsigned int prev_itterations = net->itterations;
+    float error_total = 0;
+    int neuron_count = 0;
+
+    if (batch_size < 1)
+        return -1;
+
+    if (bp_batch_alloc(net, batch_size) != 0)
+        return -2;
+
+    PROFILE_TIMER(t);
+    bp_dropouts(net);
+    drop_key = bp_dropout_key(net);
+    if (net->dropout_percent > 0) {
+        FOR(l, 1, net->hidden_layers+1)
+            if (bp_layer_compact(&net->layers[l], &net->layers[l-1],
+                                 batch_size) != 0) {
+                bp_clear_dropouts(net);
+                return -3;
+            }
+    }
+    PROFILE_LAP(DEEPLEARN_PHASE_DROPOUTS, t, batch_size);
+
+    /* forward pass over the whole batch */
+    COUNTUP(l, net->hidden_layers+1)
+        bp_layer_feed_forward_batch(&net->layers[l],
+                                    (l == 0) ? inputs :
+                                    net->layers[l-1].batch_values,
+                                    batch_size,
+                                    net->noise, drop_threshold,
+                                    rand_counter(drop_key, (unsigned int)l),
+                                    net->random_streams);
+    PROFILE_LAP(DEEPLEARN_PHASE_FORWARD, t, batch_size);
+
+    /* errors on the output units */
+    COUNTUP(b, batch_size) {
+        float * y = &output_layer->batch_values[b*no_of_outputs];
+        float * e = &output_layer->batch_errors[b*no_of_outputs];
+
+        COUNTDOWN(i, no_of_outputs) {
+            if (output_layer->units[i].excluded > 0)
+                e[i] = 0;
+            else
+                e[i] = targets[b*no_of_outputs + i] - y[i];
+            error_total += e[i];
+        }
+        bp_update_error_average(net, e);
+
+        if (net->itterations < UINT_MAX)
+            net->itterations++;
+    }
+    neuron_count += no_of_outputs;
+
+    /* back-propogate through the hidden layers */
+    for (int l = net->hidden_layers; l > 0; l--) {
+        bp_layer * lower = &net->layers[l-1];
+
+        bp_layer_backprop_batch(&net->layers[l], lower->batch_errors,
+                                batch_size);
+
+        COUNTDOWN(i, batch_size*lower->no_of_units)
+            error_total += lower->batch_errors[i];
+        neuron_count += lower->no_of_units;
+    }
+    bp_layer_backprop_batch(&net->layers[0], 0, batch_size);
+
+    /* overall average error */
+    net->backprop_error_total =
+        fabs(error_total / (neuron_count*batch_size));
+    PROFILE_LAP(DEEPLEARN_PHASE_BACKPROP, t, batch_size);
+
+    /* one update per batch */
+    optimizer_step(&net->optimizer);
+    bp_layer_learn_batch(&net->layers[0], &net->optimizer,
+                         inputs, batch_size, net->learning_rate);
+    FOR(l, 1, net->hidden_layers+1)
+        bp_layer_learn_batch(&net->layers[l], &net->optimizer,
+                             net->layers[l-1].batch_values,
+                             batch_size, net->learning_rate);
+
+    bp_batch_set_units(net, inputs, batch_size);
+
+    /* perform periodic pruning of weights if a pruning cycle
+       boundary was crossed during this batch */
+    if (net->pruning_cycle != 0) {
+        if ((net->itterations / net->pruning_cycle) !=
+            (prev_itterations / net->pruning_cycle)) {
+            bp_prune_weights(net, net->pruning_rate);
+        }
+    }
+    PROFILE_LAP(DEEPLEARN_PHASE_LEARN, t, batch_size);
+
+    bp_clear_dropouts(net);
+    PROFILE_LAP(DEEPLEARN_PHASE_DROPOUTS, t, 0);
+    return 0;
+}
+
+/**
+* @brief Feeds many samples through the network without learning.
+*        Samples are processed in blocks, and each layer is applied
+*        to a whole block at once so that the weights are streamed
+*        once per block rather than once per sample
+* @param net Backprop neural net object
+* @param inputs n x no_of_inputs array of input values
+*        in the range 0.0 to 1.0
+* @param n The number of samples
+* @param outputs Returned n x no_of_outputs array of output values
+*        in the range 0.0 to 1.0
+* @returns zero on success
+*/
+int bp_feed_forward_batch(bp * net, const float * inputs, int n,
+                          float * outputs)
+{
+    const int no_of_outputs = net->no_of_outputs;
+    bp_layer * output_layer = &net->layers[net->hidden_layers];
+    int block_size = DEEPLEARN_FEED_FORWARD_BATCH;
+
+    if (n < 1)
+        return -1;
+
+    if (n < block_size)
+        block_size = n;
+
+    if (bp_batch_alloc(net, block_size) != 0)
+        return -2;
+
+    for (int start = 0; start < n; start += block_size) {
+        const float * inp = &inputs[start*net->no_of_inputs];
+        int samples = block_size;
+
+        if (start + samples > n)
+            samples = n - start;
+
+        bp_layer_feed_forward_batch(&net->layers[0], inp, samples,
+                                    net->noise, 0, 0, net->random_streams);
+        FOR(l, 1, net->hidden_layers+1)
+            bp_layer_feed_forward_batch(&net->layers[l],
+                                        net->layers[l-1].batch_values,
+                                        samples, net->noise, 0, 0,
+                                        net->random_streams);
+
+        memcpy((void*)&outputs[start*no_of_outputs],
+               (void*)output_layer->batch_values,
+               samples*no_of_outputs*sizeof(float));
+
+        if (start + samples == n)
+            bp_batch_set_units(net, inp, samples);
+    }
+
+    return 0;
+}
+
+/**
+* @brief Feeds many samples through the first few layers of the network
+*        without learning, in the same way as bp_feed_forward_batch,
+*        and returns the values of the last of those layers
+* @param net Backprop neural net object
+* @param inputs n x no_of_inputs array of input values
+*        in the range 0.0 to 1.0
+* @param n The number of samples
+* @param layers The number of layers to feed forward through
+* @param values Returned n x units array of values of the given layer
+* @returns zero on success
+*/
+int bp_feed_forward_layers_batch(bp * net, const float * inputs, int n,
+                                 int layers, float * values)
+{
+    int block_size = DEEPLEARN_FEED_FORWARD_BATCH;
+
+    if (n < 1)
+        return -1;
+
+    if ((layers < 1) || (layers > net->hidden_layers+1))
+        return -2;
+
+    if (n < block_size)
+        block_size = n;
+
+    if (bp_batch_alloc(net, block_size) != 0)
+        return -3;
+
+    bp_layer * last_layer = &net->layers[layers-1];
+    const int no_of_units = last_layer->no_of_units;
+
+    for (int start = 0; start < n; start += block_size) {
+        const float * inp = &inputs[start*net->no_of_inputs];
+        int samples = block_size;
+
+        if (start + samples > n)
+            samples = n - start;
+
+        bp_layer_feed_forward_batch(&net->layers[0], inp, samples,
+                                    net->noise, 0, 0, net->random_streams);
+        FOR(l, 1, layers)
+            bp_layer_feed_forward_batch(&net->layers[l],
+                                        net->layers[l-1].batch_values,
+                                        samples, net->noise, 0, 0,
+                                        net->random_streams);
+
+        memcpy((void*)&values[start*no_of_units],
+               (void*)last_layer->batch_values,
+               samples*no_of_units*sizeof(float));
+    }
+
+    return 0;
+}
+
+/**
+* @brief Finds the first layer values of a row of windows of an image
+*        scan. Every unit is correlated with the image rows beneath the
+*        windows directly, accumulating each weight over all of the
+*        windows of the row at once, so that neither the patches nor the
+*        weights need to be gathered for each window
+* @param layer The first layer of the network
+* @param image Rows of pixel values beneath the windows, each split into
+*        stride phases of phase_length values, see bp_scan_image
+* @param phase_length The number of values in each phase of a row
+* @param window_size Width and height of each window
+* @param stride Step in pixels between windows
+* @param windows The number of windows in the row
+* @param sums Returned weighted sums for each window
+* @param values Returned windows x units array of unit values
+*/
+static void bp_scan_first_layer(bp_layer * layer, const float * image,
+                                int phase_length, int window_size,
+                                int stride, int windows,
+                                float * sums, float * values)
+{
+    const int no_of_units = layer->no_of_units;
+
+    COUNTDOWN(i, no_of_units) {
+        const float * w = &layer->weights[i*layer->no_of_inputs];
+
+        FLOATCLEAR(sums, windows);
+        COUNTUP(py, window_size) {
+            const float * row = &image[py*stride*phase_length];
+
+            /* pixel px of successive windows is a run of one phase */
+            COUNTUP(px, window_size) {
+                const float weight = w[py*window_size + px];
+
+                if (weight != 0)
+                    deeplearn_axpy(sums, weight,
+                                   &row[(px%stride)*phase_length +
+                                        (px/stride)], windows);
+            }
+        }
+
+        COUNTUP(wx, windows)
+            values[wx*no_of_units + i] =
+                activation_value(layer->activation,
+                                 layer->units[i].bias + sums[wx]);
+    }
+}
+
+/**
+* @brief Scans a square window across a mono image, one byte per pixel,
+*        and returns the outputs of the network for every position of
+*        the window. This gives the same results as calling
+*        bp_inputs_from_image_patch and bp_feed_forward for each window,
+*        without noise and using the float weights, but the first layer
+*        is found convolutionally over each row of windows and the
+*        remaining layers are fed forward in batches of windows.
+*        The map is (image_width - window_size)/stride + 1 windows wide
+*        and (image_height - window_size)/stride + 1 windows high.
+*        The values of the units of the network are not changed
+* @param net Backprop neural net object
+* @param img Image buffer (1 byte per pixel)
+* @param image_width Width of the image in pixels
+* @param image_height Height of the image in pixels
+* @param window_size Width and height of the window, whose area should be
+*        the number of inputs of the network
+* @param stride Step in pixels between successive windows
+* @param outputs Returned map of windows, each having no_of_outputs
+*        values in the range 0.0 to 1.0, in row major order
+* @returns zero on success
+*/
+int bp_scan_image(bp * net, unsigned char img[],
+                  int image_width, int image_height,
+                  int window_size, int stride, float * outputs)
+{
+    bp_layer * first_layer = &net->layers[0];
+    bp_layer * output_layer = &net->layers[net->hidden_layers];
+    const int no_of_units = first_layer->no_of_units;
+    const int no_of_outputs = net->no_of_outputs;
+    int map_width, map_height, block_rows, block_size, phase_length;
+    float * image, * sums;
+
+    if ((window_size < 1) ||
+        (window_size*window_size != net->no_of_inputs))
+        return -1;
+
+    if (stride < 1)
+        return -2;
+
+    if ((image_width < window_size) || (image_height < window_size))
+        return -3;
+
+    map_width = (image_width - window_size)/stride + 1;
+    map_height = (image_height - window_size)/stride + 1;
+
+    /* rows of windows fed forward together */
+    block_rows = DEEPLEARN_SCAN_WINDOWS/map_width;
+    if (block_rows < 1)
+        block_rows = 1;
+    if (block_rows > map_height)
+        block_rows = map_height;
+    block_size = block_rows*map_width;
+
+    if (bp_batch_alloc(net, block_size) != 0)
+        return -4;
+
+    /* each pixel is converted once, rather than once for every window.
+       Each row is split into stride phases, pixels x with the same
+       x%stride being consecutive, so that the windows of a row step
+       through consecutive values */
+    phase_length = (image_width + stride - 1)/stride;
+    FLOATALLOC(image, image_height*stride*phase_length);
+    if (!image)
+        return -5;
+
+    FLOATALLOC(sums, block_size);
+    if (!sums) {
+        free(image);
+        return -6;
+    }
+
+    COUNTDOWN(y, image_height) {
+        float * row = &image[y*stride*phase_length];
+
+        COUNTDOWN(x, stride*phase_length) {
+            int px = (x%phase_length)*stride + (x/phase_length);
+
+            row[x] = 0;
+            if (px < image_width)
+                row[x] = NEURON_LOW +
+                    (img[y*image_width + px]*NEURON_RANGE/255.0f);
+        }
+    }
+
+    for (int start = 0; start < map_height; start += block_rows) {
+        int rows = block_rows;
+
+        if (start + rows > map_height)
+            rows = map_height - start;
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(rows*map_width*no_of_units*net->no_of_inputs))
+        COUNTUP(r, rows) {
+            const float * top =
+                &image[(start + r)*stride*stride*phase_length];
+            float * values =
+                &first_layer->batch_values[r*map_width*no_of_units];
+
+            bp_scan_first_layer(first_layer, top, phase_length,
+                                window_size, stride, map_width,
+                                &sums[r*map_width], values);
+        }
+
+        FOR(l, 1, net->hidden_layers+1)
+            bp_layer_feed_forward_batch(&net->layers[l],
+                                        net->layers[l-1].batch_values,
+                                        rows*map_width, 0, 0, 0,
+                                        net->random_streams);
+
+        memcpy((void*)&outputs[start*map_width*no_of_outputs],
+               (void*)output_layer->batch_values,
+               rows*map_width*no_of_outputs*sizeof(float));
+    }
+
+    free(image);
+    free(sums);
+    return 0;
+}
+
+/**
+* @brief Feeds many samples through a single layer of the network
+*        without learning, given the values of the layer below
+* @param net Backprop neural net object
+* @param layer Index of the layer
+* @param inputs n x no_of_inputs array of the values of the layer below
+* @param n The number of samples
+* @param values Returned n x units array of values of the layer
+* @returns zero on success
+*/
+int bp_feed_forward_layer_batch(bp * net, int layer,
+                                const float * inputs, int n,
+                                float * values)
+{
+    int block_size = DEEPLEARN_FEED_FORWARD_BATCH;
+
+    if (n < 1)
+        return -1;
+
+    if ((layer < 0) || (layer > net->hidden_layers))
+        return -2;
+
+    if (n < block_size)
+        block_size = n;
+
+    if (bp_batch_alloc(net, block_size) != 0)
+        return -3;
+
+    bp_layer * current = &net->layers[layer];
+    const int no_of_inputs = current->no_of_inputs;
+    const int no_of_units = current->no_of_units;
+
+    for (int start = 0; start < n; start += block_size) {
+        int samples = block_size;
+
+        if (start + samples > n)
+            samples = n - start;
+
+        bp_layer_feed_forward_batch(current, &inputs[start*no_of_inputs],
+                                    samples, net->noise, 0, 0,
+                                    net->random_streams);
+
+        memcpy((void*)&values[start*no_of_units],
+               (void*)current->batch_values,
+               samples*no_of_units*sizeof(float));
+    }
+
+    return 0;
+}
+
+/**
+* @brief Creates the private buffers for a number of worker threads
+*        which train the network concurrently
+* @param net Backprop neural net object
+* @param no_of_workers The number of workers
+* @returns Array of workers, or NULL if memory could not be allocated
+*/
+bp_worker * bp_workers_init(bp * net, int no_of_workers)
+{
+    bp_worker * workers;
+    unsigned int seed = net->random_seed;
+
+    if ((no_of_workers < 1) || (no_of_workers > DEEPLEARN_MAX_THREADS))
+        return NULL;
+
+    workers = (bp_worker*)malloc(no_of_workers*sizeof(bp_worker));
+    if (!workers)
+        return NULL;
+
+    COUNTUP(w, no_of_workers) {
+        bp_worker * worker = &workers[w];
+
+        /* each worker draws noise from its own part of the sequence */
+        rand_jump(&seed, RAND_STREAM_SPACING);
+        worker->random_seed = seed;
+
+        worker->values =
+            (float**)malloc((net->hidden_layers+1)*sizeof(float*));
+        worker->errors =
+            (float**)malloc((net->hidden_layers+1)*sizeof(float*));
+        if ((!worker->values) || (!worker->errors)) {
+            free(worker->values);
+            free(worker->errors);
+            bp_workers_free(net, workers, w);
+            return NULL;
+        }
+
+        COUNTDOWN(l, net->hidden_layers+1) {
+            FLOATALLOC(worker->values[l], net->layers[l].no_of_units);
+            FLOATALLOC(worker->errors[l], net->layers[l].no_of_units);
+        }
+
+        COUNTDOWN(l, net->hidden_layers+1) {
+            if ((!worker->values[l]) || (!worker->errors[l])) {
+                bp_workers_free(net, workers, w+1);
+                return NULL;
+            }
+        }
+    }
+
+    return workers;
+}
+
+/**
+* @brief Frees the buffers of a number of worker threads
+* @param net Backprop neural net object
+* @param workers Array of workers
+* @param no_of_workers The number of workers
+*/
+void bp_workers_free(bp * net, bp_worker * workers, int no_of_workers)
+{
+    if (workers == NULL)
+        return;
+
+    COUNTDOWN(w, no_of_workers) {
+        COUNTDOWN(l, net->hidden_layers+1) {
+            free(workers[w].values[l]);
+            free(workers[w].errors[l]);
+        }
+        free(workers[w].values);
+        free(workers[w].errors);
+    }
+    free(workers);
+}
+
+/**
+* @brief Trains the network on a single sample using the private buffers
+*        of a worker.  The shared weights and biases are read and updated
+*        without locks, so updates from other workers may be overwritten
+*        or seen part way through, which stochastic gradient descent
+*        tolerates when updates are sparse relative to the weights
+* @param net Backprop neural net object
+* @param worker The worker doing the training
+* @param inputs no_of_inputs input values in the range 0.0 to 1.0
+* @param targets no_of_outputs desired output values
+* @param output_errors Returned errors of the output units
+* @returns Sum of the errors over all units
+*/
+static float bp_worker_update(bp * net, bp_worker * worker,
+                              const float * inputs, const float * targets,
+                              float * output_errors)
+{
+    const int output_index = net->hidden_layers;
+    float error_total = 0;
+
+    /* forward pass */
+    COUNTUP(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+        const float * inp = (l == 0) ? inputs : worker->values[l-1];
+
+        COUNTDOWN(i, layer->no_of_units) {
+            float * w = &layer->weights[i*layer->no_of_inputs];
+            float adder = layer->units[i].bias;
+
+            if (layer->row_start != 0) {
+                FOR(k, layer->row_start[i], layer->row_start[i+1])
+                    adder += w[layer->columns[k]] * inp[layer->columns[k]];
+            }
+            else {
+                adder += bp_layer_dot(layer, i, inp);
+            }
+
+            /* add some random noise */
+            if (net->noise > 0)
+                adder = ((1.0f - net->noise) * adder) +
+                    (net->noise *
+                     ((rand_num(&worker->random_seed)%10000)/10000.0f));
+
+            worker->values[l][i] = activation_value(layer->activation, adder);
+        }
+    }
+
+    /* errors on the output units */
+    COUNTDOWN(i, net->no_of_outputs) {
+        output_errors[i] = targets[i] - worker->values[output_index][i];
+        worker->errors[output_index][i] = output_errors[i];
+        error_total += output_errors[i];
+    }
+
+    /* convert errors into deltas, back-propagating them downwards */
+    for (int l = output_index; l >= 0; l--) {
+        bp_layer * layer = &net->layers[l];
+        float * delta = worker->errors[l];
+
+        COUNTDOWN(i, layer->no_of_units)
+            delta[i] *= af(worker->values[l][i]);
+
+        if (l == 0)
+            break;
+
+        FLOATCLEAR(worker->errors[l-1], layer->no_of_inputs);
+        COUNTDOWN(i, layer->no_of_units) {
+            if (delta[i] == 0) continue;
+            deeplearn_axpy(worker->errors[l-1], delta[i],
+                           &layer->weights[i*layer->no_of_inputs],
+                           layer->no_of_inputs);
+        }
+        COUNTDOWN(i, layer->no_of_inputs)
+            error_total += worker->errors[l-1][i];
+    }
+
+    /* update the shared weights */
+    COUNTUP(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+        const float * inp = (l == 0) ? inputs : worker->values[l-1];
+        const int no_of_inputs = layer->no_of_inputs;
+        const float e = net->learning_rate / (1.0f + no_of_inputs);
+
+        COUNTDOWN(i, layer->no_of_units) {
+            bp_neuron * n = &layer->units[i];
+            float * w = &layer->weights[i*no_of_inputs];
+            float * dw = &layer->last_weight_change[i*no_of_inputs];
+            float d = worker->errors[l][i];
+
+            if (d == 0) continue;
+
+            if (optimizer_adaptive(&net->optimizer)) {
+                bp_layer_optimize_unit(layer, &net->optimizer, i,
+                                       inp, d, d);
+                continue;
+            }
+
+            n->last_bias_change = e * (n->last_bias_change + 1.0f) * d;
+            n->bias = CLIP_WEIGHT(n->bias + n->last_bias_change);
+
+            /* pruned weights of a sparse layer stay at zero */
+            if (layer->row_start != 0) {
+                FOR(k, layer->row_start[i], layer->row_start[i+1]) {
+                    int j = layer->columns[k];
+                    dw[j] = e * d * (dw[j] + 1) * inp[j];
+                    w[j] = CLIP_WEIGHT(w[j] + dw[j]);
+                }
+                continue;
+            }
+
+            deeplearn_weight_update(w, dw, inp, e * d, no_of_inputs);
+            bp_layer_encode_unit(layer, i);
+        }
     }
 
-    return total_weight_change * 10000000 / (float)(inputs * no_of_neurons);
+    return error_total;
 }
 
 /**
- * @brief Returns a weight histogram with values in the range 0 -> 1000
- * @param net Backprop neural net object
- * @param histogram Histogram array
- * @param buckets Number of histogram buckets
- * @param max_value The maximum weight magnitude
- */
-void bp_weight_histogram(bp * net,
-                         unsigned int histogram[], int buckets,
-                         float max_value)
+* @brief Trains the network on a number of samples in the manner of
+*        Hogwild, with each worker thread taking the next sample and
+*        updating the shared weights without locks.  Dropouts are not
+*        used, since they are shared between all units of the network.
+*        The error averages are updated once all samples are done
+* @param net Backprop neural net object
+* @param workers Array of workers created with bp_workers_init
+* @param no_of_workers The number of workers
+* @param inputs no_of_samples x no_of_inputs array of input values
+*        in the range 0.0 to 1.0
+* @param targets no_of_samples x no_of_outputs array of desired output
+*        values in the range 0.0 to 1.0
+* @param no_of_samples The number of samples
+* @returns zero on success
+*/
+int bp_update_hogwild(bp * net, bp_worker * workers, int no_of_workers,
+                      const float * inputs, const float * targets,
+                      int no_of_samples)
 {
-    UINTCLEAR(histogram, buckets);
+    const int no_of_outputs = net->no_of_outputs;
+    unsigned int prev_itterations = net->itterations;
+    float * errors, * error_totals;
+    float error_total = 0;
+    int neuron_count = 0;
 
-    COUNTDOWN(l, net->hidden_layers) {
-        int no_of_neurons = HIDDENS_IN_LAYER(net, l);
-        int inputs = net->hiddens[l][0]->no_of_inputs;
+    if ((no_of_samples < 1) || (no_of_workers < 1) || (workers == NULL))
+        return -1;
 
-        COUNTDOWN(i, no_of_neurons) {
-            bp_neuron * n = net->hiddens[l][i];
-            COUNTDOWN(w, inputs) {
-                float value = fabs(n->weights[w]);
-                if (value < max_value) {
-                    histogram[(int)(value * buckets / max_value)]++;
-                }
-            }
-        }
+    FLOATALLOC(errors, no_of_samples*no_of_outputs);
+    FLOATALLOC(error_totals, no_of_samples);
+    if ((!errors) || (!error_totals)) {
+        free(errors);
+        free(error_totals);
+        return -2;
     }
 
-    /* normalize */
-    unsigned int max = 1;
-    COUNTDOWN(i, buckets) {
-        if (histogram[i] > max)
-            max = histogram[i];
+    /* the workers share a single optimizer step */
+    optimizer_step(&net->optimizer);
+
+#pragma omp parallel for schedule(dynamic) num_threads(no_of_workers)
+    COUNTUP(s, no_of_samples) {
+        bp_worker * worker = &workers[omp_get_thread_num() % no_of_workers];
+
+        error_totals[s] =
+            bp_worker_update(net, worker, &inputs[s*net->no_of_inputs],
+                             &targets[s*no_of_outputs],
+                             &errors[s*no_of_outputs]);
     }
 
-    COUNTDOWN(i, buckets) {
-        histogram[i] = histogram[i] * 1000 / max;
+    /* running averages in the same order as the samples */
+    COUNTUP(s, no_of_samples) {
+        bp_update_error_average(net, &errors[s*no_of_outputs]);
+        error_total += error_totals[s];
+
+        if (net->itterations < UINT_MAX)
+            net->itterations++;
+    }
+
+    COUNTDOWN(l, net->hidden_layers+1)
+        neuron_count += net->layers[l].no_of_units;
+
+    /* overall average error */
+    net->backprop_error_total =
+        fabs(error_total / (neuron_count*no_of_samples));
+
+    COUNTDOWN(l, net->hidden_layers+1)
+        deeplearn_backend_weights_changed(net->layers[l].weights);
+
+    /* perform periodic pruning of weights if a pruning cycle
+       boundary was crossed */
+    if (net->pruning_cycle != 0) {
+        if ((net->itterations / net->pruning_cycle) !=
+            (prev_itterations / net->pruning_cycle)) {
+            bp_prune_weights(net, net->pruning_rate);
+        }
     }
+
+    free(errors);
+    free(error_totals);
+    return 0;
 }
 
 /**
- * @brief Sets small weights to zero
- * @param net Backprop neural net object
- * @param threshold Pruning threshold in the range 0.0 -> 1.0
- * @returns The percent of weights pruned
- */
-int bp_prune_weights(bp * net, float threshold)
+* @brief Saves a sparse layer, writing only the remaining weights
+* @param fp File pointer
+* @param layer Layer object
+* @return zero on success
+*/
+static int bp_layer_save_sparse(FILE * fp, bp_layer * layer)
 {
-    float mean = 0;
-    unsigned int hits = 0;
-    unsigned int pruned = 0;
+    int nnz = layer->row_start[layer->no_of_units];
+    float * values;
 
-    COUNTDOWN(l, net->hidden_layers) {
-        int no_of_neurons = HIDDENS_IN_LAYER(net, l);
-        int inputs = net->hiddens[l][0]->no_of_inputs;
+    if (INTWRITE(nnz) == 0)
+        return -1;
 
-        hits += no_of_neurons*inputs;
+    if (INTWRITEARRAY(layer->row_start, layer->no_of_units+1) == 0)
+        return -2;
 
-        COUNTDOWN(i, no_of_neurons) {
-            bp_neuron * n = net->hiddens[l][i];
-            COUNTDOWN(w, inputs) {
-                mean += fabs(n->weights[w]);
-            }
-        }
-    }
+    if ((nnz > 0) && (INTWRITEARRAY(layer->columns, nnz) == 0))
+        return -3;
 
-    COUNTDOWN(i, net->no_of_outputs) {
-        bp_neuron * n = net->outputs[i];
-        COUNTDOWN(w, n->no_of_inputs) {
-            mean += fabs(n->weights[w]);
-            hits++;
+    FLOATALLOC(values, nnz+1);
+    if (!values)
+        return -4;
+
+    /* remaining weights followed by their previous changes */
+    COUNTUP(pass, 2) {
+        float * dense = (pass == 0) ?
+            layer->weights : layer->last_weight_change;
+
+        COUNTUP(i, layer->no_of_units) {
+            FOR(k, layer->row_start[i], layer->row_start[i+1])
+                values[k] = dense[i*layer->no_of_inputs + layer->columns[k]];
+        }
+        if ((nnz > 0) && (FLOATWRITEARRAY(values, nnz) == 0)) {
+            free(values);
+            return -5;
         }
     }
+    free(values);
 
-    if (hits == 0)
-        return 0;
+    COUNTUP(i, layer->no_of_units) {
+        bp_neuron * n = &layer->units[i];
 
-    mean /= (float)hits;
-    threshold = mean * threshold;
+        if (FLOATWRITE(n->min_weight) == 0)
+            return -6;
 
-    /* set weights to zero if they are below the pruning threshold */
-    COUNTDOWN(l, net->hidden_layers) {
-        int no_of_neurons = HIDDENS_IN_LAYER(net, l);
-        int inputs = net->hiddens[l][0]->no_of_inputs;
+        if (FLOATWRITE(n->max_weight) == 0)
+            return -7;
 
-        COUNTDOWN(i, no_of_neurons) {
-            bp_neuron * n = net->hiddens[l][i];
-            COUNTDOWN(w, inputs) {
-                if (fabs(n->weights[w]) < threshold) {
-                    n->weights[w] = 0;
-                    pruned++;
-                }
-            }
-        }
-    }
+        if (FLOATWRITE(n->bias) == 0)
+            return -8;
 
-    COUNTDOWN(i, net->no_of_outputs) {
-        bp_neuron * n = net->outputs[i];
-        COUNTDOWN(w, n->no_of_inputs) {
-            if (fabs(n->weights[w]) < threshold) {
-                n->weights[w] = 0;
-                pruned++;
-            }
-        }
+        if (FLOATWRITE(n->last_bias_change) == 0)
+            return -9;
+
+        if (FLOATWRITE(n->desired_value) == 0)
+            return -10;
     }
 
-    return (int)(pruned * 100 / hits);
+    return 0;
 }
 
 /**
- * @brief Returns the standard deviation of the weight change for a given layer
- * @param net Backprop neural net object
- * @param layer_index Index of the layer
- * @returns standard deviation of weight change
- */
-float bp_weight_gradient_std(bp * net, int layer_index)
+* @brief Loads a sparse layer saved with bp_layer_save_sparse
+* @param fp File pointer
+* @param layer Layer object
+* @return zero on success
+*/
+static int bp_layer_load_sparse(FILE * fp, bp_layer * layer)
 {
-    float mean_weight_change = 0;
-    float total_deviation = 0;
-    int no_of_neurons = HIDDENS_IN_LAYER(net, layer_index);
-    int inputs = net->hiddens[layer_index][0]->no_of_inputs;
+    const int no_of_weights = layer->no_of_units*layer->no_of_inputs;
+    int nnz = 0;
+    float * values;
+
+    if (INTREAD(nnz) == 0)
+        return -1;
+
+    if ((nnz < 0) || (nnz > no_of_weights))
+        return -2;
 
-    /* calculate the average weight magnitude */
-    COUNTDOWN(i, no_of_neurons) {
-        bp_neuron * n = net->hiddens[layer_index][i];
-        COUNTDOWN(w, inputs) {
-            mean_weight_change += n->last_weight_change[w];
+    bp_layer_decompress(layer);
+    layer->row_start = (int*)malloc((layer->no_of_units+1)*sizeof(int));
+    layer->columns = (int*)malloc((nnz+1)*sizeof(int));
+    if ((!layer->row_start) || (!layer->columns)) {
+        bp_layer_decompress(layer);
+        return -3;
+    }
+
+    if (INTREADARRAY(layer->row_start, layer->no_of_units+1) == 0) {
+        bp_layer_decompress(layer);
+        return -4;
+    }
+
+    /* the rows must follow one another across the whole of the
+       non-zero weights */
+    if ((layer->row_start[0] != 0) ||
+        (layer->row_start[layer->no_of_units] != nnz)) {
+        bp_layer_decompress(layer);
+        return -5;
+    }
+    COUNTUP(i, layer->no_of_units) {
+        if (layer->row_start[i] > layer->row_start[i+1]) {
+            bp_layer_decompress(layer);
+            return -5;
         }
     }
-    mean_weight_change /= (no_of_neurons * inputs);
 
-    /* sum of percentage deviation from the average weight magnitude */
-    if (fabs(mean_weight_change) > 0.0000000001f) {
-        COUNTDOWN(i, no_of_neurons) {
-            bp_neuron * n = net->hiddens[layer_index][i];
-            COUNTDOWN(w, inputs) {
-                total_deviation +=
-                    fabs((n->last_weight_change[w] - mean_weight_change)/mean_weight_change);
-            }
+    if ((nnz > 0) && (INTREADARRAY(layer->columns, nnz) == 0)) {
+        bp_layer_decompress(layer);
+        return -6;
+    }
+
+    COUNTDOWN(k, nnz) {
+        if ((layer->columns[k] < 0) ||
+            (layer->columns[k] >= layer->no_of_inputs)) {
+            bp_layer_decompress(layer);
+            return -7;
+        }
+    }
+
+    FLOATALLOC(values, nnz+1);
+    if (!values) {
+        bp_layer_decompress(layer);
+        return -8;
+    }
+
+    /* pruned weights are zero */
+    COUNTUP(pass, 2) {
+        float * dense = (pass == 0) ?
+            layer->weights : layer->last_weight_change;
+
+        FLOATCLEAR(dense, no_of_weights);
+        if ((nnz > 0) && (FLOATREADARRAY(values, nnz) == 0)) {
+            free(values);
+            bp_layer_decompress(layer);
+            return -9;
         }
+        COUNTUP(i, layer->no_of_units) {
+            FOR(k, layer->row_start[i], layer->row_start[i+1])
+                dense[i*layer->no_of_inputs + layer->columns[k]] = values[k];
+        }
+    }
+    free(values);
+
+    COUNTUP(i, layer->no_of_units) {
+        bp_neuron * n = &layer->units[i];
+
+        if (FLOATREAD(n->min_weight) == 0)
+            return -10;
+
+        if (FLOATREAD(n->max_weight) == 0)
+            return -11;
+
+        if (FLOATREAD(n->bias) == 0)
+            return -12;
+
+        if (FLOATREAD(n->last_bias_change) == 0)
+            return -13;
+
+        if (FLOATREAD(n->desired_value) == 0)
+            return -14;
+
+        n->value = 0;
+        n->backprop_error = 0;
+        n->excluded = 0;
     }
 
-    return total_deviation * 100 / (no_of_neurons * inputs);
+    return 0;
 }
 
 /**
-* @brief Randomly sets exclusion flags to cause units to drop out
-* @param net Backprop neural net object
+* @brief Saves a dense layer with its weights and their previous changes
+*        in bfloat16, which halves the size of the layer
+* @param fp File pointer
+* @param layer Layer object
+* @return zero on success
 */
-static void bp_dropouts(bp * net)
+static int bp_layer_save_bf16(FILE * fp, bp_layer * layer)
 {
-    int no_of_dropouts, hidden_units=0;
+    const int no_of_inputs = layer->no_of_inputs;
+    unsigned short * values;
 
-    if (net->dropout_percent == 0) return;
+    values = (unsigned short*)malloc(no_of_inputs*sizeof(unsigned short));
+    if (!values)
+        return -1;
 
-    /* total number of hidden units */
-    COUNTDOWN(l, net->hidden_layers)
-        hidden_units += HIDDENS_IN_LAYER(net,l);
+    COUNTUP(i, layer->no_of_units) {
+        bp_neuron * n = &layer->units[i];
 
-    /* total number of dropouts */
-    no_of_dropouts = net->dropout_percent*hidden_units/100;
+        /* weights followed by their previous changes */
+        COUNTUP(pass, 2) {
+            float * dense = (pass == 0) ?
+                layer->weights : layer->last_weight_change;
 
-    /* set the exclusion flags */
-    COUNTDOWN(n, no_of_dropouts) {
-        int l = rand_num(&net->random_seed)%net->hidden_layers;
-        int i = rand_num(&net->random_seed)%HIDDENS_IN_LAYER(net,l);
-        net->hiddens[l][i]->excluded = 1;
+            deeplearn_bf16_encode(values, &dense[i*no_of_inputs],
+                                  no_of_inputs);
+            if (USHORTWRITEARRAY(values, no_of_inputs) == 0) {
+                free(values);
+                return -2;
+            }
+        }
+
+        if ((FLOATWRITE(n->min_weight) == 0) ||
+            (FLOATWRITE(n->max_weight) == 0) ||
+            (FLOATWRITE(n->bias) == 0) ||
+            (FLOATWRITE(n->last_bias_change) == 0) ||
+            (FLOATWRITE(n->desired_value) == 0)) {
+            free(values);
+            return -3;
+        }
     }
+    free(values);
+    return 0;
 }
 
 /**
-* @brief Update the neural net during training
-* @param net Backprop neural net object
+* @brief Loads a dense layer saved with bp_layer_save_bf16
+* @param fp File pointer
+* @param layer Layer object
+* @return zero on success
 */
-void bp_update(bp * net, int current_hidden_layer)
+static int bp_layer_load_bf16(FILE * fp, bp_layer * layer)
 {
-    bp_dropouts(net);
-    bp_feed_forward(net, 1);
-    bp_backprop(net, current_hidden_layer);
-    bp_learn(net, current_hidden_layer);
-    bp_clear_dropouts(net);
+    const int no_of_inputs = layer->no_of_inputs;
+    unsigned short * values;
+
+    values = (unsigned short*)malloc(no_of_inputs*sizeof(unsigned short));
+    if (!values)
+        return -1;
+
+    COUNTUP(i, layer->no_of_units) {
+        bp_neuron * n = &layer->units[i];
+
+        COUNTUP(pass, 2) {
+            float * dense = (pass == 0) ?
+                layer->weights : layer->last_weight_change;
+
+            if (USHORTREADARRAY(values, no_of_inputs) == 0) {
+                free(values);
+                return -2;
+            }
+            COUNTDOWN(j, no_of_inputs)
+                dense[i*no_of_inputs + j] =
+                    deeplearn_bf16_to_float(values[j]);
+        }
+
+        if ((FLOATREAD(n->min_weight) == 0) ||
+            (FLOATREAD(n->max_weight) == 0) ||
+            (FLOATREAD(n->bias) == 0) ||
+            (FLOATREAD(n->last_bias_change) == 0) ||
+            (FLOATREAD(n->desired_value) == 0)) {
+            free(values);
+            return -3;
+        }
+
+        n->value = 0;
+        n->backprop_error = 0;
+        n->excluded = 0;
+    }
+    free(values);
+    return 0;
 }
 
 /**
@@ -998,6 +3657,14 @@ void bp_update(bp * net, int current_hidden_layer)
 */
 int bp_save(FILE * fp, bp * net)
 {
+    const unsigned int magic = DEEPLEARN_NETWORK_MAGIC;
+    const int version = DEEPLEARN_NETWORK_VERSION;
+
+    deeplearn_backend_synchronise();
+
+    if ((UINTWRITE(magic) == 0) || (INTWRITE(version) == 0))
+        return -20;
+
     if (UINTWRITE(net->itterations) == 0)
         return -1;
 
@@ -1034,19 +3701,121 @@ int bp_save(FILE * fp, bp * net)
     if (UINTWRITE(net->random_seed) == 0)
         return -12;
 
-    COUNTUP(l, net->hidden_layers) {
-        COUNTUP(i, HIDDENS_IN_LAYER(net,l))
-            bp_neuron_save(fp,net->hiddens[l][i]);
+    /* hidden layers followed by the output layer */
+    COUNTUP(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+        int storage = BP_STORAGE_DENSE;
+
+        if (layer->row_start != 0)
+            storage = BP_STORAGE_SPARSE;
+        else if (layer->weights_bf16 != 0)
+            storage = BP_STORAGE_BF16;
+
+        if (INTWRITE(storage) == 0)
+            return -14;
+
+        if (storage == BP_STORAGE_SPARSE) {
+            if (bp_layer_save_sparse(fp, layer) != 0)
+                return -15;
+            continue;
+        }
+
+        if (storage == BP_STORAGE_BF16) {
+            if (bp_layer_save_bf16(fp, layer) != 0)
+                return -15;
+            continue;
+        }
+
+        COUNTUP(i, layer->no_of_units)
+            bp_neuron_save(fp, &layer->units[i]);
+    }
+
+    COUNTUP(l, net->hidden_layers+1) {
+        if (INTWRITE(net->layers[l].activation) == 0)
+            return -13;
+    }
+
+    /* the optimizer followed by the moments of each layer */
+    if (optimizer_save(fp, &net->optimizer) != 0)
+        return -16;
+
+    COUNTUP(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+
+        if (optimizer_save_moments(fp, &net->optimizer,
+                                   layer->moment1, layer->moment2,
+                                   layer->no_of_units *
+                                   layer->no_of_inputs) != 0)
+            return -17;
+
+        if (optimizer_save_moments(fp, &net->optimizer,
+                                   layer->bias_moment1, layer->bias_moment2,
+                                   layer->no_of_units) != 0)
+            return -18;
+    }
+
+    if (INTWRITE(net->weight_precision) == 0)
+        return -19;
+
+    return 0;
+}
+
+/**
+* @brief Loads the activation functions, optimizer and weight precision
+*        which follow the layers of a network file
+* @param fp File pointer
+* @param net Backprop neural net object
+* @returns zero on success
+*/
+static int bp_load_settings(FILE * fp, bp * net)
+{
+    int precision = DEEPLEARN_PRECISION_FP32;
+    deeplearn_optimizer optimizer;
+
+    COUNTUP(l, net->hidden_layers+1) {
+        if (INTREAD(net->layers[l].activation) == 0)
+            return -16;
+        if (!activation_valid(net->layers[l].activation))
+            return -17;
+    }
+
+    /* the optimizer followed by the moments of each layer */
+    if (optimizer_load(fp, &optimizer) != 0)
+        return -20;
+
+    if (bp_set_optimizer(net, optimizer.type) != 0)
+        return -21;
+    net->optimizer = optimizer;
+
+    COUNTUP(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+
+        if (optimizer_load_moments(fp, &net->optimizer,
+                                   layer->moment1, layer->moment2,
+                                   layer->no_of_units *
+                                   layer->no_of_inputs) != 0)
+            return -22;
+
+        if (optimizer_load_moments(fp, &net->optimizer,
+                                   layer->bias_moment1, layer->bias_moment2,
+                                   layer->no_of_units) != 0)
+            return -23;
     }
 
-    COUNTUP(i, net->no_of_outputs)
-        bp_neuron_save(fp,net->outputs[i]);
+    if (INTREAD(precision) == 0)
+        return -24;
+
+    if (bp_set_precision(net, precision) != 0)
+        return -25;
 
     return 0;
 }
 
 /**
-* @brief Load a network from file
+* @brief Load a network from file.
+*        Files saved before the format had a version are still read,
+*        with dense layers, the default activation function, plain
+*        gradient descent and full precision weights
 * @brief fp File pointer
 * @param net Backprop neural net object
 * @returns zero on success
@@ -1054,16 +3823,29 @@ int bp_save(FILE * fp, bp * net)
 int bp_load(FILE * fp, bp * net)
 {
     int no_of_inputs=0, no_of_hiddens=0, no_of_outputs=0;
-    int hidden_layers=0;
+    int hidden_layers=0, version=0, legacy, retval;
     float learning_rate=0, noise=0, backprop_error_average=0;
     float dropout_percent=0,pruning_rate=0;
     unsigned int itterations=0;
     unsigned int pruning_cycle=0;
     unsigned int random_seed=0;
 
+    /* an unversioned file starts with the itterations */
     if (UINTREAD(itterations) == 0)
         return -1;
 
+    legacy = (itterations != DEEPLEARN_NETWORK_MAGIC);
+    if (!legacy) {
+        if (INTREAD(version) == 0)
+            return -1;
+
+        if (version != DEEPLEARN_NETWORK_VERSION)
+            return -26;
+
+        if (UINTREAD(itterations) == 0)
+            return -1;
+    }
+
     if (UINTREAD(pruning_cycle) == 0)
         return -2;
 
@@ -1102,16 +3884,36 @@ int bp_load(FILE * fp, bp * net)
                 &random_seed) != 0)
         return -13;
 
-    COUNTUP(l, net->hidden_layers) {
-        COUNTUP(i, HIDDENS_IN_LAYER(net,l)) {
-            if (bp_neuron_load(fp,net->hiddens[l][i]) != 0)
-                return -14;
+    /* hidden layers followed by the output layer */
+    COUNTUP(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+        int storage = BP_STORAGE_DENSE;
+
+        if ((!legacy) && (INTREAD(storage) == 0))
+            return -18;
+
+        if (storage == BP_STORAGE_SPARSE) {
+            if (bp_layer_load_sparse(fp, layer) != 0)
+                return -19;
+            continue;
+        }
+
+        if (storage == BP_STORAGE_BF16) {
+            if (bp_layer_load_bf16(fp, layer) != 0)
+                return -19;
+            continue;
+        }
+
+        COUNTUP(i, layer->no_of_units) {
+            if (bp_neuron_load(fp, &layer->units[i]) != 0)
+                return (l < net->hidden_layers) ? -14 : -15;
         }
     }
 
-    COUNTUP(i, net->no_of_outputs) {
-        if (bp_neuron_load(fp,net->outputs[i]) != 0)
-            return -15;
+    if (!legacy) {
+        retval = bp_load_settings(fp, net);
+        if (retval != 0)
+            return retval;
     }
 
     net->learning_rate = learning_rate;
@@ -1123,6 +3925,7 @@ int bp_load(FILE * fp, bp * net)
     net->dropout_percent = dropout_percent;
     net->pruning_cycle = pruning_cycle;
     net->pruning_rate = pruning_rate;
+    bp_weights_changed(net);
 
     return 0;
 }
@@ -1186,6 +3989,17 @@ int bp_compare(bp * net1, bp * net2)
     if (net1->dropout_percent!= net2->dropout_percent)
         return -13;
 
+    COUNTDOWN(l, net1->hidden_layers+1) {
+        if (net1->layers[l].activation != net2->layers[l].activation)
+            return -14;
+        if ((net1->layers[l].row_start != 0) !=
+            (net2->layers[l].row_start != 0))
+            return -15;
+    }
+
+    if (net1->optimizer.type != net2->optimizer.type)
+        return -16;
+
     return 1;
 }
 
@@ -36,7 +36,14 @@
 #include <omp.h>
 #include "globals.h"
 #include "deeplearn_random.h"
+#include "deeplearn_simd.h"
+#include "deeplearn_backend.h"
+#include "deeplearn_threads.h"
+#include "deeplearn_profile.h"
+#include "deeplearn_activation.h"
+#include "deeplearn_optimizer.h"
 #include "deeplearn_images.h"
+#include "deeplearn_arena.h"
 #include "backprop_neuron.h"
 #include "encoding.h"
 
@@ -47,6 +54,75 @@
       ((net)->no_of_hiddens -                                             \
        (((net)->no_of_hiddens - (net)->no_of_outputs)*(layer)/(net)->hidden_layers))))
 
+/* Layer-major storage for a layer of units.
+   The units of the layer are held contiguously, and their weights form
+   a single row-major matrix with one row of no_of_inputs per unit.
+   Each unit's weights and last_weight_change arrays point into its row,
+   so the per-neuron accessors continue to work on top of this storage */
+struct bp_lyr {
+    int no_of_units;
+    int no_of_inputs;
+
+    /* contiguous array of units */
+    bp_neuron * units;
+
+    /* input connections, which are the same for every unit */
+    bp_neuron ** input_units;
+
+    /* no_of_units x no_of_inputs */
+    float * weights;
+    float * last_weight_change;
+
+    /* dense activations and backprop errors for each unit */
+    float * values;
+    float * errors;
+
+    /* mini-batch buffers, batch_size x no_of_units.
+       During backprop the errors are converted into deltas */
+    float * batch_values;
+    float * batch_errors;
+
+    /* average gradients accumulated over a mini-batch */
+    float * weight_gradients;
+    float * bias_gradients;
+
+    /* moments of the weights and biases used by an adaptive optimizer,
+       allocated by bp_set_optimizer */
+    float * moment1;
+    float * moment2;
+    float * bias_moment1;
+    float * bias_moment2;
+
+    /* bfloat16 copy of the weights used when feeding forward,
+       allocated by bp_set_precision. The float weights remain the
+       master copy which is trained */
+    unsigned short * weights_bf16;
+
+    /* activation function, eg. AF_SIGMOID */
+    int activation;
+
+    /* compressed sparse rows of the weights which remain after pruning.
+       row_start has no_of_units+1 entries and columns holds the input
+       index of each remaining weight. Both are zero for a dense layer */
+    int * row_start;
+    int * columns;
+
+    /* during a mini-batch with dropouts, the indexes of the inputs which
+       remain followed by those which dropped out, with zero active
+       inputs if every input is used. The weights of the
+       remaining inputs are gathered into no_of_units x
+       no_of_active_inputs compact_weights, and the inputs and errors of
+       each sample into batch_size x no_of_active_inputs compact_inputs
+       and compact_errors. These are allocated on first use */
+    int * active_inputs;
+    int no_of_active_inputs;
+    float * compact_weights;
+    float * compact_inputs;
+    float * compact_errors;
+    int compact_capacity;
+};
+typedef struct bp_lyr bp_layer;
+
 struct backprop {
     int no_of_inputs,no_of_hiddens,no_of_outputs;
     int hidden_layers;
@@ -54,24 +130,71 @@ struct backprop {
     bp_neuron ** inputs;
     bp_neuron *** hiddens;
     bp_neuron ** outputs;
+
+    /* hidden layers followed by the output layer */
+    bp_layer * layers;
+
+    /* storage for the units, their weights and the layers, which is
+       empty when the network is held within another arena */
+    deeplearn_arena arena;
+
+    /* dense copies of the input unit values and errors */
+    float * input_values;
+    float * input_errors;
+
+    /* number of samples the mini-batch buffers can hold */
+    int batch_capacity;
+
     float backprop_error_total;
     float backprop_error, backprop_error_average;
     float backprop_error_percent;
     float learning_rate;
     float noise;
     unsigned int random_seed;
+
+    /* method used to adjust the weights, see bp_set_optimizer */
+    deeplearn_optimizer optimizer;
+
+    /* precision of the weights when feeding forward,
+       eg. DEEPLEARN_PRECISION_BF16 */
+    int weight_precision;
+
+    /* random number generator state for each thread */
+    rand_stream random_streams[DEEPLEARN_MAX_THREADS];
+
     unsigned int itterations;
     unsigned int pruning_cycle;
     float pruning_rate;
 };
 typedef struct backprop bp;
 
+/* private activations and errors of a worker thread which trains a
+   network at the same time as other workers. The weights remain
+   shared and are updated without locks */
+typedef struct {
+    /* no_of_units values and errors for each layer */
+    float ** values;
+    float ** errors;
+    unsigned int random_seed;
+} bp_worker;
+
 int bp_init(bp * net,
             int no_of_inputs,
             int no_of_hiddens,
             int hidden_layers,
             int no_of_outputs,
             unsigned int * random_seed);
+size_t bp_storage_size(int no_of_inputs,
+                       int no_of_hiddens,
+                       int hidden_layers,
+                       int no_of_outputs);
+int bp_init_arena(bp * net,
+                  int no_of_inputs,
+                  int no_of_hiddens,
+                  int hidden_layers,
+                  int no_of_outputs,
+                  deeplearn_arena * arena,
+                  unsigned int * random_seed);
 void bp_free(bp * net);
 void bp_feed_forward(bp * net, int learning);
 void bp_feed_forward_layers(bp * net, int layers);
@@ -83,10 +206,36 @@ void bp_set_output(bp * net, int index, float value);
 float bp_get_hidden(bp * net, int layer, int index);
 float bp_get_output(bp * net, int index);
 float bp_get_desired(bp * net, int index);
+int bp_set_activation(bp * net, int layer, int activation);
+int bp_get_activation(bp * net, int layer);
+int bp_set_optimizer(bp * net, int type);
+int bp_set_precision(bp * net, int precision);
+void bp_weights_changed(bp * net);
+int bp_quantize_layer(bp * net, int layer, signed char * weights,
+                      float * scale);
+int bp_sparsify(bp * net, int min_zero_percent);
+int bp_update_sparse(bp * net);
 void bp_update(bp * net, int current_hidden_layer);
+int bp_update_batch(bp * net, const float * inputs, const float * targets,
+                    int batch_size);
+int bp_feed_forward_batch(bp * net, const float * inputs, int n,
+                          float * outputs);
+int bp_feed_forward_layers_batch(bp * net, const float * inputs, int n,
+                                 int layers, float * values);
+int bp_feed_forward_layer_batch(bp * net, int layer,
+                                const float * inputs, int n,
+                                float * values);
+bp_worker * bp_workers_init(bp * net, int no_of_workers);
+void bp_workers_free(bp * net, bp_worker * workers, int no_of_workers);
+int bp_update_hogwild(bp * net, bp_worker * workers, int no_of_workers,
+                      const float * inputs, const float * targets,
+                      int no_of_samples);
 int bp_save(FILE * fp, bp * net);
 int bp_load(FILE * fp, bp * net);
 int bp_compare(bp * net1, bp * net2);
+int bp_scan_image(bp * net, unsigned char img[],
+                  int image_width, int image_height,
+                  int window_size, int stride, float * outputs);
 int bp_inputs_from_image_patch(bp * net,
                                unsigned char img[],
                                int image_width, int image_height,
@@ -108,6 +257,9 @@ void bp_normalise_inputs(bp * net);
 float bp_get_input(bp * net, int index);
 float bp_weight_gradient_mean(bp * net, int layer_index);
 float bp_weight_gradient_std(bp * net, int layer_index);
+int bp_weight_gradient_stats(bp * net, int layer_index,
+                             int samples, unsigned int * seed,
+                             float * mean, float * std);
 void bp_update_averages(bp * net, float running_average_factor);
 void bp_weight_histogram(bp * net,
                          unsigned int histogram[], int buckets,
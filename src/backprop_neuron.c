@@ -102,6 +102,40 @@ int bp_neuron_init(bp_neuron * n,
     return 0;
 }
 
+/**
+* @brief Initialises a neuron whose arrays are owned by its layer.
+*        The arrays are not freed by bp_neuron_free, and are instead
+*        deallocated together with the layer storage
+* @param n Backprop neuron object
+* @param no_of_inputs The number of input connections
+* @param weights Row of the layer weight matrix for this neuron
+* @param last_weight_change Row of the layer weight change matrix
+* @param inputs Input connections, which may be shared within the layer
+* @param random_seed Random number generator seed
+*/
+void bp_neuron_init_storage(bp_neuron * n,
+                            int no_of_inputs,
+                            float * weights,
+                            float * last_weight_change,
+                            struct bp_n ** inputs,
+                            unsigned int * random_seed)
+{
+    /* should have more than zero inpyts */
+    assert(no_of_inputs > 0);
+
+    n->no_of_inputs = no_of_inputs;
+    n->weights = weights;
+    n->last_weight_change = last_weight_change;
+    n->inputs = inputs;
+
+    bp_neuron_init_weights(n, random_seed);
+    n->desired_value = -1;
+    n->value = 0;
+    n->value_reprojected = 0;
+    n->backprop_error = 0;
+    n->excluded = 0;
+}
+
 /**
 * @brief Compares two neurons and returns a non-zero value
 *        if they are the same
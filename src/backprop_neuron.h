@@ -67,6 +67,12 @@ typedef struct bp_n bp_neuron;
 int bp_neuron_init(bp_neuron * n,
                    int no_of_inputs,
                    unsigned int * random_seed);
+void bp_neuron_init_storage(bp_neuron * n,
+                            int no_of_inputs,
+                            float * weights,
+                            float * last_weight_change,
+                            struct bp_n ** inputs,
+                            unsigned int * random_seed);
 void bp_neuron_add_connection(bp_neuron * dest,
                               int index, bp_neuron * source);
 void bp_neuron_feedForward(bp_neuron * n,
@@ -75,6 +75,7 @@ int deepconvnet_init(int no_of_convolutions,
     deeplearn_history_init(&convnet->history, "training.png",
                            "Training History",
                            "Time Step", "Training Error %");
+    deeplearn_history_set_size(&convnet->history, DEEPLEARN_HISTORY_SIZE, 1);
 
     convnet->convolution = (deeplearn_conv*)malloc(sizeof(deeplearn_conv));
 
@@ -111,6 +112,20 @@ int deepconvnet_init(int no_of_convolutions,
     convnet->images = NULL;
     convnet->classifications = NULL;
     convnet->classification_number = NULL;
+    convnet->images_map = NULL;
+    convnet->images_map_length = 0;
+    convnet->augmented_image = NULL;
+    convnet->image_planes = NULL;
+    convnet->no_of_workers = 1;
+    convnet->workers = NULL;
+    convnet->worker_inputs = NULL;
+    convnet->worker_targets = NULL;
+    convnet->output_cache_enabled = 0;
+    convnet->output_cache_filename = NULL;
+    convnet->output_cache = NULL;
+    convnet->output_cache_length = 0;
+    convnet->output_cache_valid = 0;
+    convnet->output_cache_feature_updates = 0;
 
     /* default history settings */
     convnet->backprop_error = DEEPLEARN_UNKNOWN_ERROR;
@@ -134,12 +149,39 @@ int deepconvnet_is_training(deepconvnet * convnet)
             (convnet->learner->training_complete != 0));
 }
 
+/**
+ * @brief Frees the cache of convolution outputs
+ * @param convnet Deep convnet object
+ */
+static void deepconvnet_free_output_cache(deepconvnet * convnet)
+{
+    if (convnet->output_cache != NULL) {
+        if (convnet->output_cache_filename != NULL) {
+            munmap(convnet->output_cache, convnet->output_cache_length);
+            remove(convnet->output_cache_filename);
+        }
+        else {
+            free(convnet->output_cache);
+        }
+    }
+    free(convnet->output_cache_filename);
+
+    convnet->output_cache_enabled = 0;
+    convnet->output_cache_filename = NULL;
+    convnet->output_cache = NULL;
+    convnet->output_cache_length = 0;
+    convnet->output_cache_valid = 0;
+}
+
 /**
  * @brief Frees memory
  * @param convnet Deep convnet object
  */
 void deepconvnet_free(deepconvnet * convnet)
 {
+    deepconvnet_set_workers(convnet, 1);
+    deeplearn_history_free(&convnet->history);
+
     conv_free(convnet->convolution);
     free(convnet->convolution);
 
@@ -147,19 +189,31 @@ void deepconvnet_free(deepconvnet * convnet)
     free(convnet->learner);
 
     if (convnet->no_of_images > 0) {
-        COUNTDOWN(i, convnet->no_of_images) {
-            if (convnet->images[i] != NULL) {
-                free(convnet->images[i]);
-                convnet->images[i] = 0;
-            }
-            free(convnet->classifications[i]);
-        }
-        free(convnet->images);
-        free(convnet->classifications);
-        free(convnet->classification_number);
+        deeplearn_free_training_images(convnet->images,
+                                       convnet->classifications,
+                                       convnet->classification_number,
+                                       convnet->no_of_images,
+                                       convnet->images_map,
+                                       convnet->images_map_length);
+        convnet->images = NULL;
+        convnet->classifications = NULL;
+        convnet->classification_number = NULL;
+        convnet->images_map = NULL;
         convnet->no_of_images = 0;
     }
 
+    if (convnet->augmented_image != NULL) {
+        free(convnet->augmented_image);
+        convnet->augmented_image = NULL;
+    }
+
+    if (convnet->image_planes != NULL) {
+        free(convnet->image_planes);
+        convnet->image_planes = NULL;
+    }
+
+    deepconvnet_free_output_cache(convnet);
+
     if (convnet->training_set_index != NULL)
         free(convnet->training_set_index);
 
@@ -226,17 +280,19 @@ int deepconvnet_load(FILE * fp, deepconvnet * convnet)
  *        This provides the glue sticking the preprocessing convolutional
  *        stage together with the final deep learning stage.
  * @param learner Deep learner object
- * @param conv Convolution object
+ * @param conv_outputs Outputs of the convolution layers
+ * @param no_of_conv_outputs The number of convolution outputs
  * @return zero on success
  */
 static int deepconvnet_set_inputs_conv(deeplearn * learner,
-                                       deeplearn_conv * conv)
+                                       float conv_outputs[],
+                                       int no_of_conv_outputs)
 {
-    if (learner->net->no_of_inputs != conv->no_of_outputs)
+    if (learner->net->no_of_inputs != no_of_conv_outputs)
         return -1;
 
     COUNTDOWN(i, learner->net->no_of_inputs)
-        deeplearn_set_input(learner, i, conv_get_output(conv, i));
+        deeplearn_set_input(learner, i, conv_outputs[i]);
 
     return 0;
 }
@@ -301,6 +357,130 @@ static void deepconvnet_update(deepconvnet * convnet)
     convnet->training_complete = convnet->learner->training_complete;
 }
 
+/**
+ * @brief Trains the deep learner from the outputs of the convolution layers
+ * @param convnet Deep convnet object
+ * @param conv_outputs Outputs of the convolution layers
+ * @param class_number Desired class number
+ * @return Zero on success
+ */
+static int deepconvnet_update_learner(deepconvnet * convnet,
+                                      float conv_outputs[],
+                                      int class_number)
+{
+    if (deepconvnet_set_inputs_conv(convnet->learner, conv_outputs,
+                                    convnet->convolution->no_of_outputs) != 0)
+        return -2;
+
+    if (convnet->learner->training_complete == 0) {
+        if (deeplearn_training_last_layer(convnet->learner))
+            deeplearn_set_class(convnet->learner, class_number);
+
+        deeplearn_update(convnet->learner);
+        deepconvnet_update(convnet);
+    }
+    else {
+        deeplearn_feed_forward(convnet->learner);
+    }
+    return 0;
+}
+
+/**
+ * @brief Enables or disables caching of the outputs of the convolution
+ *        layers.  Once the convolution layers are trained their outputs
+ *        for each image do not change, so the deep learner can be trained
+ *        from the cache instead of convolving every image on every step.
+ *        The cache is calculated when it is first needed, without any
+ *        input noise, and again whenever conv_learn changes the features.
+ *        It is not used while training images are being augmented.
+ * @param convnet Deep convnet object
+ * @param enable Non-zero to enable the cache
+ * @param filename File to map the cache from, or NULL to keep it in memory
+ * @returns zero on success
+ */
+int deepconvnet_set_output_cache(deepconvnet * convnet, int enable,
+                                 char * filename)
+{
+    deepconvnet_free_output_cache(convnet);
+
+    if (!enable)
+        return 0;
+
+    if (filename != NULL) {
+        CHARALLOC(convnet->output_cache_filename, strlen(filename) + 1);
+        if (!convnet->output_cache_filename)
+            return -1;
+        sprintf(convnet->output_cache_filename, "%s", filename);
+    }
+
+    convnet->output_cache_enabled = 1;
+    return 0;
+}
+
+/**
+ * @brief Returns the cached outputs of the convolution layers for an image,
+ *        calculating the cache if necessary
+ * @param convnet Deep convnet object
+ * @param index Index of the image
+ * @returns The outputs, or NULL if they are not cached
+ */
+static float * deepconvnet_cached_outputs(deepconvnet * convnet, int index)
+{
+    deeplearn_conv * conv = convnet->convolution;
+    size_t length =
+        (size_t)convnet->no_of_images*conv->no_of_outputs*sizeof(float);
+
+    if ((!convnet->output_cache_enabled) ||
+        (convnet->augmented_image != NULL) ||
+        (conv->current_layer < conv->no_of_layers) ||
+        (convnet->no_of_images == 0))
+        return NULL;
+
+    if (convnet->output_cache_valid &&
+        (convnet->output_cache_feature_updates == conv->feature_updates))
+        return &convnet->output_cache[index*conv->no_of_outputs];
+
+    if (convnet->output_cache == NULL) {
+        if (convnet->output_cache_filename != NULL) {
+            int fd = open(convnet->output_cache_filename,
+                          O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+                return NULL;
+
+            /* extend the file to the size of the cache */
+            if ((lseek(fd, (off_t)length - 1, SEEK_SET) < 0) ||
+                (write(fd, "", 1) != 1)) {
+                close(fd);
+                return NULL;
+            }
+
+            convnet->output_cache =
+                (float*)mmap(0, length, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd, 0);
+            close(fd);
+            if ((void*)convnet->output_cache == MAP_FAILED) {
+                convnet->output_cache = NULL;
+                return NULL;
+            }
+        }
+        else {
+            FLOATALLOC(convnet->output_cache,
+                       convnet->no_of_images*conv->no_of_outputs);
+            if (!convnet->output_cache)
+                return NULL;
+        }
+        convnet->output_cache_length = length;
+    }
+
+    if (conv_feed_forward_batch(conv, convnet->images, convnet->no_of_images,
+                                convnet->output_cache) != 0)
+        return NULL;
+
+    convnet->output_cache_valid = 1;
+    convnet->output_cache_feature_updates = conv->feature_updates;
+    return &convnet->output_cache[index*conv->no_of_outputs];
+}
+
 /**
  * @brief Update routine for training the system
  * @param convnet Deep convnet object
@@ -329,24 +509,13 @@ int deepconvnet_update_img(deepconvnet * convnet, unsigned char img[],
     convnet->convolution->training =
         (convnet->learner->training_complete==0);
 
+    PROFILE_TIMER(t);
     conv_feed_forward(img, convnet->convolution,
                       convnet->convolution->no_of_layers);
+    PROFILE_LAP(DEEPLEARN_PHASE_CONVOLUTION, t, 1);
 
-    if (deepconvnet_set_inputs_conv(convnet->learner,
-                                    convnet->convolution) != 0)
-        return -2;
-
-    if (convnet->learner->training_complete == 0) {
-        if (deeplearn_training_last_layer(convnet->learner))
-            deeplearn_set_class(convnet->learner, class_number);
-
-        deeplearn_update(convnet->learner);
-        deepconvnet_update(convnet);
-    }
-    else {
-        deeplearn_feed_forward(convnet->learner);
-    }
-    return 0;
+    return deepconvnet_update_learner(convnet, convnet->convolution->outputs,
+                                      class_number);
 }
 
 /**
@@ -361,7 +530,8 @@ int deepconvnet_test_img(deepconvnet * convnet, unsigned char img[])
                       convnet->convolution->no_of_layers);
 
     if (deepconvnet_set_inputs_conv(convnet->learner,
-                                    convnet->convolution) != 0)
+                                    convnet->convolution->outputs,
+                                    convnet->convolution->no_of_outputs) != 0)
         return -2;
 
     deeplearn_feed_forward(convnet->learner);
@@ -432,6 +602,32 @@ void deepconvnet_set_dropouts(deepconvnet * convnet, float dropout_percent)
     deeplearn_set_dropouts(convnet->learner, dropout_percent);
 }
 
+/**
+ * @brief Sets the number of steps which the training histories of the
+ *        convnet, its convolution layers and its deep learner can hold,
+ *        see deeplearn_set_history_size
+ * @param convnet Deep convnet object
+ * @param capacity The maximum number of steps held by each history,
+ *        or zero to not record histories
+ * @returns zero on success
+ */
+int deepconvnet_set_history_size(deepconvnet * convnet, int capacity)
+{
+    if (deeplearn_history_set_size(&convnet->history, capacity,
+                                   convnet->history.dimensions) != 0)
+        return -1;
+
+    if (deeplearn_history_set_size(&convnet->convolution->history, capacity,
+                                   convnet->convolution->history.dimensions)
+        != 0)
+        return -2;
+
+    if (deeplearn_set_history_size(convnet->learner, capacity) != 0)
+        return -3;
+
+    return 0;
+}
+
 /**
  * @brief Uses gnuplot to plot the training error for the given learner
  * @param convnet Deep convnet object
@@ -446,6 +642,174 @@ int deepconvnet_plot_history(deepconvnet * convnet,
                                   image_width, image_height);
 }
 
+/**
+ * @brief Enables or disables augmentation of training images.
+ *        When enabled each image drawn during training is randomly scaled
+ *        and translated into a scratch buffer, giving a new variant of
+ *        the image every time without storing synthetic images.
+ * @param convnet Deep convnet object
+ * @param enable Non-zero to enable augmentation
+ * @returns zero on success
+ */
+int deepconvnet_set_augmentation(deepconvnet * convnet, int enable)
+{
+    deeplearn_conv_layer * input = &convnet->convolution->layer[0];
+
+    if (!enable) {
+        free(convnet->augmented_image);
+        convnet->augmented_image = NULL;
+        return 0;
+    }
+
+    if (convnet->augmented_image != NULL)
+        return 0;
+
+    UCHARALLOC(convnet->augmented_image,
+               input->width*input->height*input->depth);
+    if (!convnet->augmented_image)
+        return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Enables or disables keeping every image as normalised input
+ *        planes.  Once the convolution layers are trained the deep learner
+ *        is then trained without converting an image on every step.
+ *        The images must already have been loaded.
+ * @param convnet Deep convnet object
+ * @param enable Non-zero to keep the input planes
+ * @returns zero on success
+ */
+int deepconvnet_set_image_planes(deepconvnet * convnet, int enable)
+{
+    deeplearn_conv_layer * input = &convnet->convolution->layer[0];
+    int size = input->width*input->height*input->depth;
+
+    free(convnet->image_planes);
+    convnet->image_planes = NULL;
+
+    if (!enable)
+        return 0;
+
+    if (convnet->no_of_images == 0)
+        return -1;
+
+    FLOATALLOC(convnet->image_planes, convnet->no_of_images*size);
+    if (!convnet->image_planes)
+        return -2;
+
+    COUNTDOWN(i, convnet->no_of_images)
+        conv_image_to_planes(convnet->convolution, convnet->images[i],
+                             &convnet->image_planes[i*size]);
+
+    return 0;
+}
+
+/**
+ * @brief Sets the number of workers which train the deep learner
+ *        concurrently.  Once the convolution layers and any autocoders
+ *        are trained, each training step gives every worker a number of
+ *        images, and the workers update the shared weights without locks.
+ *        Augmented images are always trained one at a time.
+ * @param convnet Deep convnet object
+ * @param no_of_workers The number of workers, or one to train on a
+ *        single image at a time
+ * @returns zero on success
+ */
+int deepconvnet_set_workers(deepconvnet * convnet, int no_of_workers)
+{
+    bp * net = convnet->learner->net;
+    int samples = no_of_workers*DEEPLEARN_HOGWILD_SAMPLES;
+
+    if ((no_of_workers < 1) || (no_of_workers > DEEPLEARN_MAX_THREADS))
+        return -1;
+
+    bp_workers_free(net, convnet->workers, convnet->no_of_workers);
+    free(convnet->worker_inputs);
+    free(convnet->worker_targets);
+    convnet->workers = NULL;
+    convnet->worker_inputs = NULL;
+    convnet->worker_targets = NULL;
+    convnet->no_of_workers = 1;
+
+    if (no_of_workers == 1)
+        return 0;
+
+    convnet->workers = bp_workers_init(net, no_of_workers);
+    FLOATALLOC(convnet->worker_inputs, samples*net->no_of_inputs);
+    FLOATALLOC(convnet->worker_targets, samples*net->no_of_outputs);
+    if ((!convnet->workers) || (!convnet->worker_inputs) ||
+        (!convnet->worker_targets)) {
+        bp_workers_free(net, convnet->workers, no_of_workers);
+        free(convnet->worker_inputs);
+        free(convnet->worker_targets);
+        convnet->workers = NULL;
+        convnet->worker_inputs = NULL;
+        convnet->worker_targets = NULL;
+        return -2;
+    }
+
+    convnet->no_of_workers = no_of_workers;
+    return 0;
+}
+
+/**
+ * @brief Trains the deep learner on a number of randomly chosen images
+ *        using several workers
+ * @param convnet Deep convnet object
+ * @returns zero on success
+ */
+static int deepconvnet_training_hogwild(deepconvnet * convnet)
+{
+    deeplearn_conv * conv = convnet->convolution;
+    bp * net = convnet->learner->net;
+    int training_images = convnet->no_of_images*8/10;
+    int samples = convnet->no_of_workers*DEEPLEARN_HOGWILD_SAMPLES;
+    unsigned char ** images;
+    int cached = 1;
+
+    images = (unsigned char**)malloc(samples*sizeof(unsigned char*));
+    if (!images)
+        return -1;
+
+    COUNTUP(s, samples) {
+        int index =
+            convnet->training_set_index[rand_num(&net->random_seed)%
+                                        training_images];
+        float * conv_outputs = deepconvnet_cached_outputs(convnet, index);
+        float * targets = &convnet->worker_targets[s*net->no_of_outputs];
+
+        images[s] = convnet->images[index];
+        if (conv_outputs != NULL)
+            memcpy(&convnet->worker_inputs[s*net->no_of_inputs],
+                   conv_outputs, net->no_of_inputs*sizeof(float));
+        else
+            cached = 0;
+
+        COUNTDOWN(i, net->no_of_outputs)
+            targets[i] = NEURON_LOW;
+        targets[convnet->classification_number[index]] = NEURON_HIGH;
+    }
+
+    if ((!cached) &&
+        (conv_feed_forward_batch(conv, images, samples,
+                                 convnet->worker_inputs) != 0)) {
+        free(images);
+        return -1;
+    }
+    free(images);
+
+    if (deeplearn_update_hogwild(convnet->learner, convnet->workers,
+                                 convnet->no_of_workers,
+                                 convnet->worker_inputs,
+                                 convnet->worker_targets, samples) != 0)
+        return -2;
+
+    deepconvnet_update(convnet);
+    return 0;
+}
+
 /**
  * @brief Performs training
  * @param convnet Deep convnet object
@@ -462,6 +826,17 @@ int deepconvnet_training(deepconvnet * convnet)
     if (convnet->classification_number == NULL)
         return -1;
 
+    /* several workers train the deep learner at once */
+    if ((convnet->no_of_workers > 1) &&
+        (convnet->augmented_image == NULL) &&
+        (convnet->convolution->current_layer >=
+         convnet->convolution->no_of_layers) &&
+        deeplearn_training_last_layer(convnet->learner)) {
+        if (deepconvnet_training_hogwild(convnet) != 0)
+            return -3;
+        return 0;
+    }
+
     /* pick an image at random */
     int training_images = convnet->no_of_images*8/10;
     unsigned int * random_seed = &convnet->learner->net->random_seed;
@@ -469,8 +844,46 @@ int deepconvnet_training(deepconvnet * convnet)
         rand_num(random_seed)%training_images;
     int index = convnet->training_set_index[index0];
     unsigned char * img = convnet->images[index];
+    deeplearn_conv * conv = convnet->convolution;
+    float * conv_outputs = deepconvnet_cached_outputs(convnet, index);
     int samples = 20;
 
+    /* train the deep learner from the cached convolution outputs */
+    if (conv_outputs != NULL) {
+        if (deepconvnet_update_learner(convnet, conv_outputs,
+                                       convnet->classification_number[index])
+            != 0)
+            return -2;
+        return 0;
+    }
+
+    /* feed forward from the input planes converted in advance */
+    if ((convnet->image_planes != NULL) &&
+        (convnet->augmented_image == NULL) &&
+        (conv->current_layer >= conv->no_of_layers)) {
+        deeplearn_conv_layer * input = &conv->layer[0];
+        int size = input->width*input->height*input->depth;
+
+        conv->training = (convnet->learner->training_complete==0);
+        conv_feed_forward_planes(&convnet->image_planes[index*size],
+                                 conv, conv->no_of_layers);
+        if (deepconvnet_update_learner(convnet, conv->outputs,
+                                       convnet->classification_number[index])
+            != 0)
+            return -2;
+        return 0;
+    }
+
+    /* draw a new variant of the image */
+    if (convnet->augmented_image != NULL) {
+        deeplearn_conv_layer * input = &convnet->convolution->layer[0];
+
+        image_synth_random(img, input->width, input->height, input->depth,
+                           input->width, input->height, input->depth,
+                           convnet->augmented_image, random_seed);
+        img = convnet->augmented_image;
+    }
+
     if (deepconvnet_update_img(convnet, img, samples,
                                convnet->layer_itterations,
                                convnet->classification_number[index]) != 0)
@@ -480,46 +893,126 @@ int deepconvnet_training(deepconvnet * convnet)
 }
 
 /**
- * @brief Returns performance on the test set
+ * @brief Returns performance on the test set.
+ *        Images are passed through the convolution layers a block at a
+ *        time, then the block is classified concurrently using the deep
+ *        learner compiled for inference. Errors are summed in image order
+ *        so that the result does not depend upon the number of threads.
  * @param convnet Deep convnet object
  * @return Percentage of correct classifications or a negative number on error
  */
 float deepconvnet_get_performance(deepconvnet * convnet)
 {
-    float error_percent;
-    float total_error = 0;
+    const int block_size = DEEPLEARN_FEED_FORWARD_BATCH;
+    const int threads = deeplearn_get_threads();
+    deeplearn * learner = convnet->learner;
     int test_images = convnet->no_of_images*2/10;
+    int no_of_inputs, no_of_outputs;
+    float total_error = 0;
+    float * inputs, * image_error;
+    unsigned char * block_images[DEEPLEARN_FEED_FORWARD_BATCH];
+    deeplearn_inference model;
+    deeplearn_inference_context * contexts;
 
-    if (convnet->no_of_images == 0)
+    if ((convnet->no_of_images == 0) || (test_images == 0))
         return -1;
 
     if (convnet->classification_number == NULL)
         return -2;
 
-    COUNTDOWN(i, test_images) {
-        int index = convnet->test_set_index[i];
+    no_of_inputs = learner->net->no_of_inputs;
+    no_of_outputs = learner->net->no_of_outputs;
+    if (no_of_inputs != convnet->convolution->no_of_outputs) {
+        printf("deepconvnet_test_img failed\n");
+        return -3;
+    }
+
+    if (deeplearn_compile_inference(learner, &model) != 0)
+        return -4;
+
+    contexts = deeplearn_inference_contexts_init(&model, threads);
+    if (!contexts) {
+        deeplearn_inference_free(&model);
+        return -4;
+    }
+
+    FLOATALLOC(inputs, block_size*no_of_inputs);
+    FLOATALLOC(image_error, test_images);
+    if ((!inputs) || (!image_error)) {
+        free(inputs);
+        free(image_error);
+        deeplearn_inference_contexts_free(contexts, threads);
+        deeplearn_inference_free(&model);
+        return -4;
+    }
+
+    for (int start = 0; start < test_images; start += block_size) {
+        int n = test_images - start;
+        int cached = 1;
+
+        if (n > block_size)
+            n = block_size;
 
-        deeplearn_set_class(convnet->learner,
-                            convnet->classification_number[index]);
+        COUNTUP(b, n) {
+            int index = convnet->test_set_index[start + b];
+            float * conv_outputs = deepconvnet_cached_outputs(convnet, index);
 
-        if (deepconvnet_test_img(convnet, convnet->images[index]) != 0) {
-            printf("deepconvnet_test_img failed\n");
-            break;
+            block_images[b] = convnet->images[index];
+            if (conv_outputs != NULL)
+                memcpy(&inputs[b*no_of_inputs], conv_outputs,
+                       no_of_inputs*sizeof(float));
+            else
+                cached = 0;
         }
 
-        COUNTDOWN(i, convnet->learner->net->no_of_outputs) {
-            error_percent =
-                (deeplearn_get_desired(convnet->learner,i) -
-                 deeplearn_get_output(convnet->learner,i)) /
-                NEURON_RANGE;
+        if ((!cached) &&
+            conv_feed_forward_batch(convnet->convolution, block_images, n,
+                                    inputs) != 0) {
+            free(inputs);
+            free(image_error);
+            deeplearn_inference_contexts_free(contexts, threads);
+            deeplearn_inference_free(&model);
+            return -4;
+        }
 
-            total_error += error_percent*error_percent;
+#pragma omp parallel for schedule(static) \
+    num_threads(threads) \
+    if(deeplearn_parallel(n*model.max_units))
+        COUNTUP(b, n) {
+            deeplearn_inference_context * ctx =
+                &contexts[omp_get_thread_num()];
+            int class_number =
+                convnet->classification_number[
+                    convnet->test_set_index[start + b]];
+
+            deeplearn_inference_feed_forward(&model, ctx,
+                                             &inputs[b*no_of_inputs]);
+
+            image_error[start + b] = 0;
+            COUNTDOWN(i, no_of_outputs) {
+                float desired = NEURON_LOW;
+                float error_percent;
+
+                if (i == class_number)
+                    desired = NEURON_HIGH;
+
+                error_percent = (desired - ctx->outputs[i]) / NEURON_RANGE;
+                image_error[start + b] += error_percent*error_percent;
+            }
         }
     }
 
+    /* sum in a fixed order */
+    COUNTUP(i, test_images)
+        total_error += image_error[i];
+
+    free(inputs);
+    free(image_error);
+    deeplearn_inference_contexts_free(contexts, threads);
+    deeplearn_inference_free(&model);
+
     return 100 -
-        ((float)sqrt(total_error /
-                     (convnet->learner->net->no_of_outputs*test_images))*100);
+        ((float)sqrt(total_error / (no_of_outputs*test_images))*100);
 }
 
 /**
@@ -593,7 +1086,10 @@ int deepconvnet_create_training_test_sets(deepconvnet * convnet)
  * @param error_threshold Training error thresholds for each hidden layer
  * @param random_seed Random number seed
  * @param extra_synthetic_images The number of extra synthetic images
- *        to generate for each loaded image
+ *        to generate for each loaded image. deepconvnet_set_augmentation
+ *        creates variants during training instead, without storing them.
+ * @param cache_filename Optional file used to cache the decoded images
+ *        between runs, or NULL
  * @return zero on success
  */
 int deepconvnet_read_images(char * directory,
@@ -610,7 +1106,8 @@ int deepconvnet_read_images(char * directory,
                             int output_classes,
                             float error_threshold[],
                             unsigned int * random_seed,
-                            int extra_synthetic_images)
+                            int extra_synthetic_images,
+                            char * cache_filename)
 {
     if (deepconvnet_init(no_of_convolutions,
                          no_of_deep_layers,
@@ -627,11 +1124,14 @@ int deepconvnet_read_images(char * directory,
         return -1;
 
     convnet->no_of_images =
-        deeplearn_load_training_images(directory, &convnet->images,
-                                       &convnet->classifications,
-                                       &convnet->classification_number,
-                                       image_width, image_height,
-                                       extra_synthetic_images);
+        deeplearn_load_training_images_cached(directory, cache_filename,
+                                              &convnet->images,
+                                              &convnet->classifications,
+                                              &convnet->classification_number,
+                                              image_width, image_height,
+                                              extra_synthetic_images,
+                                              &convnet->images_map,
+                                              &convnet->images_map_length);
     if (convnet->no_of_images <= 0)
         return -2;
 
@@ -40,8 +40,10 @@
 #include "encoding.h"
 #include "backprop.h"
 #include "deeplearn.h"
+#include "deeplearn_inference.h"
 #include "deeplearn_features.h"
 #include "deeplearn_conv.h"
+#include "deeplearn_images.h"
 
 typedef struct {
     /* convolution layers */
@@ -64,6 +66,38 @@ typedef struct {
     char ** classifications;
     int * classification_number;
 
+    /* mapping of the image cache file, if the images were loaded from one */
+    void * images_map;
+    size_t images_map_length;
+
+    /* scratch image into which a randomly scaled and translated copy
+       of each training image is drawn, or NULL if augmentation
+       is disabled */
+    unsigned char * augmented_image;
+
+    /* every image converted to the normalised inputs of the first
+       convolution layer, or NULL if images are converted as needed */
+    float * image_planes;
+
+    /* outputs of the convolution layers for every image, used to train
+       the deep learner once the convolution layers are trained.
+       This is held in memory, or mapped from a file if a filename
+       is given */
+    int output_cache_enabled;
+    char * output_cache_filename;
+    float * output_cache;
+    size_t output_cache_length;
+    int output_cache_valid;
+    unsigned int output_cache_feature_updates;
+
+    /* worker threads which train the deep learner concurrently once
+       the convolution layers are trained, each with private activations
+       and with the weights shared between them */
+    int no_of_workers;
+    bp_worker * workers;
+    float * worker_inputs;
+    float * worker_targets;
+
     unsigned int training_ctr;
 
     /* current backprop error */
@@ -99,6 +133,7 @@ int deepconvnet_update_img(deepconvnet * convnet, unsigned char img[],
 int deepconvnet_test_img(deepconvnet * convnet, unsigned char img[]);
 void deepconvnet_set_learning_rate(deepconvnet * convnet, float rate);
 void deepconvnet_set_dropouts(deepconvnet * convnet, float dropout_percent);
+int deepconvnet_set_history_size(deepconvnet * convnet, int capacity);
 int deepconvnet_read_images(char * directory,
                             deepconvnet * convnet,
                             int image_width, int image_height,
@@ -113,7 +148,13 @@ int deepconvnet_read_images(char * directory,
                             int output_classes,
                             float error_threshold[],
                             unsigned int * random_seed,
-                            int extra_synthetic_images);
+                            int extra_synthetic_images,
+                            char * cache_filename);
+int deepconvnet_set_augmentation(deepconvnet * convnet, int enable);
+int deepconvnet_set_image_planes(deepconvnet * convnet, int enable);
+int deepconvnet_set_workers(deepconvnet * convnet, int no_of_workers);
+int deepconvnet_set_output_cache(deepconvnet * convnet, int enable,
+                                 char * filename);
 int deepconvnet_training(deepconvnet * convnet);
 int deepconvnet_plot_history(deepconvnet * convnet,
                              int image_width, int image_height);
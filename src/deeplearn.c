@@ -28,6 +28,8 @@
 */
 
 #include "deeplearn.h"
+#include "deeplearndata.h"
+#include "deeplearn_dataset.h"
 
 /**
  * @brief Returns a training error threshold for the given layer
@@ -70,26 +72,51 @@ int deeplearn_init(deeplearn * learner,
                    float error_threshold[],
                    unsigned int * random_seed)
 {
+    size_t arena_size;
+
     /* no training/test data yet */
     learner->data = 0;
     learner->data_samples = 0;
     learner->indexed_data = 0;
     learner->indexed_data_samples = 0;
 
+    learner->data_rows = 0;
+    learner->data_rows_samples = 0;
+    learner->data_inputs = 0;
+    learner->data_outputs = 0;
+    learner->data_text = 0;
+    learner->data_encoded = 0;
+    learner->data_map = 0;
+    learner->data_map_length = 0;
+    learner->dataset = 0;
+    learner->sampler_order = 0;
+    learner->sampler_samples = 0;
+    learner->sampler_position = 0;
+    learner->sampler_labeled = 0;
+    learner->sampler_epoch = 0;
+    learner->pretrain_cache_enabled = 0;
+    learner->pretrain_cache_filename = 0;
+    learner->pretrain_cache = 0;
+    learner->pretrain_cache_length = 0;
+    learner->pretrain_cache_layer = -1;
+    learner->pretrain_cache_samples = 0;
+    learner->no_of_workers = 1;
+    learner->workers = 0;
+    learner->worker_inputs = 0;
+    learner->worker_targets = 0;
+    learner->gradient_samples = DEEPLEARN_GRADIENT_SAMPLES;
+    learner->gradient_seed = *random_seed;
+    learner->plotting = DEEPLEARN_PLOT_ASYNC;
+    deeplearn_plotter_init(&learner->plotter);
+
     learner->training_data = 0;
     learner->training_data_samples = 0;
-    learner->indexed_training_data = 0;
-    learner->indexed_training_data_samples = 0;
 
     learner->training_data_labeled = 0;
     learner->training_data_labeled_samples = 0;
-    learner->indexed_training_data_labeled = 0;
-    learner->indexed_training_data_labeled_samples = 0;
 
     learner->test_data = 0;
     learner->test_data_samples = 0;
-    learner->indexed_test_data = 0;
-    learner->indexed_test_data_samples = 0;
 
     learner->no_of_input_fields = 0;
     learner->field_length = 0;
@@ -104,6 +131,14 @@ int deeplearn_init(deeplearn * learner,
                            "Average Weight Gradient",
                            "Time Step", "Weight Gradient mean");
 
+    /* the training error is a single value at each step, and the
+       gradients have one value for each hidden layer */
+    deeplearn_history_set_size(&learner->history, DEEPLEARN_HISTORY_SIZE, 1);
+    deeplearn_history_set_size(&learner->gradients_std, DEEPLEARN_HISTORY_SIZE,
+                               CLIP(hidden_layers, 1, HISTORY_DIMENSIONS));
+    deeplearn_history_set_size(&learner->gradients_mean, DEEPLEARN_HISTORY_SIZE,
+                               CLIP(hidden_layers, 1, HISTORY_DIMENSIONS));
+
     FLOATALLOC(learner->input_range_min, no_of_inputs);
     if (!learner->input_range_min)
         return -1;
@@ -170,12 +205,26 @@ int deeplearn_init(deeplearn * learner,
         return -6;
     }
 
+    /* the network and its autocoders share a single block */
+    arena_size = bp_storage_size(no_of_inputs, no_of_hiddens,
+                                 hidden_layers, no_of_outputs);
+    learner->net->no_of_hiddens = no_of_hiddens;
+    learner->net->hidden_layers = hidden_layers;
+    learner->net->no_of_outputs = no_of_outputs;
+    COUNTUP(i, hidden_layers)
+        arena_size +=
+            autocoder_storage_size((i == 0) ? no_of_inputs :
+                                   HIDDENS_IN_LAYER(learner->net,i-1),
+                                   HIDDENS_IN_LAYER(learner->net,i));
+
     /* initialise the network */
-    if (bp_init(learner->net,
-                no_of_inputs, no_of_hiddens,
-                hidden_layers, no_of_outputs,
-                random_seed) != 0) {
+    if ((deeplearn_arena_init(&learner->arena, arena_size) != 0) ||
+        (bp_init_arena(learner->net,
+                       no_of_inputs, no_of_hiddens,
+                       hidden_layers, no_of_outputs,
+                       &learner->arena, random_seed) != 0)) {
         free(learner->net);
+        deeplearn_arena_free(&learner->arena);
         free(learner->error_threshold);
         free(learner->output_range_max);
         free(learner->output_range_min);
@@ -188,6 +237,7 @@ int deeplearn_init(deeplearn * learner,
     learner->autocoder = (ac**)malloc(sizeof(ac*)*hidden_layers);
     if (!learner->autocoder) {
         free(learner->net);
+        deeplearn_arena_free(&learner->arena);
         free(learner->error_threshold);
         free(learner->output_range_max);
         free(learner->output_range_min);
@@ -204,6 +254,7 @@ int deeplearn_init(deeplearn * learner,
             }
             free(learner->autocoder);
             free(learner->net);
+            deeplearn_arena_free(&learner->arena);
             free(learner->error_threshold);
             free(learner->output_range_max);
             free(learner->output_range_min);
@@ -216,14 +267,16 @@ int deeplearn_init(deeplearn * learner,
             /* if this is the first hidden layer then number of inputs
                for the autocoder is the same as the number of
                neural net input units */
-            if (autocoder_init(learner->autocoder[i], no_of_inputs,
-                               HIDDENS_IN_LAYER(learner->net,i),
-                               learner->net->random_seed) != 0) {
+            if (autocoder_init_arena(learner->autocoder[i], no_of_inputs,
+                                     HIDDENS_IN_LAYER(learner->net,i),
+                                     &learner->arena,
+                                     learner->net->random_seed) != 0) {
                 COUNTDOWN(j, i) {
                     free(learner->autocoder[j]);
                 }
                 free(learner->autocoder);
                 free(learner->net);
+                deeplearn_arena_free(&learner->arena);
                 free(learner->error_threshold);
                 free(learner->output_range_max);
                 free(learner->output_range_min);
@@ -233,15 +286,17 @@ int deeplearn_init(deeplearn * learner,
             }
         }
         else {
-            if (autocoder_init(learner->autocoder[i],
-                               HIDDENS_IN_LAYER(learner->net,i-1),
-                               HIDDENS_IN_LAYER(learner->net,i),
-                               learner->net->random_seed) != 0) {
+            if (autocoder_init_arena(learner->autocoder[i],
+                                     HIDDENS_IN_LAYER(learner->net,i-1),
+                                     HIDDENS_IN_LAYER(learner->net,i),
+                                     &learner->arena,
+                                     learner->net->random_seed) != 0) {
                 COUNTDOWN(j, i) {
                     free(learner->autocoder[j]);
                 }
                 free(learner->autocoder);
                 free(learner->net);
+                deeplearn_arena_free(&learner->arena);
                 free(learner->error_threshold);
                 free(learner->output_range_max);
                 free(learner->output_range_min);
@@ -278,6 +333,23 @@ void deeplearn_feed_forward(deeplearn * learner)
     bp_feed_forward(learner->net, 0);
 }
 
+/**
+ * @brief Feeds many samples through the network at once.
+ *        This gives the same results as calling deeplearn_feed_forward
+ *        for each sample, but is much faster when scoring large datasets
+ * @param learner Deep learner object
+ * @param inputs n x no_of_inputs array of input unit values
+ * @param n The number of samples
+ * @param outputs Returned n x no_of_outputs array of output unit values
+ * @returns zero on success
+ */
+int deeplearn_feed_forward_batch(deeplearn * learner,
+                                 const float * inputs, int n,
+                                 float * outputs)
+{
+    return bp_feed_forward_batch(learner->net, inputs, n, outputs);
+}
+
 /**
  * @brief Returns true if currently training the final layer
  * @param learner Deep learner object
@@ -305,6 +377,10 @@ void copy_autocoder_to_hidden_layer(deeplearn * learner, int hidden_layer)
                &autocoder->weights[i*autocoder->no_of_inputs],
                autocoder->no_of_inputs*sizeof(float));
     }
+
+    /* the copied weights may differ from any sparse pattern */
+    bp_update_sparse(learner->net);
+    bp_weights_changed(learner->net);
 }
 
 /**
@@ -334,33 +410,48 @@ void deeplearn_pretrain(bp * net, ac * autocoder, int current_layer)
 }
 
 /**
- * @brief Calculate weight gradient standard deviations for each layer
+ * @brief Calculate weight gradient standard deviations for each layer.
+ *        The statistics are only calculated on the steps which are
+ *        recorded within the gradient histories
  * @param learner Deep learner object
+ * @returns 1 if the histories were updated
  */
 static int deeplearn_update_weight_gradients(deeplearn * learner)
 {
+    float weight_gradients_std[HISTORY_DIMENSIONS];
     float weight_gradients[HISTORY_DIMENSIONS];
 
-    if (learner->gradients_std.ctr+1 < learner->gradients_std.step)
-       return 0;
+    /* monitoring is switched off */
+    if (learner->gradients_std.step == 0)
+        return 0;
 
     if (learner->net->hidden_layers >= HISTORY_DIMENSIONS)
         return 0;
 
+    /* advance the histories without the cost of calculating
+       statistics which would not be recorded */
+    if (learner->gradients_std.ctr+1 < learner->gradients_std.step) {
+        learner->gradients_std.itterations++;
+        learner->gradients_std.ctr++;
+        learner->gradients_mean.itterations++;
+        learner->gradients_mean.ctr++;
+        return 0;
+    }
+
+    FLOATCLEAR(weight_gradients_std, HISTORY_DIMENSIONS);
+    FLOATCLEAR(weight_gradients, HISTORY_DIMENSIONS);
     COUNTDOWN(layer_index, learner->net->hidden_layers) {
-        weight_gradients[layer_index] =
-            bp_weight_gradient_std(learner->net, layer_index);
+        bp_weight_gradient_stats(learner->net, layer_index,
+                                 learner->gradient_samples,
+                                 &learner->gradient_seed,
+                                 &weight_gradients[layer_index],
+                                 &weight_gradients_std[layer_index]);
     }
 
     deeplearn_history_update_from_array(&learner->gradients_std,
-                                        weight_gradients,
+                                        weight_gradients_std,
                                         PLOT_RUNNING_AVERAGE);
 
-    COUNTDOWN(layer_index, learner->net->hidden_layers) {
-        weight_gradients[layer_index] =
-            bp_weight_gradient_mean(learner->net, layer_index);
-    }
-
     deeplearn_history_update_from_array(&learner->gradients_mean,
                                         weight_gradients,
                                         PLOT_RUNNING_AVERAGE);
@@ -397,11 +488,13 @@ void deeplearn_update(deeplearn * learner)
 
     /* pretraining of autocoders */
     if (current_layer < learner->net->hidden_layers) {
+        PROFILE_TIMER(t);
 
         /* train the autocoder for this layer */
         deeplearn_pretrain(learner->net,
                            learner->autocoder[current_layer],
                            current_layer);
+        PROFILE_LAP(DEEPLEARN_PHASE_PRETRAINING, t, 1);
 
         /* update the backprop error value from the autocoder */
         learner->backprop_error =
@@ -445,6 +538,262 @@ void deeplearn_update(deeplearn * learner)
         learner->net->itterations++;
 }
 
+/**
+ * @brief Sets the number of workers used by deeplearndata_training once
+ *        pretraining is complete.  Each training step gives every worker
+ *        DEEPLEARN_HOGWILD_SAMPLES samples, and the workers run complete
+ *        forward and backward passes with their own activations and
+ *        errors, updating the shared weights without locks.
+ *        This scales with the number of workers on narrow networks, where
+ *        there is too little work within a single sample to share between
+ *        threads.  The cost is that workers may overwrite each other's
+ *        updates and the order in which samples are applied depends on
+ *        thread scheduling, so convergence is slightly noisier than
+ *        training on one sample at a time and runs are not reproducible,
+ *        even with the same random seed.  Dropouts are not used by the
+ *        workers. A single worker gives the usual reproducible training.
+ * @param learner Deep learner object
+ * @param no_of_workers The number of workers, or one to train on a
+ *        single sample at a time
+ * @returns zero on success
+ */
+int deeplearn_set_workers(deeplearn * learner, int no_of_workers)
+{
+    bp * net = learner->net;
+    int samples = no_of_workers*DEEPLEARN_HOGWILD_SAMPLES;
+
+    if ((no_of_workers < 1) || (no_of_workers > DEEPLEARN_MAX_THREADS))
+        return -1;
+
+    bp_workers_free(net, learner->workers, learner->no_of_workers);
+    free(learner->worker_inputs);
+    free(learner->worker_targets);
+    learner->workers = 0;
+    learner->worker_inputs = 0;
+    learner->worker_targets = 0;
+    learner->no_of_workers = 1;
+
+    if (no_of_workers == 1)
+        return 0;
+
+    learner->workers = bp_workers_init(net, no_of_workers);
+    FLOATALLOC(learner->worker_inputs, samples*net->no_of_inputs);
+    FLOATALLOC(learner->worker_targets, samples*net->no_of_outputs);
+    if ((!learner->workers) || (!learner->worker_inputs) ||
+        (!learner->worker_targets)) {
+        bp_workers_free(net, learner->workers, no_of_workers);
+        free(learner->worker_inputs);
+        free(learner->worker_targets);
+        learner->workers = 0;
+        learner->worker_inputs = 0;
+        learner->worker_targets = 0;
+        return -2;
+    }
+
+    learner->no_of_workers = no_of_workers;
+    return 0;
+}
+
+/**
+ * @brief Pretrains the autocoder of the current hidden layer on a
+ *        mini-batch of values of the layer below it, for example
+ *        activations which were calculated once for the whole training
+ *        set because the layers below no longer change
+ * @param learner Deep learner object
+ * @param layer_inputs n x units array of the values of the layer below
+ *        the current hidden layer, or of the network inputs when pretraining
+ *        the first hidden layer
+ * @param n The number of samples
+ * @returns zero on success
+ */
+int deeplearn_update_pretraining(deeplearn * learner,
+                                 const float * layer_inputs, int n)
+{
+    bp * net = learner->net;
+    int current_layer = learner->current_hidden_layer;
+    ac * autocoder;
+    float minimum_error_percent;
+
+    if (n < 1)
+        return -1;
+
+    if (current_layer >= net->hidden_layers)
+        return -2;
+
+    autocoder = learner->autocoder[current_layer];
+    minimum_error_percent = learner->error_threshold[current_layer];
+
+    if (autocoder_update_batch(autocoder, layer_inputs, n) != 0)
+        return -3;
+
+    /* update the backprop error value from the autocoder */
+    learner->backprop_error = autocoder->backprop_error_percent;
+
+    /* If below the error threshold, once the running average
+       has had time to stabilise */
+    if ((learner->backprop_error != DEEPLEARN_UNKNOWN_ERROR) &&
+        (learner->backprop_error < minimum_error_percent) &&
+        (autocoder->itterations > 100)) {
+        copy_autocoder_to_hidden_layer(learner, current_layer);
+
+        /* advance to the next hidden layer */
+        learner->current_hidden_layer++;
+
+        /* reset the error value */
+        learner->backprop_error = DEEPLEARN_UNKNOWN_ERROR;
+    }
+
+    deeplearn_history_update(&learner->history, learner->backprop_error);
+
+    if (net->itterations < UINT_MAX - n)
+        net->itterations += n;
+
+    return 0;
+}
+
+/**
+ * @brief Performs training on a mini-batch of samples.
+ *        During pretraining the autocoder for the current layer is
+ *        updated once per batch, and once the final layer is being
+ *        trained then the network is updated once per batch
+ * @param learner Deep learner object
+ * @param inputs batch_size x no_of_inputs array of input unit values
+ * @param targets batch_size x no_of_outputs array of desired output values.
+ *        This is not used during pretraining and may then be zero
+ * @param batch_size The number of samples in the batch
+ * @returns zero on success
+ */
+int deeplearn_update_batch(deeplearn * learner,
+                           const float * inputs, const float * targets,
+                           int batch_size)
+{
+    bp * net = learner->net;
+    float minimum_error_percent;
+
+    if (batch_size < 1)
+        return -1;
+
+    /* only continue if training is not complete */
+    if (learner->training_complete == 1)
+        return 0;
+
+    /* If there is only a single hidden layer */
+    if ((learner->current_hidden_layer == 0) &&
+        (net->hidden_layers == 1))
+        learner->current_hidden_layer = 1;
+
+    /* pretraining of autocoders */
+    if (learner->current_hidden_layer < net->hidden_layers) {
+        int current_layer = learner->current_hidden_layer;
+        float * hiddens;
+        int retval;
+
+        /* the autocoder for the first layer learns the inputs directly */
+        if (current_layer == 0)
+            return deeplearn_update_pretraining(learner, inputs, batch_size);
+
+        FLOATALLOC(hiddens, batch_size*HIDDENS_IN_LAYER(net,current_layer-1));
+        if (!hiddens)
+            return -3;
+
+        /* the hidden unit values of the previous layer are the inputs
+           of the autocoder */
+        retval = bp_feed_forward_layers_batch(net, inputs, batch_size,
+                                              current_layer, hiddens);
+        if (retval == 0)
+            retval = deeplearn_update_pretraining(learner, hiddens,
+                                                  batch_size);
+        free(hiddens);
+        return retval;
+    }
+
+    minimum_error_percent =
+        learner->error_threshold[learner->current_hidden_layer];
+
+    if (bp_update_batch(net, inputs, targets, batch_size) != 0)
+        return -2;
+
+    /* update the backprop error value */
+    learner->backprop_error = net->backprop_error_percent;
+
+    /* set the training completed flag */
+    if (learner->backprop_error < minimum_error_percent)
+        learner->training_complete = 1;
+
+    /* record the history of error values */
+    deeplearn_update_weight_gradients(learner);
+    deeplearn_history_update(&learner->history, learner->backprop_error);
+
+    /* increment the number of itterations */
+    if (net->itterations < UINT_MAX - batch_size)
+        net->itterations += batch_size;
+
+    return 0;
+}
+
+/**
+ * @brief Performs training on a number of samples with several workers
+ *        updating the shared weights concurrently, see bp_update_hogwild.
+ *        During pretraining the autocoders are updated once per batch,
+ *        as with deeplearn_update_batch
+ * @param learner Deep learner object
+ * @param workers Array of workers created with bp_workers_init
+ * @param no_of_workers The number of workers
+ * @param inputs no_of_samples x no_of_inputs array of input unit values
+ * @param targets no_of_samples x no_of_outputs array of desired output values
+ * @param no_of_samples The number of samples
+ * @returns zero on success
+ */
+int deeplearn_update_hogwild(deeplearn * learner,
+                             bp_worker * workers, int no_of_workers,
+                             const float * inputs, const float * targets,
+                             int no_of_samples)
+{
+    bp * net = learner->net;
+    float minimum_error_percent;
+
+    if (no_of_samples < 1)
+        return -1;
+
+    /* only continue if training is not complete */
+    if (learner->training_complete == 1)
+        return 0;
+
+    /* If there is only a single hidden layer */
+    if ((learner->current_hidden_layer == 0) &&
+        (net->hidden_layers == 1))
+        learner->current_hidden_layer = 1;
+
+    /* pretraining of autocoders */
+    if (learner->current_hidden_layer < net->hidden_layers)
+        return deeplearn_update_batch(learner, inputs, targets,
+                                      no_of_samples);
+
+    minimum_error_percent =
+        learner->error_threshold[learner->current_hidden_layer];
+
+    if (bp_update_hogwild(net, workers, no_of_workers,
+                          inputs, targets, no_of_samples) != 0)
+        return -2;
+
+    /* update the backprop error value */
+    learner->backprop_error = net->backprop_error_percent;
+
+    /* set the training completed flag */
+    if (learner->backprop_error < minimum_error_percent)
+        learner->training_complete = 1;
+
+    /* record the history of error values */
+    deeplearn_update_weight_gradients(learner);
+    deeplearn_history_update(&learner->history, learner->backprop_error);
+
+    /* increment the number of itterations */
+    if (net->itterations < UINT_MAX - no_of_samples)
+        net->itterations += no_of_samples;
+
+    return 0;
+}
+
 /**
  * @brief Perform continuous unsupervised learning
  * @param learner deep learner object
@@ -475,9 +824,11 @@ void deeplearn_update_continuous(deeplearn * learner)
  */
 void deeplearn_free(deeplearn * learner)
 {
-    /* clear any data */
-    deeplearndata * sample = learner->data;
-    deeplearndata * prev_sample;
+    /* the background plots may still be reading the histories */
+    deeplearn_plotter_free(&learner->plotter);
+    deeplearn_history_free(&learner->history);
+    deeplearn_history_free(&learner->gradients_std);
+    deeplearn_history_free(&learner->gradients_mean);
 
     free(learner->input_range_min);
     free(learner->input_range_max);
@@ -486,51 +837,11 @@ void deeplearn_free(deeplearn * learner)
     if (learner->field_length != 0)
         free(learner->field_length);
 
-    while (sample != 0) {
-        prev_sample = sample;
-        sample = (deeplearndata *)sample->next;
-        if (prev_sample->inputs_text != 0) {
-            /* clear any input text strings */
-            COUNTDOWN(i, learner->no_of_input_fields) {
-                if (prev_sample->inputs_text[i] != 0)
-                    free(prev_sample->inputs_text[i]);
-            }
-            free(prev_sample->inputs_text);
-        }
-        /* clear numerical fields */
-        free(prev_sample->inputs);
-        free(prev_sample->outputs);
-        free(prev_sample);
-    }
-
-    /* free training samples */
-    deeplearndata_meta * training_sample = learner->training_data;
-    deeplearndata_meta * prev_training_sample;
-    while (training_sample != 0) {
-        prev_training_sample = training_sample;
-        training_sample = (deeplearndata_meta *)training_sample->next;
-        free(prev_training_sample);
-    }
-
-    /* free labeled training samples */
-    deeplearndata_meta * training_sample_labeled =
-        learner->training_data_labeled;
-    deeplearndata_meta * prev_training_sample_labeled;
-    while (training_sample_labeled != 0) {
-        prev_training_sample_labeled = training_sample_labeled;
-        training_sample_labeled =
-            (deeplearndata_meta *)training_sample_labeled->next;
-        free(prev_training_sample_labeled);
-    }
-
-    /* free test samples */
-    deeplearndata_meta * test_sample = learner->test_data;
-    deeplearndata_meta * prev_test_sample;
-    while (test_sample != 0) {
-        prev_test_sample = test_sample;
-        test_sample = (deeplearndata_meta *)test_sample->next;
-        free(prev_test_sample);
-    }
+    /* clear any data, unless it is shared with other learners */
+    deeplearn_dataset_detach(learner);
+    free(learner->sampler_order);
+    deeplearndata_set_pretrain_cache(learner, 0, NULL);
+    deeplearn_set_workers(learner, 1);
 
     /* free the error thresholds */
     free(learner->error_threshold);
@@ -546,6 +857,7 @@ void deeplearn_free(deeplearn * learner)
     /* free the learner */
     bp_free(learner->net);
     free(learner->net);
+    deeplearn_arena_free(&learner->arena);
 }
 
 /**
@@ -581,13 +893,22 @@ void deeplearn_set_inputs(deeplearn * learner, deeplearndata * sample)
     float value, range, normalised;
     int pos = 0;
 
+    const float * encoded = sample->inputs_encoded;
+
     COUNTUP(i, learner->no_of_input_fields) {
         if (learner->field_length[i] > 0) {
             /* text value */
-            enc_text_to_binary(sample->inputs_text[i],
-                               learner->net->inputs,
-                               learner->net->no_of_inputs,
-                               pos, learner->field_length[i]/CHAR_BITS);
+            if (encoded != 0) {
+                COUNTUP(j, learner->field_length[i])
+                    deeplearn_set_input(learner, pos + j, encoded[j]);
+                encoded += learner->field_length[i];
+            }
+            else {
+                enc_text_to_binary(sample->inputs_text[i],
+                                   learner->net->inputs,
+                                   learner->net->no_of_inputs,
+                                   pos, learner->field_length[i]/CHAR_BITS);
+            }
             pos += learner->field_length[i];
         }
         else {
@@ -719,6 +1040,78 @@ void deeplearn_set_outputs(deeplearn * learner, deeplearndata * sample)
     }
 }
 
+/**
+ * @brief Normalises the inputs of the given data sample into an array,
+ *        giving the same values that deeplearn_set_inputs would set on the
+ *        network but without changing the network. Fields with no range
+ *        keep the current network input value.
+ * @param learner Deep learner object
+ * @param sample The data sample from which to obtain the input values
+ * @param inputs Array with one value per network input
+ */
+void deeplearn_encode_inputs(deeplearn * learner, deeplearndata * sample,
+                             float inputs[])
+{
+    const float * encoded = sample->inputs_encoded;
+    float range;
+    int pos = 0;
+
+    COUNTUP(i, learner->no_of_input_fields) {
+        if (learner->field_length[i] > 0) {
+            /* text value */
+            if (encoded != 0) {
+                memcpy((void*)&inputs[pos], encoded,
+                       learner->field_length[i]*sizeof(float));
+                encoded += learner->field_length[i];
+            }
+            else {
+                enc_text_to_values(sample->inputs_text[i],
+                                   inputs, learner->net->no_of_inputs,
+                                   pos, learner->field_length[i]/CHAR_BITS);
+            }
+            pos += learner->field_length[i];
+            continue;
+        }
+
+        /* numerical */
+        range = learner->input_range_max[i] - learner->input_range_min[i];
+        if (range > 0)
+            inputs[pos] =
+                (((sample->inputs[i] - learner->input_range_min[i])/range)*
+                 NEURON_RANGE) + NEURON_LOW;
+        else
+            inputs[pos] = bp_get_input(learner->net, pos);
+        pos++;
+    }
+
+    /* any inputs not covered by fields */
+    FOR(i, pos, learner->net->no_of_inputs)
+        inputs[i] = bp_get_input(learner->net, i);
+}
+
+/**
+ * @brief Normalises the outputs of the given data sample into an array,
+ *        giving the same values that deeplearn_set_outputs would set on the
+ *        network but without changing the network
+ * @param learner Deep learner object
+ * @param sample The data sample from which to obtain the output values
+ * @param outputs Array with one value per network output
+ */
+void deeplearn_encode_outputs(deeplearn * learner, deeplearndata * sample,
+                              float outputs[])
+{
+    COUNTDOWN(i, learner->net->no_of_outputs) {
+        float range =
+            learner->output_range_max[i] - learner->output_range_min[i];
+        if (range > 0)
+            outputs[i] =
+                (((sample->outputs[i] - learner->output_range_min[i])/range)*
+                 NEURON_RANGE) + NEURON_LOW;
+        else
+            outputs[i] = bp_get_desired(learner->net, i);
+    }
+}
+
 /**
  * @brief Returns the values of outputs within their normal range
  * @param learner Deep learner object
@@ -801,6 +1194,12 @@ void deeplearn_set_class(deeplearn * learner, int class)
  */
 int deeplearn_save(FILE * fp, deeplearn * learner)
 {
+    const unsigned int magic = DEEPLEARN_LEARNER_MAGIC;
+    const int version = DEEPLEARN_LEARNER_VERSION;
+
+    if ((UINTWRITE(magic) == 0) || (INTWRITE(version) == 0))
+        return -17;
+
     if (INTWRITE(learner->training_complete) == 0)
         return -1;
 
@@ -850,29 +1249,76 @@ int deeplearn_save(FILE * fp, deeplearn * learner)
                         learner->net->no_of_outputs) == 0)
         return -13;
 
-    if (fwrite(&learner->history, sizeof(deeplearn_history), 1, fp) == 0)
+    if (deeplearn_history_save(fp, &learner->history) != 0)
         return -14;
 
-    if (fwrite(&learner->gradients_std, sizeof(deeplearn_history), 1, fp) == 0)
+    if (deeplearn_history_save(fp, &learner->gradients_std) != 0)
         return -15;
 
-    if (fwrite(&learner->gradients_mean, sizeof(deeplearn_history), 1, fp) == 0)
+    if (deeplearn_history_save(fp, &learner->gradients_mean) != 0)
         return -16;
 
     return 0;
 }
 
 /**
- * @brief Loads a deep learner object from file
+ * @brief Loads a deep learner object from file.
+ *        Learners saved before the format had a version stored their
+ *        histories as raw structures, and can't be loaded
  * @param fp File pointer
  * @param learner Deep learner object
- * @return zero value on success
+ * @return zero value on success, -26 for a learner saved before the
+ *         format had a version or -27 for an unknown version
  */
 int deeplearn_load(FILE * fp, deeplearn * learner)
 {
+    unsigned int magic = 0;
+    int version = 0;
+
+    if (UINTREAD(magic) == 0)
+        return -1;
+
+    if (magic != DEEPLEARN_LEARNER_MAGIC)
+        return -26;
+
+    if (INTREAD(version) == 0)
+        return -1;
+
+    if (version != DEEPLEARN_LEARNER_VERSION)
+        return -27;
+
     /* no training/test data yet */
     learner->data = 0;
     learner->data_samples = 0;
+    learner->indexed_data = 0;
+    learner->indexed_data_samples = 0;
+    learner->data_rows = 0;
+    learner->data_rows_samples = 0;
+    learner->data_inputs = 0;
+    learner->data_outputs = 0;
+    learner->data_text = 0;
+    learner->data_encoded = 0;
+    learner->data_map = 0;
+    learner->data_map_length = 0;
+    learner->dataset = 0;
+    learner->sampler_order = 0;
+    learner->sampler_samples = 0;
+    learner->sampler_position = 0;
+    learner->sampler_labeled = 0;
+    learner->sampler_epoch = 0;
+    learner->pretrain_cache_enabled = 0;
+    learner->pretrain_cache_filename = 0;
+    learner->pretrain_cache = 0;
+    learner->pretrain_cache_length = 0;
+    learner->pretrain_cache_layer = -1;
+    learner->pretrain_cache_samples = 0;
+    learner->no_of_workers = 1;
+    learner->workers = 0;
+    learner->worker_inputs = 0;
+    learner->worker_targets = 0;
+    learner->gradient_samples = DEEPLEARN_GRADIENT_SAMPLES;
+    learner->plotting = DEEPLEARN_PLOT_ASYNC;
+    deeplearn_plotter_init(&learner->plotter);
     learner->training_data = 0;
     learner->training_data_samples = 0;
     learner->training_data_labeled = 0;
@@ -903,8 +1349,11 @@ int deeplearn_load(FILE * fp, deeplearn * learner)
 
     learner->net = (bp*)malloc(sizeof(bp));
 
+    /* the network and autocoders each have their own arena */
+    deeplearn_arena_clear(&learner->arena);
     if (bp_load(fp, learner->net) != 0)
         return -7;
+    learner->gradient_seed = learner->net->random_seed;
 
     learner->autocoder = (ac**)malloc(sizeof(ac*)*learner->net->hidden_layers);
     if (!learner->autocoder)
@@ -955,13 +1404,13 @@ int deeplearn_load(FILE * fp, deeplearn * learner)
                        learner->net->no_of_outputs) == 0)
         return -22;
 
-    if (fread(&learner->history, sizeof(deeplearn_history), 1, fp) == 0)
+    if (deeplearn_history_load(fp, &learner->history) != 0)
         return -23;
 
-    if (fread(&learner->gradients_std, sizeof(deeplearn_history), 1, fp) == 0)
+    if (deeplearn_history_load(fp, &learner->gradients_std) != 0)
         return -24;
 
-    if (fread(&learner->gradients_mean, sizeof(deeplearn_history), 1, fp) == 0)
+    if (deeplearn_history_load(fp, &learner->gradients_mean) != 0)
         return -25;
 
     return 0;
@@ -1001,8 +1450,8 @@ int deeplearn_compare(deeplearn * learner1,
         return -7;
 
     COUNTDOWN(i, learner1->history.index) {
-        if (learner1->history.history[i][0] !=
-            learner2->history.history[i][0])
+        if (HISTORY_VALUE(&learner1->history, i, 0) !=
+            HISTORY_VALUE(&learner2->history, i, 0))
             return -8;
     }
 
@@ -1057,6 +1506,31 @@ int deeplearn_plot_history(deeplearn * learner,
                                   image_width, image_height);
 }
 
+/**
+ * @brief Sets how training progress is plotted every history interval.
+ *        Plots may be drawn in the background so that training does not
+ *        wait for them, drawn as training proceeds, or turned off for
+ *        headless runs
+ * @param learner Deep learner object
+ * @param mode DEEPLEARN_PLOT_NONE, DEEPLEARN_PLOT_SYNC or
+ *        DEEPLEARN_PLOT_ASYNC
+ * @return zero on success
+ */
+int deeplearn_set_plotting(deeplearn * learner, int mode)
+{
+    if ((mode != DEEPLEARN_PLOT_NONE) &&
+        (mode != DEEPLEARN_PLOT_SYNC) &&
+        (mode != DEEPLEARN_PLOT_ASYNC))
+        return -1;
+
+    /* finish any plots already being drawn */
+    if (mode != DEEPLEARN_PLOT_ASYNC)
+        deeplearn_plotter_wait(&learner->plotter);
+
+    learner->plotting = mode;
+    return 0;
+}
+
 /**
  * @brief Plot the weight gradients for the given learner
  * @param gradient_type The type of gradient to be plotted
@@ -1113,6 +1587,11 @@ int deeplearn_plot_weight_magnitude(deeplearn * learner,
                         max_magnitude);
 
     create_scope(&s, 1);
+    if (scope_set_time_steps(&s, buckets) != 0) {
+        free(img);
+        free(histogram);
+        return 3;
+    }
     s.offset_ms = 0;
     s.marker_position = 0;
     s.time_ms = buckets;
@@ -1132,9 +1611,10 @@ int deeplearn_plot_weight_magnitude(deeplearn * learner,
                      "Weight Magnitude",
                      "Frequency", "Magnitude", 25, 4);
 
-    phosphene_write_png_file("weight_magnitude.png",
+    deeplearn_write_png_file("weight_magnitude.png",
                              img_width, img_height, 24, img);
 
+    scope_free(&s);
     free(img);
     free(histogram);
 
@@ -1142,6 +1622,27 @@ int deeplearn_plot_weight_magnitude(deeplearn * learner,
 }
 
 
+/**
+ * @brief Scans a square window across an image, returning the outputs
+ *        of the network for every position of the window, see
+ *        bp_scan_image
+ * @param learner Deep learner object
+ * @param img Image buffer (1 byte per pixel)
+ * @param image_width Width of the image in pixels
+ * @param image_height Height of the image in pixels
+ * @param window_size Width and height of the window
+ * @param stride Step in pixels between successive windows
+ * @param outputs Returned map of output unit values for each window
+ * @returns zero on success
+ */
+int deeplearn_scan_image(deeplearn * learner, unsigned char * img,
+                         int image_width, int image_height,
+                         int window_size, int stride, float * outputs)
+{
+    return bp_scan_image(learner->net, img, image_width, image_height,
+                         window_size, stride, outputs);
+}
+
 /**
  * @brief Updates the input units from a patch within a larger image
  * @param learner Deep learner object
@@ -1213,48 +1714,166 @@ void deeplearn_set_dropouts(deeplearn * learner, float dropout_percent)
 }
 
 /**
- * @brief Exports a trained network as a standalone C program
+ * @brief Sets the activation function used by a layer. The autocoder
+ *        used to pretrain a hidden layer uses the same function.
  * @param learner Deep learner object
- * @param export_type The flavor of C
- * @param filename The C source file to be produced
+ * @param layer Index of the hidden layer, or hidden_layers for the output
+ *        layer, or -1 to set every layer
+ * @param activation The activation function, eg. AF_SIGMOID_FAST
  * @returns zero on success
  */
-static int deeplearn_export_c_base(deeplearn * learner, int export_type,
-                                   char * filename)
+int deeplearn_set_activation(deeplearn * learner, int layer, int activation)
 {
-    FILE * fp;
-    int no_of_weights;
-
-    fp = fopen(filename,"w");
-    if (!fp)
+    if (bp_set_activation(learner->net, layer, activation) != 0)
         return -1;
 
-    if (export_type == EXPORT_C99) {
-        fprintf(fp,"%s\n", "#include <stdio.h>");
-        fprintf(fp,"%s\n", "#include <stdlib.h>");
+    COUNTDOWN(i, learner->net->hidden_layers) {
+        if ((layer < 0) || (layer == i))
+            learner->autocoder[i]->activation = activation;
+    }
+    return 0;
+}
 
-        if (learner->no_of_input_fields > 0)
-            fprintf(fp,"%s\n", "#include <string.h>");
+/**
+ * @brief Sets the optimizer used to adjust the weights of the network
+ *        and of the autocoders used for pretraining. Adaptive
+ *        optimizers usually reach a given error in fewer training steps
+ *        at the cost of extra memory for the moments of each weight
+ * @param learner Deep learner object
+ * @param type The optimizer, eg. OPTIMIZER_ADAM
+ * @returns zero on success
+ */
+int deeplearn_set_optimizer(deeplearn * learner, int type)
+{
+    if (bp_set_optimizer(learner->net, type) != 0)
+        return -1;
 
-        fprintf(fp,"%s\n\n", "#include <math.h>");
+    COUNTDOWN(i, learner->net->hidden_layers) {
+        if (autocoder_set_optimizer(learner->autocoder[i], type) != 0)
+            return -2;
     }
+    return 0;
+}
 
-#if ACTIVATION_FUNCTION == AF_SIGMOID
-    fprintf(fp,"%s\n\n", "#define AF(adder) (1.0f / (1.0f + exp(-(adder))))");
-#elif ACTIVATION_FUNCTION == AF_TANH
-    fprintf(fp,"%s\n\n", "#define AF(adder) " \
-            "((((2.0f / (1.0f + exp(-(2*adder)))) - 1.0f)*0.5f)+0.5f)");
-#elif ACTIVATION_FUNCTION == AF_LINEAR
-    fprintf(fp,"%s\n\n", "#define AF(adder) " \
-            "((adder) < 1.0f ? ((adder) > -1.0f ? " \
-            "(((adder)*0.5f)+0.5f) : 0.0f) : 1.0f)");
-#endif
-
-    if (learner->no_of_input_fields > 0)
-        fprintf(fp, "const int no_of_input_fields = %d;\n",
-                learner->no_of_input_fields);
+/**
+ * @brief Sets the precision of the weights of the network when feeding
+ *        forward. The autocoders used for pretraining remain at full
+ *        precision
+ * @param learner Deep learner object
+ * @param precision The precision, eg. DEEPLEARN_PRECISION_BF16
+ * @returns zero on success
+ */
+int deeplearn_set_precision(deeplearn * learner, int precision)
+{
+    if (bp_set_precision(learner->net, precision) != 0)
+        return -1;
+    return 0;
+}
 
-    fprintf(fp, "const int no_of_inputs = %d;\n",
+/**
+ * @brief Writes the remaining weights of a sparse layer as compressed
+ *        rows for an exported C program
+ * @param fp File to write to
+ * @param layer The sparse layer
+ * @param name Name of the layer within the exported program
+ */
+static void deeplearn_export_c_sparse_weights(FILE * fp, bp_layer * layer,
+                                              const char * name)
+{
+    int nnz = layer->row_start[layer->no_of_units];
+
+    fprintf(fp, "float %s_weights[] = {\n  ", name);
+    COUNTUP(i, layer->no_of_units) {
+        FOR(k, layer->row_start[i], layer->row_start[i+1]) {
+            fprintf(fp, "%.10f",
+                    layer->weights[i*layer->no_of_inputs +
+                                   layer->columns[k]]);
+            if (k < nnz-1)
+                fprintf(fp, ",");
+        }
+    }
+    if (nnz == 0)
+        fprintf(fp, "%d", 0);
+    fprintf(fp, "%s", "\n};\n\n");
+
+    fprintf(fp, "int %s_columns[] = {\n  ", name);
+    COUNTUP(k, nnz) {
+        fprintf(fp, "%d", layer->columns[k]);
+        if (k < nnz-1)
+            fprintf(fp, ",");
+    }
+    if (nnz == 0)
+        fprintf(fp, "%d", 0);
+    fprintf(fp, "%s", "\n};\n\n");
+
+    fprintf(fp, "int %s_rows[] = {\n  ", name);
+    COUNTUP(i, layer->no_of_units+1) {
+        fprintf(fp, "%d", layer->row_start[i]);
+        if (i < layer->no_of_units)
+            fprintf(fp, ",");
+    }
+    fprintf(fp, "%s", "\n};\n\n");
+}
+
+/**
+ * @brief Writes the weighted sum of inputs over the remaining weights
+ *        of a sparse layer for an exported C program
+ * @param fp File to write to
+ * @param name Name of the layer within the exported program
+ * @param inputs Name of the array of inputs to the layer
+ */
+static void deeplearn_export_c_sparse_sum(FILE * fp, const char * name,
+                                          const char * inputs)
+{
+    fprintf(fp, "    for (j = %s_rows[i]; j < %s_rows[i+1]; j++) {\n",
+            name, name);
+    fprintf(fp, "      sum += %s_weights[j]*%s[%s_columns[j]];\n",
+            name, inputs, name);
+    fprintf(fp, "%s", "    }\n");
+}
+
+/**
+ * @brief Exports a trained network as a standalone C program
+ * @param learner Deep learner object
+ * @param export_type The flavor of C
+ * @param filename The C source file to be produced
+ * @returns zero on success
+ */
+static int deeplearn_export_c_base(deeplearn * learner, int export_type,
+                                   char * filename)
+{
+    FILE * fp;
+    int no_of_weights;
+    bp_layer * output_layer =
+        &learner->net->layers[learner->net->hidden_layers];
+
+    fp = fopen(filename,"w");
+    if (!fp)
+        return -1;
+
+    if (export_type == EXPORT_C99) {
+        fprintf(fp,"%s\n", "#include <stdio.h>");
+        fprintf(fp,"%s\n", "#include <stdlib.h>");
+
+        if (learner->no_of_input_fields > 0)
+            fprintf(fp,"%s\n", "#include <string.h>");
+
+        fprintf(fp,"%s\n\n", "#include <math.h>");
+    }
+
+    fprintf(fp,"%s\n", "#define af_sigmoid(adder) " \
+            "(1.0f / (1.0f + exp(-(adder))))");
+    fprintf(fp,"%s\n", "#define af_tanh(adder) " \
+            "((((2.0f / (1.0f + exp(-(2*adder)))) - 1.0f)*0.5f)+0.5f)");
+    fprintf(fp,"%s\n\n", "#define af_linear(adder) " \
+            "((adder) < 1.0f ? ((adder) > -1.0f ? " \
+            "(((adder)*0.5f)+0.5f) : 0.0f) : 1.0f)");
+
+    if (learner->no_of_input_fields > 0)
+        fprintf(fp, "const int no_of_input_fields = %d;\n",
+                learner->no_of_input_fields);
+
+    fprintf(fp, "const int no_of_inputs = %d;\n",
             learner->net->no_of_inputs);
     fprintf(fp, "const int no_of_hiddens = %d;\n",
             learner->net->no_of_hiddens);
@@ -1313,6 +1932,14 @@ static int deeplearn_export_c_base(deeplearn * learner, int export_type,
 
     /* hidden unit weights */
     COUNTUP(i, learner->net->hidden_layers) {
+        if (learner->net->layers[i].row_start != 0) {
+            char name[32];
+            sprintf(name, "hidden_layer_%d", i);
+            deeplearn_export_c_sparse_weights(fp, &learner->net->layers[i],
+                                              name);
+            continue;
+        }
+
         fprintf(fp,
                 "float hidden_layer_%d_weights[] = {\n  ", i);
 
@@ -1349,23 +1976,28 @@ static int deeplearn_export_c_base(deeplearn * learner, int export_type,
     }
 
     /* output unit weights */
-    fprintf(fp, "%s",
-            "float output_layer_weights[] = {\n  ");
-    COUNTUP(i, learner->net->no_of_outputs) {
-        COUNTUP(j, HIDDENS_IN_LAYER(learner->net,
-                                       learner->net->hidden_layers-1)) {
-            float w = learner->net->outputs[i]->weights[j];
-            if (w != 0)
-                fprintf(fp, "%.10f", w);
-            else
-                fprintf(fp, "%d", 0);
-            if (!((i == learner->net->no_of_outputs-1) &&
-                  (j == HIDDENS_IN_LAYER(learner->net,
-                                            learner->net->hidden_layers-1)-1)))
-                fprintf(fp, ",");
+    if (output_layer->row_start != 0) {
+        deeplearn_export_c_sparse_weights(fp, output_layer, "output_layer");
+    }
+    else {
+        fprintf(fp, "%s",
+                "float output_layer_weights[] = {\n  ");
+        COUNTUP(i, learner->net->no_of_outputs) {
+            COUNTUP(j, HIDDENS_IN_LAYER(learner->net,
+                                           learner->net->hidden_layers-1)) {
+                float w = learner->net->outputs[i]->weights[j];
+                if (w != 0)
+                    fprintf(fp, "%.10f", w);
+                else
+                    fprintf(fp, "%d", 0);
+                if (!((i == learner->net->no_of_outputs-1) &&
+                      (j == HIDDENS_IN_LAYER(learner->net,
+                                             learner->net->hidden_layers-1)-1)))
+                    fprintf(fp, ",");
+            }
         }
+        fprintf(fp, "%s", "\n};\n\n");
     }
-    fprintf(fp, "%s", "\n};\n\n");
 
     /* output unit biases */
     fprintf(fp, "%s",
@@ -1531,11 +2163,17 @@ static int deeplearn_export_c_base(deeplearn * learner, int export_type,
     fprintf(fp, "%s", "  /* Hidden layer 0 */\n");
     fprintf(fp, "%s", "  for (i = 0; i < no_of_hiddens; i++) {\n");
     fprintf(fp, "%s", "    sum = hidden_layer_0_bias[i];\n");
-    fprintf(fp, "%s", "    for (j = 0; j < no_of_inputs; j++) {\n");
-    fprintf(fp, "%s", "      sum += hidden_layer_0_weights[i*no_of_inputs+j]*" \
-            "network_inputs[j];\n");
-    fprintf(fp, "%s", "    }\n");
-    fprintf(fp, "%s", "    hiddens[i] = AF(sum);\n");
+    if (learner->net->layers[0].row_start != 0)
+        deeplearn_export_c_sparse_sum(fp, "hidden_layer_0", "network_inputs");
+    else {
+        fprintf(fp, "%s", "    for (j = 0; j < no_of_inputs; j++) {\n");
+        fprintf(fp, "%s",
+                "      sum += hidden_layer_0_weights[i*no_of_inputs+j]*" \
+                "network_inputs[j];\n");
+        fprintf(fp, "%s", "    }\n");
+    }
+    fprintf(fp, "    hiddens[i] = %s(sum);\n",
+            activation_export_name(bp_get_activation(learner->net, 0)));
     fprintf(fp, "%s", "  }\n");
     fprintf(fp, "%s", "  for (i = 0; i < no_of_hiddens; i++) {\n");
     fprintf(fp, "%s", "    prev_hiddens[i] = hiddens[i];\n");
@@ -1545,13 +2183,21 @@ static int deeplearn_export_c_base(deeplearn * learner, int export_type,
         fprintf(fp, "  for (i = 0; i < %d; i++) {\n",
                 HIDDENS_IN_LAYER(learner->net,i));
         fprintf(fp, "    sum = hidden_layer_%d_bias[i];\n",i);
-        fprintf(fp, "    for (j = 0; j < %d; j++) {\n",
-                HIDDENS_IN_LAYER(learner->net,i-1));
-        fprintf(fp, "      sum += " \
-                "hidden_layer_%d_weights[i*%d+j]*prev_hiddens[j];\n",
-                i,HIDDENS_IN_LAYER(learner->net,i-1));
-        fprintf(fp, "%s", "    }\n");
-        fprintf(fp, "%s", "    hiddens[i] = AF(sum);\n");
+        if (learner->net->layers[i].row_start != 0) {
+            char name[32];
+            sprintf(name, "hidden_layer_%d", i);
+            deeplearn_export_c_sparse_sum(fp, name, "prev_hiddens");
+        }
+        else {
+            fprintf(fp, "    for (j = 0; j < %d; j++) {\n",
+                    HIDDENS_IN_LAYER(learner->net,i-1));
+            fprintf(fp, "      sum += " \
+                    "hidden_layer_%d_weights[i*%d+j]*prev_hiddens[j];\n",
+                    i,HIDDENS_IN_LAYER(learner->net,i-1));
+            fprintf(fp, "%s", "    }\n");
+        }
+        fprintf(fp, "    hiddens[i] = %s(sum);\n",
+                activation_export_name(bp_get_activation(learner->net, i)));
         fprintf(fp, "%s", "  }\n");
         fprintf(fp, "  for (i = 0; i < %d; i++) {\n",
                 HIDDENS_IN_LAYER(learner->net,i));
@@ -1561,12 +2207,20 @@ static int deeplearn_export_c_base(deeplearn * learner, int export_type,
     fprintf(fp, "%s", "  /* Output layer */\n");
     fprintf(fp, "%s", "  for (i = 0; i < no_of_outputs; i++) {\n");
     fprintf(fp, "%s", "    sum = output_layer_bias[i];\n");
-    fprintf(fp, "    for (j = 0; j < %d; j++) {\n",
-            HIDDENS_IN_LAYER(learner->net,learner->net->hidden_layers-1));
-    fprintf(fp, "      sum += output_layer_weights[i*%d+j]*prev_hiddens[j];\n",
-            HIDDENS_IN_LAYER(learner->net,learner->net->hidden_layers-1));
-    fprintf(fp, "%s", "    }\n");
-    fprintf(fp, "%s", "    outputs[i] = AF(sum);\n");
+    if (output_layer->row_start != 0)
+        deeplearn_export_c_sparse_sum(fp, "output_layer", "prev_hiddens");
+    else {
+        fprintf(fp, "    for (j = 0; j < %d; j++) {\n",
+                HIDDENS_IN_LAYER(learner->net,learner->net->hidden_layers-1));
+        fprintf(fp,
+                "      sum += output_layer_weights[i*%d+j]*prev_hiddens[j];\n",
+                HIDDENS_IN_LAYER(learner->net,learner->net->hidden_layers-1));
+        fprintf(fp, "%s", "    }\n");
+    }
+    fprintf(fp, "    outputs[i] = %s(sum);\n",
+            activation_export_name(
+                bp_get_activation(learner->net,
+                                  learner->net->hidden_layers)));
     fprintf(fp, "%s", "  }\n\n");
 
     fprintf(fp, "%s", "  for (i = 0; i < no_of_outputs; i++) {\n");
@@ -1627,6 +2281,558 @@ static int deeplearn_export_arduino(deeplearn * learner, char * filename)
     return deeplearn_export_c_base(learner, EXPORT_ARDUINO, filename);
 }
 
+/**
+ * @brief Writes a table of quantized activation values for an exported
+ *        int8 program. The table is indexed by the weighted sum in steps
+ *        of 1/32 over the range -8 to 8, and values are in the range
+ *        0 to 127
+ * @param fp File to write to
+ * @param name Name of the exported activation function, eg. af_sigmoid
+ */
+static void deeplearn_export_int8_table(FILE * fp, const char * name)
+{
+    fprintf(fp, "static const int8_t %s_table[512] PROGMEM = {\n  ", name);
+    COUNTUP(i, 512) {
+        float x = (i - 256) / 32.0f;
+        float v = 1.0f / (1.0f + expf(-x));
+
+        if (strcmp(name, "af_tanh") == 0)
+            v = (tanhf(x)*0.5f) + 0.5f;
+
+        fprintf(fp, "%d", (int)roundf(v*127));
+        if (i < 511)
+            fprintf(fp, "%s", ((i+1)%16 == 0) ? ",\n  " : ",");
+    }
+    fprintf(fp, "%s", "\n};\n\n");
+}
+
+/**
+ * @brief Writes a function which feeds activations through one layer of
+ *        an exported int8 program. The sizes are fixed, and the weighted
+ *        sums are unrolled four at a time so that the compiler can keep
+ *        them in registers or vectorise them
+ * @param fp File to write to
+ * @param layer The layer
+ * @param name Name of the layer within the exported program
+ */
+static void deeplearn_export_int8_layer(FILE * fp, bp_layer * layer,
+                                        const char * name)
+{
+    const int no_of_inputs = layer->no_of_inputs;
+    const int unrolled = no_of_inputs - (no_of_inputs%4);
+
+    fprintf(fp, "/* %s: %d units with %d inputs */\n", name,
+            layer->no_of_units, no_of_inputs);
+    fprintf(fp, "static void %s(const int8_t * in, int8_t * out)\n", name);
+    fprintf(fp, "%s", "{\n");
+    if (unrolled > 0)
+        fprintf(fp, "%s", "  int i, j;\n\n");
+    else
+        fprintf(fp, "%s", "  int i;\n\n");
+    fprintf(fp, "  for (i = 0; i < %d; i++) {\n", layer->no_of_units);
+    fprintf(fp, "    const int8_t * w = &%s_weights[i*%d];\n",
+            name, no_of_inputs);
+    fprintf(fp, "%s", "    int32_t sum = 0;\n\n");
+    if (unrolled > 0) {
+        fprintf(fp, "    for (j = 0; j < %d; j += 4) {\n", unrolled);
+        fprintf(fp, "%s", "      sum += (int32_t)read_weight(w[j])*in[j] +\n"
+                "        (int32_t)read_weight(w[j+1])*in[j+1] +\n"
+                "        (int32_t)read_weight(w[j+2])*in[j+2] +\n"
+                "        (int32_t)read_weight(w[j+3])*in[j+3];\n");
+        fprintf(fp, "%s", "    }\n");
+    }
+    FOR(j, unrolled, no_of_inputs)
+        fprintf(fp, "    sum += (int32_t)read_weight(w[%d])*in[%d];\n", j, j);
+    fprintf(fp, "    sum = (int32_t)(((int64_t)sum*%s_scale + "
+            "read_bias(%s_bias[i]) + 8388608) >> 24);\n", name, name);
+    fprintf(fp, "    out[i] = %s(sum);\n",
+            activation_export_name(layer->activation));
+    fprintf(fp, "%s", "  }\n");
+    fprintf(fp, "%s", "}\n\n");
+}
+
+/**
+ * @brief Exports a trained network as a standalone C program with
+ *        8 bit integer weights. Weighted sums are calculated with
+ *        integer arithmetic and activation functions are looked up
+ *        from tables. The Arduino flavor uses no floating point
+ *        arithmetic at all
+ * @param learner Deep learner object
+ * @param export_type The flavor of C
+ * @param filename The C source file to be produced
+ * @returns zero on success
+ */
+static int deeplearn_export_c_int8(deeplearn * learner, int export_type,
+                                   char * filename)
+{
+    bp * net = learner->net;
+    FILE * fp;
+    signed char * weights;
+    int max_weights = 0, max_units = 0;
+    int level_low = (int)roundf(NEURON_LOW*127);
+    int level_high = (int)roundf(NEURON_HIGH*127);
+    int uses_sigmoid = 0, uses_tanh = 0;
+
+    COUNTUP(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+        const char * name = activation_export_name(layer->activation);
+
+        if (layer->no_of_units*layer->no_of_inputs > max_weights)
+            max_weights = layer->no_of_units*layer->no_of_inputs;
+        if (layer->no_of_units > max_units)
+            max_units = layer->no_of_units;
+        if (strcmp(name, "af_sigmoid") == 0)
+            uses_sigmoid = 1;
+        if (strcmp(name, "af_tanh") == 0)
+            uses_tanh = 1;
+    }
+
+    weights = (signed char*)malloc(max_weights*sizeof(signed char));
+    if (!weights)
+        return -1;
+
+    fp = fopen(filename,"w");
+    if (!fp) {
+        free(weights);
+        return -2;
+    }
+
+    if (export_type == EXPORT_C99) {
+        fprintf(fp,"%s\n", "#include <stdio.h>");
+        fprintf(fp,"%s\n", "#include <stdlib.h>");
+
+        if (learner->no_of_input_fields > 0)
+            fprintf(fp,"%s\n", "#include <string.h>");
+    }
+    fprintf(fp,"%s\n\n", "#include <stdint.h>");
+
+    /* weights and tables live in program memory on AVR, which has
+       far more flash than RAM */
+    fprintf(fp, "%s", "#if defined(__AVR__)\n");
+    fprintf(fp, "%s", "#include <avr/pgmspace.h>\n");
+    fprintf(fp, "%s", "#define read_weight(w) ((int8_t)pgm_read_byte(&(w)))\n");
+    fprintf(fp, "%s", "#define read_bias(b) ((int32_t)pgm_read_dword(&(b)))\n");
+    fprintf(fp, "%s", "#define ALIGNED\n");
+    fprintf(fp, "%s", "#else\n");
+    fprintf(fp, "%s", "#define PROGMEM\n");
+    fprintf(fp, "%s", "#define read_weight(w) (w)\n");
+    fprintf(fp, "%s", "#define read_bias(b) (b)\n");
+    fprintf(fp, "%s", "#if defined(__GNUC__)\n");
+    fprintf(fp, "%s", "#define ALIGNED __attribute__((aligned(16)))\n");
+    fprintf(fp, "%s", "#else\n");
+    fprintf(fp, "%s", "#define ALIGNED\n");
+    fprintf(fp, "%s", "#endif\n");
+    fprintf(fp, "%s", "#endif\n\n");
+
+    fprintf(fp, "%s", "/* Activations are in the range 0 - 127.\n");
+    fprintf(fp, "%s", "   Weighted sums are in steps of 1/32 and "
+            "activation functions\n");
+    fprintf(fp, "%s", "   are looked up over the range -8 to 8 */\n");
+    fprintf(fp, "%s", "#define af_index(adder) ((adder) < -256 ? 0 : "
+            "((adder) > 255 ? 511 : (adder) + 256))\n");
+    if (uses_sigmoid != 0)
+        fprintf(fp, "%s", "#define af_sigmoid(adder) "
+                "read_weight(af_sigmoid_table[af_index(adder)])\n");
+    if (uses_tanh != 0)
+        fprintf(fp, "%s", "#define af_tanh(adder) "
+                "read_weight(af_tanh_table[af_index(adder)])\n");
+    fprintf(fp, "%s", "#define af_linear(adder) ((adder) < -32 ? 0 : "
+            "((adder) > 32 ? 127 : (((adder) + 32)*127)/64))\n\n");
+
+    if (uses_sigmoid != 0)
+        deeplearn_export_int8_table(fp, "af_sigmoid");
+    if (uses_tanh != 0)
+        deeplearn_export_int8_table(fp, "af_tanh");
+
+    if (learner->no_of_input_fields > 0)
+        fprintf(fp, "const int no_of_input_fields = %d;\n",
+                learner->no_of_input_fields);
+
+    fprintf(fp, "const int no_of_inputs = %d;\n", net->no_of_inputs);
+    fprintf(fp, "const int no_of_outputs = %d;\n\n", net->no_of_outputs);
+
+    /* field lengths */
+    if ((learner->field_length != 0) && (learner->no_of_input_fields > 0)) {
+        fprintf(fp, "%s", "int field_length[] = {\n  ");
+        COUNTUP(i, learner->no_of_input_fields) {
+            fprintf(fp, "%d", learner->field_length[i]);
+            if (i < learner->no_of_input_fields-1)
+                fprintf(fp, ",");
+        }
+        fprintf(fp, "%s", "\n};\n\n");
+    }
+
+    /* ranges */
+    if (export_type == EXPORT_C99) {
+        fprintf(fp, "%s", "float input_range_min[] = {\n  ");
+        COUNTUP(i, net->no_of_inputs) {
+            fprintf(fp, "%.10f", learner->input_range_min[i]);
+            if (i < net->no_of_inputs-1)
+                fprintf(fp, ",");
+        }
+        fprintf(fp, "%s", "\n};\n\n");
+        fprintf(fp, "%s", "float input_range_max[] = {\n  ");
+        COUNTUP(i, net->no_of_inputs) {
+            fprintf(fp, "%.10f", learner->input_range_max[i]);
+            if (i < net->no_of_inputs-1)
+                fprintf(fp, ",");
+        }
+        fprintf(fp, "%s", "\n};\n\n");
+        fprintf(fp, "%s", "float output_range_min[] = {\n  ");
+        COUNTUP(i, net->no_of_outputs) {
+            fprintf(fp, "%.10f", learner->output_range_min[i]);
+            if (i < net->no_of_outputs-1)
+                fprintf(fp, ",");
+        }
+        fprintf(fp, "%s", "\n};\n\n");
+        fprintf(fp, "%s", "float output_range_max[] = {\n  ");
+        COUNTUP(i, net->no_of_outputs) {
+            fprintf(fp, "%.10f", learner->output_range_max[i]);
+            if (i < net->no_of_outputs-1)
+                fprintf(fp, ",");
+        }
+        fprintf(fp, "%s", "\n};\n\n");
+    }
+    else {
+        /* fixed point conversions with 16 fractional bits, so that
+           no floating point arithmetic is needed */
+        fprintf(fp, "%s", "/* level = (input*input_mul + input_add) "
+                "/ 65536 */\n");
+        fprintf(fp, "%s", "const int64_t input_mul[] = {\n  ");
+        COUNTUP(i, net->no_of_inputs) {
+            double range =
+                learner->input_range_max[i] - learner->input_range_min[i];
+            double mul = 0;
+
+            if (range > 0)
+                mul = 127.0*NEURON_RANGE*65536.0/range;
+            fprintf(fp, "%lldLL", (long long)llround(mul));
+            if (i < net->no_of_inputs-1)
+                fprintf(fp, ",");
+        }
+        fprintf(fp, "%s", "\n};\n\n");
+        fprintf(fp, "%s", "const int64_t input_add[] = {\n  ");
+        COUNTUP(i, net->no_of_inputs) {
+            double range =
+                learner->input_range_max[i] - learner->input_range_min[i];
+            double add = 127.0*NEURON_UNKNOWN*65536.0;
+
+            /* includes one half for rounding */
+            if (range > 0)
+                add = ((127.0*NEURON_LOW) + 0.5 -
+                       (learner->input_range_min[i]*127.0*
+                        NEURON_RANGE/range))*65536.0;
+            fprintf(fp, "%lldLL", (long long)llround(add));
+            if (i < net->no_of_inputs-1)
+                fprintf(fp, ",");
+        }
+        fprintf(fp, "%s", "\n};\n\n");
+
+        fprintf(fp, "%s", "/* thousandths = (level*output_mul + "
+                "output_add) / 65536 */\n");
+        fprintf(fp, "%s", "const int64_t output_mul[] = {\n  ");
+        COUNTUP(i, net->no_of_outputs) {
+            double range =
+                learner->output_range_max[i] - learner->output_range_min[i];
+            double mul = 1000.0*65536.0/127.0;
+
+            if (range > 0)
+                mul = range*1000.0*65536.0/(127.0*NEURON_RANGE);
+            fprintf(fp, "%lldLL", (long long)llround(mul));
+            if (i < net->no_of_outputs-1)
+                fprintf(fp, ",");
+        }
+        fprintf(fp, "%s", "\n};\n\n");
+        fprintf(fp, "%s", "const int64_t output_add[] = {\n  ");
+        COUNTUP(i, net->no_of_outputs) {
+            double range =
+                learner->output_range_max[i] - learner->output_range_min[i];
+            double add = 0;
+
+            if (range > 0)
+                add = (learner->output_range_min[i] -
+                       (NEURON_LOW*range/NEURON_RANGE))*1000.0*65536.0;
+            fprintf(fp, "%lldLL", (long long)llround(add));
+            if (i < net->no_of_outputs-1)
+                fprintf(fp, ",");
+        }
+        fprintf(fp, "%s", "\n};\n\n");
+    }
+
+    /* quantized weights, fixed point scales and biases for each layer */
+    COUNTUP(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+        int no_of_weights = layer->no_of_units*layer->no_of_inputs;
+        float scale;
+        char name[32];
+
+        if (l < net->hidden_layers)
+            sprintf(name, "hidden_layer_%d", l);
+        else
+            sprintf(name, "%s", "output_layer");
+
+        bp_quantize_layer(net, l, weights, &scale);
+
+        fprintf(fp, "static const int8_t %s_weights[%d] ALIGNED PROGMEM "
+                "= {\n  ", name, no_of_weights);
+        COUNTUP(i, no_of_weights) {
+            fprintf(fp, "%d", (int)weights[i]);
+            if (i < no_of_weights-1)
+                fprintf(fp, "%s", ((i+1)%16 == 0) ? ",\n  " : ",");
+        }
+        fprintf(fp, "%s", "\n};\n\n");
+
+        /* converts a sum of weight x activation products into
+           the 1/32 steps used by the activation functions */
+        fprintf(fp, "static const int64_t %s_scale = %lldLL;\n\n", name,
+                (long long)llround(scale*32.0*16777216.0/127.0));
+
+        /* biases are within the weight limits, so fit into 32 bits */
+        fprintf(fp, "static const int32_t %s_bias[%d] PROGMEM = {\n  ",
+                name, layer->no_of_units);
+        COUNTUP(i, layer->no_of_units) {
+            double bias = CLIP_WEIGHT(layer->units[i].bias);
+
+            fprintf(fp, "%ldL", (long)llround(bias*32.0*16777216.0));
+            if (i < layer->no_of_units-1)
+                fprintf(fp, ",");
+        }
+        fprintf(fp, "%s", "\n};\n\n");
+
+        deeplearn_export_int8_layer(fp, layer, name);
+    }
+
+    if (export_type == EXPORT_C99)
+        fprintf(fp, "float inputs[%d];\n", net->no_of_inputs);
+    else
+        fprintf(fp, "int32_t inputs[%d];\n", net->no_of_inputs);
+    fprintf(fp, "int8_t network_inputs[%d];\n", net->no_of_inputs);
+    fprintf(fp, "int8_t activations[2][%d];\n", max_units);
+    if (export_type == EXPORT_C99)
+        fprintf(fp, "float outputs[%d];\n\n", net->no_of_outputs);
+    else
+        fprintf(fp, "int32_t outputs[%d];\n\n", net->no_of_outputs);
+
+    if (learner->no_of_input_fields > 0) {
+        fprintf(fp, "%s", "/* Encode some text into the input units */\n");
+        fprintf(fp, "%s", "void encode_text(char * text,\n");
+        fprintf(fp, "%s",
+                "                 int8_t * inputs, int no_of_inputs,\n");
+        fprintf(fp, "%s",
+                "                 int offset, int max_field_length_chars)\n");
+
+        fprintf(fp, "%s",
+                "{\n  int pos = offset, i, bit, max_chars = strlen(text);\n\n");
+
+        fprintf(fp, "  if (max_chars > (no_of_inputs-offset)/%d) {\n",
+                (int)CHAR_BITS);
+        fprintf(fp, "    max_chars = ((no_of_inputs-offset)/%d);\n",
+                (int)CHAR_BITS);
+        fprintf(fp, "%s", "  }\n");
+        fprintf(fp, "%s", "  if (max_chars > max_field_length_chars) {\n");
+        fprintf(fp, "%s", "    max_chars = max_field_length_chars;\n");
+        fprintf(fp, "%s", "  }\n\n");
+
+        fprintf(fp, "%s", "  /* for each character in the string */\n");
+        fprintf(fp, "%s", "  for (i = 0; i < max_chars; i++) {\n");
+        fprintf(fp, "%s", "    /* set the bits for this character */\n");
+        fprintf(fp, "    for (bit = 0; bit < %d; bit++, pos++) {\n",
+                (int)CHAR_BITS);
+        fprintf(fp, "%s", "      if (text[i] & (1<<bit)) {\n");
+        fprintf(fp,       "        inputs[pos] = %d;\n", level_high);
+        fprintf(fp, "%s", "      }\n");
+        fprintf(fp, "%s", "      else {\n");
+        fprintf(fp,       "        inputs[pos] = %d;\n", level_low);
+        fprintf(fp, "%s", "      }\n");
+        fprintf(fp, "%s", "    }\n");
+        fprintf(fp, "%s", "  }\n");
+        fprintf(fp, "%s",
+                "  /* set the remaining inputs within the field to neutral */\n");
+        fprintf(fp, "%s", "  while (i < max_field_length_chars) {\n");
+        fprintf(fp,       "    for (bit = 0; bit < %d; bit++) {\n",
+                (int)CHAR_BITS);
+        fprintf(fp, "%s", "      if (pos >= no_of_inputs) {\n");
+        fprintf(fp, "%s", "        i = max_field_length_chars;\n");
+        fprintf(fp, "%s", "        break;\n");
+        fprintf(fp, "%s", "      }\n");
+        fprintf(fp,       "      inputs[pos++] = %d;\n",
+                (int)roundf(NEURON_UNKNOWN*127));
+        fprintf(fp, "%s", "    }\n");
+        fprintf(fp, "%s", "    i++;\n");
+        fprintf(fp, "%s", "  }\n");
+        fprintf(fp, "%s", "}\n\n");
+    }
+
+    if (export_type == EXPORT_C99)
+        fprintf(fp, "%s", "int main(int argc, char* argv[])\n");
+    else {
+        fprintf(fp, "%s", "void setup()\n");
+        fprintf(fp, "%s", "{\n");
+        fprintf(fp, "%s", "  Serial.begin(115200);\n");
+        fprintf(fp, "%s", "}\n\n");
+        fprintf(fp, "%s", "void loop()\n");
+    }
+
+    fprintf(fp, "%s", "{\n");
+
+    if (learner->no_of_input_fields == 0)
+        fprintf(fp, "%s", "  int i;\n");
+    else
+        fprintf(fp, "%s", "  int i,pos;\n");
+
+    if (export_type == EXPORT_C99)
+        fprintf(fp, "%s", "  float value;\n\n");
+    else
+        fprintf(fp, "%s", "  int64_t value;\n\n");
+
+    if (export_type == EXPORT_C99) {
+        if (learner->no_of_input_fields == 0)
+            fprintf(fp, "  if (argc < %d) return -1;\n\n",
+                    net->no_of_inputs);
+        else
+            fprintf(fp, "  if (argc < %d) return -1;\n\n",
+                    learner->no_of_input_fields);
+        fprintf(fp, "%s",
+                "  /* Obtain input values from command arguments */\n");
+        fprintf(fp, "%s", "  for (i = 1; i < argc; i++) {\n");
+        fprintf(fp, "%s", "    if (i > no_of_inputs) return -2;\n");
+        fprintf(fp, "%s", "    inputs[i-1] = atof(argv[i]);\n");
+        fprintf(fp, "%s", "  }\n\n");
+    }
+    else {
+        fprintf(fp, "%s", "  /* Change the read pin numbers as needed */\n");
+        COUNTUP(i, net->no_of_inputs)
+            fprintf(fp, "  inputs[%d] = analogRead(%d);\n", i, i);
+        fprintf(fp, "%s", "\n");
+    }
+
+    if (learner->no_of_input_fields == 0) {
+        fprintf(fp, "  /* Normalise inputs into a %d - %d range */\n",
+                level_low, level_high);
+        fprintf(fp, "%s", "  for (i = 0; i < no_of_inputs; i++) {\n");
+        if (export_type == EXPORT_C99)
+            fprintf(fp, "    value = %.2f + ((inputs[i] - " \
+                    "input_range_min[i])*%.2f/(input_range_max[i] - " \
+                    "input_range_min[i]));\n" \
+                    "    value = value*127 + 0.5f;\n",
+                    NEURON_LOW, NEURON_RANGE);
+        else
+            fprintf(fp, "%s", "    value = (inputs[i]*input_mul[i] + " \
+                    "input_add[i]) / 65536;\n");
+        fprintf(fp, "    if (value < %d) value = %d;\n",
+                level_low, level_low);
+        fprintf(fp, "    if (value > %d) value = %d;\n",
+                level_high, level_high);
+        fprintf(fp, "%s", "    network_inputs[i] = (int8_t)value;\n");
+        fprintf(fp, "%s", "  }\n\n");
+    }
+    else {
+        fprintf(fp, "%s", "  pos = 0;\n");
+        fprintf(fp, "%s", "  for (i = 0; i < no_of_input_fields; i++) {\n");
+        fprintf(fp, "%s", "    if (field_length[i] == 0) {\n");
+        fprintf(fp,
+                "      /* Normalise numeric inputs into a %d - %d range */\n",
+                level_low, level_high);
+        if (export_type == EXPORT_C99)
+            fprintf(fp, "      value = %.2f + ((inputs[i] - " \
+                    "input_range_min[i])*%.2f/(input_range_max[i] - " \
+                    "input_range_min[i]));\n" \
+                    "      value = value*127 + 0.5f;\n",
+                    NEURON_LOW, NEURON_RANGE);
+        else
+            fprintf(fp, "%s", "      value = (inputs[i]*input_mul[i] + " \
+                    "input_add[i]) / 65536;\n");
+        fprintf(fp, "      if (value < %d) value = %d;\n",
+                level_low, level_low);
+        fprintf(fp, "      if (value > %d) value = %d;\n",
+                level_high, level_high);
+        fprintf(fp, "%s", "      network_inputs[pos] = (int8_t)value;\n");
+        fprintf(fp, "%s", "      pos++;\n");
+        fprintf(fp, "%s", "    }\n");
+        fprintf(fp, "%s", "    else {\n");
+        fprintf(fp, "%s", "      /* text value */\n");
+        if (export_type == EXPORT_C99)
+            fprintf(fp, "%s", "      encode_text(argv[i+1], " \
+                    "network_inputs, no_of_inputs,\n");
+        else
+            fprintf(fp, "%s", "      encode_text(\"\", " \
+                    "network_inputs, no_of_inputs,\n");
+
+        fprintf(fp,       "                  pos, field_length[i]/%d);\n",
+                (int)CHAR_BITS);
+        fprintf(fp, "%s", "      pos += field_length[i];\n");
+        fprintf(fp, "%s", "    }\n");
+        fprintf(fp, "%s", "  }\n\n");
+    }
+
+    /* each layer reads the activations written by the one before */
+    fprintf(fp, "%s", "  /* Feed forward through each layer */\n");
+    COUNTUP(l, net->hidden_layers+1) {
+        char name[32], layer_inputs[32];
+
+        if (l < net->hidden_layers)
+            sprintf(name, "hidden_layer_%d", l);
+        else
+            sprintf(name, "%s", "output_layer");
+
+        if (l == 0)
+            sprintf(layer_inputs, "%s", "network_inputs");
+        else
+            sprintf(layer_inputs, "activations[%d]", (l-1)%2);
+
+        fprintf(fp, "  %s(%s, activations[%d]);\n", name, layer_inputs, l%2);
+    }
+    fprintf(fp, "%s", "\n");
+
+    fprintf(fp, "%s", "  for (i = 0; i < no_of_outputs; i++) {\n");
+    fprintf(fp, "    /* Convert outputs from %d - %d " \
+            "back to their original range */\n",
+            level_low, level_high);
+    if (export_type == EXPORT_C99) {
+        fprintf(fp, "    outputs[i] = output_range_min[i] + " \
+                "((activations[%d][i]/127.0f - %.2f)*" \
+                "(output_range_max[i] - output_range_min[i])/%.2f);\n",
+                net->hidden_layers%2, NEURON_LOW, NEURON_RANGE);
+        fprintf(fp, "%s", "    /* Send the outputs to stdout */\n");
+        fprintf(fp, "%s", "    printf(\"%.10f\",outputs[i]);\n");
+        fprintf(fp, "%s", "    if (i < no_of_outputs-1) {\n");
+        fprintf(fp, "%s", "      printf(\" \");\n");
+        fprintf(fp, "%s", "    }\n");
+        fprintf(fp, "%s", "  }\n\n");
+        fprintf(fp, "%s", "  printf(\"\\n\");");
+        fprintf(fp, "%s", "\n");
+        fprintf(fp, "%s", "  return 0;\n");
+    }
+    else {
+        fprintf(fp, "%s", "    /* in thousandths */\n");
+        fprintf(fp, "    outputs[i] = (int32_t)((activations[%d][i]*" \
+                "output_mul[i] + output_add[i]) / 65536);\n",
+                net->hidden_layers%2);
+        fprintf(fp, "%s", "    /* Do something with the outputs here */\n");
+        fprintf(fp, "%s", "    value = outputs[i];\n");
+        fprintf(fp, "%s", "    if (value < 0) {\n");
+        fprintf(fp, "%s", "      Serial.print(\"-\");\n");
+        fprintf(fp, "%s", "      value = -value;\n");
+        fprintf(fp, "%s", "    }\n");
+        fprintf(fp, "%s", "    Serial.print((long)(value / 1000));\n");
+        fprintf(fp, "%s", "    Serial.print(\".\");\n");
+        fprintf(fp, "%s", "    if (value % 1000 < 100) Serial.print(\"0\");\n");
+        fprintf(fp, "%s", "    if (value % 1000 < 10) Serial.print(\"0\");\n");
+        fprintf(fp, "%s", "    Serial.print((long)(value % 1000));\n");
+        fprintf(fp, "%s", "    if (i < no_of_outputs-1) {\n");
+        fprintf(fp, "%s", "      Serial.print(\" \");\n");
+        fprintf(fp, "%s", "    }\n");
+        fprintf(fp, "%s", "  }\n\n");
+        fprintf(fp, "%s", "  Serial.println(\"\");");
+        fprintf(fp, "%s", "\n");
+    }
+
+    fprintf(fp, "%s", "}\n");
+    fclose(fp);
+    free(weights);
+    return 0;
+}
+
 /**
  * @brief Exports a trained network as a standalone python class
  * @param learner Deep learner object
@@ -1772,23 +2978,19 @@ static int deeplearn_export_python(deeplearn * learner, char * filename)
 
     fprintf(fp, "%s", "  # Activation function\n");
 
-#if ACTIVATION_FUNCTION == AF_SIGMOID
-    fprintf(fp, "%s", "  def af(this, adder):\n");
+    fprintf(fp, "%s", "  def af_sigmoid(this, adder):\n");
     fprintf(fp, "%s", "      return 1.0 / (1.0 + math.exp(-adder))\n\n");
-#elif ACTIVATION_FUNCTION == AF_TANH
-    fprintf(fp, "%s", "  def af(this, adder):\n");
+    fprintf(fp, "%s", "  def af_tanh(this, adder):\n");
     fprintf(fp, "%s", "      return ((((2.0 / (1.0 + math.exp(-(2*adder)))) " \
             "- 1.0)*0.5)+0.5)\n\n");
-#elif ACTIVATION_FUNCTION == AF_LINEAR
-    fprintf(fp, "%s", "  def af(this, adder):\n");
+    fprintf(fp, "%s", "  def af_linear(this, adder):\n");
     fprintf(fp, "%s", "      if adder < 1.0:\n");
     fprintf(fp, "%s", "          if adder > -1.0:\n");
     fprintf(fp, "%s", "              return (adder*0.5) + 0.5\n");
     fprintf(fp, "%s", "          else:\n");
     fprintf(fp, "%s", "              return 0.0\n");
     fprintf(fp, "%s", "      else:\n");
-    fprintf(fp, "%s", "          return 1.0\n");
-#endif
+    fprintf(fp, "%s", "          return 1.0\n\n");
 
     if (learner->no_of_input_fields > 0) {
         fprintf(fp, "%s", "  # Encode some text into the input units\n");
@@ -1892,7 +3094,8 @@ static int deeplearn_export_python(deeplearn * learner, char * filename)
     fprintf(fp, "%s", "        adder = adder + " \
             "this.hidden_layer_0_weights[i*this.no_of_inputs+j]*" \
             "network_inputs[j]\n");
-    fprintf(fp, "%s", "      hiddens.append(this.af(adder))\n");
+    fprintf(fp, "      hiddens.append(this.%s(adder))\n",
+            activation_export_name(bp_get_activation(learner->net, 0)));
     fprintf(fp, "%s", "    for i in range(this.no_of_hiddens):\n");
     fprintf(fp, "%s", "      prev_hiddens.append(hiddens[i])\n\n");
     for (int i = 1; i < learner->net->hidden_layers; i++) {
@@ -1905,7 +3108,8 @@ static int deeplearn_export_python(deeplearn * learner, char * filename)
         fprintf(fp, "        adder = adder + " \
                 "this.hidden_layer_%d_weights[i*%d+j]*prev_hiddens[j]\n",
                 i,HIDDENS_IN_LAYER(learner->net,i-1));
-        fprintf(fp, "%s", "      hiddens[i] = this.af(adder)\n");
+        fprintf(fp, "      hiddens[i] = this.%s(adder)\n",
+                activation_export_name(bp_get_activation(learner->net, i)));
         fprintf(fp, "    for i in range(%d):\n",
                 HIDDENS_IN_LAYER(learner->net,i));
         fprintf(fp, "%s", "      prev_hiddens[i] = hiddens[i]\n\n");
@@ -1918,7 +3122,10 @@ static int deeplearn_export_python(deeplearn * learner, char * filename)
     fprintf(fp, "        adder = adder + " \
             "this.output_layer_weights[i*%d+j]*prev_hiddens[j]\n",
             HIDDENS_IN_LAYER(learner->net,learner->net->hidden_layers-1));
-    fprintf(fp, "%s", "      outputs.append(this.af(adder))\n\n");
+    fprintf(fp, "      outputs.append(this.%s(adder))\n\n",
+            activation_export_name(
+                bp_get_activation(learner->net,
+                                  learner->net->hidden_layers)));
     fprintf(fp,
             "    # Convert outputs from %.2f - %.2f " \
             "back to their original range\n",
@@ -1940,6 +3147,288 @@ static int deeplearn_export_python(deeplearn * learner, char * filename)
     return 0;
 }
 
+/**
+ * @brief Writes an array of floats as base64 encoded little endian
+ *        float32 values, as a sequence of quoted python strings
+ * @param fp File to write to
+ * @param values Array of values
+ * @param length Number of values
+ * @param indent Number of spaces before each line
+ */
+static void deeplearn_export_base64(FILE * fp, float * values, int length,
+                                    int indent)
+{
+    const char * digits =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    int no_of_bytes = length*4, column = 0;
+    unsigned char block[3];
+
+    fprintf(fp, "%*s\"", indent, "");
+    for (int i = 0; i < no_of_bytes; i += 3) {
+        int n = (no_of_bytes - i < 3) ? no_of_bytes - i : 3;
+        unsigned int triple;
+
+        /* bytes of each value, least significant first */
+        COUNTUP(b, 3) {
+            unsigned int bits;
+
+            block[b] = 0;
+            if (b < n) {
+                memcpy(&bits, &values[(i+b)/4], sizeof(bits));
+                block[b] = (unsigned char)((bits >> (((i+b)%4)*8)) & 255);
+            }
+        }
+        triple = (block[0] << 16) | (block[1] << 8) | block[2];
+
+        if (column == 64) {
+            fprintf(fp, "\"\n%*s\"", indent, "");
+            column = 0;
+        }
+        fprintf(fp, "%c%c%c%c", digits[(triple >> 18) & 63],
+                digits[(triple >> 12) & 63],
+                (n > 1) ? digits[(triple >> 6) & 63] : '=',
+                (n > 2) ? digits[triple & 63] : '=');
+        column += 4;
+    }
+    fprintf(fp, "%s", "\"");
+}
+
+/**
+ * @brief Writes an array of floats as a numpy array
+ * @param fp File to write to
+ * @param name Name of the array
+ * @param values Array of values
+ * @param length Number of values
+ */
+static void deeplearn_export_numpy_array(FILE * fp, const char * name,
+                                         float * values, int length)
+{
+    fprintf(fp, "  %s = np.array([", name);
+    COUNTUP(i, length) {
+        fprintf(fp, "%.10f", values[i]);
+        if (i < length-1)
+            fprintf(fp, ",");
+    }
+    fprintf(fp, "%s", "], dtype=np.float32)\n\n");
+}
+
+/**
+ * @brief Exports a trained network as a python module which uses numpy
+ *        to feed whole batches of inputs through each layer as a single
+ *        matrix multiplication. Weights are stored as base64 encoded
+ *        float32 arrays, so the module is standalone
+ * @param learner Deep learner object
+ * @param filename The python source file to be produced
+ * @returns zero on success
+ */
+int deeplearn_export_numpy(deeplearn * learner, char * filename)
+{
+    bp * net = learner->net;
+    FILE * fp;
+    float * bias;
+    int max_units = 0;
+
+    COUNTUP(l, net->hidden_layers+1) {
+        if (net->layers[l].no_of_units > max_units)
+            max_units = net->layers[l].no_of_units;
+    }
+
+    FLOATALLOC(bias, max_units);
+    if (!bias)
+        return -1;
+
+    fp = fopen(filename,"w");
+    if (!fp) {
+        free(bias);
+        return -2;
+    }
+
+    fprintf(fp, "%s", "#!/usr/bin/python3\n\n");
+    fprintf(fp, "%s", "import sys\n");
+    fprintf(fp, "%s", "import base64\n");
+    fprintf(fp, "%s", "import numpy as np\n\n");
+
+    fprintf(fp, "NEURON_LOW = %.2f\n", NEURON_LOW);
+    fprintf(fp, "NEURON_HIGH = %.2f\n", NEURON_HIGH);
+    fprintf(fp, "NEURON_RANGE = %.2f\n", NEURON_RANGE);
+    fprintf(fp, "NEURON_UNKNOWN = %.2f\n", NEURON_UNKNOWN);
+    fprintf(fp, "CHAR_BITS = %d\n\n\n", (int)CHAR_BITS);
+
+    fprintf(fp, "%s", "def decode(text, *shape):\n");
+    fprintf(fp, "%s", "  # little endian float32 values\n");
+    fprintf(fp, "%s", "  return np.frombuffer(base64.b64decode(text), " \
+            "dtype='<f4').reshape(shape)\n\n\n");
+
+    fprintf(fp, "%s", "# Activation functions\n");
+    fprintf(fp, "%s", "def af_sigmoid(adder):\n");
+    fprintf(fp, "%s", "  return 0.5*(np.tanh(0.5*adder) + 1.0)\n\n\n");
+    fprintf(fp, "%s", "def af_tanh(adder):\n");
+    fprintf(fp, "%s", "  return (np.tanh(adder)*0.5) + 0.5\n\n\n");
+    fprintf(fp, "%s", "def af_linear(adder):\n");
+    fprintf(fp, "%s", "  return np.clip((adder*0.5) + 0.5, 0.0, 1.0)\n\n\n");
+
+    if (learner->no_of_input_fields > 0) {
+        fprintf(fp, "%s", "# Encode some text into a field of the "
+                "given number of inputs\n");
+        fprintf(fp, "%s", "def encode_text(text, length):\n");
+        fprintf(fp, "%s", "  codes = np.frombuffer(str(text).encode()"
+                "[:length // CHAR_BITS],\n");
+        fprintf(fp, "%s", "                        dtype=np.uint8)\n");
+        fprintf(fp, "%s", "  # bits of each character, least "
+                "significant first\n");
+        fprintf(fp, "%s", "  bits = (codes[:, np.newaxis] >> "
+                "np.arange(CHAR_BITS)) & 1\n");
+        fprintf(fp, "%s", "  # the remainder of the field is neutral\n");
+        fprintf(fp, "%s", "  field = np.full(length, NEURON_UNKNOWN, "
+                "dtype=np.float32)\n");
+        fprintf(fp, "%s", "  field[:bits.size] = np.where(bits.ravel() != 0, "
+                "NEURON_HIGH, NEURON_LOW)\n");
+        fprintf(fp, "%s", "  return field\n\n\n");
+    }
+
+    fprintf(fp, "%s", "class NeuralNet:\n");
+
+    if (learner->no_of_input_fields > 0)
+        fprintf(fp, "  no_of_input_fields = %d\n", learner->no_of_input_fields);
+    fprintf(fp, "  no_of_inputs = %d\n", net->no_of_inputs);
+    fprintf(fp, "  no_of_outputs = %d\n\n", net->no_of_outputs);
+
+    /* field lengths */
+    if ((learner->field_length != 0) && (learner->no_of_input_fields > 0)) {
+        fprintf(fp, "%s", "  field_length = [");
+        COUNTUP(i, learner->no_of_input_fields) {
+            fprintf(fp, "%d", learner->field_length[i]);
+            if (i < learner->no_of_input_fields-1)
+                fprintf(fp, ",");
+        }
+        fprintf(fp, "%s", "]\n\n");
+    }
+
+    /* ranges */
+    deeplearn_export_numpy_array(fp, "input_range_min",
+                                 learner->input_range_min, net->no_of_inputs);
+    deeplearn_export_numpy_array(fp, "input_range_max",
+                                 learner->input_range_max, net->no_of_inputs);
+    deeplearn_export_numpy_array(fp, "output_range_min",
+                                 learner->output_range_min,
+                                 net->no_of_outputs);
+    deeplearn_export_numpy_array(fp, "output_range_max",
+                                 learner->output_range_max,
+                                 net->no_of_outputs);
+
+    /* one no_of_units x no_of_inputs weight matrix per layer */
+    fprintf(fp, "%s", "  # (weights, bias, activation function) "
+            "for each layer\n");
+    fprintf(fp, "%s", "  layers = [\n");
+    COUNTUP(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+
+        COUNTUP(i, layer->no_of_units)
+            bias[i] = layer->units[i].bias;
+
+        fprintf(fp, "%s", "    (decode(\n");
+        deeplearn_export_base64(fp, layer->weights,
+                                layer->no_of_units*layer->no_of_inputs, 6);
+        fprintf(fp, ", %d, %d),\n", layer->no_of_units, layer->no_of_inputs);
+        fprintf(fp, "%s", "     decode(\n");
+        deeplearn_export_base64(fp, bias, layer->no_of_units, 6);
+        fprintf(fp, ", %d),\n", layer->no_of_units);
+        fprintf(fp, "     %s)", activation_export_name(layer->activation));
+        if (l < net->hidden_layers)
+            fprintf(fp, "%s", ",");
+        fprintf(fp, "%s", "\n");
+    }
+    fprintf(fp, "%s", "  ]\n\n");
+
+    fprintf(fp, "  # Normalise numeric inputs into a %.2f - %.2f range.\n",
+            NEURON_LOW, NEURON_HIGH);
+    fprintf(fp, "%s", "  # Inputs with no range are unknown\n");
+    fprintf(fp, "%s", "  def normalise(this, values, index):\n");
+    fprintf(fp, "%s", "    span = this.input_range_max[index] - "
+            "this.input_range_min[index]\n");
+    fprintf(fp, "%s", "    scaled = NEURON_LOW + ((values - "
+            "this.input_range_min[index])*NEURON_RANGE /\n");
+    fprintf(fp, "%s", "                           np.where(span > 0, "
+            "span, 1))\n");
+    fprintf(fp, "%s", "    return np.where(span > 0, np.clip(scaled, "
+            "NEURON_LOW, NEURON_HIGH),\n");
+    fprintf(fp, "%s", "                    NEURON_UNKNOWN)"
+            ".astype(np.float32)\n\n");
+
+    fprintf(fp, "%s", "  # Returns a batch x no_of_inputs array of "
+            "network inputs\n");
+    fprintf(fp, "%s", "  def encode_inputs(this, rows):\n");
+    if (learner->no_of_input_fields == 0) {
+        fprintf(fp, "%s", "    values = np.asarray(rows, dtype=np.float32)\n");
+        fprintf(fp, "%s",
+                "    values = values.reshape(-1, this.no_of_inputs)\n");
+        fprintf(fp, "%s", "    return this.normalise(values, "
+                "slice(None))\n\n");
+    }
+    else {
+        fprintf(fp, "%s", "    network_inputs = np.full((len(rows), "
+                "this.no_of_inputs),\n");
+        fprintf(fp, "%s", "                             NEURON_UNKNOWN, "
+                "dtype=np.float32)\n");
+        fprintf(fp, "%s", "    pos = 0\n");
+        fprintf(fp, "%s", "    for i in range(this.no_of_input_fields):\n");
+        fprintf(fp, "%s", "      column = [row[i] for row in rows]\n");
+        fprintf(fp, "%s", "      length = this.field_length[i]\n");
+        fprintf(fp, "%s", "      if length == 0:\n");
+        fprintf(fp, "%s", "        network_inputs[:, pos] = this.normalise(\n");
+        fprintf(fp, "%s",
+                "          np.asarray(column, dtype=np.float32), i)\n");
+        fprintf(fp, "%s", "        pos = pos + 1\n");
+        fprintf(fp, "%s", "      else:\n");
+        fprintf(fp, "%s", "        # text value\n");
+        fprintf(fp, "%s", "        for r, text in enumerate(column):\n");
+        fprintf(fp, "%s", "          network_inputs[r, pos:pos + length] = "
+                "encode_text(text, length)\n");
+        fprintf(fp, "%s", "        pos = pos + length\n");
+        fprintf(fp, "%s", "    return network_inputs\n\n");
+    }
+
+    fprintf(fp, "%s", "  # Feeds a batch of network inputs through "
+            "each layer in turn\n");
+    fprintf(fp, "%s", "  def forward(this, network_inputs):\n");
+    fprintf(fp, "%s", "    activations = network_inputs\n");
+    fprintf(fp, "%s", "    for weights, bias, af in this.layers:\n");
+    fprintf(fp, "%s", "      activations = af(activations @ weights.T "
+            "+ bias)\n");
+    fprintf(fp, "%s", "    return activations\n\n");
+
+    fprintf(fp, "%s", "  # Returns a batch x no_of_outputs array of "
+            "outputs in their original range\n");
+    fprintf(fp, "%s", "  def update_batch(this, rows):\n");
+    fprintf(fp, "%s", "    outputs = this.forward(this.encode_inputs(rows))\n");
+    fprintf(fp, "%s", "    return this.output_range_min + "
+            "((outputs - NEURON_LOW)*\n");
+    fprintf(fp, "%s", "                                    "
+            "(this.output_range_max - this.output_range_min) /\n");
+    fprintf(fp, "%s", "                                    "
+            "NEURON_RANGE)\n\n");
+
+    fprintf(fp, "%s", "  # Returns the outputs for a single set of "
+            "inputs as a list\n");
+    fprintf(fp, "%s", "  def update(this, inputs):\n");
+    if (learner->no_of_input_fields == 0)
+        fprintf(fp, "%s", "    if len(inputs) < this.no_of_inputs:\n");
+    else
+        fprintf(fp, "%s", "    if len(inputs) < this.no_of_input_fields:\n");
+    fprintf(fp, "%s", "      return []\n");
+    fprintf(fp, "%s",
+            "    return this.update_batch([inputs])[0].tolist()\n\n\n");
+
+    fprintf(fp, "%s", "if __name__ == \"__main__\":\n");
+    fprintf(fp, "%s", "  # Use the commandline arguments as input values\n");
+    fprintf(fp, "%s", "  net = NeuralNet()\n");
+    fprintf(fp, "%s", "  print(net.update(sys.argv[1:]))\n");
+
+    fclose(fp);
+    free(bias);
+    return 0;
+}
+
 /**
  * @brief Exports a trained network as a standalone program
  *        file types supported are .c and .py
@@ -1962,6 +3451,23 @@ int deeplearn_export(deeplearn * learner, char * filename)
     return deeplearn_export_c(learner, filename);
 }
 
+/**
+ * @brief Exports a trained network as a standalone C or Arduino program
+ *        with 8 bit integer weights. The flavor is chosen from the
+ *        filename in the same way as deeplearn_export
+ * @param learner Deep learner object
+ * @param filename The source file to be produced
+ * @returns zero on success
+ */
+int deeplearn_export_int8(deeplearn * learner, char * filename)
+{
+    if ((strstr(filename,"sketch") != NULL) ||
+        (strstr(filename,"arduino") != NULL))
+        return deeplearn_export_c_int8(learner, EXPORT_ARDUINO, filename);
+
+    return deeplearn_export_c_int8(learner, EXPORT_C99, filename);
+}
+
 /**
  * @brief Sets small weights to zero
  * @param learner deeplearn object
@@ -1973,6 +3479,19 @@ int deeplearn_prune_weights(deeplearn * learner, float threshold)
     return bp_prune_weights(learner->net, threshold);
 }
 
+/**
+ * @brief Converts heavily pruned layers into a sparse form, so that
+ *        pruned weights no longer cost any time or file space
+ * @param learner deeplearn object
+ * @param min_zero_percent The minimum percentage of zero weights for
+ *        a layer to become sparse
+ * @returns The number of sparse layers, or a negative value on error
+ */
+int deeplearn_sparsify(deeplearn * learner, int min_zero_percent)
+{
+    return bp_sparsify(learner->net, min_zero_percent);
+}
+
 /*
  * @brief Sets the pruning parameters used during training
  * @param learner deeplearn object
@@ -1984,3 +3503,61 @@ void deeplearn_set_pruning(deeplearn * learner, unsigned int cycle, float rate)
     learner->net->pruning_cycle = cycle;
     learner->net->pruning_rate = rate;
 }
+
+/**
+ * @brief Sets how the weight gradient histories are recorded during
+ *        training. Calculating the statistics visits the weights of
+ *        every layer, so for large networks they are recorded at
+ *        intervals and from a random sample of weights, or monitoring
+ *        may be switched off entirely
+ * @param learner deeplearn object
+ * @param interval The number of training steps between recorded values,
+ *        or zero to switch monitoring off. As the histories fill up
+ *        the interval doubles
+ * @param samples The number of weights sampled from each layer, or zero
+ *        to use every weight
+ * @returns zero on success
+ */
+int deeplearn_set_gradient_monitoring(deeplearn * learner,
+                                      int interval, int samples)
+{
+    if ((interval < 0) || (samples < 0))
+        return -1;
+
+    learner->gradients_std.step = interval;
+    learner->gradients_std.ctr = 0;
+    learner->gradients_mean.step = interval;
+    learner->gradients_mean.ctr = 0;
+    learner->gradient_samples = samples;
+    return 0;
+}
+
+/**
+ * @brief Sets the number of steps which the training error and weight
+ *        gradient histories can hold. Each history is only allocated
+ *        once something is recorded within it, and when full every
+ *        other step is discarded, so the memory used stays within this
+ *        capacity however long training runs for. For many small
+ *        models the histories may be made smaller than
+ *        DEEPLEARN_HISTORY_SIZE, or switched off entirely
+ * @param learner deeplearn object
+ * @param capacity The maximum number of steps held by each history,
+ *        or zero to not record histories
+ * @returns zero on success
+ */
+int deeplearn_set_history_size(deeplearn * learner, int capacity)
+{
+    if (deeplearn_history_set_size(&learner->history, capacity,
+                                   learner->history.dimensions) != 0)
+        return -1;
+
+    if (deeplearn_history_set_size(&learner->gradients_std, capacity,
+                                   learner->gradients_std.dimensions) != 0)
+        return -2;
+
+    if (deeplearn_history_set_size(&learner->gradients_mean, capacity,
+                                   learner->gradients_mean.dimensions) != 0)
+        return -3;
+
+    return 0;
+}
@@ -33,12 +33,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <sys/mman.h>
 #include "globals.h"
 #include "backprop.h"
 #include "autocoder.h"
 #include "encoding.h"
 #include "utils.h"
 #include "deeplearn_history.h"
+#include "deeplearn_plotter.h"
 #include "deeplearn_conv.h"
 
 /* Enumerate different flavors of C which can be exported
@@ -57,6 +59,11 @@ enum {
 struct deeplearndata {
     float * inputs;
     char ** inputs_text;
+
+    /* input values of the text fields, encoded once after loading,
+       or 0 if they have not been encoded */
+    float * inputs_encoded;
+
     float * outputs;
     unsigned int flags;
     unsigned int labeled;
@@ -65,12 +72,43 @@ struct deeplearndata {
 };
 typedef struct deeplearndata deeplearndata;
 
-struct deeplearndata_meta {
-    deeplearndata * sample;
-    struct deeplearndata_meta * prev;
-    struct deeplearndata_meta * next;
+/* Data samples together with their training and test sets, input field
+   lengths and ranges, which are shared read-only between any number of
+   learners, see deeplearn_dataset_share. The storage is the same as
+   that of a learner which owns its samples, and is freed when the last
+   reference to the dataset is released */
+struct deeplearn_dset {
+    int references;
+
+    int no_of_inputs, no_of_outputs;
+    int no_of_input_fields;
+    int * field_length;
+    float * input_range_min;
+    float * input_range_max;
+    float * output_range_min;
+    float * output_range_max;
+
+    deeplearndata * data;
+    int data_samples;
+    deeplearndata ** indexed_data;
+    int indexed_data_samples;
+    deeplearndata * data_rows;
+    int data_rows_samples;
+    float * data_inputs;
+    float * data_outputs;
+    char ** data_text;
+    float * data_encoded;
+    void * data_map;
+    size_t data_map_length;
+
+    int * training_data;
+    int training_data_samples;
+    int * training_data_labeled;
+    int training_data_labeled_samples;
+    int * test_data;
+    int test_data_samples;
 };
-typedef struct deeplearndata_meta deeplearndata_meta;
+typedef struct deeplearn_dset deeplearn_dataset;
 
 struct deepl {
     bp * net;
@@ -87,20 +125,63 @@ struct deepl {
     deeplearndata ** indexed_data;
     int indexed_data_samples;
 
-    deeplearndata_meta * training_data;
+    /* contiguous row major storage for samples loaded from a csv file.
+       data points to the last of these rows, and the rows are chained
+       together in the same way as samples added to the list */
+    deeplearndata * data_rows;
+    int data_rows_samples;
+    float * data_inputs;
+    float * data_outputs;
+    char ** data_text;
+
+    /* encoded text fields for every sample, see
+       deeplearndata_encode_text */
+    float * data_encoded;
+
+    /* mapping of a binary data file which the rows point into */
+    void * data_map;
+    size_t data_map_length;
+
+    /* training and test sets, as indexes into indexed_data */
+    int * training_data;
     int training_data_samples;
-    deeplearndata_meta ** indexed_training_data;
-    int indexed_training_data_samples;
 
-    deeplearndata_meta * training_data_labeled;
+    int * training_data_labeled;
     int training_data_labeled_samples;
-    deeplearndata_meta ** indexed_training_data_labeled;
-    int indexed_training_data_labeled_samples;
 
-    deeplearndata_meta * test_data;
+    int * test_data;
     int test_data_samples;
-    deeplearndata_meta ** indexed_test_data;
-    int indexed_test_data_samples;
+
+    /* the dataset which the samples and the training and test sets
+       above belong to when they are shared with other learners, or 0 if
+       they belong to this learner */
+    deeplearn_dataset * dataset;
+
+    /* epoch sampler, a shuffled order of positions within the training
+       set (or the labeled training set) which is walked sequentially
+       and reshuffled at the start of each epoch */
+    int * sampler_order;
+    int sampler_samples;
+    int sampler_position;
+    int sampler_labeled;
+    unsigned int sampler_epoch;
+
+    /* workers which train the final layers concurrently,
+       see deeplearn_set_workers */
+    int no_of_workers;
+    bp_worker * workers;
+    float * worker_inputs;
+    float * worker_targets;
+
+    /* values of the hidden layer below the one being pretrained for
+       every sample of the training set, see
+       deeplearndata_set_pretrain_cache */
+    int pretrain_cache_enabled;
+    char * pretrain_cache_filename;
+    float * pretrain_cache;
+    size_t pretrain_cache_length;
+    int pretrain_cache_layer;
+    int pretrain_cache_samples;
 
     float * input_range_min;
     float * input_range_max;
@@ -112,6 +193,20 @@ struct deepl {
     deeplearn_history history;
     deeplearn_history gradients_std;
     deeplearn_history gradients_mean;
+
+    /* how training progress is plotted, and the background
+       plotter used by DEEPLEARN_PLOT_ASYNC */
+    int plotting;
+    deeplearn_plotter plotter;
+
+    /* storage for the network and autocoders created by deeplearn_init.
+       Loaded learners instead give each of them its own arena */
+    deeplearn_arena arena;
+
+    /* number of weights sampled from each layer when recording the
+       gradient histories, or zero to use every weight */
+    int gradient_samples;
+    unsigned int gradient_seed;
 };
 typedef struct deepl deeplearn;
 
@@ -123,7 +218,20 @@ int deeplearn_init(deeplearn * learner,
                    float error_threshold[],
                    unsigned int * random_seed);
 void deeplearn_feed_forward(deeplearn * learner);
+int deeplearn_feed_forward_batch(deeplearn * learner,
+                                 const float * inputs, int n,
+                                 float * outputs);
 void deeplearn_update(deeplearn * learner);
+int deeplearn_update_batch(deeplearn * learner,
+                           const float * inputs, const float * targets,
+                           int batch_size);
+int deeplearn_set_workers(deeplearn * learner, int no_of_workers);
+int deeplearn_update_pretraining(deeplearn * learner,
+                                 const float * layer_inputs, int n);
+int deeplearn_update_hogwild(deeplearn * learner,
+                             bp_worker * workers, int no_of_workers,
+                             const float * inputs, const float * targets,
+                             int no_of_samples);
 void deeplearn_free(deeplearn * learner);
 void deeplearn_set_input_text(deeplearn * learner, char * text);
 void deeplearn_set_input(deeplearn * learner, int index, float value);
@@ -134,6 +242,10 @@ int deeplearn_set_input_field_text(deeplearn * learner, int fieldindex,
 void deeplearn_set_inputs(deeplearn * learner, deeplearndata * sample);
 void deeplearn_set_output(deeplearn * learner, int index, float value);
 void deeplearn_set_outputs(deeplearn * learner, deeplearndata * sample);
+void deeplearn_encode_inputs(deeplearn * learner, deeplearndata * sample,
+                             float inputs[]);
+void deeplearn_encode_outputs(deeplearn * learner, deeplearndata * sample,
+                              float outputs[]);
 void deeplearn_get_outputs(deeplearn * learner, float outputs[]);
 float deeplearn_get_output(deeplearn * learner, int index);
 float deeplearn_get_desired(deeplearn * learner, int index);
@@ -145,8 +257,12 @@ int deeplearn_compare(deeplearn * learner1,
                       deeplearn * learner2);
 int deeplearn_plot_history(deeplearn * learner,
                            int image_width, int image_height);
+int deeplearn_set_plotting(deeplearn * learner, int mode);
 int deeplearn_plot_gradients(int gradient_type, deeplearn * learner,
                              int image_width, int image_height);
+int deeplearn_scan_image(deeplearn * learner, unsigned char * img,
+                         int image_width, int image_height,
+                         int window_size, int stride, float * outputs);
 int deeplearn_inputs_from_image_patch(deeplearn * learner,
                                       unsigned char * img,
                                       int image_width, int image_height,
@@ -156,7 +272,12 @@ void deeplearn_inputs_from_image(deeplearn * learner,
                                  int image_width, int image_height);
 void deeplearn_set_learning_rate(deeplearn * learner, float rate);
 void deeplearn_set_dropouts(deeplearn * learner, float dropout_percent);
+int deeplearn_set_optimizer(deeplearn * learner, int type);
+int deeplearn_set_precision(deeplearn * learner, int precision);
+int deeplearn_set_activation(deeplearn * learner, int layer, int activation);
 int deeplearn_export(deeplearn * learner, char * filename);
+int deeplearn_export_int8(deeplearn * learner, char * filename);
+int deeplearn_export_numpy(deeplearn * learner, char * filename);
 float deeplearn_get_error_threshold(deeplearn * learner, int index);
 void deeplearn_set_error_threshold(deeplearn * learner, int index,
                                    float value);
@@ -171,6 +292,10 @@ int deeplearn_plot_weight_magnitude(deeplearn * learner,
                                     float max_magnitude,
                                     int img_width, int img_height);
 int deeplearn_prune_weights(deeplearn * learner, float threshold);
+int deeplearn_sparsify(deeplearn * learner, int min_zero_percent);
 void deeplearn_set_pruning(deeplearn * learner, unsigned int cycle, float rate);
+int deeplearn_set_gradient_monitoring(deeplearn * learner,
+                                      int interval, int samples);
+int deeplearn_set_history_size(deeplearn * learner, int capacity);
 
 #endif
@@ -0,0 +1,138 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "deeplearn_activation.h"
+
+/* sigmoid sampled at regular intervals, for the fast approximation */
+static float activation_table[AF_TABLE_SIZE];
+static int activation_table_ready = 0;
+
+/**
+ * @brief Populates the lookup table used by the fast activation functions.
+ *        This is called automatically when the library is loaded
+ */
+void activation_init(void)
+{
+    COUNTUP(i, AF_TABLE_SIZE) {
+        double x = (double)i/AF_TABLE_STEPS_PER_UNIT - AF_TABLE_RANGE;
+        activation_table[i] = (float)(1.0 / (1.0 + exp(-x)));
+    }
+    activation_table_ready = 1;
+}
+
+#ifdef __GNUC__
+__attribute__((constructor))
+static void activation_load(void)
+{
+    activation_init();
+}
+#endif
+
+/**
+ * @brief Approximates the sigmoid function by linear interpolation within
+ *        a lookup table. With 64 samples per unit the interpolation error
+ *        is below 3e-6, well within AF_FAST_MAX_ERROR
+ * @param x The weighted sum of inputs
+ * @returns Approximate sigmoid of x
+ */
+static float sigmoid_fast(float x)
+{
+    float pos;
+    int i;
+
+    if (!(x > -AF_TABLE_RANGE))
+        return activation_table[0];
+    if (x >= AF_TABLE_RANGE)
+        return activation_table[AF_TABLE_SIZE-1];
+
+    pos = (x + AF_TABLE_RANGE) * AF_TABLE_STEPS_PER_UNIT;
+    i = (int)pos;
+    if (i > AF_TABLE_SIZE-2)
+        i = AF_TABLE_SIZE-2;
+
+    return activation_table[i] +
+        ((activation_table[i+1] - activation_table[i]) * (pos - i));
+}
+
+/**
+ * @brief Returns whether the given activation function exists
+ * @param function The activation function, eg. AF_SIGMOID
+ * @returns Non-zero if the function is valid
+ */
+int activation_valid(int function)
+{
+    return ((function >= 0) && (function < AF_FUNCTIONS));
+}
+
+/**
+ * @brief Applies an activation function.
+ *        All functions return values in the range 0.0 -> 1.0
+ * @param function The activation function, eg. AF_SIGMOID
+ * @param adder The weighted sum of inputs
+ * @returns Result of the activation function
+ */
+float activation_value(int function, float adder)
+{
+    switch(function) {
+    case AF_TANH: {
+        return (((2.0f / (1.0f + expf(-(2*adder)))) - 1.0f)*0.5f)+0.5f;
+    }
+    case AF_LINEAR: {
+        return (adder < 1.0f ?
+                (adder > -1.0f ? ((adder*0.5f)+0.5f) : 0.0f) : 1.0f);
+    }
+    case AF_SIGMOID_FAST: {
+        if (!activation_table_ready) activation_init();
+        return sigmoid_fast(adder);
+    }
+    case AF_TANH_FAST: {
+        /* the tanh variant rescaled to 0.0 -> 1.0 is sigmoid(2x) */
+        if (!activation_table_ready) activation_init();
+        return sigmoid_fast(2*adder);
+    }
+    }
+    return 1.0f / (1.0f + expf(-adder));
+}
+
+/**
+ * @brief Returns the name of the activation function as used within
+ *        exported source code. Fast approximations are exported as
+ *        the functions which they approximate
+ * @param function The activation function, eg. AF_SIGMOID
+ * @returns Name of the function
+ */
+const char * activation_export_name(int function)
+{
+    switch(function) {
+    case AF_TANH_FAST:
+    case AF_TANH: return "af_tanh";
+    case AF_LINEAR: return "af_linear";
+    }
+    return "af_sigmoid";
+}
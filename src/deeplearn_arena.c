@@ -0,0 +1,104 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "deeplearn_arena.h"
+
+/**
+ * @brief Returns the space which an allocation of the given size takes
+ *        within an arena. Arena sizes are the sum of these
+ * @param bytes Size of the allocation
+ * @returns Size in bytes rounded up to DEEPLEARN_ARENA_ALIGN
+ */
+size_t deeplearn_arena_size(size_t bytes)
+{
+    return (bytes + DEEPLEARN_ARENA_ALIGN - 1) /
+        DEEPLEARN_ARENA_ALIGN * DEEPLEARN_ARENA_ALIGN;
+}
+
+/**
+ * @brief Sets an arena to own nothing
+ * @param arena Arena object
+ */
+void deeplearn_arena_clear(deeplearn_arena * arena)
+{
+    arena->memory = 0;
+    arena->block = 0;
+    arena->size = 0;
+    arena->used = 0;
+}
+
+/**
+ * @brief Allocates the block of an arena
+ * @param arena Arena object
+ * @param size Size of the block in bytes, as a sum of deeplearn_arena_size
+ * @returns zero on success
+ */
+int deeplearn_arena_init(deeplearn_arena * arena, size_t size)
+{
+    deeplearn_arena_clear(arena);
+
+    /* large blocks come zeroed from the operating system */
+    arena->memory = calloc(size + DEEPLEARN_ARENA_ALIGN, 1);
+    if (!arena->memory)
+        return -1;
+
+    arena->block = (unsigned char*)arena->memory +
+        (DEEPLEARN_ARENA_ALIGN -
+         (size_t)arena->memory % DEEPLEARN_ARENA_ALIGN);
+    arena->size = size;
+    return 0;
+}
+
+/**
+ * @brief Takes the next array from an arena
+ * @param arena Arena object
+ * @param bytes Size of the array
+ * @returns The zeroed array
+ */
+void * deeplearn_arena_alloc(deeplearn_arena * arena, size_t bytes)
+{
+    unsigned char * ptr = &arena->block[arena->used];
+
+    /* the arena should have been sized for everything taken from it */
+    assert(arena->used + deeplearn_arena_size(bytes) <= arena->size);
+
+    arena->used += deeplearn_arena_size(bytes);
+    return ptr;
+}
+
+/**
+ * @brief Frees the block of an arena, together with every array
+ *        which was taken from it
+ * @param arena Arena object
+ */
+void deeplearn_arena_free(deeplearn_arena * arena)
+{
+    free(arena->memory);
+    deeplearn_arena_clear(arena);
+}
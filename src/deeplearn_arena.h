@@ -0,0 +1,64 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEEPLEARN_ARENA_H
+#define DEEPLEARN_ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "globals.h"
+
+/* A single block of memory which is sized up front and then divided
+   between the arrays of a network, so that creating or freeing the
+   network takes one allocation rather than one for each array.
+   Arrays taken from the arena are zeroed and cannot be freed on their
+   own. An arena whose memory is zero owns nothing, which is the case
+   for objects carved out of another object's arena */
+typedef struct {
+    /* as returned by the allocator */
+    void * memory;
+
+    /* aligned start of the block */
+    unsigned char * block;
+    size_t size;
+    size_t used;
+} deeplearn_arena;
+
+#define ARENA_FLOATALLOC(arena, size) \
+    (float*)deeplearn_arena_alloc(arena, (size)*sizeof(float))
+
+size_t deeplearn_arena_size(size_t bytes);
+void deeplearn_arena_clear(deeplearn_arena * arena);
+int deeplearn_arena_init(deeplearn_arena * arena, size_t size);
+void * deeplearn_arena_alloc(deeplearn_arena * arena, size_t bytes);
+void deeplearn_arena_free(deeplearn_arena * arena);
+
+#endif
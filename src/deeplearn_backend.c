@@ -0,0 +1,259 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "deeplearn_backend.h"
+
+/* the cpu backend has no kernels of its own, so every call
+   falls through to the existing OpenMP code */
+static const deeplearn_backend backend_cpu = {
+    "cpu", NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+};
+
+/* registered backends, indexed by id */
+static const deeplearn_backend * backends[DEEPLEARN_BACKENDS] = {
+    &backend_cpu
+};
+
+/* the currently selected backend */
+static const deeplearn_backend * backend = &backend_cpu;
+static int backend_id = DEEPLEARN_BACKEND_CPU;
+
+/**
+ * @brief Registers the kernels for a compute backend, so that it can
+ *        later be selected.  Registering NULL removes the backend
+ * @param id The backend, eg. DEEPLEARN_BACKEND_OPENCL
+ * @param kernels Kernel table for the backend
+ * @returns zero on success
+ */
+int deeplearn_backend_register(int id, const deeplearn_backend * kernels)
+{
+    if ((id <= DEEPLEARN_BACKEND_CPU) || (id >= DEEPLEARN_BACKENDS))
+        return -1;
+
+    if (id == backend_id)
+        deeplearn_backend_select(DEEPLEARN_BACKEND_CPU);
+
+    backends[id] = kernels;
+    return 0;
+}
+
+/**
+ * @brief Selects the backend which the hot kernels are dispatched to.
+ *        The previous backend is released after copying back any
+ *        arrays held on its device
+ * @param id The backend, eg. DEEPLEARN_BACKEND_CPU
+ * @returns zero on success, -1 if the backend is not registered or
+ *          -2 if it could not be initialised
+ */
+int deeplearn_backend_select(int id)
+{
+    const deeplearn_backend * kernels;
+
+    if ((id < DEEPLEARN_BACKEND_CPU) || (id >= DEEPLEARN_BACKENDS))
+        return -1;
+
+    kernels = backends[id];
+    if (kernels == NULL)
+        return -1;
+
+    if (kernels == backend)
+        return 0;
+
+    if ((kernels->init != NULL) && (kernels->init() != 0))
+        return -2;
+
+    deeplearn_backend_synchronise();
+    if (backend->release != NULL)
+        backend->release();
+
+    backend = kernels;
+    backend_id = id;
+    return 0;
+}
+
+/**
+ * @brief Returns the backend currently in use
+ * @returns The backend, eg. DEEPLEARN_BACKEND_CPU
+ */
+int deeplearn_backend_id(void)
+{
+    return backend_id;
+}
+
+/**
+ * @brief Returns the name of the backend currently in use
+ * @returns Name of the backend
+ */
+const char * deeplearn_backend_name(void)
+{
+    return backend->name;
+}
+
+/**
+ * @brief Tells the backend that an array of weights or features
+ *        has been changed by the cpu
+ * @param weights The array which changed, or NULL for any array
+ */
+void deeplearn_backend_weights_changed(const float * weights)
+{
+    if (backend->weights_changed != NULL)
+        backend->weights_changed(weights);
+}
+
+/**
+ * @brief Copies any arrays held on the backend device back to the host
+ */
+void deeplearn_backend_synchronise(void)
+{
+    if (backend->synchronise != NULL)
+        backend->synchronise();
+}
+
+/**
+ * @brief Multiplies a batch of inputs by the weights of a dense layer.
+ *        This only dispatches to a registered kernel, since no device
+ *        implementation is built into the library
+ * @param weights no_of_units x no_of_inputs weights
+ * @param inputs batch_size x no_of_inputs values
+ * @param batch_size The number of samples in the batch
+ * @param no_of_inputs The number of inputs to each unit
+ * @param no_of_units The number of units in the layer
+ * @param outputs Returned batch_size x no_of_units weighted sums
+ * @returns zero if the backend did the calculation
+ */
+int deeplearn_backend_dense_forward(const float * weights,
+                                    const float * inputs,
+                                    int batch_size, int no_of_inputs,
+                                    int no_of_units, float * outputs)
+{
+    if (backend->dense_forward == NULL)
+        return -1;
+
+    return backend->dense_forward(weights, inputs, batch_size,
+                                  no_of_inputs, no_of_units, outputs);
+}
+
+/**
+ * @brief Back-propagates a batch of deltas through the weights
+ *        of a dense layer
+ * @param weights no_of_units x no_of_inputs weights
+ * @param deltas batch_size x no_of_units deltas
+ * @param batch_size The number of samples in the batch
+ * @param no_of_inputs The number of inputs to each unit
+ * @param no_of_units The number of units in the layer
+ * @param input_errors Returned batch_size x no_of_inputs errors
+ * @returns zero if the backend did the calculation
+ */
+int deeplearn_backend_dense_backward(const float * weights,
+                                     const float * deltas,
+                                     int batch_size, int no_of_inputs,
+                                     int no_of_units, float * input_errors)
+{
+    if (backend->dense_backward == NULL)
+        return -1;
+
+    return backend->dense_backward(weights, deltas, batch_size,
+                                   no_of_inputs, no_of_units,
+                                   input_errors);
+}
+
+/**
+ * @brief Convolves an input image or layer to an output layer.
+ *        See convolve_image for a description of the arguments
+ * @returns zero if the backend did the calculation
+ */
+int deeplearn_backend_convolve_image(float img[],
+                                     int img_width, int img_height,
+                                     int img_depth,
+                                     int feature_width, int no_of_features,
+                                     int pooling_factor,
+                                     float feature[],
+                                     float layer[], int layer_width,
+                                     int activation)
+{
+    if (backend->convolve_image == NULL)
+        return -1;
+
+    return backend->convolve_image(img, img_width, img_height, img_depth,
+                                   feature_width, no_of_features,
+                                   pooling_factor, feature,
+                                   layer, layer_width, activation);
+}
+
+/**
+ * @brief Deconvolves a layer back to an image or previous layer.
+ *        See deconvolve_image for a description of the arguments
+ * @returns zero if the backend did the calculation
+ */
+int deeplearn_backend_deconvolve_image(float img[],
+                                       int img_width, int img_height,
+                                       int img_depth,
+                                       int feature_width, int no_of_features,
+                                       float feature[],
+                                       float layer[], int layer_width)
+{
+    if (backend->deconvolve_image == NULL)
+        return -1;
+
+    return backend->deconvolve_image(img, img_width, img_height, img_depth,
+                                     feature_width, no_of_features,
+                                     feature, layer, layer_width);
+}
+
+/**
+ * @brief Scores a set of features against a number of image patches
+ * @param img Image or layer with img_depth values per pixel
+ * @param img_width Width of the image
+ * @param img_depth Depth of the image
+ * @param feature_width Width of each feature
+ * @param positions Top left x and y coordinates of each patch
+ * @param stride Distance between the coordinates of consecutive patches
+ * @param no_of_patches The number of patches
+ * @param feature Array containing the features
+ * @param no_of_features The number of features
+ * @param scores Returned squared distance between each patch and feature
+ * @returns zero if the backend did the calculation
+ */
+int deeplearn_backend_feature_scores(const float * img,
+                                     int img_width, int img_depth,
+                                     int feature_width,
+                                     const int * positions, int stride,
+                                     int no_of_patches,
+                                     const float * feature,
+                                     int no_of_features,
+                                     float * scores)
+{
+    if (backend->feature_scores == NULL)
+        return -1;
+
+    return backend->feature_scores(img, img_width, img_depth,
+                                   feature_width, positions, stride,
+                                   no_of_patches, feature, no_of_features,
+                                   scores);
+}
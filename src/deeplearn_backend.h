@@ -0,0 +1,137 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEEPLEARN_BACKEND_H
+#define DEEPLEARN_BACKEND_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "globals.h"
+
+/* compute backends which the hot kernels may be dispatched to.
+   Only the cpu is built in. The other ids are reserved for kernels
+   supplied by the application through deeplearn_backend_register */
+#define DEEPLEARN_BACKEND_CPU     0
+#define DEEPLEARN_BACKEND_OPENCL  1
+#define DEEPLEARN_BACKEND_VULKAN  2
+#define DEEPLEARN_BACKENDS        3
+
+/* Kernel table for a compute backend.
+   Each kernel returns zero if it handled the call, or non-zero to have
+   the cpu do the work instead, and any kernel may be left as NULL.
+   Weights and features passed to the kernels keep the same addresses
+   between calls, so a backend may hold copies of them on its device.
+   weights_changed is called whenever such an array is altered by the
+   cpu, with NULL meaning that any of them may have changed, and
+   synchronise is called before arrays are read back for saving */
+typedef struct {
+    const char * name;
+
+    int (*init)(void);
+    void (*release)(void);
+    void (*weights_changed)(const float * weights);
+    void (*synchronise)(void);
+
+    /* outputs[b][i] = sum_j inputs[b][j] * weights[i][j] */
+    int (*dense_forward)(const float * weights, const float * inputs,
+                         int batch_size, int no_of_inputs, int no_of_units,
+                         float * outputs);
+
+    /* input_errors[b][j] = sum_i deltas[b][i] * weights[i][j] */
+    int (*dense_backward)(const float * weights, const float * deltas,
+                          int batch_size, int no_of_inputs, int no_of_units,
+                          float * input_errors);
+
+    /* the same arguments as convolve_image */
+    int (*convolve_image)(float img[],
+                          int img_width, int img_height, int img_depth,
+                          int feature_width, int no_of_features,
+                          int pooling_factor,
+                          float feature[],
+                          float layer[], int layer_width,
+                          int activation);
+
+    /* the same arguments as deconvolve_image */
+    int (*deconvolve_image)(float img[],
+                            int img_width, int img_height, int img_depth,
+                            int feature_width, int no_of_features,
+                            float feature[],
+                            float layer[], int layer_width);
+
+    /* squared distance between each feature and each image patch.
+       The top left corner of patch p is at positions[p*stride] and
+       positions[p*stride + 1], and scores has no_of_features entries
+       for each patch */
+    int (*feature_scores)(const float * img, int img_width, int img_depth,
+                          int feature_width,
+                          const int * positions, int stride,
+                          int no_of_patches,
+                          const float * feature, int no_of_features,
+                          float * scores);
+} deeplearn_backend;
+
+int deeplearn_backend_register(int id, const deeplearn_backend * kernels);
+int deeplearn_backend_select(int id);
+int deeplearn_backend_id(void);
+const char * deeplearn_backend_name(void);
+
+void deeplearn_backend_weights_changed(const float * weights);
+void deeplearn_backend_synchronise(void);
+int deeplearn_backend_dense_forward(const float * weights,
+                                    const float * inputs,
+                                    int batch_size, int no_of_inputs,
+                                    int no_of_units, float * outputs);
+int deeplearn_backend_dense_backward(const float * weights,
+                                     const float * deltas,
+                                     int batch_size, int no_of_inputs,
+                                     int no_of_units, float * input_errors);
+int deeplearn_backend_convolve_image(float img[],
+                                     int img_width, int img_height,
+                                     int img_depth,
+                                     int feature_width, int no_of_features,
+                                     int pooling_factor,
+                                     float feature[],
+                                     float layer[], int layer_width,
+                                     int activation);
+int deeplearn_backend_deconvolve_image(float img[],
+                                       int img_width, int img_height,
+                                       int img_depth,
+                                       int feature_width, int no_of_features,
+                                       float feature[],
+                                       float layer[], int layer_width);
+int deeplearn_backend_feature_scores(const float * img,
+                                     int img_width, int img_depth,
+                                     int feature_width,
+                                     const int * positions, int stride,
+                                     int no_of_patches,
+                                     const float * feature,
+                                     int no_of_features,
+                                     float * scores);
+
+#endif
@@ -0,0 +1,311 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* open_memstream, fsync and threads are not part of c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include "deeplearn_checkpoint.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @brief Initialises a checkpoint with nothing being written
+ * @param checkpoint Checkpoint object
+ */
+void deeplearn_checkpoint_init(deeplearn_checkpoint * checkpoint)
+{
+    checkpoint->filename = 0;
+    checkpoint->buffer = 0;
+    checkpoint->length = 0;
+    checkpoint->running = 0;
+    checkpoint->done = 0;
+    checkpoint->status = 0;
+}
+
+/**
+ * @brief Writes the snapshot of a checkpoint to a file, making sure
+ *        that it is on disk before returning
+ * @param checkpoint Checkpoint object
+ * @param filename The file to write
+ * @returns zero on success
+ */
+static int deeplearn_checkpoint_write_file(deeplearn_checkpoint * checkpoint,
+                                           char * filename)
+{
+    size_t written = 0;
+    int fd;
+
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+
+    while (written < checkpoint->length) {
+        ssize_t n = write(fd, &checkpoint->buffer[written],
+                          checkpoint->length - written);
+        if (n <= 0) {
+            close(fd);
+            return -2;
+        }
+        written += n;
+    }
+
+    if (fsync(fd) != 0) {
+        close(fd);
+        return -3;
+    }
+
+    if (close(fd) != 0)
+        return -4;
+
+    return 0;
+}
+
+/**
+ * @brief Makes sure that a file which was renamed into a directory is
+ *        on disk, by syncing the directory
+ * @param filename The renamed file
+ * @returns zero on success
+ */
+static int deeplearn_checkpoint_sync_directory(char * filename)
+{
+    char * directory, * separator;
+    int fd, retval = 0;
+
+    CHARALLOC(directory, strlen(filename) + 2);
+    if (!directory)
+        return -1;
+
+    strcpy(directory, filename);
+    separator = strrchr(directory, '/');
+    if (separator == NULL)
+        strcpy(directory, ".");
+    else if (separator == directory)
+        directory[1] = 0;
+    else
+        *separator = 0;
+
+    fd = open(directory, O_RDONLY);
+    free(directory);
+    if (fd < 0)
+        return -2;
+
+    if (fsync(fd) != 0)
+        retval = -3;
+
+    close(fd);
+    return retval;
+}
+
+/**
+ * @brief Writes the snapshot of a checkpoint to a temporary file, which
+ *        is then renamed to the checkpoint filename. The directory is
+ *        synced afterwards, so that the rename survives a crash.
+ *        This is run on the background thread
+ * @param arg Checkpoint object
+ * @returns NULL
+ */
+static void * deeplearn_checkpoint_write(void * arg)
+{
+    deeplearn_checkpoint * checkpoint = (deeplearn_checkpoint*)arg;
+    char * temp_filename;
+    int status = 0;
+
+    CHARALLOC(temp_filename, strlen(checkpoint->filename) + 5);
+    if (!temp_filename) {
+        status = -1;
+    }
+    else {
+        sprintf(temp_filename, "%s.tmp", checkpoint->filename);
+        if (deeplearn_checkpoint_write_file(checkpoint,
+                                            temp_filename) != 0)
+            status = -2;
+        else if (rename(temp_filename, checkpoint->filename) != 0)
+            status = -3;
+        else if (deeplearn_checkpoint_sync_directory(
+                     checkpoint->filename) != 0)
+            status = -4;
+
+        if (status != 0)
+            remove(temp_filename);
+        free(temp_filename);
+    }
+
+    checkpoint->status = status;
+#pragma omp flush
+#pragma omp atomic write
+    checkpoint->done = 1;
+    return NULL;
+}
+
+/**
+ * @brief Starts the background thread which writes the snapshot
+ * @param checkpoint Checkpoint object, with its snapshot taken
+ * @param filename The checkpoint file
+ * @returns zero on success
+ */
+static int deeplearn_checkpoint_start(deeplearn_checkpoint * checkpoint,
+                                      char * filename)
+{
+    free(checkpoint->filename);
+    CHARALLOC(checkpoint->filename, strlen(filename) + 1);
+    if (!checkpoint->filename)
+        return -3;
+    strcpy(checkpoint->filename, filename);
+
+    checkpoint->done = 0;
+    checkpoint->status = 0;
+    if (pthread_create(&checkpoint->thread, NULL,
+                       deeplearn_checkpoint_write, checkpoint) != 0)
+        return -4;
+    checkpoint->running = 1;
+    return 0;
+}
+
+/**
+ * @brief Opens a stream which saves into the snapshot buffer of a
+ *        checkpoint, replacing any previous snapshot
+ * @param checkpoint Checkpoint object
+ * @returns File pointer, or NULL if a previous checkpoint is still
+ *          being written or the stream could not be opened
+ */
+static FILE * deeplearn_checkpoint_open(deeplearn_checkpoint * checkpoint)
+{
+    if (deeplearn_checkpoint_poll(checkpoint) == 1)
+        return NULL;
+
+    free(checkpoint->buffer);
+    checkpoint->buffer = 0;
+    checkpoint->length = 0;
+    return open_memstream(&checkpoint->buffer, &checkpoint->length);
+}
+
+/**
+ * @brief Saves a learner to file in the background. Training only pauses
+ *        while the learner is saved into memory, and may continue while
+ *        the file is written. Only one checkpoint may be written at a
+ *        time, see deeplearn_checkpoint_poll
+ * @param checkpoint Checkpoint object
+ * @param learner Deep learner object
+ * @param filename The checkpoint file
+ * @returns zero if the checkpoint was started, -1 if the previous one
+ *          is still being written
+ */
+int deeplearn_checkpoint_async(deeplearn_checkpoint * checkpoint,
+                               deeplearn * learner, char * filename)
+{
+    FILE * fp = deeplearn_checkpoint_open(checkpoint);
+    int retval;
+
+    if (!fp)
+        return -1;
+
+    retval = deeplearn_save(fp, learner);
+    fclose(fp);
+    if (retval != 0)
+        return -2;
+
+    return deeplearn_checkpoint_start(checkpoint, filename);
+}
+
+/**
+ * @brief Saves a deep convnet to file in the background, in the same way
+ *        as deeplearn_checkpoint_async
+ * @param checkpoint Checkpoint object
+ * @param convnet Deep convnet object
+ * @param filename The checkpoint file
+ * @returns zero if the checkpoint was started, -1 if the previous one
+ *          is still being written
+ */
+int deepconvnet_checkpoint_async(deeplearn_checkpoint * checkpoint,
+                                 deepconvnet * convnet, char * filename)
+{
+    FILE * fp = deeplearn_checkpoint_open(checkpoint);
+    int retval;
+
+    if (!fp)
+        return -1;
+
+    retval = deepconvnet_save(fp, convnet);
+    fclose(fp);
+    if (retval != 0)
+        return -2;
+
+    return deeplearn_checkpoint_start(checkpoint, filename);
+}
+
+/**
+ * @brief Returns whether the latest checkpoint has been written
+ * @param checkpoint Checkpoint object
+ * @returns 1 while the checkpoint is being written, otherwise zero if it
+ *          was written successfully or negative if it failed
+ */
+int deeplearn_checkpoint_poll(deeplearn_checkpoint * checkpoint)
+{
+    int done;
+
+    if (!checkpoint->running)
+        return checkpoint->status;
+
+#pragma omp flush
+#pragma omp atomic read
+    done = checkpoint->done;
+
+    if (!done)
+        return 1;
+
+    pthread_join(checkpoint->thread, NULL);
+    checkpoint->running = 0;
+    return checkpoint->status;
+}
+
+/**
+ * @brief Waits until the latest checkpoint has been written
+ * @param checkpoint Checkpoint object
+ * @returns zero if the checkpoint was written successfully
+ */
+int deeplearn_checkpoint_wait(deeplearn_checkpoint * checkpoint)
+{
+    if (checkpoint->running) {
+        pthread_join(checkpoint->thread, NULL);
+        checkpoint->running = 0;
+    }
+    return checkpoint->status;
+}
+
+/**
+ * @brief Waits for any checkpoint being written and frees its memory
+ * @param checkpoint Checkpoint object
+ */
+void deeplearn_checkpoint_free(deeplearn_checkpoint * checkpoint)
+{
+    deeplearn_checkpoint_wait(checkpoint);
+    free(checkpoint->filename);
+    free(checkpoint->buffer);
+    deeplearn_checkpoint_init(checkpoint);
+}
@@ -0,0 +1,73 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEEPLEARN_CHECKPOINT_H
+#define DEEPLEARN_CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <omp.h>
+#include "globals.h"
+#include "deeplearn.h"
+#include "deepconvnet.h"
+
+/* A checkpoint which is written to disk in the background.
+   The learner is saved into a buffer in memory, which only pauses
+   training for as long as the copy takes, and a thread then writes the
+   buffer to a temporary file which is renamed over the checkpoint once
+   it is complete, so the checkpoint file is never partially written */
+typedef struct {
+    char * filename;
+
+    /* snapshot of the saved state */
+    char * buffer;
+    size_t length;
+
+    pthread_t thread;
+
+    /* non-zero while the thread has not been joined */
+    int running;
+
+    /* set by the thread once the write is complete */
+    int done;
+    int status;
+} deeplearn_checkpoint;
+
+void deeplearn_checkpoint_init(deeplearn_checkpoint * checkpoint);
+int deeplearn_checkpoint_async(deeplearn_checkpoint * checkpoint,
+                               deeplearn * learner, char * filename);
+int deepconvnet_checkpoint_async(deeplearn_checkpoint * checkpoint,
+                                 deepconvnet * convnet, char * filename);
+int deeplearn_checkpoint_poll(deeplearn_checkpoint * checkpoint);
+int deeplearn_checkpoint_wait(deeplearn_checkpoint * checkpoint);
+void deeplearn_checkpoint_free(deeplearn_checkpoint * checkpoint);
+
+#endif
@@ -29,6 +29,49 @@
 
 #include "deeplearn_conv.h"
 
+/* the engine used to calculate feature responses */
+static int conv_engine = CONV_ENGINE_SUMMED_AREA;
+
+/**
+ * @brief Sets the number of image patches which are scored together
+ *        when learning features.  Batches are scored in parallel, so this
+ *        allows feature learning to make use of multiple cores
+ * @param conv Convolution instance
+ * @param batch_size The number of patches, or zero to learn from
+ *        one patch at a time
+ */
+void conv_set_feature_batch(deeplearn_conv * conv, int batch_size)
+{
+    if (batch_size < 0)
+        batch_size = 0;
+    conv->feature_batch_size = batch_size;
+}
+
+/**
+ * @brief Selects the engine used to calculate feature responses.
+ *        This applies to all convolution layers within the process and
+ *        is mainly useful for testing and benchmarking
+ * @param engine The engine, eg. CONV_ENGINE_GEMM
+ * @returns zero on success, or -1 if the engine is not known
+ */
+int conv_set_engine(int engine)
+{
+    if ((engine < CONV_ENGINE_DIRECT) || (engine > CONV_ENGINE_SUMMED_AREA))
+        return -1;
+
+    conv_engine = engine;
+    return 0;
+}
+
+/**
+ * @brief Returns the engine used to calculate feature responses
+ * @returns The engine, eg. CONV_ENGINE_GEMM
+ */
+int conv_get_engine(void)
+{
+    return conv_engine;
+}
+
 /**
  * @brief Create a number of convolutional layers
  * @param no_of_layers The number of layers
@@ -48,17 +91,31 @@ int conv_init(int no_of_layers,
               int final_image_width, int final_image_height,
               deeplearn_conv * conv)
 {
+    if ((no_of_layers < 1) || (no_of_layers > PREPROCESS_MAX_LAYERS))
+        return 5;
+
+    conv->layer = (deeplearn_conv_layer*)
+        calloc(no_of_layers, sizeof(deeplearn_conv_layer));
+    if (!conv->layer)
+        return 6;
+
     conv->no_of_layers = no_of_layers;
     conv->current_layer = 0;
     conv->learning_rate = 0.1f;
     conv->training = (1==1);
+    conv->feature_batch_size = 0;
+    conv->feature_updates = 0;
 
     conv->noise = 0.1f;
     conv->random_seed = 672593;
+    conv->activation = ACTIVATION_FUNCTION;
+    rand_streams_init(conv->random_streams, DEEPLEARN_MAX_THREADS,
+                      conv->random_seed);
 
     deeplearn_history_init(&conv->history, "feature_learning.png",
                            "Feature Learning Training History",
                            "Time Step", "Training Error %");
+    deeplearn_history_set_size(&conv->history, DEEPLEARN_HISTORY_SIZE, 1);
 
     COUNTUP(l, no_of_layers) {
         conv->layer[l].ctr = (unsigned int)0;
@@ -158,11 +215,14 @@ int conv_init(int no_of_layers,
 void conv_free(deeplearn_conv * conv)
 {
     COUNTDOWN(l, conv->no_of_layers) {
+        deeplearn_backend_weights_changed(conv->layer[l].feature);
         free(conv->layer[l].layer);
         free(conv->layer[l].feature);
     }
 
+    free(conv->layer);
     free(conv->outputs);
+    deeplearn_history_free(&conv->history);
 }
 
 /**
@@ -211,8 +271,10 @@ int conv_save(FILE * fp, deeplearn_conv * conv)
         return -9;
     if (INTWRITE(conv->current_layer) == 0)
         return -10;
-    if (fwrite(&conv->history, sizeof(deeplearn_history), 1, fp) == 0)
+    if (deeplearn_history_save(fp, &conv->history) != 0)
         return -12;
+    if (INTWRITE(conv->activation) == 0)
+        return -13;
 
     return 0;
 }
@@ -225,19 +287,28 @@ int conv_save(FILE * fp, deeplearn_conv * conv)
  */
 int conv_load(FILE * fp, deeplearn_conv * conv)
 {
+    deeplearn_conv_layer first, layer;
+
     if (FLOATREAD(conv->no_of_layers) == 0)
         return -1;
 
+    if ((conv->no_of_layers < 1) ||
+        (conv->no_of_layers > PREPROCESS_MAX_LAYERS))
+        return -1;
+
+    /* the other layers are derived from the first */
     COUNTUP(l, conv->no_of_layers) {
-        if (INTREAD(conv->layer[l].width) == 0)
+        deeplearn_conv_layer * dimensions = (l == 0) ? &first : &layer;
+
+        if (INTREAD(dimensions->width) == 0)
             return -2;
-        if (INTREAD(conv->layer[l].height) == 0)
+        if (INTREAD(dimensions->height) == 0)
             return -3;
-        if (INTREAD(conv->layer[l].depth) == 0)
+        if (INTREAD(dimensions->depth) == 0)
             return -4;
-        if (INTREAD(conv->layer[l].no_of_features) == 0)
+        if (INTREAD(dimensions->no_of_features) == 0)
             return -5;
-        if (INTREAD(conv->layer[l].feature_width) == 0)
+        if (INTREAD(dimensions->feature_width) == 0)
             return -6;
     }
 
@@ -246,24 +317,378 @@ int conv_load(FILE * fp, deeplearn_conv * conv)
     if (INTREAD(conv->no_of_outputs) == 0)
         return -8;
 
-    conv_init(conv->no_of_layers,
-              conv->layer[0].width, conv->layer[0].height,
-              conv->layer[0].depth,
-              conv->layer[0].no_of_features,
-              conv->layer[0].feature_width,
-              conv->outputs_width, conv->outputs_width,
-              conv);
+    if (conv_init(conv->no_of_layers,
+                  first.width, first.height, first.depth,
+                  first.no_of_features, first.feature_width,
+                  conv->outputs_width, conv->outputs_width,
+                  conv) != 0)
+        return -15;
 
     if (INTREAD(conv->learning_rate) == 0)
         return -9;
     if (INTREAD(conv->current_layer) == 0)
         return -10;
-    if (fread(&conv->history, sizeof(deeplearn_history), 1, fp) == 0)
+    if (deeplearn_history_load(fp, &conv->history) != 0)
         return -12;
+    if (INTREAD(conv->activation) == 0)
+        return -13;
+    if (!activation_valid(conv->activation))
+        return -14;
+
+    return 0;
+}
+
+/**
+ * @brief Convolves an input image or layer to an output layer by lowering
+ *        each patch to a row of a matrix.  The response of a feature is
+ *        the sum of the patch minus the sum of the part of the feature
+ *        which overlaps the image, so each row holds a mask of the
+ *        overlapping part and the feature sums are given by the product
+ *        of the mask rows with the features, packed one channel at a time
+ *        so that each product is a contiguous dot product.
+ * @param img Input image or previous layer with values in the range 0.0 -> 1.0
+ * @param img_width Width of the image
+ * @param img_height Height of the image
+ * @param img_depth Depth of the image
+ * @param feature_width Width if each image patch
+ * @param no_of_features The number of features in the set
+ * @param pooling_factor Pooling factor
+ * @param feature Array containing the learned features
+ * @param layer The output layer
+ * @param layer_width Width of the output layer
+ * @param activation The activation function, eg. AF_SIGMOID
+ * @returns zero on success, or -1 if memory could not be allocated
+ */
+static int convolve_image_gemm(float img[],
+                               int img_width, int img_height, int img_depth,
+                               int feature_width, int no_of_features,
+                               int pooling_factor,
+                               float feature[],
+                               float layer[], int layer_width,
+                               int activation)
+{
+    const int threads = deeplearn_get_threads();
+    int half_feature_width = feature_width/2;
+    int patch_size = feature_width*feature_width;
+    int tile_size = no_of_features*img_depth;
+    int pooling = pooling_factor;
+    int unpooled_layer_width;
+    float * packed, * rows;
+
+    if (pooling < 1)
+        pooling = 1;
+    unpooled_layer_width = layer_width*pooling;
+
+    FLOATALLOC(packed, img_depth*no_of_features*patch_size);
+    if (!packed)
+        return -1;
+
+    /* a mask row, the patch sums and an output tile for each thread */
+    FLOATALLOC(rows, threads*(patch_size + img_depth + tile_size));
+    if (!rows) {
+        free(packed);
+        return -1;
+    }
+
+    /* pack the features so that each channel is contiguous */
+    COUNTUP(d, img_depth) {
+        COUNTUP(f, no_of_features) {
+            float * dest = &packed[(d*no_of_features + f)*patch_size];
+            COUNTUP(k, patch_size)
+                dest[k] = feature[(f*patch_size + k)*img_depth + d];
+        }
+    }
+
+    /* each output unit is calculated within a tile holding the responses
+       of every feature, pooling over the units which it covers, and is
+       then written to the layer once */
+#pragma omp parallel for schedule(static) \
+    num_threads(threads) \
+    if(deeplearn_parallel(unpooled_layer_width*unpooled_layer_width* \
+                          no_of_features*patch_size*img_depth))
+    COUNTUP(pooled_layer_y, layer_width) {
+        float * mask =
+            &rows[omp_get_thread_num()*(patch_size + img_depth + tile_size)];
+        float * patch_sum = &mask[patch_size];
+        float * tile = &patch_sum[img_depth];
+
+        COUNTUP(pooled_layer_x, layer_width) {
+            /* pooled maximums begin from zero */
+            FLOATCLEAR(tile, tile_size);
+
+            FOR(layer_y, pooled_layer_y*pooling, (pooled_layer_y+1)*pooling) {
+                int y_img = layer_y * img_height / unpooled_layer_width;
+                int ty = y_img - half_feature_width;
+                int by = ty + feature_width;
+                if (ty < 0) ty = 0;
+                if (by >= img_height) by = img_height-1;
+                FOR(layer_x, pooled_layer_x*pooling,
+                    (pooled_layer_x+1)*pooling) {
+                    int x_img = layer_x * img_width / unpooled_layer_width;
+                    int tx = x_img - half_feature_width;
+                    int bx = tx + feature_width;
+                    if (tx < 0) tx = 0;
+                    if (bx >= img_width) bx = img_width-1;
+
+                    /* lower the patch */
+                    FLOATCLEAR(mask, patch_size);
+                    FLOATCLEAR(patch_sum, img_depth);
+                    FOR(yy, ty, by) {
+                        int n0 = ((yy*img_width) + tx) * img_depth;
+                        int n1 = (yy-ty) * feature_width;
+                        FOR(xx, tx, bx) {
+                            mask[n1++] = 1.0f;
+                            COUNTUP(d, img_depth)
+                                patch_sum[d] += img[n0++];
+                        }
+                    }
+
+                    COUNTUP(f, no_of_features) {
+                        float * unit = &tile[f*img_depth];
+                        COUNTUP(d, img_depth) {
+                            float * channel =
+                                &packed[(d*no_of_features + f)*patch_size];
+                            float v =
+                                activation_value(activation, patch_sum[d] -
+                                                 deeplearn_dot(mask, channel,
+                                                               patch_size));
+                            /* max pooling */
+                            if ((pooling <= 1) || (v > unit[d]))
+                                unit[d] = v;
+                        }
+                    }
+                }
+            }
+
+            memcpy(&layer[((pooled_layer_y*layer_width) + pooled_layer_x)*
+                          tile_size], tile, tile_size*sizeof(float));
+        }
+    }
+
+    free(rows);
+    free(packed);
+    return 0;
+}
+
+/**
+ * @brief Convolves an input image or layer to an output layer using
+ *        summed area tables.  The response of a feature is the sum of the
+ *        patch minus the sum of the part of the feature which overlaps
+ *        the image, so it can be found from four lookups into an integral
+ *        image together with a table of the sums of the top left part of
+ *        each feature.  Sums are accumulated in double precision so that
+ *        the differences between table entries remain accurate.
+ * @param img Input image or previous layer with values in the range 0.0 -> 1.0
+ * @param img_width Width of the image
+ * @param img_height Height of the image
+ * @param img_depth Depth of the image
+ * @param feature_width Width if each image patch
+ * @param no_of_features The number of features in the set
+ * @param pooling_factor Pooling factor
+ * @param feature Array containing the learned features
+ * @param layer The output layer
+ * @param layer_width Width of the output layer
+ * @param activation The activation function, eg. AF_SIGMOID
+ * @returns zero on success, or -1 if memory could not be allocated
+ */
+static int convolve_image_summed_area(float img[],
+                                      int img_width, int img_height,
+                                      int img_depth,
+                                      int feature_width, int no_of_features,
+                                      int pooling_factor,
+                                      float feature[],
+                                      float layer[], int layer_width,
+                                      int activation)
+{
+    const int threads = deeplearn_get_threads();
+    int half_feature_width = feature_width/2;
+    int table_width = img_width + 1;
+    int prefix_width = feature_width + 1;
+    int prefix_size = prefix_width*prefix_width*img_depth;
+    int tile_size = no_of_features*img_depth;
+    int pooling = pooling_factor;
+    int unpooled_layer_width;
+    double * table, * prefix;
+    float * tiles;
+
+    if (pooling < 1)
+        pooling = 1;
+    unpooled_layer_width = layer_width*pooling;
+
+    table = (double*)malloc(table_width*(img_height+1)*img_depth*
+                            sizeof(double));
+    if (!table)
+        return -1;
+
+    prefix = (double*)malloc(no_of_features*prefix_size*sizeof(double));
+    if (!prefix) {
+        free(table);
+        return -1;
+    }
+
+    /* an output tile for each thread */
+    FLOATALLOC(tiles, threads*tile_size);
+    if (!tiles) {
+        free(prefix);
+        free(table);
+        return -1;
+    }
+
+    /* integral image, with a row and column of zeros at the top left */
+    COUNTUP(x, table_width*img_depth)
+        table[x] = 0;
+    COUNTUP(y, img_height) {
+        double * above = &table[y*table_width*img_depth];
+        double * row = &above[table_width*img_depth];
+        float * src = &img[y*img_width*img_depth];
+        COUNTUP(d, img_depth) {
+            double sum = 0;
+            row[d] = 0;
+            COUNTUP(x, img_width) {
+                sum += src[x*img_depth + d];
+                row[(x+1)*img_depth + d] = above[(x+1)*img_depth + d] + sum;
+            }
+        }
+    }
+
+    /* sums of the top left part of each feature */
+    COUNTUP(f, no_of_features) {
+        float * curr_feature =
+            &feature[f*feature_width*feature_width*img_depth];
+        double * curr_prefix = &prefix[f*prefix_size];
+        COUNTUP(x, prefix_width*img_depth)
+            curr_prefix[x] = 0;
+        COUNTUP(y, feature_width) {
+            double * above = &curr_prefix[y*prefix_width*img_depth];
+            double * row = &above[prefix_width*img_depth];
+            float * src = &curr_feature[y*feature_width*img_depth];
+            COUNTUP(d, img_depth) {
+                double sum = 0;
+                row[d] = 0;
+                COUNTUP(x, feature_width) {
+                    sum += src[x*img_depth + d];
+                    row[(x+1)*img_depth + d] =
+                        above[(x+1)*img_depth + d] + sum;
+                }
+            }
+        }
+    }
+
+    /* each output unit is calculated within a tile holding the responses
+       of every feature, pooling over the units which it covers, and is
+       then written to the layer once */
+#pragma omp parallel for schedule(static) \
+    num_threads(threads) \
+    if(deeplearn_parallel(unpooled_layer_width*unpooled_layer_width* \
+                          no_of_features*img_depth))
+    COUNTUP(pooled_layer_y, layer_width) {
+        float * tile = &tiles[omp_get_thread_num()*tile_size];
+
+        COUNTUP(pooled_layer_x, layer_width) {
+            /* pooled maximums begin from zero */
+            FLOATCLEAR(tile, tile_size);
+
+            FOR(layer_y, pooled_layer_y*pooling, (pooled_layer_y+1)*pooling) {
+                int y_img = layer_y * img_height / unpooled_layer_width;
+                int ty = y_img - half_feature_width;
+                int by = ty + feature_width;
+                if (ty < 0) ty = 0;
+                if (by >= img_height) by = img_height-1;
+                if (by < ty) by = ty;
+                FOR(layer_x, pooled_layer_x*pooling,
+                    (pooled_layer_x+1)*pooling) {
+                    int x_img = layer_x * img_width / unpooled_layer_width;
+                    int tx = x_img - half_feature_width;
+                    int bx = tx + feature_width;
+                    if (tx < 0) tx = 0;
+                    if (bx >= img_width) bx = img_width-1;
+                    if (bx < tx) bx = tx;
+
+                    /* corners of the patch within the integral image */
+                    double * top_left =
+                        &table[(ty*table_width + tx)*img_depth];
+                    double * top_right =
+                        &table[(ty*table_width + bx)*img_depth];
+                    double * bottom_left =
+                        &table[(by*table_width + tx)*img_depth];
+                    double * bottom_right =
+                        &table[(by*table_width + bx)*img_depth];
+
+                    /* the part of each feature which overlaps the image */
+                    int overlap = ((by-ty)*prefix_width + (bx-tx))*img_depth;
+
+                    COUNTUP(f, no_of_features) {
+                        float * unit = &tile[f*img_depth];
+                        double * feature_sum =
+                            &prefix[f*prefix_size + overlap];
+                        COUNTUP(d, img_depth) {
+                            double patch_sum =
+                                bottom_right[d] - bottom_left[d] -
+                                top_right[d] + top_left[d];
+                            float v =
+                                activation_value(activation,
+                                                 (float)(patch_sum -
+                                                         feature_sum[d]));
+                            /* max pooling */
+                            if ((pooling <= 1) || (v > unit[d]))
+                                unit[d] = v;
+                        }
+                    }
+                }
+            }
+
+            memcpy(&layer[((pooled_layer_y*layer_width) + pooled_layer_x)*
+                          tile_size], tile, tile_size*sizeof(float));
+        }
+    }
 
+    free(tiles);
+    free(prefix);
+    free(table);
     return 0;
 }
 
+/**
+ * @brief Convolves using the compute backend if it is able to,
+ *        otherwise the currently selected engine
+ * @returns zero on success, or non-zero if the direct calculation
+ *          should be used instead
+ */
+static int convolve_image_engine(float img[],
+                                 int img_width, int img_height,
+                                 int img_depth,
+                                 int feature_width, int no_of_features,
+                                 int pooling_factor,
+                                 float feature[],
+                                 float layer[], int layer_width,
+                                 int activation)
+{
+    if (deeplearn_backend_convolve_image(img, img_width, img_height,
+                                         img_depth,
+                                         feature_width, no_of_features,
+                                         pooling_factor, feature,
+                                         layer, layer_width,
+                                         activation) == 0)
+        return 0;
+
+    switch(conv_engine) {
+    case CONV_ENGINE_GEMM: {
+        return convolve_image_gemm(img, img_width, img_height, img_depth,
+                                   feature_width, no_of_features,
+                                   pooling_factor, feature,
+                                   layer, layer_width, activation);
+    }
+    case CONV_ENGINE_SUMMED_AREA: {
+        return convolve_image_summed_area(img, img_width, img_height,
+                                          img_depth,
+                                          feature_width, no_of_features,
+                                          pooling_factor, feature,
+                                          layer, layer_width, activation);
+    }
+    }
+    return -1;
+}
+
 /**
  * @brief Convolves an input image or layer to an output layer
  * @param img Input image or previous layer with values in the range 0.0 -> 1.0
@@ -280,22 +705,31 @@ int conv_load(FILE * fp, deeplearn_conv * conv)
  * @param layer The output layer
  * @param layer_width Width of the output layer. The total size of the
  *        output layer should be layer_width*layer_width*no_of_features
+ * @param activation The activation function, eg. AF_SIGMOID
  */
 void convolve_image(float img[],
                     int img_width, int img_height, int img_depth,
                     int feature_width, int no_of_features,
                     int pooling_factor,
                     float feature[],
-                    float layer[], int layer_width)
+                    float layer[], int layer_width,
+                    int activation)
 {
     if (img_depth == 1) {
         convolve_image_mono(img, img_width, img_height,
                             feature_width, no_of_features,
                             pooling_factor,
-                            feature, layer, layer_width);
+                            feature, layer, layer_width,
+                            activation);
         return;
     }
 
+    if (convolve_image_engine(img, img_width, img_height, img_depth,
+                              feature_width, no_of_features,
+                              pooling_factor, feature,
+                              layer, layer_width, activation) == 0)
+        return;
+
     int half_feature_width = feature_width/2;
     int unpooled_layer_width = layer_width;
 
@@ -307,7 +741,10 @@ void convolve_image(float img[],
     }
 
     /* for each unit in the output layer */
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(unpooled_layer_width*unpooled_layer_width* \
+                          no_of_features*feature_width*feature_width))
     COUNTDOWN(layer_y, unpooled_layer_width) {
         int pooled_layer_y = layer_y / pooling_factor;
         int y_img = layer_y * img_height / unpooled_layer_width;
@@ -350,7 +787,7 @@ void convolve_image(float img[],
                         no_of_features + f;
                     COUNTDOWN(d, img_depth) {
                         layer[(layer_unit_index*img_depth) + d] =
-                            AF(match[d]);
+                            activation_value(activation, match[d]);
                     }
                 }
                 else {
@@ -358,7 +795,7 @@ void convolve_image(float img[],
                         ((pooled_layer_y*layer_width) + pooled_layer_x) *
                         no_of_features + f;
                     COUNTDOWN(d, img_depth) {
-                        float v = AF(match[d]);
+                        float v = activation_value(activation, match[d]);
                         /* max pooling */
                         if (v > layer[(layer_unit_index*img_depth) + d])
                             layer[(layer_unit_index*img_depth) + d] = v;
@@ -383,17 +820,25 @@ void convolve_image(float img[],
  * @param layer The output layer
  * @param layer_width Width of the output layer. The total size of the
  *        output layer should be layer_width*layer_width*no_of_features
+ * @param activation The activation function, eg. AF_SIGMOID
  */
 void convolve_image_mono(float img[],
                          int img_width, int img_height,
                          int feature_width, int no_of_features,
                          int pooling_factor,
                          float feature[],
-                         float layer[], int layer_width)
+                         float layer[], int layer_width,
+                         int activation)
 {
     int half_feature_width = feature_width/2;
     int unpooled_layer_width = layer_width;
 
+    if (convolve_image_engine(img, img_width, img_height, 1,
+                              feature_width, no_of_features,
+                              pooling_factor, feature,
+                              layer, layer_width, activation) == 0)
+        return;
+
     if (pooling_factor > 1) {
         /* if we are pooling then clear the values within the layer
            which will be updated, so that maximums can be calculated */
@@ -402,7 +847,10 @@ void convolve_image_mono(float img[],
     }
 
     /* for each unit in the output layer */
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(unpooled_layer_width*unpooled_layer_width* \
+                          no_of_features*feature_width*feature_width))
     COUNTDOWN(layer_y, unpooled_layer_width) {
         int pooled_layer_y = layer_y / pooling_factor;
         int y_img = layer_y * img_height / unpooled_layer_width;
@@ -439,21 +887,188 @@ void convolve_image_mono(float img[],
                 if (pooling_factor <= 1) {
                     int layer_unit_index =
                         ((layer_y*layer_width) + layer_x)*no_of_features + f;
-                    layer[layer_unit_index] = AF(match);
+                    layer[layer_unit_index] =
+                        activation_value(activation, match);
                 }
                 else {
                     int layer_unit_index =
                         ((pooled_layer_y*layer_width) +
                          pooled_layer_x)*no_of_features + f;
+                    float v = activation_value(activation, match);
                     /* max pooling */
-                    if (AF(match) > layer[layer_unit_index])
-                        layer[layer_unit_index] = AF(match);
+                    if (v > layer[layer_unit_index])
+                        layer[layer_unit_index] = v;
                 }
             }
         }
     }
 }
 
+/**
+ * @brief Finds the range of layer cells along one axis whose patches
+ *        cover each pixel.  The patches are clipped in the same way as
+ *        when deconvolving by scattering each patch into the image
+ * @param img_size Width or height of the image
+ * @param layer_width Width of the layer
+ * @param feature_width Width of each feature
+ * @param start Returned top left of the clipped patch for each cell
+ * @param first Returned first cell covering each pixel
+ * @param last Returned last cell covering each pixel, plus one
+ * @param starting Returned number of patches beginning at each pixel
+ */
+static void deconvolve_axis(int img_size, int layer_width, int feature_width,
+                            int start[], int first[], int last[],
+                            int starting[])
+{
+    int half_feature_width = feature_width/2;
+
+    COUNTDOWN(i, img_size) {
+        first[i] = layer_width;
+        last[i] = 0;
+        starting[i] = 0;
+    }
+
+    COUNTUP(l, layer_width) {
+        int t = (l * img_size / layer_width) - half_feature_width;
+        int b = t + feature_width;
+        if (t < 0) t = 0;
+        if (b >= img_size) b = img_size-1;
+        start[l] = t;
+        starting[t]++;
+
+        FOR(i, t, b) {
+            if (l < first[i]) first[i] = l;
+            if (l + 1 > last[i]) last[i] = l + 1;
+        }
+    }
+}
+
+/**
+ * @brief Deconvolves a layer by gathering, for each pixel, the products of
+ *        the layer cells whose patches cover it with the corresponding
+ *        position within each feature.  Every thread writes only to its
+ *        own rows of the image, so there are no write conflicts.  The
+ *        features are packed with the feature index innermost so that
+ *        each product over the features is a contiguous dot product.
+ * @param img Returned image, before division by the number of updates
+ * @param img_width Width of the image
+ * @param img_height Height of the image
+ * @param img_depth Depth of the image
+ * @param feature_width Width if each image patch
+ * @param no_of_features The number of features in the set
+ * @param feature Array containing the learned features
+ * @param layer The output layer to begin from
+ * @param layer_width Width of the output layer
+ * @param updates_per_pixel Returned number of updates to each pixel,
+ *        counted in the same way as by the scattering implementation.
+ *        With more than one channel each row of a patch is counted once,
+ *        at its first pixel
+ * @returns zero on success, or -1 if memory could not be allocated
+ */
+static int deconvolve_image_gather(float img[],
+                                   int img_width, int img_height,
+                                   int img_depth,
+                                   int feature_width, int no_of_features,
+                                   float feature[],
+                                   float layer[], int layer_width,
+                                   unsigned int updates_per_pixel[])
+{
+    int patch_size = feature_width*feature_width*img_depth;
+    int cells = layer_width*layer_width;
+    int * axes, * tx, * first_x, * last_x, * starting_x;
+    int * ty, * first_y, * last_y, * starting_y;
+    float * packed_feature, * packed_layer = layer;
+
+    INTALLOC(axes, (layer_width + (img_width*3)) +
+             (layer_width + (img_height*3)));
+    FLOATALLOC(packed_feature, patch_size*no_of_features);
+    if (img_depth > 1)
+        FLOATALLOC(packed_layer, cells*no_of_features*img_depth);
+    if ((!axes) || (!packed_feature) || (!packed_layer)) {
+        free(axes);
+        free(packed_feature);
+        if (img_depth > 1)
+            free(packed_layer);
+        return -1;
+    }
+
+    tx = axes;
+    first_x = &tx[layer_width];
+    last_x = &first_x[img_width];
+    starting_x = &last_x[img_width];
+    ty = &starting_x[img_width];
+    first_y = &ty[layer_width];
+    last_y = &first_y[img_height];
+    starting_y = &last_y[img_height];
+
+    deconvolve_axis(img_width, layer_width, feature_width,
+                    tx, first_x, last_x, starting_x);
+    deconvolve_axis(img_height, layer_width, feature_width,
+                    ty, first_y, last_y, starting_y);
+
+    /* position within the patch, followed by feature index */
+    COUNTDOWN(f, no_of_features)
+        COUNTDOWN(i, patch_size)
+            packed_feature[i*no_of_features + f] = feature[f*patch_size + i];
+
+    /* channel, followed by layer cell and feature index */
+    if (img_depth > 1) {
+        COUNTDOWN(i, cells*no_of_features)
+            COUNTDOWN(d, img_depth)
+                packed_layer[(d*cells*no_of_features) + i] =
+                    layer[(i*img_depth) + d];
+    }
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(cells*no_of_features*patch_size))
+    COUNTDOWN(y, img_height) {
+        int rows = last_y[y] - first_y[y];
+
+        if (rows < 0)
+            rows = 0;
+
+        COUNTDOWN(x, img_width) {
+            int n = (y*img_width) + x;
+            int columns = last_x[x] - first_x[x];
+
+            if (columns < 0)
+                columns = 0;
+
+            COUNTDOWN(d, img_depth) {
+                float * channel = &packed_layer[d*cells*no_of_features];
+                float sum = 0;
+
+                FOR(ly, first_y[y], last_y[y]) {
+                    int offset_y = (y - ty[ly])*feature_width;
+
+                    FOR(lx, first_x[x], last_x[x]) {
+                        int offset = (offset_y + x - tx[lx])*img_depth + d;
+
+                        sum += deeplearn_dot(&channel[((ly*layer_width) + lx)*
+                                                      no_of_features],
+                                             &packed_feature[offset*
+                                                             no_of_features],
+                                             no_of_features);
+                    }
+                }
+                img[(n*img_depth) + d] = sum;
+            }
+
+            if (img_depth == 1)
+                updates_per_pixel[n] = rows*columns*no_of_features;
+            else
+                updates_per_pixel[n] = rows*starting_x[x]*no_of_features;
+        }
+    }
+
+    free(axes);
+    free(packed_feature);
+    if (img_depth > 1)
+        free(packed_layer);
+    return 0;
+}
+
 /**
  * @brief Deconvolves a layer back to the source image
  * @param img Input image or previous layer with values in the range 0.0 -> 1.0
@@ -487,40 +1102,51 @@ void deconvolve_image_mono(float img[],
     /* clear the input image */
     FLOATCLEAR(img, img_width*img_height);
 
-    /* for each unit in the output layer */
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
-    COUNTDOWN(layer_y, layer_width) {
-        int y_img = layer_y * img_height / layer_width;
-        int ty = y_img - half_feature_width;
-        int by = ty + feature_width;
-        if (ty < 0) ty = 0;
-        if (by >= img_height) by = img_height-1;
-        COUNTDOWN(layer_x, layer_width) {
-            int x_img = layer_x * img_width / layer_width;
-            int tx = x_img - half_feature_width;
-            int bx = tx + feature_width;
-            if (tx < 0) tx = 0;
-            if (bx >= img_width) bx = img_width-1;
+    /* gather each pixel from the layer unless the direct engine is used,
+       in which case each patch is scattered into the image */
+    if ((conv_engine == CONV_ENGINE_DIRECT) ||
+        (deconvolve_image_gather(img, img_width, img_height, 1,
+                                 feature_width, no_of_features,
+                                 feature, layer, layer_width,
+                                 updates_per_pixel) != 0)) {
+        /* for each unit in the output layer */
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(layer_width*layer_width* \
+                          no_of_features*feature_width*feature_width))
+        COUNTDOWN(layer_y, layer_width) {
+            int y_img = layer_y * img_height / layer_width;
+            int ty = y_img - half_feature_width;
+            int by = ty + feature_width;
+            if (ty < 0) ty = 0;
+            if (by >= img_height) by = img_height-1;
+            COUNTDOWN(layer_x, layer_width) {
+                int x_img = layer_x * img_width / layer_width;
+                int tx = x_img - half_feature_width;
+                int bx = tx + feature_width;
+                if (tx < 0) tx = 0;
+                if (bx >= img_width) bx = img_width-1;
+
+                /* for every learned feature */
+                COUNTDOWN(f, no_of_features) {
+                    float * curr_feature =
+                        &feature[f*feature_width*feature_width];
 
-            /* for every learned feature */
-            COUNTDOWN(f, no_of_features) {
-                float * curr_feature =
-                    &feature[f*feature_width*feature_width];
-
-                int layer_unit_index =
-                    ((layer_y*layer_width) + layer_x)*no_of_features + f;
-                float weight = layer[layer_unit_index];
-
-                FOR(yy, ty, by) {
-                    /* position in the input image */
-                    int n0 = (yy*img_width) + tx;
-                    /* position within the feature */
-                    int n1 = (yy-ty) * feature_width;
-                    FOR(xx, tx, bx) {
-                        img[n0] += weight*curr_feature[n1];
-                        updates_per_pixel[n0]++;
-                        n0++;
-                        n1++;
+                    int layer_unit_index =
+                        ((layer_y*layer_width) + layer_x)*no_of_features + f;
+                    float weight = layer[layer_unit_index];
+
+                    FOR(yy, ty, by) {
+                        /* position in the input image */
+                        int n0 = (yy*img_width) + tx;
+                        /* position within the feature */
+                        int n1 = (yy-ty) * feature_width;
+                        FOR(xx, tx, bx) {
+                            img[n0] += weight*curr_feature[n1];
+                            updates_per_pixel[n0]++;
+                            n0++;
+                            n1++;
+                        }
                     }
                 }
             }
@@ -607,6 +1233,12 @@ void deconvolve_image(float img[],
                       float feature[],
                       float layer[], int layer_width)
 {
+    if (deeplearn_backend_deconvolve_image(img, img_width, img_height,
+                                           img_depth,
+                                           feature_width, no_of_features,
+                                           feature, layer, layer_width) == 0)
+        return;
+
     if (img_depth == 1) {
         deconvolve_image_mono(img, img_width, img_height,
                               feature_width, no_of_features,
@@ -626,43 +1258,54 @@ void deconvolve_image(float img[],
     /* clear the input image */
     FLOATCLEAR(img, img_width*img_height*img_depth);
 
-    /* for each unit in the output layer */
-#pragma omp parallel for schedule(static) num_threads(DEEPLEARN_THREADS)
-    COUNTDOWN(layer_y, layer_width) {
-        int y_img = layer_y * img_height / layer_width;
-        int ty = y_img - half_feature_width;
-        int by = ty + feature_width;
-        if (ty < 0) ty = 0;
-        if (by >= img_height) by = img_height-1;
-        COUNTDOWN(layer_x, layer_width) {
-            int x_img = layer_x * img_width / layer_width;
-            int tx = x_img - half_feature_width;
-            int bx = tx + feature_width;
-            if (tx < 0) tx = 0;
-            if (bx >= img_width) bx = img_width-1;
+    /* gather each pixel from the layer unless the direct engine is used,
+       in which case each patch is scattered into the image */
+    if ((conv_engine == CONV_ENGINE_DIRECT) ||
+        (deconvolve_image_gather(img, img_width, img_height, img_depth,
+                                 feature_width, no_of_features,
+                                 feature, layer, layer_width,
+                                 updates_per_pixel) != 0)) {
+        /* for each unit in the output layer */
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(layer_width*layer_width* \
+                          no_of_features*feature_width*feature_width))
+        COUNTDOWN(layer_y, layer_width) {
+            int y_img = layer_y * img_height / layer_width;
+            int ty = y_img - half_feature_width;
+            int by = ty + feature_width;
+            if (ty < 0) ty = 0;
+            if (by >= img_height) by = img_height-1;
+            COUNTDOWN(layer_x, layer_width) {
+                int x_img = layer_x * img_width / layer_width;
+                int tx = x_img - half_feature_width;
+                int bx = tx + feature_width;
+                if (tx < 0) tx = 0;
+                if (bx >= img_width) bx = img_width-1;
+
+                /* for every learned feature */
+                COUNTDOWN(f, no_of_features) {
+                    float * curr_feature =
+                        &feature[f*feature_width*feature_width*img_depth];
 
-            /* for every learned feature */
-            COUNTDOWN(f, no_of_features) {
-                float * curr_feature =
-                    &feature[f*feature_width*feature_width*img_depth];
-
-                int layer_unit_index =
-                    ((layer_y*layer_width) + layer_x)*no_of_features + f;
+                    int layer_unit_index =
+                        ((layer_y*layer_width) + layer_x)*no_of_features + f;
 
-                FOR(yy, ty, by) {
-                    /* position in the input image */
-                    int n0 = ((yy*img_width) + tx) * img_depth;
-                    /* position within the feature */
-                    int n1 = ((yy-ty) * feature_width) * img_depth;
-                    updates_per_pixel[(yy*img_width) + tx]++;
-                    FOR(xx, tx, bx) {
-                        COUNTDOWN(d, img_depth) {
-                            float weight =
-                                layer[(layer_unit_index*img_depth) + d];
-                            img[n0+d] += weight*curr_feature[n1+d];
+                    FOR(yy, ty, by) {
+                        /* position in the input image */
+                        int n0 = ((yy*img_width) + tx) * img_depth;
+                        /* position within the feature */
+                        int n1 = ((yy-ty) * feature_width) * img_depth;
+                        updates_per_pixel[(yy*img_width) + tx]++;
+                        FOR(xx, tx, bx) {
+                            COUNTDOWN(d, img_depth) {
+                                float weight =
+                                    layer[(layer_unit_index*img_depth) + d];
+                                img[n0+d] += weight*curr_feature[n1+d];
+                            }
+                            n0 += img_depth;
+                            n1 += img_depth;
                         }
-                        n0 += img_depth;
-                        n1 += img_depth;
                     }
                 }
             }
@@ -733,37 +1376,67 @@ void deconvolve_image(float img[],
 }
 
 /**
- * @brief Feed forward to the given layer
+ * @brief Converts an image into the normalised planes used as the input
+ *        to the first layer
+ * @param conv Convolution instance
  * @param img The input image
+ * @param planes Returned input values in the range 0.0 -> 1.0
+ */
+void conv_image_to_planes(deeplearn_conv * conv, unsigned char * img,
+                          float * planes)
+{
+    const float scale = 1.0f / 255.0f;
+
+    COUNTDOWN(i,
+              conv->layer[0].width*conv->layer[0].height*conv->layer[0].depth)
+        planes[i] = (float)img[i]*scale;
+}
+
+/**
+ * @brief Adds noise to the input layer during training.  Each thread
+ *        fills a chunk of noise from its own random number stream and
+ *        then adds it to the inputs
  * @param conv Convolution instance
- * @param layer The number of layers to convolve
  */
-void conv_feed_forward(unsigned char * img,
-                       deeplearn_conv * conv, int layer)
+static void conv_add_input_noise(deeplearn_conv * conv)
 {
-    if (!conv->training) {
-        /* convert the input image to floats */
-        COUNTDOWN(i,
-                  conv->layer[0].width*conv->layer[0].height*conv->layer[0].depth) {
-            conv->layer[0].layer[i] = (float)img[i]/255.0f;
-        }
-    }
-    else {
-        /* if we are still training add noise to the inputs */
-        COUNTDOWN(i,
-                  conv->layer[0].width*conv->layer[0].height*conv->layer[0].depth) {
-            conv->layer[0].layer[i] =
-                ((float)img[i]/255.0f) +
-                (conv->noise *
-                 (((rand_num(&conv->random_seed)%200000)/100000.0f)-1.0f));
-
-            /* limit within range 0.0 -> 1.0 */
-            if (conv->layer[0].layer[i] < 0)
-                conv->layer[0].layer[i] = 0;
-            else if (conv->layer[0].layer[i] > 1)
-                conv->layer[0].layer[i] = 1;
+    float * layer = conv->layer[0].layer;
+    int size =
+        conv->layer[0].width*conv->layer[0].height*conv->layer[0].depth;
+    int chunks = (size + DEEPLEARN_NOISE_CHUNK - 1) / DEEPLEARN_NOISE_CHUNK;
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(size))
+    COUNTUP(c, chunks) {
+        float noise[DEEPLEARN_NOISE_CHUNK];
+        unsigned int * random_seed =
+            rand_stream_seed(conv->random_streams, DEEPLEARN_MAX_THREADS);
+        float * values = &layer[c*DEEPLEARN_NOISE_CHUNK];
+        int n = size - c*DEEPLEARN_NOISE_CHUNK;
+
+        if (n > DEEPLEARN_NOISE_CHUNK)
+            n = DEEPLEARN_NOISE_CHUNK;
+
+        rand_noise(random_seed, noise, n, conv->noise);
+
+        /* limit within range 0.0 -> 1.0 */
+        COUNTUP(i, n) {
+            float v = values[i] + noise[i];
+            values[i] = (v < 0) ? 0 : ((v > 1) ? 1 : v);
         }
     }
+}
+
+/**
+ * @brief Convolves the input layer through to the given layer
+ * @param conv Convolution instance
+ * @param layer The number of layers to convolve
+ */
+static void conv_feed_forward_layers(deeplearn_conv * conv, int layer)
+{
+    if (conv->training)
+        conv_add_input_noise(conv);
 
     COUNTUP(l, layer) {
         float * next_layer = conv->outputs;
@@ -781,8 +1454,131 @@ void conv_feed_forward(unsigned char * img,
                        conv->layer[l].no_of_features,
                        conv->layer[l].pooling_factor,
                        conv->layer[l].feature,
-                       next_layer, next_layer_width);
+                       next_layer, next_layer_width,
+                       conv->activation);
+    }
+}
+
+/**
+ * @brief Feed forward to the given layer
+ * @param img The input image
+ * @param conv Convolution instance
+ * @param layer The number of layers to convolve
+ */
+void conv_feed_forward(unsigned char * img,
+                       deeplearn_conv * conv, int layer)
+{
+    conv_image_to_planes(conv, img, conv->layer[0].layer);
+    conv_feed_forward_layers(conv, layer);
+}
+
+/**
+ * @brief Feed forward to the given layer from an image which has already
+ *        been converted with conv_image_to_planes.  This avoids converting
+ *        the same image again each time it is presented
+ * @param planes The normalised input image
+ * @param conv Convolution instance
+ * @param layer The number of layers to convolve
+ */
+void conv_feed_forward_planes(float * planes,
+                              deeplearn_conv * conv, int layer)
+{
+    memcpy(conv->layer[0].layer, planes,
+           conv->layer[0].width*conv->layer[0].height*conv->layer[0].depth*
+           sizeof(float));
+    conv_feed_forward_layers(conv, layer);
+}
+
+/**
+ * @brief Returns the number of values within the input to a layer
+ * @param conv Convolution instance
+ * @param layer Index of the layer
+ * @returns The size of the layer
+ */
+static int conv_layer_size(deeplearn_conv * conv, int layer)
+{
+    int size =
+        conv->layer[layer].width*conv->layer[layer].height*
+        conv->layer[layer].depth;
+
+    if (layer > 0)
+        size *= conv->layer[layer-1].no_of_features;
+    return size;
+}
+
+/**
+ * @brief Feeds a number of images forward through every layer.
+ *        Blocks of images are passed through each layer in turn, using
+ *        scratch buffers for each image, so that one layer's features are
+ *        reused across the block and the images of a block are convolved
+ *        concurrently.  No noise is added to the inputs.
+ * @param conv Convolution instance
+ * @param images Array of input images
+ * @param no_of_images The number of images
+ * @param outputs Returned outputs, conv->no_of_outputs for each image
+ * @returns zero on success, or -1 if memory could not be allocated
+ */
+int conv_feed_forward_batch(deeplearn_conv * conv,
+                            unsigned char ** images, int no_of_images,
+                            float * outputs)
+{
+    const int block_size = DEEPLEARN_FEED_FORWARD_BATCH;
+    int scratch_size = 0;
+    float * scratch;
+
+    COUNTUP(l, conv->no_of_layers) {
+        if (conv_layer_size(conv, l) > scratch_size)
+            scratch_size = conv_layer_size(conv, l);
+    }
+
+    /* two buffers for each image within a block */
+    FLOATALLOC(scratch, block_size*2*scratch_size);
+    if (!scratch)
+        return -1;
+
+    for (int start = 0; start < no_of_images; start += block_size) {
+        int n = no_of_images - start;
+
+        if (n > block_size)
+            n = block_size;
+
+        /* convert the input images to floats */
+        COUNTUP(b, n)
+            conv_image_to_planes(conv, images[start + b],
+                                 &scratch[b*2*scratch_size]);
+
+        COUNTUP(l, conv->no_of_layers) {
+            int next_layer_width = conv->outputs_width;
+
+            if (l < conv->no_of_layers-1)
+                next_layer_width = conv->layer[l+1].width;
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(n*conv_layer_size(conv, l)* \
+                          conv->layer[l].no_of_features))
+            COUNTUP(b, n) {
+                float * layer = &scratch[(b*2 + (l%2))*scratch_size];
+                float * next_layer = &outputs[(start + b)*conv->no_of_outputs];
+
+                if (l < conv->no_of_layers-1)
+                    next_layer = &scratch[(b*2 + ((l+1)%2))*scratch_size];
+
+                convolve_image(layer,
+                               conv->layer[l].width, conv->layer[l].height,
+                               conv->layer[l].depth,
+                               conv->layer[l].feature_width,
+                               conv->layer[l].no_of_features,
+                               conv->layer[l].pooling_factor,
+                               conv->layer[l].feature,
+                               next_layer, next_layer_width,
+                               conv->activation);
+            }
+        }
     }
+
+    free(scratch);
+    return 0;
 }
 
 /**
@@ -855,18 +1651,39 @@ float conv_learn(unsigned char * img,
     if (!feature_score)
         return -1;
 
+    PROFILE_TIMER(t);
     conv_feed_forward(img, conv, layer);
-
-    matching_score +=
-        learn_features(&conv->layer[layer].layer[0],
-                       conv->layer[layer].width,
-                       conv->layer[layer].height,
-                       conv->layer[layer].depth,
-                       conv->layer[layer].feature_width,
-                       conv->layer[layer].no_of_features,
-                       &conv->layer[layer].feature[0],
-                       feature_score,
-                       samples, conv->learning_rate, random_seed);
+    PROFILE_LAP(DEEPLEARN_PHASE_CONVOLUTION, t, 1);
+
+    if (conv->feature_batch_size > 0)
+        matching_score +=
+            learn_features_batch(&conv->layer[layer].layer[0],
+                                 conv->layer[layer].width,
+                                 conv->layer[layer].height,
+                                 conv->layer[layer].depth,
+                                 conv->layer[layer].feature_width,
+                                 conv->layer[layer].no_of_features,
+                                 &conv->layer[layer].feature[0],
+                                 samples, conv->feature_batch_size,
+                                 conv->learning_rate, random_seed);
+    else
+        matching_score +=
+            learn_features(&conv->layer[layer].layer[0],
+                           conv->layer[layer].width,
+                           conv->layer[layer].height,
+                           conv->layer[layer].depth,
+                           conv->layer[layer].feature_width,
+                           conv->layer[layer].no_of_features,
+                           &conv->layer[layer].feature[0],
+                           feature_score,
+                           samples, conv->learning_rate, random_seed);
+    PROFILE_LAP(DEEPLEARN_PHASE_FEATURES, t, samples);
+
+    /* memory could not be allocated */
+    if (matching_score < 0) {
+        free(feature_score);
+        return -1;
+    }
 
     /* check for NaN */
     if (matching_score != matching_score) {
@@ -876,6 +1693,8 @@ float conv_learn(unsigned char * img,
     }
 
     deeplearn_history_update(&conv->history, matching_score);
+    conv->feature_updates++;
+    deeplearn_backend_weights_changed(conv->layer[layer].feature);
 
     free(feature_score);
 
@@ -959,7 +1778,7 @@ int bp_inputs_from_convnet(bp * net, deeplearn_conv * conv)
  */
 float conv_get_output(deeplearn_conv * conv, int index)
 {
-    return conv->layer[conv->no_of_layers-1].layer[index];
+    return conv->outputs[index];
 }
 
 /**
@@ -969,5 +1788,8 @@ float conv_get_output(deeplearn_conv * conv, int index)
  */
 float conv_get_error(deeplearn_conv * conv)
 {
-    return conv->history.history[conv->history.index][0];
+    if (conv->history.index == 0)
+        return 0;
+
+    return HISTORY_VALUE(&conv->history, conv->history.index-1, 0);
 }
@@ -42,10 +42,16 @@
 #include "autocoder.h"
 #include "deeplearn_features.h"
 #include "deeplearn_history.h"
+#include "deeplearn_backend.h"
 
 #define PREPROCESS_MAX_LAYERS 100
 #define POOLING_FACTOR        2
 
+/* ways in which the response of each feature may be calculated */
+#define CONV_ENGINE_DIRECT    0
+#define CONV_ENGINE_GEMM      1
+#define CONV_ENGINE_SUMMED_AREA 2
+
 /* minimum deconvolved value for gap filling */
 #define MIN_DECONVOLVED       0.01f
 
@@ -61,14 +67,20 @@ typedef struct {
 typedef struct {
     int no_of_layers;
 
-    /* array storing layers */
-    deeplearn_conv_layer layer[PREPROCESS_MAX_LAYERS];
+    /* array storing layers, of up to PREPROCESS_MAX_LAYERS */
+    deeplearn_conv_layer * layer;
 
     /* the amount of noise to add to inputs during training
        in the range 0.0 -> 1.0 */
     float noise;
     unsigned int random_seed;
 
+    /* activation function, eg. AF_SIGMOID */
+    int activation;
+
+    /* random number generator state for each thread */
+    rand_stream random_streams[DEEPLEARN_MAX_THREADS];
+
     /* the outputs at the end of the process */
     int outputs_width;
     int no_of_outputs;
@@ -83,6 +95,14 @@ typedef struct {
        adding noise to the input layer */
     unsigned char training;
 
+    /* the number of image patches scored together when learning
+       features, or zero to learn from one patch at a time */
+    int feature_batch_size;
+
+    /* incremented whenever features are learned, so that anything
+       derived from the outputs can tell when it is out of date */
+    unsigned int feature_updates;
+
     deeplearn_history history;
 } deeplearn_conv;
 
@@ -92,7 +112,14 @@ int conv_init(int no_of_layers,
               int final_image_width, int final_image_height,
               deeplearn_conv * conv);
 
+void conv_image_to_planes(deeplearn_conv * conv, unsigned char * img,
+                          float * planes);
 void conv_feed_forward(unsigned char * img, deeplearn_conv * conv, int layer);
+void conv_feed_forward_planes(float * planes,
+                              deeplearn_conv * conv, int layer);
+int conv_feed_forward_batch(deeplearn_conv * conv,
+                            unsigned char ** images, int no_of_images,
+                            float * outputs);
 
 float conv_learn(unsigned char * img,
                  deeplearn_conv * conv,
@@ -111,7 +138,8 @@ void convolve_image(float img[],
                     int feature_width, int no_of_features,
                     int pooling_factor,
                     float feature[],
-                    float layer[], int layer_width);
+                    float layer[], int layer_width,
+                    int activation);
 void deconvolve_image(float img[],
                       int img_width, int img_height, int img_depth,
                       int feature_width, int no_of_features,
@@ -127,7 +155,11 @@ void convolve_image_mono(float img[],
                          int feature_width, int no_of_features,
                          int pooling_factor,
                          float feature[],
-                         float layer[], int layer_width);
+                         float layer[], int layer_width,
+                         int activation);
+void conv_set_feature_batch(deeplearn_conv * conv, int batch_size);
+int conv_set_engine(int engine);
+int conv_get_engine(void);
 float conv_get_output(deeplearn_conv * conv, int index);
 float conv_get_error(deeplearn_conv * conv);
 int bp_inputs_from_convnet(bp * net, deeplearn_conv * conv);
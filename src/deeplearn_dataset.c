@@ -0,0 +1,420 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "deeplearn_dataset.h"
+
+/**
+ * @brief Moves the samples and the training and test sets of a learner
+ *        into a dataset. The learner continues to point at them
+ * @param dataset Dataset object
+ * @param learner Deep learner object
+ */
+static void deeplearn_dataset_take(deeplearn_dataset * dataset,
+                                   deeplearn * learner)
+{
+    dataset->no_of_input_fields = learner->no_of_input_fields;
+    dataset->data = learner->data;
+    dataset->data_samples = learner->data_samples;
+    dataset->indexed_data = learner->indexed_data;
+    dataset->indexed_data_samples = learner->indexed_data_samples;
+    dataset->data_rows = learner->data_rows;
+    dataset->data_rows_samples = learner->data_rows_samples;
+    dataset->data_inputs = learner->data_inputs;
+    dataset->data_outputs = learner->data_outputs;
+    dataset->data_text = learner->data_text;
+    dataset->data_encoded = learner->data_encoded;
+    dataset->data_map = learner->data_map;
+    dataset->data_map_length = learner->data_map_length;
+    dataset->training_data = learner->training_data;
+    dataset->training_data_samples = learner->training_data_samples;
+    dataset->training_data_labeled = learner->training_data_labeled;
+    dataset->training_data_labeled_samples =
+        learner->training_data_labeled_samples;
+    dataset->test_data = learner->test_data;
+    dataset->test_data_samples = learner->test_data_samples;
+}
+
+/**
+ * @brief Points a learner at the samples and the training and test
+ *        sets of a dataset, or at nothing if the dataset is zero
+ * @param learner Deep learner object
+ * @param dataset Dataset object, or 0
+ */
+static void deeplearn_dataset_view(deeplearn * learner,
+                                   const deeplearn_dataset * dataset)
+{
+    deeplearn_dataset empty;
+
+    if (dataset == 0) {
+        memset((void*)&empty, '\0', sizeof(deeplearn_dataset));
+        empty.no_of_input_fields = learner->no_of_input_fields;
+        dataset = &empty;
+    }
+
+    learner->no_of_input_fields = dataset->no_of_input_fields;
+    learner->data = dataset->data;
+    learner->data_samples = dataset->data_samples;
+    learner->indexed_data = dataset->indexed_data;
+    learner->indexed_data_samples = dataset->indexed_data_samples;
+    learner->data_rows = dataset->data_rows;
+    learner->data_rows_samples = dataset->data_rows_samples;
+    learner->data_inputs = dataset->data_inputs;
+    learner->data_outputs = dataset->data_outputs;
+    learner->data_text = dataset->data_text;
+    learner->data_encoded = dataset->data_encoded;
+    learner->data_map = dataset->data_map;
+    learner->data_map_length = dataset->data_map_length;
+    learner->training_data = dataset->training_data;
+    learner->training_data_samples = dataset->training_data_samples;
+    learner->training_data_labeled = dataset->training_data_labeled;
+    learner->training_data_labeled_samples =
+        dataset->training_data_labeled_samples;
+    learner->test_data = dataset->test_data;
+    learner->test_data_samples = dataset->test_data_samples;
+}
+
+/**
+ * @brief Frees the samples and the training and test sets of a dataset
+ * @param dataset Dataset object
+ */
+static void deeplearn_dataset_free_samples(deeplearn_dataset * dataset)
+{
+    deeplearndata * sample = dataset->data;
+    deeplearndata * prev_sample;
+
+    while (sample != 0) {
+        prev_sample = sample;
+        sample = (deeplearndata *)sample->next;
+
+        /* rows loaded from a csv file are freed as a single block */
+        if ((prev_sample >= dataset->data_rows) &&
+            (prev_sample < dataset->data_rows + dataset->data_rows_samples))
+            continue;
+
+        if (prev_sample->inputs_text != 0) {
+            /* clear any input text strings */
+            COUNTDOWN(i, dataset->no_of_input_fields) {
+                if (prev_sample->inputs_text[i] != 0)
+                    free(prev_sample->inputs_text[i]);
+            }
+            free(prev_sample->inputs_text);
+        }
+        /* clear numerical fields */
+        free(prev_sample->inputs);
+        free(prev_sample->outputs);
+        free(prev_sample);
+    }
+
+    if (dataset->data_map != 0) {
+        /* rows opened from a binary file point into its mapping */
+        free(dataset->data_text);
+        munmap(dataset->data_map, dataset->data_map_length);
+    }
+    else {
+        if (dataset->data_text != 0) {
+            COUNTDOWN(i, dataset->data_rows_samples*
+                      dataset->no_of_input_fields) {
+                if (dataset->data_text[i] != 0)
+                    free(dataset->data_text[i]);
+            }
+            free(dataset->data_text);
+        }
+        free(dataset->data_inputs);
+        free(dataset->data_outputs);
+    }
+    free(dataset->data_rows);
+    free(dataset->data_encoded);
+    free(dataset->indexed_data);
+
+    /* free training and test sets */
+    free(dataset->training_data);
+    free(dataset->training_data_labeled);
+    free(dataset->test_data);
+}
+
+/**
+ * @brief Copies an array of floats, or returns 0 if it is empty
+ * @param values The array
+ * @param n The number of values
+ * @param copy Returned copy
+ * @returns zero on success
+ */
+static int deeplearn_dataset_copy(const float * values, int n,
+                                  float ** copy)
+{
+    *copy = 0;
+    if (n <= 0)
+        return 0;
+
+    FLOATALLOC(*copy, n);
+    if (!*copy)
+        return -1;
+
+    memcpy((void*)*copy, (void*)values, n*sizeof(float));
+    return 0;
+}
+
+/**
+ * @brief Frees the field lengths and ranges of a dataset
+ * @param dataset Dataset object
+ */
+static void deeplearn_dataset_free_ranges(deeplearn_dataset * dataset)
+{
+    free(dataset->field_length);
+    free(dataset->input_range_min);
+    free(dataset->input_range_max);
+    free(dataset->output_range_min);
+    free(dataset->output_range_max);
+}
+
+/**
+ * @brief Turns the data samples of a learner, loaded with
+ *        deeplearndata_read_csv or deeplearndata_open_binary, into a
+ *        dataset which other learners can attach to. The samples, the
+ *        training and test sets and the normalisation ranges are then
+ *        held once however many learners use them, and cannot be changed.
+ *        The learner holds the first reference to the dataset
+ * @param learner Deep learner object
+ * @returns The dataset, or 0 if it could not be allocated
+ */
+deeplearn_dataset * deeplearn_dataset_share(deeplearn * learner)
+{
+    deeplearn_dataset * dataset;
+    bp * net = learner->net;
+    int retval = 0;
+
+    if (learner->dataset != 0)
+        return learner->dataset;
+
+    dataset = (deeplearn_dataset*)calloc(1, sizeof(deeplearn_dataset));
+    if (!dataset)
+        return 0;
+
+    dataset->no_of_inputs = net->no_of_inputs;
+    dataset->no_of_outputs = net->no_of_outputs;
+
+    if (learner->no_of_input_fields > 0) {
+        INTALLOC(dataset->field_length, learner->no_of_input_fields);
+        if (!dataset->field_length)
+            retval = -1;
+        else
+            memcpy((void*)dataset->field_length,
+                   (void*)learner->field_length,
+                   learner->no_of_input_fields*sizeof(int));
+    }
+
+    retval += deeplearn_dataset_copy(learner->input_range_min,
+                                     net->no_of_inputs,
+                                     &dataset->input_range_min);
+    retval += deeplearn_dataset_copy(learner->input_range_max,
+                                     net->no_of_inputs,
+                                     &dataset->input_range_max);
+    retval += deeplearn_dataset_copy(learner->output_range_min,
+                                     net->no_of_outputs,
+                                     &dataset->output_range_min);
+    retval += deeplearn_dataset_copy(learner->output_range_max,
+                                     net->no_of_outputs,
+                                     &dataset->output_range_max);
+    if (retval != 0) {
+        deeplearn_dataset_free_ranges(dataset);
+        free(dataset);
+        return 0;
+    }
+
+    deeplearn_dataset_take(dataset, learner);
+    dataset->references = 1;
+    learner->dataset = dataset;
+    return dataset;
+}
+
+/**
+ * @brief Attaches a learner to a shared dataset, in place of any samples
+ *        which it had. The learner takes the input field lengths and
+ *        ranges of the dataset and starts a new epoch, but keeps its own
+ *        network, so that many models can be trained on one copy of the
+ *        data. The network must have the inputs and outputs of the learner
+ *        which the dataset came from
+ * @param learner Deep learner object
+ * @param dataset Dataset created by deeplearn_dataset_share
+ * @returns zero on success
+ */
+int deeplearn_dataset_attach(deeplearn * learner,
+                             deeplearn_dataset * dataset)
+{
+    bp * net = learner->net;
+    int * field_length = 0;
+
+    if (learner->dataset == dataset)
+        return 0;
+
+    if ((net->no_of_inputs != dataset->no_of_inputs) ||
+        (net->no_of_outputs != dataset->no_of_outputs))
+        return -1;
+
+    if (dataset->no_of_input_fields > 0) {
+        INTALLOC(field_length, dataset->no_of_input_fields);
+        if (!field_length)
+            return -2;
+        memcpy((void*)field_length, (void*)dataset->field_length,
+               dataset->no_of_input_fields*sizeof(int));
+    }
+
+    deeplearn_dataset_detach(learner);
+    deeplearn_dataset_retain(dataset);
+    learner->dataset = dataset;
+    deeplearn_dataset_view(learner, dataset);
+
+    free(learner->field_length);
+    learner->field_length = field_length;
+
+    memcpy((void*)learner->input_range_min, (void*)dataset->input_range_min,
+           net->no_of_inputs*sizeof(float));
+    memcpy((void*)learner->input_range_max, (void*)dataset->input_range_max,
+           net->no_of_inputs*sizeof(float));
+    memcpy((void*)learner->output_range_min,
+           (void*)dataset->output_range_min,
+           net->no_of_outputs*sizeof(float));
+    memcpy((void*)learner->output_range_max,
+           (void*)dataset->output_range_max,
+           net->no_of_outputs*sizeof(float));
+
+    /* the epoch sampler starts again on the new sets */
+    free(learner->sampler_order);
+    learner->sampler_order = 0;
+    learner->sampler_samples = 0;
+    learner->sampler_position = 0;
+
+    /* cached values belong to the old training set */
+    learner->pretrain_cache_layer = -1;
+    return 0;
+}
+
+/**
+ * @brief Detaches a learner from its samples and its training and test
+ *        sets. They are freed if they belong to the learner, otherwise
+ *        the reference to the shared dataset is released
+ * @param learner Deep learner object
+ */
+void deeplearn_dataset_detach(deeplearn * learner)
+{
+    deeplearn_dataset own;
+
+    if (learner->dataset != 0) {
+        deeplearn_dataset_release(learner->dataset);
+        learner->dataset = 0;
+    }
+    else {
+        deeplearn_dataset_take(&own, learner);
+        deeplearn_dataset_free_samples(&own);
+    }
+
+    deeplearn_dataset_view(learner, 0);
+}
+
+/**
+ * @brief Takes a reference to a dataset, so that it remains after the
+ *        learners which use it have been freed
+ * @param dataset Dataset object
+ */
+void deeplearn_dataset_retain(deeplearn_dataset * dataset)
+{
+#pragma omp atomic
+    dataset->references++;
+}
+
+/**
+ * @brief Releases a reference to a dataset, freeing it once no learner
+ *        or other owner refers to it
+ * @param dataset Dataset object
+ */
+void deeplearn_dataset_release(deeplearn_dataset * dataset)
+{
+    int references;
+
+#pragma omp atomic capture
+    references = --dataset->references;
+
+    if (references > 0)
+        return;
+
+    deeplearn_dataset_free_samples(dataset);
+    deeplearn_dataset_free_ranges(dataset);
+    free(dataset);
+}
+
+/**
+ * @brief Trains a number of learners concurrently, such as the models of
+ *        a hyperparameter sweep or an ensemble attached to one dataset.
+ *        Each learner is trained by a single thread. Learners are given
+ *        to threads as they become free, so that models of different
+ *        sizes keep every thread busy. Learners should not share plot
+ *        filenames, or plotting may be turned off with
+ *        deeplearn_set_plotting
+ * @param learners Array of learners
+ * @param no_of_learners The number of learners
+ * @param batch_size The number of samples in each mini-batch, or one to
+ *        train on a sample at a time
+ * @param max_steps The largest number of training steps for each learner
+ * @returns The number of learners whose training completed, or a negative
+ *          value if training any of them failed
+ */
+int deeplearn_dataset_sweep(deeplearn * learners, int no_of_learners,
+                            int batch_size, int max_steps)
+{
+    int completed = 0, failed = 0;
+
+    /* parallel regions within each training step are not nested,
+       so they run on the thread of the learner */
+#pragma omp parallel for schedule(dynamic, 1) \
+    num_threads(deeplearn_get_threads()) reduction(+:completed,failed)
+    COUNTUP(n, no_of_learners) {
+        deeplearn * learner = &learners[n];
+        int retval = 1;
+
+        COUNTUP(step, max_steps) {
+            if (batch_size > 1)
+                retval = deeplearndata_training_batch(learner, batch_size);
+            else
+                retval = deeplearndata_training(learner);
+
+            if (retval <= 0)
+                break;
+        }
+
+        if (retval < 0)
+            failed++;
+        else if (learner->training_complete != 0)
+            completed++;
+    }
+
+    if (failed > 0)
+        return -1;
+
+    return completed;
+}
@@ -0,0 +1,861 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* sockets are not part of c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include "deeplearn_distributed.h"
+#include <unistd.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/* the message header holds the state of the layer-wise training */
+#define DISTRIBUTED_HEADER  (2*(int)sizeof(int))
+
+/**
+ * @brief Returns the number of bytes needed to hold quantized deltas
+ * @param n The number of deltas
+ * @returns Size in bytes
+ */
+int deeplearn_delta_packed_size(int n)
+{
+    int blocks = (n + DEEPLEARN_DELTA_BLOCK - 1) / DEEPLEARN_DELTA_BLOCK;
+
+    return blocks*(int)sizeof(float) + n;
+}
+
+/**
+ * @brief Quantizes an array of weight deltas into a compact buffer.
+ *        Each block of DEEPLEARN_DELTA_BLOCK deltas is stored as a
+ *        scale followed by one signed byte per delta
+ * @param delta Array of deltas
+ * @param n The number of deltas
+ * @param buffer Returned buffer of deeplearn_delta_packed_size(n) bytes
+ * @returns The number of bytes written
+ */
+int deeplearn_delta_pack(const float * delta, int n, unsigned char * buffer)
+{
+    unsigned char * ptr = buffer;
+
+    for (int start = 0; start < n; start += DEEPLEARN_DELTA_BLOCK) {
+        int block = n - start;
+        float max_delta = 0, scale;
+
+        if (block > DEEPLEARN_DELTA_BLOCK)
+            block = DEEPLEARN_DELTA_BLOCK;
+
+        COUNTUP(i, block) {
+            if (fabs(delta[start + i]) > max_delta)
+                max_delta = fabs(delta[start + i]);
+        }
+
+        scale = max_delta / 127.0f;
+        memcpy(ptr, &scale, sizeof(float));
+        ptr += sizeof(float);
+
+        COUNTUP(i, block) {
+            int q = 0;
+            if (scale > 0)
+                q = (int)floorf(delta[start + i] / scale + 0.5f);
+            *ptr++ = (unsigned char)(signed char)CLIP(q, -127, 127);
+        }
+    }
+
+    return (int)(ptr - buffer);
+}
+
+/**
+ * @brief Restores weight deltas which were quantized with
+ *        deeplearn_delta_pack
+ * @param buffer Buffer of quantized deltas
+ * @param n The number of deltas
+ * @param delta Returned array of deltas
+ */
+void deeplearn_delta_unpack(const unsigned char * buffer, int n,
+                            float * delta)
+{
+    const unsigned char * ptr = buffer;
+
+    for (int start = 0; start < n; start += DEEPLEARN_DELTA_BLOCK) {
+        int block = n - start;
+        float scale;
+
+        if (block > DEEPLEARN_DELTA_BLOCK)
+            block = DEEPLEARN_DELTA_BLOCK;
+
+        memcpy(&scale, ptr, sizeof(float));
+        ptr += sizeof(float);
+
+        COUNTUP(i, block)
+            delta[start + i] = (signed char)*ptr++ * scale;
+    }
+}
+
+/**
+ * @brief Returns the number of weights and biases which are averaged
+ *        between the nodes, including those of the autocoders
+ * @param learner Deep learner object
+ * @returns The number of parameters
+ */
+int deeplearn_distributed_parameters(deeplearn * learner)
+{
+    bp * net = learner->net;
+    int n = 0;
+
+    COUNTUP(l, net->hidden_layers+1)
+        n += net->layers[l].no_of_units*(net->layers[l].no_of_inputs + 1);
+
+    COUNTUP(l, net->hidden_layers) {
+        ac * autocoder = learner->autocoder[l];
+        n += autocoder->no_of_hiddens*(autocoder->no_of_inputs + 1);
+    }
+
+    return n;
+}
+
+/**
+ * @brief Returns the size of the largest message which is sent between
+ *        the nodes, for transports which need to know it in advance
+ * @param learner Deep learner object
+ * @returns Size in bytes
+ */
+int deeplearn_distributed_message_size(deeplearn * learner)
+{
+    return DISTRIBUTED_HEADER +
+        deeplearn_distributed_parameters(learner)*(int)sizeof(float);
+}
+
+/**
+ * @brief Copies the parameters of the learner into an array, or from
+ *        the array back into the learner
+ * @param learner Deep learner object
+ * @param parameters Array of parameters
+ * @param store Non-zero to copy from the array into the learner
+ */
+static void deeplearn_distributed_copy(deeplearn * learner,
+                                       float * parameters, int store)
+{
+    bp * net = learner->net;
+    float * ptr = parameters;
+
+    COUNTUP(l, net->hidden_layers+1) {
+        bp_layer * layer = &net->layers[l];
+        int n = layer->no_of_units*layer->no_of_inputs;
+
+        if (store)
+            memcpy(layer->weights, ptr, n*sizeof(float));
+        else
+            memcpy(ptr, layer->weights, n*sizeof(float));
+        ptr += n;
+
+        COUNTUP(i, layer->no_of_units) {
+            if (store)
+                layer->units[i].bias = *ptr;
+            else
+                *ptr = layer->units[i].bias;
+            ptr++;
+        }
+    }
+
+    COUNTUP(l, net->hidden_layers) {
+        ac * autocoder = learner->autocoder[l];
+        int n = autocoder->no_of_hiddens*autocoder->no_of_inputs;
+
+        if (store) {
+            memcpy(autocoder->weights, ptr, n*sizeof(float));
+            memcpy(autocoder->bias, &ptr[n],
+                   autocoder->no_of_hiddens*sizeof(float));
+        }
+        else {
+            memcpy(ptr, autocoder->weights, n*sizeof(float));
+            memcpy(&ptr[n], autocoder->bias,
+                   autocoder->no_of_hiddens*sizeof(float));
+        }
+        ptr += n + autocoder->no_of_hiddens;
+    }
+
+    if (store)
+        bp_weights_changed(net);
+}
+
+/**
+ * @brief Writes the state of the layer-wise training into a message header
+ * @param learner Deep learner object
+ * @param message The message
+ */
+static void deeplearn_distributed_header(deeplearn * learner,
+                                         unsigned char * message)
+{
+    int state[2];
+
+    state[0] = learner->current_hidden_layer;
+    state[1] = learner->training_complete;
+    memcpy(message, state, DISTRIBUTED_HEADER);
+}
+
+/**
+ * @brief Moves every node on to the furthest stage of training that any
+ *        of them has reached. A hidden layer whose pretraining finished
+ *        during the last interval is set again from its averaged
+ *        autocoder, so that it is the same on every node
+ * @param dist Distributed trainer object
+ */
+static void deeplearn_distributed_advance(deeplearn_distributed * dist)
+{
+    deeplearn * learner = dist->learner;
+    int nodes = dist->transport->nodes;
+    int min_layer = learner->net->hidden_layers;
+    int max_layer = 0, complete = 0;
+
+    COUNTUP(r, nodes) {
+        int state[2];
+
+        memcpy(state, &dist->messages[r*dist->message_bytes],
+               DISTRIBUTED_HEADER);
+        if (state[0] < min_layer) min_layer = state[0];
+        if (state[0] > max_layer) max_layer = state[0];
+        if (state[1] != 0) complete = 1;
+    }
+
+    if (max_layer > min_layer) {
+        FOR(l, min_layer, max_layer) {
+            if (l < learner->net->hidden_layers)
+                copy_autocoder_to_hidden_layer(learner, l);
+        }
+        if (learner->current_hidden_layer < max_layer)
+            learner->backprop_error = DEEPLEARN_UNKNOWN_ERROR;
+        learner->current_hidden_layer = max_layer;
+    }
+
+    if (complete)
+        learner->training_complete = 1;
+}
+
+/**
+ * @brief Quantizes the change in parameters since the last exchange
+ *        into the message which is sent next
+ * @param dist Distributed trainer object
+ */
+static void deeplearn_distributed_prepare(deeplearn_distributed * dist)
+{
+    int n = dist->no_of_parameters;
+
+    deeplearn_distributed_copy(dist->learner, dist->parameters, 0);
+    COUNTDOWN(i, n)
+        dist->sent[i] = dist->parameters[i] - dist->reference[i];
+
+    deeplearn_distributed_header(dist->learner, dist->message);
+    deeplearn_delta_pack(dist->sent, n, &dist->message[DISTRIBUTED_HEADER]);
+
+    /* the other nodes will see the quantized change, and anything which
+       is lost by quantizing is sent along with the next change */
+    deeplearn_delta_unpack(&dist->message[DISTRIBUTED_HEADER], n,
+                           dist->sent);
+    dist->pending = 1;
+}
+
+/**
+ * @brief Applies the average of the changes received from every node.
+ *        Changes which this node has made since its message was sent
+ *        are kept
+ * @param dist Distributed trainer object
+ */
+static void deeplearn_distributed_apply(deeplearn_distributed * dist)
+{
+    int n = dist->no_of_parameters;
+    int nodes = dist->transport->nodes;
+    float scale = 1.0f / nodes;
+
+    FLOATCLEAR(dist->parameters, n);
+    COUNTUP(r, nodes) {
+        deeplearn_delta_unpack(&dist->messages[r*dist->message_bytes +
+                                               DISTRIBUTED_HEADER],
+                               n, dist->received);
+        deeplearn_axpy(dist->parameters, scale, dist->received, n);
+    }
+
+    /* parameters now holds the average change */
+    COUNTDOWN(i, n) {
+        dist->reference[i] += dist->parameters[i];
+        dist->received[i] = dist->parameters[i] - dist->sent[i];
+    }
+
+    deeplearn_distributed_copy(dist->learner, dist->parameters, 0);
+    deeplearn_axpy(dist->parameters, 1, dist->received, n);
+    deeplearn_distributed_copy(dist->learner, dist->parameters, 1);
+
+    deeplearn_distributed_advance(dist);
+    dist->pending = 0;
+    dist->exchanges++;
+}
+
+/**
+ * @brief Initialises a distributed trainer. Every node must call this,
+ *        and afterwards all of them begin with the weights of the first
+ *        node. The training and test sets of the learner are the shard
+ *        of the data held by this node
+ * @param dist Distributed trainer object
+ * @param learner Deep learner object
+ * @param transport Transport connecting the nodes
+ * @param sync_interval The number of training steps between exchanges
+ * @returns zero on success
+ */
+int deeplearn_distributed_init(deeplearn_distributed * dist,
+                               deeplearn * learner,
+                               deeplearn_transport * transport,
+                               int sync_interval)
+{
+    int n = deeplearn_distributed_parameters(learner);
+    int raw_bytes = deeplearn_distributed_message_size(learner);
+
+    if ((sync_interval < 1) || (transport->nodes < 1) ||
+        (transport->allgather == NULL))
+        return -1;
+
+    dist->learner = learner;
+    dist->transport = transport;
+    dist->sync_interval = sync_interval;
+    dist->no_of_parameters = n;
+    dist->pending = 0;
+    dist->status = 0;
+    dist->exchanges = 0;
+
+    FLOATALLOC(dist->reference, n);
+    FLOATALLOC(dist->parameters, n);
+    FLOATALLOC(dist->sent, n);
+    FLOATALLOC(dist->received, n);
+    UCHARALLOC(dist->message, raw_bytes);
+    UCHARALLOC(dist->messages, raw_bytes*transport->nodes);
+    if ((!dist->reference) || (!dist->parameters) || (!dist->sent) ||
+        (!dist->received) || (!dist->message) || (!dist->messages)) {
+        deeplearn_distributed_free(dist);
+        return -2;
+    }
+
+    /* every node starts from the parameters of the first one */
+    deeplearn_distributed_copy(learner, dist->parameters, 0);
+    deeplearn_distributed_header(learner, dist->message);
+    memcpy(&dist->message[DISTRIBUTED_HEADER], dist->parameters,
+           n*sizeof(float));
+    if (transport->allgather(transport->context, dist->message, raw_bytes,
+                             dist->messages) != 0) {
+        deeplearn_distributed_free(dist);
+        return -3;
+    }
+    memcpy(dist->reference, &dist->messages[DISTRIBUTED_HEADER],
+           n*sizeof(float));
+    deeplearn_distributed_copy(learner, dist->reference, 1);
+
+    dist->message_bytes = DISTRIBUTED_HEADER + deeplearn_delta_packed_size(n);
+    return 0;
+}
+
+/**
+ * @brief Exchanges the pending message with the other nodes.
+ *        This is run on a background thread while training continues
+ * @param arg Distributed trainer object
+ * @returns NULL
+ */
+static void * deeplearn_distributed_exchange(void * arg)
+{
+    deeplearn_distributed * dist = (deeplearn_distributed*)arg;
+    deeplearn_transport * transport = dist->transport;
+
+    dist->status = transport->allgather(transport->context, dist->message,
+                                        dist->message_bytes,
+                                        dist->messages);
+    return NULL;
+}
+
+/**
+ * @brief Performs sync_interval training steps on this node's shard of
+ *        the data with deeplearndata_training. Every node must call this
+ *        the same number of times. The changes which were made during the
+ *        previous call are exchanged with the other nodes while the steps
+ *        are running, and their average is applied afterwards, so the
+ *        weights of each node lag the others by up to one interval
+ * @param dist Distributed trainer object
+ * @returns The value returned by the last deeplearndata_training step,
+ *          or -10 if the exchange failed
+ */
+int deeplearn_distributed_update(deeplearn_distributed * dist)
+{
+    pthread_t thread;
+    int retval = 0, started;
+
+    if (!dist->pending) {
+        COUNTUP(s, dist->sync_interval)
+            retval = deeplearndata_training(dist->learner);
+    }
+    else {
+        /* the exchange runs on its own thread, so that training keeps
+           the usual OpenMP team of the calling thread. If no thread
+           can be started then the exchange is made first, since the
+           other nodes are waiting for it */
+        started = (pthread_create(&thread, NULL,
+                                  deeplearn_distributed_exchange,
+                                  dist) == 0);
+        if (!started)
+            deeplearn_distributed_exchange(dist);
+
+        COUNTUP(s, dist->sync_interval)
+            retval = deeplearndata_training(dist->learner);
+
+        if (started)
+            pthread_join(thread, NULL);
+
+        if (dist->status != 0)
+            return -10;
+
+        deeplearn_distributed_apply(dist);
+    }
+
+    deeplearn_distributed_prepare(dist);
+    return retval;
+}
+
+/**
+ * @brief Frees memory for a distributed trainer. The transport is not
+ *        released
+ * @param dist Distributed trainer object
+ */
+void deeplearn_distributed_free(deeplearn_distributed * dist)
+{
+    free(dist->reference);
+    free(dist->parameters);
+    free(dist->sent);
+    free(dist->received);
+    free(dist->message);
+    free(dist->messages);
+    dist->reference = NULL;
+    dist->parameters = NULL;
+    dist->sent = NULL;
+    dist->received = NULL;
+    dist->message = NULL;
+    dist->messages = NULL;
+}
+
+/* nodes within a single process which exchange messages through
+   shared memory */
+typedef struct {
+    int nodes;
+    int capacity;
+    unsigned char * buffer;
+    int arrived;
+    int generation;
+    int references;
+} local_group;
+
+typedef struct {
+    local_group * group;
+    int rank;
+} local_node;
+
+/**
+ * @brief Waits until every node of a local group has arrived
+ * @param group Local group
+ */
+static void local_group_barrier(local_group * group)
+{
+    int generation, arrived;
+
+#pragma omp atomic read
+    generation = group->generation;
+
+#pragma omp atomic capture
+    arrived = ++group->arrived;
+
+    if (arrived == group->nodes) {
+#pragma omp atomic write
+        group->arrived = 0;
+#pragma omp atomic update
+        group->generation++;
+    }
+    else {
+        int current = generation;
+        while (current == generation) {
+#pragma omp atomic read
+            current = group->generation;
+        }
+    }
+#pragma omp flush
+}
+
+/**
+ * @brief allgather for nodes within a single process
+ */
+static int local_allgather(void * context, const unsigned char * message,
+                           int bytes, unsigned char * messages)
+{
+    local_node * node = (local_node*)context;
+    local_group * group = node->group;
+
+    if (bytes > group->capacity)
+        return -1;
+
+    memcpy(&group->buffer[node->rank*bytes], message, bytes);
+    local_group_barrier(group);
+    memcpy(messages, group->buffer, group->nodes*bytes);
+    local_group_barrier(group);
+    return 0;
+}
+
+/**
+ * @brief Releases a node of a local group, and the group once all of
+ *        its nodes have been released
+ */
+static void local_release(void * context)
+{
+    local_node * node = (local_node*)context;
+    local_group * group = node->group;
+    int references;
+
+#pragma omp atomic capture
+    references = --group->references;
+
+    if (references == 0) {
+        free(group->buffer);
+        free(group);
+    }
+    free(node);
+}
+
+/**
+ * @brief Creates transports for a number of nodes within a single
+ *        process, for example one per processor socket or for testing.
+ *        Each node is trained on its own thread
+ * @param transports Returned array of one transport per node
+ * @param nodes The number of nodes
+ * @param capacity The largest message, see
+ *        deeplearn_distributed_message_size
+ * @returns zero on success
+ */
+int deeplearn_transport_local_init(deeplearn_transport transports[],
+                                   int nodes, int capacity)
+{
+    local_group * group;
+
+    if ((nodes < 1) || (capacity < 1))
+        return -1;
+
+    group = (local_group*)malloc(sizeof(local_group));
+    if (!group)
+        return -2;
+
+    UCHARALLOC(group->buffer, (size_t)nodes*capacity);
+    if (!group->buffer) {
+        free(group);
+        return -3;
+    }
+    group->nodes = nodes;
+    group->capacity = capacity;
+    group->arrived = 0;
+    group->generation = 0;
+    group->references = 0;
+
+    COUNTUP(r, nodes) {
+        local_node * node = (local_node*)malloc(sizeof(local_node));
+        if (!node) {
+            if (group->references == 0) {
+                free(group->buffer);
+                free(group);
+            }
+            else {
+                COUNTUP(i, r)
+                    deeplearn_transport_free(&transports[i]);
+            }
+            return -4;
+        }
+        node->group = group;
+        node->rank = r;
+        group->references++;
+
+        transports[r].context = node;
+        transports[r].rank = r;
+        transports[r].nodes = nodes;
+        transports[r].allgather = local_allgather;
+        transports[r].release = local_release;
+    }
+    return 0;
+}
+
+/* the connections of a node to the others over tcp. The first node
+   connects to every other one, and the others only to the first */
+typedef struct {
+    int rank;
+    int nodes;
+    int * sockets;
+} tcp_node;
+
+/**
+ * @brief Sends the whole of a buffer over a socket
+ * @returns zero on success
+ */
+static int tcp_send_all(int sock, const unsigned char * buffer, size_t bytes)
+{
+    while (bytes > 0) {
+        ssize_t sent = send(sock, buffer, bytes, 0);
+        if (sent <= 0)
+            return -1;
+        buffer += sent;
+        bytes -= (size_t)sent;
+    }
+    return 0;
+}
+
+/**
+ * @brief Receives a buffer of the given size from a socket
+ * @returns zero on success
+ */
+static int tcp_receive_all(int sock, unsigned char * buffer, size_t bytes)
+{
+    while (bytes > 0) {
+        ssize_t received = recv(sock, buffer, bytes, 0);
+        if (received <= 0)
+            return -1;
+        buffer += received;
+        bytes -= (size_t)received;
+    }
+    return 0;
+}
+
+/**
+ * @brief allgather over tcp. The first node collects the messages
+ *        and sends all of them back to every node
+ */
+static int tcp_allgather(void * context, const unsigned char * message,
+                         int bytes, unsigned char * messages)
+{
+    tcp_node * node = (tcp_node*)context;
+
+    if (node->rank != 0) {
+        if (tcp_send_all(node->sockets[0], message, bytes) != 0)
+            return -1;
+        return tcp_receive_all(node->sockets[0], messages,
+                               (size_t)node->nodes*bytes);
+    }
+
+    memcpy(messages, message, bytes);
+    FOR(r, 1, node->nodes) {
+        if (tcp_receive_all(node->sockets[r], &messages[r*bytes],
+                            bytes) != 0)
+            return -1;
+    }
+    FOR(r, 1, node->nodes) {
+        if (tcp_send_all(node->sockets[r], messages,
+                         (size_t)node->nodes*bytes) != 0)
+            return -2;
+    }
+    return 0;
+}
+
+/**
+ * @brief Closes the connections of a tcp node
+ */
+static void tcp_release(void * context)
+{
+    tcp_node * node = (tcp_node*)context;
+
+    COUNTUP(r, node->nodes) {
+        if (node->sockets[r] >= 0)
+            close(node->sockets[r]);
+    }
+    free(node->sockets);
+    free(node);
+}
+
+/**
+ * @brief Accepts connections from every other node on the first node.
+ *        Each node sends its rank once connected
+ * @param node tcp node
+ * @param port Port to listen on
+ * @returns zero on success
+ */
+static int tcp_accept_nodes(tcp_node * node, int port)
+{
+    struct sockaddr_in address;
+    int listener, enable = 1;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0)
+        return -1;
+
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((unsigned short)port);
+
+    if ((bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0) ||
+        (listen(listener, node->nodes) != 0)) {
+        close(listener);
+        return -2;
+    }
+
+    FOR(r, 1, node->nodes) {
+        int rank = -1;
+        int sock = accept(listener, NULL, NULL);
+
+        if (sock < 0) {
+            close(listener);
+            return -3;
+        }
+        if ((tcp_receive_all(sock, (unsigned char*)&rank,
+                             sizeof(int)) != 0) ||
+            (rank < 1) || (rank >= node->nodes) ||
+            (node->sockets[rank] >= 0)) {
+            close(sock);
+            close(listener);
+            return -4;
+        }
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        node->sockets[rank] = sock;
+    }
+
+    close(listener);
+    return 0;
+}
+
+/**
+ * @brief Connects to the first node, retrying until it is listening
+ * @param node tcp node
+ * @param host Host name or address of the first node
+ * @param port Port which the first node listens on
+ * @returns zero on success
+ */
+static int tcp_connect_node(tcp_node * node, const char * host, int port)
+{
+    struct addrinfo hints, * addresses;
+    struct timespec delay;
+    char service[16];
+    int enable = 1;
+
+    delay.tv_sec = 0;
+    delay.tv_nsec = 100000000;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    sprintf(service, "%d", port);
+    if (getaddrinfo(host, service, &hints, &addresses) != 0)
+        return -1;
+
+    COUNTUP(attempt, DEEPLEARN_TCP_CONNECT_ATTEMPTS) {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+
+        if (sock < 0)
+            break;
+
+        if (connect(sock, addresses->ai_addr,
+                    addresses->ai_addrlen) == 0) {
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
+                       &enable, sizeof(enable));
+            freeaddrinfo(addresses);
+            node->sockets[0] = sock;
+            return tcp_send_all(sock, (unsigned char*)&node->rank,
+                                sizeof(int));
+        }
+        close(sock);
+        nanosleep(&delay, NULL);
+    }
+
+    freeaddrinfo(addresses);
+    return -2;
+}
+
+/**
+ * @brief Creates a transport which connects the nodes over tcp.
+ *        The first node listens on the given port and every other node
+ *        connects to it, so this returns once all of the nodes are
+ *        connected
+ * @param transport Returned transport
+ * @param rank Rank of this node, with zero being the first node
+ * @param nodes The number of nodes
+ * @param host Host name or address of the first node
+ * @param port Port which the first node listens on
+ * @returns zero on success
+ */
+int deeplearn_transport_tcp_init(deeplearn_transport * transport,
+                                 int rank, int nodes,
+                                 const char * host, int port)
+{
+    tcp_node * node;
+    int retval;
+
+    if ((nodes < 1) || (rank < 0) || (rank >= nodes))
+        return -1;
+
+    node = (tcp_node*)malloc(sizeof(tcp_node));
+    if (!node)
+        return -2;
+
+    INTALLOC(node->sockets, nodes);
+    if (!node->sockets) {
+        free(node);
+        return -3;
+    }
+    node->rank = rank;
+    node->nodes = nodes;
+    COUNTUP(r, nodes)
+        node->sockets[r] = -1;
+
+    if (rank == 0)
+        retval = tcp_accept_nodes(node, port);
+    else
+        retval = tcp_connect_node(node, host, port);
+
+    if (retval != 0) {
+        tcp_release(node);
+        return -4;
+    }
+
+    transport->context = node;
+    transport->rank = rank;
+    transport->nodes = nodes;
+    transport->allgather = tcp_allgather;
+    transport->release = tcp_release;
+    return 0;
+}
+
+/**
+ * @brief Releases a transport
+ * @param transport The transport
+ */
+void deeplearn_transport_free(deeplearn_transport * transport)
+{
+    if (transport->release != NULL)
+        transport->release(transport->context);
+    transport->context = NULL;
+    transport->release = NULL;
+    transport->allgather = NULL;
+}
@@ -0,0 +1,113 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEEPLEARN_DISTRIBUTED_H
+#define DEEPLEARN_DISTRIBUTED_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <omp.h>
+#include "globals.h"
+#include "deeplearn.h"
+#include "deeplearndata.h"
+
+/* Transport which carries messages between the nodes of a distributed
+   trainer, for example over TCP or MPI.
+   allgather sends a message of the given number of bytes from this node
+   and returns the messages of every node, in order of rank, including
+   its own. Every node calls it with the same number of bytes, and it
+   returns zero on success. It is called from a different thread to the
+   one which is training, so that communication overlaps with compute */
+typedef struct {
+    void * context;
+    int rank;
+    int nodes;
+
+    int (*allgather)(void * context, const unsigned char * message,
+                     int bytes, unsigned char * messages);
+    void (*release)(void * context);
+} deeplearn_transport;
+
+/* Data parallel trainer. Each node trains its own copy of the network
+   on its own shard of the training set, and every sync_interval steps
+   the changes which each node has made to the weights are averaged */
+typedef struct {
+    deeplearn * learner;
+    deeplearn_transport * transport;
+    int sync_interval;
+
+    /* weights and biases of the network and its autocoders */
+    int no_of_parameters;
+
+    /* parameters which every node agreed upon at the last exchange */
+    float * reference;
+
+    /* current parameters of this node */
+    float * parameters;
+
+    /* the change which is being sent, as received by the other nodes */
+    float * sent;
+    float * received;
+
+    /* quantized message from this node, and those from every node */
+    int message_bytes;
+    unsigned char * message;
+    unsigned char * messages;
+
+    /* non-zero if a message is waiting to be exchanged */
+    int pending;
+
+    /* result of the exchange made on the background thread */
+    int status;
+    unsigned int exchanges;
+} deeplearn_distributed;
+
+int deeplearn_delta_packed_size(int n);
+int deeplearn_delta_pack(const float * delta, int n, unsigned char * buffer);
+void deeplearn_delta_unpack(const unsigned char * buffer, int n,
+                            float * delta);
+int deeplearn_distributed_parameters(deeplearn * learner);
+int deeplearn_distributed_message_size(deeplearn * learner);
+int deeplearn_distributed_init(deeplearn_distributed * dist,
+                               deeplearn * learner,
+                               deeplearn_transport * transport,
+                               int sync_interval);
+int deeplearn_distributed_update(deeplearn_distributed * dist);
+void deeplearn_distributed_free(deeplearn_distributed * dist);
+
+int deeplearn_transport_local_init(deeplearn_transport transports[],
+                                   int nodes, int capacity);
+int deeplearn_transport_tcp_init(deeplearn_transport * transport,
+                                 int rank, int nodes,
+                                 const char * host, int port);
+void deeplearn_transport_free(deeplearn_transport * transport);
+
+#endif
@@ -94,6 +94,121 @@ int draw_features(unsigned char img[],
     return 0;
 }
 
+/**
+ * @brief Chooses the features which are closest to an image patch,
+ *        occasionally substituting a random feature or any which are
+ *        as yet unused
+ * @param feature_score Matching score of each feature for the patch
+ * @param no_of_features The number of features
+ * @param feature Array containing the features
+ * @param feature_size The number of values within each feature
+ * @param index Returned indexes of the chosen features
+ * @param closest_matches The number of features to choose
+ * @param random_seed Random number generator seed
+ */
+static void closest_features(float feature_score[], int no_of_features,
+                             float feature[], int feature_size,
+                             int index[], int closest_matches,
+                             unsigned int * random_seed)
+{
+    /* get the N closest feature indexes based upon match scores */
+    COUNTDOWN(fi, closest_matches)
+        index[fi] = (int)(rand_num(random_seed) % no_of_features);
+
+    COUNTUP(match, closest_matches) {
+        float min = 0;
+        float max = 0;
+        if (match > 0)
+            max = feature_score[index[match-1]];
+        COUNTDOWN(f, no_of_features) {
+            if ((max == 0) || (feature_score[f] > max)) {
+                if ((min == 0) || (feature_score[f] < min)) {
+                    min = feature_score[f];
+                    index[match] = f;
+                }
+            }
+        }
+    }
+
+    /* occasionally choose a feature index at random */
+    if (rand_num(random_seed) % 32 < 8) {
+        index[rand_num(random_seed) % closest_matches] =
+            (int)(rand_num(random_seed) % no_of_features);
+    }
+
+    /* use any currently unused features */
+    int index_ctr = 0;
+    COUNTDOWN(f, no_of_features) {
+        float * curr_feature = &feature[f*feature_size];
+        if ((curr_feature[0] == 0) && (curr_feature[2] == 0)) {
+            index[index_ctr] = f;
+            index_ctr++;
+            if (index_ctr >= closest_matches) break;
+        }
+    }
+}
+
+/**
+ * @brief Moves a feature towards an image patch
+ * @param img The image being learned from
+ * @param img_width Width of the image
+ * @param img_depth Depth of the image
+ * @param tx Left of the image patch
+ * @param ty Top of the image patch
+ * @param feature_width Width of the feature
+ * @param curr_feature The feature to be updated
+ * @param match Rank of the feature amongst the closest matches
+ * @param learning_rate Learning rate in the range 0.0 -> 1.0
+ * @param random_seed Random number generator seed
+ */
+static void update_feature(float img[], int img_width, int img_depth,
+                           int tx, int ty, int feature_width,
+                           float curr_feature[], int match,
+                           float learning_rate, unsigned int * random_seed)
+{
+    /* incrementally adjust the feature towards the image */
+    COUNTDOWN(yy, feature_width) {
+        /* pixel index within the image */
+        int n0 = (((ty + yy)*img_width) + tx) * img_depth;
+        /* pixel index within the feature */
+        int n1 = (yy * feature_width) * img_depth;
+        COUNTDOWN(xx, feature_width) {
+            COUNTDOWN(d, img_depth) {
+                /* move towards the image patch */
+                curr_feature[n1+d] +=
+                    (img[n0+d] - curr_feature[n1+d])*learning_rate;
+
+                /* move a little more for the top match */
+                if (match == 0)
+                    curr_feature[n1+d] +=
+                        (img[n0+d] - curr_feature[n1+d])*learning_rate;
+
+                /* move a little more for the top two */
+                if (match < 2)
+                    curr_feature[n1+d] +=
+                        (img[n0+d] - curr_feature[n1+d])*learning_rate;
+
+                /* occasionally modify at random */
+                if (rand_num(random_seed) % 32 < 8) {
+                    if (rand_num(random_seed) % 8 < 4)
+                        curr_feature[n1+d] +=
+                            (img[n0+d] -
+                             curr_feature[n1+d])*learning_rate;
+                    else
+                        curr_feature[n1+d] -=
+                            (img[n0+d] -
+                             curr_feature[n1+d])*learning_rate;
+
+                    curr_feature[n1+d] =
+                        CLIP(curr_feature[n1+d], 0.0f, 1.0f);
+                }
+            }
+            n0 += img_depth;
+            n1 += img_depth;
+        }
+    }
+}
+
 /**
  * @brief Learns a set of features from a given mono input layer
  *        If the initial layer is an image it should be converted to floats
@@ -156,91 +271,16 @@ static float learn_features_mono(float img[],
                             (float)(feature_width*feature_width));
         }
 
-        /* get the N closest feature indexes based upon match scores */
-        int index[closest_matches];
-        COUNTDOWN(fi, closest_matches)
-            index[fi] = (int)(rand_num(random_seed) % no_of_features);
-
-        COUNTUP(match, closest_matches) {
-            float min = 0;
-            float max = 0;
-            if (match > 0)
-                max = feature_score[index[match-1]];
-            COUNTDOWN(f, no_of_features) {
-                if ((max == 0) || (feature_score[f] > max)) {
-                    if ((min == 0) || (feature_score[f] < min)) {
-                        min = feature_score[f];
-                        index[match] = f;
-                    }
-                }
-            }
-        }
-
-        /* occasionally choose a feature index at random */
-        if (rand_num(random_seed) % 32 < 8) {
-            index[rand_num(random_seed) % closest_matches] =
-                (int)(rand_num(random_seed) % no_of_features);
-        }
-
-        /* use any currently unused features */
-        int index_ctr = 0;
-        COUNTDOWN(f, no_of_features) {
-            float * curr_feature =
-                &feature[f*feature_width*feature_width];
-            if ((curr_feature[0] == 0) && (curr_feature[2] == 0)) {
-                index[index_ctr] = f;
-                index_ctr++;
-                if (index_ctr >= closest_matches) break;
-            }
-        }
-
         /* move the closest features towards the image patch */
-        COUNTUP(match, closest_matches) {
-            int curr_index = index[match];
-            float * curr_feature =
-                &feature[curr_index*feature_width*feature_width];
-
-            /* incrementally adjust the feature towards the image */
-            COUNTDOWN(yy, feature_width) {
-                /* pixel index within the image */
-                int n0 = ((ty + yy)*img_width) + tx;
-                /* pixel index within the feature */
-                int n1 = yy * feature_width;
-                COUNTDOWN(xx, feature_width) {
-                    /* move towards the image patch */
-                    curr_feature[n1] +=
-                        (img[n0] - curr_feature[n1])*learning_rate;
-
-                    /* move a little more for the top match */
-                    if (match == 0)
-                        curr_feature[n1] +=
-                            (img[n0] - curr_feature[n1])*learning_rate;
-
-                    /* move a little more for the top two */
-                    if (match < 2)
-                        curr_feature[n1] +=
-                            (img[n0] - curr_feature[n1])*learning_rate;
-
-                    /* occasionally modify at random */
-                    if (rand_num(random_seed) % 32 < 8) {
-                        if (rand_num(random_seed) % 8 < 4)
-                            curr_feature[n1] +=
-                                (img[n0] -
-                                 curr_feature[n1])*learning_rate;
-                        else
-                            curr_feature[n1] -=
-                                (img[n0] -
-                                 curr_feature[n1])*learning_rate;
-
-                        curr_feature[n1] = CLIP(curr_feature[n1], 0.0f, 1.0f);
-                    }
-
-                    n0++;
-                    n1++;
-                }
-
-            }
-        }
+        int index[closest_matches];
+        closest_features(feature_score, no_of_features, feature,
+                         feature_width*feature_width,
+                         index, closest_matches, random_seed);
+
+        COUNTUP(match, closest_matches)
+            update_feature(img, img_width, 1, tx, ty, feature_width,
+                           &feature[index[match]*feature_width*feature_width],
+                           match, learning_rate, random_seed);
     }
 
     return total_match_score/(float)samples;
@@ -321,94 +361,177 @@ float learn_features(float img[],
                             (float)(feature_width*feature_width*img_depth));
         }
 
-        /* get the N closest feature indexes based upon match scores */
+        /* move the closest features towards the image patch */
         int index[closest_matches];
-        COUNTDOWN(fi, closest_matches)
-            index[fi] = (int)(rand_num(random_seed) % no_of_features);
-
-        COUNTUP(match, closest_matches) {
-            float min = 0;
-            float max = 0;
-            if (match > 0)
-                max = feature_score[index[match-1]];
-            COUNTDOWN(f, no_of_features) {
-                if ((max == 0) || (feature_score[f] > max)) {
-                    if ((min == 0) || (feature_score[f] < min)) {
-                        min = feature_score[f];
-                        index[match] = f;
-                    }
-                }
-            }
-        }
+        closest_features(feature_score, no_of_features, feature,
+                         feature_width*feature_width*img_depth,
+                         index, closest_matches, random_seed);
+
+        COUNTUP(match, closest_matches)
+            update_feature(img, img_width, img_depth, tx, ty, feature_width,
+                           &feature[index[match]*feature_width*
+                                    feature_width*img_depth],
+                           match, learning_rate, random_seed);
+    }
 
-        /* occasionally choose a feature index at random */
-        if (rand_num(random_seed) % 32 < 8) {
-            index[rand_num(random_seed) % closest_matches] =
-                (int)(rand_num(random_seed) % no_of_features);
-        }
+    return total_match_score/(float)samples;
+}
 
-        /* use any currently unused features */
-        int index_ctr = 0;
-        COUNTDOWN(f, no_of_features) {
-            float * curr_feature =
-                &feature[f*feature_width*feature_width*img_depth];
-            if ((curr_feature[0] == 0) && (curr_feature[2] == 0)) {
-                index[index_ctr] = f;
-                index_ctr++;
-                if (index_ctr >= closest_matches) break;
-            }
+/**
+ * @brief Learns a set of features from batches of image patches.
+ *        The patches within a batch are scored against every feature
+ *        concurrently, then the features are moved towards each patch in
+ *        turn.  Positions and random number sequences for each patch are
+ *        drawn serially, so the result does not depend upon the number
+ *        of threads.
+ * @param img The image to be learned from with values in the range 0.0 -> 1.0
+ * @param img_width Width of the image
+ * @param img_height Height of the image
+ * @param img_depth Depth of the image
+ * @param feature_width Width if each image patch
+ * @param no_of_features The number of features to be learned
+ * @param feature Array containing the learned features
+ * @param samples The number of samples to take from the image
+ * @param batch_size The number of patches scored together
+ * @param learning_rate Learning rate in the range 0.0 -> 1.0
+ * @param random_seed Random number generator seed
+ * @returns Total matching score, or a negative value if memory could
+ *          not be allocated
+ */
+float learn_features_batch(float img[],
+                           int img_width, int img_height, int img_depth,
+                           int feature_width, int no_of_features,
+                           float feature[],
+                           int samples, int batch_size,
+                           float learning_rate,
+                           unsigned int * random_seed)
+{
+    const int closest_matches = 3;
+    const int patch_stride = 2 + closest_matches;
+    int width = img_width-1-feature_width;
+    int height = img_height-1-feature_width;
+    int row_size = feature_width*img_depth;
+    int feature_size = feature_width*row_size;
+    float total_match_score = 0;
+    float * scores, * norms, * patch_score;
+    int * patch, start = 0, scored;
+    unsigned int * seeds;
+
+    if (batch_size > samples)
+        batch_size = samples;
+    if (batch_size < 1)
+        batch_size = 1;
+
+    FLOATALLOC(scores, batch_size*no_of_features);
+    FLOATALLOC(norms, no_of_features);
+    FLOATALLOC(patch_score, batch_size);
+    /* position and chosen features of each patch */
+    INTALLOC(patch, batch_size*patch_stride);
+    UINTALLOC(seeds, batch_size);
+    if ((!scores) || (!norms) || (!patch_score) || (!patch) || (!seeds)) {
+        free(scores);
+        free(norms);
+        free(patch_score);
+        free(patch);
+        free(seeds);
+        return -1;
+    }
+
+    while (start < samples) {
+        int n = samples - start;
+        if (n > batch_size)
+            n = batch_size;
+
+        COUNTUP(p, n) {
+            patch[p*patch_stride] = rand_num(random_seed) % width;
+            patch[p*patch_stride + 1] = rand_num(random_seed) % height;
+            seeds[p] = rand_num(random_seed);
         }
 
-        /* move the closest features towards the image patch */
-        COUNTUP(match, closest_matches) {
-            int curr_index = index[match];
-            float * curr_feature =
-                &feature[curr_index*feature_width*feature_width*img_depth];
+        /* the compute backend may score the whole batch */
+        scored = (deeplearn_backend_feature_scores(img, img_width, img_depth,
+                                                   feature_width, patch,
+                                                   patch_stride, n,
+                                                   feature, no_of_features,
+                                                   scores) == 0);
+
+        /* squared magnitude of each feature */
+        if (!scored)
+            COUNTUP(f, no_of_features)
+                norms[f] = deeplearn_dot(&feature[f*feature_size],
+                                         &feature[f*feature_size],
+                                         feature_size);
+
+        /* score every feature against each patch, using
+           |a - b|^2 = |a|^2 - 2a.b + |b|^2 so that each row of the
+           patch is a contiguous dot product */
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(n*no_of_features*feature_size))
+        COUNTUP(p, n) {
+            int tx = patch[p*patch_stride];
+            int ty = patch[p*patch_stride + 1];
+            float * feature_score = &scores[p*no_of_features];
+            float patch_norm = 0;
+
+            if (!scored) {
+                COUNTUP(yy, feature_width) {
+                    float * row =
+                        &img[(((ty + yy)*img_width) + tx)*img_depth];
+                    patch_norm += deeplearn_dot(row, row, row_size);
+                }
+            }
 
-            /* incrementally adjust the feature towards the image */
-            COUNTDOWN(yy, feature_width) {
-                /* pixel index within the image */
-                int n0 = (((ty + yy)*img_width) + tx) * img_depth;
-                /* pixel index within the feature */
-                int n1 = (yy * feature_width) * img_depth;
-                COUNTDOWN(xx, feature_width) {
-                    COUNTDOWN(d, img_depth) {
-                        /* move towards the image patch */
-                        curr_feature[n1+d] +=
-                            (img[n0+d] - curr_feature[n1+d])*learning_rate;
-
-                        /* move a little more for the top match */
-                        if (match == 0)
-                            curr_feature[n1+d] +=
-                                (img[n0+d] - curr_feature[n1+d])*learning_rate;
-
-                        /* move a little more for the top two */
-                        if (match < 2)
-                            curr_feature[n1+d] +=
-                                (img[n0+d] - curr_feature[n1+d])*learning_rate;
-
-                        /* occasionally modify at random */
-                        if (rand_num(random_seed) % 32 < 8) {
-                            if (rand_num(random_seed) % 8 < 4)
-                                curr_feature[n1+d] +=
-                                    (img[n0+d] -
-                                     curr_feature[n1+d])*learning_rate;
-                            else
-                                curr_feature[n1+d] -=
-                                    (img[n0+d] -
-                                     curr_feature[n1+d])*learning_rate;
-
-                            curr_feature[n1+d] =
-                                CLIP(curr_feature[n1+d], 0.0f, 1.0f);
-                        }
+            patch_score[p] = 0;
+            COUNTUP(f, no_of_features) {
+                float * curr_feature = &feature[f*feature_size];
+                float product = 0;
+
+                if (!scored) {
+                    COUNTUP(yy, feature_width) {
+                        float * row =
+                            &img[(((ty + yy)*img_width) + tx)*img_depth];
+                        product +=
+                            deeplearn_dot(row, &curr_feature[yy*row_size],
+                                          row_size);
                     }
-                    n0 += img_depth;
-                    n1 += img_depth;
+                    feature_score[f] = patch_norm - (2*product) + norms[f];
                 }
 
+                if (feature_score[f] < 0)
+                    feature_score[f] = 0;
+
+                patch_score[p] +=
+                    (float)sqrt(feature_score[f]/(float)feature_size);
             }
+
+            closest_features(feature_score, no_of_features, feature,
+                             feature_size, &patch[p*patch_stride + 2],
+                             closest_matches, &seeds[p]);
+        }
+
+        /* move the closest features towards each patch in turn */
+        COUNTUP(p, n) {
+            int * index = &patch[p*patch_stride + 2];
+
+            total_match_score += patch_score[p];
+            COUNTUP(match, closest_matches)
+                update_feature(img, img_width, img_depth,
+                               patch[p*patch_stride],
+                               patch[p*patch_stride + 1], feature_width,
+                               &feature[index[match]*feature_size],
+                               match, learning_rate, &seeds[p]);
         }
+        deeplearn_backend_weights_changed(feature);
+
+        start += n;
     }
 
+    free(scores);
+    free(norms);
+    free(patch_score);
+    free(patch);
+    free(seeds);
+
     return total_match_score/(float)samples;
 }
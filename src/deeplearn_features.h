@@ -54,5 +54,12 @@ float learn_features(float img[],
                      int samples,
                      float learning_rate,
                      unsigned int * random_seed);
+float learn_features_batch(float img[],
+                           int img_width, int img_height, int img_depth,
+                           int feature_width, int no_of_features,
+                           float feature[],
+                           int samples, int batch_size,
+                           float learning_rate,
+                           unsigned int * random_seed);
 
 #endif
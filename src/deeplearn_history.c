@@ -30,7 +30,9 @@
 #include "deeplearn_history.h"
 
 /**
- * @brief Initialise a structure containing training history
+ * @brief Initialise a structure containing training history.
+ *        Nothing is allocated until the first value is recorded, and
+ *        the capacity can be changed with deeplearn_history_set_size
  * @param history History instance
  * @param filename The image filename to save the history plot
  * @param title Title of the history plot
@@ -48,15 +50,133 @@ void deeplearn_history_init(deeplearn_history * history,
     history->step = 1;
     history->interval = 10;
     history->no_of_points = 0;
+    history->history = NULL;
+    history->capacity = DEEPLEARN_HISTORY_SIZE;
+    history->dimensions = HISTORY_DIMENSIONS;
 
     sprintf(history->filename,"%s", filename);
     sprintf(history->title,"%s", title);
     sprintf(history->label_horizontal, "%s", label_horizontal);
     sprintf(history->label_vertical, "%s", label_vertical);
+}
+
+/**
+ * @brief Halves the number of steps recorded, keeping every other one,
+ *        so that the history spans the whole of training
+ * @param history History instance
+ */
+static void deeplearn_history_decimate(deeplearn_history * history)
+{
+    int dimensions = history->dimensions;
+
+    COUNTUP(i, history->index)
+        memmove((void*)&history->history[(i/2)*dimensions],
+                (void*)&history->history[i*dimensions],
+                sizeof(float)*dimensions);
+
+    history->index /= 2;
+    history->step *= 2;
+}
+
+/**
+ * @brief Sets the number of steps and the number of values at each step
+ *        which a history can hold. Steps already recorded are kept,
+ *        discarding every other one until they fit
+ * @param history History instance
+ * @param capacity The maximum number of steps, or zero to stop recording
+ *        and free the values
+ * @param dimensions The number of values at each step, in the range
+ *        1 to HISTORY_DIMENSIONS
+ * @returns zero on success
+ */
+int deeplearn_history_set_size(deeplearn_history * history,
+                               int capacity, int dimensions)
+{
+    float * values;
+    int kept = dimensions;
+
+    if ((capacity < 0) || (capacity == 1) ||
+        (dimensions < 1) || (dimensions > HISTORY_DIMENSIONS))
+        return -1;
+
+    if (capacity == 0) {
+        deeplearn_history_free(history);
+        history->index = 0;
+        history->capacity = 0;
+        history->dimensions = dimensions;
+        return 0;
+    }
+
+    if (history->history != NULL) {
+        FLOATALLOC(values, capacity*dimensions);
+        if (!values)
+            return -2;
+        FLOATCLEAR(values, capacity*dimensions);
+
+        while (history->index >= capacity)
+            deeplearn_history_decimate(history);
+
+        if (kept > history->dimensions)
+            kept = history->dimensions;
+
+        COUNTUP(i, history->index)
+            memcpy((void*)&values[i*dimensions],
+                   (void*)&history->history[i*history->dimensions],
+                   sizeof(float)*kept);
+
+        free(history->history);
+        history->history = values;
+    }
+
+    history->capacity = capacity;
+    history->dimensions = dimensions;
+    return 0;
+}
+
+/**
+ * @brief Frees the values recorded within a history
+ * @param history History instance
+ */
+void deeplearn_history_free(deeplearn_history * history)
+{
+    free(history->history);
+    history->history = NULL;
+}
+
+/**
+ * @brief Returns the values of the next step to be recorded,
+ *        allocating the history if this is the first one
+ * @param history History instance
+ * @returns The values of the step, or NULL if nothing is recorded
+ */
+static float * deeplearn_history_next(deeplearn_history * history)
+{
+    if (history->capacity == 0)
+        return NULL;
+
+    if (history->history == NULL) {
+        FLOATALLOC(history->history,
+                   history->capacity*history->dimensions);
+        if (!history->history)
+            return NULL;
+        FLOATCLEAR(history->history,
+                   history->capacity*history->dimensions);
+    }
+
+    return &HISTORY_VALUE(history, history->index, 0);
+}
+
+/**
+ * @brief Moves on to the next step once the values have been recorded
+ * @param history History instance
+ */
+static void deeplearn_history_advance(deeplearn_history * history)
+{
+    history->index++;
+    history->ctr = 0;
 
-    COUNTDOWN(t, DEEPLEARN_HISTORY_SIZE)
-        memset((void*)&history->history[0], '\0',
-               sizeof(float)*HISTORY_DIMENSIONS);
+    if (history->index >= history->capacity)
+        deeplearn_history_decimate(history);
 }
 
 /**
@@ -66,42 +186,39 @@ void deeplearn_history_init(deeplearn_history * history,
  */
 void deeplearn_history_update(deeplearn_history * history, float value)
 {
+    float * values;
+
     history->itterations++;
 
     if (history->step == 0) return;
 
     history->ctr++;
     if (history->ctr >= history->step) {
+        values = deeplearn_history_next(history);
+        if (values == NULL) {
+            history->ctr = 0;
+            return;
+        }
+
         if (value == DEEPLEARN_UNKNOWN_ERROR)
             value = 0;
 
-        history->history[history->index][0] = value;
-
-        history->index++;
-        history->ctr = 0;
-
-        if (history->index >= DEEPLEARN_HISTORY_SIZE) {
-            COUNTUP(i, history->index)
-                memcpy((void*)&history->history[i/2][0],
-                       (void*)&history->history[i][0],
-                       sizeof(float)*HISTORY_DIMENSIONS);
-
-            history->index /= 2;
-            history->step *= 2;
-        }
+        values[0] = value;
+        deeplearn_history_advance(history);
     }
 }
 
 /**
  * @brief Update the history of scores during feature learning
  * @param history History instance
- * @param value The value array to be logged
+ * @param value The value array to be logged, with at least as many
+ *        values as the dimensions of the history
  * @param plot_type The type of plot
  */
 void deeplearn_history_update_from_array(deeplearn_history * history, float value[],
                                          int plot_type)
 {
-    float prev_value;
+    float prev_value, * values;
 
     history->itterations++;
 
@@ -109,35 +226,112 @@ void deeplearn_history_update_from_array(deeplearn_history * history, float valu
 
     history->ctr++;
     if (history->ctr >= history->step) {
+        values = deeplearn_history_next(history);
+        if (values == NULL) {
+            history->ctr = 0;
+            return;
+        }
+
         if (plot_type == PLOT_RUNNING_AVERAGE) {
-            COUNTDOWN(i, HISTORY_DIMENSIONS) {
+            COUNTDOWN(i, history->dimensions) {
                 if (history->index > 0) {
-                    prev_value = history->history[history->index-1][i];
-                    history->history[history->index][i] =
-                        prev_value + ((value[i] - prev_value)*0.02f);
+                    prev_value = values[i - history->dimensions];
+                    values[i] = prev_value + ((value[i] - prev_value)*0.02f);
                 }
                 else
-                    history->history[history->index][i] = value[i];
+                    values[i] = value[i];
             }
         }
         else {
-            memcpy((void*)&history->history[history->index][0],
-                   (void*)&value[0], sizeof(float)*HISTORY_DIMENSIONS);
+            memcpy((void*)values, (void*)&value[0],
+                   sizeof(float)*history->dimensions);
         }
 
-        history->index++;
-        history->ctr = 0;
+        deeplearn_history_advance(history);
+    }
+}
 
-        if (history->index >= DEEPLEARN_HISTORY_SIZE) {
-            COUNTUP(i, history->index)
-                memcpy((void*)&history->history[i/2][0],
-                       (void*)&history->history[i][0],
-                       sizeof(float)*HISTORY_DIMENSIONS);
+/**
+ * @brief Saves a history to file. Only the steps recorded so far are
+ *        saved, rather than the whole capacity
+ * @param fp File pointer
+ * @param history History instance
+ * @returns zero on success
+ */
+int deeplearn_history_save(FILE * fp, deeplearn_history * history)
+{
+    if (UINTWRITE(history->itterations) == 0)
+        return -1;
+    if (UINTWRITE(history->interval) == 0)
+        return -2;
+    if ((WRITEARRAY(history->filename, char, 256) == 0) ||
+        (WRITEARRAY(history->title, char, 256) == 0) ||
+        (WRITEARRAY(history->label_horizontal, char, 256) == 0) ||
+        (WRITEARRAY(history->label_vertical, char, 256) == 0))
+        return -3;
+    if (WRITEVAR(history->no_of_points, char) == 0)
+        return -4;
+    if ((INTWRITE(history->capacity) == 0) ||
+        (INTWRITE(history->dimensions) == 0))
+        return -5;
+    if ((INTWRITE(history->index) == 0) ||
+        (INTWRITE(history->ctr) == 0) ||
+        (INTWRITE(history->step) == 0))
+        return -6;
+    if (history->index > 0) {
+        if (FLOATWRITEARRAY(history->history,
+                            history->index*history->dimensions) == 0)
+            return -7;
+    }
+    return 0;
+}
 
-            history->index /= 2;
-            history->step *= 2;
-        }
+/**
+ * @brief Loads a history from file
+ * @param fp File pointer
+ * @param history History instance, whose values are not yet allocated
+ * @returns zero on success
+ */
+int deeplearn_history_load(FILE * fp, deeplearn_history * history)
+{
+    history->history = NULL;
+
+    if (UINTREAD(history->itterations) == 0)
+        return -1;
+    if (UINTREAD(history->interval) == 0)
+        return -2;
+    if ((READARRAY(history->filename, char, 256) == 0) ||
+        (READARRAY(history->title, char, 256) == 0) ||
+        (READARRAY(history->label_horizontal, char, 256) == 0) ||
+        (READARRAY(history->label_vertical, char, 256) == 0))
+        return -3;
+    history->filename[255] = 0;
+    history->title[255] = 0;
+    history->label_horizontal[255] = 0;
+    history->label_vertical[255] = 0;
+    if (READVAR(history->no_of_points, char) == 0)
+        return -4;
+    if ((INTREAD(history->capacity) == 0) ||
+        (INTREAD(history->dimensions) == 0))
+        return -5;
+    if ((INTREAD(history->index) == 0) ||
+        (INTREAD(history->ctr) == 0) ||
+        (INTREAD(history->step) == 0))
+        return -6;
+    if ((history->capacity < 0) || (history->capacity == 1) ||
+        (history->dimensions < 1) ||
+        (history->dimensions > HISTORY_DIMENSIONS) ||
+        (history->index < 0) || (history->step < 0) ||
+        ((history->index > 0) && (history->index >= history->capacity)))
+        return -7;
+    if (history->index > 0) {
+        if (deeplearn_history_next(history) == NULL)
+            return -8;
+        if (FLOATREADARRAY(history->history,
+                           history->index*history->dimensions) == 0)
+            return -9;
     }
+    return 0;
 }
 
 /**
@@ -181,7 +375,7 @@ int deeplearn_history_gnuplot(deeplearn_history * history,
         return -3;
 
     COUNTUP(index, history->index) {
-        value = history->history[index][0];
+        value = HISTORY_VALUE(history, index, 0);
         fprintf(fp,"%d    %.10f\n",
                 index*history->step,value);
         /* record the maximum error value */
@@ -228,29 +422,35 @@ int deeplearn_history_gnuplot(deeplearn_history * history,
 }
 
 /**
- * @brief Uses phosphene to plot the training error
+ * @brief Uses phosphene to plot the training error, reusing the trace
+ *        buffers of a scope between plots
  * @param history History instance
+ * @param s Scope created with create_scope, whose settings are reset
  * @param img_width Width of the image in pixels
  * @param img_height Height of the image in pixels
  * @return zero on success
  */
-int deeplearn_history_phosphene(deeplearn_history * history,
-                                int img_width, int img_height)
+int deeplearn_history_phosphene_scope(deeplearn_history * history,
+                                      scope * s,
+                                      int img_width, int img_height)
 {
     double value,x,y;
-    scope s;
-    unsigned int t, channel = 0, t2 = 0;
+    unsigned int t, channel = 0, t2 = 0, time_steps;
+    int retval;
     double min_time=9999999;
     double max_time=-9999999;
     double max_voltage = 0.01f;
-    double min_voltage = history->history[0][0];
+    double min_voltage = 0;
     unsigned int grid_horizontal = 20;
     unsigned int grid_vertical = 16;
     unsigned char * img;
 
+    if (history->index > 0)
+        min_voltage = HISTORY_VALUE(history, 0, 0);
+
     if (history->no_of_points == 0) {
         COUNTUP(index, history->index) {
-            value = history->history[index][0];
+            value = HISTORY_VALUE(history, index, 0);
             if (value > max_voltage)
                 max_voltage = value;
             if (value < min_voltage)
@@ -260,11 +460,11 @@ int deeplearn_history_phosphene(deeplearn_history * history,
     else {
         COUNTUP(index, history->index) {
             COUNTUP(p, history->no_of_points) {
-                if (p*2+1 >= HISTORY_DIMENSIONS)
+                if (p*2+1 >= history->dimensions)
                     break;
 
-                x = history->history[index][p*2];
-                y = history->history[index][p*2+1];
+                x = HISTORY_VALUE(history, index, p*2);
+                y = HISTORY_VALUE(history, index, p*2+1);
 
                 if (x > max_time)
                     max_time = x;
@@ -283,44 +483,51 @@ int deeplearn_history_phosphene(deeplearn_history * history,
     min_voltage = min_voltage-(max_voltage*2/100);
     max_voltage = max_voltage*102/100;
 
+    /* one time step per point plotted */
+    scope_reset(s, 1);
+    time_steps = history->index;
+    if (history->no_of_points > 0)
+        time_steps *= history->no_of_points;
+    if (scope_set_time_steps(s, time_steps) != 0)
+        return 2;
+
     UCHARALLOC(img, img_width*img_height*3);
     if (!img)
         return 1;
 
-    create_scope(&s, 1);
     if (history->no_of_points > 0)
-        s.mode = PHOSPHENE_MODE_POINTS;
-    s.offset_ms = 0;
-    s.marker_position = 0;
-    s.time_ms = history->index;
-    s.horizontal_multiplier = (unsigned int)history->step;
+        s->mode = PHOSPHENE_MODE_POINTS;
+    s->offset_ms = 0;
+    s->marker_position = 0;
+    s->time_ms = history->index;
+    s->horizontal_multiplier = (unsigned int)history->step;
 
     if (history->no_of_points == 0) {
         for (t = 0; t < history->index; t++) {
-            scope_update(&s, channel,
-                         history->history[t][0],
+            scope_update(s, channel,
+                         HISTORY_VALUE(history, t, 0),
                          min_voltage, max_voltage, t, 0);
         }
     }
     else {
         for (t = 0; t < history->index; t++) {
             COUNTUP(p, history->no_of_points) {
-                if (p*2+1 >= HISTORY_DIMENSIONS)
+                if (p*2+1 >= history->dimensions)
                     break;
 
-                x = history->history[t][p*2];
-                y = history->history[t][p*2+1];
+                x = HISTORY_VALUE(history, t, p*2);
+                y = HISTORY_VALUE(history, t, p*2+1);
 
-                scope_update(&s, channel, x,
+                scope_update(s, channel, x,
                              min_time, max_time, t2, (unsigned char)p);
-                scope_update(&s, channel+1, y,
+                scope_update(s, channel+1, y,
                              min_voltage, max_voltage, t2, (unsigned char)p);
                 t2++;
             }
         }
     }
 
-    scope_draw_graph(&s, PHOSPHENE_DRAW_ALL, 3, 100,
+    scope_draw_graph(s, PHOSPHENE_DRAW_ALL, 3, 100,
                      grid_horizontal, grid_vertical,
                      img, img_width, img_height,
                      PHOSPHENE_SHAPE_RECTANGULAR,
@@ -328,12 +535,32 @@ int deeplearn_history_phosphene(deeplearn_history * history,
                      history->label_vertical,
                      history->label_horizontal, 25, 4);
 
-    phosphene_write_png_file(history->filename,
-                             img_width, img_height, 24, img);
+    retval = deeplearn_write_png_file(history->filename,
+                                      img_width, img_height, 24, img);
 
     free(img);
 
-    return 0;
+    return retval;
+}
+
+/**
+ * @brief Uses phosphene to plot the training error
+ * @param history History instance
+ * @param img_width Width of the image in pixels
+ * @param img_height Height of the image in pixels
+ * @return zero on success
+ */
+int deeplearn_history_phosphene(deeplearn_history * history,
+                                int img_width, int img_height)
+{
+    scope s;
+    int retval;
+
+    create_scope(&s, 1);
+    retval = deeplearn_history_phosphene_scope(history, &s,
+                                               img_width, img_height);
+    scope_free(&s);
+    return retval;
 }
 
 /**
@@ -352,3 +579,23 @@ int deeplearn_history_plot(deeplearn_history * history,
     return deeplearn_history_phosphene(history, img_width, img_height);
 #endif
 }
+
+/**
+ * @brief Plot the training error to a graph image, reusing the trace
+ *        buffers of a scope between plots
+ * @param history History instance
+ * @param s Scope created with create_scope
+ * @param img_width Width of the image in pixels
+ * @param img_height Height of the image in pixels
+ * @return zero on success
+ */
+int deeplearn_history_plot_scope(deeplearn_history * history, scope * s,
+                                 int img_width, int img_height)
+{
+#ifdef PLOT_WITH_GNUPLOT
+    return deeplearn_history_gnuplot(history, img_width, img_height);
+#else
+    return deeplearn_history_phosphene_scope(history, s,
+                                             img_width, img_height);
+#endif
+}
@@ -36,9 +36,14 @@
 #include <string.h>
 #include "globals.h"
 #include "phosphene.h"
+#include "deeplearn_images.h"
 
+/* the maximum number of values recorded at each step */
 #define HISTORY_DIMENSIONS 16
 
+/* a value recorded within a history */
+#define HISTORY_VALUE(h, i, d) ((h)->history[((i)*(h)->dimensions) + (d)])
+
 /* types of plot */
 enum {
     PLOT_STANDARD = 0,
@@ -57,13 +62,20 @@ typedef struct {
     char label_vertical[256];
     char no_of_points;
 
-    float history[DEEPLEARN_HISTORY_SIZE][HISTORY_DIMENSIONS];
+    /* capacity x dimensions values, which are allocated when the first
+       value is recorded. Once full, every other value is discarded and
+       values are then recorded half as often */
+    float * history;
+    int capacity, dimensions;
     int index, ctr, step;
 } deeplearn_history;
 
 void deeplearn_history_init(deeplearn_history * history,
                             char filename[], char title[],
                             char label_horizontal[], char label_vertical[]);
+int deeplearn_history_set_size(deeplearn_history * history,
+                               int capacity, int dimensions);
+void deeplearn_history_free(deeplearn_history * history);
 void deeplearn_history_update(deeplearn_history * history, float value);
 void deeplearn_history_update_from_array(deeplearn_history * history,
                                          float value[], int plot_type);
@@ -71,7 +83,14 @@ int deeplearn_history_gnuplot(deeplearn_history * history,
                               int img_width, int img_height);
 int deeplearn_history_phosphene(deeplearn_history * history,
                                 int img_width, int img_height);
+int deeplearn_history_phosphene_scope(deeplearn_history * history,
+                                      scope * s,
+                                      int img_width, int img_height);
 int deeplearn_history_plot(deeplearn_history * history,
                            int img_width, int img_height);
+int deeplearn_history_plot_scope(deeplearn_history * history, scope * s,
+                                 int img_width, int img_height);
+int deeplearn_history_save(FILE * fp, deeplearn_history * history);
+int deeplearn_history_load(FILE * fp, deeplearn_history * history);
 
 #endif
@@ -58,6 +58,48 @@ void deeplearn_float_to_img(float float_img[],
     }
 }
 
+/**
+ * @brief Creates a synthetic image by scaling and translating an image
+ *        by a random amount.  Regions outside of the scaled image are black.
+ * @param img Image array
+ * @param image_width Width of the image
+ * @param image_height Height of the image
+ * @param image_depth Depth of the image
+ * @param result_width Width of the synthetic image
+ * @param result_height Height of the synthetic image
+ * @param result_depth Depth of the synthetic image
+ * @param result returned synthetic image
+ * @param random_seed Random number generator seed
+ */
+void image_synth_random(unsigned char img[],
+                        int image_width, int image_height, int image_depth,
+                        int result_width, int result_height, int result_depth,
+                        unsigned char result[],
+                        unsigned int * random_seed)
+{
+    int centre_x, centre_y, x_spare, y_spare;
+    float scale;
+
+    memset(result, 0, result_width*result_height*result_depth);
+
+    /* scaling factor 0.5 -> 1.0 */
+    scale = 0.5f + ((rand_num(random_seed)%100000)/200000.0f);
+
+    /* spare room for translation */
+    x_spare = 1 + (int)((1.0f - scale)*image_width);
+    y_spare = 1 + (int)((1.0f - scale)*image_height);
+
+    /* new centre */
+    centre_x = (image_width/2) - (x_spare/2) +
+        ((int)rand_num(random_seed)%x_spare);
+    centre_y = (image_height/2) - (y_spare/2) +
+        ((int)rand_num(random_seed)%y_spare);
+
+    image_synth(img, image_width, image_height, image_depth,
+                scale, centre_x, centre_y,
+                result_width, result_height, result_depth, result);
+}
+
 /**
  * @brief Reads a PNG file into a buffer
  * @param filename Filename of the image
@@ -89,8 +131,166 @@ int deeplearn_read_png_file(char * filename,
     return 0;
 }
 
+/* how images are written */
+static int image_output = DEEPLEARN_IMAGE_PNG;
+static deeplearn_image_callback image_callback = NULL;
+static void * image_callback_context = NULL;
+
+/**
+ * @brief Sets how images such as plots and feature visualisations are
+ *        written by deeplearn_write_png_file. This applies to the whole
+ *        process
+ * @param format DEEPLEARN_IMAGE_PNG for maximum compression,
+ *        DEEPLEARN_IMAGE_PNG_FAST for quicker and lighter compression,
+ *        DEEPLEARN_IMAGE_PNM for uncompressed PPM/PGM files, or
+ *        DEEPLEARN_IMAGE_CALLBACK to pass images to the callback set
+ *        with deeplearn_set_image_callback
+ * @returns zero on success
+ */
+int deeplearn_set_image_output(int format)
+{
+    if ((format < 0) || (format >= DEEPLEARN_IMAGE_OUTPUTS))
+        return -1;
+
+    if ((format == DEEPLEARN_IMAGE_CALLBACK) && (image_callback == NULL))
+        return -2;
+
+    image_output = format;
+    return 0;
+}
+
+/**
+ * @brief Returns how images are written
+ * @returns One of the DEEPLEARN_IMAGE_ formats
+ */
+int deeplearn_get_image_output(void)
+{
+    return image_output;
+}
+
 /**
- * @brief Saves an image buffer to a PNG formatted image
+ * @brief Passes images to a callback rather than writing them to file,
+ *        so that applications can display them without any encoding
+ * @param callback Function which receives the filename and raw image
+ *        buffer. The buffer is only valid during the call
+ * @param context Passed to the callback
+ * @returns zero on success
+ */
+int deeplearn_set_image_callback(deeplearn_image_callback callback,
+                                 void * context)
+{
+    if (callback == NULL)
+        return -1;
+
+    image_callback = callback;
+    image_callback_context = context;
+    image_output = DEEPLEARN_IMAGE_CALLBACK;
+    return 0;
+}
+
+/**
+ * @brief Encodes a 24 bit image as a PNG with light compression.
+ *        Every row uses the Up filter, which suits plots with large
+ *        areas of colour, and a short LZ77 window is searched
+ * @param filename Filename of the image
+ * @param width Width of the image in pixels
+ * @param height Height of the image in pixels
+ * @param image Image buffer
+ * @returns zero on success, or a lodepng error code
+ */
+static unsigned deeplearn_write_png_fast(char * filename,
+                                         unsigned int width,
+                                         unsigned int height,
+                                         unsigned char image[])
+{
+    LodePNGState state;
+    unsigned char * filters, * png = NULL;
+    size_t png_size = 0;
+    unsigned error;
+
+    UCHARALLOC(filters, height);
+    if (!filters)
+        return 83;
+    memset(filters, 2, height);
+
+    lodepng_state_init(&state);
+    state.info_raw.colortype = LCT_RGB;
+    state.info_raw.bitdepth = 8;
+    state.info_png.color.colortype = LCT_RGB;
+    state.info_png.color.bitdepth = 8;
+    state.encoder.auto_convert = 0;
+    state.encoder.filter_palette_zero = 0;
+    state.encoder.filter_strategy = LFS_PREDEFINED;
+    state.encoder.predefined_filters = filters;
+    state.encoder.zlibsettings.windowsize = 64;
+    state.encoder.zlibsettings.nicematch = 16;
+    state.encoder.zlibsettings.lazymatching = 0;
+
+    error = lodepng_encode(&png, &png_size, image, width, height, &state);
+    if (!error)
+        error = lodepng_save_file(png, png_size, filename);
+
+    free(png);
+    lodepng_state_cleanup(&state);
+    free(filters);
+    return error;
+}
+
+/**
+ * @brief Writes an uncompressed PPM image, or PGM for 8 bit images.
+ *        Any .png extension of the filename is replaced
+ * @param filename Filename of the image
+ * @param width Width of the image in pixels
+ * @param height Height of the image in pixels
+ * @param bitsperpixel Number of bits per pixel
+ * @param buffer Image buffer
+ * @return 0 on success
+ */
+static int deeplearn_write_pnm_file(char * filename,
+                                    unsigned int width, unsigned int height,
+                                    unsigned int bitsperpixel,
+                                    unsigned char buffer[])
+{
+    int length = strlen(filename);
+    int channels = (bitsperpixel == 8) ? 1 : 3;
+    char * pnm_filename;
+    FILE * fp;
+
+    if ((bitsperpixel != 8) && (bitsperpixel != 24) && (bitsperpixel != 32))
+        return -1;
+
+    CHARALLOC(pnm_filename, length + 5);
+    if (!pnm_filename)
+        return -2;
+    strcpy(pnm_filename, filename);
+    if (string_ends_with_extension(filename, "png"))
+        pnm_filename[length-4] = 0;
+    strcat(pnm_filename, (channels == 1) ? ".pgm" : ".ppm");
+
+    fp = fopen(pnm_filename, "wb");
+    free(pnm_filename);
+    if (!fp)
+        return -3;
+
+    fprintf(fp, "P%d\n%u %u\n255\n", (channels == 1) ? 5 : 6,
+            width, height);
+    if (bitsperpixel == 32) {
+        /* the alpha channel is dropped */
+        COUNTUP(i, width*height)
+            fwrite(&buffer[i*4], 1, 3, fp);
+    }
+    else {
+        fwrite(buffer, 1, (size_t)width*height*channels, fp);
+    }
+
+    if (fclose(fp) != 0)
+        return -4;
+    return 0;
+}
+
+/**
+ * @brief Saves an image buffer to a PNG formatted image, or in the
+ *        format set with deeplearn_set_image_output
  * @param filename Filename of the image
  * @param width Width of the image in pixels
  * @param height Height of the image in pixels
@@ -106,11 +306,23 @@ int deeplearn_write_png_file(char * filename,
     unsigned error=1;
     unsigned char * image = buffer;
 
+    if (image_output == DEEPLEARN_IMAGE_CALLBACK)
+        return image_callback(filename, width, height, bitsperpixel,
+                              buffer, image_callback_context);
+
+    if (image_output == DEEPLEARN_IMAGE_PNM)
+        return deeplearn_write_pnm_file(filename, width, height,
+                                        bitsperpixel, buffer);
+
     if (bitsperpixel == 32)
         error = lodepng_encode32_file(filename, image, width, height);
 
-    if (bitsperpixel == 24)
-        error = lodepng_encode24_file(filename, image, width, height);
+    if (bitsperpixel == 24) {
+        if (image_output == DEEPLEARN_IMAGE_PNG_FAST)
+            error = deeplearn_write_png_fast(filename, width, height, image);
+        else
+            error = lodepng_encode24_file(filename, image, width, height);
+    }
 
     if (bitsperpixel == 8) {
         UCHARALLOC(image, width*height*3);
@@ -119,7 +331,12 @@ int deeplearn_write_png_file(char * filename,
                 COUNTDOWN(d, 3)
                     image[i*3+d] = buffer[i];
 
-            error = lodepng_encode24_file(filename, image, width, height);
+            if (image_output == DEEPLEARN_IMAGE_PNG_FAST)
+                error = deeplearn_write_png_fast(filename, width, height,
+                                                 image);
+            else
+                error = lodepng_encode24_file(filename, image, width,
+                                              height);
             free(image);
         }
         else {
@@ -235,10 +452,87 @@ void deeplearn_downsample_colour(unsigned char img[],
     }
 }
 
+/**
+ * @brief Decodes a single training image, downsamples it and creates
+ *        its synthetic variants.  This only touches the given slots
+ *        so that it may be called for several images concurrently.
+ * @param filename Filename of the image
+ * @param images Slots for the image followed by its synthetic images
+ * @param classifications Slots for the classification of each image
+ * @param width Standardised width of the images in pixels
+ * @param height Standardised height of the images in pixels
+ * @param extra_synthetic_images The number of synthetic images to create
+ * @param random_seed Random number generator seed for this image
+ * @return 0 on success, 1 if the image could not be decoded or
+ *         a negative value if memory could not be allocated
+ */
+static int load_training_image(char * filename,
+                               unsigned char ** images,
+                               char ** classifications,
+                               int width, int height,
+                               int extra_synthetic_images,
+                               unsigned int random_seed)
+{
+    unsigned int im_width=0, im_height=0;
+    unsigned int im_bitsperpixel=0;
+    unsigned char * img, * img2;
+
+    /* get the name of the classification */
+    CHARALLOC(classifications[0], 256);
+    if (!classifications[0])
+        return -5;
+    bp_get_classification_from_filename(filename, classifications[0]);
+
+    /* obtain an image from the filename */
+    if (deeplearn_read_png_file(filename,
+                                &im_width, &im_height,
+                                &im_bitsperpixel, &img) != 0)
+        return 1;
+
+    /* create a fixed size image */
+    UCHARALLOC(images[0], width*height);
+    if (!images[0]) {
+        free(img);
+        return -4;
+    }
+
+    deeplearn_downsample_colour_to_mono(img, (int)im_width,
+                                        (int)im_height,
+                                        images[0],
+                                        width, height);
+
+    /* create some synthetic images for the same classification */
+    COUNTUP(s, extra_synthetic_images) {
+        UCHARALLOC(img2, width*height);
+        if (!img2) {
+            free(img);
+            return -6;
+        }
+
+        image_synth_random(img, (int)im_width, (int)im_height,
+                           (int)(im_bitsperpixel/8),
+                           width, height, 1, img2, &random_seed);
+        images[1+s] = img2;
+
+        CHARALLOC(classifications[1+s], 256);
+        if (!classifications[1+s]) {
+            free(img);
+            return -7;
+        }
+        sprintf(classifications[1+s], "%s", classifications[0]);
+    }
+
+    /* free the original image */
+    free(img);
+    return 0;
+}
+
 /**
  * @brief Loads a set of training images and automatically creates
  *        classification descriptions from the filenames and
- *        classification numbers
+ *        classification numbers.  Images are decoded in parallel,
+ *        each with its own random number sequence, so the result
+ *        does not depend upon the number of threads.
  * @param images_directory The directory to search for images
  * @param images Array which will be used to store the images (1 byte/pixel)
  * @param classifications Description of each image, taken from the filename
@@ -256,180 +550,524 @@ int deeplearn_load_training_images(char * images_directory,
                                    int width, int height,
                                    int extra_synthetic_images)
 {
-    int ctr, no_of_images = 0;
+    int ctr, no_of_files = 0, no_of_images = 0, retval = 0;
+    int stride = 1 + extra_synthetic_images;
     struct dirent **namelist;
-    int n, len, centre_x, centre_y, x_spare, y_spare;
-    unsigned int im_width=0, im_height=0;
-    unsigned int im_bitsperpixel=0;
-    unsigned char * img, * img2, * downsampled;
+    int n, len;
     char * extension = "png";
-    char filename[512];
-    char * classification;
+    char ** filenames;
+    int * status;
     unsigned int random_seed = 763528;
-    float scale;
 
     /* how many images are there? */
-    no_of_images = number_of_images(images_directory, extension);
-    if (no_of_images == 0)
+    no_of_files = number_of_images(images_directory, extension);
+    if (no_of_files == 0)
         return 0;
 
-    /* add the total number of synthetic images */
-    no_of_images += (extra_synthetic_images*no_of_images);
+    CHARPTRALLOC(filenames, no_of_files);
+    if (!filenames)
+        return -1;
+
+    /* get image filenames, in the order in which they will be stored */
+    n = scandir(images_directory, &namelist, 0, alphasort);
+    if (n < 0) {
+        free(filenames);
+        return 0;
+    }
+    no_of_files = 0;
+    ctr = n;
+    while (ctr--) {
+        /* is the filename long enough? */
+        len = strlen(namelist[ctr]->d_name);
+        if ((len > 4) && (retval == 0) &&
+            string_ends_with_extension(namelist[ctr]->d_name, extension)) {
+            CHARALLOC(filenames[no_of_files],
+                      strlen(images_directory) + len + 2);
+            if (filenames[no_of_files])
+                sprintf(filenames[no_of_files++], "%s/%s",
+                        images_directory, namelist[ctr]->d_name);
+            else
+                retval = -1;
+        }
+        free(namelist[ctr]);
+    }
+    free(namelist);
+
+    /* each image is followed by its synthetic images */
+    no_of_images = no_of_files*stride;
 
     /* allocate an array for the images */
     UCHARPTRALLOC(*images, no_of_images);
-    if (!images)
-        return -1;
-
     /* allocate memory for the classifications */
     CHARPTRALLOC(*classifications, no_of_images);
-    if (!classifications) {
+    /* allocate memory for the class number assigned to each image */
+    INTALLOC(*classification_number, no_of_images);
+    INTALLOC(status, no_of_files);
+    if ((retval != 0) || (!*images) || (!*classifications) ||
+        (!*classification_number) || (!status)) {
+        COUNTDOWN(i, no_of_files)
+            free(filenames[i]);
+        free(filenames);
+        free(status);
+        free(*classification_number);
+        free(*classifications);
         free(*images);
-        return -2;
+        return -1;
     }
+    memset(*images, 0, no_of_images*sizeof(unsigned char*));
+    memset(*classifications, 0, no_of_images*sizeof(char*));
 
-    /* allocate memory for the class number assigned to each image */
-    INTALLOC(*classification_number, no_of_images);
-    if (!classification_number) {
+#pragma omp parallel for schedule(dynamic) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(no_of_images*width*height))
+    COUNTUP(i, no_of_files) {
+        /* start of the random sequence for this image */
+        unsigned int seed = random_seed;
+        rand_jump(&seed, (unsigned long long)i*extra_synthetic_images*3);
+
+        status[i] = load_training_image(filenames[i],
+                                        &(*images)[i*stride],
+                                        &(*classifications)[i*stride],
+                                        width, height,
+                                        extra_synthetic_images, seed);
+    }
+
+    /* report the first failure in file order */
+    COUNTUP(i, no_of_files) {
+        if (status[i] < 0) {
+            retval = status[i];
+            break;
+        }
+    }
+
+    if (retval != 0) {
+        COUNTDOWN(i, no_of_images) {
+            free((*images)[i]);
+            free((*classifications)[i]);
+        }
+        free(*classification_number);
         free(*classifications);
         free(*images);
-        return -3;
     }
+    else {
+        /* remove the synthetic slots of any images which
+           could not be decoded */
+        no_of_images = 0;
+        COUNTUP(i, no_of_files) {
+            int count = (status[i] == 0) ? stride : 1;
+            COUNTUP(s, count) {
+                (*images)[no_of_images] = (*images)[i*stride + s];
+                (*classifications)[no_of_images] =
+                    (*classifications)[i*stride + s];
+                no_of_images++;
+            }
+        }
+
+        /* assign a class number to each image */
+        bp_classifications_to_numbers(no_of_images,
+                                      *classifications,
+                                      (*classification_number));
+    }
+
+    COUNTDOWN(i, no_of_files)
+        free(filenames[i]);
+    free(filenames);
+    free(status);
+
+    if (retval != 0)
+        return retval;
+    return no_of_images;
+}
+
+/**
+ * @brief Returns a key which changes whenever the images within a
+ *        directory are added, removed or modified
+ * @param images_directory The directory to search for images
+ * @param extension Extension of the image files
+ * @return Hash of the filenames, sizes and modification times
+ */
+static unsigned int training_images_key(char * images_directory,
+                                        char * extension)
+{
+    struct dirent **namelist;
+    struct stat file_status;
+    char filename[512];
+    unsigned int key = 2166136261u;
+    int n, ctr;
 
-    /* get image filenames */
-    no_of_images = 0;
     n = scandir(images_directory, &namelist, 0, alphasort);
-    if (n >= 0) {
-        /* for every filename */
-        ctr = n;
-        while (ctr--) {
-            /* is the filename long enough? */
-            len = strlen(namelist[ctr]->d_name);
-            if (len > 4) {
-                sprintf(filename,"%s/%s",
-                        images_directory,namelist[ctr]->d_name);
-                len = strlen(filename);
-                /* is this a png image? */
-                if (string_ends_with_extension(filename, extension)) {
-                    downsampled = NULL;
-
-                    /* obtain an image from the filename */
-                    if (deeplearn_read_png_file(filename,
-                                                &im_width, &im_height,
-                                                &im_bitsperpixel, &img) == 0) {
-                        /* create a fixed size image */
-                        UCHARALLOC(downsampled, width*height);
-                        if (!downsampled) {
-                            COUNTDOWN(i, no_of_images) {
-                                if ((*images)[i] != NULL)
-                                    free((*images)[i]);
-                            }
-                            free(*classifications);
-                            free(*images);
-                            return -4;
-                        }
+    if (n < 0)
+        return key;
 
-                        deeplearn_downsample_colour_to_mono(img, (int)im_width,
-                                                            (int)im_height,
-                                                            downsampled,
-                                                            width, height);
+    ctr = n;
+    while (ctr--) {
+        if ((strlen(namelist[ctr]->d_name) > 4) &&
+            string_ends_with_extension(namelist[ctr]->d_name, extension)) {
+            unsigned long long properties[2] = { 0, 0 };
+            char * name = namelist[ctr]->d_name;
 
-                        (*images)[no_of_images] = downsampled;
+            sprintf(filename, "%s/%s", images_directory, name);
+            if (stat(filename, &file_status) == 0) {
+                properties[0] = (unsigned long long)file_status.st_size;
+                properties[1] = (unsigned long long)file_status.st_mtime;
+            }
 
-                        /* free the original image */
-                        free(img);
-                    }
-                    else {
-                        (*images)[no_of_images] = NULL;
-                    }
+            /* FNV-1a over the name, size and modification time */
+            COUNTUP(i, strlen(name) + 1) {
+                key ^= (unsigned char)name[i];
+                key *= 16777619u;
+            }
+            COUNTUP(i, sizeof(properties)) {
+                key ^= ((unsigned char*)properties)[i];
+                key *= 16777619u;
+            }
+        }
+        free(namelist[ctr]);
+    }
+    free(namelist);
+    return key;
+}
 
-                    /* allocate memory for the classification */
-                    CHARALLOC(classification, 256);
-                    if (!classification) {
-                        COUNTDOWN(i, no_of_images) {
-                            if ((*images)[i] != NULL)
-                                free((*images)[i]);
-                        }
-                        free(*classifications);
-                        free(*images);
-                        return -5;
-                    }
+/**
+ * @brief Writes a set of loaded training images to a file
+ * @param cache_filename Filename to write
+ * @param header Cache header
+ * @param images Array of images (1 byte/pixel)
+ * @param classifications Description of each image
+ * @param classification_number Class number of each image
+ * @return zero on success
+ */
+static int write_training_images_cache(char * cache_filename,
+                                       int header[],
+                                       unsigned char ** images,
+                                       char ** classifications,
+                                       int * classification_number)
+{
+    FILE * fp;
+    int no_of_images = header[7];
+    int image_size = header[3]*header[4];
+    int slot = 0, offset = 0;
 
-                    /* get the name of the classification */
-                    bp_get_classification_from_filename(filename,
-                                                        classification);
-                    (*classifications)[no_of_images] = classification;
+    fp = fopen(cache_filename, "wb");
+    if (!fp)
+        return -1;
 
-                    no_of_images++;
+    if ((INTWRITEARRAY(header, DEEPLEARN_IMAGE_CACHE_HEADER) !=
+         DEEPLEARN_IMAGE_CACHE_HEADER) ||
+        (INTWRITEARRAY(classification_number, no_of_images) !=
+         no_of_images)) {
+        fclose(fp);
+        return -2;
+    }
 
-                    /* create some synthetic images for the
-                       same classification */
-                    if (downsampled == NULL)
-                        continue;
-
-                    COUNTDOWN(s, extra_synthetic_images) {
-                        UCHARALLOC(img2, width*height);
-                        if (img2 != NULL) {
-                            /* scaling factor 0.5 -> 1.0 */
-                            scale = 0.5f +
-                                ((rand_num(&random_seed)%100000)/200000.0f);
-
-                            /* spare room for translation */
-                            x_spare = 1 + (int)((1.0f - scale)*im_width);
-                            y_spare = 1 + (int)((1.0f - scale)*im_height);
-
-                            /* new centre */
-                            centre_x = (int)(im_width/2) - (x_spare/2) +
-                                ((int)rand_num(&random_seed)%x_spare);
-                            centre_y = (int)(im_height/2) - (y_spare/2) +
-                                ((int)rand_num(&random_seed)%y_spare);
-
-                            image_synth(img, (int)im_width, (int)im_height,
-                                        (int)(im_bitsperpixel/8),
-                                        scale, centre_x, centre_y,
-                                        width, height, 1, img2);
-                            (*images)[no_of_images] = img2;
-                        }
-                        else {
-                            COUNTDOWN(i, no_of_images) {
-                                if ((*images)[i] != NULL)
-                                    free((*images)[i]);
-                            }
-                            free(*classifications);
-                            free(*images);
-                            return -6;
-                        }
+    /* position of each image within the pixel block */
+    COUNTUP(i, no_of_images) {
+        int index = -1;
+        if (images[i] != NULL)
+            index = slot++;
+        if (INTWRITEARRAY(&index, 1) != 1) {
+            fclose(fp);
+            return -3;
+        }
+    }
 
-                        CHARALLOC(classification, 256);
-                        if (!classification) {
-                            COUNTDOWN(i, no_of_images+1) {
-                                if ((*images)[i] != NULL)
-                                    free((*images)[i]);
-                            }
-                            free(*classifications);
-                            free(*images);
-                            return -7;
-                        }
+    /* position of each classification within the text pool */
+    COUNTUP(i, no_of_images) {
+        if (INTWRITEARRAY(&offset, 1) != 1) {
+            fclose(fp);
+            return -4;
+        }
+        offset += strlen(classifications[i]) + 1;
+    }
 
-                        (*classifications)[no_of_images] = classification;
+    COUNTUP(i, no_of_images) {
+        if (images[i] == NULL)
+            continue;
+        if (WRITEARRAY(images[i], unsigned char, image_size) !=
+            (size_t)image_size) {
+            fclose(fp);
+            return -5;
+        }
+    }
 
-                        no_of_images++;
-                    }
-                }
-            }
-            free(namelist[ctr]);
+    COUNTUP(i, no_of_images) {
+        if (WRITEARRAY(classifications[i], char,
+                       strlen(classifications[i]) + 1) !=
+            strlen(classifications[i]) + 1) {
+            fclose(fp);
+            return -6;
         }
-        free(namelist);
     }
 
-    /* assign a class number to each image */
-    bp_classifications_to_numbers(no_of_images,
-                                  *classifications,
-                                  (*classification_number));
+    if (fclose(fp) != 0)
+        return -7;
+
+    return 0;
+}
+
+/**
+ * @brief Saves a set of loaded training images to a cache file.
+ *        The cache may be mapped by another process, and rewriting it
+ *        in place would change or truncate the pages beneath that
+ *        mapping, so a temporary file is written and renamed over it
+ * @param cache_filename Filename of the cache
+ * @param header Cache header
+ * @param images Array of images (1 byte/pixel)
+ * @param classifications Description of each image
+ * @param classification_number Class number of each image
+ * @return zero on success
+ */
+static int save_training_images_cache(char * cache_filename,
+                                      int header[],
+                                      unsigned char ** images,
+                                      char ** classifications,
+                                      int * classification_number)
+{
+    char * temp_filename;
+    int retval;
+
+    CHARALLOC(temp_filename, strlen(cache_filename) + 5);
+    if (!temp_filename)
+        return -8;
+
+    sprintf(temp_filename, "%s.tmp", cache_filename);
+    retval = write_training_images_cache(temp_filename, header, images,
+                                         classifications,
+                                         classification_number);
+    if ((retval == 0) && (rename(temp_filename, cache_filename) != 0))
+        retval = -9;
+
+    if (retval != 0)
+        remove(temp_filename);
+    free(temp_filename);
+    return retval;
+}
+
+/**
+ * @brief Maps a cache of training images into memory
+ * @param cache_filename Filename of the cache
+ * @param expected Expected cache header, ignoring the number of images
+ *        and length of the text pool
+ * @param images Returned array of pointers to each image
+ * @param classifications Returned array of pointers to each description
+ * @param classification_number Returned class number of each image
+ * @param map Returned mapping of the cache file
+ * @param map_length Returned length of the mapping
+ * @return The number of images or a negative value if the cache is
+ *         missing or out of date
+ */
+static int map_training_images_cache(char * cache_filename,
+                                     int expected[],
+                                     unsigned char *** images,
+                                     char *** classifications,
+                                     int ** classification_number,
+                                     void ** map, size_t * map_length)
+{
+    int fd, no_of_images, slots = 0;
+    size_t image_size, expected_length;
+    struct stat file_status;
+    int * header, * image_slot, * text_offset;
+    unsigned char * pixels;
+    char * text_pool;
+
+    fd = open(cache_filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if ((fstat(fd, &file_status) != 0) ||
+        (file_status.st_size <
+         (off_t)(DEEPLEARN_IMAGE_CACHE_HEADER*sizeof(int)))) {
+        close(fd);
+        return -2;
+    }
+
+    *map_length = (size_t)file_status.st_size;
+    *map = mmap(0, *map_length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (*map == MAP_FAILED) {
+        *map = NULL;
+        return -3;
+    }
+
+    header = (int*)*map;
+    no_of_images = header[7];
+    COUNTUP(i, 7) {
+        if (header[i] != expected[i]) {
+            munmap(*map, *map_length);
+            *map = NULL;
+            return -4;
+        }
+    }
+
+    /* check that every section is present */
+    image_size = (size_t)header[3]*header[4];
+    image_slot = &header[DEEPLEARN_IMAGE_CACHE_HEADER + no_of_images];
+    text_offset = &image_slot[no_of_images];
+    expected_length =
+        (DEEPLEARN_IMAGE_CACHE_HEADER + (size_t)no_of_images*3)*sizeof(int);
+    if ((no_of_images < 1) || (header[8] < 0) ||
+        (*map_length < expected_length)) {
+        munmap(*map, *map_length);
+        *map = NULL;
+        return -5;
+    }
+    COUNTUP(i, no_of_images) {
+        if (image_slot[i] >= 0)
+            slots++;
+    }
+    expected_length += slots*image_size + header[8];
+    if (*map_length < expected_length) {
+        munmap(*map, *map_length);
+        *map = NULL;
+        return -6;
+    }
+    pixels = (unsigned char*)&text_offset[no_of_images];
+    text_pool = (char*)&pixels[slots*image_size];
+
+    /* every description should be terminated within the text pool */
+    COUNTUP(i, no_of_images) {
+        if ((text_offset[i] < 0) || (text_offset[i] >= header[8]) ||
+            (text_pool[header[8]-1] != 0)) {
+            munmap(*map, *map_length);
+            *map = NULL;
+            return -7;
+        }
+    }
+
+    UCHARPTRALLOC(*images, no_of_images);
+    CHARPTRALLOC(*classifications, no_of_images);
+    INTALLOC(*classification_number, no_of_images);
+    if ((!*images) || (!*classifications) || (!*classification_number)) {
+        free(*images);
+        free(*classifications);
+        free(*classification_number);
+        munmap(*map, *map_length);
+        *map = NULL;
+        return -8;
+    }
+
+    memcpy(*classification_number, &header[DEEPLEARN_IMAGE_CACHE_HEADER],
+           no_of_images*sizeof(int));
+    COUNTUP(i, no_of_images) {
+        (*images)[i] = NULL;
+        if ((image_slot[i] >= 0) && (image_slot[i] < slots))
+            (*images)[i] = &pixels[image_slot[i]*image_size];
+        (*classifications)[i] = &text_pool[text_offset[i]];
+    }
 
     return no_of_images;
 }
 
+/**
+ * @brief Loads a set of training images, as deeplearn_load_training_images,
+ *        using a cache file so that the images only need to be decoded
+ *        once.  If the cache exists and matches the directory contents
+ *        and image size then it is mapped into memory, otherwise the
+ *        images are loaded and the cache is written.
+ * @param images_directory The directory to search for images
+ * @param cache_filename Filename of the cache, or NULL for no cache
+ * @param images Array which will be used to store the images (1 byte/pixel)
+ * @param classifications Description of each image, taken from the filename
+ * @param classification_number Class number of each image
+ * @param width Standardised width of the images in pixels
+ * @param height Standardised height of the images in pixels
+ * @param extra_synthetic_images The number of extra synthetic images
+ *        to generate for each loaded image
+ * @param map Returned mapping of the cache file, or NULL if the images
+ *        were loaded from the directory
+ * @param map_length Returned length of the mapping
+ * @return The number of images loaded
+ */
+int deeplearn_load_training_images_cached(char * images_directory,
+                                          char * cache_filename,
+                                          unsigned char *** images,
+                                          char *** classifications,
+                                          int ** classification_number,
+                                          int width, int height,
+                                          int extra_synthetic_images,
+                                          void ** map, size_t * map_length)
+{
+    int header[DEEPLEARN_IMAGE_CACHE_HEADER];
+    int no_of_images;
+
+    *map = NULL;
+    *map_length = 0;
+
+    if (cache_filename == NULL)
+        return deeplearn_load_training_images(images_directory, images,
+                                              classifications,
+                                              classification_number,
+                                              width, height,
+                                              extra_synthetic_images);
+
+    header[0] = DEEPLEARN_IMAGE_CACHE_MAGIC;
+    header[1] = DEEPLEARN_IMAGE_CACHE_VERSION;
+    header[2] = (int)training_images_key(images_directory, "png");
+    header[3] = width;
+    header[4] = height;
+    header[5] = 1;
+    header[6] = extra_synthetic_images;
+
+    no_of_images =
+        map_training_images_cache(cache_filename, header, images,
+                                  classifications, classification_number,
+                                  map, map_length);
+    if (no_of_images > 0)
+        return no_of_images;
+
+    no_of_images =
+        deeplearn_load_training_images(images_directory, images,
+                                       classifications,
+                                       classification_number,
+                                       width, height,
+                                       extra_synthetic_images);
+    if (no_of_images <= 0)
+        return no_of_images;
+
+    /* the cache is only an optimisation, so failing to
+       write it is not an error */
+    header[7] = no_of_images;
+    header[8] = 0;
+    COUNTUP(i, no_of_images)
+        header[8] += strlen((*classifications)[i]) + 1;
+    if (save_training_images_cache(cache_filename, header, *images,
+                                   *classifications,
+                                   *classification_number) != 0)
+        remove(cache_filename);
+
+    return no_of_images;
+}
+
+/**
+ * @brief Frees a set of training images
+ * @param images Array of images
+ * @param classifications Description of each image
+ * @param classification_number Class number of each image
+ * @param no_of_images The number of images
+ * @param map Mapping of the cache file containing the images, or NULL
+ * @param map_length Length of the mapping
+ */
+void deeplearn_free_training_images(unsigned char ** images,
+                                    char ** classifications,
+                                    int * classification_number,
+                                    int no_of_images,
+                                    void * map, size_t map_length)
+{
+    if (map == NULL) {
+        COUNTDOWN(i, no_of_images) {
+            if (images[i] != NULL)
+                free(images[i]);
+            free(classifications[i]);
+        }
+    }
+    else {
+        munmap(map, map_length);
+    }
+    free(images);
+    free(classifications);
+    free(classification_number);
+}
+
 /**
  * @brief Plots a number of mono images within a single image
  * @param images Array of images (1 byte per pixel)
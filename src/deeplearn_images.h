@@ -41,11 +41,23 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "lodepng.h"
 #include "backprop.h"
 #include "utils.h"
 
+/* receives images instead of them being written to file, see
+   deeplearn_set_image_callback */
+typedef int (*deeplearn_image_callback)(char * filename,
+                                        unsigned int width,
+                                        unsigned int height,
+                                        unsigned int bitsperpixel,
+                                        unsigned char buffer[],
+                                        void * context);
+
 int deeplearn_read_png_file(char * filename,
                             unsigned int * width,
                             unsigned int * height,
@@ -55,12 +67,29 @@ int deeplearn_write_png_file(char * filename,
                              unsigned int width, unsigned int height,
                              unsigned int bitsperpixel,
                              unsigned char buffer[]);
+int deeplearn_set_image_output(int format);
+int deeplearn_get_image_output(void);
+int deeplearn_set_image_callback(deeplearn_image_callback callback,
+                                 void * context);
 int deeplearn_load_training_images(char * images_directory,
                                    unsigned char *** images,
                                    char *** classifications,
                                    int ** classification_number,
                                    int width, int height,
                                    int extra_synthetic_images);
+int deeplearn_load_training_images_cached(char * images_directory,
+                                          char * cache_filename,
+                                          unsigned char *** images,
+                                          char *** classifications,
+                                          int ** classification_number,
+                                          int width, int height,
+                                          int extra_synthetic_images,
+                                          void ** map, size_t * map_length);
+void deeplearn_free_training_images(unsigned char ** images,
+                                    char ** classifications,
+                                    int * classification_number,
+                                    int no_of_images,
+                                    void * map, size_t map_length);
 void bp_plot_images(unsigned char **images,
                     int no_of_images,
                     int image_width, int image_height,
@@ -90,5 +119,10 @@ void image_synth(unsigned char img[],
                  float scale, int centre_x, int centre_y,
                  int result_width, int result_height, int result_depth,
                  unsigned char result[]);
+void image_synth_random(unsigned char img[],
+                        int image_width, int image_height, int image_depth,
+                        int result_width, int result_height, int result_depth,
+                        unsigned char result[],
+                        unsigned int * random_seed);
 
 #endif
@@ -0,0 +1,1005 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* shared memory is not part of c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include "deeplearn_inference.h"
+
+/**
+ * @brief Allocates the layer sizes, activation functions, field lengths
+ *        and the pointers into the blobs of a model, once its number of
+ *        layers and fields are known
+ * @param model Compiled model
+ * @returns zero on success
+ */
+static int deeplearn_inference_alloc(deeplearn_inference * model)
+{
+    const int no_of_layers = model->no_of_layers;
+    int * meta;
+
+    model->mapping = 0;
+    model->mapping_length = 0;
+    model->blob = 0;
+    model->quantized_blob = 0;
+    model->quantized_weights = 0;
+    model->weight_scale = 0;
+
+    meta = (int*)malloc(((no_of_layers*3) + model->no_of_input_fields + 1)*
+                        sizeof(int));
+    if (!meta)
+        return -1;
+    model->layer_units = meta;
+    model->layer_inputs = &meta[no_of_layers];
+    model->activation = &meta[no_of_layers*2];
+    model->field_length = &meta[no_of_layers*3];
+
+    model->weights = (float**)malloc(no_of_layers*2*sizeof(float*));
+    if (!model->weights) {
+        free(meta);
+        return -2;
+    }
+    model->bias = &model->weights[no_of_layers];
+
+    if (model->quantized != 0) {
+        model->quantized_weights =
+            (signed char**)malloc(no_of_layers*sizeof(signed char*));
+        if (!model->quantized_weights) {
+            free(model->weights);
+            free(meta);
+            return -3;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Points the weights, biases and ranges of a model into its blobs.
+ *        The blobs have the same layout in memory and within a model file
+ * @param model Compiled model with its layer sizes set
+ */
+static void deeplearn_inference_layout(deeplearn_inference * model)
+{
+    int pos = 0, quantized_pos = 0;
+
+    if (model->quantized != 0) {
+        model->weight_scale = &model->blob[pos];
+        pos += model->no_of_layers;
+    }
+
+    COUNTUP(l, model->no_of_layers) {
+        int no_of_weights = model->layer_units[l]*model->layer_inputs[l];
+
+        if (model->quantized == 0) {
+            model->weights[l] = &model->blob[pos];
+            pos += no_of_weights;
+        }
+        else {
+            model->weights[l] = 0;
+            model->quantized_weights[l] =
+                &model->quantized_blob[quantized_pos];
+            quantized_pos += no_of_weights;
+        }
+
+        model->bias[l] = &model->blob[pos];
+        pos += model->layer_units[l];
+    }
+
+    model->input_range_min = &model->blob[pos];
+    pos += model->no_of_inputs;
+    model->input_range_max = &model->blob[pos];
+    pos += model->no_of_inputs;
+    model->output_range_min = &model->blob[pos];
+    pos += model->no_of_outputs;
+    model->output_range_max = &model->blob[pos];
+}
+
+/**
+ * @brief Compiles a trained deep learner into a compact, read-only model
+ * @param learner Deep learner object
+ * @param model The compiled model to be created
+ * @param quantized Non-zero if the weights are to be quantized to 8 bits
+ * @returns zero on success
+ */
+static int deeplearn_compile(deeplearn * learner,
+                             deeplearn_inference * model,
+                             int quantized)
+{
+    bp * net = learner->net;
+    int no_of_layers = net->hidden_layers+1;
+    int no_of_fields = learner->no_of_input_fields;
+    int blob_length = 0, quantized_blob_length = 0;
+
+    model->no_of_inputs = net->no_of_inputs;
+    model->no_of_outputs = net->no_of_outputs;
+    model->no_of_layers = no_of_layers;
+    model->no_of_input_fields = no_of_fields;
+    model->quantized = quantized;
+    model->max_units = 0;
+
+    COUNTUP(l, no_of_layers) {
+        bp_layer * layer = &net->layers[l];
+        int no_of_weights = layer->no_of_units*layer->no_of_inputs;
+
+        if (quantized == 0)
+            blob_length += no_of_weights;
+        else
+            quantized_blob_length += no_of_weights;
+        blob_length += layer->no_of_units;
+
+        if (layer->no_of_units > model->max_units)
+            model->max_units = layer->no_of_units;
+    }
+    blob_length += (net->no_of_inputs + net->no_of_outputs)*2;
+    if (quantized != 0)
+        blob_length += no_of_layers;
+
+    /* layer sizes, activation functions and field lengths */
+    if (deeplearn_inference_alloc(model) != 0)
+        return -1;
+
+    FLOATALLOC(model->blob, blob_length);
+    if (!model->blob) {
+        deeplearn_inference_free(model);
+        return -3;
+    }
+    model->blob_length = blob_length;
+
+    model->quantized_blob_length = quantized_blob_length;
+    if (quantized != 0) {
+        model->quantized_blob =
+            (signed char*)malloc(quantized_blob_length*sizeof(signed char));
+        if (!model->quantized_blob) {
+            deeplearn_inference_free(model);
+            return -4;
+        }
+    }
+
+    COUNTUP(l, no_of_layers) {
+        bp_layer * layer = &net->layers[l];
+
+        model->layer_units[l] = layer->no_of_units;
+        model->layer_inputs[l] = layer->no_of_inputs;
+        model->activation[l] = layer->activation;
+    }
+    deeplearn_inference_layout(model);
+
+    COUNTUP(l, no_of_layers) {
+        bp_layer * layer = &net->layers[l];
+        int no_of_weights = layer->no_of_units*layer->no_of_inputs;
+
+        if (quantized == 0)
+            memcpy((void*)model->weights[l], (void*)layer->weights,
+                   no_of_weights*sizeof(float));
+        else
+            bp_quantize_layer(net, l, model->quantized_weights[l],
+                              &model->weight_scale[l]);
+
+        COUNTDOWN(i, layer->no_of_units)
+            model->bias[l][i] = layer->units[i].bias;
+    }
+
+    COUNTDOWN(i, no_of_fields)
+        model->field_length[i] = learner->field_length[i];
+
+    memcpy((void*)model->input_range_min, (void*)learner->input_range_min,
+           net->no_of_inputs*sizeof(float));
+    memcpy((void*)model->input_range_max, (void*)learner->input_range_max,
+           net->no_of_inputs*sizeof(float));
+    memcpy((void*)model->output_range_min, (void*)learner->output_range_min,
+           net->no_of_outputs*sizeof(float));
+    memcpy((void*)model->output_range_max, (void*)learner->output_range_max,
+           net->no_of_outputs*sizeof(float));
+
+    return 0;
+}
+
+/**
+ * @brief Compiles a trained deep learner into a compact, read-only model
+ *        which only supports the forward pass. Training state such as
+ *        previous weight changes, errors and autocoders is not copied.
+ *        The learner can be freed afterwards
+ * @param learner Deep learner object
+ * @param model The compiled model to be created
+ * @returns zero on success
+ */
+int deeplearn_compile_inference(deeplearn * learner,
+                                deeplearn_inference * model)
+{
+    return deeplearn_compile(learner, model, 0);
+}
+
+/**
+ * @brief Compiles a trained deep learner into a read-only model with
+ *        8 bit integer weights and a scale for each layer. The weights
+ *        take a quarter of the memory of the floating point model
+ * @param learner Deep learner object
+ * @param model The compiled model to be created
+ * @returns zero on success
+ */
+int deeplearn_compile_inference_int8(deeplearn * learner,
+                                     deeplearn_inference * model)
+{
+    return deeplearn_compile(learner, model, 1);
+}
+
+/**
+ * @brief Frees memory for a compiled model
+ * @param model Compiled model
+ */
+void deeplearn_inference_free(deeplearn_inference * model)
+{
+    if (model->mapping != 0) {
+        munmap(model->mapping, model->mapping_length);
+    }
+    else {
+        free(model->blob);
+        free(model->quantized_blob);
+    }
+    free(model->weights);
+    free(model->layer_units);
+    free(model->quantized_weights);
+    model->mapping = 0;
+    model->blob = 0;
+    model->quantized_blob = 0;
+    model->weights = 0;
+    model->layer_units = 0;
+    model->quantized_weights = 0;
+}
+
+/**
+ * @brief Returns the FNV-1a hash of an area of memory
+ * @param data The memory
+ * @param length Length in bytes
+ * @returns The hash
+ */
+static unsigned int deeplearn_model_checksum(const unsigned char * data,
+                                             size_t length)
+{
+    unsigned int hash = 2166136261u;
+
+    COUNTUP(i, length) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Returns an offset rounded up to a multiple of
+ *        DEEPLEARN_MODEL_ALIGN
+ * @param offset The offset in bytes
+ * @return Aligned offset
+ */
+static int deeplearn_model_align(int offset)
+{
+    return (offset + DEEPLEARN_MODEL_ALIGN - 1) /
+        DEEPLEARN_MODEL_ALIGN * DEEPLEARN_MODEL_ALIGN;
+}
+
+/**
+ * @brief Fills in the header of a model file for a compiled model
+ * @param model Compiled model
+ * @param header The returned header
+ */
+static void deeplearn_model_header_init(const deeplearn_inference * model,
+                                        deeplearn_model_header * header)
+{
+    int meta_length =
+        ((model->no_of_layers*3) + model->no_of_input_fields)*sizeof(int);
+
+    memset(header, 0, sizeof(deeplearn_model_header));
+    header->magic = DEEPLEARN_MODEL_MAGIC;
+    header->byte_order = DEEPLEARN_MODEL_BYTE_ORDER;
+    header->version = DEEPLEARN_MODEL_VERSION;
+    header->no_of_inputs = model->no_of_inputs;
+    header->no_of_outputs = model->no_of_outputs;
+    header->no_of_layers = model->no_of_layers;
+    header->no_of_input_fields = model->no_of_input_fields;
+    header->quantized = model->quantized;
+    header->max_units = model->max_units;
+    header->blob_length = model->blob_length;
+    header->quantized_blob_length =
+        (model->quantized != 0) ? model->quantized_blob_length : 0;
+
+    header->meta_offset = sizeof(deeplearn_model_header);
+    header->blob_offset =
+        deeplearn_model_align(header->meta_offset + meta_length);
+    header->quantized_offset =
+        deeplearn_model_align(header->blob_offset +
+                              header->blob_length*sizeof(float));
+    header->checksum_offset =
+        deeplearn_model_align(header->quantized_offset +
+                              header->quantized_blob_length);
+}
+
+/**
+ * @brief Builds the image of a compiled model which is saved to file
+ *        or shared memory, ending with its checksum
+ * @param model Compiled model
+ * @param header The returned header of the image
+ * @returns The image, of header.checksum_offset plus the checksum bytes
+ */
+static unsigned char * deeplearn_model_image(const deeplearn_inference * model,
+                                             deeplearn_model_header * header)
+{
+    unsigned char * image;
+    unsigned int checksum;
+
+    deeplearn_model_header_init(model, header);
+
+    image = (unsigned char*)calloc(header->checksum_offset +
+                                   sizeof(unsigned int), 1);
+    if (!image)
+        return NULL;
+
+    memcpy(image, header, sizeof(deeplearn_model_header));
+    memcpy(&image[header->meta_offset], model->layer_units,
+           model->no_of_layers*sizeof(int));
+    memcpy(&image[header->meta_offset + model->no_of_layers*sizeof(int)],
+           model->layer_inputs, model->no_of_layers*sizeof(int));
+    memcpy(&image[header->meta_offset + model->no_of_layers*2*sizeof(int)],
+           model->activation, model->no_of_layers*sizeof(int));
+    memcpy(&image[header->meta_offset + model->no_of_layers*3*sizeof(int)],
+           model->field_length, model->no_of_input_fields*sizeof(int));
+    memcpy(&image[header->blob_offset], model->blob,
+           header->blob_length*sizeof(float));
+    if (header->quantized_blob_length > 0)
+        memcpy(&image[header->quantized_offset], model->quantized_blob,
+               header->quantized_blob_length);
+    checksum = deeplearn_model_checksum(image, header->checksum_offset);
+    memcpy(&image[header->checksum_offset], &checksum, sizeof(unsigned int));
+    return image;
+}
+
+/**
+ * @brief Saves a compiled model as a single contiguous image, which can
+ *        be loaded with deeplearn_inference_map without copying
+ * @param model Compiled model
+ * @param filename Filename to save as
+ * @returns zero on success
+ */
+int deeplearn_inference_save(const deeplearn_inference * model,
+                             char * filename)
+{
+    deeplearn_model_header header;
+    unsigned char * image;
+    size_t length;
+    FILE * fp;
+    int retval = 0;
+
+    /* the image is built in memory and written at once */
+    image = deeplearn_model_image(model, &header);
+    if (!image)
+        return -1;
+    length = header.checksum_offset + sizeof(unsigned int);
+
+    fp = fopen(filename, "wb");
+    if (!fp) {
+        free(image);
+        return -2;
+    }
+
+    if (fwrite(image, 1, length, fp) != length)
+        retval = -3;
+
+    fclose(fp);
+    free(image);
+    return retval;
+}
+
+/**
+ * @brief Checks that the layers of a model loaded from file are valid,
+ *        that each one takes the outputs of the one before it,
+ *        and that they account for the whole of its blobs
+ * @param model Model with its layer sizes and blob lengths set
+ * @returns zero if the layers are valid
+ */
+static int deeplearn_model_check_layers(const deeplearn_inference * model)
+{
+    int blob_length = (model->no_of_inputs + model->no_of_outputs)*2;
+    int quantized_blob_length = 0, max_units = 0;
+    int last = model->no_of_layers - 1;
+
+    if ((model->no_of_inputs < 1) || (model->no_of_outputs < 1) ||
+        (model->no_of_layers < 1))
+        return -1;
+
+    if ((model->layer_inputs[0] != model->no_of_inputs) ||
+        (model->layer_units[last] != model->no_of_outputs))
+        return -1;
+
+    if (model->quantized != 0)
+        blob_length += model->no_of_layers;
+
+    COUNTUP(l, model->no_of_layers) {
+        int no_of_weights = model->layer_units[l]*model->layer_inputs[l];
+
+        if ((model->layer_units[l] < 1) || (model->layer_inputs[l] < 1) ||
+            (!activation_valid(model->activation[l])))
+            return -1;
+
+        if ((l > 0) && (model->layer_inputs[l] != model->layer_units[l-1]))
+            return -1;
+
+        if (model->quantized == 0)
+            blob_length += no_of_weights;
+        else
+            quantized_blob_length += no_of_weights;
+        blob_length += model->layer_units[l];
+
+        if (model->layer_units[l] > max_units)
+            max_units = model->layer_units[l];
+    }
+
+    if ((blob_length != model->blob_length) ||
+        (quantized_blob_length != model->quantized_blob_length) ||
+        (max_units != model->max_units))
+        return -2;
+
+    return 0;
+}
+
+/**
+ * @brief Maps a model image into memory and checks it, then points the
+ *        blobs of the model into the mapping
+ * @param model The returned model
+ * @param fd Open file descriptor of the image, which is closed
+ * @param verify Non-zero to verify the checksum
+ * @returns zero on success
+ */
+static int deeplearn_inference_map_fd(deeplearn_inference * model, int fd,
+                                      int verify)
+{
+    deeplearn_model_header header, expected;
+    deeplearn_inference layout;
+    struct stat st;
+    unsigned char * image;
+    unsigned int checksum;
+
+    if ((fstat(fd, &st) != 0) ||
+        ((size_t)st.st_size < sizeof(deeplearn_model_header))) {
+        close(fd);
+        return -2;
+    }
+
+    image = (unsigned char*)mmap(0, st.st_size, PROT_READ, MAP_SHARED,
+                                 fd, 0);
+    close(fd);
+    if ((void*)image == MAP_FAILED)
+        return -3;
+
+    memcpy(&header, image, sizeof(deeplearn_model_header));
+    if ((header.magic != DEEPLEARN_MODEL_MAGIC) ||
+        (header.byte_order != DEEPLEARN_MODEL_BYTE_ORDER) ||
+        (header.version != DEEPLEARN_MODEL_VERSION) ||
+        (header.no_of_layers < 1) || (header.no_of_input_fields < 0)) {
+        munmap(image, st.st_size);
+        return -4;
+    }
+
+    /* the offsets should be those which would have been saved */
+    layout.no_of_inputs = header.no_of_inputs;
+    layout.no_of_outputs = header.no_of_outputs;
+    layout.no_of_layers = header.no_of_layers;
+    layout.no_of_input_fields = header.no_of_input_fields;
+    layout.quantized = header.quantized;
+    layout.max_units = header.max_units;
+    layout.blob_length = header.blob_length;
+    layout.quantized_blob_length = header.quantized_blob_length;
+    deeplearn_model_header_init(&layout, &expected);
+    if ((memcmp(&header, &expected, sizeof(deeplearn_model_header)) != 0) ||
+        ((size_t)st.st_size !=
+         header.checksum_offset + sizeof(unsigned int))) {
+        munmap(image, st.st_size);
+        return -5;
+    }
+
+    if (verify != 0) {
+        memcpy(&checksum, &image[header.checksum_offset],
+               sizeof(unsigned int));
+        if (deeplearn_model_checksum(image, header.checksum_offset) !=
+            checksum) {
+            munmap(image, st.st_size);
+            return -6;
+        }
+    }
+
+    *model = layout;
+    if (deeplearn_inference_alloc(model) != 0) {
+        munmap(image, st.st_size);
+        return -7;
+    }
+
+    memcpy(model->layer_units, &image[header.meta_offset],
+           ((model->no_of_layers*3) + model->no_of_input_fields)*
+           sizeof(int));
+    model->mapping = image;
+    model->mapping_length = st.st_size;
+    model->blob = (float*)&image[header.blob_offset];
+    if (model->quantized != 0)
+        model->quantized_blob = (signed char*)&image[header.quantized_offset];
+
+    if (deeplearn_model_check_layers(model) != 0) {
+        deeplearn_inference_free(model);
+        return -8;
+    }
+
+    deeplearn_inference_layout(model);
+    return 0;
+}
+
+/**
+ * @brief Loads a compiled model by mapping a file saved with
+ *        deeplearn_inference_save into memory. The weights are used
+ *        directly from the mapping, so loading takes no time regardless
+ *        of the size of the model, and processes which map the same file
+ *        share its memory through the page cache
+ * @param model The returned model, which is freed with
+ *        deeplearn_inference_free
+ * @param filename Filename of the model
+ * @param verify Non-zero to verify the checksum, which reads every page
+ * @returns zero on success
+ */
+int deeplearn_inference_map(deeplearn_inference * model, char * filename,
+                            int verify)
+{
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0)
+        return -1;
+    return deeplearn_inference_map_fd(model, fd, verify);
+}
+
+/**
+ * @brief Publishes a compiled model as a POSIX shared memory object, so
+ *        that processes on the same machine can map one physical copy
+ *        of it with deeplearn_inference_map_shared, without a file
+ * @param model Compiled model
+ * @param name Name of the shared memory object, beginning with a slash
+ * @returns zero on success
+ */
+int deeplearn_inference_publish(const deeplearn_inference * model,
+                                const char * name)
+{
+    deeplearn_model_header header;
+    unsigned char * image;
+    size_t length, header_length = sizeof(deeplearn_model_header);
+    int fd, retval = 0;
+
+    image = deeplearn_model_image(model, &header);
+    if (!image)
+        return -1;
+    length = header.checksum_offset + sizeof(unsigned int);
+
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR,
+                  S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+        free(image);
+        return -2;
+    }
+
+    /* the header is written last, so a process which maps the model
+       before it is complete finds no magic number */
+    if (ftruncate(fd, length) != 0)
+        retval = -3;
+    else if ((pwrite(fd, &image[header_length], length - header_length,
+                     header_length) != (ssize_t)(length - header_length)) ||
+             (pwrite(fd, image, header_length, 0) !=
+              (ssize_t)header_length))
+        retval = -4;
+
+    close(fd);
+    free(image);
+    if (retval != 0)
+        shm_unlink(name);
+    return retval;
+}
+
+/**
+ * @brief Loads a compiled model by mapping a shared memory object
+ *        created with deeplearn_inference_publish. The weights are
+ *        shared by every process which maps it, and only the model
+ *        structure and the contexts belong to each process
+ * @param model The returned model, which is freed with
+ *        deeplearn_inference_free
+ * @param name Name of the shared memory object
+ * @param verify Non-zero to verify the checksum, which reads every page
+ * @returns zero on success
+ */
+int deeplearn_inference_map_shared(deeplearn_inference * model,
+                                   const char * name, int verify)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+
+    if (fd < 0)
+        return -1;
+    return deeplearn_inference_map_fd(model, fd, verify);
+}
+
+/**
+ * @brief Removes the name of a published model. Processes which
+ *        have already mapped it may carry on using it
+ * @param name Name of the shared memory object
+ * @returns zero on success
+ */
+int deeplearn_inference_unpublish(const char * name)
+{
+    return (shm_unlink(name) == 0) ? 0 : -1;
+}
+
+/**
+ * @brief Copies a model into memory of its own, which is placed on the
+ *        NUMA node of the calling thread
+ * @param model Compiled model, which may be mapped from a file
+ * @param copy The returned copy
+ * @returns zero on success
+ */
+static int deeplearn_inference_copy(const deeplearn_inference * model,
+                                    deeplearn_inference * copy)
+{
+    *copy = *model;
+    if (deeplearn_inference_alloc(copy) != 0)
+        return -1;
+
+    memcpy(copy->layer_units, model->layer_units,
+           ((model->no_of_layers*3) + model->no_of_input_fields)*
+           sizeof(int));
+
+    FLOATALLOC(copy->blob, model->blob_length);
+    if (!copy->blob) {
+        deeplearn_inference_free(copy);
+        return -2;
+    }
+    memcpy(copy->blob, model->blob, model->blob_length*sizeof(float));
+
+    if (model->quantized != 0) {
+        copy->quantized_blob = (signed char*)
+            malloc(model->quantized_blob_length*sizeof(signed char));
+        if (!copy->quantized_blob) {
+            deeplearn_inference_free(copy);
+            return -3;
+        }
+        memcpy(copy->quantized_blob, model->quantized_blob,
+               model->quantized_blob_length);
+    }
+
+    deeplearn_inference_layout(copy);
+    return 0;
+}
+
+/**
+ * @brief Creates one copy of a model for each NUMA node, held within
+ *        the memory of that node, so that threads on every socket read
+ *        the weights locally. Threads obtain the copy for the node which
+ *        they are running on with deeplearn_inference_replica, and
+ *        should create their own contexts
+ * @param model Compiled model, which may be freed afterwards
+ * @param no_of_replicas Returned number of copies
+ * @returns Array of copies, or 0 if they could not be allocated
+ */
+deeplearn_inference *
+deeplearn_inference_replicas_init(const deeplearn_inference * model,
+                                  int * no_of_replicas)
+{
+    deeplearn_inference * replicas;
+    int nodes = deeplearn_numa_nodes();
+
+    *no_of_replicas = 0;
+    replicas = (deeplearn_inference*)
+        malloc(nodes*sizeof(deeplearn_inference));
+    if (!replicas)
+        return 0;
+
+    /* each copy is first touched from its own node */
+    COUNTUP(n, nodes) {
+        if (nodes > 1)
+            deeplearn_numa_migrate(n);
+
+        if (deeplearn_inference_copy(model, &replicas[n]) != 0) {
+            deeplearn_inference_replicas_free(replicas, n);
+            replicas = 0;
+            break;
+        }
+    }
+
+    /* back to the processors which the thread was given */
+    if (nodes > 1) {
+        deeplearn_numa_migrate(-1);
+        if (deeplearn_get_thread_binding() != 0)
+            deeplearn_set_thread_binding(1);
+    }
+
+    if (replicas)
+        *no_of_replicas = nodes;
+    return replicas;
+}
+
+/**
+ * @brief Returns the copy of a model for the NUMA node which the
+ *        calling thread is running on
+ * @param replicas Copies created by deeplearn_inference_replicas_init
+ * @param no_of_replicas The number of copies
+ * @returns The copy which is local to the thread
+ */
+const deeplearn_inference *
+deeplearn_inference_replica(const deeplearn_inference * replicas,
+                            int no_of_replicas)
+{
+    return &replicas[deeplearn_numa_node() % no_of_replicas];
+}
+
+/**
+ * @brief Frees copies created by deeplearn_inference_replicas_init
+ * @param replicas Array of copies
+ * @param no_of_replicas The number of copies
+ */
+void deeplearn_inference_replicas_free(deeplearn_inference * replicas,
+                                       int no_of_replicas)
+{
+    COUNTDOWN(n, no_of_replicas)
+        deeplearn_inference_free(&replicas[n]);
+    free(replicas);
+}
+
+/**
+ * @brief Creates the working memory needed to run a compiled model.
+ *        Each thread should have its own context
+ * @param model Compiled model
+ * @param ctx The context to be created
+ * @returns zero on success
+ */
+int deeplearn_inference_context_init(const deeplearn_inference * model,
+                                     deeplearn_inference_context * ctx)
+{
+    FLOATALLOC(ctx->network_inputs,
+               model->no_of_inputs + (model->max_units*2));
+    if (!ctx->network_inputs)
+        return -1;
+
+    FLOATCLEAR(ctx->network_inputs,
+               model->no_of_inputs + (model->max_units*2));
+    ctx->activations[0] = &ctx->network_inputs[model->no_of_inputs];
+    ctx->activations[1] = &ctx->activations[0][model->max_units];
+    ctx->outputs = ctx->activations[(model->no_of_layers-1)%2];
+
+    ctx->quantized_inputs = 0;
+    if (model->quantized != 0) {
+        int max = model->no_of_inputs;
+
+        if (model->max_units > max)
+            max = model->max_units;
+
+        ctx->quantized_inputs =
+            (signed char*)malloc(max*sizeof(signed char));
+        if (!ctx->quantized_inputs) {
+            free(ctx->network_inputs);
+            return -2;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Creates one context for each of a number of threads, so that
+ *        a thread can use the context given by its thread number
+ * @param model Compiled model
+ * @param threads The number of contexts to create
+ * @returns Array of contexts, or 0 if they could not be allocated
+ */
+deeplearn_inference_context *
+deeplearn_inference_contexts_init(const deeplearn_inference * model,
+                                  int threads)
+{
+    deeplearn_inference_context * contexts;
+
+    contexts = (deeplearn_inference_context*)
+        malloc(threads*sizeof(deeplearn_inference_context));
+    if (!contexts)
+        return 0;
+
+    COUNTUP(t, threads) {
+        if (deeplearn_inference_context_init(model, &contexts[t]) != 0) {
+            COUNTDOWN(i, t)
+                deeplearn_inference_context_free(&contexts[i]);
+            free(contexts);
+            return 0;
+        }
+    }
+    return contexts;
+}
+
+/**
+ * @brief Frees contexts created by deeplearn_inference_contexts_init
+ * @param contexts Array of contexts
+ * @param threads The number of contexts
+ */
+void deeplearn_inference_contexts_free(deeplearn_inference_context * contexts,
+                                       int threads)
+{
+    COUNTDOWN(t, threads)
+        deeplearn_inference_context_free(&contexts[t]);
+    free(contexts);
+}
+
+/**
+ * @brief Frees the working memory of a context
+ * @param ctx The context
+ */
+void deeplearn_inference_context_free(deeplearn_inference_context * ctx)
+{
+    free(ctx->network_inputs);
+    free(ctx->quantized_inputs);
+}
+
+/**
+ * @brief Feeds input unit values through a quantized model.
+ *        The activations of each layer are quantized to 8 bits with
+ *        their own scale, so that the weighted sums are integer
+ * @param model Compiled model
+ * @param ctx Context belonging to the calling thread
+ * @param network_inputs Input unit values in the range 0.0 -> 1.0
+ */
+static void feed_forward_int8(const deeplearn_inference * model,
+                              deeplearn_inference_context * ctx,
+                              const float * network_inputs)
+{
+    const float * inputs = network_inputs;
+    signed char * q = ctx->quantized_inputs;
+
+    COUNTUP(l, model->no_of_layers) {
+        float * values = ctx->activations[l%2];
+        const int no_of_inputs = model->layer_inputs[l];
+        float max = 0, input_scale = 1.0f, scale;
+
+        COUNTDOWN(j, no_of_inputs) {
+            if (fabs(inputs[j]) > max)
+                max = fabs(inputs[j]);
+        }
+        if (max > 0)
+            input_scale = max / 127.0f;
+
+        COUNTDOWN(j, no_of_inputs)
+            q[j] = (signed char)roundf(inputs[j] / input_scale);
+
+        scale = model->weight_scale[l] * input_scale;
+        COUNTDOWN(i, model->layer_units[l]) {
+            const signed char * w = model->quantized_weights[l];
+            int sum = deeplearn_dot_int8(&w[i*no_of_inputs], q,
+                                         no_of_inputs);
+            values[i] = activation_value(model->activation[l],
+                                         model->bias[l][i] + (sum*scale));
+        }
+        inputs = values;
+    }
+}
+
+/**
+ * @brief Feeds input unit values through a compiled model.
+ *        The model is not modified, so any number of threads may do this
+ *        at the same time provided that each has its own context
+ * @param model Compiled model
+ * @param ctx Context belonging to the calling thread
+ * @param network_inputs Input unit values in the range 0.0 -> 1.0
+ */
+void deeplearn_inference_feed_forward(const deeplearn_inference * model,
+                                      deeplearn_inference_context * ctx,
+                                      const float * network_inputs)
+{
+    const float * inputs = network_inputs;
+
+    if (model->quantized != 0) {
+        feed_forward_int8(model, ctx, network_inputs);
+        return;
+    }
+
+    COUNTUP(l, model->no_of_layers) {
+        float * values = ctx->activations[l%2];
+        const int no_of_inputs = model->layer_inputs[l];
+
+        COUNTDOWN(i, model->layer_units[l]) {
+            float adder = model->bias[l][i] +
+                deeplearn_dot(&model->weights[l][i*no_of_inputs],
+                              inputs, no_of_inputs);
+            values[i] = activation_value(model->activation[l], adder);
+        }
+        inputs = values;
+    }
+}
+
+/**
+ * @brief Runs a compiled model on a set of numeric inputs, normalising
+ *        them in the same way as deeplearn_set_inputs and returning the
+ *        outputs within their original range
+ * @param model Compiled model
+ * @param ctx Context belonging to the calling thread
+ * @param inputs The input values, one per input field, or one per
+ *        input unit if there are no fields
+ * @param outputs The returned output values
+ * @returns zero on success, or -1 if the model has text input fields
+ */
+int deeplearn_inference_run(const deeplearn_inference * model,
+                            deeplearn_inference_context * ctx,
+                            const float * inputs, float * outputs)
+{
+    int no_of_fields = model->no_of_input_fields;
+
+    if (no_of_fields == 0)
+        no_of_fields = model->no_of_inputs;
+
+    COUNTUP(i, no_of_fields) {
+        float range =
+            model->input_range_max[i] - model->input_range_min[i];
+
+        if ((model->no_of_input_fields > 0) &&
+            (model->field_length[i] > 0))
+            return -1;
+
+        ctx->network_inputs[i] = inputs[i];
+        if (range > 0)
+            ctx->network_inputs[i] =
+                (((inputs[i] - model->input_range_min[i])/range)*
+                 NEURON_RANGE) + NEURON_LOW;
+    }
+
+    deeplearn_inference_feed_forward(model, ctx, ctx->network_inputs);
+
+    COUNTDOWN(i, model->no_of_outputs) {
+        float range =
+            model->output_range_max[i] - model->output_range_min[i];
+
+        outputs[i] = ctx->outputs[i];
+        if (range > 0)
+            outputs[i] =
+                (((ctx->outputs[i] - NEURON_LOW)/NEURON_RANGE)*range) +
+                model->output_range_min[i];
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the output class from the most recent forward pass
+ * @param model Compiled model
+ * @param ctx Context belonging to the calling thread
+ * @return output class
+ */
+int deeplearn_inference_get_class(const deeplearn_inference * model,
+                                  const deeplearn_inference_context * ctx)
+{
+    int class = -9999;
+    float max = -1;
+
+    COUNTDOWN(i, model->no_of_outputs) {
+        if (ctx->outputs[i] > max) {
+            max = ctx->outputs[i];
+            class = i;
+        }
+    }
+    return class;
+}
@@ -0,0 +1,172 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEEPLEARN_INFERENCE_H
+#define DEEPLEARN_INFERENCE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "globals.h"
+#include "deeplearn.h"
+#include "deeplearn_threads.h"
+
+/* A trained network frozen for inference.
+   All weights, biases and ranges are held within a single read-only
+   block, so that one model can be shared between many threads.
+   A quantized model holds its weights as 8 bit integers instead */
+struct deeplearn_inf {
+    int no_of_inputs, no_of_outputs;
+
+    /* non-zero if the weights are 8 bit integers */
+    int quantized;
+
+    /* hidden layers followed by the output layer */
+    int no_of_layers;
+
+    /* for each layer */
+    int * layer_units;
+    int * layer_inputs;
+    int * activation;
+    float ** weights;
+    float ** bias;
+
+    /* for each layer of a quantized model, weight = q * scale */
+    signed char ** quantized_weights;
+    float * weight_scale;
+
+    /* the largest number of units in any layer */
+    int max_units;
+
+    /* input fields as loaded from a data set, if any */
+    int no_of_input_fields;
+    int * field_length;
+
+    /* ranges used to normalise inputs and outputs */
+    float * input_range_min;
+    float * input_range_max;
+    float * output_range_min;
+    float * output_range_max;
+
+    /* storage for the weights, biases and ranges */
+    float * blob;
+    int blob_length;
+
+    /* storage for the weights of a quantized model */
+    signed char * quantized_blob;
+    int quantized_blob_length;
+
+    /* model file which the blobs are mapped from, if any */
+    void * mapping;
+    size_t mapping_length;
+};
+typedef struct deeplearn_inf deeplearn_inference;
+
+/* Header of a compiled model file. It is followed by the layer sizes,
+   activation functions and field lengths, then by the blob and the
+   quantized blob, each aligned to DEEPLEARN_MODEL_ALIGN bytes so that
+   they may be used directly from a memory mapping, and finally by a
+   checksum of everything before it. Values are in the byte order of
+   the machine which saved the model */
+typedef struct {
+    unsigned int magic;
+    unsigned int byte_order;
+    unsigned int version;
+    int no_of_inputs, no_of_outputs;
+    int no_of_layers;
+    int no_of_input_fields;
+    int quantized;
+    int max_units;
+    int blob_length;
+    int quantized_blob_length;
+
+    /* byte offsets within the file */
+    int meta_offset;
+    int blob_offset;
+    int quantized_offset;
+    int checksum_offset;
+} deeplearn_model_header;
+
+/* Per-thread working memory for running a compiled network */
+struct deeplearn_inf_ctx {
+    float * network_inputs;
+    float * activations[2];
+
+    /* activations of the previous layer quantized to 8 bits */
+    signed char * quantized_inputs;
+
+    /* outputs of the final layer in the range 0.0 -> 1.0 */
+    float * outputs;
+};
+typedef struct deeplearn_inf_ctx deeplearn_inference_context;
+
+int deeplearn_compile_inference(deeplearn * learner,
+                                deeplearn_inference * model);
+int deeplearn_compile_inference_int8(deeplearn * learner,
+                                     deeplearn_inference * model);
+void deeplearn_inference_free(deeplearn_inference * model);
+int deeplearn_inference_save(const deeplearn_inference * model,
+                             char * filename);
+int deeplearn_inference_map(deeplearn_inference * model, char * filename,
+                            int verify);
+int deeplearn_inference_publish(const deeplearn_inference * model,
+                                const char * name);
+int deeplearn_inference_map_shared(deeplearn_inference * model,
+                                   const char * name, int verify);
+int deeplearn_inference_unpublish(const char * name);
+deeplearn_inference *
+deeplearn_inference_replicas_init(const deeplearn_inference * model,
+                                  int * no_of_replicas);
+const deeplearn_inference *
+deeplearn_inference_replica(const deeplearn_inference * replicas,
+                            int no_of_replicas);
+void deeplearn_inference_replicas_free(deeplearn_inference * replicas,
+                                       int no_of_replicas);
+int deeplearn_inference_context_init(const deeplearn_inference * model,
+                                     deeplearn_inference_context * ctx);
+void deeplearn_inference_context_free(deeplearn_inference_context * ctx);
+deeplearn_inference_context *
+deeplearn_inference_contexts_init(const deeplearn_inference * model,
+                                  int threads);
+void deeplearn_inference_contexts_free(deeplearn_inference_context * contexts,
+                                       int threads);
+void deeplearn_inference_feed_forward(const deeplearn_inference * model,
+                                      deeplearn_inference_context * ctx,
+                                      const float * network_inputs);
+int deeplearn_inference_run(const deeplearn_inference * model,
+                            deeplearn_inference_context * ctx,
+                            const float * inputs, float * outputs);
+int deeplearn_inference_get_class(const deeplearn_inference * model,
+                                  const deeplearn_inference_context * ctx);
+
+#endif
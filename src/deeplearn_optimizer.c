@@ -0,0 +1,353 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "deeplearn_optimizer.h"
+
+/**
+ * @brief Returns non-zero if the given optimizer type is valid
+ * @param type The optimizer, eg. OPTIMIZER_ADAM
+ * @returns non-zero if valid
+ */
+int optimizer_valid(int type)
+{
+    return ((type >= 0) && (type < OPTIMIZERS));
+}
+
+/**
+ * @brief Returns non-zero if the optimizer keeps per-weight moments,
+ *        rather than being the default stochastic gradient descent
+ * @param optimizer Optimizer object
+ * @returns non-zero if adaptive
+ */
+int optimizer_adaptive(const deeplearn_optimizer * optimizer)
+{
+    return (optimizer->type != OPTIMIZER_SGD);
+}
+
+/**
+ * @brief Initialises an optimizer with default hyperparameters
+ * @param optimizer Optimizer object
+ * @param type The optimizer, eg. OPTIMIZER_ADAM
+ */
+void optimizer_init(deeplearn_optimizer * optimizer, int type)
+{
+    optimizer->type = type;
+    optimizer->learning_rate = OPTIMIZER_LEARNING_RATE;
+    optimizer->beta1 = OPTIMIZER_BETA1;
+    optimizer->beta2 = OPTIMIZER_BETA2;
+    if (type == OPTIMIZER_RMSPROP)
+        optimizer->beta2 = OPTIMIZER_RMSPROP_DECAY;
+    optimizer->epsilon = OPTIMIZER_EPSILON;
+    optimizer->step = 0;
+    optimizer->step_size = optimizer->learning_rate;
+}
+
+/**
+ * @brief Advances the optimizer by one update, calculating the bias
+ *        corrected step size so that it is only done once per update
+ *        rather than for every weight
+ * @param optimizer Optimizer object
+ */
+void optimizer_step(deeplearn_optimizer * optimizer)
+{
+    double t;
+
+    if (optimizer->step < UINT_MAX)
+        optimizer->step++;
+
+    optimizer->step_size = optimizer->learning_rate;
+    if (optimizer->type != OPTIMIZER_ADAM)
+        return;
+
+    /* the moments start at zero, so are biased towards zero early on */
+    t = (double)optimizer->step;
+    optimizer->step_size = (float)(optimizer->learning_rate *
+                                   sqrt(1.0 - pow(optimizer->beta2, t)) /
+                                   (1.0 - pow(optimizer->beta1, t)));
+}
+
+/**
+ * @brief Adjusts a single weight from its gradient
+ * @param optimizer Optimizer object
+ * @param w The weight
+ * @param dw The previous weight change, which is updated
+ * @param m First moment, which is not used by RMSprop
+ * @param v Second moment
+ * @param g Gradient, in the direction of decreasing error
+ */
+static void optimizer_update_weight(const deeplearn_optimizer * optimizer,
+                                    float * w, float * dw,
+                                    float * m, float * v, float g)
+{
+    const float beta2 = optimizer->beta2;
+
+    *v = beta2 * *v + (1.0f - beta2) * g * g;
+
+    if (optimizer->type == OPTIMIZER_ADAM) {
+        const float beta1 = optimizer->beta1;
+        *m = beta1 * *m + (1.0f - beta1) * g;
+        g = *m;
+    }
+
+    *dw = optimizer->step_size * g / (sqrtf(*v) + optimizer->epsilon);
+    *w = CLIP_WEIGHT(*w + *dw);
+}
+
+/**
+ * @brief Adjusts a row of weights using an adaptive optimizer.
+ *        The gradient of each weight is a * x
+ * @param optimizer Optimizer object
+ * @param w Weights to be updated
+ * @param dw Previous weight changes, which are also updated
+ * @param m First moments, or NULL for RMSprop
+ * @param v Second moments
+ * @param x Input values or gradients for each weight
+ * @param a Multiplier applied to each input
+ * @param n Length of the arrays
+ */
+void optimizer_update(const deeplearn_optimizer * optimizer,
+                      float * w, float * dw, float * m, float * v,
+                      const float * x, float a, int n)
+{
+    float unused = 0;
+
+    COUNTDOWN(j, n)
+        optimizer_update_weight(optimizer, &w[j], &dw[j],
+                                (m != NULL) ? &m[j] : &unused, &v[j],
+                                a * x[j]);
+}
+
+/**
+ * @brief Adjusts the remaining weights of a sparse row using an
+ *        adaptive optimizer, see optimizer_update
+ * @param optimizer Optimizer object
+ * @param w Weights to be updated
+ * @param dw Previous weight changes, which are also updated
+ * @param m First moments, or NULL for RMSprop
+ * @param v Second moments
+ * @param x Input values or gradients for each weight
+ * @param a Multiplier applied to each input
+ * @param columns Indexes of the remaining weights
+ * @param n The number of remaining weights
+ */
+void optimizer_update_sparse(const deeplearn_optimizer * optimizer,
+                             float * w, float * dw, float * m, float * v,
+                             const float * x, float a,
+                             const int * columns, int n)
+{
+    float unused = 0;
+
+    COUNTDOWN(k, n) {
+        int j = columns[k];
+        optimizer_update_weight(optimizer, &w[j], &dw[j],
+                                (m != NULL) ? &m[j] : &unused, &v[j],
+                                a * x[j]);
+    }
+}
+
+/**
+ * @brief Allocates the moments needed by an optimizer, which start
+ *        at zero. The first moment is only needed by Adam.
+ *        Rows are placed with deeplearn_first_touch, like the weights
+ * @param type The optimizer, eg. OPTIMIZER_ADAM
+ * @param rows The number of rows of weights, such as units of a layer
+ * @param row_length The number of weights in each row
+ * @param m Returned first moments, or NULL if not needed
+ * @param v Returned second moments, or NULL if not needed
+ * @returns zero on success
+ */
+int optimizer_moments_alloc(int type, int rows, int row_length,
+                            float ** m, float ** v)
+{
+    const int n = rows*row_length;
+
+    *m = NULL;
+    *v = NULL;
+
+    if (type == OPTIMIZER_SGD)
+        return 0;
+
+    if (type == OPTIMIZER_ADAM) {
+        FLOATALLOC(*m, n);
+        if (!*m)
+            return -1;
+        deeplearn_first_touch(*m, rows, row_length);
+    }
+
+    FLOATALLOC(*v, n);
+    if (!*v) {
+        optimizer_moments_free(m, v);
+        return -2;
+    }
+    deeplearn_first_touch(*v, rows, row_length);
+    return 0;
+}
+
+/**
+ * @brief Frees the moments of an optimizer
+ * @param m First moments
+ * @param v Second moments
+ */
+void optimizer_moments_free(float ** m, float ** v)
+{
+    free(*m);
+    free(*v);
+    *m = NULL;
+    *v = NULL;
+}
+
+/**
+ * @brief Saves the type and hyperparameters of an optimizer
+ * @param fp File pointer
+ * @param optimizer Optimizer object
+ * @returns zero on success
+ */
+int optimizer_save(FILE * fp, deeplearn_optimizer * optimizer)
+{
+    if (INTWRITE(optimizer->type) == 0)
+        return -1;
+
+    if (optimizer->type == OPTIMIZER_SGD)
+        return 0;
+
+    if (FLOATWRITE(optimizer->learning_rate) == 0)
+        return -2;
+
+    if (FLOATWRITE(optimizer->beta1) == 0)
+        return -3;
+
+    if (FLOATWRITE(optimizer->beta2) == 0)
+        return -4;
+
+    if (FLOATWRITE(optimizer->epsilon) == 0)
+        return -5;
+
+    if (UINTWRITE(optimizer->step) == 0)
+        return -6;
+
+    return 0;
+}
+
+/**
+ * @brief Saves the moments of an optimizer
+ * @param fp File pointer
+ * @param optimizer Optimizer object
+ * @param m First moments, or NULL if not used
+ * @param v Second moments, or NULL if not used
+ * @param n The number of weights
+ * @returns zero on success
+ */
+int optimizer_save_moments(FILE * fp, deeplearn_optimizer * optimizer,
+                           float * m, float * v, int n)
+{
+    if (optimizer->type == OPTIMIZER_SGD)
+        return 0;
+
+    if (m != NULL) {
+        if (FLOATWRITEARRAY(m, n) == 0)
+            return -1;
+    }
+
+    if (v != NULL) {
+        if (FLOATWRITEARRAY(v, n) == 0)
+            return -2;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Loads the type and hyperparameters of an optimizer.
+ *        Once its moments have been allocated they can be loaded
+ *        with optimizer_load_moments
+ * @param fp File pointer
+ * @param optimizer Optimizer object
+ * @returns zero on success
+ */
+int optimizer_load(FILE * fp, deeplearn_optimizer * optimizer)
+{
+    int type = OPTIMIZER_SGD;
+
+    if (INTREAD(type) == 0)
+        return -1;
+
+    if (!optimizer_valid(type))
+        return -2;
+
+    optimizer_init(optimizer, type);
+    if (type == OPTIMIZER_SGD)
+        return 0;
+
+    if (FLOATREAD(optimizer->learning_rate) == 0)
+        return -3;
+
+    if (FLOATREAD(optimizer->beta1) == 0)
+        return -4;
+
+    if (FLOATREAD(optimizer->beta2) == 0)
+        return -5;
+
+    if (FLOATREAD(optimizer->epsilon) == 0)
+        return -6;
+
+    if (UINTREAD(optimizer->step) == 0)
+        return -7;
+
+    optimizer->step_size = optimizer->learning_rate;
+    return 0;
+}
+
+/**
+ * @brief Loads the moments of an optimizer, saved by
+ *        optimizer_save_moments
+ * @param fp File pointer
+ * @param optimizer Optimizer object
+ * @param m First moments, or NULL if not used
+ * @param v Second moments, or NULL if not used
+ * @param n The number of weights
+ * @returns zero on success
+ */
+int optimizer_load_moments(FILE * fp, deeplearn_optimizer * optimizer,
+                           float * m, float * v, int n)
+{
+    if (optimizer->type == OPTIMIZER_SGD)
+        return 0;
+
+    if (m != NULL) {
+        if (FLOATREADARRAY(m, n) == 0)
+            return -1;
+    }
+
+    if (v != NULL) {
+        if (FLOATREADARRAY(v, n) == 0)
+            return -2;
+    }
+
+    return 0;
+}
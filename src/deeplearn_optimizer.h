@@ -0,0 +1,82 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEEPLEARN_OPTIMIZER_H
+#define DEEPLEARN_OPTIMIZER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <limits.h>
+#include <string.h>
+#include "globals.h"
+#include "deeplearn_threads.h"
+
+/* state of the method used to adjust weights during training.
+   Adaptive optimizers keep per-weight moments, which belong to the
+   network or autocoder being trained */
+typedef struct {
+    /* eg. OPTIMIZER_ADAM */
+    int type;
+
+    /* step size of the adaptive optimizers */
+    float learning_rate;
+
+    /* decay rates of the first and second moments */
+    float beta1, beta2;
+    float epsilon;
+
+    /* number of updates so far, and the bias corrected step size
+       for the current update */
+    unsigned int step;
+    float step_size;
+} deeplearn_optimizer;
+
+int optimizer_valid(int type);
+int optimizer_adaptive(const deeplearn_optimizer * optimizer);
+void optimizer_init(deeplearn_optimizer * optimizer, int type);
+void optimizer_step(deeplearn_optimizer * optimizer);
+void optimizer_update(const deeplearn_optimizer * optimizer,
+                      float * w, float * dw, float * m, float * v,
+                      const float * x, float a, int n);
+void optimizer_update_sparse(const deeplearn_optimizer * optimizer,
+                             float * w, float * dw, float * m, float * v,
+                             const float * x, float a,
+                             const int * columns, int n);
+int optimizer_moments_alloc(int type, int rows, int row_length,
+                            float ** m, float ** v);
+void optimizer_moments_free(float ** m, float ** v);
+int optimizer_save(FILE * fp, deeplearn_optimizer * optimizer);
+int optimizer_save_moments(FILE * fp, deeplearn_optimizer * optimizer,
+                           float * m, float * v, int n);
+int optimizer_load(FILE * fp, deeplearn_optimizer * optimizer);
+int optimizer_load_moments(FILE * fp, deeplearn_optimizer * optimizer,
+                           float * m, float * v, int n);
+
+#endif
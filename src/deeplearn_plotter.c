@@ -0,0 +1,220 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* threads are not part of c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include "deeplearn_plotter.h"
+
+/**
+ * @brief Initialises a plotter with nothing being drawn
+ * @param plotter Plotter object
+ */
+void deeplearn_plotter_init(deeplearn_plotter * plotter)
+{
+    plotter->snapshot = 0;
+    COUNTDOWN(i, DEEPLEARN_PLOTTER_HISTORIES)
+        plotter->snapshot_length[i] = 0;
+    plotter->no_of_histories = 0;
+    plotter->img_width = 0;
+    plotter->img_height = 0;
+    plotter->running = 0;
+    plotter->done = 0;
+    plotter->status = 0;
+    plotter->frames = 0;
+    plotter->dropped = 0;
+    create_scope(&plotter->plot_scope, 1);
+}
+
+/**
+ * @brief Copies a history. Only the values recorded so far are copied,
+ *        into values which are kept from one copy to the next
+ * @param plotter Plotter object
+ * @param i Index of the copy
+ * @param source The history to be copied
+ * @returns zero on success
+ */
+static int deeplearn_plotter_copy(deeplearn_plotter * plotter, int i,
+                                  deeplearn_history * source)
+{
+    deeplearn_history * dest = &plotter->snapshot[i];
+    float * values = dest->history;
+    int length = source->index*source->dimensions;
+
+    if (length > plotter->snapshot_length[i]) {
+        free(values);
+        plotter->snapshot_length[i] = 0;
+        length = source->capacity*source->dimensions;
+        FLOATALLOC(values, length);
+        if (!values) {
+            dest->history = NULL;
+            return -1;
+        }
+        plotter->snapshot_length[i] = length;
+    }
+
+    *dest = *source;
+    dest->history = values;
+    if (source->index > 0)
+        memcpy(dest->history, source->history,
+               source->index*source->dimensions*sizeof(float));
+    return 0;
+}
+
+/**
+ * @brief Draws each of the copied histories.
+ *        This is run on the background thread
+ * @param arg Plotter object
+ * @returns NULL
+ */
+static void * deeplearn_plotter_draw(void * arg)
+{
+    deeplearn_plotter * plotter = (deeplearn_plotter*)arg;
+    int status = 0;
+
+    COUNTUP(i, plotter->no_of_histories) {
+        if (deeplearn_history_plot_scope(&plotter->snapshot[i],
+                                         &plotter->plot_scope,
+                                         plotter->img_width,
+                                         plotter->img_height) != 0)
+            status = -1;
+    }
+
+    plotter->status = status;
+#pragma omp flush
+#pragma omp atomic write
+    plotter->done = 1;
+    return NULL;
+}
+
+/**
+ * @brief Plots histories in the background. Training only pauses while
+ *        the histories are copied. If the previous plots are still being
+ *        drawn then these ones are dropped
+ * @param plotter Plotter object
+ * @param histories Array of histories to be plotted
+ * @param no_of_histories Number of histories, up to
+ *        DEEPLEARN_PLOTTER_HISTORIES
+ * @param img_width Width of the images in pixels
+ * @param img_height Height of the images in pixels
+ * @returns zero if the plots were started, -1 if they were dropped
+ */
+int deeplearn_plotter_async(deeplearn_plotter * plotter,
+                            deeplearn_history ** histories,
+                            int no_of_histories,
+                            int img_width, int img_height)
+{
+    if ((no_of_histories < 1) ||
+        (no_of_histories > DEEPLEARN_PLOTTER_HISTORIES))
+        return -2;
+
+    if (deeplearn_plotter_poll(plotter) == 1) {
+        plotter->dropped++;
+        return -1;
+    }
+
+    if (plotter->snapshot == 0) {
+        plotter->snapshot = (deeplearn_history*)
+            calloc(DEEPLEARN_PLOTTER_HISTORIES, sizeof(deeplearn_history));
+        if (!plotter->snapshot)
+            return -3;
+    }
+
+    COUNTUP(i, no_of_histories) {
+        if (deeplearn_plotter_copy(plotter, i, histories[i]) != 0)
+            return -3;
+    }
+    plotter->no_of_histories = no_of_histories;
+    plotter->img_width = img_width;
+    plotter->img_height = img_height;
+
+    plotter->done = 0;
+    plotter->status = 0;
+    if (pthread_create(&plotter->thread, NULL,
+                       deeplearn_plotter_draw, plotter) != 0)
+        return -4;
+    plotter->running = 1;
+    plotter->frames++;
+    return 0;
+}
+
+/**
+ * @brief Returns whether the latest plots have been drawn
+ * @param plotter Plotter object
+ * @returns 1 while the plots are being drawn, otherwise zero if they
+ *          were drawn successfully or negative if they failed
+ */
+int deeplearn_plotter_poll(deeplearn_plotter * plotter)
+{
+    int done;
+
+    if (!plotter->running)
+        return plotter->status;
+
+#pragma omp flush
+#pragma omp atomic read
+    done = plotter->done;
+
+    if (!done)
+        return 1;
+
+    pthread_join(plotter->thread, NULL);
+    plotter->running = 0;
+    return plotter->status;
+}
+
+/**
+ * @brief Waits until the latest plots have been drawn
+ * @param plotter Plotter object
+ * @returns zero if the plots were drawn successfully
+ */
+int deeplearn_plotter_wait(deeplearn_plotter * plotter)
+{
+    if (plotter->running) {
+        pthread_join(plotter->thread, NULL);
+        plotter->running = 0;
+    }
+    return plotter->status;
+}
+
+/**
+ * @brief Waits for any plots being drawn and frees their memory
+ * @param plotter Plotter object
+ */
+void deeplearn_plotter_free(deeplearn_plotter * plotter)
+{
+    deeplearn_plotter_wait(plotter);
+    if (plotter->snapshot != 0) {
+        COUNTDOWN(i, DEEPLEARN_PLOTTER_HISTORIES)
+            free(plotter->snapshot[i].history);
+    }
+    free(plotter->snapshot);
+    scope_free(&plotter->plot_scope);
+    deeplearn_plotter_init(plotter);
+}
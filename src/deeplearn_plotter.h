@@ -0,0 +1,81 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEEPLEARN_PLOTTER_H
+#define DEEPLEARN_PLOTTER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <omp.h>
+#include "globals.h"
+#include "deeplearn_history.h"
+
+/* Plots histories in the background.
+   The histories are copied, which only pauses training for as long as
+   the copy takes, and a thread then draws the copies. If the previous
+   plots are still being drawn then the new ones are dropped rather than
+   making training wait */
+typedef struct {
+    /* copies of the histories being plotted, and the number of values
+       allocated for each copy */
+    deeplearn_history * snapshot;
+    int snapshot_length[DEEPLEARN_PLOTTER_HISTORIES];
+    int no_of_histories;
+    int img_width, img_height;
+
+    /* trace buffers are reused from one plot to the next */
+    scope plot_scope;
+
+    pthread_t thread;
+
+    /* non-zero while the thread has not been joined */
+    int running;
+
+    /* set by the thread once the plots are drawn */
+    int done;
+    int status;
+
+    /* number of plots started and dropped */
+    unsigned int frames;
+    unsigned int dropped;
+} deeplearn_plotter;
+
+void deeplearn_plotter_init(deeplearn_plotter * plotter);
+int deeplearn_plotter_async(deeplearn_plotter * plotter,
+                            deeplearn_history ** histories,
+                            int no_of_histories,
+                            int img_width, int img_height);
+int deeplearn_plotter_poll(deeplearn_plotter * plotter);
+int deeplearn_plotter_wait(deeplearn_plotter * plotter);
+void deeplearn_plotter_free(deeplearn_plotter * plotter);
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* clock_gettime is not part of c99 */
+#define _POSIX_C_SOURCE 199309L
+
+#include <time.h>
+#include "deeplearn_profile.h"
+
+/* non-zero when the phases of training are being timed */
+static int deeplearn_profiling = 0;
+
+static unsigned long long deeplearn_phase_nanoseconds[DEEPLEARN_PHASES];
+static unsigned long long deeplearn_phase_calls[DEEPLEARN_PHASES];
+static unsigned long long deeplearn_phase_samples[DEEPLEARN_PHASES];
+
+static char * deeplearn_phase_names[] = {
+    "forward",
+    "backprop",
+    "learn",
+    "dropouts",
+    "pretraining",
+    "convolution",
+    "features",
+    "sampling",
+    "plotting"
+};
+
+/**
+ * @brief Turns the timing of the phases of training on or off.
+ *        This applies to all objects within the process, and is only
+ *        available if the library was compiled with DEEPLEARN_PROFILE
+ * @param enable Non-zero to time each phase
+ * @returns zero on success, or -1 if timing was not compiled in
+ */
+int deeplearn_profile_enable(int enable)
+{
+#ifdef DEEPLEARN_PROFILE
+    deeplearn_profiling = (enable != 0);
+    return 0;
+#else
+    deeplearn_profiling = 0;
+    return -1;
+#endif
+}
+
+/**
+ * @brief Returns whether the phases of training are being timed
+ * @returns Non-zero if timing is enabled
+ */
+int deeplearn_profile_enabled(void)
+{
+    return deeplearn_profiling;
+}
+
+/**
+ * @brief Returns the cumulative time spent within each phase of
+ *        training since timing was enabled or the stats were reset
+ * @param stats Returned times, call counts and samples per second
+ */
+void deeplearn_get_stats(deeplearn_stats * stats)
+{
+    COUNTUP(p, DEEPLEARN_PHASES) {
+        deeplearn_phase_stats * phase = &stats->phase[p];
+
+#pragma omp atomic read
+        phase->nanoseconds = deeplearn_phase_nanoseconds[p];
+#pragma omp atomic read
+        phase->calls = deeplearn_phase_calls[p];
+#pragma omp atomic read
+        phase->samples = deeplearn_phase_samples[p];
+
+        phase->samples_per_sec = 0;
+        if (phase->nanoseconds > 0)
+            phase->samples_per_sec =
+                phase->samples * 1.0e9 / (double)phase->nanoseconds;
+    }
+}
+
+/**
+ * @brief Clears the times and counts of every phase
+ */
+void deeplearn_reset_stats(void)
+{
+    COUNTUP(p, DEEPLEARN_PHASES) {
+#pragma omp atomic write
+        deeplearn_phase_nanoseconds[p] = 0;
+#pragma omp atomic write
+        deeplearn_phase_calls[p] = 0;
+#pragma omp atomic write
+        deeplearn_phase_samples[p] = 0;
+    }
+}
+
+/**
+ * @brief Returns the name of a phase of training, for reporting
+ * @param phase The phase, one of DEEPLEARN_PHASE_*
+ * @returns The name of the phase, or NULL if it does not exist
+ */
+char * deeplearn_phase_name(int phase)
+{
+    if ((phase < 0) || (phase >= DEEPLEARN_PHASES))
+        return NULL;
+
+    return deeplearn_phase_names[phase];
+}
+
+/**
+ * @brief Returns the time from a monotonic clock if timing is enabled
+ * @returns The time in nanoseconds, or zero if timing is disabled
+ */
+unsigned long long deeplearn_profile_time(void)
+{
+    struct timespec now;
+
+    if (!deeplearn_profiling)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec*1000000000ULL +
+        (unsigned long long)now.tv_nsec;
+}
+
+/**
+ * @brief Adds the time since the start of a lap to a phase of training.
+ *        A lap of zero samples adds to the time of a call which was
+ *        already counted
+ * @param phase The phase, one of DEEPLEARN_PHASE_*
+ * @param start The time at which the lap started
+ * @param samples The number of samples processed within the lap
+ * @returns The time at which the next lap starts
+ */
+unsigned long long deeplearn_profile_lap(int phase, unsigned long long start,
+                                         int samples)
+{
+    unsigned long long now = deeplearn_profile_time();
+
+    /* timing was turned on or off during the lap */
+    if ((now == 0) || (start == 0))
+        return now;
+
+#pragma omp atomic
+    deeplearn_phase_nanoseconds[phase] += now - start;
+    if (samples > 0) {
+#pragma omp atomic
+        deeplearn_phase_calls[phase]++;
+#pragma omp atomic
+        deeplearn_phase_samples[phase] += (unsigned long long)samples;
+    }
+
+    return now;
+}
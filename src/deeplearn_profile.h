@@ -0,0 +1,70 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEEPLEARN_PROFILE_H
+#define DEEPLEARN_PROFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "globals.h"
+
+typedef struct {
+    unsigned long long nanoseconds;
+    unsigned long long calls;
+    unsigned long long samples;
+    double samples_per_sec;
+} deeplearn_phase_stats;
+
+typedef struct {
+    deeplearn_phase_stats phase[DEEPLEARN_PHASES];
+} deeplearn_stats;
+
+int deeplearn_profile_enable(int enable);
+int deeplearn_profile_enabled(void);
+void deeplearn_get_stats(deeplearn_stats * stats);
+void deeplearn_reset_stats(void);
+char * deeplearn_phase_name(int phase);
+unsigned long long deeplearn_profile_time(void);
+unsigned long long deeplearn_profile_lap(int phase, unsigned long long start,
+                                         int samples);
+
+/* Timing of the phases of training is only compiled in if
+   DEEPLEARN_PROFILE is defined, so that there is no cost otherwise.
+   PROFILE_TIMER declares a timer, and each PROFILE_LAP adds the time
+   since the previous lap to a phase */
+#ifdef DEEPLEARN_PROFILE
+#define PROFILE_TIMER(t) unsigned long long t = deeplearn_profile_time()
+#define PROFILE_LAP(phase, t, samples) \
+    t = deeplearn_profile_lap(phase, t, samples)
+#else
+#define PROFILE_TIMER(t)
+#define PROFILE_LAP(phase, t, samples)
+#endif
+
+#endif
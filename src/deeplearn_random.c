@@ -28,8 +28,14 @@
 */
 
 #include "deeplearn_random.h"
+#include "deeplearn_simd.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-#define PRNG_LEHMER(x) (((unsigned long long)(x) * 279470273UL) % 4294967291UL)
+#define PRNG_MULTIPLIER 279470273ULL
+#define PRNG_MODULUS    4294967291ULL
+#define PRNG_LEHMER(x) (((unsigned long long)(x) * PRNG_MULTIPLIER) % PRNG_MODULUS)
 
 /**
  * @brief Lehmer random number generator
@@ -67,3 +73,209 @@ float rand_initial_weight(unsigned int * seed, int no_of_inputs)
     return (magnitude*(rand_num(seed)%100000/100000.0f)*
             (rand_num(seed)%100000/100000.0f)) - (magnitude*0.5f);
 }
+
+/**
+ * @brief Returns the multiplier which advances a seed by the given
+ *        number of steps, found by repeated squaring
+ * @param steps The number of steps to jump ahead
+ * @return multiplier^steps mod modulus
+ */
+static unsigned long long rand_jump_multiplier(unsigned long long steps)
+{
+    unsigned long long multiplier = PRNG_MULTIPLIER;
+    unsigned long long jump = 1;
+
+    while (steps > 0) {
+        if (steps & 1)
+            jump = (jump * multiplier) % PRNG_MODULUS;
+        multiplier = (multiplier * multiplier) % PRNG_MODULUS;
+        steps >>= 1;
+    }
+    return jump;
+}
+
+/**
+ * @brief Advances a random number generator seed by the given number
+ *        of steps, giving the same result as calling rand_num that
+ *        many times but in logarithmic time
+ * @param seed Random number generator seed
+ * @param steps The number of steps to jump ahead
+ */
+void rand_jump(unsigned int * seed, unsigned long long steps)
+{
+    if (steps == 0)
+        return;
+
+    /* a seed which is a multiple of the modulus hits the singularity
+       handled within rand_num, so take the first step normally */
+    if ((unsigned long long)*seed % PRNG_MODULUS == 0) {
+        rand_num(seed);
+        steps--;
+    }
+
+    *seed = (unsigned int)(((unsigned long long)*seed *
+                            rand_jump_multiplier(steps)) % PRNG_MODULUS);
+}
+
+/**
+ * @brief Initialises a set of per-thread random number streams.
+ *        Each stream begins a fixed distance further along the sequence
+ *        generated from the given seed, so that the streams do not overlap
+ * @param streams Array of streams to be initialised
+ * @param no_of_streams The number of streams
+ * @param seed Random number generator seed
+ */
+void rand_streams_init(rand_stream * streams, int no_of_streams,
+                       unsigned int seed)
+{
+    /* every stream is the same jump from the one before, so the
+       multiplier is only found once */
+    unsigned long long jump = rand_jump_multiplier(RAND_STREAM_SPACING);
+    unsigned int s = seed;
+
+    for (int i = 0; i < no_of_streams; i++) {
+        if ((unsigned long long)s % PRNG_MODULUS == 0)
+            rand_jump(&s, RAND_STREAM_SPACING);
+        else
+            s = (unsigned int)(((unsigned long long)s * jump) %
+                               PRNG_MODULUS);
+        memset(&streams[i], 0, sizeof(rand_stream));
+        streams[i].seed = s;
+    }
+}
+
+/**
+ * @brief Returns the seed belonging to the calling thread
+ * @param streams Array of per-thread streams
+ * @param no_of_streams The number of streams
+ * @return Random number generator seed for the current thread
+ */
+unsigned int * rand_stream_seed(rand_stream * streams, int no_of_streams)
+{
+#ifdef _OPENMP
+    return &streams[omp_get_thread_num() % no_of_streams].seed;
+#else
+    return &streams[0].seed;
+#endif
+}
+
+/**
+ * @brief Fills an array with uniformly distributed noise in the range
+ *        -magnitude -> magnitude.  Rather than calling rand_num for each
+ *        value, a small set of xorshift generators seeded from the given
+ *        seed are stepped together, which the compiler can vectorise
+ * @param seed Random number generator seed
+ * @param values Array to be filled
+ * @param no_of_values The number of values in the array
+ * @param magnitude Maximum absolute value of the noise
+ */
+void rand_noise(unsigned int * seed, float * values, int no_of_values,
+                float magnitude)
+{
+    unsigned int lane[RAND_NOISE_LANES];
+    const float scale = 2.0f * magnitude / 16777216.0f;
+    int i = 0;
+
+    /* rand_num never returns zero, which is a fixed point of xorshift */
+    for (int j = 0; j < RAND_NOISE_LANES; j++)
+        lane[j] = rand_num(seed);
+
+    for (; i + RAND_NOISE_LANES <= no_of_values; i += RAND_NOISE_LANES) {
+        for (int j = 0; j < RAND_NOISE_LANES; j++) {
+            lane[j] ^= lane[j] << 13;
+            lane[j] ^= lane[j] >> 17;
+            lane[j] ^= lane[j] << 5;
+            values[i + j] = (float)(lane[j] >> 8)*scale - magnitude;
+        }
+    }
+
+    for (int j = 0; i < no_of_values; i++, j++) {
+        lane[j] ^= lane[j] << 13;
+        lane[j] ^= lane[j] >> 17;
+        lane[j] ^= lane[j] << 5;
+        values[i] = (float)(lane[j] >> 8)*scale - magnitude;
+    }
+}
+
+/**
+ * @brief Mixes the bits of a value so that neighbouring inputs give
+ *        unrelated outputs. This is a bijection, so distinct inputs
+ *        always give distinct outputs
+ * @param x The value to be mixed
+ * @return Mixed value
+ */
+unsigned int rand_mix(unsigned int x)
+{
+    x ^= x >> 16;
+    x *= RAND_MIX_MULTIPLIER1;
+    x ^= x >> 15;
+    x *= RAND_MIX_MULTIPLIER2;
+    x ^= x >> 16;
+    return x;
+}
+
+/**
+ * @brief Counter based random number generator. Rather than stepping a
+ *        seed, the value for any position within the sequence given by
+ *        a key is calculated directly, so values can be generated in any
+ *        order, on any thread, and many at a time
+ * @param key Selects the sequence
+ * @param counter Position within the sequence
+ * @return Pseudo-random number
+ */
+unsigned int rand_counter(unsigned int key, unsigned int counter)
+{
+    return rand_mix(rand_mix(key) + counter*RAND_COUNTER_STEP);
+}
+
+/**
+ * @brief Returns a counter based random number in the range
+ *        0 -> range-1, using a multiply and shift rather than a modulo
+ * @param key Selects the sequence
+ * @param counter Position within the sequence
+ * @param range The number of possible values
+ * @return Pseudo-random number
+ */
+unsigned int rand_range(unsigned int key, unsigned int counter,
+                        unsigned int range)
+{
+    return (unsigned int)(((unsigned long long)rand_counter(key, counter) *
+                           range) >> 32);
+}
+
+/**
+ * @brief Returns the threshold below which a counter based random
+ *        number falls with the given probability
+ * @param probability Probability in the range 0 -> RAND_MASK_RANGE
+ * @return Threshold for use with rand_mask
+ */
+unsigned int rand_mask_threshold(unsigned int probability)
+{
+    if (probability >= RAND_MASK_RANGE)
+        return 0xffffffffU;
+
+    return (unsigned int)(((unsigned long long)probability << 32) /
+                          RAND_MASK_RANGE);
+}
+
+/**
+ * @brief Fills a packed bit mask in which each bit is set if the counter
+ *        based random number at its position is at or above the given
+ *        threshold. Bit j is bit j%RAND_MASK_BITS of word
+ *        j/RAND_MASK_BITS, and is the same as comparing
+ *        rand_counter(key, counter+j) with the threshold.
+ *        The numbers are generated many at a time by the vector kernels
+ * @param key Selects the sequence
+ * @param counter Position within the sequence of the first bit
+ * @param mask Array of (no_of_bits+RAND_MASK_BITS-1)/RAND_MASK_BITS words
+ * @param no_of_bits The number of bits in the mask
+ * @param threshold Threshold returned by rand_mask_threshold
+ */
+void rand_mask(unsigned int key, unsigned int counter,
+               unsigned int * mask, int no_of_bits,
+               unsigned int threshold)
+{
+    deeplearn_counter_mask(rand_mix(key), counter, mask,
+                           (no_of_bits + RAND_MASK_BITS - 1) /
+                           RAND_MASK_BITS, threshold);
+}
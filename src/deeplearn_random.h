@@ -38,7 +38,51 @@
 #include <math.h>
 #include <assert.h>
 
+/* size of a cache line, used to keep per-thread states apart */
+#define RAND_STREAM_CACHE_LINE 64
+
+/* number of steps between the start of consecutive streams */
+#define RAND_STREAM_SPACING    (1ULL << 24)
+
+/* number of independent generators interleaved when filling arrays
+   with noise, so that the compiler can vectorise the loop */
+#define RAND_NOISE_LANES       8
+
+/* constants of the counter based generator. The key is mixed, the
+   counter is scaled by the step and added, and the sum is mixed again */
+#define RAND_COUNTER_STEP      0x9e3779b9U
+#define RAND_MIX_MULTIPLIER1   0x7feb352dU
+#define RAND_MIX_MULTIPLIER2   0x846ca68bU
+
+/* number of bits within each word of a dropout mask */
+#define RAND_MASK_BITS         32
+
+/* probabilities given to rand_mask_threshold are in the range
+   0 -> RAND_MASK_RANGE */
+#define RAND_MASK_RANGE        10000
+
+/* random number generator state for a single thread, padded so
+   that no two threads share a cache line */
+typedef struct {
+    unsigned int seed;
+    unsigned char padding[RAND_STREAM_CACHE_LINE - sizeof(unsigned int)];
+} rand_stream;
+
 unsigned int rand_num(unsigned int * seed);
 float rand_initial_weight(unsigned int * seed, int no_of_inputs);
+void rand_jump(unsigned int * seed, unsigned long long steps);
+void rand_streams_init(rand_stream * streams, int no_of_streams,
+                       unsigned int seed);
+unsigned int * rand_stream_seed(rand_stream * streams, int no_of_streams);
+void rand_noise(unsigned int * seed, float * values, int no_of_values,
+                float magnitude);
+unsigned int rand_mix(unsigned int x);
+unsigned int rand_counter(unsigned int key, unsigned int counter);
+unsigned int rand_range(unsigned int key, unsigned int counter,
+                        unsigned int range);
+unsigned int rand_mask_threshold(unsigned int probability);
+void rand_mask(unsigned int key, unsigned int counter,
+               unsigned int * mask, int no_of_bits,
+               unsigned int threshold);
 
 #endif
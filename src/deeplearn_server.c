@@ -0,0 +1,845 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* sockets and monotonic clocks are not part of c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include "deeplearn_server.h"
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/* the header sent to a client when it connects */
+#define SERVER_HEADER_VALUES  3
+
+/* how often the accepting thread checks whether to stop */
+#define SERVER_POLL_MS        100
+
+/**
+ * @brief Returns the time from a monotonic clock
+ * @returns Time in seconds
+ */
+static double server_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec*1.0e-9;
+}
+
+/**
+ * @brief Sends a buffer of the given size to a socket
+ * @returns zero on success
+ */
+static int server_send_all(int sock, const void * buffer, size_t bytes)
+{
+    const unsigned char * ptr = (const unsigned char*)buffer;
+
+    while (bytes > 0) {
+        ssize_t sent = send(sock, ptr, bytes, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return -1;
+        ptr += sent;
+        bytes -= (size_t)sent;
+    }
+    return 0;
+}
+
+/**
+ * @brief Receives a buffer of the given size from a socket
+ * @returns zero on success
+ */
+static int server_receive_all(int sock, void * buffer, size_t bytes)
+{
+    unsigned char * ptr = (unsigned char*)buffer;
+
+    while (bytes > 0) {
+        ssize_t received = recv(sock, ptr, bytes, 0);
+        if (received <= 0)
+            return -1;
+        ptr += received;
+        bytes -= (size_t)received;
+    }
+    return 0;
+}
+
+/**
+ * @brief Initialises an inference server for a learner. The learner
+ *        should not be trained while the server is running
+ * @param server Server object
+ * @param learner Deep learner object
+ * @param max_batch The largest number of samples in a batch
+ * @param latency_budget_us How long in microseconds the first request
+ *        of a batch may wait for others to arrive
+ * @returns zero on success
+ */
+int deeplearn_server_init(deeplearn_server * server, deeplearn * learner,
+                          int max_batch, int latency_budget_us)
+{
+    pthread_condattr_t attr;
+
+    memset(server, 0, sizeof(deeplearn_server));
+    server->listener = -1;
+
+    if ((max_batch < 1) || (latency_budget_us < 0))
+        return -1;
+
+    /* text fields can't be sent as floats */
+    COUNTUP(i, learner->no_of_input_fields) {
+        if (learner->field_length[i] > 0)
+            return -2;
+    }
+
+    server->learner = learner;
+    server->max_batch = max_batch;
+    server->latency_budget_us = latency_budget_us;
+
+    server->batch_capacity = max_batch;
+    FLOATALLOC(server->batch_inputs,
+               max_batch*learner->net->no_of_inputs);
+    if (!server->batch_inputs)
+        return -3;
+    FLOATALLOC(server->batch_outputs,
+               max_batch*learner->net->no_of_outputs);
+    if (!server->batch_outputs) {
+        free(server->batch_inputs);
+        server->batch_inputs = 0;
+        return -4;
+    }
+
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&server->arrived, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&server->completed, NULL);
+    return 0;
+}
+
+/**
+ * @brief Runs a batch of requests through the learner
+ * @param server Server object
+ * @param batch List of requests
+ * @param samples The total number of samples in the requests
+ * @returns zero on success
+ */
+static int server_run_batch(deeplearn_server * server,
+                            deeplearn_server_request * batch, int samples)
+{
+    deeplearn * learner = server->learner;
+    int no_of_inputs = learner->net->no_of_inputs;
+    int no_of_outputs = learner->net->no_of_outputs;
+    float * inputs, * outputs;
+    int retval;
+
+    /* a single request may be larger than the usual batch */
+    if (samples > server->batch_capacity) {
+        float * new_inputs =
+            (float*)realloc(server->batch_inputs,
+                            samples*no_of_inputs*sizeof(float));
+        if (!new_inputs)
+            return -1;
+        server->batch_inputs = new_inputs;
+
+        float * new_outputs =
+            (float*)realloc(server->batch_outputs,
+                            samples*no_of_outputs*sizeof(float));
+        if (!new_outputs)
+            return -2;
+        server->batch_outputs = new_outputs;
+        server->batch_capacity = samples;
+    }
+
+    /* normalise into the range of the input units */
+    inputs = server->batch_inputs;
+    for (deeplearn_server_request * r = batch; r != 0; r = r->next) {
+        COUNTUP(s, r->samples) {
+            const float * sample = &r->inputs[s*no_of_inputs];
+
+            COUNTUP(i, no_of_inputs) {
+                float range =
+                    learner->input_range_max[i] -
+                    learner->input_range_min[i];
+
+                inputs[i] = sample[i];
+                if (range > 0)
+                    inputs[i] =
+                        (((sample[i] - learner->input_range_min[i])/
+                          range)*NEURON_RANGE) + NEURON_LOW;
+            }
+            inputs += no_of_inputs;
+        }
+    }
+
+    retval = deeplearn_feed_forward_batch(learner, server->batch_inputs,
+                                          samples, server->batch_outputs);
+    if (retval != 0)
+        return -3;
+
+    /* return the outputs in the range of the training data */
+    outputs = server->batch_outputs;
+    for (deeplearn_server_request * r = batch; r != 0; r = r->next) {
+        COUNTUP(s, r->samples) {
+            float * sample = &r->outputs[s*no_of_outputs];
+
+            COUNTUP(i, no_of_outputs) {
+                float range =
+                    learner->output_range_max[i] -
+                    learner->output_range_min[i];
+
+                sample[i] = outputs[i];
+                if (range > 0)
+                    sample[i] =
+                        (((outputs[i] - NEURON_LOW)/NEURON_RANGE)*range) +
+                        learner->output_range_min[i];
+            }
+            outputs += no_of_outputs;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Thread which collects queued requests into batches.
+ *        A batch is run once it is full or once its oldest request
+ *        has waited for the latency budget
+ * @param arg Server object
+ */
+static void * server_batch_thread(void * arg)
+{
+    deeplearn_server * server = (deeplearn_server*)arg;
+    double budget = server->latency_budget_us*1.0e-6;
+
+    pthread_mutex_lock(&server->lock);
+    for (;;) {
+        deeplearn_server_request * batch, * last = 0;
+        int samples = 0, status;
+        double deadline, now;
+
+        while (!server->stop && !server->head)
+            pthread_cond_wait(&server->arrived, &server->lock);
+        if (server->stop)
+            break;
+
+        deadline = server->head->arrival + budget;
+        while (!server->stop &&
+               (server->pending_samples < server->max_batch)) {
+            struct timespec until;
+
+            if (server_time() >= deadline)
+                break;
+            until.tv_sec = (time_t)deadline;
+            until.tv_nsec = (long)((deadline - until.tv_sec)*1.0e9);
+            pthread_cond_timedwait(&server->arrived, &server->lock,
+                                   &until);
+        }
+        if (server->stop)
+            break;
+
+        /* take whole requests from the front of the queue */
+        batch = server->head;
+        while (server->head &&
+               ((samples == 0) ||
+                (samples + server->head->samples <= server->max_batch))) {
+            samples += server->head->samples;
+            last = server->head;
+            server->head = server->head->next;
+        }
+        last->next = 0;
+        if (!server->head)
+            server->tail = 0;
+        server->pending_samples -= samples;
+        pthread_mutex_unlock(&server->lock);
+
+        status = server_run_batch(server, batch, samples);
+
+        pthread_mutex_lock(&server->lock);
+        now = server_time();
+        while (batch) {
+            deeplearn_server_request * r = batch;
+            double latency = now - r->arrival;
+
+            batch = r->next;
+            server->stats.requests++;
+            if (status == 0)
+                server->stats.samples += r->samples;
+            else
+                server->stats.failed++;
+            server->stats.total_latency += latency;
+            if (latency > server->stats.max_latency)
+                server->stats.max_latency = latency;
+            r->status = status;
+            r->done = 1;
+        }
+        server->stats.batches++;
+        pthread_cond_broadcast(&server->completed);
+    }
+
+    /* fail anything which is still waiting */
+    while (server->head) {
+        deeplearn_server_request * r = server->head;
+
+        server->head = r->next;
+        server->stats.failed++;
+        r->status = -1;
+        r->done = 1;
+    }
+    server->tail = 0;
+    server->pending_samples = 0;
+    pthread_cond_broadcast(&server->completed);
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+/**
+ * @brief Queues a request and waits for the batching thread to run it
+ * @param server Server object
+ * @param request The request
+ * @returns zero on success
+ */
+static int server_submit(deeplearn_server * server,
+                         deeplearn_server_request * request)
+{
+    pthread_mutex_lock(&server->lock);
+    if (server->stop) {
+        pthread_mutex_unlock(&server->lock);
+        return -1;
+    }
+
+    request->arrival = server_time();
+    request->done = 0;
+    request->next = 0;
+    if (server->tail)
+        server->tail->next = request;
+    else
+        server->head = request;
+    server->tail = request;
+    server->pending_samples += request->samples;
+    pthread_cond_signal(&server->arrived);
+
+    while (!request->done)
+        pthread_cond_wait(&server->completed, &server->lock);
+    pthread_mutex_unlock(&server->lock);
+    return request->status;
+}
+
+/**
+ * @brief Thread which reads requests from a client and sends back
+ *        the replies, until the client disconnects
+ * @param arg Connection object
+ */
+static void * server_connection_thread(void * arg)
+{
+    deeplearn_server_connection * connection =
+        (deeplearn_server_connection*)arg;
+    deeplearn_server * server = connection->server;
+    int no_of_inputs = server->learner->net->no_of_inputs;
+    int no_of_outputs = server->learner->net->no_of_outputs;
+    int header[SERVER_HEADER_VALUES] = {
+        DEEPLEARN_SERVER_MAGIC, no_of_inputs, no_of_outputs
+    };
+    float * inputs = 0, * reply = 0;
+    int capacity = 0;
+
+    if (server_send_all(connection->sock, header, sizeof(header)) != 0)
+        goto done;
+
+    for (;;) {
+        deeplearn_server_request request;
+        int samples, status;
+
+        if (server_receive_all(connection->sock, &samples,
+                               sizeof(int)) != 0)
+            break;
+
+        if ((samples < 1) || (samples > DEEPLEARN_SERVER_MAX_SAMPLES)) {
+            status = -1;
+            server_send_all(connection->sock, &status, sizeof(int));
+            break;
+        }
+
+        if (samples > capacity) {
+            free(inputs);
+            free(reply);
+            FLOATALLOC(inputs, samples*no_of_inputs);
+            /* the reply holds the status followed by the outputs */
+            FLOATALLOC(reply, 1 + samples*no_of_outputs);
+            if ((!inputs) || (!reply))
+                break;
+            capacity = samples;
+        }
+
+        if (server_receive_all(connection->sock, inputs,
+                               samples*no_of_inputs*sizeof(float)) != 0)
+            break;
+
+        request.inputs = inputs;
+        request.outputs = &reply[1];
+        request.samples = samples;
+        status = server_submit(server, &request);
+        memcpy(reply, &status, sizeof(int));
+
+        if (status != 0) {
+            server_send_all(connection->sock, reply, sizeof(int));
+            break;
+        }
+        if (server_send_all(connection->sock, reply,
+                            (1 + samples*no_of_outputs)*
+                            sizeof(float)) != 0)
+            break;
+    }
+
+ done:
+    free(inputs);
+    free(reply);
+
+    pthread_mutex_lock(&server->lock);
+    connection->done = 1;
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+/**
+ * @brief Thread which accepts clients and gives each one a thread
+ * @param arg Server object
+ */
+static void * server_accept_thread(void * arg)
+{
+    deeplearn_server * server = (deeplearn_server*)arg;
+
+    for (;;) {
+        struct pollfd fds;
+        int sock, stop, enable = 1;
+        deeplearn_server_connection * connection = 0;
+
+        pthread_mutex_lock(&server->lock);
+        stop = server->stop;
+        pthread_mutex_unlock(&server->lock);
+        if (stop)
+            break;
+
+        fds.fd = server->listener;
+        fds.events = POLLIN;
+        fds.revents = 0;
+        if (poll(&fds, 1, SERVER_POLL_MS) <= 0)
+            continue;
+
+        sock = accept(server->listener, NULL, NULL);
+        if (sock < 0)
+            continue;
+        if (!server->unix_path)
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
+                       &enable, sizeof(enable));
+
+        pthread_mutex_lock(&server->lock);
+        COUNTUP(i, DEEPLEARN_SERVER_CONNECTIONS) {
+            deeplearn_server_connection * c = &server->connection[i];
+
+            if (c->running && c->done) {
+                pthread_mutex_unlock(&server->lock);
+                pthread_join(c->thread, NULL);
+                pthread_mutex_lock(&server->lock);
+                close(c->sock);
+                c->running = 0;
+            }
+            if (!c->running) {
+                connection = c;
+                break;
+            }
+        }
+
+        /* the thread is created while holding the lock so that
+           deeplearn_server_stop can always see its socket */
+        if ((!connection) || server->stop) {
+            close(sock);
+        }
+        else {
+            connection->server = server;
+            connection->sock = sock;
+            connection->done = 0;
+            connection->running = 1;
+            if (pthread_create(&connection->thread, NULL,
+                               server_connection_thread,
+                               connection) != 0) {
+                close(sock);
+                connection->running = 0;
+            }
+        }
+        pthread_mutex_unlock(&server->lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Starts the threads of a server once it is listening
+ * @param server Server object
+ * @returns zero on success
+ */
+static int server_start(deeplearn_server * server)
+{
+    if (listen(server->listener, SOMAXCONN) != 0)
+        return -1;
+
+    server->stop = 0;
+    server->started = server_time();
+
+    if (pthread_create(&server->batch_thread, NULL,
+                       server_batch_thread, server) != 0)
+        return -2;
+
+    if (pthread_create(&server->accept_thread, NULL,
+                       server_accept_thread, server) != 0) {
+        pthread_mutex_lock(&server->lock);
+        server->stop = 1;
+        pthread_cond_broadcast(&server->arrived);
+        pthread_mutex_unlock(&server->lock);
+        pthread_join(server->batch_thread, NULL);
+        return -3;
+    }
+
+    server->running = 1;
+    return 0;
+}
+
+/**
+ * @brief Starts serving over tcp
+ * @param server Server object
+ * @param port The port to listen on, or zero to have one assigned,
+ *        which is then returned in server->port
+ * @returns zero on success
+ */
+int deeplearn_server_start_tcp(deeplearn_server * server, int port)
+{
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    int enable = 1;
+
+    if (server->running)
+        return -1;
+
+    server->listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (server->listener < 0)
+        return -2;
+    setsockopt(server->listener, SOL_SOCKET, SO_REUSEADDR,
+               &enable, sizeof(enable));
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((unsigned short)port);
+
+    if ((bind(server->listener, (struct sockaddr*)&address,
+              sizeof(address)) != 0) ||
+        (getsockname(server->listener, (struct sockaddr*)&address,
+                     &length) != 0) ||
+        (server_start(server) != 0)) {
+        close(server->listener);
+        server->listener = -1;
+        return -3;
+    }
+
+    server->port = ntohs(address.sin_port);
+    return 0;
+}
+
+/**
+ * @brief Starts serving over a unix domain socket. Any existing file
+ *        at the path is replaced
+ * @param server Server object
+ * @param path Filename of the socket
+ * @returns zero on success
+ */
+int deeplearn_server_start_unix(deeplearn_server * server,
+                                const char * path)
+{
+    struct sockaddr_un address;
+
+    if (server->running)
+        return -1;
+
+    if (strlen(path) >= sizeof(address.sun_path))
+        return -2;
+
+    server->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server->listener < 0)
+        return -3;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+
+    CHARALLOC(server->unix_path, strlen(path) + 1);
+    if (!server->unix_path) {
+        close(server->listener);
+        server->listener = -1;
+        return -4;
+    }
+    strcpy(server->unix_path, path);
+
+    if ((bind(server->listener, (struct sockaddr*)&address,
+              sizeof(address)) != 0) ||
+        (server_start(server) != 0)) {
+        close(server->listener);
+        server->listener = -1;
+        unlink(path);
+        free(server->unix_path);
+        server->unix_path = 0;
+        return -5;
+    }
+    return 0;
+}
+
+/**
+ * @brief Stops a server. Clients are disconnected and any requests
+ *        which have not yet been batched fail
+ * @param server Server object
+ */
+void deeplearn_server_stop(deeplearn_server * server)
+{
+    if (!server->running)
+        return;
+
+    pthread_mutex_lock(&server->lock);
+    server->stop = 1;
+    pthread_cond_broadcast(&server->arrived);
+
+    /* wake any connection threads which are blocked on their sockets */
+    COUNTUP(i, DEEPLEARN_SERVER_CONNECTIONS) {
+        if (server->connection[i].running)
+            shutdown(server->connection[i].sock, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    pthread_join(server->accept_thread, NULL);
+    pthread_join(server->batch_thread, NULL);
+
+    COUNTUP(i, DEEPLEARN_SERVER_CONNECTIONS) {
+        deeplearn_server_connection * c = &server->connection[i];
+
+        if (c->running) {
+            pthread_join(c->thread, NULL);
+            close(c->sock);
+            c->running = 0;
+        }
+    }
+
+    close(server->listener);
+    server->listener = -1;
+    if (server->unix_path) {
+        unlink(server->unix_path);
+        free(server->unix_path);
+        server->unix_path = 0;
+    }
+    server->running = 0;
+}
+
+/**
+ * @brief Returns the throughput and latency counters of a server
+ * @param server Server object
+ * @param stats Returned counters
+ */
+void deeplearn_server_get_stats(deeplearn_server * server,
+                                deeplearn_server_stats * stats)
+{
+    pthread_mutex_lock(&server->lock);
+    *stats = server->stats;
+    if (server->started > 0)
+        stats->uptime = server_time() - server->started;
+    pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * @brief Stops a server and frees its memory. The learner is not freed
+ * @param server Server object
+ */
+void deeplearn_server_free(deeplearn_server * server)
+{
+    if (!server->learner)
+        return;
+
+    deeplearn_server_stop(server);
+    free(server->batch_inputs);
+    free(server->batch_outputs);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->arrived);
+    pthread_cond_destroy(&server->completed);
+    server->learner = 0;
+}
+
+/**
+ * @brief Reads the header which a server sends when a client connects
+ * @param client Client object
+ * @returns zero on success
+ */
+static int server_client_handshake(deeplearn_server_client * client)
+{
+    int header[SERVER_HEADER_VALUES];
+
+    if ((server_receive_all(client->sock, header, sizeof(header)) != 0) ||
+        (header[0] != DEEPLEARN_SERVER_MAGIC)) {
+        close(client->sock);
+        client->sock = -1;
+        return -1;
+    }
+
+    client->no_of_inputs = header[1];
+    client->no_of_outputs = header[2];
+    return 0;
+}
+
+/**
+ * @brief Connects to a server over tcp
+ * @param client Returned client object
+ * @param host Name or address of the server
+ * @param port Port which the server is listening on
+ * @returns zero on success
+ */
+int deeplearn_server_connect_tcp(deeplearn_server_client * client,
+                                 const char * host, int port)
+{
+    struct addrinfo hints, * result;
+    char port_str[16];
+    int enable = 1;
+
+    client->sock = -1;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    sprintf(port_str, "%d", port);
+    if (getaddrinfo(host, port_str, &hints, &result) != 0)
+        return -1;
+
+    client->sock = socket(result->ai_family, result->ai_socktype,
+                          result->ai_protocol);
+    if ((client->sock < 0) ||
+        (connect(client->sock, result->ai_addr,
+                 result->ai_addrlen) != 0)) {
+        if (client->sock >= 0)
+            close(client->sock);
+        client->sock = -1;
+        freeaddrinfo(result);
+        return -2;
+    }
+    freeaddrinfo(result);
+
+    setsockopt(client->sock, IPPROTO_TCP, TCP_NODELAY,
+               &enable, sizeof(enable));
+
+    if (server_client_handshake(client) != 0)
+        return -3;
+    return 0;
+}
+
+/**
+ * @brief Connects to a server over a unix domain socket
+ * @param client Returned client object
+ * @param path Filename of the socket
+ * @returns zero on success
+ */
+int deeplearn_server_connect_unix(deeplearn_server_client * client,
+                                  const char * path)
+{
+    struct sockaddr_un address;
+
+    client->sock = -1;
+    if (strlen(path) >= sizeof(address.sun_path))
+        return -1;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    client->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client->sock < 0)
+        return -2;
+
+    if (connect(client->sock, (struct sockaddr*)&address,
+                sizeof(address)) != 0) {
+        close(client->sock);
+        client->sock = -1;
+        return -3;
+    }
+
+    if (server_client_handshake(client) != 0)
+        return -4;
+    return 0;
+}
+
+/**
+ * @brief Sends samples to a server and waits for the outputs
+ * @param client Client object
+ * @param inputs samples x no_of_inputs array of input values
+ * @param samples The number of samples
+ * @param outputs Returned samples x no_of_outputs array of output values
+ * @returns zero on success
+ */
+int deeplearn_server_predict(deeplearn_server_client * client,
+                             const float * inputs, int samples,
+                             float * outputs)
+{
+    int status;
+
+    if (client->sock < 0)
+        return -1;
+
+    if ((server_send_all(client->sock, &samples, sizeof(int)) != 0) ||
+        (server_send_all(client->sock, inputs,
+                         samples*client->no_of_inputs*
+                         sizeof(float)) != 0))
+        return -2;
+
+    if (server_receive_all(client->sock, &status, sizeof(int)) != 0)
+        return -3;
+    if (status != 0)
+        return -4;
+
+    if (server_receive_all(client->sock, outputs,
+                           samples*client->no_of_outputs*
+                           sizeof(float)) != 0)
+        return -5;
+    return 0;
+}
+
+/**
+ * @brief Disconnects from a server
+ * @param client Client object
+ */
+void deeplearn_server_disconnect(deeplearn_server_client * client)
+{
+    if (client->sock >= 0)
+        close(client->sock);
+    client->sock = -1;
+}
@@ -0,0 +1,157 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEEPLEARN_SERVER_H
+#define DEEPLEARN_SERVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "globals.h"
+#include "deeplearn.h"
+
+/* Protocol between the server and its clients. All values are 32 bits
+   wide and in the byte order of the server, as for the model files.
+   When a client connects the server sends a header of
+   DEEPLEARN_SERVER_MAGIC, no_of_inputs and no_of_outputs.
+   Each request is then an int sample count followed by that many
+   samples of no_of_inputs floats, in the ranges of the training data.
+   The reply is an int status, followed on success by the same number
+   of samples of no_of_outputs floats */
+
+/* counters which are kept by the server */
+typedef struct {
+    unsigned long requests;
+    unsigned long samples;
+    unsigned long batches;
+    unsigned long failed;
+
+    /* seconds between a request arriving and its reply being ready */
+    double total_latency;
+    double max_latency;
+
+    /* seconds since the server was started */
+    double uptime;
+} deeplearn_server_stats;
+
+/* a request which is waiting to be batched */
+typedef struct deeplearn_server_request {
+    const float * inputs;
+    float * outputs;
+    int samples;
+    double arrival;
+
+    /* set by the batching thread once the outputs are ready */
+    int done;
+    int status;
+
+    struct deeplearn_server_request * next;
+} deeplearn_server_request;
+
+/* a connected client */
+typedef struct {
+    struct deeplearn_server * server;
+    pthread_t thread;
+    int sock;
+
+    /* non-zero while the thread has not been joined */
+    int running;
+
+    /* set by the thread once the client has gone */
+    int done;
+} deeplearn_server_connection;
+
+/* An inference server which keeps a loaded learner in memory.
+   Requests from concurrent clients are queued, and a single thread
+   runs them through deeplearn_feed_forward_batch together, waiting
+   up to a latency budget for a batch to fill */
+typedef struct deeplearn_server {
+    deeplearn * learner;
+    int max_batch;
+    int latency_budget_us;
+
+    int listener;
+    char * unix_path;
+
+    /* tcp port, which is assigned when started on port zero */
+    int port;
+
+    pthread_mutex_t lock;
+    pthread_cond_t arrived;
+    pthread_cond_t completed;
+
+    /* queue of requests, oldest first */
+    deeplearn_server_request * head;
+    deeplearn_server_request * tail;
+    int pending_samples;
+
+    /* normalised batch buffers */
+    float * batch_inputs;
+    float * batch_outputs;
+    int batch_capacity;
+
+    pthread_t accept_thread;
+    pthread_t batch_thread;
+    int running;
+    int stop;
+
+    deeplearn_server_connection connection[DEEPLEARN_SERVER_CONNECTIONS];
+
+    double started;
+    deeplearn_server_stats stats;
+} deeplearn_server;
+
+/* client side of the protocol */
+typedef struct {
+    int sock;
+    int no_of_inputs;
+    int no_of_outputs;
+} deeplearn_server_client;
+
+int deeplearn_server_init(deeplearn_server * server, deeplearn * learner,
+                          int max_batch, int latency_budget_us);
+int deeplearn_server_start_tcp(deeplearn_server * server, int port);
+int deeplearn_server_start_unix(deeplearn_server * server,
+                                const char * path);
+void deeplearn_server_stop(deeplearn_server * server);
+void deeplearn_server_get_stats(deeplearn_server * server,
+                                deeplearn_server_stats * stats);
+void deeplearn_server_free(deeplearn_server * server);
+
+int deeplearn_server_connect_tcp(deeplearn_server_client * client,
+                                 const char * host, int port);
+int deeplearn_server_connect_unix(deeplearn_server_client * client,
+                                  const char * path);
+int deeplearn_server_predict(deeplearn_server_client * client,
+                             const float * inputs, int samples,
+                             float * outputs);
+void deeplearn_server_disconnect(deeplearn_server_client * client);
+
+#endif
@@ -0,0 +1,956 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "deeplearn_simd.h"
+#include "deeplearn_random.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DEEPLEARN_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define DEEPLEARN_SIMD_ARM
+#include <arm_neon.h>
+#endif
+
+/* kernel table for one instruction set */
+typedef struct {
+    float (*dot)(const float * a, const float * b, int n);
+    void (*axpy)(float * y, float a, const float * x, int n);
+    void (*weight_update)(float * w, float * dw, const float * x,
+                          float e, int n);
+    int (*dot_int8)(const signed char * a, const signed char * b, int n);
+    float (*dot_bf16)(const unsigned short * a, const float * b, int n);
+    float (*dot_masked)(const float * a, const float * b,
+                        const unsigned int * mask, int n);
+    void (*counter_mask)(unsigned int mixed_key, unsigned int counter,
+                         unsigned int * mask, int no_of_words,
+                         unsigned int threshold);
+} deeplearn_simd_kernels;
+
+/* whether element j of an array is included by a packed bit mask */
+#define MASK_BIT(mask, j) (((mask)[(j) >> 5] >> ((j) & 31)) & 1U)
+
+/**
+ * @brief Returns the dot product of two arrays
+ * @param a First array
+ * @param b Second array
+ * @param n Length of the arrays
+ * @returns Sum of the elementwise products
+ */
+static float dot_scalar(const float * a, const float * b, int n)
+{
+    float sum = 0;
+
+    COUNTDOWN(j, n)
+        sum += a[j] * b[j];
+    return sum;
+}
+
+/**
+ * @brief Adds a scaled array to another, y = y + a*x.
+ *        This is the error scatter used during backpropagation
+ * @param y Array to be updated
+ * @param a Scaling factor
+ * @param x Array to be scaled
+ * @param n Length of the arrays
+ */
+static void axpy_scalar(float * y, float a, const float * x, int n)
+{
+    COUNTDOWN(j, n)
+        y[j] += a * x[j];
+}
+
+/**
+ * @brief Updates a row of weights using momentum, as in bp_neuron_learn
+ * @param w Weights to be updated
+ * @param dw Previous weight changes, which are also updated
+ * @param x Input values or gradients for each weight
+ * @param e Learning rate multiplied by the unit gradient
+ * @param n Length of the arrays
+ */
+static void weight_update_scalar(float * w, float * dw, const float * x,
+                                 float e, int n)
+{
+    COUNTDOWN(j, n) {
+        dw[j] = e * (dw[j] + 1) * x[j];
+        w[j] = CLIP_WEIGHT(w[j] + dw[j]);
+    }
+}
+
+/**
+ * @brief Returns the dot product of two arrays of quantized values
+ * @param a First array
+ * @param b Second array
+ * @param n Length of the arrays
+ * @returns Sum of the elementwise products
+ */
+static int dot_int8_scalar(const signed char * a, const signed char * b,
+                           int n)
+{
+    int sum = 0;
+
+    COUNTDOWN(j, n)
+        sum += (int)a[j] * (int)b[j];
+    return sum;
+}
+
+/**
+ * @brief Returns the dot product of an array of bfloat16 values with an
+ *        array of floats, accumulating in single precision
+ * @param a Array of bfloat16 values
+ * @param b Array of floats
+ * @param n Length of the arrays
+ * @returns Sum of the elementwise products
+ */
+static float dot_bf16_scalar(const unsigned short * a, const float * b,
+                             int n)
+{
+    float sum = 0;
+
+    COUNTDOWN(j, n)
+        sum += deeplearn_bf16_to_float(a[j]) * b[j];
+    return sum;
+}
+
+/**
+ * @brief Returns the dot product of two arrays, including only the
+ *        elements whose bits are set within a packed mask. The mask is
+ *        applied by multiplication rather than by branching
+ * @param a First array
+ * @param b Second array
+ * @param mask Packed bit mask, with bit j of the mask at bit j%32
+ *        of word j/32
+ * @param n Length of the arrays
+ * @returns Sum of the elementwise products which are included
+ */
+static float dot_masked_scalar(const float * a, const float * b,
+                               const unsigned int * mask, int n)
+{
+    float sum = 0;
+
+    COUNTDOWN(j, n)
+        sum += a[j] * b[j] * (float)MASK_BIT(mask, j);
+    return sum;
+}
+
+/**
+ * @brief Fills a packed bit mask from counter based random numbers,
+ *        as described for rand_mask
+ * @param mixed_key Key of the sequence, already passed through rand_mix
+ * @param counter Position within the sequence of the first bit
+ * @param mask Array of words to be filled
+ * @param no_of_words The number of words in the mask
+ * @param threshold Bits are set where the random number is at or above
+ *        this threshold
+ */
+static void counter_mask_scalar(unsigned int mixed_key, unsigned int counter,
+                                unsigned int * mask, int no_of_words,
+                                unsigned int threshold)
+{
+    unsigned int x = mixed_key + counter*RAND_COUNTER_STEP;
+
+    COUNTUP(w, no_of_words) {
+        unsigned int word = 0;
+
+        COUNTUP(b, RAND_MASK_BITS) {
+            word |= (unsigned int)(rand_mix(x) >= threshold) << b;
+            x += RAND_COUNTER_STEP;
+        }
+        mask[w] = word;
+    }
+}
+
+#ifdef DEEPLEARN_SIMD_X86
+
+__attribute__((target("avx2,fma")))
+static float dot_avx2(const float * a, const float * b, int n)
+{
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    __m128 lo;
+    float sum;
+    int j = 0;
+
+    for (; j + 16 <= n; j += 16) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[j]),
+                               _mm256_loadu_ps(&b[j]), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[j+8]),
+                               _mm256_loadu_ps(&b[j+8]), sum1);
+    }
+    for (; j + 8 <= n; j += 8)
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[j]),
+                               _mm256_loadu_ps(&b[j]), sum0);
+
+    /* horizontal sum */
+    sum0 = _mm256_add_ps(sum0, sum1);
+    lo = _mm_add_ps(_mm256_castps256_ps128(sum0),
+                    _mm256_extractf128_ps(sum0, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+    sum = _mm_cvtss_f32(lo);
+
+    for (; j < n; j++)
+        sum += a[j] * b[j];
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_avx2(float * y, float a, const float * x, int n)
+{
+    const __m256 va = _mm256_set1_ps(a);
+    int j = 0;
+
+    for (; j + 8 <= n; j += 8)
+        _mm256_storeu_ps(&y[j],
+                         _mm256_fmadd_ps(va, _mm256_loadu_ps(&x[j]),
+                                         _mm256_loadu_ps(&y[j])));
+    for (; j < n; j++)
+        y[j] += a * x[j];
+}
+
+__attribute__((target("avx2,fma")))
+static void weight_update_avx2(float * w, float * dw, const float * x,
+                               float e, int n)
+{
+    const __m256 ve = _mm256_set1_ps(e);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 lower = _mm256_set1_ps(-2.0f);
+    const __m256 upper = _mm256_set1_ps(2.0f);
+    int j = 0;
+
+    for (; j + 8 <= n; j += 8) {
+        __m256 d = _mm256_add_ps(_mm256_loadu_ps(&dw[j]), one);
+        d = _mm256_mul_ps(_mm256_mul_ps(ve, d), _mm256_loadu_ps(&x[j]));
+        _mm256_storeu_ps(&dw[j], d);
+        d = _mm256_add_ps(_mm256_loadu_ps(&w[j]), d);
+        d = _mm256_min_ps(_mm256_max_ps(d, lower), upper);
+        _mm256_storeu_ps(&w[j], d);
+    }
+    for (; j < n; j++) {
+        dw[j] = e * (dw[j] + 1) * x[j];
+        w[j] = CLIP_WEIGHT(w[j] + dw[j]);
+    }
+}
+
+__attribute__((target("avx2")))
+static int dot_int8_avx2(const signed char * a, const signed char * b,
+                         int n)
+{
+    __m256i sum0 = _mm256_setzero_si256();
+    __m128i lo;
+    int sum;
+    int j = 0;
+
+    /* widen to 16 bits, then multiply and add adjacent pairs */
+    for (; j + 16 <= n; j += 16) {
+        __m256i va =
+            _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)&a[j]));
+        __m256i vb =
+            _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)&b[j]));
+        sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(va, vb));
+    }
+
+    /* horizontal sum */
+    lo = _mm_add_epi32(_mm256_castsi256_si128(sum0),
+                       _mm256_extracti128_si256(sum0, 1));
+    lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, 0x4e));
+    lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, 0xb1));
+    sum = _mm_cvtsi128_si32(lo);
+
+    for (; j < n; j++)
+        sum += (int)a[j] * (int)b[j];
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static float dot_bf16_avx2(const unsigned short * a, const float * b,
+                           int n)
+{
+    __m256 sum0 = _mm256_setzero_ps();
+    __m128 lo;
+    float sum;
+    int j = 0;
+
+    /* bfloat16 is the upper half of a float */
+    for (; j + 8 <= n; j += 8) {
+        __m256i va =
+            _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&a[j]));
+        sum0 = _mm256_fmadd_ps(_mm256_castsi256_ps(_mm256_slli_epi32(va, 16)),
+                               _mm256_loadu_ps(&b[j]), sum0);
+    }
+
+    /* horizontal sum */
+    lo = _mm_add_ps(_mm256_castps256_ps128(sum0),
+                    _mm256_extractf128_ps(sum0, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+    sum = _mm_cvtss_f32(lo);
+
+    for (; j < n; j++)
+        sum += deeplearn_bf16_to_float(a[j]) * b[j];
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static float dot_masked_avx2(const float * a, const float * b,
+                             const unsigned int * mask, int n)
+{
+    const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256 sum0 = _mm256_setzero_ps();
+    __m128 lo;
+    float sum;
+    int j = 0;
+
+    /* each group of eight bits is expanded into a lane mask */
+    for (; j + 8 <= n; j += 8) {
+        __m256i m = _mm256_set1_epi32((int)(mask[j >> 5] >> (j & 31)));
+        __m256 keep = _mm256_castsi256_ps(
+            _mm256_cmpeq_epi32(_mm256_and_si256(m, bits), bits));
+        sum0 = _mm256_fmadd_ps(_mm256_and_ps(_mm256_loadu_ps(&a[j]), keep),
+                               _mm256_loadu_ps(&b[j]), sum0);
+    }
+
+    /* horizontal sum */
+    lo = _mm_add_ps(_mm256_castps256_ps128(sum0),
+                    _mm256_extractf128_ps(sum0, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+    sum = _mm_cvtss_f32(lo);
+
+    for (; j < n; j++)
+        sum += a[j] * b[j] * (float)MASK_BIT(mask, j);
+    return sum;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i mix_avx2(__m256i x)
+{
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)RAND_MIX_MULTIPLIER1));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)RAND_MIX_MULTIPLIER2));
+    return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+
+__attribute__((target("avx2")))
+static void counter_mask_avx2(unsigned int mixed_key, unsigned int counter,
+                              unsigned int * mask, int no_of_words,
+                              unsigned int threshold)
+{
+    const __m256i step = _mm256_set1_epi32((int)(8*RAND_COUNTER_STEP));
+    const __m256i t = _mm256_set1_epi32((int)threshold);
+    __m256i x = _mm256_add_epi32(
+        _mm256_set1_epi32((int)(mixed_key + counter*RAND_COUNTER_STEP)),
+        _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                           _mm256_set1_epi32((int)RAND_COUNTER_STEP)));
+
+    COUNTUP(w, no_of_words) {
+        unsigned int word = 0;
+
+        /* unsigned v >= t is the same as max(v, t) == v */
+        COUNTUP(g, RAND_MASK_BITS/8) {
+            __m256i v = mix_avx2(x);
+            __m256i keep = _mm256_cmpeq_epi32(_mm256_max_epu32(v, t), v);
+            word |= (unsigned int)
+                _mm256_movemask_ps(_mm256_castsi256_ps(keep)) << (g*8);
+            x = _mm256_add_epi32(x, step);
+        }
+        mask[w] = word;
+    }
+}
+
+__attribute__((target("avx512f")))
+static float dot_avx512(const float * a, const float * b, int n)
+{
+    __m512 sum0 = _mm512_setzero_ps();
+    int j = 0;
+
+    for (; j + 16 <= n; j += 16)
+        sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(&a[j]),
+                               _mm512_loadu_ps(&b[j]), sum0);
+
+    /* remaining elements with a masked load */
+    if (j < n) {
+        __mmask16 m = (__mmask16)((1U << (n - j)) - 1);
+        sum0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, &a[j]),
+                               _mm512_maskz_loadu_ps(m, &b[j]), sum0);
+    }
+    return _mm512_reduce_add_ps(sum0);
+}
+
+__attribute__((target("avx512f")))
+static void axpy_avx512(float * y, float a, const float * x, int n)
+{
+    const __m512 va = _mm512_set1_ps(a);
+    int j = 0;
+
+    for (; j + 16 <= n; j += 16)
+        _mm512_storeu_ps(&y[j],
+                         _mm512_fmadd_ps(va, _mm512_loadu_ps(&x[j]),
+                                         _mm512_loadu_ps(&y[j])));
+    if (j < n) {
+        __mmask16 m = (__mmask16)((1U << (n - j)) - 1);
+        _mm512_mask_storeu_ps(&y[j], m,
+                              _mm512_fmadd_ps(va,
+                                              _mm512_maskz_loadu_ps(m, &x[j]),
+                                              _mm512_maskz_loadu_ps(m, &y[j])));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void weight_update_avx512(float * w, float * dw, const float * x,
+                                 float e, int n)
+{
+    const __m512 ve = _mm512_set1_ps(e);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 lower = _mm512_set1_ps(-2.0f);
+    const __m512 upper = _mm512_set1_ps(2.0f);
+    int j = 0;
+
+    for (; j < n; j += 16) {
+        __mmask16 m = (__mmask16)0xffff;
+        __m512 d;
+
+        if (n - j < 16)
+            m = (__mmask16)((1U << (n - j)) - 1);
+
+        d = _mm512_add_ps(_mm512_maskz_loadu_ps(m, &dw[j]), one);
+        d = _mm512_mul_ps(_mm512_mul_ps(ve, d),
+                          _mm512_maskz_loadu_ps(m, &x[j]));
+        _mm512_mask_storeu_ps(&dw[j], m, d);
+        d = _mm512_add_ps(_mm512_maskz_loadu_ps(m, &w[j]), d);
+        d = _mm512_min_ps(_mm512_max_ps(d, lower), upper);
+        _mm512_mask_storeu_ps(&w[j], m, d);
+    }
+}
+
+__attribute__((target("avx512f")))
+static float dot_bf16_avx512(const unsigned short * a, const float * b,
+                             int n)
+{
+    __m512 sum0 = _mm512_setzero_ps();
+    float sum;
+    int j = 0;
+
+    for (; j + 16 <= n; j += 16) {
+        __m512i va =
+            _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)&a[j]));
+        sum0 = _mm512_fmadd_ps(_mm512_castsi512_ps(_mm512_slli_epi32(va, 16)),
+                               _mm512_loadu_ps(&b[j]), sum0);
+    }
+    sum = _mm512_reduce_add_ps(sum0);
+
+    for (; j < n; j++)
+        sum += deeplearn_bf16_to_float(a[j]) * b[j];
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+static float dot_masked_avx512(const float * a, const float * b,
+                               const unsigned int * mask, int n)
+{
+    __m512 sum0 = _mm512_setzero_ps();
+    int j = 0;
+
+    /* sixteen bits of the mask are used directly as a lane mask */
+    for (; j + 16 <= n; j += 16) {
+        __mmask16 m = (__mmask16)(mask[j >> 5] >> (j & 31));
+        sum0 = _mm512_mask3_fmadd_ps(_mm512_loadu_ps(&a[j]),
+                                     _mm512_loadu_ps(&b[j]), sum0, m);
+    }
+
+    if (j < n) {
+        __mmask16 m = (__mmask16)((mask[j >> 5] >> (j & 31)) &
+                                  ((1U << (n - j)) - 1));
+        sum0 = _mm512_mask3_fmadd_ps(_mm512_maskz_loadu_ps(m, &a[j]),
+                                     _mm512_maskz_loadu_ps(m, &b[j]),
+                                     sum0, m);
+    }
+    return _mm512_reduce_add_ps(sum0);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i mix_avx512(__m512i x)
+{
+    x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+    x = _mm512_mullo_epi32(x, _mm512_set1_epi32((int)RAND_MIX_MULTIPLIER1));
+    x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 15));
+    x = _mm512_mullo_epi32(x, _mm512_set1_epi32((int)RAND_MIX_MULTIPLIER2));
+    return _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+}
+
+__attribute__((target("avx512f")))
+static void counter_mask_avx512(unsigned int mixed_key, unsigned int counter,
+                                unsigned int * mask, int no_of_words,
+                                unsigned int threshold)
+{
+    const __m512i step = _mm512_set1_epi32((int)(16*RAND_COUNTER_STEP));
+    const __m512i t = _mm512_set1_epi32((int)threshold);
+    __m512i x = _mm512_add_epi32(
+        _mm512_set1_epi32((int)(mixed_key + counter*RAND_COUNTER_STEP)),
+        _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                             8, 9, 10, 11, 12, 13, 14, 15),
+                           _mm512_set1_epi32((int)RAND_COUNTER_STEP)));
+
+    COUNTUP(w, no_of_words) {
+        unsigned int word = 0;
+
+        COUNTUP(g, RAND_MASK_BITS/16) {
+            word |= (unsigned int)
+                _mm512_cmpge_epu32_mask(mix_avx512(x), t) << (g*16);
+            x = _mm512_add_epi32(x, step);
+        }
+        mask[w] = word;
+    }
+}
+
+#endif
+
+#ifdef DEEPLEARN_SIMD_ARM
+
+static float dot_neon(const float * a, const float * b, int n)
+{
+    float32x4_t sum0 = vdupq_n_f32(0);
+    float32x4_t sum1 = vdupq_n_f32(0);
+    float sum;
+    int j = 0;
+
+    for (; j + 8 <= n; j += 8) {
+        sum0 = vfmaq_f32(sum0, vld1q_f32(&a[j]), vld1q_f32(&b[j]));
+        sum1 = vfmaq_f32(sum1, vld1q_f32(&a[j+4]), vld1q_f32(&b[j+4]));
+    }
+    for (; j + 4 <= n; j += 4)
+        sum0 = vfmaq_f32(sum0, vld1q_f32(&a[j]), vld1q_f32(&b[j]));
+
+    sum = vaddvq_f32(vaddq_f32(sum0, sum1));
+    for (; j < n; j++)
+        sum += a[j] * b[j];
+    return sum;
+}
+
+static void axpy_neon(float * y, float a, const float * x, int n)
+{
+    const float32x4_t va = vdupq_n_f32(a);
+    int j = 0;
+
+    for (; j + 4 <= n; j += 4)
+        vst1q_f32(&y[j], vfmaq_f32(vld1q_f32(&y[j]), va, vld1q_f32(&x[j])));
+    for (; j < n; j++)
+        y[j] += a * x[j];
+}
+
+static void weight_update_neon(float * w, float * dw, const float * x,
+                               float e, int n)
+{
+    const float32x4_t ve = vdupq_n_f32(e);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t lower = vdupq_n_f32(-2.0f);
+    const float32x4_t upper = vdupq_n_f32(2.0f);
+    int j = 0;
+
+    for (; j + 4 <= n; j += 4) {
+        float32x4_t d = vaddq_f32(vld1q_f32(&dw[j]), one);
+        d = vmulq_f32(vmulq_f32(ve, d), vld1q_f32(&x[j]));
+        vst1q_f32(&dw[j], d);
+        d = vaddq_f32(vld1q_f32(&w[j]), d);
+        vst1q_f32(&w[j], vminq_f32(vmaxq_f32(d, lower), upper));
+    }
+    for (; j < n; j++) {
+        dw[j] = e * (dw[j] + 1) * x[j];
+        w[j] = CLIP_WEIGHT(w[j] + dw[j]);
+    }
+}
+
+static int dot_int8_neon(const signed char * a, const signed char * b,
+                         int n)
+{
+    int32x4_t sum0 = vdupq_n_s32(0);
+    int sum;
+    int j = 0;
+
+    for (; j + 16 <= n; j += 16) {
+        int8x16_t va = vld1q_s8((const int8_t*)&a[j]);
+        int8x16_t vb = vld1q_s8((const int8_t*)&b[j]);
+        int16x8_t p = vmull_s8(vget_low_s8(va), vget_low_s8(vb));
+        p = vmlal_s8(p, vget_high_s8(va), vget_high_s8(vb));
+        sum0 = vpadalq_s16(sum0, p);
+    }
+
+    sum = vaddvq_s32(sum0);
+    for (; j < n; j++)
+        sum += (int)a[j] * (int)b[j];
+    return sum;
+}
+
+static float dot_bf16_neon(const unsigned short * a, const float * b,
+                           int n)
+{
+    float32x4_t sum0 = vdupq_n_f32(0);
+    float32x4_t sum1 = vdupq_n_f32(0);
+    float sum;
+    int j = 0;
+
+    for (; j + 8 <= n; j += 8) {
+        uint16x8_t va = vld1q_u16((const uint16_t*)&a[j]);
+        float32x4_t lo =
+            vreinterpretq_f32_u32(vshll_n_u16(vget_low_u16(va), 16));
+        float32x4_t hi =
+            vreinterpretq_f32_u32(vshll_n_u16(vget_high_u16(va), 16));
+        sum0 = vfmaq_f32(sum0, lo, vld1q_f32(&b[j]));
+        sum1 = vfmaq_f32(sum1, hi, vld1q_f32(&b[j+4]));
+    }
+
+    sum = vaddvq_f32(vaddq_f32(sum0, sum1));
+    for (; j < n; j++)
+        sum += deeplearn_bf16_to_float(a[j]) * b[j];
+    return sum;
+}
+
+static float dot_masked_neon(const float * a, const float * b,
+                             const unsigned int * mask, int n)
+{
+    static const uint32_t bit_values[4] = { 1, 2, 4, 8 };
+    const uint32x4_t bits = vld1q_u32(bit_values);
+    float32x4_t sum0 = vdupq_n_f32(0);
+    float sum;
+    int j = 0;
+
+    /* each group of four bits is expanded into a lane mask */
+    for (; j + 4 <= n; j += 4) {
+        uint32x4_t keep =
+            vtstq_u32(vdupq_n_u32(mask[j >> 5] >> (j & 31)), bits);
+        float32x4_t va = vreinterpretq_f32_u32(
+            vandq_u32(vreinterpretq_u32_f32(vld1q_f32(&a[j])), keep));
+        sum0 = vfmaq_f32(sum0, va, vld1q_f32(&b[j]));
+    }
+
+    sum = vaddvq_f32(sum0);
+    for (; j < n; j++)
+        sum += a[j] * b[j] * (float)MASK_BIT(mask, j);
+    return sum;
+}
+
+static inline uint32x4_t mix_neon(uint32x4_t x)
+{
+    x = veorq_u32(x, vshrq_n_u32(x, 16));
+    x = vmulq_u32(x, vdupq_n_u32(RAND_MIX_MULTIPLIER1));
+    x = veorq_u32(x, vshrq_n_u32(x, 15));
+    x = vmulq_u32(x, vdupq_n_u32(RAND_MIX_MULTIPLIER2));
+    return veorq_u32(x, vshrq_n_u32(x, 16));
+}
+
+static void counter_mask_neon(unsigned int mixed_key, unsigned int counter,
+                              unsigned int * mask, int no_of_words,
+                              unsigned int threshold)
+{
+    static const uint32_t lane_values[4] = { 0, 1, 2, 3 };
+    static const uint32_t bit_values[4] = { 1, 2, 4, 8 };
+    const uint32x4_t bits = vld1q_u32(bit_values);
+    const uint32x4_t step = vdupq_n_u32(4*RAND_COUNTER_STEP);
+    const uint32x4_t t = vdupq_n_u32(threshold);
+    uint32x4_t x = vaddq_u32(
+        vdupq_n_u32(mixed_key + counter*RAND_COUNTER_STEP),
+        vmulq_u32(vld1q_u32(lane_values), vdupq_n_u32(RAND_COUNTER_STEP)));
+
+    COUNTUP(w, no_of_words) {
+        unsigned int word = 0;
+
+        COUNTUP(g, RAND_MASK_BITS/4) {
+            uint32x4_t keep = vcgeq_u32(mix_neon(x), t);
+            word |= vaddvq_u32(vandq_u32(keep, bits)) << (g*4);
+            x = vaddq_u32(x, step);
+        }
+        mask[w] = word;
+    }
+}
+
+#endif
+
+static const deeplearn_simd_kernels kernels_scalar = {
+    dot_scalar, axpy_scalar, weight_update_scalar, dot_int8_scalar,
+    dot_bf16_scalar, dot_masked_scalar,
+    counter_mask_scalar
+};
+
+#ifdef DEEPLEARN_SIMD_X86
+static const deeplearn_simd_kernels kernels_avx2 = {
+    dot_avx2, axpy_avx2, weight_update_avx2, dot_int8_avx2,
+    dot_bf16_avx2, dot_masked_avx2,
+    counter_mask_avx2
+};
+/* AVX-512 cpus always support AVX2, so the AVX2 int8 kernel is used */
+static const deeplearn_simd_kernels kernels_avx512 = {
+    dot_avx512, axpy_avx512, weight_update_avx512, dot_int8_avx2,
+    dot_bf16_avx512, dot_masked_avx512,
+    counter_mask_avx512
+};
+#endif
+
+#ifdef DEEPLEARN_SIMD_ARM
+static const deeplearn_simd_kernels kernels_neon = {
+    dot_neon, axpy_neon, weight_update_neon, dot_int8_neon,
+    dot_bf16_neon, dot_masked_neon,
+    counter_mask_neon
+};
+#endif
+
+/* the currently selected kernels */
+static const deeplearn_simd_kernels * kernels = &kernels_scalar;
+static int kernels_level = DEEPLEARN_SIMD_SCALAR;
+
+/**
+ * @brief Returns whether the given instruction set can be used on this cpu
+ * @param level The instruction set, eg. DEEPLEARN_SIMD_AVX2
+ * @returns Non-zero if the instruction set is supported
+ */
+int deeplearn_simd_supported(int level)
+{
+    switch(level) {
+    case DEEPLEARN_SIMD_SCALAR: return 1;
+#ifdef DEEPLEARN_SIMD_X86
+    case DEEPLEARN_SIMD_AVX2: {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") &&
+            __builtin_cpu_supports("fma");
+    }
+    case DEEPLEARN_SIMD_AVX512: {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f");
+    }
+#endif
+#ifdef DEEPLEARN_SIMD_ARM
+    /* NEON is always present on 64 bit ARM */
+    case DEEPLEARN_SIMD_NEON: return 1;
+#endif
+    }
+    return 0;
+}
+
+/**
+ * @brief Selects the kernels for a given instruction set.
+ *        This is mainly useful for testing and benchmarking
+ * @param level The instruction set, eg. DEEPLEARN_SIMD_AVX2
+ * @returns zero on success, or -1 if the instruction set is not supported
+ */
+int deeplearn_simd_select(int level)
+{
+    if (!deeplearn_simd_supported(level))
+        return -1;
+
+    switch(level) {
+#ifdef DEEPLEARN_SIMD_X86
+    case DEEPLEARN_SIMD_AVX2: { kernels = &kernels_avx2; break; }
+    case DEEPLEARN_SIMD_AVX512: { kernels = &kernels_avx512; break; }
+#endif
+#ifdef DEEPLEARN_SIMD_ARM
+    case DEEPLEARN_SIMD_NEON: { kernels = &kernels_neon; break; }
+#endif
+    default: { kernels = &kernels_scalar; break; }
+    }
+    kernels_level = level;
+    return 0;
+}
+
+/**
+ * @brief Selects the fastest kernels supported by the cpu.
+ *        This is called automatically when the library is loaded
+ * @returns The selected instruction set
+ */
+int deeplearn_simd_init(void)
+{
+    const int preference[] = {
+        DEEPLEARN_SIMD_AVX512, DEEPLEARN_SIMD_AVX2, DEEPLEARN_SIMD_NEON
+    };
+
+    COUNTUP(i, (int)(sizeof(preference)/sizeof(int))) {
+        if (deeplearn_simd_select(preference[i]) == 0)
+            return kernels_level;
+    }
+    deeplearn_simd_select(DEEPLEARN_SIMD_SCALAR);
+    return kernels_level;
+}
+
+#ifdef __GNUC__
+__attribute__((constructor))
+static void deeplearn_simd_load(void)
+{
+    deeplearn_simd_init();
+}
+#endif
+
+/**
+ * @brief Returns the instruction set currently in use
+ * @returns Instruction set, eg. DEEPLEARN_SIMD_AVX2
+ */
+int deeplearn_simd_level(void)
+{
+    return kernels_level;
+}
+
+/**
+ * @brief Returns the dot product of two arrays
+ * @param a First array
+ * @param b Second array
+ * @param n Length of the arrays
+ * @returns Sum of the elementwise products
+ */
+float deeplearn_dot(const float * a, const float * b, int n)
+{
+    return kernels->dot(a, b, n);
+}
+
+/**
+ * @brief Adds a scaled array to another, y = y + a*x
+ * @param y Array to be updated
+ * @param a Scaling factor
+ * @param x Array to be scaled
+ * @param n Length of the arrays
+ */
+void deeplearn_axpy(float * y, float a, const float * x, int n)
+{
+    kernels->axpy(y, a, x, n);
+}
+
+/**
+ * @brief Updates a row of weights with momentum and clips them
+ *        to the weight range
+ * @param w Weights to be updated
+ * @param dw Previous weight changes, which are also updated
+ * @param x Input values or gradients for each weight
+ * @param e Learning rate multiplied by the unit gradient
+ * @param n Length of the arrays
+ */
+void deeplearn_weight_update(float * w, float * dw, const float * x,
+                             float e, int n)
+{
+    kernels->weight_update(w, dw, x, e, n);
+}
+
+/**
+ * @brief Returns the dot product of two arrays of quantized values.
+ *        Products are accumulated as 32 bit integers
+ * @param a First array
+ * @param b Second array
+ * @param n Length of the arrays
+ * @returns Sum of the elementwise products
+ */
+int deeplearn_dot_int8(const signed char * a, const signed char * b, int n)
+{
+    return kernels->dot_int8(a, b, n);
+}
+
+/**
+ * @brief Returns the dot product of an array of bfloat16 values with an
+ *        array of floats. Products are accumulated in single precision
+ * @param a Array of bfloat16 values
+ * @param b Array of floats
+ * @param n Length of the arrays
+ * @returns Sum of the elementwise products
+ */
+float deeplearn_dot_bf16(const unsigned short * a, const float * b, int n)
+{
+    return kernels->dot_bf16(a, b, n);
+}
+
+/**
+ * @brief Returns the dot product of two arrays, including only the
+ *        elements whose bits are set within a packed mask, such as
+ *        the dropout masks filled by rand_mask
+ * @param a First array
+ * @param b Second array
+ * @param mask Packed bit mask, with bit j of the mask at bit j%32
+ *        of word j/32
+ * @param n Length of the arrays
+ * @returns Sum of the elementwise products which are included
+ */
+float deeplearn_dot_masked(const float * a, const float * b,
+                           const unsigned int * mask, int n)
+{
+    return kernels->dot_masked(a, b, mask, n);
+}
+
+/**
+ * @brief Fills a packed bit mask from counter based random numbers.
+ *        This is used by rand_mask, which describes the mask
+ * @param mixed_key Key of the sequence, already passed through rand_mix
+ * @param counter Position within the sequence of the first bit
+ * @param mask Array of words to be filled
+ * @param no_of_words The number of words in the mask
+ * @param threshold Bits are set where the random number is at or above
+ *        this threshold
+ */
+void deeplearn_counter_mask(unsigned int mixed_key, unsigned int counter,
+                            unsigned int * mask, int no_of_words,
+                            unsigned int threshold)
+{
+    kernels->counter_mask(mixed_key, counter, mask, no_of_words, threshold);
+}
+
+/**
+ * @brief Converts a float to bfloat16, which keeps the sign, exponent
+ *        and the upper seven bits of the mantissa, rounding to nearest
+ * @param value The value to convert
+ * @returns bfloat16 value
+ */
+unsigned short deeplearn_float_to_bf16(float value)
+{
+    unsigned int bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return (unsigned short)(bits >> 16);
+}
+
+/**
+ * @brief Converts a bfloat16 value to a float
+ * @param value bfloat16 value
+ * @returns The value as a float
+ */
+float deeplearn_bf16_to_float(unsigned short value)
+{
+    unsigned int bits = ((unsigned int)value) << 16;
+    float result;
+
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+/**
+ * @brief Converts an array of floats to bfloat16
+ * @param dest Array of bfloat16 values
+ * @param src Array of floats
+ * @param n Length of the arrays
+ */
+void deeplearn_bf16_encode(unsigned short * dest, const float * src, int n)
+{
+    COUNTDOWN(j, n)
+        dest[j] = deeplearn_float_to_bf16(src[j]);
+}
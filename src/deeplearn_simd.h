@@ -0,0 +1,64 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEEPLEARN_SIMD_H
+#define DEEPLEARN_SIMD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "globals.h"
+
+/* instruction sets which the kernels may be dispatched to */
+#define DEEPLEARN_SIMD_SCALAR  0
+#define DEEPLEARN_SIMD_AVX2    1
+#define DEEPLEARN_SIMD_AVX512  2
+#define DEEPLEARN_SIMD_NEON    3
+
+float deeplearn_dot(const float * a, const float * b, int n);
+void deeplearn_axpy(float * y, float a, const float * x, int n);
+void deeplearn_weight_update(float * w, float * dw, const float * x,
+                             float e, int n);
+int deeplearn_dot_int8(const signed char * a, const signed char * b, int n);
+float deeplearn_dot_bf16(const unsigned short * a, const float * b, int n);
+float deeplearn_dot_masked(const float * a, const float * b,
+                           const unsigned int * mask, int n);
+void deeplearn_counter_mask(unsigned int mixed_key, unsigned int counter,
+                            unsigned int * mask, int no_of_words,
+                            unsigned int threshold);
+unsigned short deeplearn_float_to_bf16(float value);
+float deeplearn_bf16_to_float(unsigned short value);
+void deeplearn_bf16_encode(unsigned short * dest, const float * src, int n);
+
+int deeplearn_simd_init(void);
+int deeplearn_simd_level(void);
+int deeplearn_simd_supported(int level);
+int deeplearn_simd_select(int level);
+
+#endif
@@ -0,0 +1,346 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* processor affinity is not part of c99 */
+#define _GNU_SOURCE
+
+#include "deeplearn_threads.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+/* the number of threads used by parallel loops */
+static int deeplearn_threads = DEEPLEARN_THREADS;
+
+/* the minimum amount of work for which a loop runs in parallel */
+static int deeplearn_parallel_min_work = DEEPLEARN_PARALLEL_MIN_WORK;
+
+/* non-zero if the threads of parallel loops are bound to processors */
+static int deeplearn_thread_binding = 0;
+
+#ifdef __linux__
+/* the processors which the process may run on, ordered by NUMA node,
+   and the node of every processor */
+static int deeplearn_no_of_cpus = 0;
+static int deeplearn_cpus[CPU_SETSIZE];
+static int deeplearn_cpu_node[CPU_SETSIZE];
+static int deeplearn_no_of_nodes = 0;
+
+/* the processors which the process could run on before binding */
+static cpu_set_t deeplearn_process_cpus;
+#endif
+
+/**
+ * @brief Sets the number of threads used for training and inference.
+ *        This applies to all objects within the process
+ * @param threads The number of threads, or zero to use one thread
+ *        per available processor
+ * @returns The number of threads which will be used
+ */
+int deeplearn_set_threads(int threads)
+{
+    if (threads <= 0) {
+#ifdef _OPENMP
+        threads = omp_get_num_procs();
+#else
+        threads = 1;
+#endif
+    }
+
+    if (threads > DEEPLEARN_MAX_THREADS)
+        threads = DEEPLEARN_MAX_THREADS;
+
+    deeplearn_threads = threads;
+
+    /* any new threads are bound to processors of their own */
+    if (deeplearn_thread_binding != 0)
+        deeplearn_set_thread_binding(1);
+
+    return deeplearn_threads;
+}
+
+/**
+ * @brief Returns the number of threads used for training and inference
+ * @returns The number of threads
+ */
+int deeplearn_get_threads(void)
+{
+    return deeplearn_threads;
+}
+
+/**
+ * @brief Sets the amount of work below which loops run on a single thread
+ * @param min_work The number of multiply-adds, or zero to always
+ *        run in parallel
+ */
+void deeplearn_set_parallel_threshold(int min_work)
+{
+    if (min_work < 0)
+        min_work = 0;
+
+    deeplearn_parallel_min_work = min_work;
+}
+
+/**
+ * @brief Returns the amount of work below which loops run on a single thread
+ * @returns The number of multiply-adds
+ */
+int deeplearn_get_parallel_threshold(void)
+{
+    return deeplearn_parallel_min_work;
+}
+
+/**
+ * @brief Returns whether a loop is large enough to be run in parallel
+ * @param work Approximate number of multiply-adds within the loop
+ * @returns Non-zero if the loop should be distributed between threads
+ */
+int deeplearn_parallel(int work)
+{
+    return ((deeplearn_threads > 1) && (work >= deeplearn_parallel_min_work));
+}
+
+#ifdef __linux__
+/**
+ * @brief Reads the processors of each NUMA node from sysfs, the first
+ *        time that it is needed. Without NUMA every processor is on node 0
+ */
+static void deeplearn_numa_topology(void)
+{
+    char filename[256];
+
+    if (deeplearn_no_of_nodes > 0)
+        return;
+
+    if (sched_getaffinity(0, sizeof(cpu_set_t),
+                          &deeplearn_process_cpus) != 0) {
+        CPU_ZERO(&deeplearn_process_cpus);
+        CPU_SET(0, &deeplearn_process_cpus);
+    }
+
+    COUNTDOWN(cpu, CPU_SETSIZE)
+        deeplearn_cpu_node[cpu] = 0;
+
+    /* node numbers may have gaps, but the nodes found are numbered
+       consecutively */
+    COUNTUP(n, DEEPLEARN_MAX_NUMA_NODES) {
+        FILE * fp;
+        int first, last, c, found = 0;
+
+        sprintf(filename, "%s/node%d/cpulist", DEEPLEARN_NUMA_PATH, n);
+        fp = fopen(filename, "r");
+        if (!fp)
+            continue;
+
+        /* a list of ranges such as 0-7,16-23 */
+        while (fscanf(fp, "%d", &first) == 1) {
+            last = first;
+            c = fgetc(fp);
+            if (c == '-') {
+                if (fscanf(fp, "%d", &last) != 1)
+                    break;
+                c = fgetc(fp);
+            }
+            for (int cpu = first; cpu <= last; cpu++) {
+                if ((cpu >= 0) && (cpu < CPU_SETSIZE)) {
+                    deeplearn_cpu_node[cpu] = deeplearn_no_of_nodes;
+                    found = 1;
+                }
+            }
+            if (c != ',')
+                break;
+        }
+        fclose(fp);
+
+        if (found != 0)
+            deeplearn_no_of_nodes++;
+    }
+
+    if (deeplearn_no_of_nodes == 0)
+        deeplearn_no_of_nodes = 1;
+
+    /* consecutive threads are given processors on the same node */
+    deeplearn_no_of_cpus = 0;
+    COUNTUP(n, deeplearn_no_of_nodes) {
+        COUNTUP(cpu, CPU_SETSIZE) {
+            if ((deeplearn_cpu_node[cpu] == n) &&
+                CPU_ISSET(cpu, &deeplearn_process_cpus))
+                deeplearn_cpus[deeplearn_no_of_cpus++] = cpu;
+        }
+    }
+
+    if (deeplearn_no_of_cpus == 0)
+        deeplearn_cpus[deeplearn_no_of_cpus++] = 0;
+}
+#endif
+
+/**
+ * @brief Binds each thread of parallel loops to a processor, or unbinds
+ *        them. Thread t of n is given the processor t*p/n of the p which
+ *        the process may run on, ordered by NUMA node, so that the rows
+ *        which a static schedule gives to neighbouring threads are
+ *        processed on the same node. Arrays placed with
+ *        deeplearn_first_touch are then local to the threads which use
+ *        them. The calling thread is bound to the first processor, and
+ *        threads which it creates afterwards inherit that binding.
+ *        OMP_PROC_BIND and OMP_PLACES give similar binding when set
+ *        before the program starts
+ * @param bind Non-zero to bind threads, or zero to let them run on any
+ *        of the processors of the process
+ * @returns zero on success, or -1 if binding is not supported
+ */
+int deeplearn_set_thread_binding(int bind)
+{
+#if defined(__linux__) && defined(_OPENMP)
+    int result = 0;
+
+    deeplearn_numa_topology();
+
+#pragma omp parallel num_threads(deeplearn_threads)
+    {
+        cpu_set_t cpus = deeplearn_process_cpus;
+
+        if (bind != 0) {
+            int t = omp_get_thread_num();
+            int n = omp_get_num_threads();
+
+            CPU_ZERO(&cpus);
+            CPU_SET(deeplearn_cpus[t*deeplearn_no_of_cpus/n], &cpus);
+        }
+
+        if (sched_setaffinity(0, sizeof(cpu_set_t), &cpus) != 0) {
+#pragma omp atomic write
+            result = -2;
+        }
+    }
+
+    deeplearn_thread_binding = ((bind != 0) && (result == 0));
+    return result;
+#else
+    return -1;
+#endif
+}
+
+/**
+ * @brief Returns whether the threads of parallel loops are bound
+ *        to processors
+ * @returns Non-zero if threads are bound
+ */
+int deeplearn_get_thread_binding(void)
+{
+    return deeplearn_thread_binding;
+}
+
+/**
+ * @brief Returns the number of NUMA nodes which have processors
+ * @returns The number of nodes, which is one without NUMA
+ */
+int deeplearn_numa_nodes(void)
+{
+#ifdef __linux__
+    deeplearn_numa_topology();
+    return deeplearn_no_of_nodes;
+#else
+    return 1;
+#endif
+}
+
+/**
+ * @brief Returns the NUMA node which the calling thread is running on
+ * @returns Node number in the range 0 -> deeplearn_numa_nodes()-1
+ */
+int deeplearn_numa_node(void)
+{
+#ifdef __linux__
+    int cpu = sched_getcpu();
+
+    deeplearn_numa_topology();
+    if ((cpu < 0) || (cpu >= CPU_SETSIZE))
+        return 0;
+
+    return deeplearn_cpu_node[cpu];
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Moves the calling thread onto the processors of a NUMA node,
+ *        so that memory which it touches first is placed on that node
+ * @param node Node number, or -1 to allow any processor of the process
+ * @returns zero on success
+ */
+int deeplearn_numa_migrate(int node)
+{
+#ifdef __linux__
+    cpu_set_t cpus;
+
+    deeplearn_numa_topology();
+    if (node >= deeplearn_no_of_nodes)
+        return -1;
+
+    cpus = deeplearn_process_cpus;
+    if (node >= 0) {
+        CPU_ZERO(&cpus);
+        COUNTDOWN(i, deeplearn_no_of_cpus)
+            if (deeplearn_cpu_node[deeplearn_cpus[i]] == node)
+                CPU_SET(deeplearn_cpus[i], &cpus);
+    }
+
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpus) != 0)
+        return -2;
+#endif
+    return 0;
+}
+
+/**
+ * @brief Zeroes an array of rows which have not yet been written.
+ *        When threads are bound, each row is first written by the thread
+ *        which processes it within loops of the form
+ *        "omp for schedule(static)" over COUNTDOWN(i, rows), so that its
+ *        pages are placed on the NUMA node of that thread
+ * @param data The array
+ * @param rows The number of rows, such as the units of a layer
+ * @param row_length The number of values in each row
+ */
+void deeplearn_first_touch(float * data, int rows, int row_length)
+{
+    if ((deeplearn_thread_binding == 0) ||
+        (!deeplearn_parallel(rows*row_length))) {
+        memset((void*)data, '\0', (size_t)rows*row_length*sizeof(float));
+        return;
+    }
+
+#pragma omp parallel for schedule(static) num_threads(deeplearn_threads)
+    COUNTDOWN(i, rows)
+        memset((void*)&data[i*row_length], '\0', row_length*sizeof(float));
+}
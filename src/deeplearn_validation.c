@@ -0,0 +1,246 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "deeplearn_validation.h"
+
+/**
+ * @brief Starts validating a learner on its test set during training
+ * @param validation Validation object
+ * @param learner Deep learner object with a test set
+ * @param interval The number of training steps between validations
+ * @param patience The number of validations in a row without improvement
+ *        after which training is stopped
+ * @returns zero on success
+ */
+int deeplearn_validation_init(deeplearn_validation * validation,
+                              deeplearn * learner,
+                              int interval, int patience)
+{
+    if ((interval < 1) || (patience < 1) ||
+        (learner->test_data_samples <= 0))
+        return -1;
+
+    validation->learner = learner;
+    validation->interval = interval;
+    validation->patience = patience;
+    validation->pending = 0;
+    validation->has_best = 0;
+    validation->performance = 0;
+    validation->best_performance = 0;
+    validation->validations = 0;
+    validation->since_best = 0;
+    validation->stopped = 0;
+    return 0;
+}
+
+/**
+ * @brief Compares the performance of the latest snapshot with the best
+ *        so far, keeping whichever is better, and stops training if
+ *        there has been no improvement for too long
+ * @param validation Validation object
+ */
+static void deeplearn_validation_judge(deeplearn_validation * validation)
+{
+    validation->validations++;
+    validation->pending = 0;
+
+    if ((!validation->has_best) ||
+        (validation->performance > validation->best_performance)) {
+        if (validation->has_best)
+            deeplearn_inference_free(&validation->best);
+        validation->best = validation->snapshot;
+        validation->best_performance = validation->performance;
+        validation->has_best = 1;
+        validation->since_best = 0;
+        return;
+    }
+
+    deeplearn_inference_free(&validation->snapshot);
+    validation->since_best++;
+    if (validation->since_best >= validation->patience) {
+        validation->stopped = 1;
+        validation->learner->training_complete = 1;
+    }
+}
+
+/**
+ * @brief Evaluates the pending snapshot on the test set.
+ *        This is run on a background thread while training continues
+ * @param arg Validation object
+ * @returns NULL
+ */
+static void * deeplearn_validation_evaluate(void * arg)
+{
+    deeplearn_validation * validation = (deeplearn_validation*)arg;
+
+    validation->performance =
+        deeplearndata_get_model_performance(validation->learner,
+                                            &validation->snapshot);
+    return NULL;
+}
+
+/**
+ * @brief Performs interval training steps with deeplearndata_training.
+ *        The snapshot taken at the end of the previous call is validated
+ *        on another thread while the steps are running, so training does
+ *        not pause, and its result is judged afterwards. Snapshots are
+ *        only taken once pretraining is complete. The steps end early
+ *        if training completes or fails
+ * @param validation Validation object
+ * @returns The value returned by the last deeplearndata_training step,
+ *          zero if training was stopped early, -10 if validation failed
+ *          or -11 if a snapshot could not be taken
+ */
+int deeplearn_validation_update(deeplearn_validation * validation)
+{
+    deeplearn * learner = validation->learner;
+    pthread_t thread;
+    int retval = 0, started;
+
+    if (validation->stopped)
+        return 0;
+
+    if (!validation->pending) {
+        COUNTUP(s, validation->interval) {
+            retval = deeplearndata_training(learner);
+            if (retval <= 0)
+                break;
+        }
+    }
+    else {
+        /* the snapshot is evaluated on its own thread, so that training
+           keeps the usual OpenMP team of the calling thread */
+        started = (pthread_create(&thread, NULL,
+                                  deeplearn_validation_evaluate,
+                                  validation) == 0);
+        if (!started)
+            deeplearn_validation_evaluate(validation);
+
+        COUNTUP(s, validation->interval) {
+            retval = deeplearndata_training(learner);
+            if (retval <= 0)
+                break;
+        }
+
+        if (started)
+            pthread_join(thread, NULL);
+
+        if (validation->performance < 0)
+            return -10;
+
+        deeplearn_validation_judge(validation);
+        if (validation->stopped)
+            return 0;
+    }
+
+    /* the weights as they are now are validated during the next call */
+    if (deeplearn_training_last_layer(learner) &&
+        (learner->training_complete == 0)) {
+        if (deeplearn_compile_inference(learner,
+                                        &validation->snapshot) != 0)
+            return -11;
+        validation->pending = 1;
+    }
+
+    return retval;
+}
+
+/**
+ * @brief Validates any remaining snapshot, without training, so that
+ *        the best weights are known once training is complete
+ * @param validation Validation object
+ * @returns zero on success
+ */
+int deeplearn_validation_finish(deeplearn_validation * validation)
+{
+    float performance;
+
+    if (!validation->pending)
+        return 0;
+
+    performance =
+        deeplearndata_get_model_performance(validation->learner,
+                                            &validation->snapshot);
+    if (performance < 0)
+        return -1;
+
+    validation->performance = performance;
+    deeplearn_validation_judge(validation);
+    return 0;
+}
+
+/**
+ * @brief Copies the weights and biases of the best snapshot back into
+ *        the network of the learner
+ * @param validation Validation object
+ * @returns zero on success
+ */
+int deeplearn_validation_restore_best(deeplearn_validation * validation)
+{
+    bp * net = validation->learner->net;
+    deeplearn_inference * best = &validation->best;
+
+    if (!validation->has_best)
+        return -1;
+
+    if (best->no_of_layers != net->hidden_layers+1)
+        return -2;
+
+    COUNTUP(l, best->no_of_layers) {
+        bp_layer * layer = &net->layers[l];
+
+        if ((best->layer_units[l] != layer->no_of_units) ||
+            (best->layer_inputs[l] != layer->no_of_inputs))
+            return -3;
+
+        memcpy(layer->weights, best->weights[l],
+               layer->no_of_units*layer->no_of_inputs*sizeof(float));
+        COUNTDOWN(i, layer->no_of_units)
+            layer->units[i].bias = best->bias[l][i];
+    }
+
+    /* the restored weights may differ from any sparse pattern */
+    bp_update_sparse(net);
+    bp_weights_changed(net);
+    return 0;
+}
+
+/**
+ * @brief Frees memory for a validation object
+ * @param validation Validation object
+ */
+void deeplearn_validation_free(deeplearn_validation * validation)
+{
+    if (validation->pending)
+        deeplearn_inference_free(&validation->snapshot);
+    if (validation->has_best)
+        deeplearn_inference_free(&validation->best);
+    validation->pending = 0;
+    validation->has_best = 0;
+}
@@ -0,0 +1,81 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEEPLEARN_VALIDATION_H
+#define DEEPLEARN_VALIDATION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <omp.h>
+#include "globals.h"
+#include "deeplearn.h"
+#include "deeplearndata.h"
+#include "deeplearn_inference.h"
+
+/* Validation on the test set while training continues.
+   Once pretraining is complete a snapshot of the weights is taken every
+   interval training steps, and it is evaluated on another thread during
+   the following interval. The snapshot with the best performance is
+   kept, and training is stopped once patience validations in a row
+   have not improved upon it */
+typedef struct {
+    deeplearn * learner;
+    int interval;
+    int patience;
+
+    /* weights waiting to be validated, and the best weights so far */
+    deeplearn_inference snapshot;
+    deeplearn_inference best;
+    int pending;
+    int has_best;
+
+    /* test performance of the latest and best snapshots */
+    float performance;
+    float best_performance;
+
+    unsigned int validations;
+
+    /* the number of validations since the best one */
+    int since_best;
+
+    /* non-zero if training was stopped because it stopped improving */
+    int stopped;
+} deeplearn_validation;
+
+int deeplearn_validation_init(deeplearn_validation * validation,
+                              deeplearn * learner,
+                              int interval, int patience);
+int deeplearn_validation_update(deeplearn_validation * validation);
+int deeplearn_validation_finish(deeplearn_validation * validation);
+int deeplearn_validation_restore_best(deeplearn_validation * validation);
+void deeplearn_validation_free(deeplearn_validation * validation);
+
+#endif
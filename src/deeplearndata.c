@@ -133,6 +133,7 @@ int deeplearndata_add(deeplearndata ** datalist,
             data->labeled = 0;
     }
 
+    data->inputs_encoded = 0;
     data->flags = 0;
 
     /* change the current head of the list */
@@ -174,33 +175,6 @@ int deeplearndata_index_data(
     return *indexed_samples == samples ? 0 : 1;
 }
 
-/**
-* @brief Indexes metadata for fast read access
-* @param meta Pointer to the metadata list
-* @param samples The size of the metadata list
-* @param indexed_list Pointer to the indexed metadata list
-* @param indexed_samples Pointer to the size of the indexed metadata list
-* @returns 0 if data indexed successfully,
-*          1 if samples does not match list size
-*/
-int deeplearndata_index_meta(
-        deeplearndata_meta * list,
-        int samples,
-        deeplearndata_meta *** indexed_list,
-        int* indexed_samples)
-{
-    *indexed_list =
-        (deeplearndata_meta**)malloc(samples*sizeof(deeplearndata_meta*));
-    deeplearndata_meta* data_head = list;
-    *indexed_samples = 0;
-    for(int i = 0; i < samples && data_head != 0; ++i) {
-        (*indexed_list)[i] = data_head;
-        data_head = data_head->next;
-        (*indexed_samples)++;
-    }
-    return *indexed_samples == samples ? 0 : 1;
-}
-
 /**
 * @brief Returns a training data sample
 * @param learner Deep learner object
@@ -208,14 +182,10 @@ int deeplearndata_index_meta(
 */
 deeplearndata * deeplearndata_get_training(deeplearn * learner, int index)
 {
-    if ((index < 0) || (index >= learner->indexed_training_data_samples))
+    if ((index < 0) || (index >= learner->training_data_samples))
         return 0;
 
-    deeplearndata_meta * meta = learner->indexed_training_data[index];
-    if (meta == 0)
-        return 0;
-
-    return meta->sample;
+    return deeplearndata_get(learner, learner->training_data[index]);
 }
 
 /**
@@ -227,14 +197,10 @@ deeplearndata * deeplearndata_get_training_labeled(deeplearn * learner,
                                                    int index)
 {
     if ((index < 0) ||
-        (index >= learner->indexed_training_data_labeled_samples))
-        return 0;
-
-    deeplearndata_meta * meta = learner->indexed_training_data_labeled[index];
-    if (meta == 0)
+        (index >= learner->training_data_labeled_samples))
         return 0;
 
-    return meta->sample;
+    return deeplearndata_get(learner, learner->training_data_labeled[index]);
 }
 
 /**
@@ -244,14 +210,10 @@ deeplearndata * deeplearndata_get_training_labeled(deeplearn * learner,
 */
 deeplearndata * deeplearndata_get_test(deeplearn * learner, int index)
 {
-    if ((index < 0) || (index >= learner->indexed_test_data_samples))
+    if ((index < 0) || (index >= learner->test_data_samples))
         return 0;
 
-    deeplearndata_meta * meta = learner->indexed_test_data[index];
-    if (meta == 0)
-        return 0;
-
-    return meta->sample;
+    return deeplearndata_get(learner, learner->test_data[index]);
 }
 
 /**
@@ -288,144 +250,99 @@ static void deeplearndata_clear_flags(deeplearn * learner)
 */
 static void deeplearndata_free_datasets(deeplearn * learner)
 {
-    /* free training samples */
-    deeplearndata_meta * training_sample = learner->training_data;
-    deeplearndata_meta * prev_training_sample;
-    while (training_sample != 0) {
-        prev_training_sample = training_sample;
-        training_sample = (deeplearndata_meta *)training_sample->next;
-        free(prev_training_sample);
-    }
+    free(learner->training_data);
     learner->training_data = 0;
     learner->training_data_samples = 0;
-    free(learner->indexed_training_data);
-    learner->indexed_training_data = 0;
-    learner->indexed_training_data_samples = 0;
-
-    /* free labeled training samples */
-    deeplearndata_meta * training_sample_labeled =
-        learner->training_data_labeled;
-    deeplearndata_meta * prev_training_sample_labeled;
-    while (training_sample_labeled != 0) {
-        prev_training_sample_labeled = training_sample_labeled;
-        training_sample_labeled =
-            (deeplearndata_meta *)training_sample_labeled->next;
-        free(prev_training_sample_labeled);
-    }
+
+    free(learner->training_data_labeled);
     learner->training_data_labeled = 0;
     learner->training_data_labeled_samples = 0;
-    free(learner->indexed_training_data_labeled);
-    learner->indexed_training_data_labeled = 0;
-    learner->indexed_training_data_labeled_samples = 0;
-
-    /* free test samples */
-    deeplearndata_meta * test_sample = learner->test_data;
-    deeplearndata_meta * prev_test_sample;
-    while (test_sample != 0) {
-        prev_test_sample = test_sample;
-        test_sample = (deeplearndata_meta *)test_sample->next;
-        free(prev_test_sample);
-    }
+
+    free(learner->test_data);
     learner->test_data = 0;
     learner->test_data_samples = 0;
-    free(learner->indexed_test_data);
-    learner->indexed_test_data = 0;
-    learner->indexed_test_data_samples = 0;
+
+    /* the epoch sampler starts again on the new sets */
+    free(learner->sampler_order);
+    learner->sampler_order = 0;
+    learner->sampler_samples = 0;
+    learner->sampler_position = 0;
+
+    /* cached values belong to the old training set */
+    learner->pretrain_cache_layer = -1;
 }
 
 /**
-* @brief Adds a sample to the training set
+* @brief Appends a data sample index to a training or test set
 * @param learner Deep learner object
-* @param sample The data sample to be added
+* @param set The training or test set
+* @param set_samples The number of samples in the set
+* @param index Index of the data sample
 * @returns zero on success
 */
-int deeplearndata_add_training_sample(deeplearn * learner,
-                                      deeplearndata * sample)
+static int deeplearndata_add_to_set(deeplearn * learner,
+                                    int ** set, int * set_samples,
+                                    int index)
 {
-    deeplearndata_meta * data;
-
-    if (sample == 0)
+    if ((index < 0) || (index >= learner->indexed_data_samples))
         return -1;
 
-    data = (deeplearndata_meta*)malloc(sizeof(deeplearndata_meta));
-    if (!data)
-        return -2;
+    /* the sets of a shared dataset cannot be changed */
+    if (learner->dataset != 0)
+        return -4;
 
-    data->sample = sample;
-    data->prev = 0;
-    data->next = 0;
-    if (learner->training_data) {
-        learner->training_data->prev = (struct deeplearndata_meta *)data;
-        data->next = (struct deeplearndata_meta *)learner->training_data;
+    /* a set never holds more than every sample once */
+    if (*set == 0) {
+        INTALLOC(*set, learner->indexed_data_samples);
+        if (!*set)
+            return -2;
     }
-    learner->training_data = data;
-    learner->training_data_samples++;
+
+    if (*set_samples >= learner->indexed_data_samples)
+        return -3;
+
+    (*set)[(*set_samples)++] = index;
     return 0;
 }
 
 /**
-* @brief Adds a labeled sample to the training set
+* @brief Adds a sample to the training set
 * @param learner Deep learner object
-* @param sample The data sample to be added
+* @param index Index of the data sample to be added
 * @returns zero on success
 */
-int deeplearndata_add_labeled_training_sample(deeplearn * learner,
-                                              deeplearndata * sample)
+int deeplearndata_add_training_sample(deeplearn * learner, int index)
 {
-    deeplearndata_meta * data;
-
-    if (sample == 0)
-        return -1;
-
-    data = (deeplearndata_meta*)malloc(sizeof(deeplearndata_meta));
-    if (!data)
-        return -2;
-
-    data->sample = sample;
-    data->prev = 0;
-    data->next = 0;
-
-    if (learner->training_data_labeled) {
-        learner->training_data_labeled->prev =
-            (struct deeplearndata_meta *)data;
-        data->next =
-            (struct deeplearndata_meta *)learner->training_data_labeled;
-    }
+    return deeplearndata_add_to_set(learner, &learner->training_data,
+                                    &learner->training_data_samples,
+                                    index);
+}
 
-    learner->training_data_labeled = data;
-    learner->training_data_labeled_samples++;
-    return 0;
+/**
+* @brief Adds a labeled sample to the training set
+* @param learner Deep learner object
+* @param index Index of the data sample to be added
+* @returns zero on success
+*/
+int deeplearndata_add_labeled_training_sample(deeplearn * learner, int index)
+{
+    return deeplearndata_add_to_set(learner,
+                                    &learner->training_data_labeled,
+                                    &learner->training_data_labeled_samples,
+                                    index);
 }
 
 /**
 * @brief Adds a sample to the test set
 * @param learner Deep learner object
-* @param sample The data sample to be added
+* @param index Index of the data sample to be added
 * @returns zero on success
 */
-int deeplearndata_add_test_sample(deeplearn * learner, deeplearndata * sample)
+int deeplearndata_add_test_sample(deeplearn * learner, int index)
 {
-    deeplearndata_meta * data;
-
-    if (sample == 0)
-        return -1;
-
-    data = (deeplearndata_meta*)malloc(sizeof(deeplearndata_meta));
-    if (!data)
-        return -2;
-
-    data->sample = sample;
-    data->prev = 0;
-    data->next = 0;
-
-    if (learner->test_data) {
-        learner->test_data->prev = (struct deeplearndata_meta *)data;
-        data->next = (struct deeplearndata_meta *)learner->test_data;
-    }
-
-    learner->test_data = data;
-    learner->test_data_samples++;
-    return 0;
+    return deeplearndata_add_to_set(learner, &learner->test_data,
+                                    &learner->test_data_samples,
+                                    index);
 }
 
 /**
@@ -442,9 +359,14 @@ int deeplearndata_create_datasets(deeplearn * learner,
     int index, retval;
     deeplearndata * sample;
 
-    if (learner->data == 0)
+    if ((learner->data == 0) ||
+        (learner->indexed_data_samples != learner->data_samples))
         return -1;
 
+    /* the sets of a shared dataset cannot be changed */
+    if (learner->dataset != 0)
+        return -2;
+
     deeplearndata_clear_flags(learner);
     deeplearndata_free_datasets(learner);
 
@@ -459,60 +381,237 @@ int deeplearndata_create_datasets(deeplearn * learner,
         if (sample->flags == 0) {
             sample->flags = 1;
             retval =
-              deeplearndata_add_training_sample(learner, sample);
+              deeplearndata_add_training_sample(learner, index);
 
             if (retval != 0)
                 return -200 + retval;
 
             if (sample->labeled != 0) {
                 retval =
-                    deeplearndata_add_labeled_training_sample(learner, sample);
+                    deeplearndata_add_labeled_training_sample(learner, index);
                 if (retval != 0)
                     return -300 + retval;
             }
         }
     }
 
-    /* create the indexed array for fast access */
-    deeplearndata_index_meta(learner->training_data,
-                             learner->training_data_samples,
-                             &learner->indexed_training_data,
-                             &learner->indexed_training_data_samples);
-    deeplearndata_index_meta(learner->training_data_labeled,
-                             learner->training_data_labeled_samples,
-                             &learner->indexed_training_data_labeled,
-                             &learner->indexed_training_data_labeled_samples);
-
     /* create test samples */
-    sample = learner->data;
-    while (sample != 0) {
-        if (sample->flags == 0) {
-            if (sample->labeled != 0) {
-                retval =
-                    deeplearndata_add_test_sample(learner, sample);
-                if (retval != 0)
-                    return -400 + retval;
-            }
-            else {
-                retval =
-                    deeplearndata_add_training_sample(learner, sample);
-                if (retval != 0)
-                    return -500 + retval;
+    COUNTUP(i, learner->data_samples) {
+        sample = deeplearndata_get(learner, i);
+        if (sample->flags != 0)
+            continue;
+
+        if (sample->labeled != 0) {
+            retval = deeplearndata_add_test_sample(learner, i);
+            if (retval != 0)
+                return -400 + retval;
+        }
+        else {
+            retval = deeplearndata_add_training_sample(learner, i);
+            if (retval != 0)
+                return -500 + retval;
+        }
+    }
+
+    return 0;
+}
+
+/**
+* @brief Grows the row major blocks which hold the samples read from a csv
+*        file so that they can hold at least the given number of rows
+* @param rows The number of rows needed
+* @param capacity The number of rows which the blocks can currently hold
+* @param no_of_input_fields The number of input fields per row
+* @param no_of_outputs The number of outputs per row
+* @param inputs Block of input values
+* @param outputs Block of output values
+* @param text Block of input text strings, or 0 if there are no text fields
+* @returns zero on success
+*/
+static int deeplearndata_reserve_rows(int rows, int * capacity,
+                                      int no_of_input_fields,
+                                      int no_of_outputs,
+                                      float ** inputs, float ** outputs,
+                                      char *** text)
+{
+    int new_capacity = *capacity;
+    float * grown;
+    char ** grown_text;
+
+    if (rows <= *capacity)
+        return 0;
+
+    if (new_capacity < DEEPLEARN_CSV_INITIAL_ROWS)
+        new_capacity = DEEPLEARN_CSV_INITIAL_ROWS;
+    while (new_capacity < rows)
+        new_capacity *= 2;
+
+    /* one spare element, so that a block is never of zero size */
+    grown = (float*)realloc(*inputs, (new_capacity*no_of_input_fields + 1)*
+                            sizeof(float));
+    if (!grown)
+        return -1;
+    *inputs = grown;
+
+    grown = (float*)realloc(*outputs, (new_capacity*no_of_outputs + 1)*
+                            sizeof(float));
+    if (!grown)
+        return -2;
+    *outputs = grown;
+
+    if (*text != 0) {
+        grown_text =
+            (char**)realloc(*text, (new_capacity*no_of_input_fields + 1)*
+                            sizeof(char*));
+        if (!grown_text)
+            return -3;
+
+        memset((void*)&grown_text[(*capacity)*no_of_input_fields], 0,
+               (new_capacity - *capacity)*no_of_input_fields*sizeof(char*));
+        *text = grown_text;
+    }
+
+    *capacity = new_capacity;
+    return 0;
+}
+
+/**
+* @brief Frees the text strings held within a block of csv rows
+* @param text Block of input text strings, or 0 if there are no text fields
+* @param entries The number of entries within the block
+*/
+static void deeplearndata_free_text(char ** text, int entries)
+{
+    if (text == 0)
+        return;
+
+    COUNTDOWN(i, entries) {
+        if (text[i] != 0)
+            free(text[i]);
+    }
+    free(text);
+}
+
+/**
+* @brief Creates the data samples for rows held in row major blocks.
+*        The samples are chained together with the last row at the head,
+*        which is the same order that deeplearndata_add produces.
+* @param samples The number of rows
+* @param no_of_input_fields The number of input fields per row
+* @param no_of_outputs The number of outputs per row
+* @param inputs Block of input values
+* @param text Block of input text strings, or 0 if there are no text fields
+* @param outputs Block of output values
+* @returns Array of data samples, or 0 if it could not be allocated
+*/
+static deeplearndata * deeplearndata_create_rows(int samples,
+                                                 int no_of_input_fields,
+                                                 int no_of_outputs,
+                                                 float * inputs,
+                                                 char ** text,
+                                                 float * outputs)
+{
+    deeplearndata * rows, * row;
+
+    rows = (deeplearndata*)malloc((samples + 1)*sizeof(deeplearndata));
+    if (!rows)
+        return 0;
+
+    COUNTUP(i, samples) {
+        row = &rows[i];
+        row->inputs = &inputs[i*no_of_input_fields];
+        row->inputs_text = 0;
+        if (text != 0)
+            row->inputs_text = &text[i*no_of_input_fields];
+        row->outputs = &outputs[i*no_of_outputs];
+        row->inputs_encoded = 0;
+        row->flags = 0;
+
+        row->labeled = 1;
+        COUNTUP(j, no_of_outputs) {
+            if ((int)row->outputs[j] == DEEPLEARN_UNKNOWN_VALUE) {
+                row->labeled = 0;
+                break;
             }
         }
-        sample = (deeplearndata*)sample->next;
+
+        row->prev = 0;
+        if (i < samples-1)
+            row->prev = (struct deeplearndata *)&rows[i+1];
+
+        row->next = 0;
+        if (i > 0)
+            row->next = (struct deeplearndata *)&rows[i-1];
     }
 
+    return rows;
+}
+
+/**
+* @brief Attaches rows created by deeplearndata_create_rows to a learner
+*        and indexes them for fast access
+* @param learner Deep learner object
+* @param rows Array of data samples
+* @param samples The number of data samples
+* @param inputs Block of input values which the samples point into
+* @param outputs Block of output values which the samples point into
+* @param text Block of input text strings, or 0 if there are no text fields
+*/
+static void deeplearndata_attach_rows(deeplearn * learner,
+                                      deeplearndata * rows, int samples,
+                                      float * inputs, float * outputs,
+                                      char ** text)
+{
+    learner->data_rows = rows;
+    learner->data_rows_samples = samples;
+    learner->data_inputs = inputs;
+    learner->data_outputs = outputs;
+    learner->data_text = text;
+    if (samples > 0)
+        learner->data = &rows[samples-1];
+    learner->data_samples = samples;
+
     /* create the indexed array for fast access */
-    deeplearndata_index_meta(learner->test_data, learner->test_data_samples,
-                             &learner->indexed_test_data,
-                             &learner->indexed_test_data_samples);
+    deeplearndata_index_data(learner->data, learner->data_samples,
+                             &learner->indexed_data,
+                             &learner->indexed_data_samples);
+}
 
-    return 0;
+/**
+* @brief Reads the next block of a csv file into the line buffer, after any
+*        partial line left over from the previous block. The buffer is
+*        doubled in size if a single line fills it.
+* @param fp csv file
+* @param buffer Line buffer
+* @param buffer_size Size of the line buffer, excluding the terminator
+* @param buffer_length Number of bytes currently in the buffer
+* @returns Number of bytes read, zero at the end of the file or -1 if the
+*          buffer could not be grown
+*/
+static int deeplearndata_read_csv_block(FILE * fp, char ** buffer,
+                                        int * buffer_size,
+                                        int * buffer_length)
+{
+    char * grown;
+
+    if (*buffer_length == *buffer_size) {
+        grown = (char*)realloc(*buffer, (*buffer_size)*2 + 1);
+        if (!grown)
+            return -1;
+
+        *buffer = grown;
+        *buffer_size *= 2;
+    }
+
+    return (int)fread(&(*buffer)[*buffer_length], sizeof(char),
+                      *buffer_size - *buffer_length, fp);
 }
 
 /**
-* @brief Loads a data set from a csv file and creates a deep learner
+* @brief Loads a data set from a csv file and creates a deep learner.
+*        The file is read in large blocks and each line is parsed in place
+*        within the block, so there is no limit on line length and numeric
+*        fields are converted without being copied.
 * @param filename csv filename
 * @param learner Deep learner object
 * @param no_of_hiddens The number of hidden units per layer
@@ -533,11 +632,12 @@ int deeplearndata_read_csv(char * filename,
                            float error_threshold[],
                            unsigned int * random_seed)
 {
-    int field_number, input_index, ctr, samples_loaded = 0;
+    int field_number, input_index, samples_loaded = 0;
     FILE * fp;
-    char line[2000],valuestr[DEEPLEARN_MAX_FIELD_LENGTH_CHARS],*retval;
+    char * buffer, * line, * field, * end_of_line, delimiter;
+    int buffer_size = DEEPLEARN_CSV_BUFFER_SIZE;
+    int buffer_length = 0, line_start, line_end, bytes_read = 1;
     float value;
-    int data_set_index = 0;
     int no_of_inputs = 0;
     int no_of_input_fields = 0;
     float inputs[DEEPLEARN_MAX_CSV_INPUTS];
@@ -546,8 +646,10 @@ int deeplearndata_read_csv(char * filename,
     int fields_per_example = 0;
     int network_outputs = no_of_outputs;
     int is_text, output_ctr;
-    deeplearndata * data = 0;
-    int data_samples = 0;
+    deeplearndata * rows = 0;
+    float * rows_inputs = 0, * rows_outputs = 0;
+    char ** rows_text = 0;
+    int rows_capacity = 0;
     float input_range_min[DEEPLEARN_MAX_CSV_INPUTS];
     float input_range_max[DEEPLEARN_MAX_CSV_INPUTS];
     float output_range_min[DEEPLEARN_MAX_CSV_OUTPUTS];
@@ -576,142 +678,245 @@ int deeplearndata_read_csv(char * filename,
     if (!fp)
         return -1;
 
-    while (!feof(fp)) {
-        retval = fgets(line, 1999, fp);
-        if (!retval)
-            continue;
-
-        if (strlen(line)==0)
-            continue;
-
-        if ((line[0]=='"') || (line[0]=='#'))
-            continue;
+    /* one extra byte so that the last line can always be terminated */
+    CHARALLOC(buffer, buffer_size+1);
+    if (!buffer) {
+        fclose(fp);
+        return -2;
+    }
 
-        field_number = 0;
-        input_index = 0;
-        ctr = 0;
-        COUNTUP(i, strlen(line)) {
-            if (!((line[i] == ',') || (line[i] == ';') ||
-                  (i==strlen(line)-1))) {
-                /* update the value string */
-                if (ctr < DEEPLEARN_MAX_FIELD_LENGTH_CHARS-1)
-                    valuestr[ctr++] = line[i];
-                continue;
+    while ((bytes_read > 0) || (buffer_length > 0)) {
+        if (bytes_read > 0) {
+            bytes_read = deeplearndata_read_csv_block(fp, &buffer,
+                                                      &buffer_size,
+                                                      &buffer_length);
+            if (bytes_read < 0) {
+                free(buffer);
+                fclose(fp);
+                return -2;
             }
+            buffer_length += bytes_read;
+        }
 
-            if (i == strlen(line)-1) {
-                if (ctr < DEEPLEARN_MAX_FIELD_LENGTH_CHARS-1)
-                    valuestr[ctr++]=line[i];
+        line_start = 0;
+        while (line_start < buffer_length) {
+            end_of_line =
+                (char*)memchr(&buffer[line_start], '\n',
+                              buffer_length - line_start);
+            if (end_of_line == 0) {
+                /* wait for the rest of the line unless this is the end */
+                if (bytes_read > 0)
+                    break;
+                line_end = buffer_length;
             }
-            valuestr[ctr]=0;
-            ctr=0;
-
-            /* get the value from the string */
-            value = 0;
-            is_text = 0;
-            if ((valuestr[0]!='?') && (valuestr[0]!=10)) {
-                /* positive numbers*/
-                if (((valuestr[0] >= '0') &&
-                     (valuestr[0] <= '9')) ||
-                    /* negative numbers*/
-                    ((valuestr[0] == '-') &&
-                     (valuestr[1] >= '0') &&
-                     (valuestr[1] <= '9'))) {
-                    value = atof(valuestr);
-                }
-                else {
-                    is_text = 1;
-                }
+            else {
+                line_end = (int)(end_of_line - buffer);
             }
 
-            output_ctr = 0;
-            COUNTUP(j, no_of_outputs) {
-                if (field_number != output_field_index[j]) {
-                    output_ctr++;
-                    continue;
+            line = &buffer[line_start];
+            line_start = line_end + 1;
+
+            buffer[line_end] = 0;
+            if ((line_end > 0) && (&buffer[line_end-1] >= line) &&
+                (buffer[line_end-1] == '\r'))
+                buffer[line_end-1] = 0;
+
+            if ((line[0] == 0) || (line[0]=='"') || (line[0]=='#'))
+                continue;
+
+            field_number = 0;
+            input_index = 0;
+            field = line;
+            do {
+                /* find the end of the field */
+                end_of_line = field;
+                while ((*end_of_line != 0) &&
+                       (*end_of_line != ',') && (*end_of_line != ';'))
+                    end_of_line++;
+                delimiter = *end_of_line;
+
+                /* get the value from the string */
+                value = 0;
+                is_text = 0;
+                if ((field[0] != '?') && (end_of_line != field)) {
+                    /* positive numbers*/
+                    if (((field[0] >= '0') &&
+                         (field[0] <= '9')) ||
+                        /* negative numbers*/
+                        ((field[0] == '-') &&
+                         (field[1] >= '0') &&
+                         (field[1] <= '9'))) {
+                        value = (float)strtod(field, 0);
+                    }
+                    else {
+                        is_text = 1;
+                    }
                 }
 
-                if (j < DEEPLEARN_MAX_CSV_OUTPUTS-1) {
-                    if (output_classes <= 0) {
-                        outputs[j] = value;
-                        break;
+                output_ctr = 0;
+                COUNTUP(j, no_of_outputs) {
+                    if (field_number != output_field_index[j]) {
+                        output_ctr++;
+                        continue;
                     }
 
-                    /* for a class number */
-                    COUNTUP(k, network_outputs) {
-                        if (k != (int)value)
-                            outputs[k] = NEURON_LOW;
-                        else
-                            outputs[k] = NEURON_HIGH;
+                    if (j < DEEPLEARN_MAX_CSV_OUTPUTS-1) {
+                        if (output_classes <= 0) {
+                            outputs[j] = value;
+                            break;
+                        }
+
+                        /* for a class number */
+                        COUNTUP(k, network_outputs) {
+                            if (k != (int)value)
+                                outputs[k] = NEURON_LOW;
+                            else
+                                outputs[k] = NEURON_HIGH;
+                        }
+
+                        break;
                     }
 
-                    break;
+                    output_ctr++;
+                }
+                if ((output_ctr == no_of_outputs) &&
+                    (input_index < DEEPLEARN_MAX_CSV_INPUTS-1)) {
+                    inputs_text[input_index] = 0;
+                    if (is_text != 0) {
+                        /* terminate the text within the buffer, which
+                           deeplearndata_add then copies */
+                        if (end_of_line - field >=
+                            DEEPLEARN_MAX_FIELD_LENGTH_CHARS)
+                            field[DEEPLEARN_MAX_FIELD_LENGTH_CHARS-1] = 0;
+                        *end_of_line = 0;
+                        inputs_text[input_index] = field;
+                    }
+                    inputs[input_index++] = value;
                 }
 
-                output_ctr++;
+                field_number++;
+                field = end_of_line + 1;
+            } while (delimiter != 0);
+
+            if (fields_per_example == 0)
+                fields_per_example = field_number;
+
+            if (samples_loaded == 0)
+                no_of_input_fields = input_index;
+
+            /* add a data sample */
+            if (deeplearndata_reserve_rows(samples_loaded+1, &rows_capacity,
+                                           no_of_input_fields,
+                                           network_outputs,
+                                           &rows_inputs, &rows_outputs,
+                                           &rows_text) != 0) {
+                deeplearndata_free_text(rows_text,
+                                        samples_loaded*no_of_input_fields);
+                free(rows_inputs);
+                free(rows_outputs);
+                free(buffer);
+                fclose(fp);
+                return -3;
             }
-            if ((output_ctr == no_of_outputs) &&
-                (input_index < DEEPLEARN_MAX_CSV_INPUTS-1)) {
-                inputs_text[input_index] = 0;
-                if (is_text != 0) {
-                    /* allocate some memory for the string */
-                    CHARALLOC(inputs_text[input_index],
-                              strlen(valuestr)+1);
-                    if (!inputs_text[input_index])
-                        return -2;
-
-                    /* copy it */
-                    strcpy(inputs_text[input_index],
-                           (char*)valuestr);
-                }
-                inputs[input_index++] = value;
+
+            memcpy((void*)&rows_inputs[samples_loaded*no_of_input_fields],
+                   inputs, no_of_input_fields*sizeof(float));
+            memcpy((void*)&rows_outputs[samples_loaded*network_outputs],
+                   outputs, network_outputs*sizeof(float));
+
+            /* update the data range */
+            COUNTUP(i, no_of_input_fields) {
+                if (inputs[i] < input_range_min[i])
+                    input_range_min[i] = inputs[i];
+
+                if (inputs[i] > input_range_max[i])
+                    input_range_max[i] = inputs[i];
             }
 
-            field_number++;
-            data_set_index++;
-        }
+            COUNTUP(i, network_outputs) {
+                if ((int)outputs[i] == DEEPLEARN_UNKNOWN_VALUE)
+                    continue;
 
-        if (fields_per_example == 0)
-            fields_per_example = field_number;
+                if (outputs[i] < output_range_min[i])
+                    output_range_min[i] = outputs[i];
 
-        if (samples_loaded == 0)
-            no_of_input_fields = input_index;
+                if (outputs[i] > output_range_max[i])
+                    output_range_max[i] = outputs[i];
+            }
 
-        /* add a data sample */
-        if (deeplearndata_add(&data,
-                              &data_samples,
-                              inputs, inputs_text,
-                              outputs,
-                              no_of_input_fields,
-                              network_outputs,
-                              input_range_min,
-                              input_range_max,
-                              output_range_min,
-                              output_range_max) != 0) {
-            fclose(fp);
-            return -3;
-        }
+            /* copy any text out of the buffer */
+            COUNTUP(i, no_of_input_fields) {
+                if (inputs_text[i] == 0)
+                    continue;
 
-        /* free memory for any text strings */
-        COUNTUP(i, no_of_input_fields) {
-            if (inputs_text[i] != 0) {
-                free(inputs_text[i]);
-                inputs_text[i] = 0;
+                if (rows_text == 0) {
+                    rows_text = (char**)calloc(rows_capacity*
+                                               no_of_input_fields + 1,
+                                               sizeof(char*));
+                    if (!rows_text) {
+                        free(rows_inputs);
+                        free(rows_outputs);
+                        free(buffer);
+                        fclose(fp);
+                        return -3;
+                    }
+                }
+
+                CHARALLOC(rows_text[samples_loaded*no_of_input_fields + i],
+                          strlen(inputs_text[i])+1);
+                if (!rows_text[samples_loaded*no_of_input_fields + i]) {
+                    deeplearndata_free_text(rows_text,
+                                            rows_capacity*no_of_input_fields);
+                    free(rows_inputs);
+                    free(rows_outputs);
+                    free(buffer);
+                    fclose(fp);
+                    return -3;
+                }
+                strcpy(rows_text[samples_loaded*no_of_input_fields + i],
+                       inputs_text[i]);
             }
-        }
 
-        COUNTDOWN(i, network_outputs)
-            outputs[i] = DEEPLEARN_UNKNOWN_VALUE;
+            /* text strings point into the buffer */
+            COUNTUP(i, no_of_input_fields)
+                inputs_text[i] = 0;
+
+            COUNTDOWN(i, network_outputs)
+                outputs[i] = DEEPLEARN_UNKNOWN_VALUE;
 
-        samples_loaded++;
+            samples_loaded++;
+        }
+
+        /* move any partial line to the start of the buffer */
+        if (line_start < buffer_length) {
+            memmove(buffer, &buffer[line_start], buffer_length - line_start);
+            buffer_length -= line_start;
+        }
+        else {
+            buffer_length = 0;
+        }
     }
 
+    free(buffer);
     fclose(fp);
 
+    /* create the samples on top of the row blocks */
+    rows = deeplearndata_create_rows(samples_loaded, no_of_input_fields,
+                                     network_outputs, rows_inputs,
+                                     rows_text, rows_outputs);
+    if (!rows) {
+        deeplearndata_free_text(rows_text, rows_capacity*no_of_input_fields);
+        free(rows_inputs);
+        free(rows_outputs);
+        return -3;
+    }
+
     /* calculate field lengths */
     no_of_inputs =
         deeplearndata_update_field_lengths(no_of_input_fields,
-                                           field_length, data);
+                                           field_length,
+                                           (samples_loaded > 0) ?
+                                           &rows[samples_loaded-1] : 0);
 
     /* create the deep learner */
     deeplearn_init(learner,
@@ -719,6 +924,10 @@ int deeplearndata_read_csv(char * filename,
                    hidden_layers, network_outputs,
                    error_threshold, random_seed);
 
+    /* attach the data samples */
+    deeplearndata_attach_rows(learner, rows, samples_loaded,
+                              rows_inputs, rows_outputs, rows_text);
+
     /* set the input fields */
     learner->no_of_input_fields = no_of_input_fields;
 
@@ -734,15 +943,6 @@ int deeplearndata_read_csv(char * filename,
         }
     }
 
-    /* attach the data samples */
-    learner->data = data;
-    learner->data_samples = data_samples;
-
-    /* create the indexed array for fast access */
-    deeplearndata_index_data(learner->data, learner->data_samples,
-                             &learner->indexed_data,
-                             &learner->indexed_data_samples);
-
     /* set the field ranges */
     COUNTDOWN(i, no_of_input_fields) {
         learner->input_range_min[i] = input_range_min[i];
@@ -754,6 +954,9 @@ int deeplearndata_read_csv(char * filename,
         learner->output_range_max[i] = output_range_max[i];
     }
 
+    if (deeplearndata_encode_text(learner) != 0)
+        return -6;
+
     /* create training and test data sets */
     if (deeplearndata_create_datasets(learner, 20) != 0)
         return -5;
@@ -762,101 +965,1633 @@ int deeplearndata_read_csv(char * filename,
 }
 
 /**
- * @brief Update the training history graph
- * @param learner Deep learner object
- */
-static void deeplearndata_update_training_history(deeplearn * learner)
+* @brief Returns the data sample stored at the given row of a binary
+*        data file. Rows are stored in the order in which they were read,
+*        which is the reverse of the indexed order.
+* @param learner Deep learner object
+* @param row Row number
+* @returns deeplearndata object
+*/
+static deeplearndata * deeplearndata_binary_row(deeplearn * learner, int row)
 {
-    /* plot a graph showing training progress */
-    if (learner->training_ctr > learner->history.interval) {
-        deeplearn_plot_history(learner,
-                               DEEPLEARN_PLOT_WIDTH, DEEPLEARN_PLOT_HEIGHT);
-        deeplearn_plot_gradients(GRADIENT_STANDARD_DEVIATION, learner,
-                                 DEEPLEARN_PLOT_WIDTH, DEEPLEARN_PLOT_HEIGHT);
-        deeplearn_plot_gradients(GRADIENT_MEAN, learner,
-                                 DEEPLEARN_PLOT_WIDTH, DEEPLEARN_PLOT_HEIGHT);
-        learner->training_ctr = 0;
-    }
-    learner->training_ctr++;
+    return deeplearndata_get(learner, learner->data_samples - 1 - row);
 }
 
 /**
-* @brief Performs a single training step
+* @brief Saves the data samples, field lengths, ranges and the current
+*        training and test sets to a binary file which can later be
+*        opened with deeplearndata_open_binary, avoiding parsing the
+*        original csv file again
 * @param learner Deep learner object
-* @returns 1=pretraining,2=final training,0=training complete,-1=no training data
+* @param filename Binary data filename
+* @returns zero on success
 */
-int deeplearndata_training(deeplearn * learner)
+int deeplearndata_save_binary(deeplearn * learner, char * filename)
 {
-    if (learner->training_data_samples == 0)
+    FILE * fp;
+    deeplearndata * sample;
+    int header[DEEPLEARN_BINARY_DATA_HEADER];
+    int fields = learner->no_of_input_fields;
+    int outputs = learner->net->no_of_outputs;
+    int has_text = 0, text_length = 0, offset;
+
+    if ((learner->data_samples == 0) ||
+        (learner->indexed_data_samples != learner->data_samples) ||
+        (learner->field_length == 0))
         return -1;
 
-    deeplearndata_update_training_history(learner);
+    /* size of the text strings */
+    COUNTUP(r, learner->data_samples) {
+        sample = deeplearndata_binary_row(learner, r);
+        if (sample->inputs_text == 0)
+            continue;
 
-    if ((learner->net->hidden_layers > 1) &&
-        (learner->current_hidden_layer < learner->net->hidden_layers)) {
-        /* index number of a random training sample */
-        int index =
-            rand_num(&learner->net->random_seed)%
-            learner->training_data_samples;
-        /* get the sample */
-        deeplearndata * sample = deeplearndata_get_training(learner, index);
-        deeplearn_set_inputs(learner, sample);
-        deeplearn_update(learner);
-        return 1;
+        COUNTUP(i, fields) {
+            if (sample->inputs_text[i] != 0) {
+                has_text = 1;
+                text_length += strlen(sample->inputs_text[i]) + 1;
+            }
+        }
     }
 
-    if (learner->training_complete == 0) {
-        /* index number of a random training sample */
-        int index = rand_num(&learner->net->random_seed)%
-            learner->training_data_labeled_samples;
-        /* get the sample */
-        deeplearndata * sample =
-            deeplearndata_get_training_labeled(learner, index);
-        deeplearn_set_inputs(learner, sample);
-        deeplearn_set_outputs(learner, sample);
-        deeplearn_update(learner);
-        return 2;
+    fp = fopen(filename, "wb");
+    if (!fp)
+        return -2;
+
+    header[0] = DEEPLEARN_BINARY_DATA_MAGIC;
+    header[1] = DEEPLEARN_BINARY_DATA_VERSION;
+    header[2] = learner->data_samples;
+    header[3] = fields;
+    header[4] = outputs;
+    header[5] = learner->training_data_samples;
+    header[6] = learner->training_data_labeled_samples;
+    header[7] = learner->test_data_samples;
+    header[8] = has_text;
+    header[9] = text_length;
+
+    if (INTWRITEARRAY(header, DEEPLEARN_BINARY_DATA_HEADER) == 0) {
+        fclose(fp);
+        return -3;
     }
+
+    if ((INTWRITEARRAY(learner->field_length, fields) != fields) ||
+        (FLOATWRITEARRAY(learner->input_range_min, fields) != fields) ||
+        (FLOATWRITEARRAY(learner->input_range_max, fields) != fields) ||
+        (FLOATWRITEARRAY(learner->output_range_min, outputs) != outputs) ||
+        (FLOATWRITEARRAY(learner->output_range_max, outputs) != outputs)) {
+        fclose(fp);
+        return -4;
+    }
+
+    COUNTUP(r, learner->data_samples) {
+        sample = deeplearndata_binary_row(learner, r);
+        if (FLOATWRITEARRAY(sample->inputs, fields) != fields) {
+            fclose(fp);
+            return -5;
+        }
+    }
+
+    COUNTUP(r, learner->data_samples) {
+        sample = deeplearndata_binary_row(learner, r);
+        if (FLOATWRITEARRAY(sample->outputs, outputs) != outputs) {
+            fclose(fp);
+            return -6;
+        }
+    }
+
+    /* the training and test sets */
+    if ((INTWRITEARRAY(learner->training_data,
+                       learner->training_data_samples) !=
+         learner->training_data_samples) ||
+        (INTWRITEARRAY(learner->training_data_labeled,
+                       learner->training_data_labeled_samples) !=
+         learner->training_data_labeled_samples) ||
+        (INTWRITEARRAY(learner->test_data,
+                       learner->test_data_samples) !=
+         learner->test_data_samples)) {
+        fclose(fp);
+        return -7;
+    }
+
+    if (has_text == 0) {
+        fclose(fp);
+        return 0;
+    }
+
+    /* offsets of each text string, or -1 for numeric fields */
+    offset = 0;
+    COUNTUP(r, learner->data_samples) {
+        sample = deeplearndata_binary_row(learner, r);
+        COUNTUP(i, fields) {
+            int text_offset = -1;
+            if ((sample->inputs_text != 0) &&
+                (sample->inputs_text[i] != 0)) {
+                text_offset = offset;
+                offset += strlen(sample->inputs_text[i]) + 1;
+            }
+            if (INTWRITE(text_offset) == 0) {
+                fclose(fp);
+                return -8;
+            }
+        }
+    }
+
+    COUNTUP(r, learner->data_samples) {
+        sample = deeplearndata_binary_row(learner, r);
+        if (sample->inputs_text == 0)
+            continue;
+
+        COUNTUP(i, fields) {
+            if (sample->inputs_text[i] == 0)
+                continue;
+
+            if (fwrite(sample->inputs_text[i], sizeof(char),
+                       strlen(sample->inputs_text[i]) + 1, fp) == 0) {
+                fclose(fp);
+                return -9;
+            }
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/**
+* @brief Copies a training or test set from a binary data file
+* @param learner Deep learner object
+* @param set The training or test set to be created
+* @param stored The set within the binary file
+* @param samples The number of samples in the set
+* @returns zero on success
+*/
+static int deeplearndata_open_binary_set(deeplearn * learner, int ** set,
+                                         int * stored, int samples)
+{
+    INTALLOC(*set, samples + 1);
+    if (!*set)
+        return -1;
+
+    COUNTUP(i, samples) {
+        if ((stored[i] < 0) || (stored[i] >= learner->data_samples))
+            return -2;
+        (*set)[i] = stored[i];
+    }
+
+    return 0;
+}
+
+/**
+* @brief Creates a deep learner from a binary data file saved with
+*        deeplearndata_save_binary. The file is memory mapped and the
+*        samples point directly into the mapping, so that opening is
+*        quick and processes using the same file share its pages.
+* @param filename Binary data filename
+* @param learner Deep learner object
+* @param no_of_hiddens The number of hidden units per layer
+* @param hidden layers The number of hidden layers
+* @param error_threshold Training error thresholds for each hidden layer
+* @param random_seed Random number seed
+* @returns The number of data samples loaded, or a negative error code
+*/
+int deeplearndata_open_binary(char * filename,
+                              deeplearn * learner,
+                              int no_of_hiddens, int hidden_layers,
+                              float error_threshold[],
+                              unsigned int * random_seed)
+{
+    int fd, samples, fields, outputs, no_of_inputs = 0;
+    struct stat file_status;
+    size_t map_length, expected_length;
+    void * map;
+    int * header, * field_length, * training, * labeled, * test;
+    int * text_offsets = 0;
+    float * ranges, * inputs, * outputs_block;
+    char * text_pool = 0, ** text = 0;
+    deeplearndata * rows;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if ((fstat(fd, &file_status) != 0) ||
+        (file_status.st_size <
+         (off_t)(DEEPLEARN_BINARY_DATA_HEADER*sizeof(int)))) {
+        close(fd);
+        return -2;
+    }
+
+    map_length = (size_t)file_status.st_size;
+    map = mmap(0, map_length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -3;
+
+    header = (int*)map;
+    samples = header[2];
+    fields = header[3];
+    outputs = header[4];
+    if ((header[0] != DEEPLEARN_BINARY_DATA_MAGIC) ||
+        (header[1] != DEEPLEARN_BINARY_DATA_VERSION) ||
+        (samples < 1) || (fields < 0) || (outputs < 1) ||
+        (header[5] < 0) || (header[6] < 0) || (header[7] < 0) ||
+        (header[5] > samples) || (header[6] > samples) ||
+        (header[7] > samples) || (header[9] < 0)) {
+        munmap(map, map_length);
+        return -4;
+    }
+
+    /* check that every section is present */
+    expected_length =
+        (DEEPLEARN_BINARY_DATA_HEADER + fields +
+         header[5] + header[6] + header[7])*sizeof(int) +
+        (fields*2 + outputs*2 + (size_t)samples*(fields + outputs))*
+        sizeof(float);
+    if (header[8] != 0)
+        expected_length +=
+            (size_t)samples*fields*sizeof(int) + header[9];
+    if (map_length < expected_length) {
+        munmap(map, map_length);
+        return -5;
+    }
+
+    /* locate the sections within the mapping */
+    field_length = &header[DEEPLEARN_BINARY_DATA_HEADER];
+    ranges = (float*)&field_length[fields];
+    inputs = &ranges[fields*2 + outputs*2];
+    outputs_block = &inputs[(size_t)samples*fields];
+    training = (int*)&outputs_block[(size_t)samples*outputs];
+    labeled = &training[header[5]];
+    test = &labeled[header[6]];
+    if (header[8] != 0) {
+        text_offsets = &test[header[7]];
+        text_pool = (char*)&text_offsets[(size_t)samples*fields];
+
+        /* the last string must end within the pool */
+        if ((header[9] > 0) && (text_pool[header[9]-1] != 0)) {
+            munmap(map, map_length);
+            return -7;
+        }
+    }
+
+    /* pointers to any text strings */
+    if (text_offsets != 0) {
+        CHARPTRALLOC(text, samples*fields + 1);
+        if (!text) {
+            munmap(map, map_length);
+            return -6;
+        }
+
+        COUNTUP(i, samples*fields) {
+            text[i] = 0;
+            if (text_offsets[i] < 0)
+                continue;
+
+            if (text_offsets[i] >= header[9]) {
+                free(text);
+                munmap(map, map_length);
+                return -7;
+            }
+            text[i] = &text_pool[text_offsets[i]];
+        }
+    }
+
+    rows = deeplearndata_create_rows(samples, fields, outputs,
+                                     inputs, text, outputs_block);
+    if (!rows) {
+        free(text);
+        munmap(map, map_length);
+        return -8;
+    }
+
+    COUNTUP(i, fields) {
+        if (field_length[i] > 0)
+            no_of_inputs += field_length[i];
+        else
+            no_of_inputs++;
+    }
+
+    /* create the deep learner */
+    deeplearn_init(learner,
+                   no_of_inputs, no_of_hiddens,
+                   hidden_layers, outputs,
+                   error_threshold, random_seed);
+
+    /* attach the data samples */
+    deeplearndata_attach_rows(learner, rows, samples,
+                              inputs, outputs_block, text);
+    learner->data_map = map;
+    learner->data_map_length = map_length;
+
+    /* set the input fields */
+    learner->no_of_input_fields = fields;
+
+    INTALLOC(learner->field_length, fields + 1);
+    if (!learner->field_length)
+        return -9;
+
+    COUNTDOWN(i, fields) {
+        learner->field_length[i] = field_length[i];
+        learner->input_range_min[i] = ranges[i];
+        learner->input_range_max[i] = ranges[fields + i];
+    }
+
+    COUNTDOWN(i, outputs) {
+        learner->output_range_min[i] = ranges[fields*2 + i];
+        learner->output_range_max[i] = ranges[fields*2 + outputs + i];
+    }
+
+    /* restore the training and test sets */
+    if ((deeplearndata_open_binary_set(learner, &learner->training_data,
+                                       training, header[5]) != 0) ||
+        (deeplearndata_open_binary_set(learner,
+                                       &learner->training_data_labeled,
+                                       labeled, header[6]) != 0) ||
+        (deeplearndata_open_binary_set(learner, &learner->test_data,
+                                       test, header[7]) != 0))
+        return -10;
+
+    learner->training_data_samples = header[5];
+    learner->training_data_labeled_samples = header[6];
+    learner->test_data_samples = header[7];
+
+    if (deeplearndata_encode_text(learner) != 0)
+        return -11;
+
+    return samples;
+}
+
+/**
+ * @brief Update the training history graph
+ * @param learner Deep learner object
+ */
+static void deeplearndata_update_training_history(deeplearn * learner)
+{
+    /* plot a graph showing training progress */
+    if (learner->training_ctr > learner->history.interval) {
+        PROFILE_TIMER(t);
+
+        if (learner->plotting == DEEPLEARN_PLOT_ASYNC) {
+            deeplearn_history * histories[] = {
+                &learner->history,
+                &learner->gradients_std,
+                &learner->gradients_mean
+            };
+
+            /* dropped if the previous plots are still being drawn */
+            deeplearn_plotter_async(&learner->plotter, histories, 3,
+                                    DEEPLEARN_PLOT_WIDTH,
+                                    DEEPLEARN_PLOT_HEIGHT);
+        }
+        else if (learner->plotting == DEEPLEARN_PLOT_SYNC) {
+            deeplearn_plot_history(learner, DEEPLEARN_PLOT_WIDTH,
+                                   DEEPLEARN_PLOT_HEIGHT);
+            deeplearn_plot_gradients(GRADIENT_STANDARD_DEVIATION, learner,
+                                     DEEPLEARN_PLOT_WIDTH,
+                                     DEEPLEARN_PLOT_HEIGHT);
+            deeplearn_plot_gradients(GRADIENT_MEAN, learner,
+                                     DEEPLEARN_PLOT_WIDTH,
+                                     DEEPLEARN_PLOT_HEIGHT);
+        }
+        learner->training_ctr = 0;
+        PROFILE_LAP(DEEPLEARN_PHASE_PLOTTING, t, 1);
+    }
+    learner->training_ctr++;
+}
+
+/**
+* @brief Returns the position of the next training sample to be used.
+*        Each epoch visits every sample of the set once, in an order which
+*        is shuffled at the start of the epoch.
+* @param learner Deep learner object
+* @param labeled Non-zero to sample from the labeled training set
+* @returns Position within the training set, or -1 if the set is empty
+*/
+static int deeplearndata_next_sample(deeplearn * learner, int labeled)
+{
+    int samples = learner->training_data_samples;
+    int i, j, swap;
+
+    if (labeled != 0)
+        samples = learner->training_data_labeled_samples;
+
+    if (samples <= 0)
+        return -1;
+
+    if ((learner->sampler_order == 0) ||
+        (learner->sampler_samples != samples) ||
+        (learner->sampler_labeled != labeled)) {
+        free(learner->sampler_order);
+        INTALLOC(learner->sampler_order, samples);
+        if (!learner->sampler_order) {
+            learner->sampler_samples = 0;
+            return rand_num(&learner->net->random_seed)%samples;
+        }
+
+        COUNTDOWN(k, samples)
+            learner->sampler_order[k] = k;
+        learner->sampler_samples = samples;
+        learner->sampler_labeled = labeled;
+        learner->sampler_position = samples;
+    }
+
+    /* shuffle at the start of each epoch */
+    if (learner->sampler_position >= samples) {
+        for (i = samples-1; i > 0; i--) {
+            j = rand_num(&learner->net->random_seed)%(i+1);
+            swap = learner->sampler_order[i];
+            learner->sampler_order[i] = learner->sampler_order[j];
+            learner->sampler_order[j] = swap;
+        }
+        learner->sampler_position = 0;
+        learner->sampler_epoch++;
+    }
+
+    return learner->sampler_order[learner->sampler_position++];
+}
+
+/**
+* @brief Allocates an array for cached layer values, either in memory
+*        or mapped from a file
+* @param filename File to map the array from, or NULL to keep it in memory
+* @param length Size of the array in bytes
+* @returns The array, or NULL if it could not be allocated
+*/
+static float * deeplearndata_cache_alloc(char * filename, size_t length)
+{
+    float * cache;
+    int fd;
+
+    if (filename == NULL)
+        return (float*)malloc(length);
+
+    fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return NULL;
+
+    /* extend the file to the size of the cache */
+    if ((lseek(fd, (off_t)length - 1, SEEK_SET) < 0) ||
+        (write(fd, "", 1) != 1)) {
+        close(fd);
+        return NULL;
+    }
+
+    cache = (float*)mmap(0, length, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+    close(fd);
+    if ((void*)cache == MAP_FAILED)
+        return NULL;
+
+    return cache;
+}
+
+/**
+* @brief Releases an array allocated with deeplearndata_cache_alloc
+* @param cache The array
+* @param filename File which the array is mapped from, or NULL
+* @param length Size of the array in bytes
+*/
+static void deeplearndata_cache_free(float * cache, char * filename,
+                                     size_t length)
+{
+    if (cache == NULL)
+        return;
+
+    if (filename != NULL) {
+        munmap(cache, length);
+        remove(filename);
+    }
+    else {
+        free(cache);
+    }
+}
+
+/**
+* @brief Enables or disables caching of layer values during pretraining.
+*        Once a hidden layer has been pretrained it no longer changes,
+*        so its values for every training sample are calculated once
+*        and the autocoder of the next layer is trained directly from
+*        them. Each layer's values are calculated from those of the
+*        layer below, so every layer is fed forward only once for
+*        the training set. Autocoders are trained from the cache with
+*        autocoder_update_batch, even a single sample at a time.
+* @param learner Deep learner object
+* @param enable Non-zero to enable the cache
+* @param filename File to map the cache from, or NULL to keep it in memory
+* @returns zero on success
+*/
+int deeplearndata_set_pretrain_cache(deeplearn * learner, int enable,
+                                     char * filename)
+{
+    deeplearndata_cache_free(learner->pretrain_cache,
+                             learner->pretrain_cache_filename,
+                             learner->pretrain_cache_length);
+    free(learner->pretrain_cache_filename);
+
+    learner->pretrain_cache_enabled = 0;
+    learner->pretrain_cache_filename = NULL;
+    learner->pretrain_cache = NULL;
+    learner->pretrain_cache_length = 0;
+    learner->pretrain_cache_layer = -1;
+    learner->pretrain_cache_samples = 0;
+
+    if (!enable)
+        return 0;
+
+    if (filename != NULL) {
+        CHARALLOC(learner->pretrain_cache_filename, strlen(filename) + 1);
+        if (!learner->pretrain_cache_filename)
+            return -1;
+        sprintf(learner->pretrain_cache_filename, "%s", filename);
+    }
+
+    learner->pretrain_cache_enabled = 1;
+    return 0;
+}
+
+/**
+* @brief Calculates the values of a hidden layer for every training sample.
+*        If the values of the layer below are cached then only this layer
+*        is fed forward, otherwise the samples are fed through every layer
+*        up to and including this one
+* @param learner Deep learner object
+* @param layer Index of the hidden layer
+* @param values Returned training_data_samples x units array of values
+* @returns zero on success
+*/
+static int deeplearndata_cache_layer(deeplearn * learner, int layer,
+                                     float * values)
+{
+    bp * net = learner->net;
+    const int samples = learner->training_data_samples;
+    int block_size = DEEPLEARN_FEED_FORWARD_BATCH;
+    int units = HIDDENS_IN_LAYER(net, layer);
+    float * inputs;
+
+    if ((layer > 0) && (learner->pretrain_cache != NULL) &&
+        (learner->pretrain_cache_layer == layer) &&
+        (learner->pretrain_cache_samples == samples))
+        return bp_feed_forward_layer_batch(net, layer,
+                                           learner->pretrain_cache,
+                                           samples, values);
+
+    FLOATALLOC(inputs, block_size*net->no_of_inputs);
+    if (!inputs)
+        return -1;
+
+    for (int start = 0; start < samples; start += block_size) {
+        int n = block_size;
+
+        if (start + n > samples)
+            n = samples - start;
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(n*net->no_of_inputs))
+        COUNTUP(b, n) {
+            deeplearndata * sample =
+                deeplearndata_get_training(learner, start + b);
+            deeplearn_encode_inputs(learner, sample,
+                                    &inputs[b*net->no_of_inputs]);
+        }
+
+        if (bp_feed_forward_layers_batch(net, inputs, n, layer+1,
+                                         &values[start*units]) != 0) {
+            free(inputs);
+            return -2;
+        }
+    }
+
+    free(inputs);
+    return 0;
+}
+
+/**
+* @brief Returns the cached values of the layer below the hidden layer
+*        which is currently being pretrained, calculating them when
+*        pretraining moves on to a new layer
+* @param learner Deep learner object
+* @returns The cached values, or NULL if they are not cached
+*/
+static float * deeplearndata_pretrain_cache(deeplearn * learner)
+{
+    bp * net = learner->net;
+    const int current_layer = learner->current_hidden_layer;
+    const int samples = learner->training_data_samples;
+    char * filename = learner->pretrain_cache_filename;
+    char * next_filename = NULL;
+    float * cache;
+    size_t length;
+
+    if ((!learner->pretrain_cache_enabled) ||
+        (current_layer < 1) || (current_layer >= net->hidden_layers) ||
+        (samples == 0))
+        return NULL;
+
+    /* the cache holds the inputs of the current layer */
+    if ((learner->pretrain_cache_layer == current_layer) &&
+        (learner->pretrain_cache_samples == samples))
+        return learner->pretrain_cache;
+
+    /* the new values are calculated from the old ones, so while
+       they are being calculated both are needed */
+    if (filename != NULL) {
+        CHARALLOC(next_filename, strlen(filename) + 5);
+        if (!next_filename)
+            return NULL;
+        sprintf(next_filename, "%s.new", filename);
+    }
+
+    length = (size_t)samples*HIDDENS_IN_LAYER(net, current_layer-1)*
+        sizeof(float);
+    cache = deeplearndata_cache_alloc(next_filename, length);
+    if (cache == NULL) {
+        free(next_filename);
+        return NULL;
+    }
+
+    if (deeplearndata_cache_layer(learner, current_layer-1, cache) != 0) {
+        deeplearndata_cache_free(cache, next_filename, length);
+        free(next_filename);
+        return NULL;
+    }
+
+    deeplearndata_cache_free(learner->pretrain_cache, filename,
+                             learner->pretrain_cache_length);
+    if (next_filename != NULL) {
+        rename(next_filename, filename);
+        free(next_filename);
+    }
+
+    learner->pretrain_cache = cache;
+    learner->pretrain_cache_length = length;
+    learner->pretrain_cache_layer = current_layer;
+    learner->pretrain_cache_samples = samples;
+    return cache;
+}
+
+/**
+* @brief Trains the network on the next samples from the epoch sampler,
+*        with each worker taking DEEPLEARN_HOGWILD_SAMPLES of them,
+*        see deeplearn_set_workers
+* @param learner Deep learner object
+* @returns zero on success
+*/
+static int deeplearndata_training_hogwild(deeplearn * learner)
+{
+    bp * net = learner->net;
+    int samples = learner->no_of_workers*DEEPLEARN_HOGWILD_SAMPLES;
+    int * batch;
+
+    INTALLOC(batch, samples);
+    if (!batch)
+        return -1;
+
+    COUNTUP(s, samples)
+        batch[s] = deeplearndata_next_sample(learner, 1);
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(samples*net->no_of_inputs))
+    COUNTUP(s, samples) {
+        deeplearndata * sample =
+            deeplearndata_get_training_labeled(learner, batch[s]);
+        deeplearn_encode_inputs(learner, sample,
+                                &learner->worker_inputs[s*net->no_of_inputs]);
+        deeplearn_encode_outputs(learner, sample,
+                                 &learner->worker_targets[s*
+                                                          net->no_of_outputs]);
+    }
+    free(batch);
+
+    return deeplearn_update_hogwild(learner, learner->workers,
+                                    learner->no_of_workers,
+                                    learner->worker_inputs,
+                                    learner->worker_targets, samples);
+}
+
+/**
+* @brief Performs a single training step. Once pretraining is complete
+*        this trains every worker on a number of samples if there is
+*        more than one, see deeplearn_set_workers
+* @param learner Deep learner object
+* @returns 1=pretraining,2=final training,0=training complete,-1=no training data
+*/
+int deeplearndata_training(deeplearn * learner)
+{
+    if (learner->training_data_samples == 0)
+        return -1;
+
+    deeplearndata_update_training_history(learner);
+
+    if ((learner->net->hidden_layers > 1) &&
+        (learner->current_hidden_layer < learner->net->hidden_layers)) {
+        float * cache = deeplearndata_pretrain_cache(learner);
+        PROFILE_TIMER(t);
+        /* index number of the next training sample */
+        int index = deeplearndata_next_sample(learner, 0);
+        if (cache != NULL) {
+            int units = HIDDENS_IN_LAYER(learner->net,
+                                         learner->current_hidden_layer-1);
+            if (deeplearn_update_pretraining(learner, &cache[index*units],
+                                             1) != 0)
+                return -2;
+            return 1;
+        }
+        /* get the sample */
+        deeplearndata * sample = deeplearndata_get_training(learner, index);
+        deeplearn_set_inputs(learner, sample);
+        PROFILE_LAP(DEEPLEARN_PHASE_SAMPLING, t, 1);
+        deeplearn_update(learner);
+        return 1;
+    }
+
+    if (learner->training_complete == 0) {
+        /* several workers train the network at once */
+        if (learner->no_of_workers > 1) {
+            if (learner->training_data_labeled_samples == 0)
+                return -1;
+            if (deeplearndata_training_hogwild(learner) != 0)
+                return -3;
+            return 2;
+        }
+
+        PROFILE_TIMER(t);
+        /* index number of the next training sample */
+        int index = deeplearndata_next_sample(learner, 1);
+        /* get the sample */
+        deeplearndata * sample =
+            deeplearndata_get_training_labeled(learner, index);
+        deeplearn_set_inputs(learner, sample);
+        deeplearn_set_outputs(learner, sample);
+        PROFILE_LAP(DEEPLEARN_PHASE_SAMPLING, t, 1);
+        deeplearn_update(learner);
+        return 2;
+    }
+    return 0;
+}
+
+/**
+* @brief Pretrains the autocoder of the current layer on a mini-batch
+*        of the next samples from the epoch sampler. Labels are not
+*        needed, so all training samples are used. If the values of the
+*        layer below are cached then the autocoder is trained from those
+* @param learner Deep learner object
+* @param batch_size The number of samples in each batch
+* @returns 1 on success, or a negative value on error
+*/
+static int deeplearndata_pretraining_batch(deeplearn * learner,
+                                           int batch_size)
+{
+    bp * net = learner->net;
+    float * cache = deeplearndata_pretrain_cache(learner);
+    float * inputs;
+    int * batch;
+    int retval = 1;
+
+    if (cache != NULL) {
+        int units = HIDDENS_IN_LAYER(net, learner->current_hidden_layer-1);
+
+        FLOATALLOC(inputs, batch_size*units);
+        if (!inputs)
+            return -2;
+
+        deeplearndata_update_training_history(learner);
+
+        COUNTUP(b, batch_size)
+            memcpy((void*)&inputs[b*units],
+                   &cache[deeplearndata_next_sample(learner, 0)*units],
+                   units*sizeof(float));
+
+        if (deeplearn_update_pretraining(learner, inputs, batch_size) != 0)
+            retval = -4;
+
+        free(inputs);
+        return retval;
+    }
+
+    FLOATALLOC(inputs, batch_size*net->no_of_inputs);
+    if (!inputs)
+        return -2;
+
+    INTALLOC(batch, batch_size);
+    if (!batch) {
+        free(inputs);
+        return -3;
+    }
+
+    deeplearndata_update_training_history(learner);
+
+    COUNTUP(b, batch_size)
+        batch[b] = deeplearndata_next_sample(learner, 0);
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(batch_size*net->no_of_inputs))
+    COUNTUP(b, batch_size) {
+        deeplearndata * sample =
+            deeplearndata_get_training(learner, batch[b]);
+        deeplearn_encode_inputs(learner, sample,
+                                &inputs[b*net->no_of_inputs]);
+    }
+
+    if (deeplearn_update_batch(learner, inputs, 0, batch_size) != 0)
+        retval = -4;
+
+    free(batch);
+    free(inputs);
+    return retval;
+}
+
+/**
+* @brief Performs a training step on a mini-batch of the next samples
+*        from the epoch sampler.
+*        During pretraining the autocoder of the current layer is
+*        trained on a batch of unlabeled samples
+* @param learner Deep learner object
+* @param batch_size The number of samples in each batch
+* @returns 1=pretraining,2=final training,0=training complete,-1=no training data
+*/
+int deeplearndata_training_batch(deeplearn * learner, int batch_size)
+{
+    bp * net = learner->net;
+    float * inputs, * targets;
+    int * batch;
+    int retval = 0;
+
+    if (learner->training_data_samples == 0)
+        return -1;
+
+    if ((net->hidden_layers > 1) &&
+        (learner->current_hidden_layer < net->hidden_layers))
+        return deeplearndata_pretraining_batch(learner, batch_size);
+
+    if (learner->training_complete != 0)
+        return 0;
+
+    if (learner->training_data_labeled_samples == 0)
+        return -1;
+
+    FLOATALLOC(inputs, batch_size*net->no_of_inputs);
+    if (!inputs)
+        return -2;
+
+    FLOATALLOC(targets, batch_size*net->no_of_outputs);
+    if (!targets) {
+        free(inputs);
+        return -3;
+    }
+
+    INTALLOC(batch, batch_size);
+    if (!batch) {
+        free(inputs);
+        free(targets);
+        return -3;
+    }
+
+    deeplearndata_update_training_history(learner);
+
+    /* choose the samples, then normalise them into the batch arrays.
+       Encoding does not alter the network so samples are encoded
+       concurrently */
+    COUNTUP(b, batch_size)
+        batch[b] = deeplearndata_next_sample(learner, 1);
+
+#pragma omp parallel for schedule(static) \
+    num_threads(deeplearn_get_threads()) \
+    if(deeplearn_parallel(batch_size*net->no_of_inputs))
+    COUNTUP(b, batch_size) {
+        deeplearndata * sample =
+            deeplearndata_get_training_labeled(learner, batch[b]);
+        deeplearn_encode_inputs(learner, sample,
+                                &inputs[b*net->no_of_inputs]);
+        deeplearn_encode_outputs(learner, sample,
+                                 &targets[b*net->no_of_outputs]);
+    }
+
+    if (deeplearn_update_batch(learner, inputs, targets, batch_size) != 0)
+        retval = -4;
+    else
+        retval = 2;
+
+    free(batch);
+    free(inputs);
+    free(targets);
+    return retval;
+}
+
+/**
+* @brief Initialises a streaming data source, which supplies training
+*        samples through a bounded buffer rather than holding them all
+*        in memory
+* @param stream Stream object
+* @param source The data source, passed to the read and close functions
+* @param read Reads the next sample from the source into the given arrays,
+*        returning zero on success, 1 at the end of the source or a
+*        negative value on error. After returning 1 the source starts
+*        again from its beginning.
+* @param close Releases the source when the stream is freed, or 0
+* @param no_of_input_fields The number of input fields per sample
+* @param no_of_outputs The number of outputs per sample
+* @param capacity The number of samples held within the buffer
+* @returns zero on success
+*/
+int deeplearndata_stream_init(deeplearndata_stream * stream,
+                              void * source,
+                              int (*read)(void *, float *, float *),
+                              void (*close)(void *),
+                              int no_of_input_fields, int no_of_outputs,
+                              int capacity)
+{
+    if ((read == 0) || (no_of_outputs < 1) || (capacity < 1))
+        return -1;
+
+    stream->source = source;
+    stream->read = read;
+    stream->close = close;
+    stream->no_of_input_fields = no_of_input_fields;
+    stream->no_of_outputs = no_of_outputs;
+    stream->capacity = capacity;
+    stream->count = 0;
+    stream->exhausted = 0;
+    stream->passes = 0;
+
+    FLOATALLOC(stream->inputs, capacity*no_of_input_fields + 1);
+    if (!stream->inputs)
+        return -2;
+
+    FLOATALLOC(stream->outputs, capacity*no_of_outputs);
+    if (!stream->outputs) {
+        free(stream->inputs);
+        return -3;
+    }
+    return 0;
+}
+
+/**
+* @brief Frees a streaming data source and closes its source
+* @param stream Stream object
+*/
+void deeplearndata_stream_free(deeplearndata_stream * stream)
+{
+    if (stream->close != 0)
+        stream->close(stream->source);
+    free(stream->inputs);
+    free(stream->outputs);
+}
+
+/**
+* @brief Reads ahead from the source until the buffer is full or the
+*        source is exhausted
+* @param stream Stream object
+* @returns zero on success
+*/
+static int deeplearndata_stream_fill(deeplearndata_stream * stream)
+{
+    while ((stream->count < stream->capacity) && (stream->exhausted == 0)) {
+        int retval =
+            stream->read(stream->source,
+                         &stream->inputs[stream->count*
+                                         stream->no_of_input_fields],
+                         &stream->outputs[stream->count*
+                                          stream->no_of_outputs]);
+        if (retval < 0)
+            return -1;
+
+        if (retval > 0) {
+            stream->exhausted = 1;
+            break;
+        }
+        stream->count++;
+    }
+    return 0;
+}
+
+/**
+* @brief Replaces a buffered sample which has been used with the next
+*        sample from the source, or removes it once the source has been
+*        exhausted
+* @param stream Stream object
+* @param slot Position of the sample within the buffer
+* @returns zero on success
+*/
+static int deeplearndata_stream_replace(deeplearndata_stream * stream,
+                                        int slot)
+{
+    const int fields = stream->no_of_input_fields;
+    const int outputs = stream->no_of_outputs;
+    int last;
+
+    if (stream->exhausted == 0) {
+        int retval = stream->read(stream->source,
+                                  &stream->inputs[slot*fields],
+                                  &stream->outputs[slot*outputs]);
+        if (retval < 0)
+            return -1;
+
+        if (retval == 0)
+            return 0;
+
+        stream->exhausted = 1;
+    }
+
+    /* move the last sample into the gap */
+    last = stream->count - 1;
+    if (slot != last) {
+        memcpy((void*)&stream->inputs[slot*fields],
+               &stream->inputs[last*fields], fields*sizeof(float));
+        memcpy((void*)&stream->outputs[slot*outputs],
+               &stream->outputs[last*outputs], outputs*sizeof(float));
+    }
+    stream->count--;
     return 0;
 }
 
 /**
-* @brief Returns the performance on the test data set as a percentage value
+* @brief Chooses a random buffered sample. Choosing from within the buffer
+*        shuffles samples locally, and each pass through the source
+*        visits every sample once.
 * @param learner Deep learner object
-* @return Training or test performance on the given data, in the range 0 to 100%
+* @param stream Stream object
+* @param labeled Non-zero if the sample must be labeled
+* @returns Position of the sample within the buffer, or a negative value
+*          if the source contains no suitable samples
 */
-float deeplearndata_get_performance(deeplearn * learner)
+static int deeplearndata_stream_next(deeplearn * learner,
+                                     deeplearndata_stream * stream,
+                                     int labeled)
+{
+    int slot, is_labeled, restarted = 0;
+
+    while (1) {
+        if (stream->count == 0) {
+            /* begin another pass through the source */
+            if (stream->exhausted != 0) {
+                if (restarted != 0)
+                    return -1;
+                stream->exhausted = 0;
+                stream->passes++;
+                restarted = 1;
+            }
+
+            if (deeplearndata_stream_fill(stream) != 0)
+                return -2;
+
+            if (stream->count == 0)
+                continue;
+        }
+
+        slot = rand_num(&learner->net->random_seed)%stream->count;
+        if (labeled == 0)
+            return slot;
+
+        is_labeled = 1;
+        COUNTDOWN(i, stream->no_of_outputs) {
+            if ((int)stream->outputs[slot*stream->no_of_outputs + i] ==
+                DEEPLEARN_UNKNOWN_VALUE) {
+                is_labeled = 0;
+                break;
+            }
+        }
+        if (is_labeled != 0)
+            return slot;
+
+        /* unlabeled samples are not used for final training */
+        if (deeplearndata_stream_replace(stream, slot) != 0)
+            return -2;
+    }
+}
+
+/**
+* @brief Performs a single training step using a sample from a streaming
+*        data source, in the same way as deeplearndata_training.
+*        Only numeric input fields can be streamed.
+* @param learner Deep learner object
+* @param stream Stream object
+* @returns 1=pretraining,2=final training,0=training complete,
+*          -1=no training data,-2=text fields or a source error
+*/
+int deeplearndata_training_stream(deeplearn * learner,
+                                  deeplearndata_stream * stream)
+{
+    deeplearndata sample;
+    int pretraining, slot;
+
+    if (stream->no_of_input_fields != learner->no_of_input_fields)
+        return -2;
+
+    COUNTDOWN(i, learner->no_of_input_fields) {
+        if (learner->field_length[i] > 0)
+            return -2;
+    }
+
+    pretraining = ((learner->net->hidden_layers > 1) &&
+                   (learner->current_hidden_layer <
+                    learner->net->hidden_layers));
+
+    if ((pretraining == 0) && (learner->training_complete != 0))
+        return 0;
+
+    slot = deeplearndata_stream_next(learner, stream, !pretraining);
+    if (slot == -1)
+        return -1;
+    if (slot < 0)
+        return -2;
+
+    sample.inputs = &stream->inputs[slot*stream->no_of_input_fields];
+    sample.inputs_text = 0;
+    sample.outputs = &stream->outputs[slot*stream->no_of_outputs];
+
+    deeplearndata_update_training_history(learner);
+
+    deeplearn_set_inputs(learner, &sample);
+    if (pretraining == 0)
+        deeplearn_set_outputs(learner, &sample);
+    deeplearn_update(learner);
+
+    if (deeplearndata_stream_replace(stream, slot) != 0)
+        return -2;
+
+    if (pretraining != 0)
+        return 1;
+    return 2;
+}
+
+/* A training data source which reads rows from a binary data file */
+typedef struct {
+    FILE * inputs_fp;
+    FILE * outputs_fp;
+    long inputs_offset;
+    long outputs_offset;
+    int samples, row;
+    int no_of_input_fields;
+    int no_of_outputs;
+
+    /* ascending rows of the test set, which are skipped */
+    int * test_rows;
+    int test_samples, test_position;
+} deeplearndata_binary_source;
+
+/**
+* @brief Reads the next training row from a binary data file
+* @param source Binary data source
+* @param inputs Returned input field values
+* @param outputs Returned output values
+* @returns zero on success, 1 at the end of the file, -1 on error
+*/
+static int deeplearndata_binary_source_read(void * source,
+                                            float * inputs, float * outputs)
+{
+    deeplearndata_binary_source * src =
+        (deeplearndata_binary_source*)source;
+    FILE * fp;
+
+    while (src->row < src->samples) {
+        fp = src->inputs_fp;
+        if (FLOATREADARRAY(inputs, src->no_of_input_fields) !=
+            (size_t)src->no_of_input_fields)
+            return -1;
+
+        fp = src->outputs_fp;
+        if (FLOATREADARRAY(outputs, src->no_of_outputs) !=
+            (size_t)src->no_of_outputs)
+            return -1;
+
+        if ((src->test_position < src->test_samples) &&
+            (src->test_rows[src->test_position] == src->row)) {
+            src->test_position++;
+            src->row++;
+            continue;
+        }
+
+        src->row++;
+        return 0;
+    }
+
+    /* back to the start for the next pass */
+    src->row = 0;
+    src->test_position = 0;
+    if ((fseek(src->inputs_fp, src->inputs_offset, SEEK_SET) != 0) ||
+        (fseek(src->outputs_fp, src->outputs_offset, SEEK_SET) != 0))
+        return -1;
+    return 1;
+}
+
+/**
+* @brief Closes a binary data source
+* @param source Binary data source
+*/
+static void deeplearndata_binary_source_close(void * source)
+{
+    deeplearndata_binary_source * src =
+        (deeplearndata_binary_source*)source;
+
+    if (src == 0)
+        return;
+
+    if (src->inputs_fp != 0)
+        fclose(src->inputs_fp);
+    if (src->outputs_fp != 0)
+        fclose(src->outputs_fp);
+    free(src->test_rows);
+    free(src);
+}
+
+/**
+* @brief Comparison used to sort row numbers
+* @param a First row number
+* @param b Second row number
+* @returns Difference between the row numbers
+*/
+static int deeplearndata_compare_rows(const void * a, const void * b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+/**
+* @brief Creates a deep learner from a binary data file saved with
+*        deeplearndata_save_binary, keeping only the test set and the
+*        ranges in memory. The training samples are read from the file
+*        through a stream, for use with deeplearndata_training_stream,
+*        so that the data set may be larger than the available memory.
+*        Only numeric data files can be streamed.
+* @param filename Binary data filename
+* @param learner Deep learner object
+* @param no_of_hiddens The number of hidden units per layer
+* @param hidden layers The number of hidden layers
+* @param error_threshold Training error thresholds for each hidden layer
+* @param random_seed Random number seed
+* @param stream Returned stream of training samples
+* @returns The number of test samples loaded, or a negative error code
+*/
+int deeplearndata_open_binary_stream(char * filename,
+                                     deeplearn * learner,
+                                     int no_of_hiddens, int hidden_layers,
+                                     float error_threshold[],
+                                     unsigned int * random_seed,
+                                     deeplearndata_stream * stream)
+{
+    FILE * fp;
+    int header[DEEPLEARN_BINARY_DATA_HEADER];
+    int samples, fields, outputs, test_samples, no_of_inputs = 0;
+    int * field_length;
+    float * ranges, * test_inputs, * test_outputs;
+    long offset;
+    deeplearndata_binary_source * src;
+    deeplearndata * rows;
+
+    fp = fopen(filename, "rb");
+    if (!fp)
+        return -1;
+
+    if (INTREADARRAY(header, DEEPLEARN_BINARY_DATA_HEADER) !=
+        DEEPLEARN_BINARY_DATA_HEADER) {
+        fclose(fp);
+        return -2;
+    }
+
+    samples = header[2];
+    fields = header[3];
+    outputs = header[4];
+    test_samples = header[7];
+    if ((header[0] != DEEPLEARN_BINARY_DATA_MAGIC) ||
+        (header[1] != DEEPLEARN_BINARY_DATA_VERSION) ||
+        (samples < 1) || (fields < 0) || (outputs < 1) ||
+        (header[5] < 0) || (header[6] < 0) ||
+        (test_samples < 0) || (test_samples > samples)) {
+        fclose(fp);
+        return -3;
+    }
+
+    /* text fields can't be streamed */
+    if (header[8] != 0) {
+        fclose(fp);
+        return -4;
+    }
+
+    src = (deeplearndata_binary_source*)
+        malloc(sizeof(deeplearndata_binary_source));
+    if (!src) {
+        fclose(fp);
+        return -5;
+    }
+    src->inputs_fp = 0;
+    src->outputs_fp = 0;
+    src->samples = samples;
+    src->row = 0;
+    src->no_of_input_fields = fields;
+    src->no_of_outputs = outputs;
+    src->test_samples = test_samples;
+    src->test_position = 0;
+    INTALLOC(src->test_rows, test_samples + 1);
+    INTALLOC(field_length, fields + 1);
+    FLOATALLOC(ranges, fields*2 + outputs*2);
+    FLOATALLOC(test_inputs, test_samples*fields + 1);
+    FLOATALLOC(test_outputs, test_samples*outputs + 1);
+    if ((!src->test_rows) || (!field_length) || (!ranges) ||
+        (!test_inputs) || (!test_outputs)) {
+        free(field_length);
+        free(ranges);
+        free(test_inputs);
+        free(test_outputs);
+        deeplearndata_binary_source_close(src);
+        fclose(fp);
+        return -5;
+    }
+
+    /* field lengths and ranges */
+    if ((INTREADARRAY(field_length, fields) != (size_t)fields) ||
+        (FLOATREADARRAY(ranges, fields*2 + outputs*2) !=
+         (size_t)(fields*2 + outputs*2))) {
+        free(field_length);
+        free(ranges);
+        free(test_inputs);
+        free(test_outputs);
+        deeplearndata_binary_source_close(src);
+        fclose(fp);
+        return -6;
+    }
+
+    src->inputs_offset = ftell(fp);
+    src->outputs_offset =
+        src->inputs_offset + (long)samples*fields*sizeof(float);
+
+    /* the test set, converted from indexes into file rows */
+    offset = src->outputs_offset + (long)samples*outputs*sizeof(float) +
+        (long)(header[5] + header[6])*sizeof(int);
+    if ((fseek(fp, offset, SEEK_SET) != 0) ||
+        (INTREADARRAY(src->test_rows, test_samples) !=
+         (size_t)test_samples)) {
+        free(field_length);
+        free(ranges);
+        free(test_inputs);
+        free(test_outputs);
+        deeplearndata_binary_source_close(src);
+        fclose(fp);
+        return -7;
+    }
+    COUNTDOWN(i, test_samples)
+        src->test_rows[i] = samples - 1 - src->test_rows[i];
+    qsort(src->test_rows, test_samples, sizeof(int),
+          deeplearndata_compare_rows);
+
+    /* load the test samples */
+    COUNTUP(i, test_samples) {
+        int row = src->test_rows[i];
+
+        if ((row < 0) || (row >= samples) ||
+            (fseek(fp, src->inputs_offset +
+                   (long)row*fields*sizeof(float), SEEK_SET) != 0) ||
+            (FLOATREADARRAY(&test_inputs[i*fields], fields) !=
+             (size_t)fields) ||
+            (fseek(fp, src->outputs_offset +
+                   (long)row*outputs*sizeof(float), SEEK_SET) != 0) ||
+            (FLOATREADARRAY(&test_outputs[i*outputs], outputs) !=
+             (size_t)outputs)) {
+            free(field_length);
+            free(ranges);
+            free(test_inputs);
+            free(test_outputs);
+            deeplearndata_binary_source_close(src);
+            fclose(fp);
+            return -8;
+        }
+    }
+    fclose(fp);
+
+    /* separate handles for reading the inputs and outputs sections */
+    src->inputs_fp = fopen(filename, "rb");
+    src->outputs_fp = fopen(filename, "rb");
+    if ((!src->inputs_fp) || (!src->outputs_fp) ||
+        (fseek(src->inputs_fp, src->inputs_offset, SEEK_SET) != 0) ||
+        (fseek(src->outputs_fp, src->outputs_offset, SEEK_SET) != 0) ||
+        (deeplearndata_stream_init(stream, src,
+                                   deeplearndata_binary_source_read,
+                                   deeplearndata_binary_source_close,
+                                   fields, outputs,
+                                   DEEPLEARN_STREAM_BUFFER_SAMPLES) != 0)) {
+        free(field_length);
+        free(ranges);
+        free(test_inputs);
+        free(test_outputs);
+        deeplearndata_binary_source_close(src);
+        return -9;
+    }
+
+    rows = deeplearndata_create_rows(test_samples, fields, outputs,
+                                     test_inputs, 0, test_outputs);
+    if (!rows) {
+        free(field_length);
+        free(ranges);
+        free(test_inputs);
+        free(test_outputs);
+        deeplearndata_stream_free(stream);
+        return -10;
+    }
+
+    COUNTUP(i, fields) {
+        if (field_length[i] > 0)
+            no_of_inputs += field_length[i];
+        else
+            no_of_inputs++;
+    }
+
+    /* create the deep learner */
+    deeplearn_init(learner,
+                   no_of_inputs, no_of_hiddens,
+                   hidden_layers, outputs,
+                   error_threshold, random_seed);
+
+    deeplearndata_attach_rows(learner, rows, test_samples,
+                              test_inputs, test_outputs, 0);
+
+    learner->no_of_input_fields = fields;
+    learner->field_length = field_length;
+
+    COUNTDOWN(i, fields) {
+        learner->input_range_min[i] = ranges[i];
+        learner->input_range_max[i] = ranges[fields + i];
+    }
+
+    COUNTDOWN(i, outputs) {
+        learner->output_range_min[i] = ranges[fields*2 + i];
+        learner->output_range_max[i] = ranges[fields*2 + outputs + i];
+    }
+    free(ranges);
+
+    /* every sample held in memory is a test sample */
+    COUNTUP(i, test_samples) {
+        if (deeplearndata_add_test_sample(learner, i) != 0)
+            return -11;
+    }
+
+    return test_samples;
+}
+
+/**
+* @brief Returns the performance of a compiled model on the test data set
+*        as a percentage value. The test samples are evaluated
+*        concurrently, and the errors are then summed in sample order so
+*        that the result does not depend upon the number of threads.
+*        Since the model holds its own copy of the weights this may be
+*        called while the learner continues to be trained
+* @param learner Deep learner object
+* @param model Model compiled from the learner
+* @return Test performance in the range 0 to 100%
+*/
+float deeplearndata_get_model_performance(deeplearn * learner,
+                                          const deeplearn_inference * model)
 {
+    const int no_of_outputs = learner->net->no_of_outputs;
+    const int samples = learner->test_data_samples;
+    const int threads = deeplearn_get_threads();
     int hits=0;
-    float error_percent, total_error=0, average_error;
-    float * outputs;
+    float total_error=0, average_error;
+    float * sample_error;
+    int * sample_hits;
+    deeplearn_inference_context * contexts;
+
+    if (samples <= 0)
+        return 0;
 
-    FLOATALLOC(outputs, learner->net->no_of_outputs);
-    if (!outputs)
+    contexts = deeplearn_inference_contexts_init(model, threads);
+    if (!contexts)
         return -1;
 
-    COUNTUP(index, learner->test_data_samples) {
-        deeplearndata * sample = deeplearndata_get_test(learner, index);
-        deeplearn_set_inputs(learner, sample);
-        deeplearn_feed_forward(learner);
-        deeplearn_get_outputs(learner, outputs);
+    FLOATALLOC(sample_error, samples);
+    INTALLOC(sample_hits, samples);
+    if ((!sample_error) || (!sample_hits)) {
+        free(sample_error);
+        free(sample_hits);
+        deeplearn_inference_contexts_free(contexts, threads);
+        return -1;
+    }
+
+#pragma omp parallel for schedule(static) \
+    num_threads(threads) \
+    if(deeplearn_parallel(samples*model->max_units))
+    COUNTUP(s, samples) {
+        deeplearn_inference_context * ctx =
+            &contexts[omp_get_thread_num()];
+        deeplearndata * sample = deeplearndata_get_test(learner, s);
+
+        sample_error[s] = 0;
+        sample_hits[s] = 0;
+
+        deeplearn_encode_inputs(learner, sample, ctx->network_inputs);
+        deeplearn_inference_feed_forward(model, ctx, ctx->network_inputs);
+
+        COUNTUP(i, no_of_outputs) {
+            float value = ctx->outputs[i];
+            float range =
+                learner->output_range_max[i] - learner->output_range_min[i];
+
+            if (range > 0)
+                value = (((value - NEURON_LOW)/NEURON_RANGE)*range) +
+                    learner->output_range_min[i];
 
-        COUNTUP(i, learner->net->no_of_outputs) {
             if (sample->outputs[i] != 0) {
-                error_percent =
-                    (sample->outputs[i] - outputs[i]) / sample->outputs[i];
-                total_error += error_percent*error_percent;
-                hits++;
+                float error_percent =
+                    (sample->outputs[i] - value) / sample->outputs[i];
+                sample_error[s] += error_percent*error_percent;
+                sample_hits[s]++;
             }
         }
     }
+
+    /* sum in a fixed order */
+    COUNTUP(s, samples) {
+        total_error += sample_error[s];
+        hits += sample_hits[s];
+    }
+
+    free(sample_error);
+    free(sample_hits);
+    deeplearn_inference_contexts_free(contexts, threads);
+
     if (hits > 0) {
         average_error = (float)sqrt(total_error / hits) * 100;
         if (average_error > 100) average_error = 100;
-        free(outputs);
         return 100 - average_error;
     }
-    free(outputs);
+    return 0;
+}
+
+/**
+* @brief Returns the performance on the test data set as a percentage value.
+*        The network is compiled for inference so that test samples can be
+*        evaluated concurrently
+* @param learner Deep learner object
+* @return Training or test performance on the given data, in the range 0 to 100%
+*/
+float deeplearndata_get_performance(deeplearn * learner)
+{
+    deeplearn_inference model;
+    float performance;
+
+    if (learner->test_data_samples <= 0)
+        return 0;
+
+    if (deeplearn_compile_inference(learner, &model) != 0)
+        return -1;
+
+    performance = deeplearndata_get_model_performance(learner, &model);
+    deeplearn_inference_free(&model);
+    return performance;
+}
+
+/**
+* @brief Encodes the text fields of every data sample into input values,
+*        so that they don't need to be encoded each time that a sample is
+*        used. This is done once the field lengths are known.
+* @param learner Deep learner object
+* @returns zero on success
+*/
+int deeplearndata_encode_text(deeplearn * learner)
+{
+    int text_inputs = 0, pos;
+    deeplearndata * sample;
+    float * encoded;
+
+    COUNTUP(i, learner->no_of_input_fields)
+        text_inputs += learner->field_length[i];
+
+    if ((text_inputs == 0) || (learner->data_samples == 0))
+        return 0;
+
+    /* the samples of a shared dataset are already encoded */
+    if (learner->dataset != 0)
+        return 0;
+
+    free(learner->data_encoded);
+    FLOATALLOC(learner->data_encoded,
+               (size_t)learner->data_samples*text_inputs);
+    if (!learner->data_encoded)
+        return -1;
+
+    encoded = learner->data_encoded;
+    sample = learner->data;
+    while (sample != 0) {
+        pos = 0;
+        COUNTUP(i, learner->no_of_input_fields) {
+            if (learner->field_length[i] == 0)
+                continue;
+
+            if ((sample->inputs_text != 0) &&
+                (sample->inputs_text[i] != 0))
+                enc_text_to_values(sample->inputs_text[i], &encoded[pos],
+                                   learner->field_length[i], 0,
+                                   learner->field_length[i]/CHAR_BITS);
+            else
+                enc_text_to_values("", &encoded[pos],
+                                   learner->field_length[i], 0,
+                                   learner->field_length[i]/CHAR_BITS);
+            pos += learner->field_length[i];
+        }
+        sample->inputs_encoded = encoded;
+        encoded += text_inputs;
+        sample = (deeplearndata *)sample->next;
+    }
     return 0;
 }
 
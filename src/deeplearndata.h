@@ -35,10 +35,39 @@
 #include <string.h>
 #include <limits.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "globals.h"
 #include "deeplearn.h"
+#include "deeplearn_inference.h"
 #include "deeplearn_images.h"
 
+/* A source of training samples which is read through a bounded buffer,
+   so that the samples do not all need to be held in memory */
+struct deeplearndata_strm {
+    void * source;
+    int (*read)(void * source, float * inputs, float * outputs);
+    void (*close)(void * source);
+
+    int no_of_input_fields;
+    int no_of_outputs;
+
+    /* buffered samples */
+    int capacity;
+    int count;
+    float * inputs;
+    float * outputs;
+
+    /* non-zero once the current pass through the source has ended */
+    int exhausted;
+
+    /* the number of completed passes through the source */
+    unsigned int passes;
+};
+typedef struct deeplearndata_strm deeplearndata_stream;
+
 int deeplearndata_add(deeplearndata ** datalist,
                       int data_samples[],
                       float inputs[],
@@ -55,29 +84,28 @@ int deeplearndata_index_data(
         int samples,
         deeplearndata *** indexed_list,
         int* indexed_samples);
-int deeplearndata_index_meta(
-        deeplearndata_meta * list,
-        int samples,
-        deeplearndata_meta *** indexed_list,
-        int* indexed_samples);
 deeplearndata * deeplearndata_get(deeplearn * learner, int index);
 deeplearndata * deeplearndata_get_training(deeplearn * learner, int index);
 deeplearndata * deeplearndata_get_training_labeled(deeplearn * learner,
                                                    int index);
 deeplearndata * deeplearndata_get_test(deeplearn * learner, int index);
-int deeplearndata_add_training_sample(deeplearn * learner,
-                                      deeplearndata * sample);
-int deeplearndata_add_labeled_training_sample(deeplearn * learner,
-                                              deeplearndata * sample);
-int deeplearndata_add_test_sample(deeplearn * learner, deeplearndata * sample);
+int deeplearndata_add_training_sample(deeplearn * learner, int index);
+int deeplearndata_add_labeled_training_sample(deeplearn * learner, int index);
+int deeplearndata_add_test_sample(deeplearn * learner, int index);
 int deeplearndata_create_datasets(deeplearn * learner,
                                   int test_data_percentage);
 int deeplearndata_training(deeplearn * learner);
+int deeplearndata_training_batch(deeplearn * learner, int batch_size);
+int deeplearndata_set_pretrain_cache(deeplearn * learner, int enable,
+                                     char * filename);
 float deeplearndata_get_performance(deeplearn * learner);
+float deeplearndata_get_model_performance(deeplearn * learner,
+                                          const deeplearn_inference * model);
 int deeplearndata_get_field_length(deeplearndata * data, int field_index);
 int deeplearndata_update_field_lengths(int no_of_input_fields,
                                        int field_length[],
                                        deeplearndata * data);
+int deeplearndata_encode_text(deeplearn * learner);
 int deeplearndata_read_csv(char * filename,
                            deeplearn * learner,
                            int no_of_hiddens, int hidden_layers,
@@ -85,4 +113,25 @@ int deeplearndata_read_csv(char * filename,
                            int output_classes,
                            float error_threshold[],
                            unsigned int * random_seed);
+int deeplearndata_save_binary(deeplearn * learner, char * filename);
+int deeplearndata_open_binary(char * filename,
+                              deeplearn * learner,
+                              int no_of_hiddens, int hidden_layers,
+                              float error_threshold[],
+                              unsigned int * random_seed);
+int deeplearndata_stream_init(deeplearndata_stream * stream,
+                              void * source,
+                              int (*read)(void *, float *, float *),
+                              void (*close)(void *),
+                              int no_of_input_fields, int no_of_outputs,
+                              int capacity);
+void deeplearndata_stream_free(deeplearndata_stream * stream);
+int deeplearndata_training_stream(deeplearn * learner,
+                                  deeplearndata_stream * stream);
+int deeplearndata_open_binary_stream(char * filename,
+                                     deeplearn * learner,
+                                     int no_of_hiddens, int hidden_layers,
+                                     float error_threshold[],
+                                     unsigned int * random_seed,
+                                     deeplearndata_stream * stream);
 #endif
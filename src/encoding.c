@@ -77,3 +77,47 @@ int enc_text_to_binary(char * text,
     }
     return pos;
 }
+
+/**
+* @brief Encodes text into an array of input values, in the same way as
+*        enc_text_to_binary, without needing the input neurons
+* @param text The text string to be encoded
+* @param values Array of input values
+* @param no_of_values The number of input values
+* @param offset The index of the input value to begin inserting the text
+* @param max_field_length_chars The maximum length of a text field in characters
+* @returns current values index
+*/
+int enc_text_to_values(char * text,
+                       float values[], int no_of_values,
+                       int offset,
+                       int max_field_length_chars)
+{
+    int pos = offset, max_chars = strlen(text);
+
+    if (max_chars > (no_of_values-offset)/CHAR_BITS)
+        max_chars = ((no_of_values-offset)/CHAR_BITS);
+
+    if (max_chars > max_field_length_chars)
+        max_chars = max_field_length_chars;
+
+    COUNTUP(c, max_chars) {
+        COUNTUP(bit, CHAR_BITS) {
+            if (text[c] & (1<<bit))
+                values[pos++] = NEURON_HIGH;
+            else
+                values[pos++] = NEURON_LOW;
+        }
+    }
+
+    FOR(i, max_chars, max_field_length_chars) {
+        COUNTUP(bit, CHAR_BITS) {
+            if (pos >= no_of_values) {
+                i = max_field_length_chars;
+                break;
+            }
+            values[pos++] = NEURON_UNKNOWN;
+        }
+    }
+    return pos;
+}
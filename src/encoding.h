@@ -39,5 +39,9 @@ int enc_text_to_binary(char * text,
                        bp_neuron ** inputs, int no_of_inputs,
                        int offset,
                        int max_field_length_chars);
+int enc_text_to_values(char * text,
+                       float values[], int no_of_values,
+                       int offset,
+                       int max_field_length_chars);
 
 #endif
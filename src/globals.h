@@ -30,20 +30,130 @@
 #ifndef DEEPLEARN_GLOBALS_H
 #define DEEPLEARN_GLOBALS_H
 
+/* default number of threads, which can be changed at runtime
+   with deeplearn_set_threads */
 #define DEEPLEARN_THREADS                 4
+#define DEEPLEARN_MAX_THREADS             256
+
+/* loops with fewer multiply-adds than this are not worth the cost
+   of distributing between threads */
+#define DEEPLEARN_PARALLEL_MIN_WORK       8192
+
+/* where the processors of each NUMA node are listed, and the
+   highest node number looked for, see deeplearn_set_thread_binding */
+#define DEEPLEARN_NUMA_PATH               "/sys/devices/system/node"
+#define DEEPLEARN_MAX_NUMA_NODES          64
+
+/* number of samples fed through each layer at a time when
+   scoring a batch, chosen so that the inputs stay within cache */
+#define DEEPLEARN_FEED_FORWARD_BATCH      64
+
+/* least number of windows of an image scan whose first layer responses
+   are found before the remaining layers are applied to them as a batch */
+#define DEEPLEARN_SCAN_WINDOWS            256
+
+/* number of samples each worker trains on during a training step */
+#define DEEPLEARN_HOGWILD_SAMPLES         8
+
+/* number of input values given noise by each thread at a time */
+#define DEEPLEARN_NOISE_CHUNK             1024
+
+/* number of autocoder outputs decoded together, so that each row
+   of the tied weight matrix is read contiguously */
+#define AUTOCODER_DECODE_TILE             64
 
 #undef PLOT_WITH_GNUPLOT
 #define DEEPLEARN_PLOT_WIDTH              1024
 #define DEEPLEARN_PLOT_HEIGHT             1024
 
+/* how training progress is plotted, see deeplearn_set_plotting */
+#define DEEPLEARN_PLOT_NONE               0
+#define DEEPLEARN_PLOT_SYNC               1
+#define DEEPLEARN_PLOT_ASYNC              2
+
+/* how images such as plots are written, see deeplearn_set_image_output */
+#define DEEPLEARN_IMAGE_PNG               0
+#define DEEPLEARN_IMAGE_PNG_FAST          1
+#define DEEPLEARN_IMAGE_PNM               2
+#define DEEPLEARN_IMAGE_CALLBACK          3
+#define DEEPLEARN_IMAGE_OUTPUTS           4
+
+/* phases of training which are timed if compiled with DEEPLEARN_PROFILE,
+   see deeplearn_get_stats */
+#define DEEPLEARN_PHASE_FORWARD           0
+#define DEEPLEARN_PHASE_BACKPROP          1
+#define DEEPLEARN_PHASE_LEARN             2
+#define DEEPLEARN_PHASE_DROPOUTS          3
+#define DEEPLEARN_PHASE_PRETRAINING       4
+#define DEEPLEARN_PHASE_CONVOLUTION       5
+#define DEEPLEARN_PHASE_FEATURES          6
+#define DEEPLEARN_PHASE_SAMPLING          7
+#define DEEPLEARN_PHASE_PLOTTING          8
+#define DEEPLEARN_PHASES                  9
+
+/* maximum number of histories plotted together in the background */
+#define DEEPLEARN_PLOTTER_HISTORIES       4
+
 #define DEEPLEARN_TEMP_DIRECTORY          "/tmp/"
 #define DEEPLEARN_HISTORY_SIZE            8000
 #define DEEPLEARN_UNKNOWN_ERROR           9999
+
+/* number of weights sampled from each layer when recording the
+   weight gradient history, see deeplearn_set_gradient_monitoring */
+#define DEEPLEARN_GRADIENT_SAMPLES        1024
 #define DEEPLEARN_UNKNOWN_VALUE          -9999
 #define DEEPLEARN_MAX_FIELD_LENGTH_CHARS  1024
 #define DEEPLEARN_MAX_CSV_INPUTS          2048
 #define DEEPLEARN_MAX_CSV_OUTPUTS         1024
 
+/* initial size of the block read from a csv file, which grows
+   as needed to hold the longest line */
+#define DEEPLEARN_CSV_BUFFER_SIZE         (1024*1024)
+
+/* initial number of rows allocated for the samples read from
+   a csv file, doubled whenever it is exceeded */
+#define DEEPLEARN_CSV_INITIAL_ROWS        256
+
+/* networks written by bp_save and learners written by deeplearn_save.
+   Files saved before the magic numbers were added start with the
+   number of training itterations instead */
+#define DEEPLEARN_NETWORK_MAGIC           0x64706e6e
+#define DEEPLEARN_NETWORK_VERSION         1
+#define DEEPLEARN_LEARNER_MAGIC           0x64706c6e
+#define DEEPLEARN_LEARNER_VERSION         1
+
+/* binary data files written by deeplearndata_save_binary */
+#define DEEPLEARN_BINARY_DATA_MAGIC       0x6470646c
+#define DEEPLEARN_BINARY_DATA_VERSION     1
+#define DEEPLEARN_BINARY_DATA_HEADER      10
+
+/* training image cache files written by
+   deeplearn_load_training_images_cached */
+#define DEEPLEARN_IMAGE_CACHE_MAGIC       0x64706963
+#define DEEPLEARN_IMAGE_CACHE_VERSION     1
+#define DEEPLEARN_IMAGE_CACHE_HEADER      9
+
+/* number of samples buffered when streaming training data */
+#define DEEPLEARN_STREAM_BUFFER_SAMPLES   4096
+
+/* number of weight deltas which share a scale when they are
+   quantized for sending between the nodes of a distributed trainer */
+#define DEEPLEARN_DELTA_BLOCK             256
+
+/* number of times a node tries to connect to the first node of a
+   distributed trainer, a tenth of a second apart */
+#define DEEPLEARN_TCP_CONNECT_ATTEMPTS    100
+
+/* inference server, see deeplearn_server.h. The magic number is sent
+   when a client connects, and lets it detect a byte order mismatch */
+#define DEEPLEARN_SERVER_MAGIC            0x646c7376
+#define DEEPLEARN_SERVER_CONNECTIONS      64
+#define DEEPLEARN_SERVER_MAX_SAMPLES      65536
+
+/* alignment in bytes of each allocation taken from an arena,
+   which is a cache line */
+#define DEEPLEARN_ARENA_ALIGN             64
+
 /* The number of bits per character in a text string */
 #define CHAR_BITS               (sizeof(char)*8)
 
@@ -59,12 +169,64 @@
 #define AF_TANH                 1
 #define AF_LINEAR               2
 
+/* table approximations of sigmoid and tanh, with an absolute
+   error no greater than AF_FAST_MAX_ERROR */
+#define AF_SIGMOID_FAST         3
+#define AF_TANH_FAST            4
+#define AF_FUNCTIONS            5
+#define AF_FAST_MAX_ERROR       0.00001f
+
+/* the blocks of back-propagated errors gathered by each thread are a
+   multiple of this many inputs, which fill whole cache lines so that
+   threads do not write to the same line */
+#define BP_BACKPROP_BLOCK       16
+
+/* methods used to adjust the weights during training */
+#define OPTIMIZER_SGD           0
+#define OPTIMIZER_ADAM          1
+#define OPTIMIZER_RMSPROP       2
+#define OPTIMIZERS              3
+
+/* default hyperparameters of the adaptive optimizers */
+#define OPTIMIZER_LEARNING_RATE 0.005f
+#define OPTIMIZER_BETA1         0.9f
+#define OPTIMIZER_BETA2         0.999f
+#define OPTIMIZER_RMSPROP_DECAY 0.9f
+#define OPTIMIZER_EPSILON       0.00000001f
+
+/* precision of the copy of the weights used when feeding forward */
+#define DEEPLEARN_PRECISION_FP32 0
+#define DEEPLEARN_PRECISION_BF16 1
+#define DEEPLEARN_PRECISIONS     2
+
+/* file format of a compiled model, which can be mapped into memory */
+#define DEEPLEARN_MODEL_MAGIC      0x4d44504c
+#define DEEPLEARN_MODEL_VERSION    1
+#define DEEPLEARN_MODEL_BYTE_ORDER 0x01020304
+#define DEEPLEARN_MODEL_ALIGN      64
+
+/* how the weights of a layer are stored within a saved network */
+#define BP_STORAGE_DENSE        0
+#define BP_STORAGE_SPARSE       1
+#define BP_STORAGE_BF16         2
+
+/* number of inputs whose dropout mask is generated at a time when
+   feeding forward, which is held on the stack */
+#define DROPOUT_MASK_INPUTS     1024
+
+/* the inputs which remain after dropouts are gathered when the batch
+   size times the number which dropped out is at least this multiple of
+   the number which remain, so that the cost of gathering is outweighed
+   by the work saved over the batch */
+#define DROPOUT_COMPACT_RATIO   4
+
+/* default activation function for new networks */
 #define ACTIVATION_FUNCTION     AF_SIGMOID
 
 #if ACTIVATION_FUNCTION == AF_SIGMOID
-#define AF(adder) (1.0f / (1.0f + exp(-(adder))))
+#define AF(adder) (1.0f / (1.0f + expf(-(adder))))
 #elif ACTIVATION_FUNCTION == AF_TANH
-#define AF(adder) ((((2.0f / (1.0f + exp(-(2*adder)))) - 1.0f)*0.5f)+0.5f)
+#define AF(adder) ((((2.0f / (1.0f + expf(-(2*adder)))) - 1.0f)*0.5f)+0.5f)
 #elif ACTIVATION_FUNCTION == AF_LINEAR
 #define AF(adder) ((adder) < 1.0f ? ((adder) > -1.0f ? \
                                      (((adder)*0.5f)+0.5f) : 0.0f) : 1.0f)
@@ -96,6 +258,7 @@
 #define INTWRITE(m) WRITEVAR(m, int)
 #define UINTWRITE(m) WRITEVAR(m, unsigned int)
 #define BYTEWRITE(m) WRITEVAR(m, unsigned char)
+#define USHORTWRITEARRAY(m, size) WRITEARRAY(m, unsigned short, size)
 
 #define READVAR(m, type) fread(&m, sizeof(type), 1, fp)
 #define READARRAY(m, type, size) fread(m, sizeof(type), size, fp)
@@ -106,6 +269,7 @@
 #define INTREAD(m) READVAR(m, int)
 #define UINTREAD(m) READVAR(m, unsigned int)
 #define BYTEREAD(m) READVAR(m, unsigned char)
+#define USHORTREADARRAY(m, size) READARRAY(m, unsigned short, size)
 
 /* clip between min and max */
 #define CLIP(x, min, max) ( ((x) > max) ? max : ( ((x) < min) ? (min) : (x) ) )
@@ -180,11 +180,27 @@ int phosphene_write_png_file(char* filename,
 }
 
 /**
- * @brief Creates an oscilloscope instance
+ * @brief Creates an oscilloscope instance. The trace buffers are
+ *        allocated by scope_set_time_steps and freed by scope_free
  * @param s Oscilloscope instance
  * @param step_ms Update time step
  */
 void create_scope(scope * s, unsigned int step_ms)
+{
+    s->trace1 = NULL;
+    s->trace2 = NULL;
+    s->trace_class = NULL;
+    s->max_time_steps = 0;
+    scope_reset(s, step_ms);
+}
+
+/**
+ * @brief Restores the default settings of an oscilloscope, keeping its
+ *        trace buffers so that they can be reused for another plot
+ * @param s Oscilloscope instance
+ * @param step_ms Update time step
+ */
+void scope_reset(scope * s, unsigned int step_ms)
 {
     s->mode = PHOSPHENE_MODE_DEFAULT;
     s->marker_orientation = PHOSPHENE_MARKER_VERTICAL;
@@ -240,8 +256,7 @@ void create_scope(scope * s, unsigned int step_ms)
     s->trace2_scan_ms = 0;
     s->time_ms = 2000;
 
-    s->trace1[0] = PHOSPHENE_NO_TRACE;
-    s->trace2[0] = PHOSPHENE_NO_TRACE;
+    scope_clear(s);
 
     s->offset_ms = 0;
     s->trigger_voltage = 0;
@@ -250,14 +265,73 @@ void create_scope(scope * s, unsigned int step_ms)
     s->horizontal_multiplier=1;
 }
 
+/**
+ * @brief Sizes the trace buffers for a number of time steps, up to
+ *        PHOSPHENE_MAX_TIME_STEPS. Buffers are only reallocated if they
+ *        need to grow, and all plots are cleared
+ * @param s Oscilloscope instance
+ * @param time_steps The number of time steps to be plotted
+ * @returns zero on success
+ */
+int scope_set_time_steps(scope * s, unsigned int time_steps)
+{
+    if (time_steps > PHOSPHENE_MAX_TIME_STEPS)
+        time_steps = PHOSPHENE_MAX_TIME_STEPS;
+
+    if (time_steps > s->max_time_steps) {
+        float * trace1, * trace2;
+        unsigned char * trace_class;
+
+        trace1 = (float*)realloc(s->trace1, time_steps*sizeof(float));
+        if (!trace1)
+            return -1;
+        s->trace1 = trace1;
+
+        trace2 = (float*)realloc(s->trace2, time_steps*sizeof(float));
+        if (!trace2)
+            return -2;
+        s->trace2 = trace2;
+
+        trace_class = (unsigned char*)realloc(s->trace_class, time_steps);
+        if (!trace_class)
+            return -3;
+        s->trace_class = trace_class;
+
+        s->max_time_steps = time_steps;
+    }
+
+    scope_clear(s);
+    return 0;
+}
+
+/**
+ * @brief Frees the trace buffers of an oscilloscope
+ * @param s Oscilloscope instance
+ */
+void scope_free(scope * s)
+{
+    free(s->trace1);
+    free(s->trace2);
+    free(s->trace_class);
+    s->trace1 = NULL;
+    s->trace2 = NULL;
+    s->trace_class = NULL;
+    s->max_time_steps = 0;
+}
+
 /**
  * @brief Clears all plots
  * @param s Oscilloscope instance
  */
 void scope_clear(scope * s)
 {
-    s->trace1[0] = PHOSPHENE_NO_TRACE;
-    s->trace2[0] = PHOSPHENE_NO_TRACE;
+    unsigned int t;
+
+    for (t = 0; t < s->max_time_steps; t++) {
+        s->trace1[t] = PHOSPHENE_NO_TRACE;
+        s->trace2[t] = PHOSPHENE_NO_TRACE;
+        s->trace_class[t] = 0;
+    }
 }
 
 /**
@@ -295,20 +369,20 @@ void scope_update(scope * s,
 {
     unsigned int t = t_ms/s->step_ms;
 
-    if (t >= PHOSPHENE_MAX_TIME_STEPS)
+    if (t >= s->max_time_steps)
         return;
 
     if ((t_ms < s->time_ms) ||
         (s->mode > PHOSPHENE_MODE_DEFAULT)) {
         if (trace_index == 0) {
-            s->trace1[t] = value;
+            s->trace1[t] = (float)value;
             s->trace1_min = min;
             s->trace1_max = max;
             s->trace1_scan_ms = t_ms;
         }
         else {
             s->no_of_traces = 2;
-            s->trace2[t] = value;
+            s->trace2[t] = (float)value;
             s->trace2_min = min;
             s->trace2_max = max;
             s->trace2_scan_ms = t_ms;
@@ -924,14 +998,15 @@ static void scope_trace(scope * s,
         t = (((unsigned int)n)%s->time_ms) / s->step_ms;
 
         if (trace_index == 0)
-            value = s->trace1[t] + (((rand()%10000)-5000)/5000.0*s->noise);
+            value = s->trace1[t];
         else
-            value = s->trace2[t] + (((rand()%10000)-5000)/5000.0*s->noise);
+            value = s->trace2[t];
 
         if ((value == PHOSPHENE_NO_TRACE) || (max <= min)) {
             t_ms += s->step_ms;
             continue;
         }
+        value += ((rand()%10000)-5000)/5000.0*s->noise;
 
         x = top_x + border_x +
             (t_ms * ((bottom_x-top_x)-(border_x*2)) / s->time_ms);
@@ -1121,13 +1196,15 @@ static void scope_xy(scope * s,
         n = (int)t_ms - s->offset_ms;
         if (n < 0) n += (int)s->time_ms;
         t = (((unsigned int)n)%s->time_ms) / s->step_ms;
-        value_x = s->trace1[t] + (((rand()%10000)-5000)/5000.0*s->noise);
-        value_y = s->trace2[t] + (((rand()%10000)-5000)/5000.0*s->noise);
+        value_x = s->trace1[t];
+        value_y = s->trace2[t];
         if ((value_x == PHOSPHENE_NO_TRACE) ||
             (value_y == PHOSPHENE_NO_TRACE)) {
             t_ms += s->step_ms;
             continue;
         }
+        value_x += ((rand()%10000)-5000)/5000.0*s->noise;
+        value_y += ((rand()%10000)-5000)/5000.0*s->noise;
 
         x = screen_bx -
             (int)((screen_bx - screen_tx)*(value_x-min_x)/(max_x - min_x));
@@ -1246,9 +1323,9 @@ void scope_draw_bounded(scope * s,
 
     if ((draw_type == PHOSPHENE_DRAW_ALL) ||
         (draw_type == PHOSPHENE_DRAW_FOREGROUND)) {
-        /* check that the time base doesn't exceed the maximum */
-        if (s->time_ms/s->step_ms >= PHOSPHENE_MAX_TIME_STEPS)
-            s->time_ms = (PHOSPHENE_MAX_TIME_STEPS-1) * s->step_ms;
+        /* check that the time base doesn't exceed the trace buffers */
+        if (s->time_ms > s->max_time_steps*s->step_ms)
+            s->time_ms = s->max_time_steps*s->step_ms;
 
         /* if a trigger voltage is set then check for it
            and adjust the marker position accordingly */
@@ -71,9 +71,11 @@ struct scope_struct {
     double vertical_percent[2];
     double trace1_min, trace1_max;
     double trace2_min, trace2_max;
-    double trace1[PHOSPHENE_MAX_TIME_STEPS];
-    double trace2[PHOSPHENE_MAX_TIME_STEPS];
-    unsigned char trace_class[PHOSPHENE_MAX_TIME_STEPS];
+    /* trace buffers, allocated by scope_set_time_steps */
+    float * trace1;
+    float * trace2;
+    unsigned char * trace_class;
+    unsigned int max_time_steps;
     int offset_ms;
     unsigned int time_ms, step_ms;
     unsigned int trace1_scan_ms, trace2_scan_ms;
@@ -99,6 +101,9 @@ int phosphene_write_png_file(char* filename,
                              unsigned int bitsperpixel,
                              unsigned char buffer[]);
 void create_scope(scope * s, unsigned int step_ms);
+void scope_reset(scope * s, unsigned int step_ms);
+int scope_set_time_steps(scope * s, unsigned int time_steps);
+void scope_free(scope * s);
 void scope_clear(scope * s);
 void scope_update(scope * s,
                   unsigned int trace_index,
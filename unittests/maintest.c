@@ -31,8 +31,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include "tests_random.h"
+#include "tests_simd.h"
+#include "tests_backend.h"
 #include "tests_backprop.h"
 #include "tests_deeplearn.h"
+#include "tests_inference.h"
 #include "tests_data.h"
 #include "tests_images.h"
 #include "tests_encoding.h"
@@ -40,6 +43,12 @@
 #include "tests_conv.h"
 #include "tests_deepconvnet.h"
 #include "tests_autocoder.h"
+#include "tests_distributed.h"
+#include "tests_validation.h"
+#include "tests_checkpoint.h"
+#include "tests_plotter.h"
+#include "tests_server.h"
+#include "tests_profile.h"
 
 int main(int argc, char* argv[])
 {
@@ -49,12 +58,21 @@ int main(int argc, char* argv[])
     run_tests_backprop();
     run_tests_images();
     run_tests_random();
+    run_tests_simd();
+    run_tests_backend();
     run_tests_deeplearn();
+    run_tests_inference();
     run_tests_data();
     run_tests_encoding();
     run_tests_features();
     run_tests_conv();
     run_tests_deepconvnet();
+    run_tests_distributed();
+    run_tests_validation();
+    run_tests_checkpoint();
+    run_tests_plotter();
+    run_tests_server();
+    run_tests_profile();
 
     printf("\nAll tests completed\n");
 
@@ -102,6 +102,89 @@ static void test_autocoder_save_load()
     printf("Ok\n");
 }
 
+static void test_autocoder_optimizer()
+{
+    ac autocoder[OPTIMIZERS], autocoder_loaded;
+    int no_of_inputs = 32;
+    int no_of_hiddens = 24;
+    int batch_size = 4;
+    unsigned int random_seed = 5322;
+    float inputs[4*32];
+    float error[OPTIMIZERS];
+    FILE * fp;
+
+    printf("test_autocoder_optimizer...");
+
+    for (int s = 0; s < batch_size; s++) {
+        for (int i = 0; i < no_of_inputs; i++)
+            inputs[s*no_of_inputs + i] =
+                NEURON_LOW + (((i*(s+1))%no_of_inputs)/
+                              (float)no_of_inputs)*NEURON_RANGE;
+    }
+
+    for (int o = 0; o < OPTIMIZERS; o++) {
+        assert(autocoder_init(&autocoder[o],
+                              no_of_inputs,
+                              no_of_hiddens,
+                              random_seed) == 0);
+        autocoder[o].noise = 0;
+        assert(autocoder_set_optimizer(&autocoder[o], o) == 0);
+
+        /* single samples followed by mini-batches */
+        for (int t = 0; t < 500; t++) {
+            autocoder_set_inputs(&autocoder[o],
+                                 &inputs[(t%batch_size)*no_of_inputs]);
+            autocoder_update(&autocoder[o]);
+        }
+        for (int t = 0; t < 500; t++)
+            assert(autocoder_update_batch(&autocoder[o], inputs,
+                                          batch_size) == 0);
+        error[o] = autocoder[o].backprop_error_percent;
+        assert(error[o] > 0);
+    }
+    assert(autocoder_set_optimizer(&autocoder[0], -1) == -1);
+
+    /* adaptive optimizers arrive at a much lower error */
+    assert(error[OPTIMIZER_ADAM]*2 < error[OPTIMIZER_SGD]);
+    assert(error[OPTIMIZER_RMSPROP]*2 < error[OPTIMIZER_SGD]);
+    assert(autocoder[OPTIMIZER_ADAM].optimizer.step == 1000);
+
+    /* the optimizer state is saved with the autocoder */
+    fp = fopen("/tmp/autocoder_optimizer_test.dat","w");
+    assert(fp);
+    assert(autocoder_save(fp, &autocoder[OPTIMIZER_ADAM])==0);
+    fclose(fp);
+
+    assert(autocoder_init(&autocoder_loaded,
+                          no_of_inputs,
+                          no_of_hiddens,
+                          random_seed) == 0);
+    fp = fopen("/tmp/autocoder_optimizer_test.dat","r");
+    assert(fp);
+    assert(autocoder_load(fp, &autocoder_loaded, 0)==0);
+    fclose(fp);
+
+    assert(autocoder_compare(&autocoder[OPTIMIZER_ADAM],
+                             &autocoder_loaded) == 0);
+    assert(autocoder_loaded.optimizer.type == OPTIMIZER_ADAM);
+    assert(autocoder_loaded.optimizer.step == 1000);
+    for (int i = 0; i < no_of_inputs*no_of_hiddens; i++) {
+        assert(autocoder_loaded.moment1[i] ==
+               autocoder[OPTIMIZER_ADAM].moment1[i]);
+        assert(autocoder_loaded.moment2[i] ==
+               autocoder[OPTIMIZER_ADAM].moment2[i]);
+    }
+    for (int h = 0; h < no_of_hiddens; h++)
+        assert(autocoder_loaded.bias_moment2[h] ==
+               autocoder[OPTIMIZER_ADAM].bias_moment2[h]);
+
+    for (int o = 0; o < OPTIMIZERS; o++)
+        autocoder_free(&autocoder[o]);
+    autocoder_free(&autocoder_loaded);
+
+    printf("Ok\n");
+}
+
 static void test_autocoder_update()
 {
     ac autocoder;
@@ -155,6 +238,204 @@ static void test_autocoder_update()
     printf("Ok\n");
 }
 
+static void test_autocoder_tied_weights()
+{
+    ac autocoder;
+    int no_of_inputs = 150;
+    int no_of_hiddens = 40;
+    unsigned int random_seed = 8251;
+    int initial_threads = deeplearn_get_threads();
+    int initial_threshold = deeplearn_get_parallel_threshold();
+    float * weights, * weight_change, * bias, * bias_change;
+    float decoded[150], bperr[40];
+
+    printf("test_autocoder_tied_weights...");
+
+    assert(deeplearn_set_threads(4) == 4);
+    deeplearn_set_parallel_threshold(0);
+
+    assert(autocoder_init(&autocoder,
+                          no_of_inputs,
+                          no_of_hiddens,
+                          random_seed) == 0);
+    autocoder.noise = 0;
+
+    weights = (float*)malloc(no_of_inputs*no_of_hiddens*sizeof(float));
+    weight_change = (float*)malloc(no_of_inputs*no_of_hiddens*sizeof(float));
+    bias = (float*)malloc(no_of_hiddens*sizeof(float));
+    bias_change = (float*)malloc(no_of_hiddens*sizeof(float));
+    assert(weights && weight_change && bias && bias_change);
+
+    for (int i = 0; i < no_of_inputs; i++)
+        autocoder_set_input(&autocoder, i,
+                            (rand_num(&random_seed)%10000)/10000.0f);
+
+    for (int t = 0; t < 3; t++) {
+        autocoder_encode(&autocoder, autocoder.hiddens, 0);
+        autocoder.hiddens[t] = AUTOCODER_DROPPED_OUT;
+
+        /* decode by walking the columns of the weight matrix */
+        for (int i = 0; i < no_of_inputs; i++) {
+            float adder = 0;
+            for (int h = 0; h < no_of_hiddens; h++)
+                if (autocoder.hiddens[h] != AUTOCODER_DROPPED_OUT)
+                    adder += autocoder.weights[h*no_of_inputs + i] *
+                        autocoder.hiddens[h];
+            decoded[i] = activation_value(autocoder.activation, adder);
+        }
+
+        /* skip the dropped out unit then decode one row at a time */
+        autocoder.hiddens[t] = 0;
+        autocoder_decode(&autocoder, autocoder.outputs, 0);
+        autocoder.hiddens[t] = AUTOCODER_DROPPED_OUT;
+        for (int i = 0; i < no_of_inputs; i++)
+            assert(fabs(autocoder.outputs[i] - decoded[i]) < 0.0001f);
+
+        /* separate output side and input side weight updates */
+        memcpy(weights, autocoder.weights,
+               no_of_inputs*no_of_hiddens*sizeof(float));
+        memcpy(weight_change, autocoder.last_weight_change,
+               no_of_inputs*no_of_hiddens*sizeof(float));
+        memcpy(bias, autocoder.bias, no_of_hiddens*sizeof(float));
+        memcpy(bias_change, autocoder.last_bias_change,
+               no_of_hiddens*sizeof(float));
+        for (int h = 0; h < no_of_hiddens; h++) {
+            bperr[h] = 0;
+            if (autocoder.hiddens[h] == AUTOCODER_DROPPED_OUT)
+                continue;
+            for (int i = 0; i < no_of_inputs; i++) {
+                float o = autocoder.outputs[i];
+                bperr[h] += (autocoder.inputs[i] - o) * o * (1.0f - o) *
+                    weights[h*no_of_inputs + i];
+            }
+        }
+        for (int i = 0; i < no_of_inputs; i++) {
+            float o = autocoder.outputs[i];
+            float e = autocoder.learning_rate / (1.0f + no_of_hiddens);
+            float egradient = e * (autocoder.inputs[i] - o) * o * (1.0f - o);
+            for (int h = 0; h < no_of_hiddens; h++) {
+                int n = h*no_of_inputs + i;
+                if (autocoder.hiddens[h] == AUTOCODER_DROPPED_OUT)
+                    continue;
+                weight_change[n] =
+                    egradient * (weight_change[n] + 1) * autocoder.hiddens[h];
+                weights[n] = CLIP_WEIGHT(weights[n] + weight_change[n]);
+            }
+        }
+        for (int h = 0; h < no_of_hiddens; h++) {
+            float e = autocoder.learning_rate / (1.0f + no_of_inputs);
+            float hid = autocoder.hiddens[h];
+            float gradient = hid * (1.0f - hid) * bperr[h];
+            if (hid == AUTOCODER_DROPPED_OUT)
+                continue;
+            bias_change[h] = e * (bias_change[h] + 1.0f) * gradient;
+            bias[h] = CLIP_WEIGHT(bias[h] + bias_change[h]);
+            for (int i = 0; i < no_of_inputs; i++) {
+                int n = h*no_of_inputs + i;
+                weight_change[n] = e * gradient * (weight_change[n] + 1) *
+                    autocoder.inputs[i];
+                weights[n] = CLIP_WEIGHT(weights[n] + weight_change[n]);
+            }
+        }
+
+        autocoder_backprop(&autocoder);
+        for (int h = 0; h < no_of_hiddens; h++)
+            assert(fabs(autocoder.bperr[h] - bperr[h]) < 0.0001f);
+
+        autocoder_learn(&autocoder);
+        for (int n = 0; n < no_of_inputs*no_of_hiddens; n++)
+            assert(fabs(autocoder.weights[n] - weights[n]) < 0.0001f);
+        for (int h = 0; h < no_of_hiddens; h++)
+            assert(fabs(autocoder.bias[h] - bias[h]) < 0.0001f);
+    }
+
+    free(weights);
+    free(weight_change);
+    free(bias);
+    free(bias_change);
+    autocoder_free(&autocoder);
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+
+    printf("Ok\n");
+}
+
+static void test_autocoder_update_batch()
+{
+    ac autocoder, batched;
+    int no_of_inputs = 100;
+    int no_of_hiddens = 30;
+    int batch_size = 16;
+    unsigned int random_seed = 3761;
+    int initial_threads = deeplearn_get_threads();
+    int initial_threshold = deeplearn_get_parallel_threshold();
+    float * inputs;
+
+    printf("test_autocoder_update_batch...");
+
+    assert(deeplearn_set_threads(4) == 4);
+    deeplearn_set_parallel_threshold(0);
+
+    assert(autocoder_init(&autocoder, no_of_inputs, no_of_hiddens,
+                          random_seed) == 0);
+    assert(autocoder_init(&batched, no_of_inputs, no_of_hiddens,
+                          random_seed) == 0);
+    autocoder.dropout_percent = 0;
+    batched.dropout_percent = 0;
+
+    inputs = (float*)malloc(batch_size*no_of_inputs*sizeof(float));
+    assert(inputs);
+    for (int i = 0; i < batch_size*no_of_inputs; i++)
+        inputs[i] = NEURON_LOW + ((i%no_of_inputs)/(float)no_of_inputs)*
+            NEURON_RANGE*((i/no_of_inputs)%2);
+
+    /* a batch of one sample is the same as a single update */
+    assert(autocoder_update_batch(&batched, inputs, 0) != 0);
+    for (int t = 0; t < 5; t++) {
+        autocoder_set_inputs(&autocoder, &inputs[t*no_of_inputs]);
+        autocoder_encode(&autocoder, autocoder.hiddens, 0);
+        autocoder_decode(&autocoder, autocoder.outputs, 0);
+        autocoder_backprop(&autocoder);
+        autocoder_learn(&autocoder);
+
+        assert(autocoder_update_batch(&batched,
+                                      &inputs[t*no_of_inputs], 1) == 0);
+        for (int n = 0; n < no_of_inputs*no_of_hiddens; n++)
+            assert(fabs(batched.weights[n] - autocoder.weights[n]) <
+                   0.0001f);
+        for (int h = 0; h < no_of_hiddens; h++) {
+            assert(fabs(batched.bias[h] - autocoder.bias[h]) < 0.0001f);
+            assert(fabs(batched.hiddens[h] - autocoder.hiddens[h]) <
+                   0.0001f);
+        }
+        for (int i = 0; i < no_of_inputs; i++)
+            assert(fabs(batched.outputs[i] - autocoder.outputs[i]) <
+                   0.0001f);
+        assert(fabs(batched.backprop_error_percent -
+                    autocoder.backprop_error_percent) < 0.001f);
+    }
+    assert(batched.itterations == autocoder.itterations);
+
+    /* training on whole batches reduces the error */
+    batched.dropout_percent = 0.1f;
+    for (int t = 0; t < 20; t++)
+        assert(autocoder_update_batch(&batched, inputs, batch_size) == 0);
+    float initial_error_percent = batched.backprop_error_percent;
+    for (int t = 0; t < 200; t++)
+        assert(autocoder_update_batch(&batched, inputs, batch_size) == 0);
+    assert(batched.backprop_error_percent > 0);
+    assert(batched.backprop_error_percent < initial_error_percent);
+    assert(batched.itterations == 5 + 220*batch_size);
+
+    free(inputs);
+    autocoder_free(&autocoder);
+    autocoder_free(&batched);
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+
+    printf("Ok\n");
+}
+
 int run_tests_autocoder()
 {
     printf("\nRunning autocoder tests\n");
@@ -162,6 +443,9 @@ int run_tests_autocoder()
     test_autocoder_init();
     test_autocoder_save_load();
     test_autocoder_update();
+    test_autocoder_tied_weights();
+    test_autocoder_update_batch();
+    test_autocoder_optimizer();
 
     printf("All autocoder tests completed\n");
     return 0;
@@ -0,0 +1,405 @@
+/*
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "tests_backend.h"
+
+/* number of calls made to each kernel of the test backend */
+static int test_init_calls, test_release_calls, test_changed_calls;
+static int test_synchronise_calls, test_forward_calls, test_backward_calls;
+static int test_convolve_calls, test_scores_calls;
+
+static int test_init(void)
+{
+    test_init_calls++;
+    return 0;
+}
+
+static void test_release(void)
+{
+    test_release_calls++;
+}
+
+static void test_weights_changed(const float * weights)
+{
+    test_changed_calls++;
+}
+
+static void test_synchronise(void)
+{
+    test_synchronise_calls++;
+}
+
+static int test_dense_forward(const float * weights, const float * inputs,
+                              int batch_size, int no_of_inputs,
+                              int no_of_units, float * outputs)
+{
+    test_forward_calls++;
+    for (int b = 0; b < batch_size; b++) {
+        for (int i = 0; i < no_of_units; i++) {
+            float sum = 0;
+            for (int j = 0; j < no_of_inputs; j++)
+                sum += inputs[b*no_of_inputs + j]*weights[i*no_of_inputs + j];
+            outputs[b*no_of_units + i] = sum;
+        }
+    }
+    return 0;
+}
+
+static int test_dense_backward(const float * weights, const float * deltas,
+                               int batch_size, int no_of_inputs,
+                               int no_of_units, float * input_errors)
+{
+    test_backward_calls++;
+    for (int b = 0; b < batch_size; b++) {
+        for (int j = 0; j < no_of_inputs; j++) {
+            float sum = 0;
+            for (int i = 0; i < no_of_units; i++)
+                sum += deltas[b*no_of_units + i]*weights[i*no_of_inputs + j];
+            input_errors[b*no_of_inputs + j] = sum;
+        }
+    }
+    return 0;
+}
+
+/* declines every call, so the cpu should do the work */
+static int test_convolve_image(float img[],
+                               int img_width, int img_height, int img_depth,
+                               int feature_width, int no_of_features,
+                               int pooling_factor,
+                               float feature[],
+                               float layer[], int layer_width,
+                               int activation)
+{
+    test_convolve_calls++;
+    return -1;
+}
+
+static int test_feature_scores(const float * img, int img_width,
+                               int img_depth, int feature_width,
+                               const int * positions, int stride,
+                               int no_of_patches,
+                               const float * feature, int no_of_features,
+                               float * scores)
+{
+    int row_size = feature_width*img_depth;
+    int feature_size = feature_width*row_size;
+
+    test_scores_calls++;
+    for (int p = 0; p < no_of_patches; p++) {
+        int tx = positions[p*stride];
+        int ty = positions[p*stride + 1];
+
+        for (int f = 0; f < no_of_features; f++) {
+            float sum = 0;
+
+            for (int y = 0; y < feature_width; y++) {
+                for (int x = 0; x < row_size; x++) {
+                    float diff =
+                        img[((ty + y)*img_width + tx)*img_depth + x] -
+                        feature[f*feature_size + y*row_size + x];
+                    sum += diff*diff;
+                }
+            }
+            scores[p*no_of_features + f] = sum;
+        }
+    }
+    return 0;
+}
+
+static const deeplearn_backend test_backend = {
+    "test", test_init, test_release, test_weights_changed, test_synchronise,
+    test_dense_forward, test_dense_backward, test_convolve_image, NULL,
+    test_feature_scores
+};
+
+static void test_backend_select()
+{
+    printf("test_backend_select...");
+
+    assert(deeplearn_backend_id() == DEEPLEARN_BACKEND_CPU);
+    assert(strcmp(deeplearn_backend_name(), "cpu") == 0);
+
+    /* backends must be registered before they can be selected */
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_OPENCL) == -1);
+    assert(deeplearn_backend_select(DEEPLEARN_BACKENDS) == -1);
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_CPU,
+                                      &test_backend) == -1);
+
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_OPENCL,
+                                      &test_backend) == 0);
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_OPENCL) == 0);
+    assert(deeplearn_backend_id() == DEEPLEARN_BACKEND_OPENCL);
+    assert(strcmp(deeplearn_backend_name(), "test") == 0);
+    assert(test_init_calls == 1);
+
+    /* device arrays are copied back before switching */
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_CPU) == 0);
+    assert(test_synchronise_calls == 1);
+    assert(test_release_calls == 1);
+
+    /* removing the selected backend returns to the cpu */
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_OPENCL) == 0);
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_OPENCL, NULL) == 0);
+    assert(deeplearn_backend_id() == DEEPLEARN_BACKEND_CPU);
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_OPENCL) == -1);
+
+    printf("Ok\n");
+}
+
+static void test_backend_dense()
+{
+    bp net, net2;
+    unsigned int random_seed = 6152, random_seed2 = 6152;
+    int no_of_inputs = 12, no_of_outputs = 3, batch_size = 5;
+    float inputs[12*5], targets[3*5], outputs[3*5], outputs2[3*5];
+    int i, l, changed;
+
+    printf("test_backend_dense...");
+
+    assert(bp_init(&net, no_of_inputs, 8, 2, no_of_outputs,
+                   &random_seed) == 0);
+    assert(bp_init(&net2, no_of_inputs, 8, 2, no_of_outputs,
+                   &random_seed2) == 0);
+    net.dropout_percent = net2.dropout_percent = 0;
+    net.noise = net2.noise = 0;
+
+    for (i = 0; i < no_of_inputs*batch_size; i++)
+        inputs[i] = (rand_num(&random_seed)%10000)/10000.0f;
+    for (i = 0; i < no_of_outputs*batch_size; i++)
+        targets[i] = (rand_num(&random_seed)%10000)/10000.0f;
+
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_OPENCL,
+                                      &test_backend) == 0);
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_OPENCL) == 0);
+
+    test_forward_calls = test_backward_calls = 0;
+    changed = test_changed_calls;
+    assert(bp_update_batch(&net, inputs, targets, batch_size) == 0);
+    assert(bp_feed_forward_batch(&net, inputs, batch_size, outputs) == 0);
+    assert(test_forward_calls > 0);
+    assert(test_backward_calls > 0);
+
+    /* the backend is told that the weights have been updated */
+    assert(test_changed_calls > changed);
+
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_CPU) == 0);
+
+    /* the same as the cpu */
+    assert(bp_update_batch(&net2, inputs, targets, batch_size) == 0);
+    assert(bp_feed_forward_batch(&net2, inputs, batch_size, outputs2) == 0);
+    for (i = 0; i < no_of_outputs*batch_size; i++)
+        assert(fabs(outputs[i] - outputs2[i]) < 0.0001f);
+    for (l = 0; l <= net.hidden_layers; l++)
+        for (i = 0; i < net.layers[l].no_of_units*
+                 net.layers[l].no_of_inputs; i++)
+            assert(fabs(net.layers[l].weights[i] -
+                        net2.layers[l].weights[i]) < 0.0001f);
+
+    bp_free(&net);
+    bp_free(&net2);
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_OPENCL, NULL) == 0);
+
+    printf("Ok\n");
+}
+
+static void test_backend_update()
+{
+    bp net;
+    unsigned int random_seed = 4270;
+    int no_of_inputs = 10, no_of_outputs = 3;
+    int i, changed;
+
+    printf("test_backend_update...");
+
+    assert(bp_init(&net, no_of_inputs, 6, 2, no_of_outputs,
+                   &random_seed) == 0);
+    net.dropout_percent = 0;
+    net.noise = 0;
+
+    for (i = 0; i < no_of_inputs; i++)
+        bp_set_input(&net, i, (rand_num(&random_seed)%10000)/10000.0f);
+    for (i = 0; i < no_of_outputs; i++)
+        bp_set_output(&net, i, (rand_num(&random_seed)%10000)/10000.0f);
+
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_OPENCL,
+                                      &test_backend) == 0);
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_OPENCL) == 0);
+
+    /* each layer is reported once per single sample update */
+    changed = test_changed_calls;
+    bp_update(&net, 0);
+    assert(test_changed_calls == changed + net.hidden_layers + 1);
+
+    changed = test_changed_calls;
+    bp_update(&net, 0);
+    bp_update(&net, 0);
+    assert(test_changed_calls == changed + 2*(net.hidden_layers + 1));
+
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_CPU) == 0);
+
+    /* the cpu does not count */
+    changed = test_changed_calls;
+    bp_update(&net, 0);
+    assert(test_changed_calls == changed);
+
+    bp_free(&net);
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_OPENCL, NULL) == 0);
+
+    printf("Ok\n");
+}
+
+static void test_backend_autocoder()
+{
+    ac autocoder, autocoder2;
+    int no_of_inputs = 16, no_of_hiddens = 6, batch_size = 4;
+    float inputs[16*4], encoded[6], encoded2[6];
+    unsigned int random_seed = 8317;
+    int i, changed;
+
+    printf("test_backend_autocoder...");
+
+    assert(autocoder_init(&autocoder, no_of_inputs, no_of_hiddens,
+                          random_seed) == 0);
+    assert(autocoder_init(&autocoder2, no_of_inputs, no_of_hiddens,
+                          random_seed) == 0);
+
+    for (i = 0; i < no_of_inputs*batch_size; i++)
+        inputs[i] = (rand_num(&random_seed)%10000)/10000.0f;
+
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_OPENCL,
+                                      &test_backend) == 0);
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_OPENCL) == 0);
+
+    /* the batch is encoded by the backend */
+    test_forward_calls = 0;
+    changed = test_changed_calls;
+    assert(autocoder_update_batch(&autocoder, inputs, batch_size) == 0);
+    assert(test_forward_calls == 1);
+    assert(test_changed_calls > changed);
+
+    /* and so is a single sample without dropouts */
+    autocoder_set_inputs(&autocoder, inputs);
+    autocoder_encode(&autocoder, encoded, 0);
+    assert(test_forward_calls == 2);
+
+    /* individual connections are dropped on the cpu */
+    autocoder_update(&autocoder);
+    assert(test_forward_calls == 2);
+
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_CPU) == 0);
+
+    /* the same as the cpu */
+    assert(autocoder_update_batch(&autocoder2, inputs, batch_size) == 0);
+    autocoder_set_inputs(&autocoder2, inputs);
+    autocoder_encode(&autocoder2, encoded2, 0);
+    for (i = 0; i < no_of_hiddens; i++)
+        assert(fabs(encoded[i] - encoded2[i]) < 0.0001f);
+    autocoder_update(&autocoder2);
+    for (i = 0; i < no_of_inputs*no_of_hiddens; i++)
+        assert(fabs(autocoder.weights[i] - autocoder2.weights[i]) < 0.0001f);
+
+    autocoder_free(&autocoder);
+    autocoder_free(&autocoder2);
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_OPENCL, NULL) == 0);
+
+    printf("Ok\n");
+}
+
+static void test_backend_features()
+{
+    int img_width = 30, img_height = 20, img_depth = 2;
+    int feature_width = 4, no_of_features = 6;
+    int feature_size = feature_width*feature_width*img_depth;
+    float img[30*20*2], layer[8*8*6*2], layer2[8*8*6*2];
+    float feature[4*4*6*2], feature2[4*4*6*2];
+    float score, score2;
+    unsigned int random_seed = 1739, random_seed2;
+    int i;
+
+    printf("test_backend_features...");
+
+    for (i = 0; i < img_width*img_height*img_depth; i++)
+        img[i] = (rand_num(&random_seed)%10000)/10000.0f;
+    for (i = 0; i < no_of_features*feature_size; i++)
+        feature[i] = (rand_num(&random_seed)%10000)/10000.0f;
+    memcpy(feature2, feature, no_of_features*feature_size*sizeof(float));
+    random_seed2 = random_seed;
+
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_OPENCL,
+                                      &test_backend) == 0);
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_OPENCL) == 0);
+
+    /* features scored by the backend */
+    test_scores_calls = 0;
+    score = learn_features_batch(img, img_width, img_height, img_depth,
+                                 feature_width, no_of_features, feature,
+                                 40, 8, 0.1f, &random_seed);
+    assert(test_scores_calls == 5);
+
+    /* convolution falls back to the cpu when the backend declines */
+    test_convolve_calls = 0;
+    convolve_image(img, img_width, img_height, img_depth,
+                   feature_width, no_of_features, 2, feature,
+                   layer, 8, AF_SIGMOID);
+    assert(test_convolve_calls == 1);
+
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_CPU) == 0);
+
+    score2 = learn_features_batch(img, img_width, img_height, img_depth,
+                                  feature_width, no_of_features, feature2,
+                                  40, 8, 0.1f, &random_seed2);
+    assert(fabs(score - score2) < 0.001f);
+    assert(random_seed == random_seed2);
+    for (i = 0; i < no_of_features*feature_size; i++)
+        assert(fabs(feature[i] - feature2[i]) < 0.0001f);
+
+    convolve_image(img, img_width, img_height, img_depth,
+                   feature_width, no_of_features, 2, feature,
+                   layer2, 8, AF_SIGMOID);
+    for (i = 0; i < 8*8*no_of_features*img_depth; i++)
+        assert(fabs(layer[i] - layer2[i]) < 0.001f);
+
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_OPENCL, NULL) == 0);
+
+    printf("Ok\n");
+}
+
+int run_tests_backend()
+{
+    printf("\nRunning backend tests\n");
+
+    test_backend_select();
+    test_backend_dense();
+    test_backend_update();
+    test_backend_autocoder();
+    test_backend_features();
+
+    printf("All backend tests completed\n");
+    return 0;
+}
@@ -95,6 +95,85 @@ static void test_backprop_inputs_from_image()
     printf("Ok\n");
 }
 
+static void test_backprop_scan_image()
+{
+    bp net;
+    int image_width=40;
+    int image_height=30;
+    int window_size=8;
+    int no_of_hiddens=16;
+    int hidden_layers=2;
+    int no_of_outputs=3;
+    int strides[] = { 1, 3 };
+    unsigned int random_seed = 7193;
+    unsigned char img[40*30];
+    float * outputs;
+    int initial_threads = deeplearn_get_threads();
+    int initial_threshold = deeplearn_get_parallel_threshold();
+
+    printf("test_backprop_scan_image...");
+
+    COUNTUP(i, image_width*image_height)
+        img[i] = (unsigned char)((i*37 + (i/image_width)*11)%256);
+
+    bp_init(&net,
+            window_size*window_size, no_of_hiddens,
+            hidden_layers,
+            no_of_outputs, &random_seed);
+    FLOATALLOC(outputs, image_width*image_height*no_of_outputs);
+    assert(outputs);
+
+    assert(bp_scan_image(&net, img, image_width, image_height,
+                         window_size+1, 1, outputs) == -1);
+    assert(bp_scan_image(&net, img, image_width, image_height,
+                         window_size, 0, outputs) == -2);
+    assert(bp_scan_image(&net, img, window_size-1, image_height,
+                         window_size, 1, outputs) == -3);
+
+    /* the same outputs as feeding forward each window in turn,
+       with the rows of windows shared between threads or not */
+    COUNTUP(t, 2) {
+        if (t == 1) {
+            deeplearn_set_threads(4);
+            deeplearn_set_parallel_threshold(0);
+        }
+
+        COUNTUP(s, 2) {
+            int stride = strides[s];
+            int map_width = (image_width - window_size)/stride + 1;
+            int map_height = (image_height - window_size)/stride + 1;
+
+            assert(bp_scan_image(&net, img, image_width, image_height,
+                                 window_size, stride, outputs) == 0);
+
+            COUNTUP(wy, map_height) {
+                COUNTUP(wx, map_width) {
+                    float * out =
+                        &outputs[(wy*map_width + wx)*no_of_outputs];
+
+                    assert(bp_inputs_from_image_patch(&net, img,
+                                                      image_width,
+                                                      image_height,
+                                                      wx*stride,
+                                                      wy*stride) == 0);
+                    bp_feed_forward(&net, 0);
+                    COUNTUP(i, no_of_outputs)
+                        assert(fabs(out[i] - bp_get_output(&net, i)) <
+                               0.0001f);
+                }
+            }
+        }
+    }
+
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+
+    free(outputs);
+    bp_free(&net);
+
+    printf("Ok\n");
+}
+
 static void test_backprop_init()
 {
     bp net;
@@ -115,7 +194,22 @@ static void test_backprop_init()
     assert((&net)->outputs!=0);
     assert(HIDDENS_IN_LAYER(&net,1) < HIDDENS_IN_LAYER(&net,0));
     assert(HIDDENS_IN_LAYER(&net,2) < HIDDENS_IN_LAYER(&net,1));
+
+    /* the network fills a single arena of the expected size */
+    assert(net.arena.memory != 0);
+    assert(net.arena.size ==
+           bp_storage_size(no_of_inputs, no_of_hiddens,
+                           hidden_layers, no_of_outputs));
+    assert(net.arena.used == net.arena.size);
+    assert((size_t)net.layers[0].weights % DEEPLEARN_ARENA_ALIGN == 0);
+    assert((unsigned char*)net.layers[1].weights > net.arena.block);
+    assert((unsigned char*)net.layers[hidden_layers].errors <
+           net.arena.block + net.arena.size);
+    assert(net.inputs[0]->no_of_inputs == 1);
+    assert(net.inputs[0]->inputs[0] == 0);
+    assert(net.layers[0].values[0] == 0);
     bp_free(&net);
+    assert(net.arena.memory == 0);
 
     printf("Ok\n");
 }
@@ -278,6 +372,400 @@ static void test_backprop1()
     printf("Ok\n");
 }
 
+static void test_backprop_layer_storage()
+{
+    bp net;
+    int no_of_inputs=10;
+    int no_of_hiddens=6;
+    int hidden_layers=2;
+    int no_of_outputs=3;
+    int i,j,l;
+    unsigned int random_seed = 123;
+
+    printf("test_backprop_layer_storage...");
+
+    bp_init(&net,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers,
+            no_of_outputs, &random_seed);
+
+    /* unit weights should be rows within the layer weight matrix */
+    for (l = 0; l < hidden_layers; l++) {
+        for (i = 0; i < HIDDENS_IN_LAYER(&net,l); i++) {
+            assert((&net)->hiddens[l][i] == &(&net)->layers[l].units[i]);
+            assert((&net)->hiddens[l][i]->weights ==
+                   &(&net)->layers[l].weights[i*(&net)->layers[l].no_of_inputs]);
+        }
+    }
+    for (i = 0; i < no_of_outputs; i++) {
+        assert((&net)->outputs[i]->weights ==
+               &(&net)->layers[hidden_layers].weights[i*HIDDENS_IN_LAYER(&net,hidden_layers-1)]);
+    }
+
+    /* set some inputs */
+    for (i = 0; i < no_of_inputs; i++) {
+        bp_set_input(&net, i, i/(float)no_of_inputs);
+    }
+
+    bp_feed_forward(&net, 0);
+
+    /* the dense feed forward should give the same result as
+       summing over the input connections of each unit */
+    for (l = 0; l < hidden_layers+1; l++) {
+        bp_layer * layer = &(&net)->layers[l];
+        for (i = 0; i < layer->no_of_units; i++) {
+            bp_neuron * n = &layer->units[i];
+            float adder = n->bias;
+            for (j = 0; j < n->no_of_inputs; j++) {
+                adder += n->weights[j] * n->inputs[j]->value;
+            }
+            assert(fabs(AF(adder) - n->value) < 0.0001f);
+            assert(layer->values[i] == n->value);
+        }
+    }
+
+    bp_free(&net);
+
+    printf("Ok\n");
+}
+
+static void test_backprop_activation()
+{
+    bp net;
+    int no_of_inputs=10;
+    int no_of_hiddens=8;
+    int no_of_outputs=3;
+    int hidden_layers=2;
+    unsigned int random_seed = 853;
+    float exact[3];
+
+    printf("test_backprop_activation...");
+
+    /* the fast approximations should stay within the error bound */
+    for (float x = -30.0f; x <= 30.0f; x += 0.0037f) {
+        assert(fabs(activation_value(AF_SIGMOID_FAST, x) -
+                    activation_value(AF_SIGMOID, x)) < AF_FAST_MAX_ERROR);
+        assert(fabs(activation_value(AF_TANH_FAST, x) -
+                    activation_value(AF_TANH, x)) < AF_FAST_MAX_ERROR);
+    }
+    assert(activation_value(AF_LINEAR, 0) == 0.5f);
+    assert(activation_value(AF_LINEAR, 3) == 1.0f);
+
+    bp_init(&net,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers, no_of_outputs,
+            &random_seed);
+
+    assert(bp_set_activation(&net, 0, AF_FUNCTIONS) != 0);
+    assert(bp_set_activation(&net, hidden_layers+1, AF_TANH) != 0);
+
+    COUNTUP(i, no_of_inputs)
+        bp_set_input(&net, i, i/(float)no_of_inputs);
+
+    bp_feed_forward(&net, 0);
+    COUNTUP(i, no_of_outputs)
+        exact[i] = bp_get_output(&net, i);
+
+    /* switching every layer to the fast sigmoid should give
+       almost identical outputs */
+    assert(bp_set_activation(&net, -1, AF_SIGMOID_FAST) == 0);
+    COUNTUP(l, hidden_layers+1)
+        assert(bp_get_activation(&net, l) == AF_SIGMOID_FAST);
+    bp_feed_forward(&net, 0);
+    COUNTUP(i, no_of_outputs)
+        assert(fabs(bp_get_output(&net, i) - exact[i]) < 0.0001f);
+
+    /* a linear output layer gives different outputs */
+    assert(bp_set_activation(&net, hidden_layers, AF_LINEAR) == 0);
+    bp_feed_forward(&net, 0);
+    COUNTUP(i, no_of_outputs) {
+        bp_layer * output_layer = &net.layers[hidden_layers];
+        int n = output_layer->no_of_inputs;
+        float adder = output_layer->units[i].bias;
+        COUNTUP(j, n)
+            adder += output_layer->weights[i*n + j] *
+                net.layers[hidden_layers-1].values[j];
+        assert(fabs(bp_get_output(&net, i) -
+                    activation_value(AF_LINEAR, adder)) < 0.0001f);
+    }
+
+    bp_free(&net);
+
+    printf("Ok\n");
+}
+
+static void test_backprop_threads()
+{
+    bp net;
+    int no_of_inputs=20;
+    int no_of_hiddens=16;
+    int no_of_outputs=5;
+    int hidden_layers=3;
+    unsigned int random_seed = 6301;
+    float serial[5];
+    int initial_threads = deeplearn_get_threads();
+    int initial_threshold = deeplearn_get_parallel_threshold();
+
+    printf("test_backprop_threads...");
+
+    assert(deeplearn_set_threads(0) >= 1);
+    assert(deeplearn_set_threads(DEEPLEARN_MAX_THREADS+10) ==
+           DEEPLEARN_MAX_THREADS);
+    assert(deeplearn_set_threads(1) == 1);
+    assert(!deeplearn_parallel(1000000));
+
+    bp_init(&net,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers, no_of_outputs,
+            &random_seed);
+
+    COUNTUP(i, no_of_inputs)
+        bp_set_input(&net, i, 0.25f + (i%3)*0.25f);
+
+    bp_feed_forward(&net, 0);
+    COUNTUP(i, no_of_outputs)
+        serial[i] = bp_get_output(&net, i);
+
+    /* force every layer to be distributed between threads */
+    assert(deeplearn_set_threads(4) == 4);
+    deeplearn_set_parallel_threshold(0);
+    assert(deeplearn_parallel(1));
+
+    bp_feed_forward(&net, 0);
+    COUNTUP(i, no_of_outputs)
+        assert(fabs(bp_get_output(&net, i) - serial[i]) < 0.00001f);
+
+    /* a full update within a single parallel region */
+    COUNTUP(i, no_of_outputs)
+        bp_set_output(&net, i, 0.75f);
+    COUNTUP(t, 10)
+        bp_update(&net, 0);
+    assert(net.itterations == 10);
+    assert(net.backprop_error_average != DEEPLEARN_UNKNOWN_ERROR);
+
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+
+    bp_free(&net);
+
+    printf("Ok\n");
+}
+
+static void test_backprop_thread_binding()
+{
+    bp net1, net2;
+    int no_of_inputs=20;
+    int no_of_hiddens=16;
+    int no_of_outputs=5;
+    int hidden_layers=2;
+    unsigned int random_seed = 4117;
+    int initial_threads = deeplearn_get_threads();
+    int initial_threshold = deeplearn_get_parallel_threshold();
+
+    printf("test_backprop_thread_binding...");
+
+    assert(deeplearn_numa_nodes() >= 1);
+    assert(deeplearn_numa_node() >= 0);
+    assert(deeplearn_numa_node() < deeplearn_numa_nodes());
+    assert(deeplearn_get_thread_binding() == 0);
+
+    assert(deeplearn_set_threads(4) == 4);
+    deeplearn_set_parallel_threshold(0);
+
+    bp_init(&net1,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers, no_of_outputs,
+            &random_seed);
+
+    /* binding may not be allowed, in which case nothing changes */
+    if (deeplearn_set_thread_binding(1) == 0)
+        assert(deeplearn_get_thread_binding() == 1);
+    else
+        assert(deeplearn_get_thread_binding() == 0);
+
+    /* placing the weights does not change the network */
+    random_seed = 4117;
+    bp_init(&net2,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers, no_of_outputs,
+            &random_seed);
+    assert(bp_set_optimizer(&net2, OPTIMIZER_ADAM) == 0);
+    assert(bp_set_optimizer(&net1, OPTIMIZER_ADAM) == 0);
+
+    COUNTUP(i, no_of_inputs) {
+        bp_set_input(&net1, i, 0.25f + (i%3)*0.25f);
+        bp_set_input(&net2, i, 0.25f + (i%3)*0.25f);
+    }
+    COUNTUP(i, no_of_outputs) {
+        bp_set_output(&net1, i, 0.75f);
+        bp_set_output(&net2, i, 0.75f);
+    }
+    COUNTUP(t, 10) {
+        bp_update(&net1, 0);
+        bp_update(&net2, 0);
+    }
+
+    COUNTUP(l, hidden_layers+1) {
+        bp_layer * layer1 = &net1.layers[l];
+        bp_layer * layer2 = &net2.layers[l];
+
+        COUNTUP(i, layer1->no_of_units*layer1->no_of_inputs)
+            assert(fabs(layer1->weights[i] - layer2->weights[i]) < 0.00001f);
+    }
+
+    /* threads may run anywhere again */
+    if (deeplearn_get_thread_binding() != 0)
+        assert(deeplearn_set_thread_binding(0) == 0);
+    assert(deeplearn_get_thread_binding() == 0);
+
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+
+    bp_free(&net1);
+    bp_free(&net2);
+
+    printf("Ok\n");
+}
+
+static void test_backprop_dropouts()
+{
+    bp net;
+    int no_of_inputs=50;
+    int no_of_hiddens=16;
+    int no_of_outputs=5;
+    int hidden_layers=2;
+    unsigned int random_seed = 6301, seed;
+    float plain[5], serial[5];
+    int differences = 0;
+    int initial_threads = deeplearn_get_threads();
+    int initial_threshold = deeplearn_get_parallel_threshold();
+
+    printf("test_backprop_dropouts...");
+
+    bp_init(&net,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers, no_of_outputs,
+            &random_seed);
+
+    COUNTUP(i, no_of_inputs)
+        bp_set_input(&net, i, 0.25f + (i%3)*0.25f);
+
+    net.dropout_percent = 0;
+    bp_feed_forward(&net, 1);
+    COUNTUP(i, no_of_outputs)
+        plain[i] = bp_get_output(&net, i);
+
+    /* inputs drop out while learning */
+    net.dropout_percent = 30;
+    seed = net.random_seed;
+    assert(deeplearn_set_threads(1) == 1);
+    bp_feed_forward(&net, 1);
+    COUNTUP(i, no_of_outputs) {
+        serial[i] = bp_get_output(&net, i);
+        if (fabs(serial[i] - plain[i]) > 0.00001f)
+            differences++;
+    }
+    assert(differences > 0);
+    assert(net.random_seed != seed);
+
+    /* the same inputs drop out however many threads are used */
+    net.random_seed = seed;
+    assert(deeplearn_set_threads(4) == 4);
+    deeplearn_set_parallel_threshold(0);
+    bp_feed_forward(&net, 1);
+    COUNTUP(i, no_of_outputs)
+        assert(fabs(bp_get_output(&net, i) - serial[i]) < 0.00001f);
+
+    /* but not when there is no learning */
+    bp_feed_forward(&net, 0);
+    COUNTUP(i, no_of_outputs)
+        assert(fabs(bp_get_output(&net, i) - plain[i]) < 0.00001f);
+
+    /* training with dropouts */
+    COUNTUP(i, no_of_outputs)
+        bp_set_output(&net, i, 0.75f);
+    COUNTUP(t, 10)
+        bp_update(&net, 0);
+    assert(net.itterations == 10);
+    assert(net.backprop_error_average != DEEPLEARN_UNKNOWN_ERROR);
+
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+
+    bp_free(&net);
+
+    printf("Ok\n");
+}
+
+/* back-propagates errors with the given number of threads, returning
+   the errors of the inputs and of the first hidden layer */
+static void backprop_errors(bp * net, int threads,
+                            float * input_errors, float * hidden_errors)
+{
+    deeplearn_set_threads(threads);
+    bp_backprop(net, 0);
+    COUNTUP(i, net->no_of_inputs)
+        input_errors[i] = net->input_errors[i];
+    COUNTUP(i, net->layers[0].no_of_units)
+        hidden_errors[i] = net->layers[0].errors[i];
+}
+
+static void test_backprop_gather()
+{
+    bp net;
+    int no_of_inputs=100;
+    int no_of_hiddens=70;
+    int no_of_outputs=5;
+    int hidden_layers=2;
+    unsigned int random_seed = 7812;
+    float serial_inputs[100], serial_hiddens[70];
+    float parallel_inputs[100], parallel_hiddens[70];
+    int initial_threads = deeplearn_get_threads();
+    int initial_threshold = deeplearn_get_parallel_threshold();
+
+    printf("test_backprop_gather...");
+
+    bp_init(&net,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers, no_of_outputs,
+            &random_seed);
+
+    COUNTUP(i, no_of_inputs)
+        bp_set_input(&net, i, 0.25f + (i%3)*0.25f);
+    COUNTUP(i, no_of_outputs)
+        bp_set_output(&net, i, 0.25f + (i%2)*0.5f);
+    bp_feed_forward(&net, 0);
+
+    deeplearn_set_parallel_threshold(0);
+
+    /* each input error is gathered by a single thread, in the same
+       order as on one thread, so the results are identical */
+    COUNTUP(pass, 2) {
+        backprop_errors(&net, 1, serial_inputs, serial_hiddens);
+        backprop_errors(&net, 8, parallel_inputs, parallel_hiddens);
+
+        COUNTUP(i, no_of_inputs) {
+            if (pass == 0)
+                assert(serial_inputs[i] != 0);
+            assert(parallel_inputs[i] == serial_inputs[i]);
+        }
+        COUNTUP(i, no_of_hiddens)
+            assert(parallel_hiddens[i] == serial_hiddens[i]);
+
+        /* and again with sparse layers */
+        bp_prune_weights(&net, 0.5f);
+        assert(bp_sparsify(&net, 10) > 0);
+        bp_feed_forward(&net, 0);
+    }
+
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+
+    bp_free(&net);
+
+    printf("Ok\n");
+}
+
 static void test_backprop_update()
 {
     bp net;
@@ -312,6 +800,286 @@ static void test_backprop_update()
     printf("Ok\n");
 }
 
+static void test_backprop_update_batch()
+{
+    bp net1, net2;
+    int no_of_inputs=6;
+    int no_of_hiddens=5;
+    int hidden_layers=2;
+    int no_of_outputs=3;
+    int i,j,l,itt;
+    unsigned int random_seed = 123;
+    float inputs[6*4], targets[3*4];
+
+    printf("test_backprop_update_batch...");
+
+    bp_init(&net1,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers,
+            no_of_outputs, &random_seed);
+    random_seed = 123;
+    bp_init(&net2,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers,
+            no_of_outputs, &random_seed);
+    net1.dropout_percent = 0;
+    net2.dropout_percent = 0;
+
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < no_of_inputs; j++) {
+            inputs[i*no_of_inputs + j] = 0.25f + (((i+j)%3)*0.25f);
+        }
+        for (j = 0; j < no_of_outputs; j++) {
+            targets[i*no_of_outputs + j] = 0.25f + (((i*j)%2)*0.5f);
+        }
+    }
+
+    /* a batch of one sample should be the same as a normal update */
+    for (itt = 0; itt < 20; itt++) {
+        i = itt%4;
+        for (j = 0; j < no_of_inputs; j++) {
+            bp_set_input(&net1, j, inputs[i*no_of_inputs + j]);
+        }
+        for (j = 0; j < no_of_outputs; j++) {
+            bp_set_output(&net1, j, targets[i*no_of_outputs + j]);
+        }
+        bp_update(&net1, 0);
+        assert(bp_update_batch(&net2, &inputs[i*no_of_inputs],
+                               &targets[i*no_of_outputs], 1) == 0);
+    }
+
+    for (l = 0; l < hidden_layers+1; l++) {
+        bp_layer * layer1 = &(&net1)->layers[l];
+        bp_layer * layer2 = &(&net2)->layers[l];
+        for (i = 0; i < layer1->no_of_units*layer1->no_of_inputs; i++) {
+            assert(fabs(layer1->weights[i] - layer2->weights[i]) < 0.00001f);
+        }
+        for (i = 0; i < layer1->no_of_units; i++) {
+            assert(fabs(layer1->units[i].bias -
+                        layer2->units[i].bias) < 0.00001f);
+        }
+    }
+    assert(fabs(net1.backprop_error_percent -
+                net2.backprop_error_percent) < 0.001f);
+    assert(bp_get_output(&net2, 0) == net2.layers[hidden_layers].values[0]);
+
+    /* training on whole batches should reduce the error */
+    for (itt = 0; itt < 2000; itt++) {
+        assert(bp_update_batch(&net2, inputs, targets, 4) == 0);
+    }
+    assert(net2.backprop_error_percent < net1.backprop_error_percent);
+
+    assert(bp_update_batch(&net2, inputs, targets, 0) != 0);
+
+    bp_free(&net1);
+    bp_free(&net2);
+
+    printf("Ok\n");
+}
+
+static void test_backprop_update_batch_dropouts()
+{
+    bp net1, net2;
+    int no_of_inputs=10;
+    int no_of_hiddens=32;
+    int hidden_layers=3;
+    int no_of_outputs=4;
+    int batch_size=32;
+    unsigned int random_seed = 5231;
+    float inputs[10*32], targets[4*32];
+    float * weights;
+    int fixed_rows = 0, fixed_columns = 0;
+    int initial_threads = deeplearn_get_threads();
+    int initial_threshold = deeplearn_get_parallel_threshold();
+    bp_layer * layer;
+
+    printf("test_backprop_update_batch_dropouts...");
+
+    bp_init(&net1,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers,
+            no_of_outputs, &random_seed);
+    random_seed = 5231;
+    bp_init(&net2,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers,
+            no_of_outputs, &random_seed);
+    net1.dropout_percent = net2.dropout_percent = 50;
+
+    COUNTUP(i, batch_size*no_of_inputs)
+        inputs[i] = 0.25f + ((i%7)*0.5f/7.0f);
+    COUNTUP(i, batch_size*no_of_outputs)
+        targets[i] = 0.25f + ((i%3)*0.25f);
+
+    /* the same units and inputs drop out however many threads are used */
+    assert(deeplearn_set_threads(1) == 1);
+    COUNTUP(itt, 5)
+        assert(bp_update_batch(&net1, inputs, targets, batch_size) == 0);
+    assert(deeplearn_set_threads(4) == 4);
+    deeplearn_set_parallel_threshold(0);
+    COUNTUP(itt, 5)
+        assert(bp_update_batch(&net2, inputs, targets, batch_size) == 0);
+
+    COUNTUP(l, hidden_layers+1) {
+        bp_layer * layer1 = &net1.layers[l];
+        bp_layer * layer2 = &net2.layers[l];
+
+        /* every input is used once the batch is complete */
+        assert(layer2->no_of_active_inputs == 0);
+
+        COUNTUP(i, layer1->no_of_units*layer1->no_of_inputs)
+            assert(fabs(layer1->weights[i] - layer2->weights[i]) < 0.00001f);
+    }
+
+    /* the weights of the units which dropped out are unchanged,
+       as are those of the inputs which dropped out */
+    layer = &net1.layers[1];
+    FLOATALLOC(weights, layer->no_of_units*no_of_hiddens);
+    assert(weights);
+    memcpy(weights, layer->weights,
+           layer->no_of_units*no_of_hiddens*sizeof(float));
+    assert(bp_update_batch(&net1, inputs, targets, batch_size) == 0);
+
+    COUNTUP(i, layer->no_of_units) {
+        int fixed = 1;
+        COUNTUP(j, no_of_hiddens)
+            if (weights[i*no_of_hiddens + j] !=
+                layer->weights[i*no_of_hiddens + j])
+                fixed = 0;
+        fixed_rows += fixed;
+    }
+    COUNTUP(j, no_of_hiddens) {
+        int fixed = 1;
+        COUNTUP(i, layer->no_of_units)
+            if (weights[i*no_of_hiddens + j] !=
+                layer->weights[i*no_of_hiddens + j])
+                fixed = 0;
+        if (!fixed) continue;
+
+        fixed_columns++;
+        COUNTUP(i, layer->no_of_units) {
+            int changed = 0;
+            COUNTUP(k, no_of_hiddens)
+                if (weights[i*no_of_hiddens + k] !=
+                    layer->weights[i*no_of_hiddens + k])
+                    changed = 1;
+            if (changed)
+                assert(layer->last_weight_change[i*no_of_hiddens + j] == 0);
+        }
+    }
+    assert(fixed_rows > 0);
+    assert(fixed_rows < layer->no_of_units);
+    assert(fixed_columns > 0);
+    assert(fixed_columns < no_of_hiddens);
+    free(weights);
+
+    /* adaptive optimizers with compacted layers */
+    assert(bp_set_optimizer(&net2, OPTIMIZER_ADAM) == 0);
+    COUNTUP(itt, 5)
+        assert(bp_update_batch(&net2, inputs, targets, batch_size) == 0);
+    COUNTUP(l, hidden_layers+1) {
+        layer = &net2.layers[l];
+        COUNTUP(i, layer->no_of_units*layer->no_of_inputs)
+            assert(!isnan(layer->weights[i]));
+    }
+
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+
+    bp_free(&net1);
+    bp_free(&net2);
+
+    printf("Ok\n");
+}
+
+static void test_backprop_update_hogwild()
+{
+    bp net1, net2;
+    bp_worker * workers;
+    int no_of_inputs=6;
+    int no_of_hiddens=5;
+    int hidden_layers=2;
+    int no_of_outputs=3;
+    int i,j,l,itt;
+    unsigned int random_seed = 123;
+    unsigned int itterations;
+    float inputs[6*16], targets[3*16];
+    float initial_error;
+
+    printf("test_backprop_update_hogwild...");
+
+    bp_init(&net1,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers,
+            no_of_outputs, &random_seed);
+    random_seed = 123;
+    bp_init(&net2,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers,
+            no_of_outputs, &random_seed);
+    net1.dropout_percent = net2.dropout_percent = 0;
+    net1.noise = net2.noise = 0;
+
+    for (i = 0; i < 16; i++) {
+        for (j = 0; j < no_of_inputs; j++) {
+            inputs[i*no_of_inputs + j] = 0.25f + ((((i%4)+j)%3)*0.25f);
+        }
+        for (j = 0; j < no_of_outputs; j++) {
+            targets[i*no_of_outputs + j] = 0.25f + ((((i%4)*j)%2)*0.5f);
+        }
+    }
+
+    assert(bp_workers_init(&net2, 0) == NULL);
+
+    /* a single worker is the same as a batch of one sample */
+    workers = bp_workers_init(&net2, 1);
+    assert(workers != NULL);
+    for (itt = 0; itt < 20; itt++) {
+        i = itt%4;
+        assert(bp_update_batch(&net1, &inputs[i*no_of_inputs],
+                               &targets[i*no_of_outputs], 1) == 0);
+        assert(bp_update_hogwild(&net2, workers, 1,
+                                 &inputs[i*no_of_inputs],
+                                 &targets[i*no_of_outputs], 1) == 0);
+    }
+    bp_workers_free(&net2, workers, 1);
+
+    for (l = 0; l < hidden_layers+1; l++) {
+        bp_layer * layer1 = &(&net1)->layers[l];
+        bp_layer * layer2 = &(&net2)->layers[l];
+        for (i = 0; i < layer1->no_of_units*layer1->no_of_inputs; i++) {
+            assert(fabs(layer1->weights[i] - layer2->weights[i]) < 0.00001f);
+        }
+        for (i = 0; i < layer1->no_of_units; i++) {
+            assert(fabs(layer1->units[i].bias -
+                        layer2->units[i].bias) < 0.00001f);
+        }
+    }
+    assert(fabs(net1.backprop_error_percent -
+                net2.backprop_error_percent) < 0.001f);
+    assert(net1.itterations == net2.itterations);
+
+    /* several workers reduce the error */
+    workers = bp_workers_init(&net2, 4);
+    assert(workers != NULL);
+    initial_error = net2.backprop_error_percent;
+    itterations = net2.itterations;
+    for (itt = 0; itt < 500; itt++) {
+        assert(bp_update_hogwild(&net2, workers, 4, inputs, targets,
+                                 16) == 0);
+    }
+    assert(net2.backprop_error_percent < initial_error);
+    assert(net2.itterations == itterations + 500*16);
+
+    assert(bp_update_hogwild(&net2, workers, 4, inputs, targets, 0) != 0);
+    bp_workers_free(&net2, workers, 4);
+
+    bp_free(&net1);
+    bp_free(&net2);
+
+    printf("Ok\n");
+}
+
 static void test_backprop_training()
 {
     bp * net;
@@ -520,6 +1288,7 @@ static void test_backprop_save_load()
             no_of_inputs, no_of_hiddens,
             hidden_layers, no_of_outputs,
             &random_seed);
+    assert(bp_set_activation(&net1, 1, AF_TANH_FAST) == 0);
 
     sprintf(filename,"%stemp_deep.dat",DEEPLEARN_TEMP_DIRECTORY);
 
@@ -541,6 +1310,8 @@ static void test_backprop_save_load()
         printf("\nretval = %d\n",retval);
     }
     assert(retval==1);
+    assert(bp_get_activation(&net2, 1) == AF_TANH_FAST);
+    assert(bp_get_activation(&net2, 0) == ACTIVATION_FUNCTION);
 
     /* free memory */
     bp_free(&net1);
@@ -549,6 +1320,467 @@ static void test_backprop_save_load()
     printf("Ok\n");
 }
 
+/* saves a network in the unversioned format written before layers
+   had storage types, activation functions, optimizers or precisions */
+static void save_legacy_network(FILE * fp, bp * net)
+{
+    assert(UINTWRITE(net->itterations) != 0);
+    assert(UINTWRITE(net->pruning_cycle) != 0);
+    assert(FLOATWRITE(net->pruning_rate) != 0);
+    assert(INTWRITE(net->no_of_inputs) != 0);
+    assert(INTWRITE(net->no_of_hiddens) != 0);
+    assert(INTWRITE(net->no_of_outputs) != 0);
+    assert(INTWRITE(net->hidden_layers) != 0);
+    assert(FLOATWRITE(net->learning_rate) != 0);
+    assert(FLOATWRITE(net->noise) != 0);
+    assert(FLOATWRITE(net->backprop_error_average) != 0);
+    assert(FLOATWRITE(net->dropout_percent) != 0);
+    assert(UINTWRITE(net->random_seed) != 0);
+    for (int l = 0; l <= net->hidden_layers; l++)
+        for (int i = 0; i < net->layers[l].no_of_units; i++)
+            assert(bp_neuron_save(fp, &net->layers[l].units[i]) == 0);
+}
+
+static void test_backprop_load_legacy()
+{
+    bp net1, net2;
+    unsigned int random_seed = 8163;
+    unsigned int magic = 0;
+    int version = DEEPLEARN_NETWORK_VERSION + 1;
+    char filename[256];
+    FILE * fp;
+    int i, itt;
+
+    printf("test_backprop_load_legacy...");
+
+    assert(bp_init(&net1, 10, 6, 2, 3, &random_seed) == 0);
+    net1.learning_rate = 0.4f;
+    for (itt = 0; itt < 20; itt++) {
+        for (i = 0; i < 10; i++)
+            bp_set_input(&net1, i, ((i+itt)%5)/5.0f);
+        for (i = 0; i < 3; i++)
+            bp_set_output(&net1, i, ((i+itt)%2)*0.5f + 0.25f);
+        bp_update(&net1, 0);
+    }
+
+    sprintf(filename,"%stemp_deep_legacy.dat",DEEPLEARN_TEMP_DIRECTORY);
+    fp = fopen(filename,"wb");
+    assert(fp!=0);
+    save_legacy_network(fp, &net1);
+    fclose(fp);
+
+    /* a network saved before the format had a version */
+    fp = fopen(filename,"rb");
+    assert(fp!=0);
+    assert(bp_load(fp, &net2) == 0);
+    fclose(fp);
+    assert(bp_compare(&net1, &net2) == 1);
+    for (i = 0; i <= net2.hidden_layers; i++) {
+        assert(net2.layers[i].row_start == 0);
+        assert(net2.layers[i].activation == ACTIVATION_FUNCTION);
+    }
+    assert(net2.optimizer.type == OPTIMIZER_SGD);
+    assert(net2.weight_precision == DEEPLEARN_PRECISION_FP32);
+    for (i = 0; i < 10; i++) {
+        bp_set_input(&net1, i, (i%3)/3.0f);
+        bp_set_input(&net2, i, (i%3)/3.0f);
+    }
+    bp_feed_forward(&net1, 0);
+    bp_feed_forward(&net2, 0);
+    for (i = 0; i < 3; i++)
+        assert(bp_get_output(&net1, i) == bp_get_output(&net2, i));
+    bp_free(&net2);
+
+    /* networks are now saved with a magic number and version */
+    fp = fopen(filename,"wb");
+    assert(fp!=0);
+    assert(bp_save(fp, &net1) == 0);
+    fclose(fp);
+    fp = fopen(filename,"r+b");
+    assert(fp!=0);
+    assert(UINTREAD(magic) != 0);
+    assert(magic == DEEPLEARN_NETWORK_MAGIC);
+
+    /* and a version which isn't known is rejected */
+    assert(INTWRITE(version) != 0);
+    fclose(fp);
+    fp = fopen(filename,"rb");
+    assert(fp!=0);
+    assert(bp_load(fp, &net2) == -26);
+    fclose(fp);
+
+    bp_free(&net1);
+
+    printf("Ok\n");
+}
+
+/* number of mini-batches needed for the error to drop below
+   the given percentage, using the given optimizer */
+static int optimizer_batches(int optimizer, float error_percent,
+                             int max_batches)
+{
+    bp net;
+    int no_of_inputs=6;
+    int no_of_hiddens=5;
+    int hidden_layers=2;
+    int no_of_outputs=3;
+    int i,j,itt;
+    unsigned int random_seed = 123;
+    float inputs[6*4], targets[3*4];
+
+    bp_init(&net,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers,
+            no_of_outputs, &random_seed);
+    net.dropout_percent = 0;
+    assert(bp_set_optimizer(&net, optimizer) == 0);
+
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < no_of_inputs; j++) {
+            inputs[i*no_of_inputs + j] = 0.25f + (((i+j)%3)*0.25f);
+        }
+        for (j = 0; j < no_of_outputs; j++) {
+            targets[i*no_of_outputs + j] = 0.25f + (((i*j)%2)*0.5f);
+        }
+    }
+
+    for (itt = 0; itt < max_batches; itt++) {
+        assert(bp_update_batch(&net, inputs, targets, 4) == 0);
+        if ((itt > 10) && (net.backprop_error_percent < error_percent))
+            break;
+    }
+
+    assert(net.optimizer.step == (unsigned int)(itt < max_batches ?
+                                                itt+1 : max_batches));
+    bp_free(&net);
+    return itt;
+}
+
+static void test_backprop_optimizer()
+{
+    bp net1, net2;
+    int no_of_inputs=10;
+    int no_of_hiddens=4;
+    int no_of_outputs=3;
+    int hidden_layers=2;
+    int i, sgd, adam, rmsprop;
+    unsigned int random_seed = 123;
+    char filename[256];
+    FILE * fp;
+
+    printf("test_backprop_optimizer...");
+
+    /* adaptive optimizers reach the same error in far fewer updates */
+    sgd = optimizer_batches(OPTIMIZER_SGD, 10, 20000);
+    adam = optimizer_batches(OPTIMIZER_ADAM, 10, 20000);
+    rmsprop = optimizer_batches(OPTIMIZER_RMSPROP, 10, 20000);
+    assert(adam < 5000);
+    assert(rmsprop < 5000);
+    assert(adam*4 < sgd);
+    assert(rmsprop*4 < sgd);
+
+    bp_init(&net1,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers, no_of_outputs,
+            &random_seed);
+    assert(bp_set_optimizer(&net1, OPTIMIZERS) == -1);
+
+    /* moments are only allocated for adaptive optimizers */
+    assert(net1.layers[0].moment2 == 0);
+    assert(bp_set_optimizer(&net1, OPTIMIZER_RMSPROP) == 0);
+    assert(net1.layers[0].moment1 == 0);
+    assert(net1.layers[0].moment2 != 0);
+    assert(bp_set_optimizer(&net1, OPTIMIZER_ADAM) == 0);
+    assert(net1.layers[0].moment1 != 0);
+    assert(net1.layers[hidden_layers].bias_moment1 != 0);
+
+    /* train with single samples */
+    for (i = 0; i < no_of_inputs; i++)
+        bp_set_input(&net1, i, 0.25f + ((i%3)*0.25f));
+    for (i = 0; i < no_of_outputs; i++)
+        bp_set_output(&net1, i, 0.75f);
+    for (i = 0; i < 20; i++)
+        bp_update(&net1, 0);
+    assert(net1.optimizer.step == 20);
+    assert(net1.layers[0].moment2[0] > 0);
+
+    /* the optimizer state is saved with the network */
+    sprintf(filename,"%stemp_deep_optimizer.dat",DEEPLEARN_TEMP_DIRECTORY);
+    fp = fopen(filename,"wb");
+    assert(fp!=0);
+    assert(bp_save(fp, &net1) == 0);
+    fclose(fp);
+
+    fp = fopen(filename,"rb");
+    assert(fp!=0);
+    assert(bp_load(fp, &net2) == 0);
+    fclose(fp);
+
+    assert(bp_compare(&net1, &net2) == 1);
+    assert(net2.optimizer.type == OPTIMIZER_ADAM);
+    assert(net2.optimizer.step == net1.optimizer.step);
+    for (i = 0; i < no_of_hiddens*no_of_inputs; i++) {
+        assert(net1.layers[0].moment1[i] == net2.layers[0].moment1[i]);
+        assert(net1.layers[0].moment2[i] == net2.layers[0].moment2[i]);
+    }
+    for (i = 0; i < no_of_outputs; i++) {
+        assert(net1.layers[hidden_layers].bias_moment2[i] ==
+               net2.layers[hidden_layers].bias_moment2[i]);
+    }
+
+    /* and the moments are freed when returning to plain sgd */
+    assert(bp_set_optimizer(&net2, OPTIMIZER_SGD) == 0);
+    assert(net2.layers[0].moment1 == 0);
+    assert(net2.layers[0].moment2 == 0);
+    assert(bp_compare(&net1, &net2) == -16);
+
+    bp_free(&net1);
+    bp_free(&net2);
+
+    printf("Ok\n");
+}
+
+static void test_backprop_precision()
+{
+    bp net1, net2;
+    int no_of_inputs=50;
+    int no_of_hiddens=20;
+    int no_of_outputs=5;
+    int hidden_layers=2;
+    int i;
+    unsigned int random_seed = 123;
+    float outputs[5], error_before = 0, error_after = 0;
+    long fp32_size, bf16_size;
+    char filename[256];
+    FILE * fp;
+
+    printf("test_backprop_precision...");
+
+    bp_init(&net1,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers, no_of_outputs,
+            &random_seed);
+    assert(bp_set_precision(&net1, DEEPLEARN_PRECISIONS) == -1);
+    assert(net1.layers[0].weights_bf16 == 0);
+
+    for (i = 0; i < no_of_inputs; i++)
+        bp_set_input(&net1, i, 0.25f + ((i%3)*0.25f));
+    for (i = 0; i < no_of_outputs; i++)
+        bp_set_output(&net1, i, 0.2f + (i*0.15f));
+
+    bp_feed_forward(&net1, 0);
+    for (i = 0; i < no_of_outputs; i++)
+        outputs[i] = bp_get_output(&net1, i);
+
+    sprintf(filename,"%stemp_deep_precision.dat",DEEPLEARN_TEMP_DIRECTORY);
+    fp = fopen(filename,"wb");
+    assert(fp!=0);
+    assert(bp_save(fp, &net1) == 0);
+    fp32_size = ftell(fp);
+    fclose(fp);
+
+    /* reduced precision outputs are close to those at full precision */
+    assert(bp_set_precision(&net1, DEEPLEARN_PRECISION_BF16) == 0);
+    assert(net1.layers[0].weights_bf16 != 0);
+    assert(net1.layers[hidden_layers].weights_bf16 != 0);
+    bp_feed_forward(&net1, 0);
+    for (i = 0; i < no_of_outputs; i++) {
+        assert(fabs(bp_get_output(&net1, i) - outputs[i]) < 0.01f);
+        error_before += fabs(bp_get_output(&net1, i) -
+                             bp_get_desired(&net1, i));
+    }
+
+    /* training still reduces the error */
+    for (i = 0; i < 200; i++)
+        bp_update(&net1, 0);
+    bp_feed_forward(&net1, 0);
+    for (i = 0; i < no_of_outputs; i++) {
+        error_after += fabs(bp_get_output(&net1, i) -
+                            bp_get_desired(&net1, i));
+        outputs[i] = bp_get_output(&net1, i);
+    }
+    assert(error_after < error_before*0.75f);
+
+    /* the weights are saved with reduced precision */
+    fp = fopen(filename,"wb");
+    assert(fp!=0);
+    assert(bp_save(fp, &net1) == 0);
+    bf16_size = ftell(fp);
+    fclose(fp);
+    assert(bf16_size*10 < fp32_size*6);
+
+    fp = fopen(filename,"rb");
+    assert(fp!=0);
+    assert(bp_load(fp, &net2) == 0);
+    fclose(fp);
+
+    assert(net2.weight_precision == DEEPLEARN_PRECISION_BF16);
+    for (i = 0; i < no_of_inputs; i++)
+        bp_set_input(&net2, i, 0.25f + ((i%3)*0.25f));
+    bp_feed_forward(&net2, 0);
+    for (i = 0; i < no_of_outputs; i++)
+        assert(fabs(bp_get_output(&net2, i) - outputs[i]) < 0.0001f);
+
+    /* the copies are freed when returning to full precision */
+    assert(bp_set_precision(&net2, DEEPLEARN_PRECISION_FP32) == 0);
+    assert(net2.layers[0].weights_bf16 == 0);
+
+    bp_free(&net1);
+    bp_free(&net2);
+
+    printf("Ok\n");
+}
+
+static void test_backprop_sparse()
+{
+    bp net1, net2;
+    int no_of_inputs=40;
+    int no_of_hiddens=20;
+    int no_of_outputs=3;
+    int hidden_layers=2;
+    unsigned int random_seed = 4721;
+    float outputs[3];
+    long dense_size, sparse_size, offset;
+    char filename[256];
+    unsigned char * saved;
+    int rows[3];
+    FILE * fp;
+    int i, l, itt;
+
+    printf("test_backprop_sparse...");
+
+    bp_init(&net1,
+            no_of_inputs, no_of_hiddens,
+            hidden_layers, no_of_outputs,
+            &random_seed);
+    net1.learning_rate = 0.5f;
+
+    sprintf(filename,"%stemp_sparse.dat",DEEPLEARN_TEMP_DIRECTORY);
+
+    fp = fopen(filename,"wb");
+    assert(fp!=0);
+    assert(bp_save(fp, &net1) == 0);
+    dense_size = ftell(fp);
+    fclose(fp);
+
+    /* prune most of the weights */
+    for (l = 0; l <= hidden_layers; l++) {
+        bp_layer * layer = &net1.layers[l];
+        for (i = 0; i < layer->no_of_units*layer->no_of_inputs; i++)
+            if (i%5 != 0) layer->weights[i] = 0;
+    }
+
+    /* a layer only becomes sparse if enough of it has been pruned */
+    assert(bp_sparsify(&net1, 101) == 0);
+    for (l = 0; l <= hidden_layers; l++)
+        assert(net1.layers[l].row_start == 0);
+    assert(bp_sparsify(&net1, 50) == hidden_layers+1);
+    for (l = 0; l <= hidden_layers; l++) {
+        bp_layer * layer = &net1.layers[l];
+        int nonzero = 0;
+
+        assert(layer->row_start != 0);
+        for (i = 0; i < layer->no_of_units*layer->no_of_inputs; i++)
+            if (layer->weights[i] != 0) nonzero++;
+        assert(layer->row_start[layer->no_of_units] == nonzero);
+    }
+
+    /* sparse feed forward gives the same result as dense */
+    for (i = 0; i < no_of_inputs; i++)
+        bp_set_input(&net1, i, (i%7)/7.0f);
+    bp_feed_forward(&net1, 0);
+    for (i = 0; i < no_of_outputs; i++)
+        outputs[i] = bp_get_output(&net1, i);
+    assert(bp_sparsify(&net1, 101) == 0);
+    bp_feed_forward(&net1, 0);
+    for (i = 0; i < no_of_outputs; i++)
+        assert(fabs(outputs[i] - bp_get_output(&net1, i)) < 0.0001f);
+    assert(bp_sparsify(&net1, 50) == hidden_layers+1);
+
+    /* pruned weights stay at zero during training */
+    for (itt = 0; itt < 100; itt++) {
+        for (i = 0; i < no_of_inputs; i++)
+            bp_set_input(&net1, i, ((i+itt)%7)/7.0f);
+        for (i = 0; i < no_of_outputs; i++)
+            bp_set_output(&net1, i, (itt%2)*0.5f + 0.25f);
+        bp_update(&net1, 0);
+    }
+    for (l = 0; l <= hidden_layers; l++) {
+        bp_layer * layer = &net1.layers[l];
+        int nonzero = 0;
+
+        for (i = 0; i < layer->no_of_units*layer->no_of_inputs; i++)
+            if (layer->weights[i] != 0) nonzero++;
+        assert(nonzero <= layer->row_start[layer->no_of_units]);
+    }
+
+    /* further pruning shrinks the sparse layers */
+    i = net1.layers[0].row_start[net1.layers[0].no_of_units];
+    assert(bp_prune_weights(&net1, 0.5f) > 0);
+    assert(net1.layers[0].row_start[net1.layers[0].no_of_units] < i);
+
+    /* only the remaining weights are saved */
+    fp = fopen(filename,"wb");
+    assert(fp!=0);
+    assert(bp_save(fp, &net1) == 0);
+    sparse_size = ftell(fp);
+    fclose(fp);
+    assert(sparse_size < dense_size/2);
+
+    fp = fopen(filename,"rb");
+    assert(fp!=0);
+    assert(bp_load(fp, &net2) == 0);
+    fclose(fp);
+    assert(bp_compare(&net1, &net2) == 1);
+    for (l = 0; l <= hidden_layers; l++) {
+        assert(net2.layers[l].row_start != 0);
+        assert(net2.layers[l].row_start[net2.layers[l].no_of_units] ==
+               net1.layers[l].row_start[net1.layers[l].no_of_units]);
+    }
+    bp_free(&net2);
+
+    /* rows which run outside of the non-zero weights are rejected */
+    saved = (unsigned char*)malloc(sparse_size);
+    assert(saved);
+    fp = fopen(filename,"rb");
+    assert(fp!=0);
+    assert(fread(saved, 1, sparse_size, fp) == (size_t)sparse_size);
+    fclose(fp);
+    rows[0] = net1.layers[0].row_start[net1.layers[0].no_of_units];
+    rows[1] = net1.layers[0].row_start[0];
+    rows[2] = net1.layers[0].row_start[1];
+    for (offset = 0; offset + 12 <= sparse_size; offset++)
+        if (memcmp(&saved[offset], rows, 3*sizeof(int)) == 0)
+            break;
+    assert(offset + 12 <= sparse_size);
+    offset += sizeof(int);
+    free(saved);
+
+    for (i = 0; i < 2; i++) {
+        rows[0] = (i == 0) ? 1 : 0;
+        rows[1] = (i == 0) ? net1.layers[0].row_start[1] : -1;
+        fp = fopen(filename,"r+b");
+        assert(fp!=0);
+        fseek(fp, offset, SEEK_SET);
+        assert(fwrite(rows, sizeof(int), 2, fp) == 2);
+        fclose(fp);
+
+        fp = fopen(filename,"rb");
+        assert(fp!=0);
+        assert(bp_load(fp, &net2) != 0);
+        fclose(fp);
+
+        /* and the layer is not left half sparse */
+        assert(net2.layers[0].row_start == 0);
+        assert(net2.layers[0].columns == 0);
+        bp_free(&net2);
+    }
+
+    bp_free(&net1);
+
+    printf("Ok\n");
+}
+
 static void test_backprop_classification_from_filename()
 {
     char classification[256];
@@ -590,13 +1822,27 @@ int run_tests_backprop()
     test_backprop_neuron_init();
     test_backprop_init();
     test_backprop_feed_forward();
+    test_backprop_layer_storage();
     test_backprop1();
     test_backprop2();
+    test_backprop_activation();
+    test_backprop_threads();
+    test_backprop_thread_binding();
+    test_backprop_dropouts();
+    test_backprop_gather();
     test_backprop_update();
+    test_backprop_update_batch();
+    test_backprop_update_batch_dropouts();
+    test_backprop_update_hogwild();
     test_backprop_training();
     test_backprop_neuron_save_load();
     test_backprop_save_load();
+    test_backprop_load_legacy();
+    test_backprop_optimizer();
+    test_backprop_precision();
+    test_backprop_sparse();
     test_backprop_inputs_from_image();
+    test_backprop_scan_image();
     test_backprop_autocoder();
     test_backprop_classification_from_filename();
     test_backprop_classifications_to_numbers();
@@ -0,0 +1,144 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tests_checkpoint.h"
+
+static int files_equal(char * filename1, char * filename2)
+{
+    FILE * fp1 = fopen(filename1, "rb");
+    FILE * fp2 = fopen(filename2, "rb");
+    int c1 = 0, c2 = 0;
+
+    assert(fp1);
+    assert(fp2);
+    while ((c1 == c2) && (c1 != EOF)) {
+        c1 = fgetc(fp1);
+        c2 = fgetc(fp2);
+    }
+    fclose(fp1);
+    fclose(fp2);
+    return (c1 == c2);
+}
+
+static void test_checkpoint_deeplearn()
+{
+    deeplearn learner;
+    deeplearn_checkpoint checkpoint;
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f, 0.01f };
+    unsigned int random_seed = 123;
+    char filename[256], expected_filename[256], temp_filename[256+4];
+    FILE * fp;
+
+    printf("test_checkpoint_deeplearn...");
+
+    assert(deeplearn_init(&learner, 10, 4, 3, 3, error_threshold,
+                          &random_seed) == 0);
+
+    sprintf(filename,"%stemp_checkpoint.dat",DEEPLEARN_TEMP_DIRECTORY);
+    sprintf(expected_filename,"%stemp_checkpoint_expected.dat",
+            DEEPLEARN_TEMP_DIRECTORY);
+    sprintf(temp_filename,"%s.tmp",filename);
+
+    fp = fopen(expected_filename,"wb");
+    assert(fp!=0);
+    assert(deeplearn_save(fp, &learner) == 0);
+    fclose(fp);
+
+    deeplearn_checkpoint_init(&checkpoint);
+    assert(deeplearn_checkpoint_poll(&checkpoint) == 0);
+    assert(deeplearn_checkpoint_async(&checkpoint, &learner,
+                                      filename) == 0);
+
+    /* changes after the snapshot are not in the checkpoint */
+    learner.net->layers[0].weights[0] += 1;
+
+    assert(deeplearn_checkpoint_wait(&checkpoint) == 0);
+    assert(deeplearn_checkpoint_poll(&checkpoint) == 0);
+    assert(files_equal(filename, expected_filename));
+    assert(fopen(temp_filename,"rb") == 0);
+
+    /* a failed write leaves no partial file behind */
+    assert(deeplearn_checkpoint_async(&checkpoint, &learner,
+                                      "/nonexistent/checkpoint.dat") == 0);
+    assert(deeplearn_checkpoint_wait(&checkpoint) < 0);
+    assert(deeplearn_checkpoint_poll(&checkpoint) < 0);
+
+    deeplearn_checkpoint_free(&checkpoint);
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+static void test_checkpoint_deepconvnet()
+{
+    deepconvnet convnet;
+    deeplearn_checkpoint checkpoint;
+    float error_threshold[] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    unsigned int random_seed = 123;
+    char filename[256], expected_filename[256];
+    FILE * fp;
+
+    printf("test_checkpoint_deepconvnet...");
+
+    assert(deepconvnet_init(2, 3, 32, 32, 1, 4*4, 4, 4, 4, 1000, 2,
+                            &convnet, error_threshold,
+                            &random_seed) == 0);
+
+    sprintf(filename,"%stemp_checkpoint_convnet.dat",
+            DEEPLEARN_TEMP_DIRECTORY);
+    sprintf(expected_filename,"%stemp_checkpoint_convnet_expected.dat",
+            DEEPLEARN_TEMP_DIRECTORY);
+
+    fp = fopen(expected_filename,"wb");
+    assert(fp!=0);
+    assert(deepconvnet_save(fp, &convnet) == 0);
+    fclose(fp);
+
+    deeplearn_checkpoint_init(&checkpoint);
+    assert(deepconvnet_checkpoint_async(&checkpoint, &convnet,
+                                        filename) == 0);
+    assert(deeplearn_checkpoint_wait(&checkpoint) == 0);
+    assert(files_equal(filename, expected_filename));
+
+    deeplearn_checkpoint_free(&checkpoint);
+    deepconvnet_free(&convnet);
+
+    printf("Ok\n");
+}
+
+int run_tests_checkpoint()
+{
+    printf("\nRunning checkpoint tests\n");
+
+    test_checkpoint_deeplearn();
+    test_checkpoint_deepconvnet();
+
+    printf("All checkpoint tests completed\n");
+    return 0;
+}
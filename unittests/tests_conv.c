@@ -52,6 +52,91 @@ static void test_conv_init()
     printf("Ok\n");
 }
 
+static void test_conv_feed_forward_batch()
+{
+    int no_of_layers = 3;
+    int image_width = 32;
+    int image_height = 32;
+    int image_depth = 3;
+    int no_of_features = 4;
+    int feature_width = 6;
+    int final_image_width = 4;
+    int final_image_height = 4;
+    int no_of_images = 5;
+    unsigned char * images[5];
+    float * outputs, * planes;
+    unsigned int random_seed = 5291;
+    deeplearn_conv conv;
+    int i, l;
+
+    printf("test_conv_feed_forward_batch...");
+
+    assert(conv_init(no_of_layers,
+                     image_width, image_height, image_depth,
+                     no_of_features, feature_width,
+                     final_image_width, final_image_height,
+                     &conv) == 0);
+    conv.training = 0;
+
+    for (l = 0; l < no_of_layers; l++) {
+        for (i = 0; i < conv.layer[l].no_of_features*
+                 conv.layer[l].feature_width*conv.layer[l].feature_width*
+                 conv.layer[l].depth; i++)
+            conv.layer[l].feature[i] =
+                (rand_num(&random_seed)%10000)/10000.0f;
+    }
+
+    for (l = 0; l < no_of_images; l++) {
+        images[l] = (unsigned char*)malloc(image_width*image_height*
+                                           image_depth);
+        assert(images[l] != NULL);
+        for (i = 0; i < image_width*image_height*image_depth; i++)
+            images[l][i] = (unsigned char)(rand_num(&random_seed)%256);
+    }
+
+    outputs = (float*)malloc(no_of_images*conv.no_of_outputs*sizeof(float));
+    assert(outputs != NULL);
+    assert(conv_feed_forward_batch(&conv, images, no_of_images,
+                                   outputs) == 0);
+
+    /* the same as feeding forward one image at a time */
+    for (l = 0; l < no_of_images; l++) {
+        conv_feed_forward(images[l], &conv, no_of_layers);
+        for (i = 0; i < conv.no_of_outputs; i++)
+            assert(fabs(outputs[l*conv.no_of_outputs + i] -
+                        conv_get_output(&conv, i)) < 0.00001f);
+    }
+
+    /* or from images which were converted in advance */
+    planes = (float*)malloc(image_width*image_height*image_depth*
+                            sizeof(float));
+    assert(planes != NULL);
+    for (l = 0; l < no_of_images; l++) {
+        conv_image_to_planes(&conv, images[l], planes);
+        conv_feed_forward_planes(planes, &conv, no_of_layers);
+        for (i = 0; i < conv.no_of_outputs; i++)
+            assert(fabs(outputs[l*conv.no_of_outputs + i] -
+                        conv_get_output(&conv, i)) < 0.00001f);
+    }
+
+    /* noise added during training stays within range */
+    conv.training = 1;
+    conv_feed_forward_planes(planes, &conv, 0);
+    for (i = 0; i < image_width*image_height*image_depth; i++) {
+        assert(conv.layer[0].layer[i] >= 0.0f);
+        assert(conv.layer[0].layer[i] <= 1.0f);
+        assert(fabs(conv.layer[0].layer[i] - planes[i]) <= conv.noise);
+    }
+    free(planes);
+
+    for (l = 0; l < no_of_images; l++)
+        free(images[l]);
+    free(outputs);
+    conv_free(&conv);
+
+    printf("Ok\n");
+}
+
 static void test_conv_learn()
 {
     int no_of_layers = 3;
@@ -260,11 +345,120 @@ static void test_reconstruction_from_features()
     printf("Ok\n");
 }
 
+static void compare_conv_engines(int img_depth, int pooling_factor,
+                                 int activation)
+{
+    int img_width = 23, img_height = 19;
+    int feature_width = 5, no_of_features = 4;
+    int layer_width = 6;
+    int layer_size = layer_width*layer_width*no_of_features*img_depth;
+    float img[23*19*3];
+    float feature[5*5*4*3];
+    float layer_direct[6*6*4*3], layer[6*6*4*3];
+    unsigned int random_seed = 7823;
+    int i, engine, initial_engine = conv_get_engine();
+
+    for (i = 0; i < img_width*img_height*img_depth; i++)
+        img[i] = (rand_num(&random_seed)%10000)/10000.0f;
+    for (i = 0; i < feature_width*feature_width*no_of_features*img_depth; i++)
+        feature[i] = (rand_num(&random_seed)%10000)/10000.0f;
+
+    assert(conv_set_engine(CONV_ENGINE_DIRECT) == 0);
+    convolve_image(img, img_width, img_height, img_depth,
+                   feature_width, no_of_features, pooling_factor,
+                   feature, layer_direct, layer_width, activation);
+
+    for (engine = CONV_ENGINE_GEMM; engine <= CONV_ENGINE_SUMMED_AREA;
+         engine++) {
+        assert(conv_set_engine(engine) == 0);
+        convolve_image(img, img_width, img_height, img_depth,
+                       feature_width, no_of_features, pooling_factor,
+                       feature, layer, layer_width, activation);
+
+        for (i = 0; i < layer_size; i++)
+            assert(fabs(layer[i] - layer_direct[i]) < 0.0001f);
+    }
+
+    conv_set_engine(initial_engine);
+}
+
+static void test_conv_engines()
+{
+    printf("test_conv_engines...");
+
+    assert(conv_set_engine(-1) != 0);
+    assert(conv_set_engine(CONV_ENGINE_SUMMED_AREA+1) != 0);
+
+    compare_conv_engines(1, 1, AF_LINEAR);
+    compare_conv_engines(3, 1, AF_LINEAR);
+    compare_conv_engines(1, 2, AF_TANH);
+    compare_conv_engines(3, 3, AF_SIGMOID);
+
+    printf("Ok\n");
+}
+
+static void compare_deconv_engines(int img_depth, int layer_width,
+                                   int threads)
+{
+    int img_width = 23, img_height = 19;
+    int feature_width = 5, no_of_features = 4;
+    int layer_size = layer_width*layer_width*no_of_features*img_depth;
+    float img_direct[23*19*3], img[23*19*3];
+    float feature[5*5*4*3];
+    float layer[12*12*4*3];
+    unsigned int random_seed = 4172;
+    int i, initial_engine = conv_get_engine();
+    int initial_threads = deeplearn_get_threads();
+    int initial_threshold = deeplearn_get_parallel_threshold();
+
+    for (i = 0; i < layer_size; i++)
+        layer[i] = (rand_num(&random_seed)%10000)/10000.0f;
+    for (i = 0; i < feature_width*feature_width*no_of_features*img_depth; i++)
+        feature[i] = (rand_num(&random_seed)%10000)/10000.0f;
+
+    /* scattering patches is only safe on a single thread */
+    deeplearn_set_threads(1);
+    assert(conv_set_engine(CONV_ENGINE_DIRECT) == 0);
+    deconvolve_image(img_direct, img_width, img_height, img_depth,
+                     feature_width, no_of_features, feature,
+                     layer, layer_width);
+
+    /* gathering gives the same image, without write conflicts */
+    assert(deeplearn_set_threads(threads) == threads);
+    deeplearn_set_parallel_threshold(0);
+    assert(conv_set_engine(CONV_ENGINE_GEMM) == 0);
+    deconvolve_image(img, img_width, img_height, img_depth,
+                     feature_width, no_of_features, feature,
+                     layer, layer_width);
+
+    for (i = 0; i < img_width*img_height*img_depth; i++)
+        assert(fabs(img[i] - img_direct[i]) < 0.0001f);
+
+    conv_set_engine(initial_engine);
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+}
+
+static void test_deconv_engines()
+{
+    printf("test_deconv_engines...");
+
+    compare_deconv_engines(1, 6, 1);
+    compare_deconv_engines(3, 6, 1);
+    compare_deconv_engines(1, 12, 4);
+    compare_deconv_engines(3, 12, 4);
+
+    printf("Ok\n");
+}
+
 int run_tests_conv()
 {
     printf("\nRunning convolution tests\n");
 
     test_conv_init();
+    test_conv_engines();
+    test_deconv_engines();
+    test_conv_feed_forward_batch();
     test_conv_learn();
     test_reconstruction_from_features();
 
@@ -171,16 +171,10 @@ static void test_data_training_test()
     assert(learner.training_data_samples == 0);
     assert(learner.training_data_labeled_samples == 0);
     assert(learner.test_data_samples == 0);
-    assert(learner.indexed_training_data_samples == 0);
-    assert(learner.indexed_training_data_labeled_samples == 0);
-    assert(learner.indexed_test_data_samples == 0);
     assert(deeplearndata_create_datasets(&learner, 20) == 0);
     assert(learner.training_data_samples == 80);
     assert(learner.training_data_labeled_samples == 77);
     assert(learner.test_data_samples == 20);
-    assert(learner.indexed_training_data_samples == 80);
-    assert(learner.indexed_training_data_labeled_samples == 77);
-    assert(learner.indexed_test_data_samples == 20);
 
     /* check that all test samples are labeled */
     for (int i = 0; i < learner.test_data_samples; i++) {
@@ -221,12 +215,191 @@ static void test_data_training_test()
     printf("Ok\n");
 }
 
+static void test_data_epoch_sampler()
+{
+    deeplearn learner;
+    int no_of_inputs=4;
+    int no_of_hiddens=4;
+    int hidden_layers=2;
+    int no_of_outputs=2;
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f };
+    unsigned int random_seed = 123;
+    float inputs[4], outputs[2];
+    int visits[40];
+
+    printf("test_data_epoch_sampler...");
+
+    deeplearn_init(&learner,
+                   no_of_inputs, no_of_hiddens,
+                   hidden_layers,
+                   no_of_outputs,
+                   error_threshold,
+                   &random_seed);
+
+    for (int i = 0; i < 50; i++) {
+        for (int j = 0; j < no_of_inputs; j++)
+            inputs[j] = i + j;
+        for (int j = 0; j < no_of_outputs; j++)
+            outputs[j] = j;
+        assert(deeplearndata_add(&learner.data,
+                                 &learner.data_samples,
+                                 inputs, 0, outputs,
+                                 no_of_inputs, no_of_outputs,
+                                 learner.input_range_min,
+                                 learner.input_range_max,
+                                 learner.output_range_min,
+                                 learner.output_range_max) == 0);
+    }
+    assert(deeplearndata_index_data(
+            learner.data,
+            learner.data_samples,
+            &learner.indexed_data,
+            &learner.indexed_data_samples) == 0);
+    assert(deeplearndata_create_datasets(&learner, 20) == 0);
+    assert(learner.training_data_samples == 40);
+
+    /* one epoch of pretraining visits every training sample once */
+    for (int i = 0; i < learner.training_data_samples; i++)
+        assert(deeplearndata_training(&learner) == 1);
+    assert(learner.sampler_epoch == 1);
+    assert(learner.sampler_samples == 40);
+    assert(learner.sampler_position == 40);
+
+    memset((void*)visits, '\0', 40*sizeof(int));
+    for (int i = 0; i < learner.sampler_samples; i++)
+        visits[learner.sampler_order[i]]++;
+    for (int i = 0; i < 40; i++)
+        assert(visits[i] == 1);
+
+    /* the next step begins a new epoch */
+    assert(deeplearndata_training(&learner) == 1);
+    assert(learner.sampler_epoch == 2);
+    assert(learner.sampler_position == 1);
+
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+static void test_data_shared_dataset()
+{
+    deeplearn learners[4], serial[2];
+    deeplearn wrong;
+    deeplearn_dataset * dataset;
+    int no_of_inputs, no_of_outputs;
+    int output_field_index[] = { 2 };
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f };
+    unsigned int random_seed = 826;
+    char * csv_filename = "/tmp/libdeep_shared.csv";
+    FILE * fp;
+
+    printf("test_data_shared_dataset...");
+
+    fp = fopen(csv_filename, "w");
+    assert(fp);
+    for (int i = 0; i < 50; i++)
+        fprintf(fp, "%f,%f,%f\n", (i%7)*0.1f, (i%5)*0.2f, (float)(i%2));
+    fclose(fp);
+
+    assert(deeplearndata_read_csv(csv_filename, &learners[0], 8, 2, 1,
+                                  output_field_index, 0,
+                                  error_threshold, &random_seed) == 50);
+    no_of_inputs = learners[0].net->no_of_inputs;
+    no_of_outputs = learners[0].net->no_of_outputs;
+
+    dataset = deeplearn_dataset_share(&learners[0]);
+    assert(dataset);
+    assert(dataset->references == 1);
+    assert(deeplearn_dataset_share(&learners[0]) == dataset);
+    assert(dataset->training_data_samples == 40);
+
+    /* the network must fit the samples */
+    assert(deeplearn_init(&wrong, no_of_inputs+1, 8, 2, no_of_outputs,
+                          error_threshold, &random_seed) == 0);
+    assert(deeplearn_dataset_attach(&wrong, dataset) == -1);
+    deeplearn_free(&wrong);
+    assert(dataset->references == 1);
+
+    /* models of different sizes on one copy of the data */
+    for (int n = 1; n < 4; n++) {
+        random_seed = 826 + n;
+        assert(deeplearn_init(&learners[n], no_of_inputs, 4*n, 2,
+                              no_of_outputs, error_threshold,
+                              &random_seed) == 0);
+        assert(deeplearn_dataset_attach(&learners[n], dataset) == 0);
+        assert(learners[n].data == learners[0].data);
+        assert(learners[n].indexed_data == learners[0].indexed_data);
+        assert(learners[n].training_data == learners[0].training_data);
+        assert(learners[n].test_data == learners[0].test_data);
+        assert(learners[n].no_of_input_fields ==
+               learners[0].no_of_input_fields);
+        for (int i = 0; i < no_of_inputs; i++)
+            assert(learners[n].input_range_max[i] ==
+                   learners[0].input_range_max[i]);
+    }
+    assert(dataset->references == 4);
+
+    /* the shared sets cannot be changed */
+    assert(deeplearndata_create_datasets(&learners[1], 20) == -2);
+    assert(deeplearndata_add_training_sample(&learners[1], 0) == -4);
+    assert(learners[1].training_data_samples == 40);
+
+    /* the same models trained one after another */
+    for (int n = 0; n < 2; n++) {
+        random_seed = 827 + n;
+        assert(deeplearn_init(&serial[n], no_of_inputs, 4*(n+1), 2,
+                              no_of_outputs, error_threshold,
+                              &random_seed) == 0);
+        assert(deeplearn_dataset_attach(&serial[n], dataset) == 0);
+        deeplearn_set_plotting(&serial[n], DEEPLEARN_PLOT_NONE);
+        for (int step = 0; step < 100; step++)
+            assert(deeplearndata_training(&serial[n]) > 0);
+    }
+    assert(dataset->references == 6);
+
+    for (int n = 0; n < 4; n++)
+        deeplearn_set_plotting(&learners[n], DEEPLEARN_PLOT_NONE);
+    assert(deeplearn_dataset_sweep(learners, 4, 1, 100) >= 0);
+
+    /* training concurrently gives the same models */
+    for (int n = 0; n < 2; n++) {
+        bp * net1 = learners[n+1].net;
+        bp * net2 = serial[n].net;
+
+        assert(net1->itterations == net2->itterations);
+        for (int i = 0; i < HIDDENS_IN_LAYER(net1,0)*no_of_inputs; i++)
+            assert(fabs(net1->layers[0].weights[i] -
+                        net2->layers[0].weights[i]) < 0.00001f);
+        for (int i = 0; i < learners[n+1].autocoder[0]->no_of_inputs*
+                 learners[n+1].autocoder[0]->no_of_hiddens; i++)
+            assert(fabs(learners[n+1].autocoder[0]->weights[i] -
+                        serial[n].autocoder[0]->weights[i]) < 0.00001f);
+    }
+
+    /* mini-batches */
+    assert(deeplearn_dataset_sweep(learners, 4, 8, 10) >= 0);
+
+    /* the dataset remains while any learner uses it */
+    deeplearn_free(&learners[0]);
+    assert(dataset->references == 5);
+    assert(deeplearndata_training(&learners[1]) > 0);
+
+    deeplearn_free(&serial[0]);
+    deeplearn_free(&serial[1]);
+    for (int n = 1; n < 4; n++)
+        deeplearn_free(&learners[n]);
+
+    printf("Ok\n");
+}
+
 int run_tests_data()
 {
     printf("\nRunning data tests\n");
 
     test_data_add();
     test_data_training_test();
+    test_data_epoch_sampler();
+    test_data_shared_dataset();
 
     printf("All data tests completed\n");
     return 0;
@@ -40,6 +40,7 @@
 #include "backprop.h"
 #include "deeplearn.h"
 #include "deeplearndata.h"
+#include "deeplearn_dataset.h"
 
 int run_tests_data();
 
@@ -66,6 +66,213 @@ static void test_deepconvnet_init()
                             error_threshold,
                             &random_seed) == 0);
 
+    /* augmentation uses a single scratch image */
+    assert(convnet.augmented_image == NULL);
+    assert(deepconvnet_set_augmentation(&convnet, 1) == 0);
+    assert(convnet.augmented_image != NULL);
+    assert(deepconvnet_set_augmentation(&convnet, 0) == 0);
+    assert(convnet.augmented_image == NULL);
+    assert(deepconvnet_set_augmentation(&convnet, 1) == 0);
+
+    deepconvnet_free(&convnet);
+    assert(convnet.augmented_image == NULL);
+
+    printf("Ok\n");
+}
+
+/* gives a convnet random features, as if the convolution layers had
+   already been trained, together with a set of random images */
+static void set_trained_images(deepconvnet * convnet, int no_of_images,
+                               unsigned int * random_seed)
+{
+    deeplearn_conv * conv = convnet->convolution;
+    int image_size =
+        conv->layer[0].width*conv->layer[0].height*conv->layer[0].depth;
+    int no_of_outputs = convnet->learner->net->no_of_outputs;
+    int i, l;
+
+    for (l = 0; l < conv->no_of_layers; l++)
+        for (i = 0; i < conv->layer[l].no_of_features*
+                 conv->layer[l].feature_width*
+                 conv->layer[l].feature_width*conv->layer[l].depth; i++)
+            conv->layer[l].feature[i] =
+                (rand_num(random_seed)%10000)/10000.0f;
+    conv->current_layer = conv->no_of_layers;
+
+    convnet->no_of_images = no_of_images;
+    convnet->images =
+        (unsigned char**)malloc(no_of_images*sizeof(unsigned char*));
+    convnet->classifications =
+        (char**)malloc(no_of_images*sizeof(char*));
+    convnet->classification_number =
+        (int*)malloc(no_of_images*sizeof(int));
+    assert(convnet->images != NULL);
+    assert(convnet->classifications != NULL);
+    assert(convnet->classification_number != NULL);
+    for (l = 0; l < no_of_images; l++) {
+        convnet->images[l] = (unsigned char*)malloc(image_size);
+        assert(convnet->images[l] != NULL);
+        for (i = 0; i < image_size; i++)
+            convnet->images[l][i] =
+                (unsigned char)(rand_num(random_seed)%256);
+        convnet->classifications[l] = (char*)malloc(2);
+        assert(convnet->classifications[l] != NULL);
+        sprintf(convnet->classifications[l], "%d", l%no_of_outputs);
+        convnet->classification_number[l] = l%no_of_outputs;
+    }
+    convnet->training_set_index = (int*)malloc(no_of_images*sizeof(int));
+    assert(convnet->training_set_index != NULL);
+    for (l = 0; l < no_of_images; l++)
+        convnet->training_set_index[l] = no_of_images - 1 - l;
+}
+
+static void test_deepconvnet_output_cache()
+{
+    int no_of_convolutions = 2;
+    int image_width = 32;
+    int image_height = 32;
+    int image_depth = 1;
+    int max_features = 4;
+    int feature_width = 4;
+    int final_image_width = 4;
+    int final_image_height = 4;
+    float error_threshold[] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    unsigned int random_seed = 7284;
+    unsigned int layer_itterations = 1000;
+    int no_of_deep_layers = 2;
+    int no_of_outputs = 2;
+    int no_of_images = 10;
+    char * filenames[] = { NULL, "/tmp/libdeep_output_cache.dat" };
+    deepconvnet convnet;
+    deeplearn_conv * conv;
+    float * outputs;
+    unsigned int seed;
+    int i, l, mode;
+    FILE * fp;
+
+    printf("test_deepconvnet_output_cache...");
+
+    for (mode = 0; mode < 2; mode++) {
+        assert(deepconvnet_init(no_of_convolutions,
+                                no_of_deep_layers,
+                                image_width,
+                                image_height,
+                                image_depth,
+                                max_features,
+                                feature_width,
+                                final_image_width,
+                                final_image_height,
+                                layer_itterations,
+                                no_of_outputs,
+                                &convnet,
+                                error_threshold,
+                                &random_seed) == 0);
+        set_trained_images(&convnet, no_of_images, &random_seed);
+        conv = convnet.convolution;
+
+        assert(deepconvnet_set_output_cache(&convnet, 1,
+                                            filenames[mode]) == 0);
+        assert(convnet.output_cache == NULL);
+        assert(deepconvnet_training(&convnet) == 0);
+        assert(convnet.output_cache != NULL);
+        assert(convnet.output_cache_valid != 0);
+        if (filenames[mode] != NULL) {
+            fp = fopen(filenames[mode], "rb");
+            assert(fp != NULL);
+            fclose(fp);
+        }
+
+        /* the cache holds the outputs of the convolution layers */
+        outputs = (float*)malloc(no_of_images*conv->no_of_outputs*
+                                 sizeof(float));
+        assert(outputs != NULL);
+        assert(conv_feed_forward_batch(conv, convnet.images, no_of_images,
+                                       outputs) == 0);
+        for (i = 0; i < no_of_images*conv->no_of_outputs; i++)
+            assert(fabs(convnet.output_cache[i] - outputs[i]) < 0.00001f);
+
+        /* changing the features invalidates the cache */
+        for (i = 0; i < conv->layer[0].no_of_features*
+                 conv->layer[0].feature_width*
+                 conv->layer[0].feature_width*conv->layer[0].depth; i++)
+            conv->layer[0].feature[i] =
+                (rand_num(&random_seed)%10000)/10000.0f;
+        conv->feature_updates++;
+        assert(deepconvnet_training(&convnet) == 0);
+        assert(convnet.output_cache_feature_updates == conv->feature_updates);
+        assert(conv_feed_forward_batch(conv, convnet.images, no_of_images,
+                                       outputs) == 0);
+        for (i = 0; i < no_of_images*conv->no_of_outputs; i++)
+            assert(fabs(convnet.output_cache[i] - outputs[i]) < 0.00001f);
+
+        /* the deep learner is given the cached outputs */
+        seed = convnet.learner->net->random_seed;
+        l = convnet.training_set_index[rand_num(&seed)%
+                                       (no_of_images*8/10)];
+        assert(deepconvnet_training(&convnet) == 0);
+        for (i = 0; i < conv->no_of_outputs; i++)
+            assert(convnet.learner->net->inputs[i]->value ==
+                   convnet.output_cache[l*conv->no_of_outputs + i]);
+        free(outputs);
+        deepconvnet_free(&convnet);
+
+        /* the cache file is removed */
+        if (filenames[mode] != NULL) {
+            fp = fopen(filenames[mode], "rb");
+            assert(fp == NULL);
+        }
+    }
+
+    printf("Ok\n");
+}
+
+static void test_deepconvnet_workers()
+{
+    float error_threshold[] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    unsigned int random_seed = 9316;
+    deepconvnet convnet;
+    unsigned int itterations, history_itterations;
+    int i, initial_threads, initial_threshold;
+
+    printf("test_deepconvnet_workers...");
+
+    assert(deepconvnet_init(2, 2, 32, 32, 1, 4, 4, 4, 4, 1000, 2,
+                            &convnet, error_threshold,
+                            &random_seed) == 0);
+    set_trained_images(&convnet, 20, &random_seed);
+
+    /* the autocoders are also trained */
+    convnet.learner->current_hidden_layer =
+        convnet.learner->net->hidden_layers;
+
+    assert(convnet.no_of_workers == 1);
+    assert(deepconvnet_set_workers(&convnet, 0) == -1);
+    assert(deepconvnet_set_workers(&convnet, 4) == 0);
+    assert(convnet.no_of_workers == 4);
+    assert(convnet.workers != NULL);
+
+    initial_threads = deeplearn_get_threads();
+    initial_threshold = deeplearn_get_parallel_threshold();
+    assert(deeplearn_set_threads(4) == 4);
+    deeplearn_set_parallel_threshold(0);
+
+    /* each step trains every worker on a number of images */
+    itterations = convnet.learner->net->itterations;
+    history_itterations = convnet.learner->history.itterations;
+    for (i = 0; i < 10; i++)
+        assert(deepconvnet_training(&convnet) == 0);
+    assert(convnet.learner->net->itterations >=
+           itterations + 10*4*DEEPLEARN_HOGWILD_SAMPLES);
+    assert(convnet.learner->history.itterations > history_itterations);
+    assert(convnet.learner->backprop_error != DEEPLEARN_UNKNOWN_ERROR);
+
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+
+    /* back to a single image at a time */
+    assert(deepconvnet_set_workers(&convnet, 1) == 0);
+    assert(convnet.workers == NULL);
+    assert(deepconvnet_training(&convnet) == 0);
 
     deepconvnet_free(&convnet);
 
@@ -77,6 +284,8 @@ int run_tests_deepconvnet()
     printf("\nRunning deepconvnet tests\n");
 
     test_deepconvnet_init();
+    test_deepconvnet_output_cache();
+    test_deepconvnet_workers();
 
     printf("All deepconvnet tests completed\n");
     return 0;
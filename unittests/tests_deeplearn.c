@@ -70,6 +70,18 @@ static void test_deeplearn_init()
     assert((&learner)->autocoder[1]->no_of_inputs==no_of_hiddens);
     assert((&learner)->autocoder[1]->no_of_hiddens==9);
 
+    /* the network and autocoders share the arena of the learner */
+    assert(learner.arena.used == learner.arena.size);
+    assert(learner.net->arena.memory == 0);
+    COUNTUP(i, hidden_layers) {
+        unsigned char * weights =
+            (unsigned char*)learner.autocoder[i]->weights;
+
+        assert(learner.autocoder[i]->arena.memory == 0);
+        assert(weights > learner.arena.block);
+        assert(weights < learner.arena.block + learner.arena.size);
+    }
+
     /* free memory */
     deeplearn_free(&learner);
 
@@ -78,7 +90,7 @@ static void test_deeplearn_init()
 
 static void test_deeplearn_update()
 {
-    deeplearn learner, learner2;
+    deeplearn learner, learner2, learner3;
     int no_of_inputs=10;
     int no_of_hiddens=4;
     int hidden_layers=2;
@@ -195,6 +207,18 @@ static void test_deeplearn_update()
     }
     assert(retval==1);
 
+    /* a learner saved before the format had a version starts with
+       whether training was complete, and is rejected */
+    fp = fopen(filename,"wb");
+    assert(fp!=0);
+    assert(INTWRITE(learner.training_complete) != 0);
+    assert(INTWRITE(learner.current_hidden_layer) != 0);
+    fclose(fp);
+    fp = fopen(filename,"rb");
+    assert(fp!=0);
+    assert(deeplearn_load(fp, &learner3) == -26);
+    fclose(fp);
+
     /* save a graph */
     sprintf(&learner.history.filename[0], "%stemp_graph.png",
             DEEPLEARN_TEMP_DIRECTORY);
@@ -261,6 +285,10 @@ static void test_deeplearn_export()
 {
     char * filename1 = "/tmp/libdeep_export.c";
     char * filename2 = "/tmp/libdeep_export.py";
+    char * filename3 = "/tmp/libdeep_export_int8.c";
+    char * filename4 = "/tmp/libdeep_export_int8_arduino.c";
+    char * filename5 = "/tmp/libdeep_export_numpy.py";
+    char line[256];
     deeplearn learner;
     int no_of_inputs=10;
     int no_of_hiddens=4;
@@ -269,6 +297,7 @@ static void test_deeplearn_export()
     float error_threshold[] = { 0.01f, 0.01f, 0.01f };
     unsigned int random_seed = 123;
     FILE * fp;
+    int progmem;
 
     printf("test_deeplearn_export...");
 
@@ -293,6 +322,35 @@ static void test_deeplearn_export()
     assert(fp);
     fclose(fp);
 
+    /* quantized C and Arduino programs */
+    assert(deeplearn_export_int8(&learner, filename3) == 0);
+    fp = fopen(filename3,"r");
+    assert(fp);
+    assert(fgets(line, 255, fp) != 0);
+    assert(strstr(line, "#include <stdio.h>") != 0);
+    fclose(fp);
+
+    assert(deeplearn_export_int8(&learner, filename4) == 0);
+    fp = fopen(filename4,"r");
+    assert(fp);
+    assert(fgets(line, 255, fp) != 0);
+    assert(strstr(line, "#include <stdint.h>") != 0);
+    /* weights should be placed in program memory */
+    progmem = 0;
+    while (fgets(line, 255, fp) != 0)
+        if (strstr(line, "_weights[") && strstr(line, "PROGMEM"))
+            progmem = 1;
+    assert(progmem == 1);
+    fclose(fp);
+
+    /* vectorised python */
+    assert(deeplearn_export_numpy(&learner, filename5) == 0);
+    fp = fopen(filename5,"r");
+    assert(fp);
+    assert(fgets(line, 255, fp) != 0);
+    assert(strstr(line, "#!/usr/bin/python3") != 0);
+    fclose(fp);
+
     /* free memory */
     deeplearn_free(&learner);
 
@@ -311,6 +369,8 @@ static void test_deeplearn_csv_with_text()
     char * csv_filename = "/tmp/libdeep.csv";
     char * export_filename1 = "/tmp/libdeep_text.c";
     char * export_filename2 = "/tmp/libdeep_text.py";
+    char * export_filename3 = "/tmp/libdeep_text_int8.c";
+    char * export_filename4 = "/tmp/libdeep_text_numpy.py";
     FILE * fp;
 
     printf("test_deeplearn_csv_with_text...");
@@ -338,11 +398,8 @@ static void test_deeplearn_csv_with_text()
                            &random_seed);
 
     assert(learner.training_data_samples == 6);
-    assert(learner.indexed_training_data_samples == 6);
     assert(learner.training_data_labeled_samples == 6);
-    assert(learner.indexed_training_data_labeled_samples == 6);
     assert(learner.test_data_samples == 2);
-    assert(learner.indexed_test_data_samples == 2);
     assert(learner.net->no_of_inputs == 2 + (5*CHAR_BITS));
     assert(learner.no_of_input_fields == 3);
 
@@ -361,6 +418,16 @@ static void test_deeplearn_csv_with_text()
     assert(fp);
     fclose(fp);
 
+    assert(deeplearn_export_int8(&learner, export_filename3) == 0);
+    fp = fopen(export_filename3,"r");
+    assert(fp);
+    fclose(fp);
+
+    assert(deeplearn_export_numpy(&learner, export_filename4) == 0);
+    fp = fopen(export_filename4,"r");
+    assert(fp);
+    fclose(fp);
+
     /* free memory */
     deeplearn_free(&learner);
 
@@ -404,11 +471,8 @@ static void test_deeplearn_csv_numeric()
                            &random_seed);
 
     assert(learner.training_data_samples == 6);
-    assert(learner.indexed_training_data_samples == 6);
     assert(learner.training_data_labeled_samples == 6);
-    assert(learner.indexed_training_data_labeled_samples == 6);
     assert(learner.test_data_samples == 2);
-    assert(learner.indexed_test_data_samples == 2);
     assert(learner.net->no_of_inputs == 3);
     assert(learner.no_of_input_fields == 3);
 
@@ -423,6 +487,881 @@ static void test_deeplearn_csv_numeric()
     printf("Ok\n");
 }
 
+static void test_deeplearn_csv_long_lines()
+{
+    deeplearn learner;
+    int no_of_hiddens=4;
+    int hidden_layers=1;
+    int no_of_outputs = 1;
+    int no_of_fields = 300;
+    int output_field_index[] = { 300 };
+    float error_threshold_percent[] = { 10.0f, 10.0f, 10.0f };
+    unsigned int random_seed = 123;
+    char * csv_filename = "/tmp/libdeep_long.csv";
+    FILE * fp;
+    int row, field;
+
+    printf("test_deeplearn_csv_long_lines...");
+
+    /* create a csv file with lines longer than a typical line buffer,
+       windows line endings and no newline on the last line */
+    fp = fopen(csv_filename,"w");
+    assert(fp);
+    fprintf(fp,"# comment\r\n");
+    for (row = 0; row < 10; row++) {
+        for (field = 0; field < no_of_fields; field++) {
+            if ((row == 3) && (field == 1))
+                fprintf(fp,"?,");
+            else
+                fprintf(fp,"%f;",1000.0f + row + (field*0.001f));
+        }
+        fprintf(fp,"%d", row);
+        if (row < 9)
+            fprintf(fp,"\r\n");
+    }
+    fclose(fp);
+
+    /* load the data */
+    assert(deeplearndata_read_csv(csv_filename,
+                                  &learner,
+                                  no_of_hiddens, hidden_layers,
+                                  no_of_outputs,
+                                  output_field_index, 0,
+                                  error_threshold_percent,
+                                  &random_seed) == 10);
+
+    assert(learner.no_of_input_fields == no_of_fields);
+    assert(learner.net->no_of_inputs == no_of_fields);
+    assert(learner.training_data_samples + learner.test_data_samples == 10);
+
+    /* ranges are collected while reading */
+    assert(fabs(learner.input_range_min[0] - 1000.0f) < 0.01f);
+    assert(fabs(learner.input_range_max[0] - 1009.0f) < 0.01f);
+    assert(fabs(learner.input_range_min[1]) < 0.01f);
+    assert(fabs(learner.input_range_max[299] - 1009.299f) < 0.01f);
+    assert(fabs(learner.output_range_min[0]) < 0.01f);
+    assert(fabs(learner.output_range_max[0] - 9.0f) < 0.01f);
+
+    /* free memory */
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+static void test_deeplearn_binary_data()
+{
+    deeplearn learner, opened;
+    int no_of_hiddens=4;
+    int hidden_layers=1;
+    int no_of_outputs = 1;
+    int output_field_index[] = { 3 };
+    float error_threshold_percent[] = { 10.0f, 10.0f, 10.0f };
+    unsigned int random_seed = 123;
+    char * csv_filename = "/tmp/libdeep_binary.csv";
+    char * binary_filename = "/tmp/libdeep_binary.dat";
+    deeplearndata * sample, * opened_sample;
+    FILE * fp;
+    int i, j;
+
+    printf("test_deeplearn_binary_data...");
+
+    /* create a csv file with a text field */
+    fp = fopen(csv_filename,"w");
+    assert(fp);
+    for (i = 0; i < 30; i++)
+        fprintf(fp,"%f,%s,%f,%f\n", i*0.3f, (i%3 == 0) ? "one" : "three",
+                60.0f - i, (float)(i%4));
+    fclose(fp);
+
+    assert(deeplearndata_read_csv(csv_filename,
+                                  &learner,
+                                  no_of_hiddens, hidden_layers,
+                                  no_of_outputs,
+                                  output_field_index, 0,
+                                  error_threshold_percent,
+                                  &random_seed) == 30);
+    assert(deeplearndata_save_binary(&learner, binary_filename) == 0);
+
+    assert(deeplearndata_open_binary(binary_filename, &opened,
+                                     no_of_hiddens, hidden_layers,
+                                     error_threshold_percent,
+                                     &random_seed) == 30);
+    assert(opened.data_map != 0);
+    assert(opened.net->no_of_inputs == learner.net->no_of_inputs);
+    assert(opened.net->no_of_outputs == learner.net->no_of_outputs);
+    assert(opened.no_of_input_fields == learner.no_of_input_fields);
+    assert(opened.training_data_samples == learner.training_data_samples);
+    assert(opened.training_data_labeled_samples ==
+           learner.training_data_labeled_samples);
+    assert(opened.test_data_samples == learner.test_data_samples);
+
+    for (i = 0; i < learner.no_of_input_fields; i++) {
+        assert(opened.field_length[i] == learner.field_length[i]);
+        assert(opened.input_range_min[i] == learner.input_range_min[i]);
+        assert(opened.input_range_max[i] == learner.input_range_max[i]);
+    }
+    assert(opened.output_range_min[0] == learner.output_range_min[0]);
+    assert(opened.output_range_max[0] == learner.output_range_max[0]);
+
+    /* the same samples are in the same sets */
+    for (i = 0; i < learner.training_data_samples; i++) {
+        sample = deeplearndata_get_training(&learner, i);
+        opened_sample = deeplearndata_get_training(&opened, i);
+        assert(sample != 0);
+        assert(opened_sample != 0);
+        for (j = 0; j < learner.no_of_input_fields; j++) {
+            assert(opened_sample->inputs[j] == sample->inputs[j]);
+            if (sample->inputs_text[j] != 0)
+                assert(strcmp(opened_sample->inputs_text[j],
+                              sample->inputs_text[j]) == 0);
+            else
+                assert(opened_sample->inputs_text[j] == 0);
+        }
+        assert(opened_sample->outputs[0] == sample->outputs[0]);
+    }
+    for (i = 0; i < learner.test_data_samples; i++) {
+        sample = deeplearndata_get_test(&learner, i);
+        opened_sample = deeplearndata_get_test(&opened, i);
+        assert(opened_sample->inputs[0] == sample->inputs[0]);
+        assert(opened_sample->outputs[0] == sample->outputs[0]);
+    }
+
+    /* the opened data can be trained upon */
+    for (i = 0; i < 10; i++)
+        assert(deeplearndata_training(&opened) >= 0);
+    assert(deeplearndata_get_performance(&opened) >= 0);
+
+    /* free memory */
+    deeplearn_free(&learner);
+    deeplearn_free(&opened);
+
+    /* text which runs off the end of the pool is rejected */
+    fp = fopen(binary_filename,"r+b");
+    assert(fp);
+    fseek(fp, -1, SEEK_END);
+    fputc('x', fp);
+    fclose(fp);
+    assert(deeplearndata_open_binary(binary_filename, &opened,
+                                     no_of_hiddens, hidden_layers,
+                                     error_threshold_percent,
+                                     &random_seed) == -7);
+
+    /* as is a negative length of pool */
+    i = -1;
+    fp = fopen(binary_filename,"r+b");
+    assert(fp);
+    fseek(fp, 9*sizeof(int), SEEK_SET);
+    assert(fwrite(&i, sizeof(int), 1, fp) == 1);
+    fclose(fp);
+    assert(deeplearndata_open_binary(binary_filename, &opened,
+                                     no_of_hiddens, hidden_layers,
+                                     error_threshold_percent,
+                                     &random_seed) == -4);
+
+    printf("Ok\n");
+}
+
+static void test_deeplearn_encode()
+{
+    deeplearn learner;
+    int no_of_hiddens=4;
+    int hidden_layers=1;
+    int no_of_outputs = 1;
+    int output_field_index[] = { 3 };
+    float error_threshold_percent[] = { 10.0f, 10.0f, 10.0f };
+    unsigned int random_seed = 123;
+    char * csv_filename = "/tmp/libdeep_encode.csv";
+    float inputs[128], outputs[1];
+    deeplearndata * sample;
+    FILE * fp;
+    int i, j;
+
+    printf("test_deeplearn_encode...");
+
+    fp = fopen(csv_filename,"w");
+    assert(fp);
+    for (i = 0; i < 20; i++)
+        fprintf(fp,"%f,%s,%f,%f\n", i*0.3f, (i%2 == 0) ? "ab" : "abcd",
+                5.0f, (float)(i%4));
+    fclose(fp);
+
+    assert(deeplearndata_read_csv(csv_filename,
+                                  &learner,
+                                  no_of_hiddens, hidden_layers,
+                                  no_of_outputs,
+                                  output_field_index, 0,
+                                  error_threshold_percent,
+                                  &random_seed) == 20);
+    assert(learner.net->no_of_inputs <= 128);
+
+    /* encoding gives the values that setting the network would */
+    for (i = 0; i < learner.data_samples; i++) {
+        sample = deeplearndata_get(&learner, i);
+        deeplearn_encode_inputs(&learner, sample, inputs);
+        deeplearn_encode_outputs(&learner, sample, outputs);
+        deeplearn_set_inputs(&learner, sample);
+        deeplearn_set_outputs(&learner, sample);
+        for (j = 0; j < learner.net->no_of_inputs; j++)
+            assert(inputs[j] == bp_get_input(learner.net, j));
+        assert(outputs[0] == bp_get_desired(learner.net, 0));
+    }
+
+    /* text fields are encoded once when loaded, giving the same
+       values as encoding the text each time */
+    for (i = 0; i < learner.data_samples; i++) {
+        float * encoded;
+
+        sample = deeplearndata_get(&learner, i);
+        assert(sample->inputs_encoded != 0);
+        deeplearn_set_inputs(&learner, sample);
+        for (j = 0; j < learner.net->no_of_inputs; j++)
+            inputs[j] = bp_get_input(learner.net, j);
+
+        encoded = sample->inputs_encoded;
+        sample->inputs_encoded = 0;
+        deeplearn_set_inputs(&learner, sample);
+        sample->inputs_encoded = encoded;
+        for (j = 0; j < learner.net->no_of_inputs; j++)
+            assert(inputs[j] == bp_get_input(learner.net, j));
+    }
+
+    /* free memory */
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+static void test_deeplearn_performance_threads()
+{
+    deeplearn learner;
+    int no_of_hiddens=8;
+    int hidden_layers=2;
+    int no_of_outputs = 1;
+    int output_field_index[] = { 3 };
+    float error_threshold_percent[] = { 10.0f, 10.0f, 10.0f };
+    unsigned int random_seed = 123;
+    char * csv_filename = "/tmp/libdeep_performance.csv";
+    int initial_threads = deeplearn_get_threads();
+    int initial_threshold = deeplearn_get_parallel_threshold();
+    float serial, parallel, expected, total_error = 0;
+    float outputs[1];
+    int hits = 0;
+    FILE * fp;
+    int i;
+
+    printf("test_deeplearn_performance_threads...");
+
+    fp = fopen(csv_filename,"w");
+    assert(fp);
+    for (i = 0; i < 200; i++)
+        fprintf(fp,"%f,%f,%f,%f\n", (i%7)*0.5f, (i%11)*0.2f,
+                60.0f + (i%5), 1.0f + (i%3));
+    fclose(fp);
+
+    assert(deeplearndata_read_csv(csv_filename,
+                                  &learner,
+                                  no_of_hiddens, hidden_layers,
+                                  no_of_outputs,
+                                  output_field_index, 0,
+                                  error_threshold_percent,
+                                  &random_seed) == 200);
+    for (i = 0; i < 200; i++)
+        deeplearndata_training(&learner);
+
+    /* reference evaluated one sample at a time through the network */
+    for (i = 0; i < learner.test_data_samples; i++) {
+        deeplearndata * sample = deeplearndata_get_test(&learner, i);
+        deeplearn_set_inputs(&learner, sample);
+        deeplearn_feed_forward(&learner);
+        deeplearn_get_outputs(&learner, outputs);
+        total_error += ((sample->outputs[0] - outputs[0])/sample->outputs[0])*
+            ((sample->outputs[0] - outputs[0])/sample->outputs[0]);
+        hits++;
+    }
+    expected = 100 - (float)sqrt(total_error / hits)*100;
+
+    assert(deeplearn_set_threads(1) == 1);
+    serial = deeplearndata_get_performance(&learner);
+    assert(fabs(serial - expected) < 0.01f);
+
+    /* the same result regardless of the number of threads */
+    assert(deeplearn_set_threads(4) == 4);
+    deeplearn_set_parallel_threshold(0);
+    parallel = deeplearndata_get_performance(&learner);
+    assert(parallel == serial);
+
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+
+    /* free memory */
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+static void test_deeplearn_binary_stream()
+{
+    deeplearn learner, streamed;
+    deeplearndata_stream stream;
+    int no_of_hiddens=4;
+    int hidden_layers=2;
+    int no_of_outputs = 1;
+    int output_field_index[] = { 3 };
+    float error_threshold_percent[] = { 10.0f, 10.0f, 10.0f };
+    unsigned int random_seed = 123;
+    char * csv_filename = "/tmp/libdeep_stream.csv";
+    char * binary_filename = "/tmp/libdeep_stream.dat";
+    float total = 0, streamed_total = 0;
+    FILE * fp;
+    int i, training_samples;
+
+    printf("test_deeplearn_binary_stream...");
+
+    fp = fopen(csv_filename,"w");
+    assert(fp);
+    for (i = 0; i < 100; i++)
+        fprintf(fp,"%f,%f,%f,%f\n", i*0.3f, (i%9)*0.1f,
+                60.0f - i, (float)(1 + i%4));
+    fclose(fp);
+
+    assert(deeplearndata_read_csv(csv_filename,
+                                  &learner,
+                                  no_of_hiddens, hidden_layers,
+                                  no_of_outputs,
+                                  output_field_index, 0,
+                                  error_threshold_percent,
+                                  &random_seed) == 100);
+    assert(deeplearndata_save_binary(&learner, binary_filename) == 0);
+
+    /* only the test set is held in memory */
+    assert(deeplearndata_open_binary_stream(binary_filename, &streamed,
+                                            no_of_hiddens, hidden_layers,
+                                            error_threshold_percent,
+                                            &random_seed, &stream) ==
+           learner.test_data_samples);
+    assert(streamed.data_samples == learner.test_data_samples);
+    assert(streamed.test_data_samples == learner.test_data_samples);
+    assert(streamed.training_data_samples == 0);
+    assert(streamed.net->no_of_inputs == learner.net->no_of_inputs);
+    for (i = 0; i < learner.no_of_input_fields; i++) {
+        assert(streamed.input_range_min[i] == learner.input_range_min[i]);
+        assert(streamed.input_range_max[i] == learner.input_range_max[i]);
+    }
+
+    for (i = 0; i < learner.test_data_samples; i++) {
+        total += deeplearndata_get_test(&learner, i)->inputs[0];
+        streamed_total += deeplearndata_get_test(&streamed, i)->inputs[0];
+    }
+    assert(fabs(total - streamed_total) < 0.001f);
+
+    /* each pass through the file visits every training sample once */
+    training_samples = 100 - learner.test_data_samples;
+    for (i = 0; i < training_samples; i++)
+        assert(deeplearndata_training_stream(&streamed, &stream) == 1);
+    assert(stream.passes == 0);
+    assert(stream.count == 0);
+    assert(deeplearndata_training_stream(&streamed, &stream) == 1);
+    assert(stream.passes == 1);
+    assert(stream.count == training_samples - 1);
+
+    assert(deeplearndata_get_performance(&streamed) >= 0);
+
+    /* free memory */
+    deeplearndata_stream_free(&stream);
+    deeplearn_free(&learner);
+    deeplearn_free(&streamed);
+
+    printf("Ok\n");
+}
+
+static void test_deeplearn_training_batch()
+{
+    deeplearn learner;
+    int no_of_hiddens=8;
+    int hidden_layers=2;
+    int no_of_outputs = 1;
+    int output_field_index[] = { 3 };
+    float error_threshold_percent[] = { 10.0f, 10.0f, 0.01f };
+    unsigned int random_seed = 123;
+    char * csv_filename = "/tmp/libdeep_batch.csv";
+    FILE * fp;
+    int itt, retval, final_training = 0;
+    unsigned int initial_itterations = 0;
+    float initial_weight = 0;
+
+    printf("test_deeplearn_training_batch...");
+
+    /* create a csv file */
+    fp = fopen(csv_filename,"w");
+    assert(fp);
+    for (itt = 0; itt < 40; itt++) {
+        fprintf(fp,"%f,%f,%f,%f\n",
+                (float)(itt%5), (float)(itt%7), (float)(itt%3),
+                (float)((itt%5) + (itt%3)));
+    }
+    fclose(fp);
+
+    /* load the data */
+    assert(deeplearndata_read_csv(csv_filename,
+                                  &learner,
+                                  no_of_hiddens, hidden_layers,
+                                  no_of_outputs,
+                                  output_field_index, 0,
+                                  error_threshold_percent,
+                                  &random_seed) == 40);
+
+    /* don't plot graphs during the test */
+    learner.history.interval = 1000000;
+
+    for (itt = 0; itt < 20000; itt++) {
+        retval = deeplearndata_training_batch(&learner, 8);
+        assert((retval == 1) || (retval == 2));
+        if (retval == 2) {
+            if (final_training == 0) {
+                initial_itterations = learner.net->itterations;
+                initial_weight = learner.net->outputs[0]->weights[0];
+            }
+            final_training++;
+            if (final_training > 2000)
+                break;
+        }
+    }
+
+    /* the final layer should have been trained using batches */
+    assert(final_training > 0);
+    assert(learner.current_hidden_layer == hidden_layers);
+    assert(learner.net->itterations > initial_itterations + 2000*8);
+    assert(learner.net->outputs[0]->weights[0] != initial_weight);
+    assert(learner.net->backprop_error_percent > 0);
+    assert(learner.net->backprop_error_percent < 100);
+
+    /* free memory */
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+static void test_deeplearn_pretrain_cache()
+{
+    deeplearn learner, cached, mapped;
+    int no_of_hiddens=8;
+    int hidden_layers=3;
+    int no_of_outputs = 1;
+    int output_field_index[] = { 3 };
+    float error_threshold_percent[] = { 10.0f, 10.0f, 10.0f, 0.01f };
+    unsigned int random_seed0 = 562, random_seed1 = 562, random_seed2 = 562;
+    char * csv_filename = "/tmp/libdeep_pretrain_cache.csv";
+    char * cache_filename = "/tmp/libdeep_pretrain_cache.dat";
+    FILE * fp;
+    int itt, retval = 1, mapped_layer = 0;
+
+    printf("test_deeplearn_pretrain_cache...");
+
+    /* create a csv file */
+    fp = fopen(csv_filename,"w");
+    assert(fp);
+    for (itt = 0; itt < 40; itt++) {
+        fprintf(fp,"%f,%f,%f,%f\n",
+                (float)(itt%5), (float)(itt%7), (float)(itt%3),
+                (float)((itt%5) + (itt%3)));
+    }
+    fclose(fp);
+
+    assert(deeplearndata_read_csv(csv_filename, &learner,
+                                  no_of_hiddens, hidden_layers,
+                                  no_of_outputs, output_field_index, 0,
+                                  error_threshold_percent,
+                                  &random_seed0) == 40);
+    assert(deeplearndata_read_csv(csv_filename, &cached,
+                                  no_of_hiddens, hidden_layers,
+                                  no_of_outputs, output_field_index, 0,
+                                  error_threshold_percent,
+                                  &random_seed1) == 40);
+    assert(deeplearndata_read_csv(csv_filename, &mapped,
+                                  no_of_hiddens, hidden_layers,
+                                  no_of_outputs, output_field_index, 0,
+                                  error_threshold_percent,
+                                  &random_seed2) == 40);
+    learner.history.interval = 1000000;
+    cached.history.interval = 1000000;
+    mapped.history.interval = 1000000;
+
+    assert(deeplearndata_set_pretrain_cache(&cached, 1, NULL) == 0);
+    assert(deeplearndata_set_pretrain_cache(&mapped, 1, cache_filename) == 0);
+
+    /* training from the cached values of the lower layers is the same
+       as feeding every sample through them */
+    for (itt = 0; itt < 20000; itt++) {
+        int layer = mapped.current_hidden_layer;
+
+        retval = deeplearndata_training_batch(&learner, 8);
+        assert(deeplearndata_training_batch(&cached, 8) == retval);
+        assert(deeplearndata_training_batch(&mapped, 8) == retval);
+        if (retval != 1)
+            break;
+
+        /* values of the layer below were cached after moving
+           on to a new layer */
+        if ((layer > 0) && (mapped.current_hidden_layer == layer)) {
+            assert(mapped.pretrain_cache_layer == layer);
+            fp = fopen(cache_filename, "rb");
+            assert(fp);
+            fclose(fp);
+            mapped_layer = layer;
+        }
+        assert(cached.current_hidden_layer == learner.current_hidden_layer);
+        assert(mapped.current_hidden_layer == learner.current_hidden_layer);
+    }
+
+    assert(retval == 2);
+    assert(mapped_layer == hidden_layers-1);
+    for (int l = 0; l < hidden_layers; l++) {
+        ac * autocoder = learner.autocoder[l];
+        for (int i = 0; i < autocoder->no_of_inputs*autocoder->no_of_hiddens;
+             i++) {
+            assert(fabs(cached.autocoder[l]->weights[i] -
+                        autocoder->weights[i]) < 0.001f);
+            assert(fabs(mapped.autocoder[l]->weights[i] -
+                        autocoder->weights[i]) < 0.001f);
+        }
+    }
+
+    /* the cache file is removed along with the learner */
+    deeplearn_free(&learner);
+    deeplearn_free(&cached);
+    deeplearn_free(&mapped);
+    fp = fopen(cache_filename, "rb");
+    assert(!fp);
+
+    printf("Ok\n");
+}
+
+/* mean absolute error of the outputs over the labeled training set */
+static float labeled_training_error(deeplearn * learner)
+{
+    bp * net = learner->net;
+    int samples = learner->training_data_labeled_samples;
+    float * inputs, * targets, * outputs;
+    float error = 0;
+
+    inputs = (float*)malloc(samples*net->no_of_inputs*sizeof(float));
+    targets = (float*)malloc(samples*net->no_of_outputs*sizeof(float));
+    outputs = (float*)malloc(samples*net->no_of_outputs*sizeof(float));
+    assert(inputs && targets && outputs);
+
+    for (int s = 0; s < samples; s++) {
+        deeplearndata * sample =
+            deeplearndata_get_training_labeled(learner, s);
+        deeplearn_encode_inputs(learner, sample,
+                                &inputs[s*net->no_of_inputs]);
+        deeplearn_encode_outputs(learner, sample,
+                                 &targets[s*net->no_of_outputs]);
+    }
+    assert(deeplearn_feed_forward_batch(learner, inputs, samples,
+                                        outputs) == 0);
+    for (int i = 0; i < samples*net->no_of_outputs; i++)
+        error += fabs(targets[i] - outputs[i]);
+
+    free(inputs);
+    free(targets);
+    free(outputs);
+    return error / samples;
+}
+
+static void test_deeplearn_training_workers()
+{
+    deeplearn learner;
+    int no_of_outputs = 1;
+    int output_field_index[] = { 3 };
+    float error_threshold_percent[] = { 10.0f, 10.0f, 0.01f };
+    unsigned int random_seed = 3187;
+    char * csv_filename = "/tmp/libdeep_workers.csv";
+    FILE * fp;
+    int itt, initial_threads, initial_threshold;
+    unsigned int itterations;
+    float initial_error;
+
+    printf("test_deeplearn_training_workers...");
+
+    /* create a csv file */
+    fp = fopen(csv_filename,"w");
+    assert(fp);
+    for (itt = 0; itt < 40; itt++) {
+        fprintf(fp,"%f,%f,%f,%f\n",
+                (float)(itt%5), (float)(itt%7), (float)(itt%3),
+                (float)((itt%5) + (itt%3)));
+    }
+    fclose(fp);
+
+    assert(deeplearndata_read_csv(csv_filename, &learner, 8, 2,
+                                  no_of_outputs, output_field_index, 0,
+                                  error_threshold_percent,
+                                  &random_seed) == 40);
+    learner.history.interval = 1000000;
+
+    /* the autocoders are also trained */
+    learner.current_hidden_layer = learner.net->hidden_layers;
+
+    assert(learner.no_of_workers == 1);
+    assert(deeplearn_set_workers(&learner, 0) == -1);
+    assert(deeplearn_set_workers(&learner, DEEPLEARN_MAX_THREADS+1) == -1);
+    assert(deeplearn_set_workers(&learner, 4) == 0);
+    assert(learner.no_of_workers == 4);
+    assert(learner.workers != NULL);
+
+    initial_threads = deeplearn_get_threads();
+    initial_threshold = deeplearn_get_parallel_threshold();
+    assert(deeplearn_set_threads(4) == 4);
+    deeplearn_set_parallel_threshold(0);
+
+    /* each step trains every worker on a number of samples */
+    itterations = learner.net->itterations;
+    initial_error = labeled_training_error(&learner);
+    for (itt = 0; itt < 500; itt++)
+        assert(deeplearndata_training(&learner) == 2);
+    assert(learner.net->itterations >=
+           itterations + 500*4*DEEPLEARN_HOGWILD_SAMPLES);
+    assert(learner.net->backprop_error_percent > 0);
+    assert(labeled_training_error(&learner) < initial_error);
+
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+
+    /* back to a single sample at a time */
+    assert(deeplearn_set_workers(&learner, 1) == 0);
+    assert(learner.workers == NULL);
+    itterations = learner.net->itterations;
+    assert(deeplearndata_training(&learner) == 2);
+    assert(learner.net->itterations > itterations);
+
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+static void test_deeplearn_gradient_monitoring()
+{
+    deeplearn learner;
+    int no_of_inputs=64;
+    int no_of_hiddens=64;
+    int hidden_layers=1;
+    int no_of_outputs=4;
+    int batch_size=8;
+    float error_threshold[] = { 0.01f, 0.01f };
+    unsigned int random_seed = 123;
+    unsigned int seed = 456;
+    float inputs[8*64], targets[8*4];
+    float mean, std, sampled_mean, sampled_std;
+    int itt, i;
+
+    printf("test_deeplearn_gradient_monitoring...");
+
+    assert(deeplearn_init(&learner,
+                          no_of_inputs, no_of_hiddens,
+                          hidden_layers,
+                          no_of_outputs,
+                          error_threshold,
+                          &random_seed) == 0);
+
+    for (i = 0; i < batch_size*no_of_inputs; i++)
+        inputs[i] = NEURON_LOW + ((i*7)%11)*NEURON_RANGE/11.0f;
+    for (i = 0; i < batch_size*no_of_outputs; i++)
+        targets[i] = NEURON_LOW + ((i*3)%5)*NEURON_RANGE/5.0f;
+
+    assert(deeplearn_set_gradient_monitoring(&learner, -1, 0) == -1);
+    assert(deeplearn_set_gradient_monitoring(&learner, 1, -1) == -1);
+
+    /* switched off, nothing is recorded */
+    assert(deeplearn_set_gradient_monitoring(&learner, 0, 0) == 0);
+    for (itt = 0; itt < 10; itt++)
+        assert(deeplearn_update_batch(&learner, inputs, targets,
+                                      batch_size) == 0);
+    assert(learner.gradients_std.index == 0);
+    assert(learner.gradients_mean.index == 0);
+
+    /* recorded every few steps from a sample of the weights */
+    assert(deeplearn_set_gradient_monitoring(&learner, 4, 128) == 0);
+    for (itt = 0; itt < 20; itt++)
+        assert(deeplearn_update_batch(&learner, inputs, targets,
+                                      batch_size) == 0);
+    assert(learner.gradients_std.index == 5);
+    assert(learner.gradients_mean.index == 5);
+    assert(HISTORY_VALUE(&learner.gradients_mean, 4, 0) > 0);
+
+    /* using every weight gives the same values as the
+       individual statistics */
+    assert(bp_weight_gradient_stats(learner.net, 1, 0, &seed,
+                                    &mean, &std) == -1);
+    assert(bp_weight_gradient_stats(learner.net, 0, 0, &seed,
+                                    &mean, &std) == 0);
+    assert(mean == bp_weight_gradient_mean(learner.net, 0));
+    assert(std == bp_weight_gradient_std(learner.net, 0));
+    assert(mean > 0);
+    assert(bp_weight_gradient_stats(learner.net, 0,
+                                    no_of_inputs*no_of_hiddens, &seed,
+                                    &sampled_mean, &sampled_std) == 0);
+    assert(sampled_mean == mean);
+    assert(sampled_std == std);
+
+    /* a sample of half of the weights gives a similar mean */
+    assert(bp_weight_gradient_stats(learner.net, 0,
+                                    no_of_inputs*no_of_hiddens/2, &seed,
+                                    &sampled_mean, &sampled_std) == 0);
+    assert(sampled_mean > mean*0.5f);
+    assert(sampled_mean < mean*1.5f);
+
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+static void test_deeplearn_history_size()
+{
+    deeplearn learner;
+    deeplearn_history history;
+    int no_of_inputs=10;
+    int no_of_hiddens=4;
+    int hidden_layers=3;
+    int no_of_outputs=2;
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f, 0.01f };
+    unsigned int random_seed = 123;
+    float values[HISTORY_DIMENSIONS];
+    int i;
+
+    printf("test_deeplearn_history_size...");
+
+    assert(deeplearn_init(&learner,
+                          no_of_inputs, no_of_hiddens,
+                          hidden_layers,
+                          no_of_outputs,
+                          error_threshold,
+                          &random_seed) == 0);
+
+    /* nothing is allocated until something is recorded */
+    assert(learner.history.history == NULL);
+    assert(learner.gradients_std.history == NULL);
+    assert(learner.gradients_mean.history == NULL);
+    assert(learner.history.dimensions == 1);
+    assert(learner.gradients_std.dimensions == hidden_layers);
+    assert(learner.gradients_mean.dimensions == hidden_layers);
+
+    assert(deeplearn_set_history_size(&learner, 1) == -1);
+    assert(deeplearn_set_history_size(&learner, 0) == 0);
+    assert(learner.history.capacity == 0);
+    assert(learner.gradients_mean.capacity == 0);
+
+    deeplearn_free(&learner);
+
+    deeplearn_history_init(&history, "test.png", "title",
+                           "horizontal", "vertical");
+    assert(deeplearn_history_set_size(&history, -1, 1) == -1);
+    assert(deeplearn_history_set_size(&history, 8, 0) == -1);
+    assert(deeplearn_history_set_size(&history, 8,
+                                      HISTORY_DIMENSIONS+1) == -1);
+    assert(deeplearn_history_set_size(&history, 8, 2) == 0);
+    assert(history.history == NULL);
+
+    /* recording the first step allocates the values */
+    values[0] = 1;
+    values[1] = 2;
+    deeplearn_history_update_from_array(&history, values,
+                                        PLOT_STANDARD);
+    assert(history.history != NULL);
+    assert(history.index == 1);
+    assert(HISTORY_VALUE(&history, 0, 0) == 1);
+    assert(HISTORY_VALUE(&history, 0, 1) == 2);
+
+    /* once full, every other step is discarded */
+    for (i = 1; i < 100; i++) {
+        values[0] = i + 1;
+        values[1] = (i + 1)*2;
+        deeplearn_history_update_from_array(&history, values,
+                                            PLOT_STANDARD);
+        assert(history.index < history.capacity);
+    }
+    assert(history.step > 1);
+    for (i = 1; i < history.index; i++) {
+        assert(HISTORY_VALUE(&history, i, 0) >
+               HISTORY_VALUE(&history, i-1, 0));
+        assert(HISTORY_VALUE(&history, i, 1) ==
+               HISTORY_VALUE(&history, i, 0)*2);
+    }
+    values[0] = HISTORY_VALUE(&history, 0, 0);
+
+    /* shrinking keeps the steps recorded so far */
+    assert(deeplearn_history_set_size(&history, 4, 1) == 0);
+    assert(history.index < 4);
+    assert(history.dimensions == 1);
+    assert(HISTORY_VALUE(&history, 0, 0) >= values[0]);
+
+    /* a capacity of zero frees the values and stops recording */
+    assert(deeplearn_history_set_size(&history, 0, 1) == 0);
+    assert(history.history == NULL);
+    assert(history.index == 0);
+    for (i = 0; i < 100; i++)
+        deeplearn_history_update(&history, i);
+    assert(history.history == NULL);
+    assert(history.index == 0);
+
+    deeplearn_history_free(&history);
+
+    printf("Ok\n");
+}
+
+static void test_deeplearn_feed_forward_batch()
+{
+    deeplearn learner;
+    int no_of_inputs=12;
+    int no_of_outputs=3;
+    int no_of_samples=DEEPLEARN_FEED_FORWARD_BATCH*2 + 5;
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f };
+    unsigned int random_seed = 952;
+    float * inputs, * outputs;
+    int s, i;
+
+    printf("test_deeplearn_feed_forward_batch...");
+
+    assert(deeplearn_init(&learner,
+                          no_of_inputs, 8, 2,
+                          no_of_outputs,
+                          error_threshold,
+                          &random_seed) == 0);
+
+    inputs = (float*)malloc(no_of_samples*no_of_inputs*sizeof(float));
+    outputs = (float*)malloc(no_of_samples*no_of_outputs*sizeof(float));
+    assert(inputs);
+    assert(outputs);
+
+    for (i = 0; i < no_of_samples*no_of_inputs; i++)
+        inputs[i] = NEURON_LOW +
+            ((rand_num(&random_seed)%10000)/10000.0f)*NEURON_RANGE;
+
+    assert(deeplearn_feed_forward_batch(&learner, inputs, 0, outputs) != 0);
+    assert(deeplearn_feed_forward_batch(&learner, inputs, no_of_samples,
+                                        outputs) == 0);
+
+    /* the output units should contain the final sample */
+    for (i = 0; i < no_of_outputs; i++)
+        assert(fabs(deeplearn_get_output(&learner, i) -
+                    outputs[(no_of_samples-1)*no_of_outputs + i]) < 0.0001f);
+
+    /* compare against feeding forward one sample at a time */
+    for (s = 0; s < no_of_samples; s++) {
+        for (i = 0; i < no_of_inputs; i++)
+            deeplearn_set_input(&learner, i, inputs[s*no_of_inputs + i]);
+        deeplearn_feed_forward(&learner);
+        for (i = 0; i < no_of_outputs; i++)
+            assert(fabs(deeplearn_get_output(&learner, i) -
+                        outputs[s*no_of_outputs + i]) < 0.0001f);
+    }
+
+    free(inputs);
+    free(outputs);
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
 static void test_deeplearn_set_input_field_text()
 {
     deeplearn learner;
@@ -518,6 +1457,17 @@ int run_tests_deeplearn()
     test_deeplearn_export();
     test_deeplearn_csv_with_text();
     test_deeplearn_csv_numeric();
+    test_deeplearn_csv_long_lines();
+    test_deeplearn_binary_data();
+    test_deeplearn_binary_stream();
+    test_deeplearn_encode();
+    test_deeplearn_performance_threads();
+    test_deeplearn_training_batch();
+    test_deeplearn_pretrain_cache();
+    test_deeplearn_training_workers();
+    test_deeplearn_gradient_monitoring();
+    test_deeplearn_history_size();
+    test_deeplearn_feed_forward_batch();
     test_deeplearn_set_input_field_text();
 
     printf("All deeplearn tests completed\n");
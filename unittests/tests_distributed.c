@@ -0,0 +1,192 @@
+/*
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tests_distributed.h"
+
+static void test_delta_pack()
+{
+    int n = DEEPLEARN_DELTA_BLOCK*2 + 17;
+    float delta[DEEPLEARN_DELTA_BLOCK*2 + 17];
+    float unpacked[DEEPLEARN_DELTA_BLOCK*2 + 17];
+    unsigned char buffer[DEEPLEARN_DELTA_BLOCK*2 + 17 + 3*sizeof(float)];
+    unsigned int random_seed = 8161;
+    int i;
+
+    printf("test_delta_pack...");
+
+    for (i = 0; i < n; i++)
+        delta[i] = ((rand_num(&random_seed)%20000)/10000.0f - 1.0f) *
+            ((i < DEEPLEARN_DELTA_BLOCK) ? 0.01f : 0.5f);
+
+    /* one byte per delta, and a scale for each block */
+    assert(deeplearn_delta_packed_size(n) == n + 3*(int)sizeof(float));
+    assert(deeplearn_delta_pack(delta, n, buffer) ==
+           deeplearn_delta_packed_size(n));
+    deeplearn_delta_unpack(buffer, n, unpacked);
+
+    /* each block is quantized to its own range */
+    for (i = 0; i < n; i++) {
+        float range = (i < DEEPLEARN_DELTA_BLOCK) ? 0.01f : 0.5f;
+        assert(fabs(unpacked[i] - delta[i]) <= range/127.0f);
+    }
+
+    /* no change at all is exact */
+    memset(delta, 0, sizeof(delta));
+    deeplearn_delta_pack(delta, n, buffer);
+    deeplearn_delta_unpack(buffer, n, unpacked);
+    for (i = 0; i < n; i++)
+        assert(unpacked[i] == 0);
+
+    printf("Ok\n");
+}
+
+static void write_shard(char * filename, int shard)
+{
+    FILE * fp = fopen(filename, "w");
+    int i;
+
+    assert(fp);
+    for (i = shard; i < 80; i += 2) {
+        fprintf(fp,"%f,%f,%f,%f\n",
+                (float)(i%5), (float)(i%7), (float)(i%3),
+                (float)((i%5) + (i%3)));
+    }
+    fclose(fp);
+}
+
+static void test_distributed_local()
+{
+    deeplearn learner[2];
+    deeplearn_distributed dist[2];
+    deeplearn_transport transports[2];
+    int output_field_index[] = { 3 };
+    float error_threshold[] = { 50.0f, 50.0f, 0.01f };
+    unsigned int random_seed[] = { 271, 828 };
+    char * filenames[] = {
+        "/tmp/libdeep_shard0.csv", "/tmp/libdeep_shard1.csv"
+    };
+    int n, r, retval[2];
+
+    printf("test_distributed_local...");
+
+    for (r = 0; r < 2; r++) {
+        write_shard(filenames[r], r);
+        assert(deeplearndata_read_csv(filenames[r], &learner[r], 8, 2, 1,
+                                      output_field_index, 0,
+                                      error_threshold,
+                                      &random_seed[r]) == 40);
+        learner[r].history.interval = 1000000;
+    }
+
+    n = deeplearn_distributed_parameters(&learner[0]);
+    assert(deeplearn_transport_local_init(transports, 2,
+               deeplearn_distributed_message_size(&learner[0])) == 0);
+    assert(transports[1].rank == 1);
+    assert(transports[1].nodes == 2);
+
+    /* every node trains on its own thread */
+#pragma omp parallel for num_threads(2)
+    for (r = 0; r < 2; r++) {
+        assert(deeplearn_distributed_init(&dist[r], &learner[r],
+                                          &transports[r], 20) == 0);
+        for (int i = 0; i < 100; i++) {
+            retval[r] = deeplearn_distributed_update(&dist[r]);
+            assert(retval[r] >= 0);
+        }
+    }
+
+    /* the nodes agree upon the weights, and on the stage of training,
+       having moved on to the final layer together */
+    assert(dist[0].exchanges == 99);
+    assert(dist[1].exchanges == 99);
+    assert(memcmp(dist[0].reference, dist[1].reference,
+                  n*sizeof(float)) == 0);
+    assert(learner[0].current_hidden_layer == 2);
+    assert(learner[1].current_hidden_layer == 2);
+    assert(retval[0] == 2);
+    assert(retval[1] == 2);
+
+    /* each node holds the agreed weights plus its own recent changes */
+    for (int i = 0; i < n; i++) {
+        assert(fabs(dist[0].parameters[i] - dist[0].reference[i]) < 1);
+        assert(fabs(dist[1].parameters[i] - dist[1].reference[i]) < 1);
+    }
+
+    for (r = 0; r < 2; r++) {
+        deeplearn_distributed_free(&dist[r]);
+        deeplearn_transport_free(&transports[r]);
+        deeplearn_free(&learner[r]);
+    }
+
+    printf("Ok\n");
+}
+
+static void test_distributed_tcp()
+{
+    deeplearn_transport transports[2];
+    unsigned char messages[2][8];
+    int status[2];
+
+    printf("test_distributed_tcp...");
+
+    /* a small message from every node reaches all of them */
+#pragma omp parallel for num_threads(2)
+    for (int r = 0; r < 2; r++) {
+        unsigned char message[4];
+
+        status[r] = deeplearn_transport_tcp_init(&transports[r], r, 2,
+                                                 "127.0.0.1", 47613);
+        if (status[r] == 0) {
+            memset(message, 10 + r, 4);
+            status[r] = transports[r].allgather(transports[r].context,
+                                                message, 4, messages[r]);
+        }
+    }
+
+    assert(status[0] == 0);
+    assert(status[1] == 0);
+    for (int r = 0; r < 2; r++) {
+        for (int i = 0; i < 8; i++)
+            assert(messages[r][i] == 10 + i/4);
+        deeplearn_transport_free(&transports[r]);
+    }
+
+    printf("Ok\n");
+}
+
+int run_tests_distributed()
+{
+    printf("\nRunning distributed tests\n");
+
+    test_delta_pack();
+    test_distributed_local();
+    test_distributed_tcp();
+
+    printf("All distributed tests completed\n");
+    return 0;
+}
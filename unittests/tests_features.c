@@ -37,12 +37,64 @@ void test_clip_value()
     printf("Ok\n");
 }
 
+static void test_learn_features_batch()
+{
+    int img_width = 40, img_height = 30, img_depth = 3;
+    int feature_width = 5, no_of_features = 9;
+    int feature_size = feature_width*feature_width*img_depth;
+    float img[40*30*3];
+    float feature[5*5*9*3], feature2[5*5*9*3];
+    float score, initial_score = 0, score2;
+    unsigned int random_seed = 8326, random_seed2;
+    int i, initial_threads, initial_threshold;
+
+    printf("test_learn_features_batch...");
+
+    for (i = 0; i < img_width*img_height*img_depth; i++)
+        img[i] = (rand_num(&random_seed)%10000)/10000.0f;
+    for (i = 0; i < no_of_features*feature_size; i++)
+        feature[i] = (rand_num(&random_seed)%10000)/10000.0f;
+    memcpy(feature2, feature, no_of_features*feature_size*sizeof(float));
+    random_seed2 = random_seed;
+
+    /* features move towards the image */
+    for (i = 0; i < 50; i++) {
+        score = learn_features_batch(img, img_width, img_height, img_depth,
+                                     feature_width, no_of_features, feature,
+                                     100, 16, 0.1f, &random_seed);
+        assert(score >= 0);
+        if (i == 0)
+            initial_score = score;
+    }
+    assert(score < initial_score);
+
+    /* the same features are learned with several threads */
+    initial_threads = deeplearn_get_threads();
+    initial_threshold = deeplearn_get_parallel_threshold();
+    assert(deeplearn_set_threads(4) == 4);
+    deeplearn_set_parallel_threshold(0);
+    for (i = 0; i < 50; i++)
+        score2 = learn_features_batch(img, img_width, img_height, img_depth,
+                                      feature_width, no_of_features,
+                                      feature2, 100, 16, 0.1f,
+                                      &random_seed2);
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+
+    assert(score2 == score);
+    assert(random_seed2 == random_seed);
+    assert(memcmp(feature, feature2,
+                  no_of_features*feature_size*sizeof(float)) == 0);
+
+    printf("Ok\n");
+}
 
 int run_tests_features()
 {
     printf("\nRunning feature learning tests\n");
 
     test_clip_value();
+    test_learn_features_batch();
 
     printf("All feature learning tests completed\n");
     return 0;
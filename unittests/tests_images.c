@@ -116,13 +116,100 @@ static void test_load_image()
     printf("Ok\n");
 }
 
+static int image_callback_calls = 0;
+
+static int image_callback(char * filename,
+                          unsigned int width, unsigned int height,
+                          unsigned int bitsperpixel,
+                          unsigned char buffer[], void * context)
+{
+    assert(strcmp(filename, "callback.png") == 0);
+    assert(width == 4);
+    assert(height == 2);
+    assert(bitsperpixel == 8);
+    assert(buffer[5] == 5);
+    assert(context == &image_callback_calls);
+    image_callback_calls++;
+    return 0;
+}
+
+static void test_image_output()
+{
+    char filename[256], pnm_filename[256], header[16];
+    unsigned char * buffer;
+    unsigned char grey[8];
+    unsigned int width=0,height=0,bitsperpixel=0;
+    int i, c;
+    FILE * fp;
+
+    printf("test_image_output...");
+
+    assert(deeplearn_get_image_output() == DEEPLEARN_IMAGE_PNG);
+    assert(deeplearn_set_image_output(-1) != 0);
+    assert(deeplearn_set_image_output(DEEPLEARN_IMAGE_OUTPUTS) != 0);
+    /* no callback has been set yet */
+    assert(deeplearn_set_image_output(DEEPLEARN_IMAGE_CALLBACK) != 0);
+    assert(deeplearn_get_image_output() == DEEPLEARN_IMAGE_PNG);
+
+    /* the fast encoder produces the same pixels */
+    assert(deeplearn_set_image_output(DEEPLEARN_IMAGE_PNG_FAST) == 0);
+    sprintf(filename,"%stemp_img_fast.png",DEEPLEARN_TEMP_DIRECTORY);
+    save_image(filename);
+    assert(deeplearn_read_png_file(filename, &width, &height,
+                                   &bitsperpixel, &buffer)==0);
+    assert(width==80);
+    assert(height==80);
+    for (i = 0; i < width*height*3; i+=3) {
+        assert(buffer[i] == i%256);
+        assert(buffer[i+1] == 255 - buffer[i]);
+        assert(buffer[i+2] == buffer[i]);
+    }
+    free(buffer);
+    remove(filename);
+
+    /* uncompressed */
+    COUNTUP(j, 8)
+        grey[j] = (unsigned char)j;
+    assert(deeplearn_set_image_output(DEEPLEARN_IMAGE_PNM) == 0);
+    sprintf(filename,"%stemp_img_pnm.png",DEEPLEARN_TEMP_DIRECTORY);
+    sprintf(pnm_filename,"%stemp_img_pnm.pgm",DEEPLEARN_TEMP_DIRECTORY);
+    assert(deeplearn_write_png_file(filename, 4, 2, 8, grey) == 0);
+    fp = fopen(pnm_filename, "rb");
+    assert(fp);
+    assert(fgets(header, 16, fp) != 0);
+    assert(strcmp(header, "P5\n") == 0);
+    assert(fgets(header, 16, fp) != 0);
+    assert(strcmp(header, "4 2\n") == 0);
+    assert(fgets(header, 16, fp) != 0);
+    assert(strcmp(header, "255\n") == 0);
+    COUNTUP(j, 8) {
+        c = fgetc(fp);
+        assert(c == j);
+    }
+    assert(fgetc(fp) == EOF);
+    fclose(fp);
+    remove(pnm_filename);
+
+    /* passed to the application without encoding */
+    assert(deeplearn_set_image_callback(NULL, NULL) != 0);
+    assert(deeplearn_set_image_callback(image_callback,
+                                        &image_callback_calls) == 0);
+    assert(deeplearn_get_image_output() == DEEPLEARN_IMAGE_CALLBACK);
+    assert(deeplearn_write_png_file("callback.png", 4, 2, 8, grey) == 0);
+    assert(image_callback_calls == 1);
+
+    assert(deeplearn_set_image_output(DEEPLEARN_IMAGE_PNG) == 0);
+
+    printf("Ok\n");
+}
+
 static void test_load_training_images()
 {
     char filename[256];
-    unsigned char ** images=NULL;
-    char ** classifications=NULL;
-    int * numbers;
-    int im;
+    unsigned char ** images=NULL, ** images2=NULL;
+    char ** classifications=NULL, ** classifications2=NULL;
+    int * numbers, * numbers2;
+    int im, initial_threads, initial_threshold;
     int no_of_images2;
     int width=40,height=40;
     char commandstr[256],str[256];
@@ -165,14 +252,45 @@ static void test_load_training_images()
     assert(no_of_images+(no_of_images*extra_synthetic_images) == no_of_images2);
     assert(images!=NULL);
 
+    /* synthetic images have the same classification as the original */
+    for (im = 0; im < no_of_images2; im++) {
+        assert(images[im] != NULL);
+        assert(numbers[im] == numbers[im - (im % (1+extra_synthetic_images))]);
+    }
+
+    /* loading in parallel should give the same images */
+    initial_threads = deeplearn_get_threads();
+    initial_threshold = deeplearn_get_parallel_threshold();
+    assert(deeplearn_set_threads(4) == 4);
+    deeplearn_set_parallel_threshold(0);
+    assert(deeplearn_load_training_images(str,
+                                          &images2,
+                                          &classifications2,
+                                          &numbers2,
+                                          width, height,
+                                          extra_synthetic_images) ==
+           no_of_images2);
+    deeplearn_set_threads(initial_threads);
+    deeplearn_set_parallel_threshold(initial_threshold);
+    for (im = 0; im < no_of_images2; im++) {
+        assert(memcmp(images[im], images2[im], width*height) == 0);
+        assert(strcmp(classifications[im], classifications2[im]) == 0);
+        assert(numbers[im] == numbers2[im]);
+    }
+
     /* free memory */
-    for (im = 0; im < no_of_images; im++) {
+    for (im = 0; im < no_of_images2; im++) {
         free(images[im]);
         free(classifications[im]);
+        free(images2[im]);
+        free(classifications2[im]);
     }
     free(images);
     free(classifications);
     free(numbers);
+    free(images2);
+    free(classifications2);
+    free(numbers2);
 
     /* remove the images */
     sprintf(commandstr,"rm -rf %sdeeplearn_test_images",
@@ -182,13 +300,159 @@ static void test_load_training_images()
     printf("Ok\n");
 }
 
+static void test_load_training_images_cached()
+{
+    char filename[256], cache_filename[256];
+    unsigned char ** images=NULL, ** images2=NULL, ** images3=NULL;
+    char ** classifications=NULL, ** classifications2=NULL;
+    char ** classifications3=NULL;
+    int * numbers, * numbers2, * numbers3;
+    int im, no_of_images2;
+    int width=20,height=20;
+    char commandstr[256],str[256];
+    int extra_synthetic_images = 2;
+    int no_of_images = 3;
+    void * map, * map2, * map3;
+    size_t map_length, map_length2, map_length3;
+
+    printf("test_load_training_images_cached...");
+
+    sprintf(commandstr,"rm -rf %sdeeplearn_test_cache_images",
+            DEEPLEARN_TEMP_DIRECTORY);
+    system(commandstr);
+    sprintf(commandstr,"mkdir %sdeeplearn_test_cache_images",
+            DEEPLEARN_TEMP_DIRECTORY);
+    system(commandstr);
+
+    for (im = 0; im < no_of_images; im++) {
+        sprintf(filename,"%sdeeplearn_test_cache_images/img%d.%d.png",
+                DEEPLEARN_TEMP_DIRECTORY, im%2, im);
+        save_image(filename);
+    }
+
+    sprintf(str,"%sdeeplearn_test_cache_images",
+            DEEPLEARN_TEMP_DIRECTORY);
+    sprintf(cache_filename,"%stemp_deeplearn_images.cache",
+            DEEPLEARN_TEMP_DIRECTORY);
+    remove(cache_filename);
+
+    /* the first load decodes the images and writes the cache */
+    no_of_images2 =
+        deeplearn_load_training_images_cached(str, cache_filename,
+                                              &images, &classifications,
+                                              &numbers, width, height,
+                                              extra_synthetic_images,
+                                              &map, &map_length);
+    assert(no_of_images2 == no_of_images*(1+extra_synthetic_images));
+    assert(map == NULL);
+
+    /* the second load maps the cache */
+    assert(deeplearn_load_training_images_cached(str, cache_filename,
+                                                 &images2,
+                                                 &classifications2,
+                                                 &numbers2, width, height,
+                                                 extra_synthetic_images,
+                                                 &map2, &map_length2) ==
+           no_of_images2);
+    assert(map2 != NULL);
+    for (im = 0; im < no_of_images2; im++) {
+        assert(memcmp(images[im], images2[im], width*height) == 0);
+        assert(strcmp(classifications[im], classifications2[im]) == 0);
+        assert(numbers[im] == numbers2[im]);
+    }
+
+    /* a change to the directory contents does not use the cache */
+    sprintf(filename,"%sdeeplearn_test_cache_images/img1.%d.png",
+            DEEPLEARN_TEMP_DIRECTORY, no_of_images);
+    save_image(filename);
+    assert(deeplearn_load_training_images_cached(str, cache_filename,
+                                                 &images3,
+                                                 &classifications3,
+                                                 &numbers3, width, height,
+                                                 extra_synthetic_images,
+                                                 &map3, &map_length3) ==
+           (no_of_images+1)*(1+extra_synthetic_images));
+    assert(map3 == NULL);
+    deeplearn_free_training_images(images3, classifications3, numbers3,
+                                   (no_of_images+1)*
+                                   (1+extra_synthetic_images),
+                                   map3, map_length3);
+
+    /* nor does a different image size */
+    assert(deeplearn_load_training_images_cached(str, cache_filename,
+                                                 &images3,
+                                                 &classifications3,
+                                                 &numbers3, width/2, height,
+                                                 extra_synthetic_images,
+                                                 &map3, &map_length3) ==
+           (no_of_images+1)*(1+extra_synthetic_images));
+    assert(map3 == NULL);
+    deeplearn_free_training_images(images3, classifications3, numbers3,
+                                   (no_of_images+1)*
+                                   (1+extra_synthetic_images),
+                                   map3, map_length3);
+
+    /* rewriting the cache leaves the earlier mapping intact */
+    for (im = 0; im < no_of_images2; im++) {
+        assert(memcmp(images[im], images2[im], width*height) == 0);
+        assert(strcmp(classifications[im], classifications2[im]) == 0);
+    }
+    deeplearn_free_training_images(images2, classifications2, numbers2,
+                                   no_of_images2, map2, map_length2);
+
+    deeplearn_free_training_images(images, classifications, numbers,
+                                   no_of_images2, map, map_length);
+
+    remove(cache_filename);
+    sprintf(commandstr,"rm -rf %sdeeplearn_test_cache_images",
+            DEEPLEARN_TEMP_DIRECTORY);
+    system(commandstr);
+
+    printf("Ok\n");
+}
+
+static void test_image_synth_random()
+{
+    int width = 30, height = 20;
+    unsigned char img[30*20], result[30*20], result2[30*20];
+    unsigned int random_seed = 5362, random_seed2 = 5362;
+    int i, hits = 0;
+
+    printf("test_image_synth_random...");
+
+    for (i = 0; i < width*height; i++)
+        img[i] = 1 + (i%200);
+
+    /* the same seed gives the same image */
+    image_synth_random(img, width, height, 1, width, height, 1,
+                       result, &random_seed);
+    image_synth_random(img, width, height, 1, width, height, 1,
+                       result2, &random_seed2);
+    assert(random_seed == random_seed2);
+    assert(memcmp(result, result2, width*height) == 0);
+
+    /* some of the original image remains */
+    for (i = 0; i < width*height; i++)
+        if (result[i] != 0)
+            hits++;
+    assert(hits > 0);
+
+    /* the seed advances, giving a new variant next time */
+    assert(random_seed != 5362);
+
+    printf("Ok\n");
+}
+
 int run_tests_images()
 {
     printf("\nRunning images tests\n");
 
     test_save_image();
     test_load_image();
+    test_image_output();
+    test_image_synth_random();
     test_load_training_images();
+    test_load_training_images_cached();
 
     printf("All images tests completed\n");
     return 0;
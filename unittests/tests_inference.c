@@ -0,0 +1,462 @@
+/*
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tests_inference.h"
+
+#define TEST_INF_INPUTS  20
+#define TEST_INF_OUTPUTS 3
+#define TEST_INF_SAMPLES 64
+
+static void test_inference_compile()
+{
+    deeplearn learner;
+    deeplearn_inference model;
+    deeplearn_inference_context ctx;
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f };
+    float inputs[TEST_INF_INPUTS], outputs[TEST_INF_OUTPUTS];
+    unsigned int random_seed = 5723;
+
+    printf("test_inference_compile...");
+
+    assert(deeplearn_init(&learner, TEST_INF_INPUTS, 16, 2,
+                          TEST_INF_OUTPUTS, error_threshold,
+                          &random_seed) == 0);
+    assert(deeplearn_set_activation(&learner, 1, AF_TANH) == 0);
+
+    assert(deeplearn_compile_inference(&learner, &model) == 0);
+    assert(model.no_of_layers == 3);
+    assert(model.layer_units[0] == 16);
+    assert(model.layer_inputs[0] == TEST_INF_INPUTS);
+    assert(model.layer_units[2] == TEST_INF_OUTPUTS);
+    assert(model.activation[1] == AF_TANH);
+    assert(deeplearn_inference_context_init(&model, &ctx) == 0);
+
+    for (int s = 0; s < 10; s++) {
+        for (int i = 0; i < TEST_INF_INPUTS; i++) {
+            inputs[i] = NEURON_LOW +
+                ((rand_num(&random_seed)%10000)/10000.0f)*NEURON_RANGE;
+            deeplearn_set_input(&learner, i, inputs[i]);
+        }
+        deeplearn_feed_forward(&learner);
+
+        /* input ranges are unset, so values are passed straight through */
+        assert(deeplearn_inference_run(&model, &ctx, inputs, outputs) == 0);
+        for (int i = 0; i < TEST_INF_OUTPUTS; i++) {
+            assert(fabs(outputs[i] -
+                        deeplearn_get_output(&learner, i)) < 0.0001f);
+            assert(fabs(ctx.outputs[i] - outputs[i]) < 0.0001f);
+        }
+        assert(deeplearn_inference_get_class(&model, &ctx) ==
+               deeplearn_get_class(&learner));
+    }
+
+    /* the model no longer depends upon the learner */
+    deeplearn_free(&learner);
+    assert(deeplearn_inference_run(&model, &ctx, inputs, outputs) == 0);
+
+    deeplearn_inference_context_free(&ctx);
+    deeplearn_inference_free(&model);
+
+    printf("Ok\n");
+}
+
+static void test_inference_threads()
+{
+    deeplearn learner;
+    deeplearn_inference model;
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f };
+    float inputs[TEST_INF_SAMPLES][TEST_INF_INPUTS];
+    float expected[TEST_INF_SAMPLES][TEST_INF_OUTPUTS];
+    float outputs[TEST_INF_SAMPLES][TEST_INF_OUTPUTS];
+    unsigned int random_seed = 184;
+
+    printf("test_inference_threads...");
+
+    assert(deeplearn_init(&learner, TEST_INF_INPUTS, 16, 2,
+                          TEST_INF_OUTPUTS, error_threshold,
+                          &random_seed) == 0);
+    assert(deeplearn_compile_inference(&learner, &model) == 0);
+    deeplearn_free(&learner);
+
+    for (int s = 0; s < TEST_INF_SAMPLES; s++)
+        for (int i = 0; i < TEST_INF_INPUTS; i++)
+            inputs[s][i] = NEURON_LOW +
+                ((rand_num(&random_seed)%10000)/10000.0f)*NEURON_RANGE;
+
+    /* single threaded reference */
+    {
+        deeplearn_inference_context ctx;
+        assert(deeplearn_inference_context_init(&model, &ctx) == 0);
+        for (int s = 0; s < TEST_INF_SAMPLES; s++)
+            assert(deeplearn_inference_run(&model, &ctx, inputs[s],
+                                           expected[s]) == 0);
+        deeplearn_inference_context_free(&ctx);
+    }
+
+    /* many threads sharing the same model, each with its own context */
+#pragma omp parallel num_threads(4)
+    {
+        deeplearn_inference_context ctx;
+        int retval = deeplearn_inference_context_init(&model, &ctx);
+        assert(retval == 0);
+
+#pragma omp for schedule(static, 1)
+        for (int s = 0; s < TEST_INF_SAMPLES; s++)
+            deeplearn_inference_run(&model, &ctx, inputs[s], outputs[s]);
+
+        deeplearn_inference_context_free(&ctx);
+    }
+
+    for (int s = 0; s < TEST_INF_SAMPLES; s++)
+        for (int i = 0; i < TEST_INF_OUTPUTS; i++)
+            assert(outputs[s][i] == expected[s][i]);
+
+    deeplearn_inference_free(&model);
+
+    printf("Ok\n");
+}
+
+static void test_inference_replicas()
+{
+    deeplearn learner;
+    deeplearn_inference model;
+    deeplearn_inference * replicas;
+    deeplearn_inference_context ctx;
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f };
+    float inputs[TEST_INF_INPUTS];
+    float expected[TEST_INF_OUTPUTS], outputs[TEST_INF_OUTPUTS];
+    unsigned int random_seed = 3379;
+    int no_of_replicas;
+    const deeplearn_inference * replica;
+
+    printf("test_inference_replicas...");
+
+    assert(deeplearn_init(&learner, TEST_INF_INPUTS, 16, 2,
+                          TEST_INF_OUTPUTS, error_threshold,
+                          &random_seed) == 0);
+    assert(deeplearn_compile_inference(&learner, &model) == 0);
+    deeplearn_free(&learner);
+
+    for (int i = 0; i < TEST_INF_INPUTS; i++)
+        inputs[i] = NEURON_LOW +
+            ((rand_num(&random_seed)%10000)/10000.0f)*NEURON_RANGE;
+
+    assert(deeplearn_inference_context_init(&model, &ctx) == 0);
+    assert(deeplearn_inference_run(&model, &ctx, inputs, expected) == 0);
+    deeplearn_inference_context_free(&ctx);
+
+    /* one copy for each node, held in memory of its own */
+    replicas = deeplearn_inference_replicas_init(&model, &no_of_replicas);
+    assert(replicas);
+    assert(no_of_replicas == deeplearn_numa_nodes());
+    for (int n = 0; n < no_of_replicas; n++) {
+        assert(replicas[n].blob != model.blob);
+        assert(replicas[n].mapping == 0);
+        assert(replicas[n].blob_length == model.blob_length);
+    }
+
+    /* the copies do not depend upon the model */
+    deeplearn_inference_free(&model);
+
+    replica = deeplearn_inference_replica(replicas, no_of_replicas);
+    assert(replica >= replicas);
+    assert(replica < &replicas[no_of_replicas]);
+    assert(deeplearn_inference_context_init(replica, &ctx) == 0);
+    assert(deeplearn_inference_run(replica, &ctx, inputs, outputs) == 0);
+    for (int i = 0; i < TEST_INF_OUTPUTS; i++)
+        assert(outputs[i] == expected[i]);
+    deeplearn_inference_context_free(&ctx);
+
+    deeplearn_inference_replicas_free(replicas, no_of_replicas);
+
+    printf("Ok\n");
+}
+
+static void test_inference_int8()
+{
+    deeplearn learner;
+    deeplearn_inference model, model8;
+    deeplearn_inference_context ctx, ctx8;
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f };
+    float inputs[TEST_INF_INPUTS];
+    float outputs[TEST_INF_OUTPUTS], outputs8[TEST_INF_OUTPUTS];
+    unsigned int random_seed = 3361;
+    int no_of_weights = 0;
+
+    printf("test_inference_int8...");
+
+    assert(deeplearn_init(&learner, TEST_INF_INPUTS, 16, 2,
+                          TEST_INF_OUTPUTS, error_threshold,
+                          &random_seed) == 0);
+    assert(deeplearn_set_activation(&learner, 1, AF_TANH) == 0);
+
+    /* larger weights than after initialisation, so that the
+       outputs depend strongly upon the inputs */
+    for (int l = 0; l <= learner.net->hidden_layers; l++) {
+        bp_layer * layer = &learner.net->layers[l];
+        int n = layer->no_of_units*layer->no_of_inputs;
+
+        for (int i = 0; i < n; i++)
+            layer->weights[i] =
+                ((rand_num(&random_seed)%20000)/10000.0f) - 1.0f;
+        no_of_weights += n;
+    }
+
+    assert(deeplearn_compile_inference(&learner, &model) == 0);
+    assert(deeplearn_compile_inference_int8(&learner, &model8) == 0);
+    deeplearn_free(&learner);
+
+    assert(model8.quantized == 1);
+    assert(model8.quantized_blob_length == no_of_weights);
+    assert(model8.blob_length < model.blob_length - no_of_weights + 4);
+    assert(model8.weights[0] == 0);
+
+    assert(deeplearn_inference_context_init(&model, &ctx) == 0);
+    assert(deeplearn_inference_context_init(&model8, &ctx8) == 0);
+
+    for (int s = 0; s < 20; s++) {
+        for (int i = 0; i < TEST_INF_INPUTS; i++)
+            inputs[i] = NEURON_LOW +
+                ((rand_num(&random_seed)%10000)/10000.0f)*NEURON_RANGE;
+
+        assert(deeplearn_inference_run(&model, &ctx, inputs, outputs) == 0);
+        assert(deeplearn_inference_run(&model8, &ctx8, inputs,
+                                       outputs8) == 0);
+        for (int i = 0; i < TEST_INF_OUTPUTS; i++)
+            assert(fabs(outputs[i] - outputs8[i]) < 0.02f);
+    }
+
+    deeplearn_inference_context_free(&ctx);
+    deeplearn_inference_context_free(&ctx8);
+    deeplearn_inference_free(&model);
+    deeplearn_inference_free(&model8);
+
+    printf("Ok\n");
+}
+
+static void test_inference_map()
+{
+    deeplearn learner;
+    deeplearn_inference model, mapped;
+    deeplearn_inference_context ctx, mapped_ctx;
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f };
+    float inputs[TEST_INF_INPUTS];
+    float outputs[TEST_INF_OUTPUTS], mapped_outputs[TEST_INF_OUTPUTS];
+    unsigned int random_seed = 7151;
+    char filename[256];
+    int no_of_layers, units[2], layer_inputs[2], chained[2];
+    long units_offset = sizeof(deeplearn_model_header), inputs_offset;
+    FILE * fp;
+
+    printf("test_inference_map...");
+
+    sprintf(filename,"%stemp_deep_model.bin",DEEPLEARN_TEMP_DIRECTORY);
+    assert(deeplearn_init(&learner, TEST_INF_INPUTS, 16, 2,
+                          TEST_INF_OUTPUTS, error_threshold,
+                          &random_seed) == 0);
+    assert(deeplearn_set_activation(&learner, 1, AF_TANH) == 0);
+
+    for (int quantized = 0; quantized < 2; quantized++) {
+        if (quantized == 0)
+            assert(deeplearn_compile_inference(&learner, &model) == 0);
+        else
+            assert(deeplearn_compile_inference_int8(&learner, &model) == 0);
+
+        assert(deeplearn_inference_save(&model, filename) == 0);
+        assert(deeplearn_inference_map(&mapped, filename, 1) == 0);
+
+        /* the weights are used in place, suitably aligned */
+        assert(mapped.mapping != 0);
+        assert((char*)mapped.blob > (char*)mapped.mapping);
+        assert((size_t)mapped.blob % DEEPLEARN_MODEL_ALIGN == 0);
+        assert(mapped.quantized == quantized);
+        assert(mapped.no_of_layers == model.no_of_layers);
+        assert(mapped.max_units == model.max_units);
+        assert(memcmp(mapped.blob, model.blob,
+                      model.blob_length*sizeof(float)) == 0);
+        if (quantized != 0)
+            assert(memcmp(mapped.quantized_blob, model.quantized_blob,
+                          model.quantized_blob_length) == 0);
+
+        assert(deeplearn_inference_context_init(&model, &ctx) == 0);
+        assert(deeplearn_inference_context_init(&mapped, &mapped_ctx) == 0);
+        for (int s = 0; s < 10; s++) {
+            for (int i = 0; i < TEST_INF_INPUTS; i++)
+                inputs[i] = NEURON_LOW +
+                    ((rand_num(&random_seed)%10000)/10000.0f)*NEURON_RANGE;
+
+            assert(deeplearn_inference_run(&model, &ctx, inputs,
+                                           outputs) == 0);
+            assert(deeplearn_inference_run(&mapped, &mapped_ctx, inputs,
+                                           mapped_outputs) == 0);
+            for (int i = 0; i < TEST_INF_OUTPUTS; i++)
+                assert(outputs[i] == mapped_outputs[i]);
+        }
+        deeplearn_inference_context_free(&ctx);
+        deeplearn_inference_context_free(&mapped_ctx);
+        deeplearn_inference_free(&mapped);
+        deeplearn_inference_free(&model);
+    }
+
+    /* layers which do not chain together are rejected, even when
+       their sizes still account for the whole blob */
+    assert(deeplearn_compile_inference(&learner, &model) == 0);
+    assert(deeplearn_inference_save(&model, filename) == 0);
+    no_of_layers = model.no_of_layers;
+    deeplearn_inference_free(&model);
+    deeplearn_free(&learner);
+    inputs_offset = units_offset + no_of_layers*sizeof(int);
+    fp = fopen(filename, "r+b");
+    assert(fp);
+    fseek(fp, units_offset, SEEK_SET);
+    assert(fread(units, sizeof(int), 2, fp) == 2);
+    fseek(fp, inputs_offset, SEEK_SET);
+    assert(fread(layer_inputs, sizeof(int), 2, fp) == 2);
+    assert(layer_inputs[1] == units[0]);
+    assert(units[0] >= units[1]);
+    chained[0] = 1;
+    chained[1] = units[1]*(layer_inputs[1] + 1) - 1;
+    fseek(fp, units_offset + sizeof(int), SEEK_SET);
+    assert(fwrite(&chained[0], sizeof(int), 1, fp) == 1);
+    fseek(fp, inputs_offset + sizeof(int), SEEK_SET);
+    assert(fwrite(&chained[1], sizeof(int), 1, fp) == 1);
+    fclose(fp);
+    assert(deeplearn_inference_map(&mapped, filename, 0) == -8);
+
+    fp = fopen(filename, "r+b");
+    assert(fp);
+    fseek(fp, units_offset + sizeof(int), SEEK_SET);
+    assert(fwrite(&units[1], sizeof(int), 1, fp) == 1);
+    fseek(fp, inputs_offset + sizeof(int), SEEK_SET);
+    assert(fwrite(&layer_inputs[1], sizeof(int), 1, fp) == 1);
+    fclose(fp);
+    assert(deeplearn_inference_map(&mapped, filename, 1) == 0);
+    deeplearn_inference_free(&mapped);
+
+    /* corruption is found by the checksum */
+    fp = fopen(filename, "r+b");
+    assert(fp);
+    fseek(fp, -8, SEEK_END);
+    fputc(0x55, fp);
+    fclose(fp);
+    assert(deeplearn_inference_map(&mapped, filename, 1) == -6);
+    assert(deeplearn_inference_map(&mapped, filename, 0) == 0);
+    deeplearn_inference_free(&mapped);
+
+    /* files which are not models are rejected */
+    fp = fopen(filename, "r+b");
+    assert(fp);
+    fputc(0, fp);
+    fclose(fp);
+    assert(deeplearn_inference_map(&mapped, filename, 0) == -4);
+
+    printf("Ok\n");
+}
+
+static void test_inference_shared()
+{
+    deeplearn learner;
+    deeplearn_inference model, shared, shared2;
+    deeplearn_inference_context ctx, shared_ctx;
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f };
+    float inputs[TEST_INF_INPUTS];
+    float outputs[TEST_INF_OUTPUTS], shared_outputs[TEST_INF_OUTPUTS];
+    unsigned int random_seed = 3862;
+    char * name = "/libdeep_test_model";
+
+    printf("test_inference_shared...");
+
+    assert(deeplearn_init(&learner, TEST_INF_INPUTS, 16, 2,
+                          TEST_INF_OUTPUTS, error_threshold,
+                          &random_seed) == 0);
+    assert(deeplearn_compile_inference(&learner, &model) == 0);
+
+    deeplearn_inference_unpublish(name);
+    assert(deeplearn_inference_map_shared(&shared, name, 0) == -1);
+    assert(deeplearn_inference_publish(&model, name) == 0);
+
+    /* an existing model is not overwritten */
+    assert(deeplearn_inference_publish(&model, name) == -2);
+
+    assert(deeplearn_inference_map_shared(&shared, name, 1) == 0);
+    assert(deeplearn_inference_map_shared(&shared2, name, 0) == 0);
+    assert(shared.mapping != 0);
+    assert(shared2.mapping != shared.mapping);
+    assert((size_t)shared.blob % DEEPLEARN_MODEL_ALIGN == 0);
+    assert(memcmp(shared.blob, model.blob,
+                  model.blob_length*sizeof(float)) == 0);
+    assert(memcmp(shared2.blob, model.blob,
+                  model.blob_length*sizeof(float)) == 0);
+
+    assert(deeplearn_inference_context_init(&model, &ctx) == 0);
+    assert(deeplearn_inference_context_init(&shared, &shared_ctx) == 0);
+    for (int s = 0; s < 10; s++) {
+        for (int i = 0; i < TEST_INF_INPUTS; i++)
+            inputs[i] = NEURON_LOW +
+                ((rand_num(&random_seed)%10000)/10000.0f)*NEURON_RANGE;
+
+        assert(deeplearn_inference_run(&model, &ctx, inputs,
+                                       outputs) == 0);
+        assert(deeplearn_inference_run(&shared, &shared_ctx, inputs,
+                                       shared_outputs) == 0);
+        for (int i = 0; i < TEST_INF_OUTPUTS; i++)
+            assert(outputs[i] == shared_outputs[i]);
+    }
+
+    /* existing mappings remain usable once the name is removed */
+    deeplearn_inference_free(&shared2);
+    assert(deeplearn_inference_unpublish(name) == 0);
+    assert(deeplearn_inference_map_shared(&shared2, name, 0) == -1);
+    assert(deeplearn_inference_run(&shared, &shared_ctx, inputs,
+                                   shared_outputs) == 0);
+    for (int i = 0; i < TEST_INF_OUTPUTS; i++)
+        assert(outputs[i] == shared_outputs[i]);
+
+    deeplearn_inference_context_free(&ctx);
+    deeplearn_inference_context_free(&shared_ctx);
+    deeplearn_inference_free(&shared);
+    deeplearn_inference_free(&model);
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+int run_tests_inference()
+{
+    printf("\nRunning inference tests\n");
+
+    test_inference_compile();
+    test_inference_threads();
+    test_inference_replicas();
+    test_inference_int8();
+    test_inference_map();
+    test_inference_shared();
+
+    printf("All inference tests completed\n");
+    return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tests_plotter.h"
+
+static void test_plotter_async()
+{
+    deeplearn_plotter plotter;
+    deeplearn_history history;
+    deeplearn_history * histories[1];
+    char filename[256];
+    int retval, plots = 0;
+    FILE * fp;
+
+    printf("test_plotter_async...");
+
+    sprintf(filename,"%stemp_plotter.png",DEEPLEARN_TEMP_DIRECTORY);
+    remove(filename);
+    deeplearn_history_init(&history, filename, "Plotter", "Time Step",
+                           "Value");
+    COUNTUP(i, 2000)
+        deeplearn_history_update(&history, i % 100);
+    histories[0] = &history;
+
+    deeplearn_plotter_init(&plotter);
+    assert(deeplearn_plotter_poll(&plotter) == 0);
+    assert(deeplearn_plotter_async(&plotter, histories, 0, 64, 64) == -2);
+    assert(deeplearn_plotter_async(&plotter, histories,
+                                   DEEPLEARN_PLOTTER_HISTORIES+1,
+                                   64, 64) == -2);
+
+    /* plots are dropped rather than waiting for the previous ones */
+    COUNTUP(i, 4) {
+        retval = deeplearn_plotter_async(&plotter, histories, 1,
+                                         DEEPLEARN_PLOT_WIDTH,
+                                         DEEPLEARN_PLOT_HEIGHT);
+        assert((retval == 0) || (retval == -1));
+        if (retval == 0)
+            plots++;
+    }
+    assert(plots >= 1);
+    assert(plotter.frames == (unsigned int)plots);
+    assert(plotter.frames + plotter.dropped == 4);
+
+    /* changes after the copy are not plotted */
+    COUNTUP(i, 2000)
+        deeplearn_history_update(&history, 0);
+
+    assert(deeplearn_plotter_wait(&plotter) == 0);
+    assert(deeplearn_plotter_poll(&plotter) == 0);
+    fp = fopen(filename, "rb");
+    assert(fp);
+    fclose(fp);
+
+    deeplearn_plotter_free(&plotter);
+    assert(plotter.snapshot == 0);
+    deeplearn_history_free(&history);
+
+    printf("Ok\n");
+}
+
+static void test_plotter_scope()
+{
+    scope s;
+    float * trace1;
+    deeplearn_history history;
+    char filename[256];
+    FILE * fp;
+
+    printf("test_plotter_scope...");
+
+    create_scope(&s, 1);
+    assert(s.max_time_steps == 0);
+    assert(s.trace1 == NULL);
+
+    /* updates beyond the trace buffers are ignored */
+    scope_update(&s, 0, 1.0, 0, 2, 0, 0);
+
+    assert(scope_set_time_steps(&s, 100) == 0);
+    assert(s.max_time_steps == 100);
+    assert(s.trace1[99] == PHOSPHENE_NO_TRACE);
+    assert(s.trace2[0] == PHOSPHENE_NO_TRACE);
+    s.time_ms = 200;
+    scope_update(&s, 0, 1.5, 0, 2, 50, 0);
+    scope_update(&s, 0, 1.5, 0, 2, 100, 0);
+    assert(s.trace1[50] == 1.5f);
+
+    /* smaller plots reuse the buffers, which are cleared */
+    trace1 = s.trace1;
+    assert(scope_set_time_steps(&s, 10) == 0);
+    assert(s.trace1 == trace1);
+    assert(s.max_time_steps == 100);
+    assert(s.trace1[50] == PHOSPHENE_NO_TRACE);
+
+    assert(scope_set_time_steps(&s, PHOSPHENE_MAX_TIME_STEPS*2) == 0);
+    assert(s.max_time_steps == PHOSPHENE_MAX_TIME_STEPS);
+
+    /* the same scope can draw several plots */
+    sprintf(filename,"%stemp_plotter_scope.png",DEEPLEARN_TEMP_DIRECTORY);
+    deeplearn_history_init(&history, filename, "Scope", "Time Step",
+                           "Value");
+    COUNTUP(i, 500)
+        deeplearn_history_update(&history, i % 10);
+    COUNTUP(i, 2) {
+        remove(filename);
+        assert(deeplearn_history_phosphene_scope(&history, &s,
+                                                 128, 128) == 0);
+        fp = fopen(filename, "rb");
+        assert(fp);
+        fclose(fp);
+    }
+
+    scope_free(&s);
+    assert(s.trace1 == NULL);
+    assert(s.max_time_steps == 0);
+    deeplearn_history_free(&history);
+
+    printf("Ok\n");
+}
+
+static void test_plotter_learner()
+{
+    deeplearn learner;
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f };
+    unsigned int random_seed = 123;
+
+    printf("test_plotter_learner...");
+
+    assert(deeplearn_init(&learner, 10, 4, 2, 2, error_threshold,
+                          &random_seed) == 0);
+    assert(learner.plotting == DEEPLEARN_PLOT_ASYNC);
+
+    assert(deeplearn_set_plotting(&learner, -1) != 0);
+    assert(deeplearn_set_plotting(&learner, 3) != 0);
+    assert(learner.plotting == DEEPLEARN_PLOT_ASYNC);
+    assert(deeplearn_set_plotting(&learner, DEEPLEARN_PLOT_NONE) == 0);
+    assert(learner.plotting == DEEPLEARN_PLOT_NONE);
+    assert(deeplearn_set_plotting(&learner, DEEPLEARN_PLOT_SYNC) == 0);
+    assert(learner.plotting == DEEPLEARN_PLOT_SYNC);
+
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+int run_tests_plotter()
+{
+    printf("\nRunning plotter tests\n");
+
+    test_plotter_async();
+    test_plotter_scope();
+    test_plotter_learner();
+
+    printf("All plotter tests completed\n");
+    return 0;
+}
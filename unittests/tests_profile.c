@@ -0,0 +1,160 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tests_profile.h"
+
+static void test_profile_phases()
+{
+    printf("test_profile_phases...");
+
+    COUNTUP(p, DEEPLEARN_PHASES)
+        assert(deeplearn_phase_name(p) != NULL);
+    assert(strcmp(deeplearn_phase_name(DEEPLEARN_PHASE_FORWARD),
+                  "forward") == 0);
+    assert(strcmp(deeplearn_phase_name(DEEPLEARN_PHASE_PLOTTING),
+                  "plotting") == 0);
+    assert(deeplearn_phase_name(-1) == NULL);
+    assert(deeplearn_phase_name(DEEPLEARN_PHASES) == NULL);
+
+    printf("Ok\n");
+}
+
+static void test_profile_backprop()
+{
+    bp net;
+    deeplearn_stats stats;
+    unsigned int random_seed = 4821;
+    float inputs[10*8], targets[10*2];
+    int profiled;
+
+    printf("test_profile_backprop...");
+
+    assert(bp_init(&net, 8, 6, 2, 2, &random_seed) == 0);
+    COUNTUP(i, 8)
+        bp_set_input(&net, i, 0.2f + (i%3)*0.2f);
+    COUNTUP(i, 2)
+        bp_set_output(&net, i, 0.4f);
+    COUNTUP(i, 10*8)
+        inputs[i] = (i%5)*0.2f;
+    COUNTUP(i, 10*2)
+        targets[i] = (i%2)*0.8f;
+
+    profiled = (deeplearn_profile_enable(1) == 0);
+    deeplearn_reset_stats();
+
+    COUNTUP(i, 20)
+        bp_update(&net, 0);
+    assert(bp_update_batch(&net, inputs, targets, 10) == 0);
+
+    deeplearn_get_stats(&stats);
+    if (!profiled) {
+        /* timing is not compiled in, so nothing is recorded */
+        assert(deeplearn_profile_enabled() == 0);
+        COUNTUP(p, DEEPLEARN_PHASES) {
+            assert(stats.phase[p].calls == 0);
+            assert(stats.phase[p].nanoseconds == 0);
+        }
+    }
+    else {
+        assert(deeplearn_profile_enabled() != 0);
+        assert(stats.phase[DEEPLEARN_PHASE_FORWARD].calls == 21);
+        assert(stats.phase[DEEPLEARN_PHASE_FORWARD].samples == 30);
+        assert(stats.phase[DEEPLEARN_PHASE_BACKPROP].calls == 21);
+        assert(stats.phase[DEEPLEARN_PHASE_LEARN].calls == 21);
+        assert(stats.phase[DEEPLEARN_PHASE_LEARN].samples == 30);
+        assert(stats.phase[DEEPLEARN_PHASE_DROPOUTS].calls == 21);
+        assert(stats.phase[DEEPLEARN_PHASE_FORWARD].nanoseconds > 0);
+        assert(stats.phase[DEEPLEARN_PHASE_FORWARD].samples_per_sec > 0);
+        assert(stats.phase[DEEPLEARN_PHASE_PRETRAINING].calls == 0);
+
+        /* nothing is recorded once timing is turned off */
+        assert(deeplearn_profile_enable(0) == 0);
+        bp_update(&net, 0);
+        deeplearn_get_stats(&stats);
+        assert(stats.phase[DEEPLEARN_PHASE_FORWARD].calls == 21);
+
+        deeplearn_reset_stats();
+        deeplearn_get_stats(&stats);
+        COUNTUP(p, DEEPLEARN_PHASES) {
+            assert(stats.phase[p].calls == 0);
+            assert(stats.phase[p].samples_per_sec == 0);
+        }
+    }
+
+    deeplearn_profile_enable(0);
+    bp_free(&net);
+
+    printf("Ok\n");
+}
+
+static void test_profile_deeplearn()
+{
+    deeplearn learner;
+    deeplearn_stats stats;
+    unsigned int random_seed = 3719;
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f };
+
+    printf("test_profile_deeplearn...");
+
+    assert(deeplearn_init(&learner, 10, 8, 2, 3, error_threshold,
+                          &random_seed) == 0);
+    COUNTUP(i, 10)
+        deeplearn_set_input(&learner, i, 0.25f + (i%2)*0.5f);
+
+    if (deeplearn_profile_enable(1) == 0) {
+        deeplearn_reset_stats();
+
+        /* the first hidden layer is pretrained by its autocoder */
+        COUNTUP(i, 5)
+            deeplearn_update(&learner);
+        assert(learner.current_hidden_layer == 0);
+
+        deeplearn_get_stats(&stats);
+        assert(stats.phase[DEEPLEARN_PHASE_PRETRAINING].calls == 5);
+        assert(stats.phase[DEEPLEARN_PHASE_PRETRAINING].samples == 5);
+        assert(stats.phase[DEEPLEARN_PHASE_FORWARD].calls == 0);
+        deeplearn_profile_enable(0);
+    }
+
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+int run_tests_profile()
+{
+    printf("\nRunning profile tests\n");
+
+    test_profile_phases();
+    test_profile_backprop();
+    test_profile_deeplearn();
+
+    printf("All profile tests completed\n");
+    return 0;
+}
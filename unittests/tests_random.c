@@ -93,11 +93,149 @@ static void test_rand_num()
     printf("Ok\n");
 }
 
+static void test_rand_jump()
+{
+    unsigned int seed0, seed1;
+    rand_stream streams[4];
+    rand_stream streams2[4];
+
+    printf("test_rand_jump...");
+
+    /* jumping ahead should match stepping the generator */
+    for (unsigned int steps = 0; steps < 200; steps += 7) {
+        seed0 = 7392;
+        seed1 = 7392;
+        for (int i = 0; i < steps; i++)
+            rand_num(&seed0);
+        rand_jump(&seed1, steps);
+        assert(seed0 == seed1);
+    }
+
+    /* including from a seed at the singularity */
+    seed0 = 4294967291U;
+    seed1 = 4294967291U;
+    for (int i = 0; i < 10; i++)
+        rand_num(&seed0);
+    rand_jump(&seed1, 10);
+    assert(seed0 == seed1);
+
+    /* streams are spaced along the sequence */
+    rand_streams_init(streams, 4, 123);
+    seed0 = 123;
+    for (int i = 0; i < 4; i++) {
+        rand_jump(&seed0, RAND_STREAM_SPACING);
+        assert(streams[i].seed == seed0);
+    }
+    assert(streams[0].seed != streams[1].seed);
+    assert(sizeof(rand_stream) == RAND_STREAM_CACHE_LINE);
+
+    /* the same seed gives the same streams */
+    rand_streams_init(streams2, 4, 123);
+    for (int i = 0; i < 4; i++)
+        assert(streams2[i].seed == streams[i].seed);
+
+    printf("Ok\n");
+}
+
+static void test_rand_noise()
+{
+    float values[1003], values2[1003];
+    float mean = 0, min_value = 1, max_value = -1;
+    unsigned int seed0 = 6301, seed1 = 6301;
+
+    printf("test_rand_noise...");
+
+    rand_noise(&seed0, values, 1003, 0.25f);
+    rand_noise(&seed1, values2, 1003, 0.25f);
+    assert(seed0 == seed1);
+
+    for (int i = 0; i < 1003; i++) {
+        /* the same seed gives the same noise */
+        assert(values[i] == values2[i]);
+
+        assert(values[i] >= -0.25f);
+        assert(values[i] < 0.25f);
+        if (values[i] < min_value) min_value = values[i];
+        if (values[i] > max_value) max_value = values[i];
+        mean += values[i];
+    }
+    mean /= 1003;
+
+    /* roughly uniform about zero */
+    assert(fabs(mean) < 0.02f);
+    assert(min_value < -0.2f);
+    assert(max_value > 0.2f);
+
+    /* the seed advances */
+    rand_noise(&seed0, values2, 1003, 0.25f);
+    assert(values2[0] != values[0]);
+
+    printf("Ok\n");
+}
+
+static void test_rand_mask()
+{
+    unsigned int mask[40], mask2[40];
+    unsigned int threshold;
+    int set = 0, ranges[7] = { 0 };
+
+    printf("test_rand_mask...");
+
+    assert(rand_mask_threshold(0) == 0);
+    assert(rand_mask_threshold(RAND_MASK_RANGE) == 0xffffffffU);
+    assert(rand_mask_threshold(RAND_MASK_RANGE/2) == 0x80000000U);
+
+    /* the value at any position can be calculated directly */
+    assert(rand_counter(6301, 5) == rand_counter(6301, 5));
+    assert(rand_counter(6301, 5) != rand_counter(6301, 6));
+    assert(rand_counter(6301, 5) != rand_counter(6302, 5));
+
+    /* each bit agrees with the counter based number at its position */
+    threshold = rand_mask_threshold(2000);
+    rand_mask(6301, 100, mask, 40*RAND_MASK_BITS - 5, threshold);
+    for (int j = 0; j < 40*RAND_MASK_BITS - 5; j++) {
+        int bit = (mask[j/RAND_MASK_BITS] >> (j%RAND_MASK_BITS)) & 1;
+        assert(bit == (rand_counter(6301, 100 + j) >= threshold));
+        set += bit;
+    }
+
+    /* roughly the given proportion of bits are cleared */
+    assert(set > (40*RAND_MASK_BITS - 5)*0.75f);
+    assert(set < (40*RAND_MASK_BITS - 5)*0.85f);
+
+    /* a mask may be generated in pieces */
+    rand_mask(6301, 100 + 8*RAND_MASK_BITS, mask2, 3*RAND_MASK_BITS,
+              threshold);
+    for (int w = 0; w < 3; w++)
+        assert(mask2[w] == mask[8 + w]);
+
+    /* nothing drops out with a threshold of zero */
+    rand_mask(6301, 0, mask, 40*RAND_MASK_BITS, rand_mask_threshold(0));
+    for (int w = 0; w < 40; w++)
+        assert(mask[w] == 0xffffffffU);
+
+    /* values within a range */
+    for (unsigned int i = 0; i < 7000; i++) {
+        unsigned int v = rand_range(3, i, 7);
+        assert(v < 7);
+        ranges[v]++;
+    }
+    for (int i = 0; i < 7; i++) {
+        assert(ranges[i] > 800);
+        assert(ranges[i] < 1200);
+    }
+
+    printf("Ok\n");
+}
+
 int run_tests_random()
 {
     printf("\nRunning random number generator tests\n");
 
     test_rand_num();
+    test_rand_jump();
+    test_rand_noise();
+    test_rand_mask();
 
     printf("All random number generator tests completed\n");
     return 0;
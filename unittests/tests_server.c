@@ -0,0 +1,220 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tests_server.h"
+
+#define SERVER_TEST_INPUTS   6
+#define SERVER_TEST_OUTPUTS  2
+#define SERVER_TEST_CLIENTS  4
+#define SERVER_TEST_REQUESTS 25
+
+static char server_test_path[256];
+
+/**
+ * @brief Creates a learner with known input and output ranges
+ */
+static void server_test_learner(deeplearn * learner,
+                                unsigned int * random_seed)
+{
+    float error_threshold[] = { 0.01f, 0.01f, 0.01f };
+
+    assert(deeplearn_init(learner,
+                          SERVER_TEST_INPUTS, 5, 2,
+                          SERVER_TEST_OUTPUTS,
+                          error_threshold,
+                          random_seed) == 0);
+
+    COUNTUP(i, SERVER_TEST_INPUTS) {
+        learner->input_range_min[i] = 0;
+        learner->input_range_max[i] = 10;
+    }
+    COUNTUP(i, SERVER_TEST_OUTPUTS) {
+        learner->output_range_min[i] = -1;
+        learner->output_range_max[i] = 1;
+    }
+}
+
+/**
+ * @brief Returns the outputs which the server should give for samples
+ */
+static void server_test_expected(deeplearn * learner, const float * inputs,
+                                 int samples, float * outputs)
+{
+    float * normalised =
+        (float*)malloc(samples*SERVER_TEST_INPUTS*sizeof(float));
+
+    assert(normalised);
+    COUNTUP(i, samples*SERVER_TEST_INPUTS)
+        normalised[i] = (inputs[i]/10.0f)*NEURON_RANGE + NEURON_LOW;
+    assert(deeplearn_feed_forward_batch(learner, normalised, samples,
+                                        outputs) == 0);
+    COUNTUP(i, samples*SERVER_TEST_OUTPUTS)
+        outputs[i] = ((outputs[i] - NEURON_LOW)/NEURON_RANGE)*2 - 1;
+    free(normalised);
+}
+
+/**
+ * @brief A client which sends many single sample requests
+ */
+static void * server_test_client(void * arg)
+{
+    unsigned int random_seed = *(unsigned int*)arg;
+    deeplearn_server_client client;
+    float inputs[SERVER_TEST_INPUTS];
+    float outputs[SERVER_TEST_OUTPUTS];
+
+    assert(deeplearn_server_connect_unix(&client, server_test_path) == 0);
+    COUNTUP(r, SERVER_TEST_REQUESTS) {
+        COUNTUP(i, SERVER_TEST_INPUTS)
+            inputs[i] = (rand_num(&random_seed)%1000)/100.0f;
+        assert(deeplearn_server_predict(&client, inputs, 1, outputs) == 0);
+        COUNTUP(i, SERVER_TEST_OUTPUTS)
+            assert((outputs[i] >= -1) && (outputs[i] <= 1));
+    }
+    deeplearn_server_disconnect(&client);
+    return NULL;
+}
+
+static void test_server_unix()
+{
+    deeplearn learner;
+    deeplearn_server server;
+    deeplearn_server_client client;
+    deeplearn_server_stats stats;
+    pthread_t threads[SERVER_TEST_CLIENTS];
+    unsigned int seeds[SERVER_TEST_CLIENTS];
+    unsigned int random_seed = 2783;
+    int samples = 20;
+    float inputs[20*SERVER_TEST_INPUTS];
+    float outputs[20*SERVER_TEST_OUTPUTS];
+    float expected[20*SERVER_TEST_OUTPUTS];
+
+    printf("test_server_unix...");
+
+    sprintf(server_test_path, "%slibdeep_server.sock",
+            DEEPLEARN_TEMP_DIRECTORY);
+
+    server_test_learner(&learner, &random_seed);
+    assert(deeplearn_server_init(&server, &learner, 0, 1000) != 0);
+    assert(deeplearn_server_init(&server, &learner, 8, 2000) == 0);
+    assert(deeplearn_server_start_unix(&server, server_test_path) == 0);
+
+    assert(deeplearn_server_connect_unix(&client, server_test_path) == 0);
+    assert(client.no_of_inputs == SERVER_TEST_INPUTS);
+    assert(client.no_of_outputs == SERVER_TEST_OUTPUTS);
+
+    /* larger than a batch, so it is run on its own */
+    COUNTUP(i, samples*SERVER_TEST_INPUTS)
+        inputs[i] = (rand_num(&random_seed)%1000)/100.0f;
+    server_test_expected(&learner, inputs, samples, expected);
+    assert(deeplearn_server_predict(&client, inputs, samples,
+                                    outputs) == 0);
+    COUNTUP(i, samples*SERVER_TEST_OUTPUTS)
+        assert(fabs(outputs[i] - expected[i]) < 0.0001f);
+
+    /* concurrent requests get batched together */
+    COUNTUP(t, SERVER_TEST_CLIENTS) {
+        seeds[t] = 100 + t;
+        assert(pthread_create(&threads[t], NULL, server_test_client,
+                              &seeds[t]) == 0);
+    }
+    COUNTUP(t, SERVER_TEST_CLIENTS)
+        pthread_join(threads[t], NULL);
+
+    deeplearn_server_get_stats(&server, &stats);
+    assert(stats.requests == 1 + SERVER_TEST_CLIENTS*SERVER_TEST_REQUESTS);
+    assert(stats.samples ==
+           (unsigned long)(samples +
+                           SERVER_TEST_CLIENTS*SERVER_TEST_REQUESTS));
+    assert(stats.failed == 0);
+    assert(stats.batches >= 1);
+    assert(stats.batches <= stats.requests);
+    assert(stats.max_latency > 0);
+    assert(stats.total_latency >= stats.max_latency);
+    assert(stats.uptime > 0);
+
+    /* invalid sample counts are refused */
+    assert(deeplearn_server_predict(&client, inputs, 0, outputs) != 0);
+    deeplearn_server_disconnect(&client);
+
+    deeplearn_server_free(&server);
+    assert(deeplearn_server_connect_unix(&client, server_test_path) != 0);
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+static void test_server_tcp()
+{
+    deeplearn learner;
+    deeplearn_server server;
+    deeplearn_server_client client;
+    unsigned int random_seed = 612;
+    float inputs[3*SERVER_TEST_INPUTS];
+    float outputs[3*SERVER_TEST_OUTPUTS];
+    float expected[3*SERVER_TEST_OUTPUTS];
+
+    printf("test_server_tcp...");
+
+    server_test_learner(&learner, &random_seed);
+    assert(deeplearn_server_init(&server, &learner, 16, 0) == 0);
+    assert(deeplearn_server_start_tcp(&server, 0) == 0);
+    assert(server.port > 0);
+    assert(deeplearn_server_start_tcp(&server, 0) != 0);
+
+    assert(deeplearn_server_connect_tcp(&client, "127.0.0.1",
+                                        server.port) == 0);
+    COUNTUP(i, 3*SERVER_TEST_INPUTS)
+        inputs[i] = (rand_num(&random_seed)%1000)/100.0f;
+    server_test_expected(&learner, inputs, 3, expected);
+    assert(deeplearn_server_predict(&client, inputs, 3, outputs) == 0);
+    COUNTUP(i, 3*SERVER_TEST_OUTPUTS)
+        assert(fabs(outputs[i] - expected[i]) < 0.0001f);
+
+    /* clients which are still connected are dropped when stopping */
+    deeplearn_server_stop(&server);
+    assert(deeplearn_server_predict(&client, inputs, 3, outputs) != 0);
+    deeplearn_server_disconnect(&client);
+
+    deeplearn_server_free(&server);
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+int run_tests_server()
+{
+    printf("\nRunning server tests\n");
+
+    test_server_unix();
+    test_server_tcp();
+
+    printf("All server tests completed\n");
+    return 1;
+}
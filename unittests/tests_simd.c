@@ -0,0 +1,171 @@
+/*
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tests_simd.h"
+
+static void test_simd_kernels()
+{
+    const int lengths[] = { 1, 3, 8, 15, 16, 17, 33, 100 };
+    int level, initial_level;
+    unsigned int random_seed = 2847;
+
+    printf("test_simd_kernels...");
+
+    initial_level = deeplearn_simd_level();
+    assert(deeplearn_simd_supported(initial_level));
+    assert(deeplearn_simd_supported(DEEPLEARN_SIMD_SCALAR));
+    assert(deeplearn_simd_select(-1) == -1);
+
+    for (level = DEEPLEARN_SIMD_AVX2; level <= DEEPLEARN_SIMD_NEON; level++) {
+        if (!deeplearn_simd_supported(level))
+            continue;
+
+        for (int t = 0; t < (int)(sizeof(lengths)/sizeof(int)); t++) {
+            int n = lengths[t];
+            float a[100], b[100];
+            float y0[100], y1[100];
+            float w0[100], w1[100], dw0[100], dw1[100];
+            float dot0, dot1;
+            signed char qa[100], qb[100];
+            int qdot0, qdot1;
+            unsigned int mask[4], cmask0[4], cmask1[4];
+            unsigned int threshold = rand_num(&random_seed);
+            float mdot0, mdot1, mdot = 0;
+
+            for (int j = 0; j < n; j++) {
+                a[j] = (rand_num(&random_seed)%20000/10000.0f) - 1.0f;
+                b[j] = (rand_num(&random_seed)%20000/10000.0f) - 1.0f;
+                y0[j] = y1[j] = (rand_num(&random_seed)%20000/10000.0f) - 1.0f;
+                /* include some weights close to the clipping limits */
+                w0[j] = w1[j] = (rand_num(&random_seed)%40000/10000.0f) - 2.0f;
+                dw0[j] = dw1[j] = (rand_num(&random_seed)%2000/10000.0f) - 0.1f;
+                qa[j] = (signed char)((int)(rand_num(&random_seed)%255) - 127);
+                qb[j] = (signed char)((int)(rand_num(&random_seed)%255) - 127);
+            }
+            for (int j = 0; j < 4; j++)
+                mask[j] = rand_num(&random_seed) ^
+                    (rand_num(&random_seed) << 16);
+            for (int j = 0; j < n; j++)
+                if ((mask[j/32] >> (j%32)) & 1)
+                    mdot += a[j] * b[j];
+
+            assert(deeplearn_simd_select(DEEPLEARN_SIMD_SCALAR) == 0);
+            dot0 = deeplearn_dot(a, b, n);
+            deeplearn_axpy(y0, 0.3f, a, n);
+            deeplearn_weight_update(w0, dw0, b, 0.5f, n);
+            qdot0 = deeplearn_dot_int8(qa, qb, n);
+            mdot0 = deeplearn_dot_masked(a, b, mask, n);
+            deeplearn_counter_mask(rand_mix(n), n*77, cmask0, 4, threshold);
+
+            assert(deeplearn_simd_select(level) == 0);
+            assert(deeplearn_simd_level() == level);
+            dot1 = deeplearn_dot(a, b, n);
+            deeplearn_axpy(y1, 0.3f, a, n);
+            deeplearn_weight_update(w1, dw1, b, 0.5f, n);
+            qdot1 = deeplearn_dot_int8(qa, qb, n);
+            mdot1 = deeplearn_dot_masked(a, b, mask, n);
+            deeplearn_counter_mask(rand_mix(n), n*77, cmask1, 4, threshold);
+
+            assert(fabs(dot0 - dot1) < 0.0001f);
+            assert(fabs(mdot0 - mdot) < 0.0001f);
+            assert(fabs(mdot1 - mdot) < 0.0001f);
+            for (int j = 0; j < 4; j++)
+                assert(cmask0[j] == cmask1[j]);
+            assert(qdot0 == qdot1);
+            for (int j = 0; j < n; j++) {
+                assert(fabs(y0[j] - y1[j]) < 0.00001f);
+                assert(fabs(dw0[j] - dw1[j]) < 0.00001f);
+                assert(fabs(w0[j] - w1[j]) < 0.00001f);
+                assert(w1[j] >= -2.0f);
+                assert(w1[j] <= 2.0f);
+            }
+        }
+    }
+
+    /* restore the automatically selected kernels */
+    assert(deeplearn_simd_select(initial_level) == 0);
+
+    printf("Ok\n");
+}
+
+static void test_simd_bf16()
+{
+    const int lengths[] = { 1, 7, 8, 16, 17, 100 };
+    int level, initial_level;
+    unsigned int random_seed = 5723;
+    unsigned short h[100];
+    float a[100], b[100];
+
+    printf("test_simd_bf16...");
+
+    /* values with few mantissa bits are exact */
+    assert(deeplearn_bf16_to_float(deeplearn_float_to_bf16(1.0f)) == 1.0f);
+    assert(deeplearn_bf16_to_float(deeplearn_float_to_bf16(-0.375f)) ==
+           -0.375f);
+    assert(deeplearn_bf16_to_float(deeplearn_float_to_bf16(0)) == 0);
+
+    /* otherwise rounded to within the precision of eight bits */
+    for (int j = 0; j < 100; j++) {
+        a[j] = (rand_num(&random_seed)%40000/10000.0f) - 2.0f;
+        b[j] = (rand_num(&random_seed)%20000/10000.0f) - 1.0f;
+        assert(fabs(deeplearn_bf16_to_float(deeplearn_float_to_bf16(a[j])) -
+                    a[j]) <= fabs(a[j])/256.0f);
+    }
+    deeplearn_bf16_encode(h, a, 100);
+
+    initial_level = deeplearn_simd_level();
+    for (level = DEEPLEARN_SIMD_SCALAR; level <= DEEPLEARN_SIMD_NEON;
+         level++) {
+        if (!deeplearn_simd_supported(level))
+            continue;
+
+        assert(deeplearn_simd_select(level) == 0);
+        for (int t = 0; t < (int)(sizeof(lengths)/sizeof(int)); t++) {
+            int n = lengths[t];
+            float expected = 0;
+
+            for (int j = 0; j < n; j++)
+                expected += deeplearn_bf16_to_float(h[j]) * b[j];
+            assert(fabs(deeplearn_dot_bf16(h, b, n) - expected) < 0.0001f);
+        }
+    }
+    assert(deeplearn_simd_select(initial_level) == 0);
+
+    printf("Ok\n");
+}
+
+int run_tests_simd()
+{
+    printf("\nRunning SIMD kernel tests\n");
+
+    test_simd_kernels();
+    test_simd_bf16();
+
+    printf("All SIMD kernel tests completed\n");
+    return 0;
+}
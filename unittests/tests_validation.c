@@ -0,0 +1,178 @@
+/*
+ libdeep - a library for deep learning
+ Copyright (C) 2013-2017  Bob Mottram <bob@freedombone.net>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tests_validation.h"
+
+/* size of a team started from within training, and the number of
+   times that training reported a change of weights to the backend */
+static int training_team, training_updates;
+
+static void test_weights_changed(const float * weights)
+{
+    int team = 0;
+
+#pragma omp parallel num_threads(2)
+    {
+#pragma omp master
+        team = omp_get_num_threads();
+    }
+
+    if ((training_updates == 0) || (team < training_team))
+        training_team = team;
+    training_updates++;
+}
+
+static const deeplearn_backend test_backend = {
+    "test", NULL, NULL, test_weights_changed, NULL,
+    NULL, NULL, NULL, NULL, NULL
+};
+
+static void test_validation_threads()
+{
+    deeplearn learner;
+    deeplearn_validation validation;
+    int output_field_index[] = { 3 };
+    float error_threshold[] = { 0.01f, 0.01f };
+    unsigned int random_seed = 7290;
+    char filename[256];
+    FILE * fp;
+    int i;
+
+    printf("test_validation_threads...");
+
+    sprintf(filename,"%slibdeep_validation_threads.csv",
+            DEEPLEARN_TEMP_DIRECTORY);
+    fp = fopen(filename, "w");
+    assert(fp);
+    for (i = 0; i < 100; i++)
+        fprintf(fp,"%f,%f,%f,%f\n",
+                (float)(i%5), (float)(i%7), (float)(i%3),
+                (float)((i%5) + (i%3)));
+    fclose(fp);
+
+    assert(deeplearndata_read_csv(filename, &learner, 8, 1, 1,
+                                  output_field_index, 0,
+                                  error_threshold, &random_seed) == 100);
+    learner.history.interval = 1000000;
+    assert(deeplearn_validation_init(&validation, &learner, 50, 1000) == 0);
+
+    for (i = 0; (i < 2000) && (!validation.pending); i++)
+        assert(deeplearn_validation_update(&validation) > 0);
+    assert(validation.pending);
+
+    /* training while a snapshot is validated is not nested within
+       another parallel region, so it can still start a team */
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_OPENCL,
+                                      &test_backend) == 0);
+    assert(deeplearn_backend_select(DEEPLEARN_BACKEND_OPENCL) == 0);
+    training_updates = 0;
+    assert(deeplearn_validation_update(&validation) > 0);
+    assert(training_updates > 0);
+    assert(training_team == 2);
+    assert(deeplearn_backend_register(DEEPLEARN_BACKEND_OPENCL, NULL) == 0);
+
+    assert(validation.validations == 1);
+
+    deeplearn_validation_free(&validation);
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+static void test_validation_early_stopping()
+{
+    deeplearn learner;
+    deeplearn_validation validation;
+    int output_field_index[] = { 3 };
+    float error_threshold[] = { 0.01f, 0.01f };
+    unsigned int random_seed = 5713;
+    char filename[256];
+    FILE * fp;
+    int i, retval = 1;
+
+    printf("test_validation_early_stopping...");
+
+    sprintf(filename,"%slibdeep_validation.csv",DEEPLEARN_TEMP_DIRECTORY);
+    fp = fopen(filename, "w");
+    assert(fp);
+    for (i = 0; i < 100; i++)
+        fprintf(fp,"%f,%f,%f,%f\n",
+                (float)(i%5), (float)(i%7), (float)(i%3),
+                (float)((i%5) + (i%3)));
+    fclose(fp);
+
+    assert(deeplearndata_read_csv(filename, &learner, 8, 1, 1,
+                                  output_field_index, 0,
+                                  error_threshold, &random_seed) == 100);
+    learner.history.interval = 1000000;
+    assert(learner.test_data_samples > 0);
+
+    assert(deeplearn_validation_init(&validation, &learner, 0, 3) == -1);
+    assert(deeplearn_validation_init(&validation, &learner, 100, 0) == -1);
+    assert(deeplearn_validation_init(&validation, &learner, 500, 5) == 0);
+
+    /* nothing to restore before the first validation */
+    assert(deeplearn_validation_restore_best(&validation) == -1);
+
+    for (i = 0; (i < 2000) && (retval > 0); i++) {
+        retval = deeplearn_validation_update(&validation);
+        assert(retval >= 0);
+    }
+
+    /* training stops once it no longer improves upon the best snapshot */
+    assert(retval == 0);
+    assert(validation.stopped == 1);
+    assert(validation.since_best == 5);
+    assert(validation.validations > 5);
+    assert(learner.training_complete == 1);
+    assert(deeplearndata_training(&learner) == 0);
+    assert(deeplearn_validation_update(&validation) == 0);
+
+    /* and the best weights can be recovered */
+    assert(deeplearn_validation_finish(&validation) == 0);
+    assert(deeplearn_validation_restore_best(&validation) == 0);
+    assert(fabs(deeplearndata_get_performance(&learner) -
+                validation.best_performance) < 0.0001f);
+
+    deeplearn_validation_free(&validation);
+    deeplearn_free(&learner);
+
+    printf("Ok\n");
+}
+
+int run_tests_validation()
+{
+    printf("\nRunning validation tests\n");
+
+    test_validation_early_stopping();
+    test_validation_threads();
+
+    printf("All validation tests completed\n");
+    return 0;
+}